@@ -55,12 +55,14 @@ def amalgamate_source(source_top_dir=None,
                        header_include_path=None,
                        include_xml=True,
                        custom_namespace=None,
-                       define_curl=True):
+                       define_curl=True,
+                       drivers=("s3", "google", "dropbox")):
     """Produces amalgamated source.
        Parameters:
            source_top_dir: top-directory
            target_source_path: output .cpp path
            header_include_path: generated header path relative to target_source_path.
+           drivers: optional drivers to include, of s3, google, and dropbox
     """
 
     gitsha = None
@@ -113,30 +115,76 @@ def amalgamate_source(source_top_dir=None,
     else:
         print "NOT #defining ARBITER_CURL"
 
+    for driver in ("s3", "google", "dropbox"):
+        if driver not in drivers:
+            print("NOT bundling the %s driver" % driver)
+            header.add_text("#define ARBITER_NO_%s" % driver.upper())
+
     header.add_file("arbiter/third/json/json.hpp")
     header.add_file("arbiter/util/exports.hpp")
+    header.add_file("arbiter/util/probes.hpp")
     header.add_file("arbiter/util/types.hpp")
     header.add_file("arbiter/util/json.hpp")
+    header.add_file("arbiter/util/affinity.hpp")
+    header.add_file("arbiter/util/blocks.hpp")
+    header.add_file("arbiter/util/budget.hpp")
+    header.add_file("arbiter/util/buffers.hpp")
+    header.add_file("arbiter/util/cancel.hpp")
+    header.add_file("arbiter/util/priority.hpp")
+    header.add_file("arbiter/util/progress.hpp")
+    header.add_file("arbiter/util/rate.hpp")
     header.add_file("arbiter/util/curl.hpp")
+    header.add_file("arbiter/util/executor.hpp")
+    header.add_file("arbiter/util/flight.hpp")
+    header.add_file("arbiter/util/glob.hpp")
+    header.add_file("arbiter/util/paths.hpp")
+    header.add_file("arbiter/util/slowlog.hpp")
     header.add_file("arbiter/util/http.hpp")
     header.add_file("arbiter/util/ini.hpp")
+    header.add_file("arbiter/util/log.hpp")
     header.add_file("arbiter/util/time.hpp")
+    header.add_file("arbiter/util/trace.hpp")
+    header.add_file("arbiter/util/record.hpp")
     header.add_file("arbiter/util/macros.hpp")
+    header.add_file("arbiter/util/crc32c.hpp")
     header.add_file("arbiter/util/md5.hpp")
+    header.add_file("arbiter/util/metrics.hpp")
+    header.add_file("arbiter/util/prefetch.hpp")
     header.add_file("arbiter/util/sha256.hpp")
+    header.add_file("arbiter/util/credentials.hpp")
+    header.add_file("arbiter/util/streambuf.hpp")
+    header.add_file("arbiter/util/transfer.hpp")
+    header.add_file("arbiter/util/runtime.hpp")
     header.add_file("arbiter/util/transforms.hpp")
+    header.add_file("arbiter/util/iocp.hpp")
+    header.add_file("arbiter/util/uring.hpp")
     header.add_file("arbiter/util/util.hpp")
+    header.add_file("arbiter/util/spool.hpp")
+    header.add_file("arbiter/util/writebehind.hpp")
 
     header.add_file("arbiter/driver.hpp")
     header.add_file("arbiter/drivers/fs.hpp")
     header.add_file("arbiter/drivers/http.hpp")
 
-    header.add_file("arbiter/drivers/s3.hpp")
-    header.add_file("arbiter/drivers/google.hpp")
-    header.add_file("arbiter/drivers/dropbox.hpp")
+    for driver in ("s3", "google", "dropbox"):
+        if driver in drivers:
+            header.add_file("arbiter/drivers/%s.hpp" % driver)
     header.add_file("arbiter/drivers/test.hpp")
+    header.add_file("arbiter/drivers/memory.hpp")
+    header.add_file("arbiter/drivers/cache.hpp")
+    header.add_file("arbiter/drivers/compressed.hpp")
+    header.add_file("arbiter/drivers/archive.hpp")
+    header.add_file("arbiter/drivers/metadata.hpp")
+    header.add_file("arbiter/drivers/listing.hpp")
+    header.add_file("arbiter/drivers/shard.hpp")
+    header.add_file("arbiter/drivers/replica.hpp")
+    header.add_file("arbiter/drivers/cas.hpp")
     header.add_file("arbiter/endpoint.hpp")
+    header.add_file("arbiter/drivers/pack.hpp")
+    header.add_file("arbiter/drivers/sidecar.hpp")
     header.add_file("arbiter/arbiter.hpp")
+    header.add_file("arbiter/sidecar.hpp")
+    header.add_file("arbiter/replay.hpp")
 
     target_header_path = os.path.join(os.path.dirname(target_source_path), header_include_path)
     print("Writing amalgamated header to %r" % target_header_path)
@@ -158,19 +206,58 @@ def amalgamate_source(source_top_dir=None,
     source.add_file("arbiter/arbiter.cpp")
     source.add_file("arbiter/driver.cpp")
     source.add_file("arbiter/endpoint.cpp")
+    source.add_file("arbiter/sidecar.cpp")
+    source.add_file("arbiter/replay.cpp")
     source.add_file("arbiter/drivers/fs.cpp")
     source.add_file("arbiter/drivers/http.cpp")
-    source.add_file("arbiter/drivers/s3.cpp")
-    source.add_file("arbiter/drivers/google.cpp")
-    source.add_file("arbiter/drivers/dropbox.cpp")
+    for driver in ("s3", "google", "dropbox"):
+        if driver in drivers:
+            source.add_file("arbiter/drivers/%s.cpp" % driver)
+    source.add_file("arbiter/drivers/memory.cpp")
+    source.add_file("arbiter/drivers/cache.cpp")
+    source.add_file("arbiter/drivers/compressed.cpp")
+    source.add_file("arbiter/drivers/archive.cpp")
+    source.add_file("arbiter/drivers/metadata.cpp")
+    source.add_file("arbiter/drivers/listing.cpp")
+    source.add_file("arbiter/drivers/shard.cpp")
+    source.add_file("arbiter/drivers/replica.cpp")
+    source.add_file("arbiter/drivers/cas.cpp")
+    source.add_file("arbiter/drivers/pack.cpp")
+    source.add_file("arbiter/drivers/sidecar.cpp")
+    source.add_file("arbiter/util/affinity.cpp")
+    source.add_file("arbiter/util/blocks.cpp")
+    source.add_file("arbiter/util/budget.cpp")
+    source.add_file("arbiter/util/buffers.cpp")
+    source.add_file("arbiter/util/cancel.cpp")
+    source.add_file("arbiter/util/crc32c.cpp")
+    source.add_file("arbiter/util/credentials.cpp")
     source.add_file("arbiter/util/curl.cpp")
+    source.add_file("arbiter/util/executor.cpp")
+    source.add_file("arbiter/util/glob.cpp")
     source.add_file("arbiter/util/http.cpp")
     source.add_file("arbiter/util/ini.cpp")
+    source.add_file("arbiter/util/log.cpp")
     source.add_file("arbiter/util/md5.cpp")
+    source.add_file("arbiter/util/metrics.cpp")
+    source.add_file("arbiter/util/paths.cpp")
+    source.add_file("arbiter/util/prefetch.cpp")
+    source.add_file("arbiter/util/priority.cpp")
+    source.add_file("arbiter/util/progress.cpp")
+    source.add_file("arbiter/util/rate.cpp")
+    source.add_file("arbiter/util/record.cpp")
+    source.add_file("arbiter/util/runtime.cpp")
     source.add_file("arbiter/util/sha256.cpp")
+    source.add_file("arbiter/util/slowlog.cpp")
+    source.add_file("arbiter/util/spool.cpp")
+    source.add_file("arbiter/util/streambuf.cpp")
+    source.add_file("arbiter/util/transfer.cpp")
     source.add_file("arbiter/util/transforms.cpp")
     source.add_file("arbiter/util/time.cpp")
+    source.add_file("arbiter/util/trace.cpp")
+    source.add_file("arbiter/util/iocp.cpp")
+    source.add_file("arbiter/util/uring.cpp")
     source.add_file("arbiter/util/util.cpp")
+    source.add_file("arbiter/util/writebehind.cpp")
 
     print("Writing amalgamated source to %r" % target_source_path)
     source.write_to(target_source_path)
@@ -222,6 +309,13 @@ Generate a single amalgamated source and header file from the sources.
             action="store",
             default=None)
 
+    parser.add_option(
+            "-n", "--no-driver",
+            dest="excluded_drivers",
+            action="append",
+            default=[],
+            help="""Leave out an optional driver, one of s3, google, or dropbox.  May be repeated.""")
+
     parser.enable_interspersed_args()
     options, args = parser.parse_args()
 
@@ -230,7 +324,9 @@ Generate a single amalgamated source and header file from the sources.
                              header_include_path=options.header_include_path,
                              include_xml=options.include_xml,
                              custom_namespace=options.custom_namespace,
-                             define_curl=options.define_curl)
+                             define_curl=options.define_curl,
+                             drivers=[d for d in ("s3", "google", "dropbox")
+                                      if d not in options.excluded_drivers])
     if msg:
         sys.stderr.write(msg + "\n")
         sys.exit(1)
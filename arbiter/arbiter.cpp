@@ -2,6 +2,7 @@
 #include <arbiter/arbiter.hpp>
 
 #include <arbiter/driver.hpp>
+#include <arbiter/util/md5.hpp>
 #include <arbiter/util/sha256.hpp>
 #include <arbiter/util/json.hpp>
 #include <arbiter/util/transforms.hpp>
@@ -9,8 +10,16 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
 #include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
@@ -24,10 +33,10 @@ namespace
 {
     const std::string delimiter("://");
 
-#ifdef ARBITER_CURL
-    const std::size_t concurrentHttpReqs(32);
-    const std::size_t httpRetryCount(8);
-#endif
+    const std::size_t defaultRangeGap(64 * 1024);
+
+    // Copies within a remote driver are handed to it this many at a time.
+    const std::size_t copyBatchSize(1000);
 
     json getConfig(const std::string& s)
     {
@@ -46,379 +55,2270 @@ namespace
 
         return merge(in, config);
     }
+
+    // Take the contents of @p data, which is only copied if other callers
+    // share it.
+    std::vector<char> takeShared(std::shared_ptr<std::vector<char>>& data)
+    {
+        if (data.use_count() == 1) return std::move(*data);
+        return *data;
+    }
+
+    // Parse a `Range` header for a single bounded range, if that is all that
+    // @p headers holds, into its @p offset and @p length.
+    bool getBoundedRange(
+            const http::Headers& headers,
+            std::size_t& offset,
+            std::size_t& length)
+    {
+        if (headers.size() != 1) return false;
+
+        std::string name(headers.begin()->first);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name != "range") return false;
+
+        const std::string& v(headers.begin()->second);
+        const std::string prefix("bytes=");
+        if (v.compare(0, prefix.size(), prefix)) return false;
+
+        const std::size_t dash(v.find('-', prefix.size()));
+        if (dash == std::string::npos || dash == prefix.size()) return false;
+
+        const std::string a(v.substr(prefix.size(), dash - prefix.size()));
+        const std::string b(v.substr(dash + 1));
+        const std::string digits("0123456789");
+        if (b.empty() || a.find_first_not_of(digits) != std::string::npos ||
+                b.find_first_not_of(digits) != std::string::npos)
+        {
+            return false;
+        }
+
+        const std::size_t first(std::stoull(a));
+        const std::size_t last(std::stoull(b));
+        if (last < first) return false;
+
+        offset = first;
+        length = last - first + 1;
+        return true;
+    }
+
+    // The longest that the completion of a file by Arbiter::copyResumable
+    // goes unrecorded.
+    const std::chrono::seconds journalInterval(5);
+
+    // True if @p dst is an up to date copy of @p src, judging by the
+    // metadata of their listings.
+    bool isCurrent(const FileInfo& src, const FileInfo& dst, bool sameType)
+    {
+        if (!src.hasSize || !dst.hasSize || src.size != dst.size) return false;
+
+        if (sameType && src.version.size() && src.version == dst.version)
+        {
+            return true;
+        }
+
+        return src.modified && dst.modified && dst.modified >= src.modified;
+    }
+
+    // True if the local file @p local has the contents given by the S3 ETag
+    // of @p remote, found by hashing the file rather than transferring it.
+    bool hasEtagOf(
+            const FileInfo& local,
+            const FileInfo& remote,
+            Executor& executor)
+    {
+        if (!local.hasSize || !remote.hasSize || local.size != remote.size ||
+                remote.version.empty())
+        {
+            return false;
+        }
+
+        try
+        {
+            const MappedFile file(Arbiter::stripType(local.path));
+            return crypto::matchesEtag(
+                    file.data(),
+                    file.size(),
+                    remote.version,
+                    { },
+                    executor.size(),
+                    &executor);
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    double secondsSince(const std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    // A random name for a local copy of @p path, keeping its extension.
+    std::string tempBasename(const std::string& path)
+    {
+        const auto ext(Arbiter::getExtension(path));
+        return std::to_string(randomNumber()) + (ext.size() ? "." + ext : "");
+    }
+
+    // Run @p f for each of @p results using up to the threads of
+    // @p executor, recording the failure of each item in its result rather
+    // than throwing.
+    template <typename R>
+    void runBatch(
+            std::vector<R>& results,
+            Executor& executor,
+            const std::function<void(std::size_t)>& f)
+    {
+        parallelFor(results.size(), executor.size(), [&](const std::size_t i)
+        {
+            try
+            {
+                f(i);
+            }
+            catch (...)
+            {
+                results[i].error = std::current_exception();
+            }
+        }, &executor);
+    }
 }
 
 Arbiter::Arbiter() : Arbiter(json().dump()) { }
 
-Arbiter::Arbiter(const std::string s)
-    : m_drivers()
-#ifdef ARBITER_CURL
-    , m_pool(
-            new http::Pool(
-                concurrentHttpReqs,
-                httpRetryCount,
-                getConfig(s).dump()))
-#endif
+Arbiter::Arbiter(const std::string s) : Arbiter(s, nullptr) { }
+
+Arbiter::Arbiter(const std::string s, std::shared_ptr<Executor> executor)
+    : Arbiter(Runtime::create(getConfig(s).dump(), executor), s)
+{ }
+
+Arbiter::Arbiter(std::shared_ptr<Runtime> runtime, const std::string s)
+    : m_drivers(std::make_shared<const DriverTable>())
+    , m_reads(new SingleFlight<SharedData>())
+    , m_sizes(new SingleFlight<SharedSize>())
+    , m_exists(new SingleFlight<bool>())
+    , m_runtime(runtime)
 {
     using namespace drivers;
 
+    if (!m_runtime) throw ArbiterError("Cannot construct without a runtime");
+
     const json c(getConfig(s));
 
-    if (auto d = Fs::create())
+    m_executor = &m_runtime->executor();
+    m_compute = &m_runtime->compute();
+    m_blocks = m_runtime->blockCache();
+    m_budget = m_runtime->memoryBudget();
+    m_transfer = m_runtime->transferPlanner();
+    m_rangeGap = c.value("rangeGap", defaultRangeGap);
+
+    m_prefetch = Prefetcher::create(
+            *m_executor,
+            [this](const std::string& key)
+            {
+                return coalescedGet(getDriver(key), key);
+            },
+            c.value("prefetch", json()).dump());
+    m_writeBehind = WriteBehind::create(
+            [this](
+                const std::string& path,
+                std::vector<char> data,
+                Completion<void> done)
+            {
+                putAsync(path, std::move(data), done);
+            },
+            c.value("writeBehind", json()).dump());
+    m_tracer = Recorder::create(c.value("record", json()).dump());
+
+    // Drivers are only constructed once they're used, at which point they
+    // are wrapped in any configured caches.  Sharding is innermost, so that
+    // the caches see logical paths.
+    const DriverWrapper shards(
+            Sharded::wrapper(c.value("shards", json()).dump()));
+    const DriverWrapper listings(
+            ListingIndex::wrapper(c.value("listings", json()).dump()));
+    const DriverWrapper cache(Cache::wrapper(c.value("cache", json()).dump()));
+    const DriverWrapper metadata(
+            MetadataCache::wrapper(c.value("metadata", json()).dump()));
+
+    using Create = std::function<std::unique_ptr<Driver>()>;
+    auto add([this, shards, listings, cache, metadata](
+                const std::string type,
+                Create create)
     {
-        m_drivers[d->type()] = std::move(d);
-    }
+        std::unique_ptr<DriverSlot> slot(new DriverSlot());
+        slot->create = [create, shards, listings, cache, metadata]()
+        {
+            std::unique_ptr<Driver> driver(create());
+            if (driver && shards) driver = shards(std::move(driver));
+            if (driver && listings) driver = listings(std::move(driver));
+            if (driver && cache) driver = cache(std::move(driver));
+            if (driver && metadata) driver = metadata(std::move(driver));
+            return driver;
+        };
+        setDriver(type, std::move(slot));
+    });
+
+    const std::string fsConfig(c.value("file", json()).dump());
+    add("file", [fsConfig]() { return Fs::create(fsConfig); });
+    add("test", []() { return Test::create(); });
+
+    const std::string memConfig(c.value("mem", json()).dump());
+    add("mem", [memConfig]() { return Memory::create(memConfig); });
+
+#ifdef ARBITER_CURL
+    add("http", [this]() { return Http::create(httpPool("http")); });
+    add("https", [this]() { return Https::create(httpPool("https")); });
 
-    if (auto d = Test::create())
+#ifndef ARBITER_NO_S3
     {
-        m_drivers[d->type()] = std::move(d);
+        // Each S3 profile is its own type, which we can tell without
+        // discovering its credentials.
+        const json s3(c.value("s3", json()));
+        const json list(s3.is_array() ? s3 : json::array({ s3 }));
+
+        for (const json& entry : list)
+        {
+            const std::string j(entry.dump());
+            const std::string type(S3::typeOf(j));
+            add(type, [this, type, j]()
+            {
+                return S3::createOne(httpPool(type), j, m_runtime.get());
+            });
+        }
     }
 
-#ifdef ARBITER_CURL
-    if (auto d = Http::create(*m_pool))
+#endif
+
+#ifndef ARBITER_NO_DROPBOX
+    // Credential-based drivers should probably all do something similar to the
+    // S3 driver to support multiple profiles.
+    const std::string dropboxConfig(c.value("dropbox", json()).dump());
+    add("dropbox", [this, dropboxConfig]()
+    {
+        return Dropbox::create(httpPool("dropbox"), dropboxConfig);
+    });
+#endif
+
+#if defined(ARBITER_OPENSSL) && !defined(ARBITER_NO_GOOGLE)
+    const std::string googleConfig(c.value("gs", json()).dump());
+    add("gs", [this, googleConfig]()
+    {
+        return Google::create(httpPool("gs"), googleConfig);
+    });
+#endif
+
+    const json sidecar(c.value("sidecar", json()));
+    if (sidecar.is_object())
     {
-        m_drivers[d->type()] = std::move(d);
+        if (!m_runtime->pools().count("sidecar"))
+        {
+            throw ArbiterError("Runtime has no pool for the sidecar");
+        }
+
+        for (const json& t : sidecar.value("types", json::array()))
+        {
+            const std::string type(t.get<std::string>());
+            add(type, [this, type]()
+            {
+                return Sidecar::create(httpPool("sidecar"), type);
+            });
+        }
     }
 
-    if (auto d = Https::create(*m_pool))
+#endif
+
+    // Replica sets and content stores are reached through the drivers of
+    // their roots.
+    const std::function<const Driver&(const std::string&)> find(
+            [this](const std::string& path) -> const Driver&
+            {
+                return getDriver(path);
+            });
+
+    const json replicas(c.value("replicas", json()));
+    if (replicas.is_object())
     {
-        m_drivers[d->type()] = std::move(d);
+        const std::string j(replicas.dump());
+
+        std::unique_ptr<DriverSlot> slot(new DriverSlot());
+        slot->create = [find, j]()
+        {
+            return std::unique_ptr<Driver>(
+                    drivers::Replicated::create(find, j));
+        };
+        setDriver("replica", std::move(slot));
     }
 
+    const json cas(c.value("cas", json()));
+    if (cas.is_object())
     {
-        auto dlist(S3::create(*m_pool, c.value("s3", json()).dump()));
-        for (auto& d : dlist) m_drivers[d->type()] = std::move(d);
+        const std::string j(cas.dump());
+
+        std::unique_ptr<DriverSlot> slot(new DriverSlot());
+        slot->create = [find, j]()
+        {
+            return std::unique_ptr<Driver>(
+                    drivers::ContentStore::create(find, j));
+        };
+        setDriver("cas", std::move(slot));
     }
 
-    // Credential-based drivers should probably all do something similar to the
-    // S3 driver to support multiple profiles.
-    if (auto d = Dropbox::create(*m_pool, c.value("dropbox", json()).dump()))
+    const json packs(c.value("packs", json()));
+    if (packs.is_object())
     {
-        m_drivers[d->type()] = std::move(d);
+        const std::string j(packs.dump());
+
+        std::unique_ptr<DriverSlot> slot(new DriverSlot());
+        slot->create = [this, find, j]()
+        {
+            return std::unique_ptr<Driver>(
+                    drivers::Packs::create(find, j, *m_executor));
+        };
+        setDriver("pack", std::move(slot));
     }
 
-#ifdef ARBITER_OPENSSL
-    if (auto d = Google::create(*m_pool, c.value("gs", json()).dump()))
+    // Each driver may also be reached through transparent compression, and
+    // the members of its ZIP archives read in place.
+    m_compression = c.value("compression", json()).dump();
+    m_archives = c.value("archives", json()).dump();
+
+    std::vector<std::string> types;
+    for (const auto& entry : *m_drivers) types.push_back(entry.first);
+    for (const std::string& type : types)
     {
-        m_drivers[d->type()] = std::move(d);
+        addCompressed(type);
+        addArchive(type);
     }
-#endif
 
-#endif
+    // Now that every driver can be found, the uploads spooled by a previous
+    // process are resumed.
+    m_writeBehind->recover();
 }
 
-bool Arbiter::hasDriver(const std::string path) const
+bool Arbiter::hasDriver(const std::string& path) const
 {
-    return m_drivers.count(getType(path));
+    return findDriver(path) != nullptr;
 }
 
-void Arbiter::addDriver(const std::string type, std::unique_ptr<Driver> driver)
+http::Pool& Arbiter::httpPool(const std::string& type)
 {
-    if (!driver) throw ArbiterError("Cannot add empty driver for " + type);
-    m_drivers[type] = std::move(driver);
+    return m_runtime->httpPool(type);
 }
 
-std::string Arbiter::get(const std::string path) const
+void Arbiter::addDriver(const std::string type, std::unique_ptr<Driver> driver)
 {
-    return getDriver(path).get(stripType(path));
-}
+    if (!driver) throw ArbiterError("Cannot add empty driver for " + type);
 
-std::vector<char> Arbiter::getBinary(const std::string path) const
-{
-    return getDriver(path).getBinary(stripType(path));
+    std::unique_ptr<DriverSlot> slot(new DriverSlot());
+    slot->driver = std::move(driver);
+    setDriver(type, std::move(slot));
+
+    addCompressed(type);
+    addArchive(type);
 }
 
-std::unique_ptr<std::string> Arbiter::tryGet(std::string path) const
+void Arbiter::addCompressed(const std::string& type)
 {
-    return getDriver(path).tryGet(stripType(path));
+    const json c(json::parse(m_compression));
+
+    for (const std::string& codec : drivers::Compressed::codecs())
+    {
+        const std::string config(
+                c.is_object() ? c.value(codec, json()).dump() : "null");
+
+        std::unique_ptr<DriverSlot> slot(new DriverSlot());
+        slot->create = [this, type, codec, config]()
+        {
+            const Driver& driver(getDriver(type + delimiter));
+            return std::unique_ptr<Driver>(
+                    drivers::Compressed::create(driver, codec, config));
+        };
+        setDriver(codec + "+" + type, std::move(slot));
+    }
 }
 
-std::unique_ptr<std::vector<char>> Arbiter::tryGetBinary(std::string path) const
+void Arbiter::addArchive(const std::string& type)
 {
-    return getDriver(path).tryGetBinary(stripType(path));
+    const std::string config(m_archives);
+
+    std::unique_ptr<DriverSlot> slot(new DriverSlot());
+    slot->create = [this, type, config]()
+    {
+        const Driver& driver(getDriver(type + delimiter));
+        return std::unique_ptr<Driver>(
+                drivers::Archive::create(driver, config));
+    };
+    setDriver("zip+" + type, std::move(slot));
 }
 
-std::size_t Arbiter::getSize(const std::string path) const
+void Arbiter::setDriver(
+        const std::string& type,
+        std::unique_ptr<DriverSlot> slot)
 {
-    return getDriver(path).getSize(stripType(path));
+    std::lock_guard<std::mutex> lock(m_registry);
+
+    // Requests in flight keep the table they loaded, so a copy is modified
+    // and then published in its place.
+    std::shared_ptr<DriverTable> table(
+            std::make_shared<DriverTable>(*std::atomic_load(&m_drivers)));
+    std::shared_ptr<DriverSlot> added(std::move(slot));
+
+    auto it(std::find_if(
+            table->begin(),
+            table->end(),
+            [&type](const DriverTable::value_type& entry)
+            {
+                return entry.first == type;
+            }));
+
+    if (it != table->end())
+    {
+        m_retired.push_back(std::move(it->second));
+        it->second = added;
+    }
+    else table->emplace_back(type, added);
+
+    std::atomic_store(
+            &m_drivers,
+            std::shared_ptr<const DriverTable>(std::move(table)));
 }
 
-std::unique_ptr<std::size_t> Arbiter::tryGetSize(const std::string path) const
+void Arbiter::setTracer(std::shared_ptr<Tracer> tracer)
 {
-    return getDriver(path).tryGetSize(stripType(path));
+    m_tracer = std::move(tracer);
 }
 
-void Arbiter::put(const std::string path, const std::string& data) const
+std::string Arbiter::metrics() const
 {
-    return getDriver(path).put(stripType(path), data);
+    std::string out;
+
+    if (const auto tracer = dynamic_cast<const MetricsTracer*>(m_tracer.get()))
+    {
+        tracer->render(out);
+    }
+
+    std::vector<std::pair<std::string, const http::Pool*>> pools {
+        { "default", m_runtime->commonPool() }
+    };
+    for (const auto& p : m_runtime->pools())
+    {
+        pools.emplace_back(p.first, p.second.get());
+    }
+    renderPoolMetrics(pools, out);
+
+    if (m_blocks) renderBlockCacheMetrics(*m_blocks, out);
+
+    out += "# EOF\n";
+    return out;
 }
 
-void Arbiter::put(const std::string path, const std::vector<char>& data) const
+std::string Arbiter::get(const std::string& path) const
 {
-    return getDriver(path).put(stripType(path), data);
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "get", stripType(path));
+    const SharedData shared(readShared(driver, path));
+    if (!shared) throw ArbiterError("Could not read file " + stripType(path));
+    std::string data(shared->begin(), shared->end());
+    span.done(data.size());
+    return data;
 }
 
-std::string Arbiter::get(
-        const std::string path,
-        const http::Headers headers,
-        const http::Query query) const
+std::vector<char> Arbiter::getBinary(const std::string& path) const
 {
-    return getHttpDriver(path).get(stripType(path), headers, query);
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "getBinary", stripType(path));
+    SharedData shared(readShared(driver, path));
+    if (!shared) throw ArbiterError("Could not read file " + stripType(path));
+    std::vector<char> data(takeShared(shared));
+    span.done(data.size());
+    return data;
 }
 
-std::unique_ptr<std::string> Arbiter::tryGet(
-        const std::string path,
-        const http::Headers headers,
-        const http::Query query) const
+std::unique_ptr<std::string> Arbiter::tryGet(const std::string& path) const
 {
-    return getHttpDriver(path).tryGet(stripType(path), headers, query);
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "tryGet", stripType(path));
+    std::unique_ptr<std::string> data;
+    if (const SharedData shared = readShared(driver, path))
+    {
+        data.reset(new std::string(shared->begin(), shared->end()));
+    }
+    span.done(data ? data->size() : 0);
+    return data;
 }
 
-std::vector<char> Arbiter::getBinary(
-        const std::string path,
-        const http::Headers headers,
-        const http::Query query) const
+std::unique_ptr<std::vector<char>> Arbiter::tryGetBinary(const std::string& path) const
 {
-    return getHttpDriver(path).getBinary(stripType(path), headers, query);
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "tryGetBinary", stripType(path));
+    std::unique_ptr<std::vector<char>> data;
+    if (SharedData shared = readShared(driver, path))
+    {
+        data.reset(new std::vector<char>(takeShared(shared)));
+    }
+    span.done(data ? data->size() : 0);
+    return data;
 }
 
-std::unique_ptr<std::vector<char>> Arbiter::tryGetBinary(
-        const std::string path,
-        const http::Headers headers,
-        const http::Query query) const
+Status Arbiter::tryRead(
+        const std::string& path,
+        std::vector<char>& data) const
 {
-    return getHttpDriver(path).tryGetBinary(stripType(path), headers, query);
+    const Driver* driver(tryFindDriver(path));
+    if (!driver) return Status(Status::Code::Failed);
+
+    TraceSpan span(m_tracer.get(), *driver, "tryRead", stripType(path));
+    const Status status(driver->tryRead(stripType(path), data));
+    span.done(status.ok() ? data.size() : 0);
+    return status;
 }
 
-void Arbiter::put(
-        const std::string path,
-        const std::string& data,
-        const http::Headers headers,
-        const http::Query query) const
+std::size_t Arbiter::getInto(
+        const std::string& path,
+        char* const data,
+        const std::size_t size) const
 {
-    return getHttpDriver(path).put(stripType(path), data, headers, query);
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "getInto", stripType(path));
+    const std::size_t read(driver.getInto(stripType(path), data, size));
+    span.done(read);
+    return read;
 }
 
-void Arbiter::put(
-        const std::string path,
-        const std::vector<char>& data,
-        const http::Headers headers,
-        const http::Query query) const
+std::vector<char> Arbiter::getRange(
+        const std::string& path,
+        const std::size_t offset,
+        const std::size_t length) const
 {
-    return getHttpDriver(path).put(stripType(path), data, headers, query);
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "getRange", stripType(path));
+    span.range(offset, length);
+    std::vector<char> data(
+            useBlocks(driver) ?
+                getBlocks(driver, path, offset, length) :
+                driver.getRange(stripType(path), offset, length));
+    span.done(data.size());
+    return data;
 }
 
-void Arbiter::copy(
-        const std::string src,
-        const std::string dst,
-        const bool verbose) const
+std::vector<std::vector<char>> Arbiter::getRanges(
+        const std::string& path,
+        const std::vector<std::pair<std::size_t, std::size_t>>& ranges) const
 {
-    if (src.empty()) throw ArbiterError("Cannot copy from empty source");
-    if (dst.empty()) throw ArbiterError("Cannot copy to empty destination");
-
-    // Globify the source path if it's a directory.  In this case, the source
-    // already ends with a slash.
-    const std::string srcToResolve(src + (isDirectory(src) ? "**" : ""));
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "getRanges", stripType(path));
+    std::vector<std::vector<char>> results;
 
-    if (srcToResolve.back() != '*')
-    {
-        // The source is a single file.
-        copyFile(src, dst, verbose);
-    }
-    else
+    if (ranges.size())
     {
-        // We'll need this to mirror the directory structure in the output.
-        // All resolved paths will contain this common prefix, so we can
-        // determine any nested paths from recursive resolutions by stripping
-        // that common portion.
-        const Endpoint& srcEndpoint(getEndpoint(stripPostfixing(src)));
-        const std::string commonPrefix(srcEndpoint.prefixedRoot());
-
-        const Endpoint dstEndpoint(getEndpoint(dst));
-
-        if (srcEndpoint.prefixedRoot() == dstEndpoint.prefixedRoot())
+        std::size_t begin(ranges.front().first);
+        std::size_t end(begin);
+        for (const auto& r : ranges)
         {
-            throw ArbiterError("Cannot copy directory to itself");
+            begin = (std::min)(begin, r.first);
+            end = (std::max)(end, r.first + r.second);
         }
+        span.range(begin, end - begin);
+    }
 
-        int i(0);
-        const auto paths(resolve(srcToResolve, verbose));
-
-        for (const auto& path : paths)
+    if (useBlocks(driver))
+    {
+        // The block cache already shares reads between nearby ranges.
+        results.resize(ranges.size());
+        parallelFor(ranges.size(), m_executor->size(), [&](std::size_t i)
         {
-            const std::string subpath(path.substr(commonPrefix.size()));
+            results[i] = getBlocks(
+                    driver,
+                    path,
+                    ranges[i].first,
+                    ranges[i].second);
+        }, m_executor);
+    }
+    else
+    {
+        results = driver.getRanges(
+                stripType(path),
+                ranges,
+                m_rangeGap,
+                *m_executor);
+    }
 
-            if (verbose)
-            {
-                std::cout <<
-                    ++i << " / " << paths.size() << ": " <<
-                    path << " -> " << dstEndpoint.prefixedFullPath(subpath) <<
-                    std::endl;
-            }
+    std::size_t bytes(0);
+    for (const auto& r : results) bytes += r.size();
+    span.done(bytes);
+    return results;
+}
 
-            if (dstEndpoint.isLocal())
+std::unique_ptr<RemoteStreamBuf> Arbiter::getStreamBuf(
+        const std::string& path,
+        const std::string j) const
+{
+    return RemoteStreamBuf::create(
+            [this, path](const std::size_t offset, const std::size_t length)
             {
-                mkdirp(getNonBasename(dstEndpoint.fullPath(subpath)));
-            }
-
-            dstEndpoint.put(subpath, getBinary(path));
-        }
-    }
+                return getRange(path, offset, length);
+            },
+            getSize(path),
+            *m_executor,
+            j);
 }
 
-void Arbiter::copyFile(
-        const std::string file,
-        std::string dst,
-        const bool verbose) const
+std::size_t Arbiter::getSize(const std::string& path) const
 {
-    if (dst.empty()) throw ArbiterError("Cannot copy to empty destination");
-
-    const Endpoint dstEndpoint(getEndpoint(dst));
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "getSize", stripType(path));
+    const SharedSize size(coalescedGetSize(driver, path));
+    if (!size) throw ArbiterError("Could not get size of " + stripType(path));
+    span.done();
+    return *size;
+}
 
-    if (isDirectory(dst))
+std::unique_ptr<std::size_t> Arbiter::tryGetSize(const std::string& path) const
+{
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "tryGetSize", stripType(path));
+    std::unique_ptr<std::size_t> size;
+    if (const SharedSize shared = coalescedGetSize(driver, path))
     {
-        // If the destination is a directory, maintain the basename of the
-        // source file.
-        dst += getBasename(file);
+        size.reset(new std::size_t(*shared));
     }
+    span.done();
+    return size;
+}
 
-    if (verbose) std::cout << file << " -> " << dst << std::endl;
+Status Arbiter::tryReadSize(
+        const std::string& path,
+        std::size_t& size) const
+{
+    const Driver* driver(tryFindDriver(path));
+    if (!driver) return Status(Status::Code::Failed);
 
-    if (dstEndpoint.isLocal()) mkdirp(getNonBasename(dst));
+    TraceSpan span(m_tracer.get(), *driver, "tryReadSize", stripType(path));
+    const Status status(driver->tryReadSize(stripType(path), size));
+    span.done();
+    return status;
+}
 
-    if (getEndpoint(file).type() == dstEndpoint.type())
+void Arbiter::put(const std::string& path, const std::string& data) const
+{
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "put", stripType(path), data.size());
+    dropCached(path);
+    if (!putPlanned(driver, path, data.data(), data.size()))
     {
-        // If this copy is within the same driver domain, defer to the
-        // hopefully specialized copy method.
-        getDriver(file).copy(stripType(file), stripType(dst));
+        driver.put(stripType(path), data);
     }
-    else
+    span.done();
+}
+
+void Arbiter::put(const std::string& path, const std::vector<char>& data) const
+{
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "put", stripType(path), data.size());
+    dropCached(path);
+    if (!putPlanned(driver, path, data.data(), data.size()))
     {
-        // Otherwise do a GET/PUT for the copy.
-        put(dst, getBinary(file));
+        driver.put(stripType(path), data);
     }
+    span.done();
 }
 
-bool Arbiter::isRemote(const std::string path) const
+void Arbiter::put(const std::string& path, std::vector<char>&& data) const
 {
-    return getDriver(path).isRemote();
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "put", stripType(path), data.size());
+    dropCached(path);
+    if (!putPlanned(driver, path, data.data(), data.size()))
+    {
+        driver.put(stripType(path), std::move(data));
+    }
+    span.done();
 }
 
-bool Arbiter::isLocal(const std::string path) const
+void Arbiter::putFrom(
+        const std::string& path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size) const
 {
-    return !isRemote(path);
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "putFrom", stripType(path), size);
+    dropCached(path);
+    driver.putFrom(stripType(path), source, size);
+    span.done();
 }
 
-bool Arbiter::exists(const std::string path) const
+void Arbiter::remove(const std::string& path) const
 {
-    return tryGetSize(path).get() != nullptr;
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "remove", stripType(path));
+    dropCached(path);
+    driver.remove(stripType(path));
+    span.done();
 }
 
-bool Arbiter::isHttpDerived(const std::string path) const
+void Arbiter::putFile(std::string localPath, const std::string& path) const
 {
-    return tryGetHttpDriver(path) != nullptr;
+    localPath = expandTilde(stripType(localPath));
+    const std::size_t size(drivers::Fs().getSize(localPath));
+
+    std::ifstream stream(localPath, std::ios::in | std::ios::binary);
+    if (!stream.good()) throw ArbiterError("Could not read file " + localPath);
+
+    putFrom(path, [&stream](char* data, std::size_t n)->std::size_t
+    {
+        stream.read(data, n);
+        return stream.gcount();
+    }, size);
 }
 
-std::vector<std::string> Arbiter::resolve(
-        const std::string path,
-        const bool verbose) const
+std::string Arbiter::get(
+        const std::string& path,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
-    return getDriver(path).resolve(stripType(path), verbose);
+    const drivers::Http& driver(getHttpDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "get", stripType(path));
+    std::string data(driver.get(stripType(path), headers, query));
+    span.done(data.size());
+    return data;
 }
 
-Endpoint Arbiter::getEndpoint(const std::string root) const
+std::unique_ptr<std::string> Arbiter::tryGet(
+        const std::string& path,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
-    return Endpoint(getDriver(root), stripType(root));
+    const drivers::Http& driver(getHttpDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "tryGet", stripType(path));
+    std::unique_ptr<std::string> data(
+            driver.tryGet(stripType(path), headers, query));
+    span.done(data ? data->size() : 0);
+    return data;
 }
 
-const Driver& Arbiter::getDriver(const std::string path) const
+std::vector<char> Arbiter::getBinary(
+        const std::string& path,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
-    const auto type(getType(path));
+    const drivers::Http& driver(getHttpDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "getBinary", stripType(path));
 
-    if (!m_drivers.count(type))
+    std::size_t offset(0);
+    std::size_t length(0);
+    if (m_blocks && query.empty() && getBoundedRange(headers, offset, length))
     {
-        throw ArbiterError("No driver for " + path);
+        // As without caching, a range which is entirely unsatisfiable is an
+        // error.
+        std::vector<char> data(getBlocks(driver, path, offset, length));
+        if (data.empty())
+        {
+            throw ArbiterError("Could not read file " + stripType(path));
+        }
+        span.done(data.size());
+        return data;
     }
 
-    return *m_drivers.at(type);
+    std::vector<char> data(driver.getBinary(stripType(path), headers, query));
+    span.done(data.size());
+    return data;
 }
 
-const drivers::Http* Arbiter::tryGetHttpDriver(const std::string path) const
+std::unique_ptr<std::vector<char>> Arbiter::tryGetBinary(
+        const std::string& path,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
-    return dynamic_cast<const drivers::Http*>(&getDriver(path));
+    const drivers::Http& driver(getHttpDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "tryGetBinary", stripType(path));
+    std::unique_ptr<std::vector<char>> data(
+            driver.tryGetBinary(stripType(path), headers, query));
+    span.done(data ? data->size() : 0);
+    return data;
 }
 
-const drivers::Http& Arbiter::getHttpDriver(const std::string path) const
+void Arbiter::put(
+        const std::string& path,
+        const std::string& data,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
-    if (auto d = tryGetHttpDriver(path)) return *d;
-    else throw ArbiterError("Cannot get driver for " + path + " as HTTP");
+    const drivers::Http& driver(getHttpDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "put", stripType(path), data.size());
+    dropCached(path);
+    driver.put(stripType(path), data, headers, query);
+    span.done();
 }
 
-std::unique_ptr<LocalHandle> Arbiter::getLocalHandle(
-        const std::string path,
-        const Endpoint& tempEndpoint) const
+void Arbiter::put(
+        const std::string& path,
+        const std::vector<char>& data,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
-    std::unique_ptr<LocalHandle> localHandle;
+    const drivers::Http& driver(getHttpDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "put", stripType(path), data.size());
+    dropCached(path);
+    driver.put(stripType(path), data, headers, query);
+    span.done();
+}
 
-    if (isRemote(path))
-    {
-        if (tempEndpoint.isRemote())
-        {
-            throw ArbiterError("Temporary endpoint must be local.");
-        }
+std::future<std::string> Arbiter::getAsync(const std::string& path) const
+{
+    return m_executor->async([this, path]() { return get(path); });
+}
 
-        const auto ext(getExtension(path));
-        const std::string basename(
-                std::to_string(randomNumber()) +
-                (ext.size() ? "." + ext : ""));
-        tempEndpoint.put(basename, getBinary(path));
-        localHandle.reset(
-                new LocalHandle(tempEndpoint.root() + basename, true));
-    }
-    else
+std::future<std::vector<char>> Arbiter::getBinaryAsync(
+        const std::string& path) const
+{
+    if (const Driver* driver = tryGetAsyncDriver(path))
     {
-        localHandle.reset(
-                new LocalHandle(expandTilde(stripType(path)), false));
+        return driver->getBinaryAsync(stripType(path));
     }
 
-    return localHandle;
+    return m_executor->async([this, path]() { return getBinary(path); });
 }
 
-std::unique_ptr<LocalHandle> Arbiter::getLocalHandle(
-        const std::string path,
-        std::string tempPath) const
+std::future<std::size_t> Arbiter::getSizeAsync(const std::string& path) const
 {
-    if (tempPath.empty()) tempPath = getTempPath();
-    return getLocalHandle(path, getEndpoint(tempPath));
+    return m_executor->async([this, path]() { return getSize(path); });
 }
 
-std::string Arbiter::getType(const std::string path)
+std::future<void> Arbiter::putAsync(
+        const std::string& path,
+        const std::string data) const
 {
-    std::string type("file");
-    const std::size_t pos(path.find(delimiter));
+    return putAsync(path, std::vector<char>(data.begin(), data.end()));
+}
 
-    if (pos != std::string::npos)
+std::future<void> Arbiter::putAsync(
+        const std::string& path,
+        std::vector<char> data) const
+{
+    if (const Driver* driver = tryGetAsyncDriver(path))
     {
-        type = path.substr(0, pos);
+        dropCached(path);
+        return driver->putAsync(stripType(path), std::move(data));
     }
 
-    return type;
+    auto shared(std::make_shared<std::vector<char>>(std::move(data)));
+    return m_executor->async([this, path, shared]()
+    {
+        put(path, std::move(*shared));
+    });
 }
 
-std::string Arbiter::stripType(const std::string raw)
+void Arbiter::getBinaryAsync(
+        const std::string& path,
+        const Completion<std::vector<char>> done) const
 {
-    std::string result(raw);
-    const std::size_t pos(raw.find(delimiter));
-
-    if (pos != std::string::npos)
+    SharedData shared;
+    if (m_prefetch->take(keyOf(path), shared))
     {
-        result = raw.substr(pos + delimiter.size());
+        return complete(done, [&]() { return takeShared(shared); });
     }
 
+    if (m_tracer)
+    {
+        return m_executor->post([this, path, done]()
+        {
+            complete(done, [&]() { return getBinary(path); });
+        });
+    }
+
+    getDriver(path).getBinaryThen(stripType(path), done, *m_executor);
+}
+
+void Arbiter::getSizeAsync(
+        const std::string& path,
+        const Completion<std::size_t> done) const
+{
+    if (m_tracer)
+    {
+        return m_executor->post([this, path, done]()
+        {
+            complete(done, [&]() { return getSize(path); });
+        });
+    }
+
+    const std::string stripped(stripType(path));
+    getDriver(path).tryGetSizeThen(
+            stripped,
+            [stripped, done](std::future<std::unique_ptr<std::size_t>> f)
+            {
+                complete(done, [&]()
+                {
+                    const std::unique_ptr<std::size_t> size(f.get());
+                    if (!size)
+                    {
+                        throw ArbiterError("Could not get size of " + stripped);
+                    }
+                    return *size;
+                });
+            },
+            *m_executor);
+}
+
+void Arbiter::putAsync(
+        const std::string& path,
+        std::vector<char> data,
+        const Completion<void> done) const
+{
+    if (m_tracer)
+    {
+        auto shared(std::make_shared<std::vector<char>>(std::move(data)));
+        return m_executor->post([this, path, shared, done]()
+        {
+            complete(done, [&]() { put(path, std::move(*shared)); });
+        });
+    }
+
+    dropCached(path);
+    getDriver(path).putThen(
+            stripType(path),
+            std::move(data),
+            done,
+            *m_executor);
+}
+
+void Arbiter::resolveAsync(
+        const std::string& path,
+        const Completion<std::vector<std::string>> done) const
+{
+    m_executor->post([this, path, done]()
+    {
+        complete(done, [&]() { return resolve(path); });
+    });
+}
+
+void Arbiter::putBehind(
+        const std::string& path,
+        std::vector<char> data) const
+{
+    m_writeBehind->put(path, std::move(data));
+}
+
+void Arbiter::flush() const
+{
+    m_writeBehind->flush();
+}
+
+void Arbiter::prefetch(const std::vector<std::string>& paths) const
+{
+    std::vector<std::string> keys;
+    keys.reserve(paths.size());
+    for (const std::string& path : paths)
+    {
+        keys.push_back(keyOf(path));
+    }
+
+    m_prefetch->prefetch(keys);
+}
+
+std::vector<BatchResult<std::vector<char>>> Arbiter::getMany(
+        const std::vector<std::string>& paths) const
+{
+    const std::vector<const Driver*> drivers(getDrivers(paths));
+    std::vector<BatchResult<std::vector<char>>> results(paths.size());
+
+    runBatch(results, *m_executor, [&](const std::size_t i)
+    {
+        const std::string& path(paths[i]);
+        if (!drivers[i]) throw ArbiterError("No driver for " + path);
+
+        const Driver& driver(*drivers[i]);
+        TraceSpan span(m_tracer.get(), driver, "getBinary", stripType(path));
+        SharedData shared(readShared(driver, path));
+        if (!shared)
+        {
+            throw ArbiterError("Could not read file " + stripType(path));
+        }
+        results[i].value = takeShared(shared);
+        span.done(results[i].value.size());
+    });
+
+    return results;
+}
+
+std::vector<BatchResult<>> Arbiter::putMany(
+        const std::vector<std::pair<std::string, std::vector<char>>>& items)
+    const
+{
+    std::vector<std::string> paths;
+    paths.reserve(items.size());
+    for (const auto& item : items) paths.push_back(item.first);
+
+    const std::vector<const Driver*> drivers(getDrivers(paths));
+    std::vector<BatchResult<>> results(items.size());
+
+    runBatch(results, *m_executor, [&](const std::size_t i)
+    {
+        const std::string& path(paths[i]);
+        if (!drivers[i]) throw ArbiterError("No driver for " + path);
+
+        const Driver& driver(*drivers[i]);
+        const std::vector<char>& data(items[i].second);
+        TraceSpan span(
+                m_tracer.get(),
+                driver,
+                "put",
+                stripType(path),
+                data.size());
+        dropCached(path);
+        driver.put(stripType(path), data);
+        span.done();
+    });
+
+    return results;
+}
+
+std::vector<BatchResult<std::size_t>> Arbiter::getSizeMany(
+        const std::vector<std::string>& paths) const
+{
+    auto sizes(tryGetSizesGrouped(paths, "getSizeMany"));
+    std::vector<BatchResult<std::size_t>> results(paths.size());
+
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        if (sizes[i].error) results[i].error = sizes[i].error;
+        else if (sizes[i].value) results[i].value = *sizes[i].value;
+        else
+        {
+            results[i].error = std::make_exception_ptr(
+                    ArbiterError(
+                        "Could not get size of " + stripType(paths[i])));
+        }
+    }
+
+    return results;
+}
+
+std::vector<BatchResult<bool>> Arbiter::existsMany(
+        const std::vector<std::string>& paths) const
+{
+    auto sizes(tryGetSizesGrouped(paths, "existsMany"));
+    std::vector<BatchResult<bool>> results(paths.size());
+
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        results[i].error = sizes[i].error;
+        results[i].value = !!sizes[i].value;
+    }
+
+    return results;
+}
+
+std::vector<BatchResult<std::unique_ptr<std::size_t>>>
+Arbiter::tryGetSizesGrouped(
+        const std::vector<std::string>& paths,
+        const char* const operation) const
+{
+    const std::vector<const Driver*> drivers(getDrivers(paths));
+    std::vector<BatchResult<std::unique_ptr<std::size_t>>> results(
+            paths.size());
+
+    // Indices of the paths of each driver.
+    std::map<const Driver*, std::vector<std::size_t>> groups;
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        if (drivers[i]) groups[drivers[i]].push_back(i);
+        else
+        {
+            results[i].error = std::make_exception_ptr(
+                    ArbiterError("No driver for " + paths[i]));
+        }
+    }
+
+    for (const auto& group : groups)
+    {
+        const Driver& driver(*group.first);
+        const std::vector<std::size_t>& indices(group.second);
+
+        std::vector<std::string> stripped;
+        stripped.reserve(indices.size());
+        for (const std::size_t i : indices)
+        {
+            stripped.push_back(stripType(paths[i]));
+        }
+
+        TraceSpan span(m_tracer.get(), driver, operation, stripped.front());
+        try
+        {
+            std::vector<std::unique_ptr<std::size_t>> sizes(
+                    driver.tryGetSizes(stripped));
+            for (std::size_t j(0); j < indices.size(); ++j)
+            {
+                results[indices[j]].value = std::move(sizes.at(j));
+            }
+            span.done();
+        }
+        catch (...)
+        {
+            for (const std::size_t i : indices)
+            {
+                results[i].error = std::current_exception();
+            }
+        }
+    }
+
+    return results;
+}
+
+std::vector<BatchResult<>> Arbiter::removeMany(
+        const std::vector<std::string>& paths) const
+{
+    const std::vector<const Driver*> drivers(getDrivers(paths));
+    std::vector<BatchResult<>> results(paths.size());
+
+    // Indices of the paths of each driver.
+    std::map<const Driver*, std::vector<std::size_t>> groups;
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        if (drivers[i]) groups[drivers[i]].push_back(i);
+        else
+        {
+            results[i].error = std::make_exception_ptr(
+                    ArbiterError("No driver for " + paths[i]));
+        }
+    }
+
+    for (const auto& group : groups)
+    {
+        const Driver& driver(*group.first);
+        const std::vector<std::size_t>& indices(group.second);
+
+        std::vector<std::string> stripped;
+        stripped.reserve(indices.size());
+        for (const std::size_t i : indices)
+        {
+            dropCached(paths[i]);
+            stripped.push_back(stripType(paths[i]));
+        }
+
+        TraceSpan span(m_tracer.get(), driver, "removeMany", stripped.front());
+        try
+        {
+            const std::vector<std::exception_ptr> errors(
+                    driver.removeMany(stripped, m_executor->size()));
+            for (std::size_t j(0); j < indices.size(); ++j)
+            {
+                results[indices[j]].error = errors.at(j);
+            }
+            span.done();
+        }
+        catch (...)
+        {
+            for (const std::size_t i : indices)
+            {
+                results[i].error = std::current_exception();
+            }
+        }
+    }
+
+    return results;
+}
+
+void Arbiter::copy(
+        const std::string src,
+        const std::string dst,
+        const bool verbose) const
+{
+    PriorityScope priority(Priority::Bulk);
+
+    if (src.empty()) throw ArbiterError("Cannot copy from empty source");
+    if (dst.empty()) throw ArbiterError("Cannot copy to empty destination");
+
+    // Globify the source path if it's a directory.  In this case, the source
+    // already ends with a slash.
+    const std::string srcToResolve(src + (isDirectory(src) ? "**" : ""));
+
+    if (srcToResolve.back() != '*')
+    {
+        // The source is a single file.
+        copyFile(src, dst, verbose);
+    }
+    else
+    {
+        // We'll need this to mirror the directory structure in the output.
+        // All resolved paths will contain this common prefix, so we can
+        // determine any nested paths from recursive resolutions by stripping
+        // that common portion.
+        const Endpoint& srcEndpoint(getEndpoint(stripPostfixing(src)));
+        const std::string commonPrefix(srcEndpoint.prefixedRoot());
+
+        const Endpoint dstEndpoint(getEndpoint(dst));
+
+        if (srcEndpoint.prefixedRoot() == dstEndpoint.prefixedRoot())
+        {
+            throw ArbiterError("Cannot copy directory to itself");
+        }
+
+        copyFiles(
+                resolve(srcToResolve, verbose),
+                commonPrefix,
+                dstEndpoint,
+                verbose);
+    }
+}
+
+void Arbiter::copyResumable(
+        const std::string src,
+        const std::string dst,
+        std::string journal,
+        const bool verbose) const
+{
+    PriorityScope priority(Priority::Bulk);
+
+    if (!isDirectory(src))
+    {
+        throw ArbiterError("Resumable copy source must be a directory");
+    }
+    if (!isDirectory(journal) || isGlob(journal))
+    {
+        throw ArbiterError("Copy journal must be a directory");
+    }
+
+    const Endpoint srcEndpoint(getEndpoint(stripPostfixing(src)));
+    const Endpoint dstEndpoint(getEndpoint(dst));
+    const std::string srcRoot(srcEndpoint.prefixedRoot());
+
+    if (srcRoot == dstEndpoint.prefixedRoot())
+    {
+        throw ArbiterError("Cannot copy directory to itself");
+    }
+
+    if (isLocal(journal)) mkdirp(journal);
+
+    // Each journal file lists the relative paths of completed files, one per
+    // line, and is named by its sequence number.
+    const std::vector<std::string> segments(resolve(journal + "*"));
+    std::set<std::string> completed;
+    std::size_t sequence(0);
+
+    for (const std::string& segment : segments)
+    {
+        std::istringstream lines(get(segment));
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            if (line.size()) completed.insert(line);
+        }
+
+        const std::string name(getBasename(segment));
+        if (name.size() && std::isdigit(static_cast<unsigned char>(name[0])))
+        {
+            sequence = (std::max<std::size_t>)(
+                    sequence,
+                    std::stoull(name) + 1);
+        }
+    }
+
+    std::vector<std::string> paths;
+    for (std::string& path : resolve(isGlob(src) ? src : src + "**", verbose))
+    {
+        if (!completed.count(path.substr(srcRoot.size())))
+        {
+            paths.push_back(std::move(path));
+        }
+    }
+
+    if (verbose)
+    {
+        logging::info(
+                "\tResuming with " + std::to_string(paths.size()) +
+                " files, " + std::to_string(completed.size()) +
+                " already copied");
+    }
+
+    std::mutex mutex;
+    std::string pending;
+    auto last(std::chrono::steady_clock::now());
+
+    // Journal files are written one at a time, outside of the lock which
+    // guards the pending entries so that copies continue meanwhile.
+    std::mutex writeMutex;
+    auto flush([&](std::string entries)
+    {
+        if (entries.empty()) return;
+        std::lock_guard<std::mutex> lock(writeMutex);
+        std::string name(std::to_string(sequence++));
+        name.insert(0, 12 - (std::min<std::size_t>)(name.size(), 12), '0');
+        put(journal + name, entries);
+    });
+
+    auto record([&](const std::string& subpath)
+    {
+        std::string entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending += subpath + "\n";
+
+            const auto now(std::chrono::steady_clock::now());
+            if (now - last < journalInterval) return;
+
+            last = now;
+            entries.swap(pending);
+        }
+        flush(std::move(entries));
+    });
+
+    try
+    {
+        copyFiles(paths, srcRoot, dstEndpoint, verbose, record);
+    }
+    catch (...)
+    {
+        // Record what did complete, so that a retry may skip it.
+        try { flush(std::move(pending)); }
+        catch (...) { }
+        throw;
+    }
+
+    for (const auto& r : removeMany(resolve(journal + "*")))
+    {
+        if (!r.ok()) std::rethrow_exception(r.error);
+    }
+    if (isLocal(journal)) arbiter::remove(journal);
+}
+
+SyncResult Arbiter::sync(
+        const std::string src,
+        const std::string dst,
+        const bool prune,
+        const bool verbose) const
+{
+    PriorityScope priority(Priority::Bulk);
+
+    if (!isDirectory(src))
+    {
+        throw ArbiterError("Sync source must be a directory");
+    }
+    if (!isDirectory(dst) || isGlob(dst))
+    {
+        throw ArbiterError("Sync destination must be a directory");
+    }
+
+    const Endpoint srcEndpoint(getEndpoint(stripPostfixing(src)));
+    const Endpoint dstEndpoint(getEndpoint(dst));
+    const std::string srcRoot(srcEndpoint.prefixedRoot());
+    const std::string dstRoot(dstEndpoint.prefixedRoot());
+
+    if (srcRoot == dstRoot)
+    {
+        throw ArbiterError("Cannot sync directory to itself");
+    }
+
+    // Destination files by their path relative to the destination root.  A
+    // local destination which doesn't exist yet is simply empty.
+    std::map<std::string, FileInfo> existing;
+    if (!dstEndpoint.isLocal() || drivers::Fs().exists(dstEndpoint.root()))
+    {
+        for (FileInfo& info : resolveInfo(dstRoot + "**", verbose))
+        {
+            const std::string subpath(info.path.substr(dstRoot.size()));
+            existing[subpath] = std::move(info);
+        }
+    }
+
+    const bool sameType(srcEndpoint.type() == dstEndpoint.type());
+
+    // Between local files and S3, files whose listings disagree may still
+    // be unchanged, as their ETags show without any transfer.
+    const bool toS3(srcEndpoint.isLocal() && dstEndpoint.type() == "s3");
+    const bool fromS3(srcEndpoint.type() == "s3" && dstEndpoint.isLocal());
+
+    SyncResult result;
+    std::vector<std::string> changed;
+    std::uint64_t changedBytes(0);
+    bool sized(true);
+
+    for (const FileInfo& info : resolveInfo(isGlob(src) ? src : src + "**"))
+    {
+        const std::string subpath(info.path.substr(srcRoot.size()));
+        const auto it(existing.find(subpath));
+
+        if (it != existing.end() && isCurrent(info, it->second, sameType))
+        {
+            ++result.skipped;
+        }
+        else if (it != existing.end() &&
+                ((toS3 && hasEtagOf(info, it->second, *m_executor)) ||
+                 (fromS3 && hasEtagOf(it->second, info, *m_executor))))
+        {
+            ++result.skipped;
+            ++result.verified;
+        }
+        else
+        {
+            changed.push_back(info.path);
+            changedBytes += info.size;
+            sized = sized && info.hasSize;
+        }
+
+        if (it != existing.end()) existing.erase(it);
+    }
+
+    // A total missing some sizes would only mislead an estimate.
+    Progress* progress(ProgressScope::current());
+    if (progress && sized) progress->expect(0, changedBytes);
+
+    if (verbose)
+    {
+        logging::info(
+                "\tSyncing " + std::to_string(changed.size()) +
+                " changed files, " + std::to_string(result.skipped) +
+                " unchanged");
+    }
+
+    copyFiles(changed, srcRoot, dstEndpoint, verbose);
+    result.copied = changed.size();
+
+    if (prune && existing.size())
+    {
+        std::vector<std::string> extraneous;
+        for (const auto& entry : existing)
+        {
+            extraneous.push_back(entry.second.path);
+        }
+
+        for (const auto& r : removeMany(extraneous))
+        {
+            if (!r.ok()) std::rethrow_exception(r.error);
+        }
+        result.removed = extraneous.size();
+    }
+
+    return result;
+}
+
+void Arbiter::copyFiles(
+        const std::vector<std::string>& paths,
+        const std::string& srcRoot,
+        const Endpoint& dst,
+        const bool verbose,
+        const std::function<void(const std::string&)>& copied) const
+{
+    const std::size_t total(paths.size());
+    if (Progress* progress = ProgressScope::current()) progress->expect(total);
+
+    // Copies within a remote driver are left to it, so that those which can
+    // copy many files at once do.
+    if (total && dst.isRemote() &&
+            getEndpoint(paths.front()).type() == dst.type() &&
+            getDriver(paths.front()).capabilities().serverSideCopy)
+    {
+        return copyBatches(paths, srcRoot, dst, verbose, copied);
+    }
+
+    std::atomic<std::size_t> done(0);
+    std::size_t reported(0);
+    std::mutex mutex;
+
+    // Many files usually share only a few destination directories.
+    DirectoryCache dirs;
+
+    parallelFor(total, m_executor->size(), [&](const std::size_t i)
+    {
+        const std::string& path(paths[i]);
+        const std::string subpath(path.substr(srcRoot.size()));
+
+        copyFile(path, dst.prefixedFullPath(subpath), false, dirs);
+        if (copied) copied(subpath);
+
+        // Report progress in whole percentages rather than per file.
+        const std::size_t percent(++done * 100 / total);
+        if (verbose)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (percent > reported)
+            {
+                reported = percent;
+                logging::info(
+                        "\tCopied " + std::to_string(done) + " / " +
+                        std::to_string(total) + " (" +
+                        std::to_string(percent) + "%)");
+            }
+        }
+    }, m_executor);
+}
+
+void Arbiter::copyBatches(
+        const std::vector<std::string>& paths,
+        const std::string& srcRoot,
+        const Endpoint& dst,
+        const bool verbose,
+        const std::function<void(const std::string&)>& copied) const
+{
+    const Driver& driver(getDriver(paths.front()));
+    Progress* progress(ProgressScope::current());
+    const std::size_t total(paths.size());
+
+    for (std::size_t begin(0); begin < total; begin += copyBatchSize)
+    {
+        const std::size_t end((std::min)(begin + copyBatchSize, total));
+
+        std::vector<std::pair<std::string, std::string>> pairs;
+        pairs.reserve(end - begin);
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            const std::string to(
+                    dst.prefixedFullPath(paths[i].substr(srcRoot.size())));
+            dropCached(to);
+            pairs.emplace_back(stripType(paths[i]), stripType(to));
+        }
+
+        TraceSpan span(m_tracer.get(), driver, "copyMany", pairs[0].first);
+        const std::vector<std::exception_ptr> errors(
+                driver.copyMany(pairs, m_executor->size()));
+
+        // Those which were copied are recorded before any failure is thrown,
+        // so that a resumed copy need not repeat them.
+        std::exception_ptr error;
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            if (const std::exception_ptr& e = errors.at(i - begin))
+            {
+                if (!error) error = e;
+                continue;
+            }
+
+            if (copied) copied(paths[i].substr(srcRoot.size()));
+            if (progress) progress->fileDone();
+        }
+
+        if (error) std::rethrow_exception(error);
+        span.done();
+
+        if (verbose)
+        {
+            logging::info(
+                    "\tCopied " + std::to_string(end) + " / " +
+                    std::to_string(total) + " (" +
+                    std::to_string(end * 100 / total) + "%)");
+        }
+    }
+}
+
+void Arbiter::move(
+        const std::string src,
+        const std::string dst,
+        const bool verbose) const
+{
+    PriorityScope priority(Priority::Bulk);
+
+    if (src.empty()) throw ArbiterError("Cannot move from empty source");
+    if (dst.empty()) throw ArbiterError("Cannot move to empty destination");
+
+    const bool directory(isDirectory(src));
+    const Endpoint dstEndpoint(getEndpoint(dst));
+
+    // Paths within a directory are moved to the same relative paths within
+    // the destination.
+    std::string srcRoot;
+    std::vector<std::string> paths;
+    std::vector<std::pair<std::string, std::string>> pairs;
+
+    if (!directory)
+    {
+        paths.push_back(src);
+        pairs.emplace_back(
+                src,
+                isDirectory(dst) ? dst + getBasename(src) : dst);
+    }
+    else
+    {
+        srcRoot = getEndpoint(stripPostfixing(src)).prefixedRoot();
+        if (srcRoot == dstEndpoint.prefixedRoot())
+        {
+            throw ArbiterError("Cannot move directory to itself");
+        }
+
+        paths = resolve(src + "**", verbose);
+        pairs.reserve(paths.size());
+        for (const std::string& path : paths)
+        {
+            pairs.emplace_back(
+                    path,
+                    dstEndpoint.prefixedFullPath(path.substr(srcRoot.size())));
+        }
+
+        if (pairs.empty()) return;
+    }
+
+    const Driver& driver(getDriver(src));
+    if (getEndpoint(src).type() == dstEndpoint.type())
+    {
+        return moveBatches(driver, pairs, verbose);
+    }
+
+    // Drivers can't move between each other, so the data is copied, and
+    // since a failed copy throws, every source may then be removed.
+    if (directory) copyFiles(paths, srcRoot, dstEndpoint, verbose);
+    else copyFile(src, dst, verbose);
+
+    for (const BatchResult<>& result : removeMany(paths))
+    {
+        if (result.error) std::rethrow_exception(result.error);
+    }
+}
+
+void Arbiter::moveBatches(
+        const Driver& driver,
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        const bool verbose) const
+{
+    const std::size_t total(pairs.size());
+    Progress* progress(ProgressScope::current());
+    if (progress) progress->expect(total);
+
+    // Many files usually share only a few destination directories.
+    DirectoryCache dirs;
+    const bool local(getEndpoint(pairs.front().second).isLocal());
+
+    std::exception_ptr error;
+
+    for (std::size_t begin(0); begin < total; begin += copyBatchSize)
+    {
+        const std::size_t end((std::min)(begin + copyBatchSize, total));
+
+        std::vector<std::pair<std::string, std::string>> stripped;
+        stripped.reserve(end - begin);
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            const std::string& from(pairs[i].first);
+            const std::string& to(pairs[i].second);
+            if (verbose && total == 1) logging::info(from + " -> " + to);
+
+            if (local) dirs.mkdirp(getNonBasename(to));
+            dropCached(from);
+            dropCached(to);
+            stripped.emplace_back(stripType(from), stripType(to));
+        }
+
+        TraceSpan span(m_tracer.get(), driver, "moveMany", stripped[0].first);
+        std::vector<std::exception_ptr> errors(stripped.size());
+        if (stripped.size() == 1)
+        {
+            // A batch of one would only add the overhead of the batch.
+            try { driver.move(stripped[0].first, stripped[0].second); }
+            catch (...) { errors[0] = std::current_exception(); }
+        }
+        else errors = driver.moveMany(stripped, m_executor->size());
+
+        for (const std::exception_ptr& e : errors)
+        {
+            if (e && !error) error = e;
+            else if (!e && progress) progress->fileDone();
+        }
+
+        span.done();
+
+        if (verbose && total > 1)
+        {
+            logging::info(
+                    "\tMoved " + std::to_string(end) + " / " +
+                    std::to_string(total) + " (" +
+                    std::to_string(end * 100 / total) + "%)");
+        }
+    }
+
+    if (error) std::rethrow_exception(error);
+}
+
+void Arbiter::copyFile(
+        const std::string file,
+        const std::string dst,
+        const bool verbose) const
+{
+    PriorityScope priority(Priority::Bulk);
+    if (Progress* progress = ProgressScope::current()) progress->expect(1);
+    DirectoryCache dirs;
+    copyFile(file, dst, verbose, dirs);
+}
+
+void Arbiter::copyFile(
+        const std::string file,
+        std::string dst,
+        const bool verbose,
+        DirectoryCache& dirs) const
+{
+    if (dst.empty()) throw ArbiterError("Cannot copy to empty destination");
+
+    const Endpoint dstEndpoint(getEndpoint(dst));
+
+    if (isDirectory(dst))
+    {
+        // If the destination is a directory, maintain the basename of the
+        // source file.
+        dst += getBasename(file);
+    }
+
+    if (verbose) logging::info(file + " -> " + dst);
+
+    if (dstEndpoint.isLocal()) dirs.mkdirp(getNonBasename(dst));
+    dropCached(dst);
+
+    if (getEndpoint(file).type() == dstEndpoint.type())
+    {
+        // If this copy is within the same driver domain, defer to the
+        // hopefully specialized copy method.
+        const Driver& driver(getDriver(file));
+        TraceSpan span(m_tracer.get(), driver, "copy", stripType(file));
+        driver.copy(stripType(file), stripType(dst));
+        span.done();
+    }
+    else if (isMappedUpload(file, dst))
+    {
+        // Uploads which send from the caller's buffer are sent straight
+        // from a mapping of the local file, which costs no heap buffer and
+        // no copy of its contents.
+        const auto& fs(static_cast<const drivers::Fs&>(getDriver(file)));
+        const std::unique_ptr<MappedFile> map(fs.map(stripType(file)));
+
+        const Driver& driver(getDriver(dst));
+        TraceSpan span(
+                m_tracer.get(), driver, "put", stripType(dst), map->size());
+        if (!putPlanned(driver, dst, map->data(), map->size()))
+        {
+            driver.put(stripType(dst), map->data(), map->size());
+        }
+        span.done();
+
+        if (Progress* progress = ProgressScope::current())
+        {
+            progress->add(map->size());
+        }
+    }
+    else
+    {
+        // Otherwise stream the data from the source to the destination, so
+        // large files don't need to be held in memory.  Drivers which can't
+        // stream may hold the whole file, so it counts against our budget.
+        const Driver& driver(getDriver(file));
+        const MemoryBudget::Reservation reservation(reserve(driver, file));
+        TraceSpan span(m_tracer.get(), driver, "getStream", stripType(file));
+        std::size_t bytes(0);
+
+        // Bytes received over HTTP are counted by the transfer itself.
+        Progress* progress(
+                driver.isRemote() ? nullptr : ProgressScope::current());
+
+        auto writer(getDriver(dst).putStream(stripType(dst)));
+
+        driver.getStream(
+                stripType(file),
+                [&writer, &bytes, progress](const char* data, std::size_t size)
+                {
+                    writer->write(data, size);
+                    bytes += size;
+                    if (progress) progress->add(size);
+                });
+
+        writer->done();
+        span.done(bytes);
+    }
+
+    if (Progress* progress = ProgressScope::current()) progress->fileDone();
+}
+
+bool Arbiter::isMappedUpload(
+        const std::string& src,
+        const std::string& dst) const
+{
+    return dynamic_cast<const drivers::Fs*>(&getDriver(src)) &&
+        getDriver(dst).capabilities().multipart;
+}
+
+bool Arbiter::isRemote(const std::string& path) const
+{
+    return getDriver(path).isRemote();
+}
+
+Capabilities Arbiter::capabilities(const std::string& path) const
+{
+    return getDriver(path).capabilities();
+}
+
+bool Arbiter::isLocal(const std::string& path) const
+{
+    return !isRemote(path);
+}
+
+bool Arbiter::exists(const std::string& path) const
+{
+    const Driver& driver(getDriver(path));
+    const std::string stripped(stripType(path));
+    TraceSpan span(m_tracer.get(), driver, "exists", stripped);
+    const bool result(m_exists->run(
+                keyOf(path),
+                [&driver, &stripped]() { return driver.exists(stripped); }));
+    span.done();
     return result;
 }
 
-std::string Arbiter::getExtension(const std::string path)
+bool Arbiter::isHttpDerived(const std::string& path) const
+{
+    return tryGetHttpDriver(path) != nullptr;
+}
+
+std::vector<std::string> Arbiter::resolve(
+        const std::string& path,
+        const bool verbose) const
+{
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "resolve", stripType(path));
+    std::vector<std::string> results(driver.resolve(stripType(path), verbose));
+    span.done();
+    return results;
+}
+
+void Arbiter::resolve(
+        const std::string& path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "resolve", stripType(path));
+    driver.resolve(stripType(path), f, verbose);
+    span.done();
+}
+
+std::vector<std::string> Arbiter::resolve(
+        const std::string& path,
+        const std::size_t shard,
+        const std::size_t shards,
+        const bool verbose) const
+{
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "resolve", stripType(path));
+    std::vector<std::string> results(
+            driver.resolve(stripType(path), shard, shards, verbose));
+    span.done();
+    return results;
+}
+
+PathList Arbiter::resolveList(
+        const std::string& path,
+        const bool verbose) const
+{
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "resolveList", stripType(path));
+    PathList results(driver.resolveList(stripType(path), verbose));
+    span.done();
+    return results;
+}
+
+std::vector<FileInfo> Arbiter::resolveInfo(
+        const std::string& path,
+        const bool verbose) const
+{
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "resolveInfo", stripType(path));
+    std::vector<FileInfo> results(
+            driver.resolveInfo(stripType(path), verbose));
+    span.done();
+    return results;
+}
+
+void Arbiter::resolveInfo(
+        const std::string& path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const Driver& driver(getDriver(path));
+    TraceSpan span(m_tracer.get(), driver, "resolveInfo", stripType(path));
+    driver.resolveInfo(stripType(path), f, verbose);
+    span.done();
+}
+
+std::unique_ptr<Watch> Arbiter::watch(
+        const std::string& path,
+        ChangeCallback f,
+        const std::chrono::milliseconds interval) const
+{
+    return getDriver(path).watch(stripType(path), std::move(f), interval);
+}
+
+Endpoint Arbiter::getEndpoint(const std::string root) const
+{
+    return Endpoint(
+            getDriver(root),
+            stripType(root),
+            m_executor,
+            m_tracer,
+            m_prefetch.get());
+}
+
+const Driver& Arbiter::getDriver(const std::string& path) const
+{
+    const Driver* driver(findDriver(path));
+    if (!driver) throw ArbiterError("No driver for " + path);
+    return *driver;
+}
+
+const Driver* Arbiter::findDriver(const std::string& path) const
+{
+    static const std::string fileType("file");
+
+    const std::size_t pos(path.find(delimiter));
+    const std::string& type(pos == std::string::npos ? fileType : path);
+    const std::size_t size(pos == std::string::npos ? fileType.size() : pos);
+
+    const std::shared_ptr<const DriverTable> table(
+            std::atomic_load(&m_drivers));
+    for (const auto& entry : *table)
+    {
+        if (entry.first.size() != size) continue;
+        if (entry.first.compare(0, size, type, 0, size)) continue;
+
+        DriverSlot& slot(*entry.second);
+        std::call_once(slot.once, [&slot]()
+        {
+            if (!slot.driver && slot.create) slot.driver = slot.create();
+        });
+        return slot.driver.get();
+    }
+
+    return nullptr;
+}
+
+const Driver* Arbiter::tryFindDriver(const std::string& path) const
+{
+    try
+    {
+        return findDriver(path);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+std::vector<const Driver*> Arbiter::getDrivers(
+        const std::vector<std::string>& paths) const
+{
+    std::vector<const Driver*> drivers;
+    drivers.reserve(paths.size());
+    for (const std::string& path : paths) drivers.push_back(findDriver(path));
+    return drivers;
+}
+
+const Driver* Arbiter::tryGetAsyncDriver(const std::string& path) const
+{
+    if (m_tracer) return nullptr;
+
+    const Driver* driver(findDriver(path));
+    return driver && driver->isAsync() ? driver : nullptr;
+}
+
+const drivers::Http* Arbiter::tryGetHttpDriver(const std::string& path) const
+{
+    const Driver* driver(&getDriver(path));
+    while (const Driver* inner = driver->wrapped()) driver = inner;
+    return dynamic_cast<const drivers::Http*>(driver);
+}
+
+bool Arbiter::useBlocks(const Driver& driver) const
+{
+    return m_blocks && driver.isRemote() && driver.capabilities().rangedReads;
+}
+
+std::vector<char> Arbiter::getBlocks(
+        const Driver& driver,
+        const std::string& path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    const std::string stripped(stripType(path));
+    return m_blocks->get(
+            keyOf(path),
+            offset,
+            length,
+            [&driver, &stripped](std::size_t offset, std::size_t length)
+            {
+                return driver.getRange(stripped, offset, length);
+            });
+}
+
+Arbiter::SharedData Arbiter::coalescedGet(
+        const Driver& driver,
+        const std::string& path) const
+{
+    const std::string stripped(stripType(path));
+    return m_reads->run(keyOf(path), [&]()
+    {
+        const MemoryBudget::Reservation reservation(reserve(driver, path));
+        if (m_transfer && driver.isRemote()) return getPlanned(driver, path);
+        return SharedData(driver.tryGetBinary(stripped));
+    });
+}
+
+Arbiter::SharedData Arbiter::getPlanned(
+        const Driver& driver,
+        const std::string& path) const
+{
+    const std::string stripped(stripType(path));
+    const SharedSize size(coalescedGetSize(driver, path));
+    const TransferPlan plan(
+            size ?
+                m_transfer->planGet(*size, m_executor->size()) :
+                TransferPlan());
+
+    if (plan.method == TransferPlan::Method::Ranged &&
+            driver.capabilities().rangedReads)
+    {
+        SharedData data(std::make_shared<std::vector<char>>(*size));
+        std::atomic<bool> good(true);
+
+        // Each part is timed alone, which measures a single connection.
+        parallelFor(plan.parts, m_executor->size(), [&](const std::size_t i)
+        {
+            if (!good) return;
+
+            const std::size_t begin(i * plan.partSize);
+            const std::size_t length(
+                    (std::min)(plan.partSize, *size - begin));
+
+            try
+            {
+                const auto start(std::chrono::steady_clock::now());
+                const std::vector<char> part(
+                        driver.getRange(stripped, begin, length));
+                m_transfer->record(part.size(), secondsSince(start));
+
+                if (part.size() != length) good = false;
+                std::copy(part.begin(), part.end(), data->begin() + begin);
+            }
+            catch (...)
+            {
+                good = false;
+            }
+        }, m_executor);
+
+        // Otherwise the object may have changed since its size was looked
+        // up, so whatever it now holds is read whole.
+        if (good) return data;
+    }
+
+    const auto start(std::chrono::steady_clock::now());
+    SharedData data(driver.tryGetBinary(stripped));
+    if (data) m_transfer->record(data->size(), secondsSince(start));
+    return data;
+}
+
+bool Arbiter::putPlanned(
+        const Driver& driver,
+        const std::string& path,
+        const char* const data,
+        const std::size_t size) const
+{
+    if (!m_transfer || !driver.capabilities().multipart) return false;
+
+    const TransferPlan plan(m_transfer->planPut(size));
+    if (plan.method != TransferPlan::Method::Multipart) return false;
+
+    driver.putParts(stripType(path), data, size, plan.partSize);
+    return true;
+}
+
+Arbiter::SharedData Arbiter::readShared(
+        const Driver& driver,
+        const std::string& path) const
+{
+    SharedData data;
+    if (m_prefetch->take(keyOf(path), data)) return data;
+    return coalescedGet(driver, path);
+}
+
+Arbiter::SharedSize Arbiter::coalescedGetSize(
+        const Driver& driver,
+        const std::string& path) const
+{
+    const std::string stripped(stripType(path));
+    return m_sizes->run(keyOf(path), [&]()
+    {
+        return SharedSize(driver.tryGetSize(stripped));
+    });
+}
+
+MemoryBudget::Reservation Arbiter::reserve(
+        const Driver& driver,
+        const std::string& path) const
+{
+    if (!m_budget) return MemoryBudget::Reservation();
+
+    const SharedSize size(coalescedGetSize(driver, path));
+    if (!size) return MemoryBudget::Reservation();
+
+    return m_budget->reserve(*size);
+}
+
+void Arbiter::dropCached(const std::string& path) const
+{
+    const std::string key(keyOf(path));
+    if (m_blocks) m_blocks->erase(key);
+
+    m_reads->forget(key);
+    m_prefetch->erase(key);
+    m_sizes->forget(key);
+    m_exists->forget(key);
+
+    const Driver* driver(findDriver(path));
+    if (auto m = dynamic_cast<const drivers::MetadataCache*>(driver))
+    {
+        m->erase(stripType(path));
+    }
+}
+
+const drivers::Http& Arbiter::getHttpDriver(const std::string& path) const
+{
+    if (auto d = tryGetHttpDriver(path)) return *d;
+    else throw ArbiterError("Cannot get driver for " + path + " as HTTP");
+}
+
+std::unique_ptr<LocalHandle> Arbiter::getLocalHandle(
+        const std::string& path,
+        const Endpoint& tempEndpoint) const
+{
+    std::unique_ptr<LocalHandle> localHandle;
+
+    if (isRemote(path))
+    {
+        if (tempEndpoint.isRemote())
+        {
+            throw ArbiterError("Temporary endpoint must be local.");
+        }
+
+        const std::string basename(tempBasename(path));
+
+        // The handle is created first so that a failed download is removed.
+        localHandle.reset(
+                new LocalHandle(tempEndpoint.root() + basename, true));
+
+        const Driver& driver(getDriver(path));
+        TraceSpan span(m_tracer.get(), driver, "getFile", stripType(path));
+        driver.getFile(stripType(path), localHandle->localPath());
+        span.done();
+    }
+    else
+    {
+        localHandle.reset(
+                new LocalHandle(expandTilde(stripType(path)), false));
+    }
+
+    return localHandle;
+}
+
+std::unique_ptr<LocalHandle> Arbiter::getLocalHandle(
+        const std::string& path,
+        std::string tempPath) const
+{
+    if (tempPath.empty()) tempPath = getTempPath();
+    return getLocalHandle(path, getEndpoint(tempPath));
+}
+
+std::unique_ptr<LocalHandle> Arbiter::getLocalHandle(
+        const std::string& path,
+        const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+        const Endpoint& tempEndpoint) const
+{
+    if (!isRemote(path)) return getLocalHandle(path, tempEndpoint);
+
+    if (tempEndpoint.isRemote())
+    {
+        throw ArbiterError("Temporary endpoint must be local.");
+    }
+
+    const std::size_t size(getSize(path));
+
+    std::unique_ptr<LocalHandle> localHandle(
+            new LocalHandle(tempEndpoint.root() + tempBasename(path), true));
+
+    // The file stays open for the life of the handle, so that each fill
+    // writes its range into place.
+    std::shared_ptr<WritableFile> file(
+            std::make_shared<WritableFile>(localHandle->localPath(), size));
+
+    localHandle->m_fill = [this, path, size, file](
+            const std::size_t offset,
+            const std::size_t length)
+    {
+        if (offset >= size) return;
+
+        const std::vector<char> data(getRange(
+                    path,
+                    offset,
+                    (std::min)(length, size - offset)));
+        file->write(offset, data.data(), data.size());
+    };
+
+    const LocalHandle& handle(*localHandle);
+    parallelFor(ranges.size(), m_executor->size(), [&](const std::size_t i)
+    {
+        handle.fill(ranges[i].first, ranges[i].second);
+    }, m_executor);
+
+    return localHandle;
+}
+
+std::unique_ptr<LocalHandle> Arbiter::getLocalHandle(
+        const std::string& path,
+        const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+        std::string tempPath) const
+{
+    if (tempPath.empty()) tempPath = getTempPath();
+    return getLocalHandle(path, ranges, getEndpoint(tempPath));
+}
+
+std::vector<BatchResult<std::unique_ptr<LocalHandle>>>
+Arbiter::getLocalHandleMany(
+        const std::vector<std::string>& paths,
+        const Endpoint& tempEndpoint) const
+{
+    std::vector<BatchResult<std::unique_ptr<LocalHandle>>> results(
+            paths.size());
+
+    runBatch(results, *m_executor, [&](const std::size_t i)
+    {
+        results[i].value = getLocalHandle(paths[i], tempEndpoint);
+    });
+
+    return results;
+}
+
+std::vector<BatchResult<std::unique_ptr<LocalHandle>>>
+Arbiter::getLocalHandleMany(
+        const std::vector<std::string>& paths,
+        std::string tempPath) const
+{
+    if (tempPath.empty()) tempPath = getTempPath();
+    return getLocalHandleMany(paths, getEndpoint(tempPath));
+}
+
+std::string Arbiter::getType(const std::string& path)
+{
+    const std::size_t pos(path.find(delimiter));
+    if (pos == std::string::npos) return "file";
+    return path.substr(0, pos);
+}
+
+std::string Arbiter::stripType(const std::string& raw)
+{
+    const std::size_t pos(raw.find(delimiter));
+    if (pos == std::string::npos) return raw;
+    return raw.substr(pos + delimiter.size());
+}
+
+std::string Arbiter::keyOf(const std::string& path)
+{
+    if (path.find(delimiter) != std::string::npos) return path;
+    return "file" + delimiter + path;
+}
+
+std::string Arbiter::getExtension(const std::string& path)
 {
     const std::size_t pos(path.find_last_of('.'));
 
@@ -426,7 +2326,7 @@ std::string Arbiter::getExtension(const std::string path)
     else return std::string();
 }
 
-std::string Arbiter::stripExtension(const std::string path)
+std::string Arbiter::stripExtension(const std::string& path)
 {
     const std::size_t pos(path.find_last_of('.'));
     return path.substr(0, pos);
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 #include <string>
 
@@ -10,15 +17,47 @@
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/endpoint.hpp>
 #include <arbiter/driver.hpp>
+#include <arbiter/drivers/archive.hpp>
+#include <arbiter/drivers/cache.hpp>
+#include <arbiter/drivers/cas.hpp>
+#include <arbiter/drivers/compressed.hpp>
 #include <arbiter/drivers/dropbox.hpp>
 #include <arbiter/drivers/fs.hpp>
 #include <arbiter/drivers/google.hpp>
 #include <arbiter/drivers/http.hpp>
+#include <arbiter/drivers/listing.hpp>
+#include <arbiter/drivers/memory.hpp>
+#include <arbiter/drivers/metadata.hpp>
+#include <arbiter/drivers/pack.hpp>
+#include <arbiter/drivers/replica.hpp>
 #include <arbiter/drivers/s3.hpp>
+#include <arbiter/drivers/shard.hpp>
+#include <arbiter/drivers/sidecar.hpp>
 #include <arbiter/drivers/test.hpp>
+#include <arbiter/util/affinity.hpp>
+#include <arbiter/util/blocks.hpp>
+#include <arbiter/util/budget.hpp>
+#include <arbiter/util/buffers.hpp>
+#include <arbiter/util/cancel.hpp>
+#include <arbiter/util/executor.hpp>
+#include <arbiter/util/flight.hpp>
+#include <arbiter/util/log.hpp>
+#include <arbiter/util/metrics.hpp>
+#include <arbiter/util/paths.hpp>
+#include <arbiter/util/prefetch.hpp>
+#include <arbiter/util/priority.hpp>
+#include <arbiter/util/progress.hpp>
+#include <arbiter/util/rate.hpp>
+#include <arbiter/util/record.hpp>
+#include <arbiter/util/runtime.hpp>
+#include <arbiter/util/slowlog.hpp>
+#include <arbiter/util/streambuf.hpp>
 #include <arbiter/util/exports.hpp>
+#include <arbiter/util/trace.hpp>
+#include <arbiter/util/transfer.hpp>
 #include <arbiter/util/types.hpp>
 #include <arbiter/util/util.hpp>
+#include <arbiter/util/writebehind.hpp>
 #endif
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
@@ -31,6 +70,50 @@ namespace arbiter
 
 namespace http { class Pool; }
 
+/** @brief The outcome of one item of a batch operation like
+ * Arbiter::getMany.
+ *
+ * If the item failed, @p error holds the exception which it would have
+ * thrown, which may be rethrown with `std::rethrow_exception`.  Otherwise
+ * @p value holds its result.
+ */
+template <typename T = void>
+struct BatchResult
+{
+    bool ok() const { return !error; }
+
+    T value = T();
+    std::exception_ptr error;
+};
+
+/** @brief The outcome of one item of a batch operation with no result. */
+template <>
+struct BatchResult<void>
+{
+    bool ok() const { return !error; }
+
+    std::exception_ptr error;
+};
+
+/** @brief The files affected by an Arbiter::sync. */
+struct SyncResult
+{
+    /** Files which were new or changed, and so were copied. */
+    std::size_t copied = 0;
+
+    /** Files which were unchanged, and so were not copied. */
+    std::size_t skipped = 0;
+
+    /** Of those skipped, the files between the local filesystem and S3
+     * whose listings differed, but whose contents were found unchanged by
+     * hashing the local file as its S3 ETag.
+     */
+    std::size_t verified = 0;
+
+    /** Extraneous destination files which were removed. */
+    std::size_t removed = 0;
+};
+
 /** @brief The primary interface for storage abstraction.
  *
  * The Arbiter is the primary layer of abstraction for all supported Driver
@@ -51,92 +134,395 @@ public:
      */
     Arbiter();
 
-    /** @brief Construct an Arbiter with driver configurations. */
+    /** @brief Construct an Arbiter with driver configurations.
+     *
+     * Drivers are constructed on first use of their type, so that the cost
+     * of discovering their credentials is only paid for those which are
+     * used.  Errors in the configuration of a driver are likewise only
+     * reported on first use.
+     *
+     * Every driver may also be reached through transparent compression by
+     * prefixing its type with a codec, as in `gz+s3://`.  See
+     * drivers::Compressed, and drivers::Compressed::create for the
+     * `compression` entry of the configuration.
+     *
+     * The members of ZIP archives stored by any driver may be read without
+     * reading the archives in full, by prefixing its type with `zip+`, as
+     * in `zip+s3://bucket/data.zip!/member`.  See drivers::Archive, and
+     * drivers::Archive::create for the `archives` entry of the
+     * configuration.
+     *
+     * Files under the prefixes of the `shards` entry of the configuration
+     * are spread across hashed shard prefixes, to spread their requests
+     * across partitions.  See drivers::Sharded.
+     *
+     * The sets of equivalent roots of the `replicas` entry are read as
+     * `replica://<set>/<path>` from whichever root answers fastest.  See
+     * drivers::Replicated::create.
+     *
+     * Files written as `cas://<name>` are stored once per distinct content
+     * beneath the root of the `cas` entry.  See drivers::ContentStore.
+     *
+     * The sets of packs of the `packs` entry, written by PackWriter, are
+     * read as `pack://<set>/<path>`.  See drivers::Packs::create.
+     *
+     * Threads may be pinned to CPUs by the `affinity` entry, whose `io`,
+     * `workers`, and `compute` entries pin the HTTP I/O threads, the
+     * threads of our Executor, and those which decode responses.  Each is
+     * given as by Affinity::create, for example `{ "node": 0 }` for the CPUs
+     * of the first NUMA node.  Buffers are allocated when first written, by
+     * the pinned threads, and so land on their nodes.
+     *
+     * The operations of a workload may be recorded to a file by the
+     * `record` entry, for example `{ "path": "workload.trace" }`, for later
+     * replay by a Replayer.  See Recorder.  Installing another Tracer stops
+     * the recording.
+     */
     Arbiter(std::string stringifiedJson);
 
-    /** True if a Driver has been registered for this file type. */
-    bool hasDriver(std::string path) const;
+    /** As above, but running asynchronous operations and the concurrent
+     * parts of all operations on @p executor rather than on an Executor of
+     * our own, so that it may be shared with the rest of an application.
+     * If @p executor is null, our own is created as usual, with the number
+     * of threads given by the `threads` entry of the configuration.
+     *
+     * A shared @p executor must outlive this Arbiter, which must not be
+     * destroyed while its asynchronous operations remain outstanding, since
+     * their tasks are no longer completed by its destruction.  Prefetching,
+     * which runs unbidden, should be left unconfigured.
+     */
+    Arbiter(std::string stringifiedJson, std::shared_ptr<Executor> executor);
+
+    /** @brief Construct an Arbiter using the resources of @p runtime.
+     *
+     * Our drivers are configured by @p stringifiedJson as above, but the
+     * HTTP pools, executors, block cache, memory budget, and transfer
+     * planner are those of @p runtime, so the entries of the configuration
+     * which would describe them are ignored.  Many Arbiters with different
+     * drivers, as for different tenants, may so share one Runtime, and with
+     * it the credentials discovered for each S3 profile.
+     *
+     * As with a shared executor, this Arbiter must not be destroyed while
+     * its asynchronous operations remain outstanding if @p runtime is
+     * shared.  A `sidecar` entry requires that of @p runtime.
+     */
+    Arbiter(
+            std::shared_ptr<Runtime> runtime,
+            std::string stringifiedJson = "");
+
+    /** True if a Driver has been registered for this file type.  This
+     * constructs the Driver, if it hasn't already been.
+     */
+    bool hasDriver(const std::string& path) const;
 
     /** @brief Add a custom driver for the supplied type.
      *
      * After this operation completes, future requests into arbiter beginning
      * with the prefix @p type followed by the delimiter `://` will be routed
      * to the supplied @p driver.  If a Driver of type @p type already exists,
-     * the supplied @p driver will replace it.
+     * the supplied @p driver will replace it, as will the drivers which
+     * compress its files.
      *
      * This operation will throw ArbiterError if @p driver is empty.
      *
-     * @note This operation is not thread-safe.
+     * This may be called while other threads make requests, which are
+     * routed without taking a lock, each to the driver registered when it
+     * began.  Since references to a replaced driver may still be held, it
+     * isn't destroyed until this Arbiter is.
      */
     void addDriver(std::string type, std::unique_ptr<Driver> driver);
 
+    /** @brief Install a Tracer to observe subsequent operations.
+     *
+     * Operations performed through this Arbiter, and through any Endpoint
+     * subsequently created from it, will be reported to @p tracer.  Pass an
+     * empty pointer to remove it.  Without a Tracer, tracing costs nothing
+     * beyond a null check per operation.
+     *
+     * @note This operation is not thread-safe.
+     */
+    void setTracer(std::shared_ptr<Tracer> tracer);
+
+    /** Render our statistics in the OpenMetrics text format, for scraping
+     * by Prometheus or the like.  These are the activity of each HTTP pool,
+     * labeled `default` for the common pool or by type for those configured
+     * by `http.pools`, and the hits and misses of the block cache, if there
+     * is one.  If the installed Tracer is a MetricsTracer, its counts of
+     * operations by driver, operation, and host are included.  Counters are
+     * only gathered when rendered, so this may be called as often as a
+     * scraper likes.
+     */
+    std::string metrics() const;
+
     /** Get data or throw if inaccessible. */
-    std::string get(std::string path) const;
+    std::string get(const std::string& path) const;
 
     /** Get data if accessible. */
-    std::unique_ptr<std::string> tryGet(std::string path) const;
+    std::unique_ptr<std::string> tryGet(const std::string& path) const;
 
     /** Get data in binary form or throw if inaccessible. */
-    std::vector<char> getBinary(std::string path) const;
+    std::vector<char> getBinary(const std::string& path) const;
 
     /** Get data in binary form if accessible. */
-    std::unique_ptr<std::vector<char>> tryGetBinary(std::string path) const;
+    std::unique_ptr<std::vector<char>> tryGetBinary(const std::string& path) const;
+
+    /** Read into @p data without throwing, so that reads expected to miss
+     * are cheap, and so that a missing file can be told apart from a
+     * refused request.  Unlike tryGetBinary, the read is passed straight to
+     * the driver, without being shared with concurrent reads of the same
+     * path.  See Driver::tryRead.
+     */
+    Status tryRead(const std::string& path, std::vector<char>& data) const;
+
+    /** Read into the caller's buffer of @p size bytes at @p data, returning
+     * the number of bytes read.  Throws if inaccessible or if the data would
+     * not fit.
+     */
+    std::size_t getInto(const std::string& path, char* data, std::size_t size) const;
+
+    /** Read up to @p length bytes starting at byte @p offset.  See
+     * Driver::getRange.  For remote paths, this is served through the block
+     * cache, if one is configured.  See Arbiter::blockCache.
+     */
+    std::vector<char> getRange(
+            const std::string& path,
+            std::size_t offset,
+            std::size_t length) const;
+
+    /** Read each of @p ranges of @p path, given as pairs of offset and
+     * length, returning their data in the same order.  Nearby ranges are
+     * merged into single reads, which are run concurrently.  See
+     * Driver::getRanges, to which the `rangeGap` configuration entry is
+     * passed as the gap, by default 64 KiB.  For remote paths, ranges are
+     * instead served through the block cache, if one is configured.
+     */
+    std::vector<std::vector<char>> getRanges(
+            const std::string& path,
+            const std::vector<std::pair<std::size_t, std::size_t>>& ranges)
+        const;
+
+    /** Get a read-only, seekable stream buffer over @p path, for reading
+     * it with a std::istream without holding the whole of it.  Blocks are
+     * read as by Arbiter::getRange, and read ahead on our Executor, so this
+     * Arbiter must outlive the buffer.  @p j may be stringified JSON with the
+     * settings described by RemoteStreamBuf::create.  Throws ArbiterError if
+     * the size of @p path cannot be found.
+     */
+    std::unique_ptr<RemoteStreamBuf> getStreamBuf(
+            const std::string& path,
+            std::string j = "") const;
 
     /** Get file size in bytes or throw if inaccessible. */
-    std::size_t getSize(std::string path) const;
+    std::size_t getSize(const std::string& path) const;
 
     /** Get file size in bytes if accessible. */
-    std::unique_ptr<std::size_t> tryGetSize(std::string path) const;
+    std::unique_ptr<std::size_t> tryGetSize(const std::string& path) const;
+
+    /** Look up the file size in bytes without throwing.  See
+     * Driver::tryReadSize.
+     */
+    Status tryReadSize(const std::string& path, std::size_t& size) const;
 
     /** Write data to path. */
-    void put(std::string path, const std::string& data) const;
+    void put(const std::string& path, const std::string& data) const;
 
     /** Write data to path. */
-    void put(std::string path, const std::vector<char>& data) const;
+    void put(const std::string& path, const std::vector<char>& data) const;
+
+    /** Write data to path, passing ownership of it to the driver.  See
+     * Driver::put(std::string, std::vector<char>&&) const.
+     */
+    void put(const std::string& path, std::vector<char>&& data) const;
+
+    /** Write @p size bytes to path, pulled in pieces from @p source.  See
+     * Driver::putFrom.
+     */
+    void putFrom(
+            const std::string& path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size) const;
+
+    /** Upload the local file at @p localPath to @p path without reading it
+     * into memory in full.
+     */
+    void putFile(std::string localPath, const std::string& path) const;
 
     /** Get data with additional HTTP-specific parameters.  Throws if
      * isHttpDerived is false for this path. */
     std::string get(
-            std::string path,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     /** Get data with additional HTTP-specific parameters.  Throws if
      * isHttpDerived is false for this path. */
     std::unique_ptr<std::string> tryGet(
-            std::string path,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     /** Get data in binary form with additional HTTP-specific parameters.
-     * Throws if isHttpDerived is false for this path. */
+     * Throws if isHttpDerived is false for this path.  If the only parameter
+     * is a `Range` header for a single bounded range, this is served through
+     * the block cache, if one is configured.  See Arbiter::blockCache. */
     std::vector<char> getBinary(
-            std::string path,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     /** Get data in binary form with additional HTTP-specific parameters.
      * Throws if isHttpDerived is false for this path. */
     std::unique_ptr<std::vector<char>> tryGetBinary(
-            std::string path,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     /** Write data to path with additional HTTP-specific parameters.
      * Throws if isHttpDerived is false for this path. */
     void put(
-            std::string path,
+            const std::string& path,
             const std::string& data,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     /** Write data to path with additional HTTP-specific parameters.
      * Throws if isHttpDerived is false for this path. */
     void put(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
+
+    /* Asynchronous variants of the operations above.  These are scheduled
+     * on an internal Executor, whose size may be set with the `threads` key
+     * of the Arbiter configuration, and share the same HTTP pool as the
+     * synchronous operations.  Errors are propagated through the resulting
+     * future.
+     */
+
+    /** Asynchronous Arbiter::get. */
+    std::future<std::string> getAsync(const std::string& path) const;
+
+    /** Asynchronous Arbiter::getBinary. */
+    std::future<std::vector<char>> getBinaryAsync(const std::string& path) const;
+
+    /** Asynchronous Arbiter::getSize. */
+    std::future<std::size_t> getSizeAsync(const std::string& path) const;
+
+    /** Asynchronous Arbiter::put.  The data is copied, so the caller's
+     * buffer need not outlive the operation.
+     */
+    std::future<void> putAsync(const std::string& path, std::string data) const;
+
+    /** Asynchronous Arbiter::put. */
+    std::future<void> putAsync(const std::string& path, std::vector<char> data) const;
+
+    /* Asynchronous variants which pass their outcome to @p done rather than
+     * returning a future, so that no thread need wait on them.  For HTTP,
+     * HTTPS, and S3 paths, reads, writes, and sizes are requests driven by
+     * the transfer engine of the HTTP pool, so that any number of them may
+     * be in flight without holding a thread each.  Everything else runs on
+     * the Executor as above.  Either way, @p done is called on an internal
+     * thread, so should hand off its work rather than block.
+     *
+     * Like the future variants, these skip the coalescing and caching of
+     * concurrent reads, although reads of prefetched paths are served from
+     * their prefetched data.  These are the basis of the awaitables in
+     * arbiter/util/coro.hpp.
+     */
+
+    void getBinaryAsync(
+            const std::string& path,
+            Completion<std::vector<char>> done) const;
+
+    void getSizeAsync(
+            const std::string& path,
+            Completion<std::size_t> done) const;
+
+    void putAsync(
+            const std::string& path,
+            std::vector<char> data,
+            Completion<void> done) const;
+
+    void resolveAsync(
+            const std::string& path,
+            Completion<std::vector<std::string>> done) const;
+
+    /** @brief Write @p data to @p path in the background.
+     *
+     * This returns at once, unless the data of unfinished background writes
+     * would exceed the `limit` of the `writeBehind` entry of the Arbiter
+     * configuration, by default 256 MiB, in which case it waits for some to
+     * finish.  Writes are made as by the completion-based putAsync, so are
+     * retried according to the `http.retry` policy.  Successive writes to
+     * the same path land in order, and a read of a path before its write
+     * has been flushed may see its previous contents.
+     *
+     * If the `writeBehind` entry has a `spool` directory, each write is
+     * first appended to a durable log there, so that writes left unfinished
+     * by the death of the process are made once an Arbiter is next
+     * constructed with that spool.  See WriteBehind::create.
+     */
+    void putBehind(const std::string& path, std::vector<char> data) const;
+
+    /** Wait for all background writes of putBehind to finish.  Throws an
+     * ArbiterError naming each path whose latest write failed since the
+     * last flush, if any.  Destruction also waits for them, but ignores
+     * their failures.
+     */
+    void flush() const;
+
+    /** @brief Begin fetching @p paths in the background.
+     *
+     * Paths are fetched in order, keeping a window of them in flight or
+     * fetched and not yet read, whose size may be set with the `window` key
+     * of the `prefetch` entry of the Arbiter configuration, and which is 8
+     * by default.  Each later read of one of these paths by Arbiter::get,
+     * Arbiter::getBinary, or their `try` variants is served from its
+     * prefetched data, once, which lets the next path start.  A path which
+     * is written through this Arbiter is no longer prefetched.
+     */
+    void prefetch(const std::vector<std::string>& paths) const;
+
+    /* Batch variants of the operations above, for many paths at once.  The
+     * driver for each distinct type is looked up once, and the items are
+     * run concurrently using up to the number of threads given by the
+     * `threads` configuration entry.  Each item succeeds or fails on its own
+     * without affecting the others, so these only throw if the batch could
+     * not be run at all.  Results are in the order of the inputs.
+     */
+
+    /** Batch Arbiter::getBinary. */
+    std::vector<BatchResult<std::vector<char>>> getMany(
+            const std::vector<std::string>& paths) const;
+
+    /** Batch Arbiter::put, of path and data pairs. */
+    std::vector<BatchResult<>> putMany(
+            const std::vector<std::pair<std::string, std::vector<char>>>&
+                items) const;
+
+    /** Batch Arbiter::getSize.  The paths of each driver are passed to its
+     * Driver::tryGetSizes together, as for existsMany, so that Google
+     * Storage, for example, looks them up in batch requests.
+     */
+    std::vector<BatchResult<std::size_t>> getSizeMany(
+            const std::vector<std::string>& paths) const;
+
+    /** Batch Arbiter::exists.  The paths of each driver are passed to its
+     * Driver::tryGetSizes together, so that those whose listings report
+     * sizes, like S3, Google Storage, and the local filesystem, answer the
+     * directories holding many of the paths with a listing of each rather
+     * than a lookup of every path, and look up the rest concurrently.
+     */
+    std::vector<BatchResult<bool>> existsMany(
+            const std::vector<std::string>& paths) const;
+
+    /** Batch Arbiter::remove.  The paths of each driver are passed to its
+     * Driver::removeMany together, so that those which can remove many
+     * files in one request, like S3, do so.
+     */
+    std::vector<BatchResult<>> removeMany(
+            const std::vector<std::string>& paths) const;
 
     /** Copy data from @p src to @p dst.  @p src will be resolved with
      * Arbiter::resolve prior to the copy, so globbed directories are supported.
@@ -145,8 +531,16 @@ public:
      *
      * If @p dst is a filesystem path, mkdirp will be called prior to the
      * start of copying.  If @p src is a recursive glob, `mkdirp` will
-     * be repeatedly called during copying to ensure that any nested directories
-     * are reproduced.
+     * be called during copying to ensure that any nested directories are
+     * reproduced, once for each distinct directory.
+     *
+     * Multiple files are copied concurrently, using up to the number of
+     * threads given by the `threads` configuration entry.  Each file is
+     * copied as by Arbiter::copyFile.
+     *
+     * Copies, like Arbiter::copyResumable and Arbiter::sync, run under
+     * Priority::Bulk, so that their requests yield HTTP handles to other
+     * work once the pool is exhausted.
      */
     void copy(std::string src, std::string dst, bool verbose = false) const;
 
@@ -160,30 +554,98 @@ public:
      */
     void copyFile(std::string file, std::string to, bool verbose = false) const;
 
+    /** Move data from @p src to @p dst, which are resolved as by
+     * Arbiter::copy, so that a directory @p src is moved recursively and a
+     * file moved to a directory @p dst keeps its basename.
+     *
+     * Moves within a single driver use its native move where it has one:
+     * renames for the filesystem, `move_batch_v2` for Dropbox, and for
+     * object stores, server-side copies followed by batched deletes.  Moves
+     * between drivers copy the data, then remove the sources.  A source is
+     * only removed once it has been copied, and on failure the first error
+     * is thrown once every file has been attempted.
+     */
+    void move(std::string src, std::string dst, bool verbose = false) const;
+
+    /** As Arbiter::copy from a directory @p src, but resumable.  Each file
+     * copied is recorded in a journal in the directory @p journal, which
+     * may be on any endpoint, so that if the copy is interrupted, running
+     * it again with the same journal copies only the files which it had
+     * not completed.  The journal is removed once the copy succeeds.
+     *
+     * Since object stores can't append to files, completed files are
+     * recorded in batches, each written as a new small file within
+     * @p journal, at most a few seconds after they complete.
+     */
+    void copyResumable(
+            std::string src,
+            std::string dst,
+            std::string journal,
+            bool verbose = false) const;
+
+    /** Copy only the new or changed files of the directory @p src into the
+     * directory @p dst, mirroring any nested directory structure as
+     * Arbiter::copy does.  Both must end with a slash, or @p src with a
+     * glob.
+     *
+     * Files are compared using the metadata from listings of both sides, so
+     * that unchanged files cost nothing beyond the listings.  A file is
+     * unchanged if its destination exists with the same size, and either
+     * has the same version, where both sides are of the same driver type,
+     * or was modified no earlier than the source.  Where a listing provides
+     * neither, the file is copied.
+     *
+     * Between the local filesystem and S3, a file of the same size which
+     * seems to have changed by its listings is compared by hashing the
+     * local file as S3 computes its ETag, for single or multipart uploads,
+     * which costs a read of the local file but no transfer.  See
+     * crypto::matchesEtag.
+     *
+     * If @p prune is true, destination files with no counterpart in
+     * @p src are then removed, as by Arbiter::removeMany.
+     */
+    SyncResult sync(
+            std::string src,
+            std::string dst,
+            bool prune = false,
+            bool verbose = false) const;
+
+    /** Remove the file at @p path.  Removing a file which does not exist is
+     * not an error.  Throws ArbiterError if the driver for @p path cannot
+     * remove files.
+     */
+    void remove(const std::string& path) const;
+
     /** Returns true if this path is a remote path, or false if it is on the
      * local filesystem.
      */
-    bool isRemote(std::string path) const;
+    bool isRemote(const std::string& path) const;
+
+    /** What the driver of @p path does natively, for callers choosing how
+     * to read, write, copy, or list it.  See Capabilities.
+     */
+    Capabilities capabilities(const std::string& path) const;
 
     /** Returns true if this path is on the local filesystem, or false if it is
      * remote.
      */
-    bool isLocal(std::string path) const;
+    bool isLocal(const std::string& path) const;
 
-    /** Returns true if this path exists.  Equivalent to:
+    /** Returns true if this path exists.  Unless the driver knows better,
+     * as a MetadataCache may, this is equivalent to:
      * @code
      * tryGetSize(path).get() != nullptr
      * @endcode
      *
      * @note This means that an existing file of size zero will return true.
      */
-    bool exists(std::string path) const;
+    bool exists(const std::string& path) const;
 
     /** Returns true if the protocol for this driver is build on HTTP, like the
      * S3 and Dropbox drivers are.  If this returns true, http::Headers and
      * http::Query parameter methods may be used for this path.
      */
-    bool isHttpDerived(std::string path) const;
+    bool isHttpDerived(const std::string& path) const;
 
     /** @brief Resolve a possibly globbed path.
      *
@@ -203,6 +665,11 @@ public:
      * a.resolve("s3://my-bucket/prefix-*");
      * @endcode
      *
+     * Wildcards before the end of @p path, such as in the name of one of its
+     * directories, make it a pattern as described by Glob, whose matching
+     * files are returned from any depth.  The literal prefix of the pattern
+     * is listed, and for S3, only the directories under which it may match.
+     *
      * @note Throws ArbiterError if the selected driver does not support
      * globbing, for example the HTTP driver.
      *
@@ -217,9 +684,104 @@ public:
      * are a vector of size one containing only @p path itself, unaltered.
      */
     std::vector<std::string> resolve(
-            std::string path,
+            const std::string& path,
             bool verbose = false) const;
 
+    /** @brief Resolve a possibly globbed path, calling @p f with each result
+     * as soon as it is available.
+     *
+     * This is useful for very large listings, since results need not be
+     * held in memory at once and processing may begin with the first page of
+     * the listing.  Calls to @p f are serialized, but results are not
+     * necessarily sorted.  Otherwise this behaves like
+     * Arbiter::resolve(std::string, bool) const.
+     */
+    void resolve(
+            const std::string& path,
+            const std::function<void(std::string)>& f,
+            bool verbose = false) const;
+
+    /** @brief Resolve the share numbered @p shard, from zero, of @p shards
+     * shares of the glob @p path, which must end with `*`, sorted by path.
+     *
+     * This lets many workers split a prefix among themselves without a
+     * coordinator: if each resolves a different share, with the same
+     * @p shards, every file is resolved by exactly one of them, as long as
+     * the files under @p path do not change until all of them are done.
+     * Each share of an S3 or Google Storage prefix is a run of consecutive
+     * keys, and each of a local directory a set of its entries chosen by
+     * hashing their names, so that each worker lists little more than its
+     * own share.  To agree on their shares, workers each list the levels
+     * of @p path, one at a time, down to the first at which there are at
+     * least @p shards entries, which for a prefix whose files lie flat
+     * within it means listing all of them.  Other drivers list everything
+     * and keep the files whose paths hash to @p shard.
+     */
+    std::vector<std::string> resolve(
+            const std::string& path,
+            std::size_t shard,
+            std::size_t shards,
+            bool verbose = false) const;
+
+    /** @brief Resolve a possibly globbed path into a compact PathList,
+     * sorted by path.
+     *
+     * The prefix which the results share is held once and the rest of each
+     * is packed into large blocks, which suits listings of millions of files
+     * that as separate strings would cost far more memory and allocation.
+     * The S3, Google Storage, Dropbox, and filesystem drivers fill the list
+     * as they list, without building a string for each path.  Otherwise
+     * this behaves like Arbiter::resolve(std::string, bool) const.
+     */
+    PathList resolveList(const std::string& path, bool verbose = false) const;
+
+    /** @brief Resolve a possibly globbed path, along with the metadata of
+     * each file which the listing provides, sorted by path.
+     *
+     * Listings of S3, Google Storage, and Dropbox include the sizes of
+     * their files, and local listings their sizes, versions, and
+     * modification times, so these need not be looked up one file at a
+     * time afterward.  Metadata which a listing does not include is left
+     * empty, as it is for paths which are not globbed.  Listed sizes are
+     * also recorded by the `metadata` cache, if one is configured.
+     *
+     * Globs within the prefixes of the `listings` entry of the
+     * configuration are resolved from local indexes of those prefixes.  See
+     * drivers::ListingIndex.
+     *
+     * See Arbiter::resolve(std::string, bool) const for the resolution of
+     * paths.
+     */
+    std::vector<FileInfo> resolveInfo(
+            const std::string& path,
+            bool verbose = false) const;
+
+    /** @brief As resolveInfo, but calls @p f with each result as soon as it
+     * is available, with the ordering of
+     * Arbiter::resolve(std::string, std::function, bool) const.
+     */
+    void resolveInfo(
+            const std::string& path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose = false) const;
+
+    /** @brief Deliver the changes to the files matching @p path to @p f
+     * until the returned Watch, which must not outlive us, is destroyed.
+     *
+     * A @p path ending with a slash watches everything beneath it, and
+     * otherwise it is a glob, as for resolve.  Local directories are
+     * watched with inotify on Linux, and S3 and Google Storage buckets by
+     * the notifications delivered to the `notifications` queue or
+     * subscription of their configuration.  Otherwise, @p path is listed
+     * every @p interval, and the changes between listings are delivered.
+     * See Driver::watch.
+     */
+    std::unique_ptr<Watch> watch(
+            const std::string& path,
+            ChangeCallback f,
+            std::chrono::milliseconds interval =
+                std::chrono::seconds(60)) const;
+
     /** @brief Get a reusable Endpoint for this root directory. */
     Endpoint getEndpoint(std::string root) const;
 
@@ -231,14 +793,15 @@ public:
      *
      * Optionally, filesystem paths may be explicitly prefixed with `file://`.
      */
-    const Driver& getDriver(std::string path) const;
+    const Driver& getDriver(const std::string& path) const;
 
     /** @brief Get a LocalHandle to a possibly remote file.
      *
      * If @p path is remote (see Arbiter::isRemote), this operation will fetch
      * the file contents and write them to the local filesystem in the
      * directory represented by @p tmpEndpoint.  The contents of @p path are
-     * not copied if @p path is already local.
+     * not copied if @p path is already local.  Downloads are written to the
+     * file as they arrive rather than held in memory.  See Driver::getFile.
      *
      * There are no filename guarantees if @p path is remote.  Use
      * LocalHandle::localPath to determine this.
@@ -254,7 +817,7 @@ public:
      * @return A LocalHandle for local access to the resulting file.
      */
     std::unique_ptr<LocalHandle> getLocalHandle(
-            std::string path,
+            const std::string& path,
             const Endpoint& tempEndpoint) const;
 
     /** @brief Get a LocalHandle to a possibly remote file.
@@ -263,36 +826,308 @@ public:
      * temporary location.
      */
     std::unique_ptr<LocalHandle> getLocalHandle(
-            std::string path,
+            const std::string& path,
+            std::string tempPath = "") const;
+
+    /** @brief Get a LocalHandle to a possibly remote file of which only the
+     * byte @p ranges, given as pairs of offset and length, are downloaded.
+     *
+     * The local file has the full size of @p path, but holds only the
+     * requested ranges, which are read concurrently as by Arbiter::getRange.
+     * The rest of it is a hole, which reads as zeros and, on filesystems
+     * which support sparse files, takes no space.  Further ranges may be
+     * downloaded with LocalHandle::fill, which requires that this Arbiter
+     * outlive the handle.  Local paths are not copied, as for
+     * getLocalHandle.
+     */
+    std::unique_ptr<LocalHandle> getLocalHandle(
+            const std::string& path,
+            const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+            const Endpoint& tempEndpoint) const;
+
+    /** @brief As above, in @p tempPath, or if that is not specified, a
+     * temporary location from the environment.
+     */
+    std::unique_ptr<LocalHandle> getLocalHandle(
+            const std::string& path,
+            const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+            std::string tempPath = "") const;
+
+    /** @brief Batch Arbiter::getLocalHandle.
+     *
+     * Remote paths are downloaded concurrently, as for the batch operations
+     * above, with each download sharing the HTTP pool and Executor.  Results
+     * are in the order of the inputs, and the failure of one path does not
+     * affect the others.
+     */
+    std::vector<BatchResult<std::unique_ptr<LocalHandle>>> getLocalHandleMany(
+            const std::vector<std::string>& paths,
+            const Endpoint& tempEndpoint) const;
+
+    /** @brief Batch Arbiter::getLocalHandle, into @p tempPath, or if that
+     * is not specified, a temporary location from the environment.
+     */
+    std::vector<BatchResult<std::unique_ptr<LocalHandle>>> getLocalHandleMany(
+            const std::vector<std::string>& paths,
             std::string tempPath = "") const;
 
     /** If no delimiter of "://" is found, returns "file".  Otherwise, returns
      * the substring prior to but not including this delimiter.
      */
-    static std::string getType(std::string path);
+    static std::string getType(const std::string& path);
 
     /** Strip the type and delimiter `://`, if they exist. */
-    static std::string stripType(std::string path);
+    static std::string stripType(const std::string& path);
 
     /** Get the characters following the final instance of '.', or an empty
      * string if there are no '.' characters. */
-    static std::string getExtension(std::string path);
+    static std::string getExtension(const std::string& path);
 
     /** Strip the characters following (and including) the final instance of
      * '.' if one exists, otherwise return the full path. */
-    static std::string stripExtension(std::string path);
+    static std::string stripExtension(const std::string& path);
 
     /** Fetch the common HTTP pool, which may be useful when dynamically
      * constructing adding a Driver via Arbiter::addDriver.
+     *
+     * The pool begins with the number of handles given by the
+     * `http.concurrency` configuration entry, defaulting to 32, and retries
+     * failed requests up to `http.retry.count` times, defaulting to 8.  Its
+     * size may be changed while in use with http::Pool::resize.
+     */
+    http::Pool& httpPool() { return m_runtime->httpPool(); }
+
+    /** Fetch the HTTP pool of the drivers of @p type, like `https` or
+     * `profile@s3`.  This is the common pool unless the `http.pools` entry
+     * of the configuration has an entry for @p type, in which case its
+     * drivers have a pool of their own, configured as the common pool but
+     * with the entries of that object, like `concurrency`, `timeout`,
+     * `retry`, and `http2`, in place of those of `http`.  A source whose
+     * requests stall or fail then can't occupy the handles of the others.
+     */
+    http::Pool& httpPool(const std::string& type);
+
+    /** Fetch the Executor on which asynchronous operations are scheduled,
+     * and onto which concurrent work like parallel copies, ranged downloads,
+     * multipart uploads, and recursive listings is spread.
+     */
+    Executor& executor() const { return *m_executor; }
+
+    /** Fetch the Executor on which CPU-bound stages of transfers, like the
+     * decompression of response bodies, run apart from the threads doing
+     * I/O.  Its threads are given by the `computeThreads` configuration
+     * entry, by default the number of hardware threads.
+     */
+    Executor& compute() const { return *m_compute; }
+
+    /** Fetch the in-memory cache of ranged reads from remote paths, or null
+     * if there is none.  It is created by the `blocks` key of the Arbiter
+     * configuration, as described by BlockCache::create.  Writes through
+     * this Arbiter drop the cached blocks of their destination, but changes
+     * made elsewhere are not seen while blocks remain cached.
      */
-    http::Pool& httpPool() { return *m_pool; }
+    BlockCache* blockCache() const { return m_blocks; }
+
+    /** Fetch the limit on the bytes held by transfers in flight, or null if
+     * there is none.  It is created by the `memory` key of the Arbiter
+     * configuration, as described by MemoryBudget::create.
+     *
+     * With a budget, each whole-file read and each copy between drivers
+     * reserves the size of its file before it begins, waiting if the budget
+     * is exhausted, and releases it once the file has been read or
+     * written.  Sizes are looked up first, as by
+     * Arbiter::getSize, so that reads of unlisted remote files may cost an
+     * additional request.
+     */
+    MemoryBudget* memoryBudget() const { return m_budget; }
+
+    /** Fetch the planner which chooses how whole files are transferred, or
+     * null if there is none.  It is created by the `transfer` key of the
+     * Arbiter configuration, as described by TransferPlanner::create.
+     *
+     * With a planner, whole-file reads of remote paths look up their sizes
+     * first, as by Arbiter::getSize, and those it plans as ranged are read
+     * in parts concurrently on the executor.  Writes of remote paths which
+     * it plans as multipart are passed to Driver::putParts.
+     */
+    TransferPlanner* transferPlanner() const { return m_transfer; }
+
+    /** Fetch the Runtime whose resources we use, which may be shared with
+     * other Arbiters.
+     */
+    const std::shared_ptr<Runtime>& runtime() const { return m_runtime; }
 
 private:
-    const drivers::Http* tryGetHttpDriver(std::string path) const;
-    const drivers::Http& getHttpDriver(std::string path) const;
+    // Copy each of @p paths, all within @p srcRoot, to the same relative
+    // path within @p dst, passing the relative path of each to @p copied
+    // once it is complete, if given.
+    void copyFiles(
+            const std::vector<std::string>& paths,
+            const std::string& srcRoot,
+            const Endpoint& dst,
+            bool verbose,
+            const std::function<void(const std::string&)>& copied =
+                nullptr) const;
+
+    // As copyFiles, for copies within a single remote driver, which are
+    // handed to it in batches through Driver::copyMany.
+    void copyBatches(
+            const std::vector<std::string>& paths,
+            const std::string& srcRoot,
+            const Endpoint& dst,
+            bool verbose,
+            const std::function<void(const std::string&)>& copied) const;
+
+    // Move each pair of source and destination paths, both of the driver of
+    // @p driver, in batches through Driver::moveMany.
+    void moveBatches(
+            const Driver& driver,
+            const std::vector<std::pair<std::string, std::string>>& pairs,
+            bool verbose) const;
+
+    // As the public overload, creating local directories through @p dirs.
+    void copyFile(
+            std::string file,
+            std::string to,
+            bool verbose,
+            DirectoryCache& dirs) const;
+
+    // The driver for @p path if it performs its own asynchronous I/O, which
+    // is bypassed when tracing so that every operation is recorded.
+    const Driver* tryGetAsyncDriver(const std::string& path) const;
+
+    // A driver, or the means to construct it on first use.
+    struct DriverSlot
+    {
+        std::once_flag once;
+        std::function<std::unique_ptr<Driver>()> create;
+        std::unique_ptr<Driver> driver;
+    };
+
+    using DriverTable =
+        std::vector<std::pair<std::string, std::shared_ptr<DriverSlot>>>;
+
+    // Add or replace the driver of @p type, publishing a new table.
+    void setDriver(const std::string& type, std::unique_ptr<DriverSlot> slot);
+
+    // Add or replace the drivers which compress the files of the driver of
+    // @p type, one for each codec, as `<codec>+<type>`.
+    void addCompressed(const std::string& type);
+
+    // Add or replace the driver which reads the members of ZIP archives
+    // stored by the driver of @p type, as `zip+<type>`.
+    void addArchive(const std::string& type);
+
+    // The driver for the type of @p path, constructing it if necessary, or
+    // null if there is none.  The type is matched in place against a short
+    // flat table, so routing allocates nothing and takes no lock.
+    const Driver* findDriver(const std::string& path) const;
+
+    // As findDriver, but also null if constructing the driver throws.
+    const Driver* tryFindDriver(const std::string& path) const;
+
+    // The driver for each of @p paths.  Paths with no driver map to null.
+    std::vector<const Driver*> getDrivers(
+            const std::vector<std::string>& paths) const;
+
+    const drivers::Http* tryGetHttpDriver(const std::string& path) const;
+    const drivers::Http& getHttpDriver(const std::string& path) const;
+
+    // True if ranges of @p driver are read through the block cache, which
+    // only pays for remote drivers which read ranges natively.
+    bool useBlocks(const Driver& driver) const;
+
+    // Read a range of @p path from @p driver through the block cache.
+    std::vector<char> getBlocks(
+            const Driver& driver,
+            const std::string& path,
+            std::size_t offset,
+            std::size_t length) const;
+
+    // Reserve the size of @p path from the memory budget, if there is one
+    // and the size can be found.
+    MemoryBudget::Reservation reserve(
+            const Driver& driver,
+            const std::string& path) const;
+
+    // Drop any cached blocks and metadata of @p path, which is being
+    // written, for writes which may bypass the MetadataCache, and keep
+    // later reads from joining those already in flight.
+    void dropCached(const std::string& path) const;
+
+    // Identical concurrent reads and lookups share a single request.
+    using SharedData = std::shared_ptr<std::vector<char>>;
+    using SharedSize = std::shared_ptr<const std::size_t>;
+
+    SharedData coalescedGet(
+            const Driver& driver,
+            const std::string& path) const;
+
+    // Read @p path, which is remote, as planned by our TransferPlanner,
+    // measuring the throughput of the transfer.
+    SharedData getPlanned(const Driver& driver, const std::string& path) const;
+
+    // True if copies from @p src to @p dst are sent from a mapping of the
+    // source, which is a local file, to a driver whose uploads don't copy
+    // the caller's buffer.
+    bool isMappedUpload(const std::string& src, const std::string& dst) const;
+
+    // Write @p path as a multipart upload if so planned by our
+    // TransferPlanner, returning false if it is not.
+    bool putPlanned(
+            const Driver& driver,
+            const std::string& path,
+            const char* data,
+            std::size_t size) const;
+
+    // Look up the sizes of @p paths by passing those of each driver to its
+    // Driver::tryGetSizes together, traced as @p operation.
+    std::vector<BatchResult<std::unique_ptr<std::size_t>>> tryGetSizesGrouped(
+            const std::vector<std::string>& paths,
+            const char* operation) const;
+
+    // Read @p path from its prefetched data, if any, and otherwise through
+    // a coalesced read.
+    SharedData readShared(const Driver& driver, const std::string& path) const;
+    SharedSize coalescedGetSize(
+            const Driver& driver,
+            const std::string& path) const;
+
+    // The key by which @p path is cached and coalesced, which is @p path
+    // itself if it is prefixed with its type.
+    static std::string keyOf(const std::string& path);
+
+    // The drivers by type.  The table is never modified once published,
+    // but replaced whole under the registry mutex, so that routing loads it
+    // atomically without a lock.  Replaced slots are retired rather than
+    // destroyed, since their drivers may still be in use.
+    std::shared_ptr<const DriverTable> m_drivers;
+    std::mutex m_registry;
+    std::vector<std::shared_ptr<DriverSlot>> m_retired;
+    std::string m_compression;
+    std::string m_archives;
+    std::size_t m_rangeGap = 0;
+
+    std::shared_ptr<Tracer> m_tracer;
+
+    std::unique_ptr<SingleFlight<SharedData>> m_reads;
+    std::unique_ptr<SingleFlight<SharedSize>> m_sizes;
+    std::unique_ptr<SingleFlight<bool>> m_exists;
+    std::unique_ptr<Prefetcher> m_prefetch;
+
+    // Destroyed next to last, so any outstanding tasks complete on its
+    // executor while the drivers they reference still exist, unless it is
+    // shared.  The rest are borrowed from it.
+    std::shared_ptr<Runtime> m_runtime;
+    Executor* m_executor = nullptr;
+    Executor* m_compute = nullptr;
+    BlockCache* m_blocks = nullptr;
+    MemoryBudget* m_budget = nullptr;
+    TransferPlanner* m_transfer = nullptr;
 
-    DriverMap m_drivers;
-    std::unique_ptr<http::Pool> m_pool;
+    // Destroyed first, waiting for background writes to drain through the
+    // pool and the executor.
+    std::unique_ptr<WriteBehind> m_writeBehind;
 };
 
 } // namespace arbiter
@@ -2,8 +2,17 @@
 #include <arbiter/driver.hpp>
 
 #include <arbiter/arbiter.hpp>
+#include <arbiter/util/crc32c.hpp>
 #endif
 
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
 {
@@ -12,18 +21,194 @@ namespace ARBITER_CUSTOM_NAMESPACE
 namespace arbiter
 {
 
+namespace
+{
+    class BufferedWriter : public Writer
+    {
+    public:
+        BufferedWriter(const Driver& driver, std::string path)
+            : m_driver(driver)
+            , m_path(path)
+        { }
+
+        virtual void write(const char* data, std::size_t size) override
+        {
+            m_data.insert(m_data.end(), data, data + size);
+        }
+
+        virtual void done() override { m_driver.put(m_path, m_data); }
+
+    private:
+        const Driver& m_driver;
+        const std::string m_path;
+        std::vector<char> m_data;
+    };
+
+    // An empty list for the results of resolving @p path with @p driver,
+    // whose prefix is the directory they share, up to its first wildcard.
+    PathList listFor(const Driver& driver, const std::string& path)
+    {
+        const std::string expanded(
+                driver.isRemote() ? path : expandTilde(path));
+        const std::size_t slash(
+                expanded.rfind('/', expanded.find_first_of("*?[")));
+        const std::string dir(
+                slash == std::string::npos ?
+                    std::string() : expanded.substr(0, slash + 1));
+
+        return PathList(driver.isRemote() ? driver.type() + "://" + dir : dir);
+    }
+
+    // A directory holding at least this many of the paths looked up
+    // together is listed rather than looking up each of them, since a page
+    // of a listing covers up to 1000 files for about the cost of a lookup.
+    const std::size_t listedLookups(16);
+
+    // Watches by diffing successive listings.
+    class PollingWatch : public Watch
+    {
+    public:
+        PollingWatch(
+                const Driver& driver,
+                const std::string path,
+                ChangeCallback f,
+                const std::chrono::milliseconds interval)
+            : m_driver(driver)
+            , m_path(path.size() && path.back() == '/' ? path + "**" : path)
+            , m_f(std::move(f))
+            , m_interval(interval)
+        {
+            // The first listing is the baseline against which changes are
+            // found, so it is taken before we return.
+            m_files = list();
+            m_thread = std::thread([this]() { run(); });
+        }
+
+        ~PollingWatch()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done = true;
+            }
+            m_cv.notify_all();
+            m_thread.join();
+        }
+
+    private:
+        using Files = std::map<std::string, FileInfo>;
+
+        Files list() const
+        {
+            Files files;
+
+            const std::string& p(m_path);
+            if (Glob::isPattern(p) || (p.size() > 1 && p.back() == '*'))
+            {
+                m_driver.resolveInfo(p, [&files](FileInfo info)
+                {
+                    files[info.path] = std::move(info);
+                });
+            }
+            else if (auto size = m_driver.tryGetSize(p))
+            {
+                // A single file, whose listing is a lookup.
+                m_driver.resolve(p, [&](std::string resolved)
+                {
+                    FileInfo info(resolved);
+                    info.hasSize = true;
+                    info.size = *size;
+                    if (auto version = m_driver.tryGetVersion(p))
+                    {
+                        info.version = *version;
+                    }
+                    files[resolved] = info;
+                });
+            }
+
+            return files;
+        }
+
+        static bool same(const FileInfo& a, const FileInfo& b)
+        {
+            return
+                a.hasSize == b.hasSize &&
+                a.size == b.size &&
+                a.version == b.version &&
+                a.modified == b.modified;
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto done([this]() { return m_done; });
+            while (!m_cv.wait_for(lock, m_interval, done))
+            {
+                lock.unlock();
+                try { poll(); }
+                catch (std::exception& e)
+                {
+                    logging::warn(
+                            "Could not list " + m_path + " to watch it: " +
+                            e.what());
+                }
+                lock.lock();
+            }
+        }
+
+        void poll()
+        {
+            Files files(list());
+
+            ChangeEvent event;
+            for (const auto& entry : files)
+            {
+                auto it(m_files.find(entry.first));
+                if (it == m_files.end() || !same(it->second, entry.second))
+                {
+                    event.type = ChangeEvent::Type::Changed;
+                    event.info = entry.second;
+                    m_f(event);
+                }
+            }
+            for (const auto& entry : m_files)
+            {
+                if (!files.count(entry.first))
+                {
+                    event.type = ChangeEvent::Type::Removed;
+                    event.info = FileInfo(entry.first);
+                    m_f(event);
+                }
+            }
+
+            m_files = std::move(files);
+        }
+
+        const Driver& m_driver;
+        const std::string m_path;
+        const ChangeCallback m_f;
+        const std::chrono::milliseconds m_interval;
+
+        Files m_files;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_done = false;
+        std::thread m_thread;
+    };
+}
+
 std::string Driver::get(const std::string path) const
 {
-    const std::vector<char> data(getBinary(path));
-    return std::string(data.begin(), data.end());
+    std::string data;
+    if (!getText(path, data)) throw ArbiterError("Could not read file " + path);
+    return data;
 }
 
 std::unique_ptr<std::string> Driver::tryGet(const std::string path) const
 {
-    std::unique_ptr<std::string> result;
-    std::unique_ptr<std::vector<char>> data(tryGetBinary(path));
-    if (data) result.reset(new std::string(data->begin(), data->end()));
-    return result;
+    std::unique_ptr<std::string> data(new std::string());
+    if (!getText(path, *data)) data.reset();
+    return data;
 }
 
 std::vector<char> Driver::getBinary(std::string path) const
@@ -40,15 +225,265 @@ std::unique_ptr<std::vector<char>> Driver::tryGetBinary(std::string path) const
     return data;
 }
 
+bool Driver::getText(const std::string path, std::string& data) const
+{
+    std::vector<char> binary;
+    if (!get(path, binary)) return false;
+    data.assign(binary.begin(), binary.end());
+    return true;
+}
+
+Status Driver::tryRead(const std::string path, std::vector<char>& data) const
+{
+    try
+    {
+        data.clear();
+        return get(path, data) ? Status() : Status(Status::Code::NotFound);
+    }
+    catch (...)
+    {
+        return Status(Status::Code::Failed);
+    }
+}
+
+Status Driver::tryReadSize(const std::string path, std::size_t& size) const
+{
+    try
+    {
+        const auto found(tryGetSize(path));
+        if (!found) return Status(Status::Code::NotFound);
+        size = *found;
+        return Status();
+    }
+    catch (...)
+    {
+        return Status(Status::Code::Failed);
+    }
+}
+
 std::size_t Driver::getSize(const std::string path) const
 {
     if (auto size = tryGetSize(path)) return *size;
     else throw ArbiterError("Could not get size of " + path);
 }
 
+bool Driver::exists(const std::string path) const
+{
+    return tryGetSize(path).get() != nullptr;
+}
+
+std::unique_ptr<std::string> Driver::tryGetVersion(
+        const std::string path) const
+{
+    if (auto size = tryGetSize(path))
+    {
+        return makeUnique<std::string>(std::to_string(*size));
+    }
+    return std::unique_ptr<std::string>();
+}
+
+ChangedData Driver::tryGetChanged(
+        const std::string path,
+        const std::string& version) const
+{
+    ChangedData result;
+
+    const auto current(tryGetVersion(path));
+    if (!current) return result;
+
+    result.exists = true;
+    result.version = *current;
+    if (*current == version) return result;
+
+    if (auto data = tryGetBinary(path))
+    {
+        result.changed = true;
+        result.data = std::move(*data);
+    }
+    else result.exists = false;
+
+    return result;
+}
+
+std::vector<std::unique_ptr<std::size_t>> Driver::tryGetSizes(
+        const std::vector<std::string>& paths) const
+{
+    if (capabilities().listingMetadata) return tryGetSizesListed(paths);
+
+    std::vector<std::unique_ptr<std::size_t>> sizes;
+    for (const std::string& path : paths) sizes.push_back(tryGetSize(path));
+    return sizes;
+}
+
+std::vector<std::unique_ptr<std::size_t>> Driver::tryGetSizesListed(
+        const std::vector<std::string>& paths,
+        const std::size_t threads,
+        Executor* executor,
+        const SizesLookup& lookup,
+        std::size_t batchSize) const
+{
+    std::vector<std::unique_ptr<std::size_t>> sizes(paths.size());
+    if (!lookup || !batchSize) batchSize = 1;
+
+    // Each path as its listing would report it, grouped by directory.
+    std::vector<std::string> listedPaths;
+    std::map<std::string, std::vector<std::size_t>> dirs;
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        const std::string path(isRemote() ? paths[i] : expandTilde(paths[i]));
+        const std::size_t slash(path.rfind('/'));
+        dirs[slash == std::string::npos ? "" : path.substr(0, slash + 1)]
+            .push_back(i);
+        listedPaths.push_back(isRemote() ? type() + "://" + path : path);
+    }
+
+    std::vector<const std::string*> listed;
+    std::vector<std::size_t> single;
+    for (const auto& dir : dirs)
+    {
+        if (dir.first.size() && dir.second.size() >= listedLookups)
+        {
+            listed.push_back(&dir.first);
+        }
+        else single.insert(single.end(), dir.second.begin(), dir.second.end());
+    }
+
+    const std::size_t batches((single.size() + batchSize - 1) / batchSize);
+    parallelFor(listed.size() + batches, threads, [&](std::size_t i)
+    {
+        if (i >= listed.size())
+        {
+            const std::size_t begin((i - listed.size()) * batchSize);
+            const std::size_t end((std::min)(begin + batchSize, single.size()));
+
+            if (!lookup)
+            {
+                sizes[single[begin]] = tryGetSize(paths[single[begin]]);
+                return;
+            }
+
+            std::vector<std::string> batch;
+            for (std::size_t j(begin); j < end; ++j)
+            {
+                batch.push_back(paths[single[j]]);
+            }
+
+            std::vector<std::unique_ptr<std::size_t>> found(lookup(batch));
+            for (std::size_t j(begin); j < end; ++j)
+            {
+                sizes[single[j]] = std::move(found.at(j - begin));
+            }
+            return;
+        }
+
+        const std::string& dir(*listed[i]);
+        std::map<std::string, std::size_t> found;
+        globInfo(dir + "*", [&found](FileInfo info)
+        {
+            if (info.hasSize) found[info.path] = info.size;
+        }, false);
+
+        for (const std::size_t index : dirs.at(dir))
+        {
+            const auto it(found.find(listedPaths[index]));
+            if (it != found.end())
+            {
+                sizes[index] = makeUnique<std::size_t>(it->second);
+            }
+        }
+    }, executor);
+
+    return sizes;
+}
+
+std::future<std::vector<char>> Driver::getBinaryAsync(
+        const std::string path) const
+{
+    std::promise<std::vector<char>> promise;
+
+    try { promise.set_value(getBinary(path)); }
+    catch (...) { promise.set_exception(std::current_exception()); }
+
+    return promise.get_future();
+}
+
+std::future<void> Driver::putAsync(
+        const std::string path,
+        std::vector<char> data) const
+{
+    std::promise<void> promise;
+
+    try
+    {
+        put(path, std::move(data));
+        promise.set_value();
+    }
+    catch (...) { promise.set_exception(std::current_exception()); }
+
+    return promise.get_future();
+}
+
+void Driver::getBinaryThen(
+        const std::string path,
+        const Completion<std::vector<char>> done,
+        Executor& executor) const
+{
+    executor.post([this, path, done]()
+    {
+        complete(done, [this, &path]() { return getBinary(path); });
+    });
+}
+
+void Driver::putThen(
+        const std::string path,
+        std::vector<char> data,
+        const Completion<void> done,
+        Executor& executor) const
+{
+    // Shared so that the task, which must be copyable, needn't copy it.
+    auto shared(std::make_shared<std::vector<char>>(std::move(data)));
+    executor.post([this, path, shared, done]()
+    {
+        complete(done, [&]() { put(path, std::move(*shared)); });
+    });
+}
+
+void Driver::tryGetSizeThen(
+        const std::string path,
+        const Completion<std::unique_ptr<std::size_t>> done,
+        Executor& executor) const
+{
+    executor.post([this, path, done]()
+    {
+        complete(done, [this, &path]() { return tryGetSize(path); });
+    });
+}
+
+void Driver::put(
+        const std::string path,
+        const char* const data,
+        const std::size_t size) const
+{
+    put(path, std::vector<char>(data, data + size));
+}
+
+void Driver::put(const std::string path, std::vector<char>&& data) const
+{
+    put(path, static_cast<const std::vector<char>&>(data));
+}
+
+void Driver::putParts(
+        const std::string path,
+        const char* const data,
+        const std::size_t size,
+        std::size_t) const
+{
+    put(path, data, size);
+}
+
 void Driver::put(std::string path, const std::string& data) const
 {
-    put(path, std::vector<char>(data.begin(), data.end()));
+    put(path, data.data(), data.size());
 }
 
 void Driver::copy(std::string src, std::string dst) const
@@ -56,26 +491,283 @@ void Driver::copy(std::string src, std::string dst) const
     put(dst, getBinary(src));
 }
 
+void Driver::remove(const std::string path) const
+{
+    throw ArbiterError("Cannot remove " + path + " from driver " + type());
+}
+
+std::vector<std::exception_ptr> Driver::copyMany(
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        const std::size_t threads) const
+{
+    std::vector<std::exception_ptr> errors(pairs.size());
+    parallelFor(pairs.size(), threads, [&](const std::size_t i)
+    {
+        try { copy(pairs[i].first, pairs[i].second); }
+        catch (...) { errors[i] = std::current_exception(); }
+    });
+    return errors;
+}
+
+Capabilities Driver::capabilities() const
+{
+    if (const Driver* inner = wrapped()) return inner->capabilities();
+    return Capabilities();
+}
+
+void Driver::move(const std::string src, const std::string dst) const
+{
+    copy(src, dst);
+    remove(src);
+}
+
+std::vector<std::exception_ptr> Driver::moveMany(
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        const std::size_t threads) const
+{
+    std::vector<std::exception_ptr> errors(copyMany(pairs, threads));
+
+    std::vector<std::size_t> copied;
+    std::vector<std::string> sources;
+    for (std::size_t i(0); i < pairs.size(); ++i)
+    {
+        if (errors[i]) continue;
+        copied.push_back(i);
+        sources.push_back(pairs[i].first);
+    }
+
+    const std::vector<std::exception_ptr> removed(
+            removeMany(sources, threads));
+    for (std::size_t j(0); j < copied.size(); ++j)
+    {
+        errors[copied[j]] = removed[j];
+    }
+    return errors;
+}
+
+std::vector<std::exception_ptr> Driver::removeMany(
+        const std::vector<std::string>& paths,
+        const std::size_t threads) const
+{
+    std::vector<std::exception_ptr> errors(paths.size());
+    parallelFor(paths.size(), threads, [&](const std::size_t i)
+    {
+        try { remove(paths[i]); }
+        catch (...) { errors[i] = std::current_exception(); }
+    });
+    return errors;
+}
+
+void Driver::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    const std::vector<char> data(getBinary(path));
+    sink(data.data(), data.size());
+}
+
+std::size_t Driver::getInto(
+        const std::string path,
+        char* const data,
+        const std::size_t size) const
+{
+    std::size_t written(0);
+    getStream(path, bufferSink(path, data, size, written));
+    return written;
+}
+
+std::vector<char> Driver::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    const std::vector<char> data(getBinary(path));
+    if (offset >= data.size()) return std::vector<char>();
+
+    const std::size_t end(offset + (std::min)(length, data.size() - offset));
+    return std::vector<char>(data.begin() + offset, data.begin() + end);
+}
+
+void Driver::getFile(
+        const std::string path,
+        const std::string localPath) const
+{
+    std::ofstream stream(
+            localPath,
+            std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+
+    if (!stream.good())
+    {
+        throw ArbiterError("Could not open " + localPath + " for writing");
+    }
+
+    getStream(path, [&stream](const char* data, std::size_t size)
+    {
+        stream.write(data, size);
+    });
+
+    stream.close();
+    if (!stream.good())
+    {
+        throw ArbiterError("Error occurred while writing " + localPath);
+    }
+}
+
+std::vector<std::vector<char>> Driver::getRanges(
+        const std::string path,
+        const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+        const std::size_t gap,
+        Executor& executor) const
+{
+    std::vector<std::size_t> readOf;
+    const std::vector<std::pair<std::size_t, std::size_t>> reads(
+            mergeRanges(ranges, gap, readOf));
+
+    std::vector<std::vector<char>> data(reads.size());
+    parallelFor(reads.size(), executor.size(), [&](const std::size_t i)
+    {
+        data[i] = getRange(
+                path,
+                reads[i].first,
+                reads[i].second - reads[i].first);
+    }, &executor);
+
+    return splitRanges(ranges, reads, readOf, data);
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> Driver::mergeRanges(
+        const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+        const std::size_t gap,
+        std::vector<std::size_t>& readOf)
+{
+    // Merge the ranges in order of offset, noting which read holds each.
+    std::vector<std::size_t> order(ranges.size());
+    for (std::size_t i(0); i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+    {
+        return ranges[a].first < ranges[b].first;
+    });
+
+    std::vector<std::pair<std::size_t, std::size_t>> reads;
+    readOf.assign(ranges.size(), 0);
+
+    for (const std::size_t i : order)
+    {
+        const std::size_t begin(ranges[i].first);
+        const std::size_t end(begin + ranges[i].second);
+        if (begin == end) continue;
+
+        const bool merge(
+                !reads.empty() &&
+                (begin <= reads.back().second ||
+                    begin - reads.back().second <= gap));
+
+        if (merge) reads.back().second = (std::max)(reads.back().second, end);
+        else reads.emplace_back(begin, end);
+
+        readOf[i] = reads.size() - 1;
+    }
+
+    return reads;
+}
+
+std::vector<std::vector<char>> Driver::splitRanges(
+        const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+        const std::vector<std::pair<std::size_t, std::size_t>>& reads,
+        const std::vector<std::size_t>& readOf,
+        const std::vector<std::vector<char>>& data)
+{
+    std::vector<std::vector<char>> results(ranges.size());
+    for (std::size_t i(0); i < ranges.size(); ++i)
+    {
+        if (!ranges[i].second) continue;
+
+        const std::vector<char>& read(data[readOf[i]]);
+        const std::size_t begin(
+                (std::min)(
+                    ranges[i].first - reads[readOf[i]].first,
+                    read.size()));
+        const std::size_t end(
+                (std::min)(begin + ranges[i].second, read.size()));
+        results[i].assign(read.begin() + begin, read.begin() + end);
+    }
+
+    return results;
+}
+
+std::function<void(const char*, std::size_t)> Driver::bufferSink(
+        const std::string& path,
+        char* const data,
+        const std::size_t size,
+        std::size_t& written)
+{
+    return [path, data, size, &written](const char* in, std::size_t n)
+    {
+        if (n > size - written)
+        {
+            throw ArbiterError(
+                    "Buffer of " + std::to_string(size) +
+                    " bytes is too small for " + path);
+        }
+
+        std::copy(in, in + n, data + written);
+        written += n;
+    };
+}
+
+void Driver::putFrom(
+        const std::string path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size) const
+{
+    static const std::size_t chunkSize(4 * 1024 * 1024);
+
+    auto writer(putStream(path));
+    std::vector<char> buffer((std::min)(size, chunkSize));
+
+    for (std::size_t done(0); done < size; )
+    {
+        const std::size_t want((std::min)(buffer.size(), size - done));
+        const std::size_t n(source(buffer.data(), want));
+        if (!n) throw ArbiterError("Source ended early writing " + path);
+
+        writer->write(buffer.data(), n);
+        done += n;
+    }
+
+    writer->done();
+}
+
+std::unique_ptr<Writer> Driver::putStream(const std::string path) const
+{
+    return std::unique_ptr<Writer>(new BufferedWriter(*this, path));
+}
+
 std::vector<std::string> Driver::resolve(
         std::string path,
         const bool verbose) const
 {
     std::vector<std::string> results;
 
-    if (path.size() > 1 && path.back() == '*')
+    if (Glob::isPattern(path))
     {
-        if (verbose)
+        resolve(path, [&results](std::string p)
         {
-            std::cout << "Resolving [" << type() << "]: " << path << " ..." <<
-                std::flush;
-        }
+            results.push_back(std::move(p));
+        }, verbose);
+        std::sort(results.begin(), results.end());
+    }
+    else if (path.size() > 1 && path.back() == '*')
+    {
+        if (verbose) logging::info("Resolving [" + type() + "]: " + path);
 
         results = glob(path, verbose);
 
         if (verbose)
         {
-            std::cout << "\n\tResolved to " << results.size() <<
-                " paths." << std::endl;
+            logging::info(
+                    "\tResolved to " + std::to_string(results.size()) +
+                    " paths.");
         }
     }
     else
@@ -89,11 +781,325 @@ std::vector<std::string> Driver::resolve(
     return results;
 }
 
-std::vector<std::string> Driver::glob(std::string path, bool verbose) const
+void Driver::resolve(
+        std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    const bool pattern(Glob::isPattern(path));
+
+    if (pattern || (path.size() > 1 && path.back() == '*'))
+    {
+        if (verbose) logging::info("Resolving [" + type() + "]: " + path);
+
+        std::size_t count(0);
+        auto counted([&f, &count](std::string p)
+        {
+            ++count;
+            f(std::move(p));
+        });
+
+        if (pattern)
+        {
+            globPattern(
+                    Glob(isRemote() ? path : expandTilde(path)),
+                    [&counted](FileInfo info)
+                    {
+                        counted(std::move(info.path));
+                    },
+                    verbose);
+        }
+        else glob(path, counted, verbose);
+
+        if (verbose)
+        {
+            logging::info(
+                    "\tResolved to " + std::to_string(count) + " paths.");
+        }
+    }
+    else
+    {
+        if (isRemote()) path = type() + "://" + path;
+        else path = expandTilde(path);
+
+        f(path);
+    }
+}
+
+std::vector<FileInfo> Driver::resolveInfo(
+        const std::string path,
+        const bool verbose) const
+{
+    std::vector<FileInfo> results;
+    resolveInfo(path, [&results](FileInfo info)
+    {
+        results.push_back(std::move(info));
+    }, verbose);
+
+    std::sort(
+            results.begin(),
+            results.end(),
+            [](const FileInfo& a, const FileInfo& b)
+            {
+                return a.path < b.path;
+            });
+    return results;
+}
+
+void Driver::resolveInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const bool pattern(Glob::isPattern(path));
+
+    if (pattern || (path.size() > 1 && path.back() == '*'))
+    {
+        if (verbose) logging::info("Resolving [" + type() + "]: " + path);
+
+        if (pattern)
+        {
+            globPattern(
+                    Glob(isRemote() ? path : expandTilde(path)),
+                    f,
+                    verbose);
+        }
+        else globInfo(path, f, verbose);
+    }
+    else
+    {
+        // A path which is not globbed has no listing to describe it.
+        resolve(path, [&f](std::string p) { f(FileInfo(std::move(p))); });
+    }
+}
+
+void Driver::resolveInfoAfter(
+        const std::string path,
+        const std::string& after,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    if (path.size() < 2 || path.back() != '*')
+    {
+        throw ArbiterError("Cannot list after a path in: " + path);
+    }
+
+    globInfoAfter(path, after, f, verbose);
+}
+
+std::vector<std::string> Driver::resolve(
+        const std::string path,
+        const std::size_t shard,
+        const std::size_t shards,
+        const bool verbose) const
+{
+    if (shard >= shards)
+    {
+        throw ArbiterError(
+                "Invalid share " + std::to_string(shard) + " of " +
+                std::to_string(shards));
+    }
+
+    if (Glob::isPattern(path) || path.size() < 2 || path.back() != '*')
+    {
+        throw ArbiterError("Cannot resolve a share of: " + path);
+    }
+
+    if (verbose)
+    {
+        logging::info(
+                "Resolving [" + type() + "] share " + std::to_string(shard) +
+                " of " + std::to_string(shards) + ": " + path);
+    }
+
+    std::vector<std::string> results;
+    auto found([&results](FileInfo info)
+    {
+        results.push_back(std::move(info.path));
+    });
+
+    globShard(
+            isRemote() ? path : expandTilde(path),
+            shard,
+            shards,
+            found,
+            verbose);
+
+    std::sort(results.begin(), results.end());
+    return results;
+}
+
+std::unique_ptr<Watch> Driver::watch(
+        const std::string path,
+        ChangeCallback f,
+        const std::chrono::milliseconds interval) const
+{
+    return std::unique_ptr<Watch>(
+            new PollingWatch(*this, path, std::move(f), interval));
+}
+
+PathList Driver::resolveList(const std::string path, const bool verbose) const
+{
+    if (!Glob::isPattern(path) && path.size() > 1 && path.back() == '*')
+    {
+        if (verbose) logging::info("Resolving [" + type() + "]: " + path);
+
+        PathList list(globList(path, verbose));
+        list.sort();
+
+        if (verbose)
+        {
+            logging::info(
+                    "\tResolved to " + std::to_string(list.size()) +
+                    " paths.");
+        }
+        return list;
+    }
+
+    // Patterns are matched as they are listed, and paths which are not
+    // globbed resolve to themselves.
+    PathList list(listFor(*this, path));
+    resolve(path, [&list](std::string p) { list.push(p); }, verbose);
+    list.sort();
+    return list;
+}
+
+PathList Driver::globList(const std::string path, const bool verbose) const
+{
+    PathList list(listFor(*this, path));
+    glob(path, [&list](std::string p) { list.push(p); }, verbose);
+    return list;
+}
+
+std::vector<std::string> Driver::glob(std::string path, bool) const
 {
     throw ArbiterError("Cannot glob driver for: " + path);
 }
 
+void Driver::glob(
+        std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    for (auto& p : glob(path, verbose)) f(std::move(p));
+}
+
+void Driver::globInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    glob(path, [&f](std::string p) { f(FileInfo(std::move(p))); }, verbose);
+}
+
+void Driver::globInfoAfter(
+        const std::string path,
+        const std::string& after,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [&after, &f](FileInfo info)
+    {
+        if (Arbiter::stripType(info.path) > after) f(std::move(info));
+    }, verbose);
+}
+
+void Driver::globShard(
+        const std::string path,
+        const std::size_t shard,
+        const std::size_t shards,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [shard, shards, &f](FileInfo info)
+    {
+        const std::string stripped(Arbiter::stripType(info.path));
+        if (crypto::crc32c(stripped) % shards == shard) f(std::move(info));
+    }, verbose);
+}
+
+std::vector<Driver::ShardEntry> Driver::shardEntries(
+        const std::string& dir,
+        const std::size_t shards,
+        const bool recursive,
+        const LevelList& list) const
+{
+    const std::string root(isRemote() ? type() + "://" : "");
+
+    std::vector<ShardEntry> entries;
+    std::vector<std::string> level { dir };
+
+    while (level.size())
+    {
+        std::vector<std::string> next;
+        for (const std::string& listed : level)
+        {
+            list(listed, [&entries](FileInfo info)
+            {
+                entries.emplace_back(std::move(info), false);
+            },
+            [&next](std::string sub) { next.push_back(std::move(sub)); });
+        }
+
+        level.clear();
+        if (!recursive) break;
+
+        if (entries.size() + next.size() < shards) level.swap(next);
+        else
+        {
+            for (const std::string& sub : next)
+            {
+                entries.emplace_back(FileInfo(root + sub), true);
+            }
+        }
+    }
+
+    std::sort(
+            entries.begin(),
+            entries.end(),
+            [](const ShardEntry& a, const ShardEntry& b)
+            {
+                return a.info.path < b.info.path;
+            });
+    return entries;
+}
+
+std::pair<std::size_t, std::size_t> Driver::shardRange(
+        const std::size_t count,
+        const std::size_t shard,
+        const std::size_t shards)
+{
+    return std::make_pair(count * shard / shards, count * (shard + 1) / shards);
+}
+
+void Driver::globPattern(
+        const Glob& glob,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    // Remote listings may begin partway through a name, while those of the
+    // filesystem begin with a directory.
+    const std::string& prefix(glob.prefix());
+    const std::string listed(
+            isRemote() ?
+                prefix :
+                prefix.substr(0, prefix.find_last_of('/') + 1));
+
+    const std::string root(isRemote() ? type() + "://" : "");
+
+    globInfo(
+            listed + (glob.recursive() ? "**" : "*"),
+            [&](FileInfo info)
+            {
+                if (info.path.compare(0, root.size(), root) == 0 &&
+                        glob.match(info.path.substr(root.size())))
+                {
+                    f(std::move(info));
+                }
+            },
+            verbose);
+}
+
 } // namespace arbiter
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
@@ -1,13 +1,22 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/executor.hpp>
 #include <arbiter/util/exports.hpp>
+#include <arbiter/util/glob.hpp>
+#include <arbiter/util/paths.hpp>
 #endif
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
@@ -20,6 +29,191 @@ namespace arbiter
 
 class HttpPool;
 
+/** @brief A file found by resolving a path, with whatever metadata the
+ * listing which found it provided, so that it need not be looked up again.
+ */
+struct ARBITER_DLL FileInfo
+{
+    FileInfo() { }
+    explicit FileInfo(std::string path) : path(std::move(path)) { }
+
+    /** The path, as returned by Driver::resolve. */
+    std::string path;
+
+    /** The size in bytes, which is only known if @p hasSize is true. */
+    bool hasSize = false;
+    std::size_t size = 0;
+
+    /** The token returned by Driver::tryGetVersion, like an ETag, or empty
+     * if unknown.
+     */
+    std::string version;
+
+    /** The time of the last modification in seconds since the epoch, or
+     * zero if unknown.
+     */
+    std::int64_t modified = 0;
+};
+
+/** @brief The outcome of a read made only if a file has changed.  See
+ * Driver::tryGetChanged.
+ */
+struct ARBITER_DLL ChangedData
+{
+    /** False if the file does not exist, in which case the rest is unset. */
+    bool exists = false;
+
+    /** True if the file no longer has the version it was read against, in
+     * which case @p data holds its contents.
+     */
+    bool changed = false;
+
+    /** The current version of the file, as by Driver::tryGetVersion. */
+    std::string version;
+
+    std::vector<char> data;
+};
+
+/** @brief The outcome of an operation which reports failure rather than
+ * throwing, like Driver::tryRead, so that reads expected to miss cost no
+ * exception.
+ */
+struct ARBITER_DLL Status
+{
+    enum class Code
+    {
+        Ok,
+        /** The file does not exist. */
+        NotFound,
+        /** The server refused the request for its rate, and it may succeed
+         * if made again later.
+         */
+        Throttled,
+        /** Any other failure. */
+        Failed
+    };
+
+    Status() { }
+    explicit Status(Code code, int httpCode = 0)
+        : code(code)
+        , httpCode(httpCode)
+    { }
+
+    /** The outcome described by an HTTP response code. */
+    static Status fromHttp(int httpCode)
+    {
+        if (httpCode >= 200 && httpCode < 300)
+        {
+            return Status(Code::Ok, httpCode);
+        }
+        if (httpCode == 404 || httpCode == 410)
+        {
+            return Status(Code::NotFound, httpCode);
+        }
+        if (httpCode == 429 || httpCode == 503)
+        {
+            return Status(Code::Throttled, httpCode);
+        }
+        return Status(Code::Failed, httpCode);
+    }
+
+    bool ok() const { return code == Code::Ok; }
+    explicit operator bool() const { return ok(); }
+
+    Code code = Code::Ok;
+
+    /** The code of the HTTP response which decided the outcome, or zero if
+     * there was none, as for drivers which aren't HTTP-based or requests
+     * which failed before a response arrived.
+     */
+    int httpCode = 0;
+};
+
+/** @brief What a driver does natively, beyond reading and writing whole
+ * files, so that callers may choose the fastest strategy it supports.
+ *
+ * See Driver::capabilities.
+ */
+struct Capabilities
+{
+    /** Byte ranges are read without reading the rest of the file. */
+    bool rangedReads = false;
+
+    /** Files are copied without their data passing through us. */
+    bool serverSideCopy = false;
+
+    /** Large files are written by Driver::putParts as multipart uploads. */
+    bool multipart = false;
+
+    /** A directory is listed alone, without listing everything beneath
+     * it, as object stores do with a delimiter.
+     */
+    bool delimiters = false;
+
+    /** Listings report the size of each file, so Driver::globInfo needs
+     * no request per file to find it.
+     */
+    bool listingMetadata = false;
+
+    /** Driver::watch is driven by notifications of changes, rather than by
+     * polling listings, so that its cost scales with the changes rather
+     * than with the files watched.
+     */
+    bool changeNotifications = false;
+};
+
+/** @brief A change to a file, as delivered by Driver::watch. */
+struct ARBITER_DLL ChangeEvent
+{
+    enum class Type
+    {
+        /** The file was created or overwritten. */
+        Changed,
+        /** The file was removed. */
+        Removed
+    };
+
+    Type type = Type::Changed;
+
+    /** The file, with its path as returned by Driver::resolve, and such
+     * metadata as the notification carried.
+     */
+    FileInfo info;
+};
+
+using ChangeCallback = std::function<void(const ChangeEvent&)>;
+
+/** @brief A subscription to changes, returned by Driver::watch, which ends
+ * when it is destroyed.
+ *
+ * Destruction waits for any callback in progress, and for notifications
+ * which are long-polled, for the poll in progress.  A Watch must not
+ * outlive the Driver which created it.
+ */
+class ARBITER_DLL Watch
+{
+public:
+    virtual ~Watch() { }
+};
+
+/** @brief Destination for data which is written in sequential pieces.
+ *
+ * See Driver::putStream.
+ */
+class ARBITER_DLL Writer
+{
+public:
+    virtual ~Writer() { }
+
+    /** Append @p size bytes from @p data. */
+    virtual void write(const char* data, std::size_t size) = 0;
+
+    /** Complete the write.  Until this succeeds, the destination should not
+     * be considered to hold the data that has been written.
+     */
+    virtual void done() = 0;
+};
+
 /** @brief Base class for interacting with a storage type.
  *
  * A Driver handles reading, writing, and possibly globbing from a storage
@@ -71,25 +265,292 @@ public:
      */
     virtual void put(std::string path, const std::vector<char>& data) const = 0;
 
+    /** Write the @p size bytes at @p data to @p path.
+     *
+     * The default copies them for put, so drivers which can write from the
+     * caller's buffer should override.
+     */
+    virtual void put(std::string path, const char* data, std::size_t size)
+        const;
+
+    /** Write @p data to @p path, taking ownership of it.
+     *
+     * The default passes it to put, so drivers which keep the data they are
+     * given should override.
+     */
+    virtual void put(std::string path, std::vector<char>&& data) const;
+
+    /** Write the @p size bytes at @p data to @p path as a multipart upload
+     * of parts of about @p partSize bytes, for drivers which support them.
+     *
+     * The default performs a single put, which is also what drivers may do
+     * if @p partSize is below the smallest part they can upload.
+     */
+    virtual void putParts(
+            std::string path,
+            const char* data,
+            std::size_t size,
+            std::size_t partSize) const;
+
     /** True for remote paths, otherwise false.  If `true`, a fs::LocalHandle
      * request will download and write this file to the local filesystem.
      */
     virtual bool isRemote() const { return true; }
 
+    /** True if this driver performs asynchronous reads and writes natively,
+     * rather than needing a thread for each, in which case the asynchronous
+     * operations of Arbiter and Endpoint are passed to getBinaryAsync and
+     * putAsync instead of being scheduled on the Executor.
+     */
+    virtual bool isAsync() const { return false; }
+
+    /** The driver which this one wraps, as caches do, or null. */
+    virtual const Driver* wrapped() const { return nullptr; }
+
+    /** What this driver does natively.  The default is those of the driver
+     * which this one wraps, if any, or otherwise none.
+     */
+    virtual Capabilities capabilities() const;
+
+    /** Read @p path asynchronously, with errors propagated through the
+     * resulting future.
+     *
+     * The default reads synchronously and returns a ready future.
+     */
+    virtual std::future<std::vector<char>> getBinaryAsync(
+            std::string path) const;
+
+    /** Write @p data to @p path asynchronously, with errors propagated
+     * through the resulting future.
+     *
+     * The default writes synchronously and returns a ready future.
+     */
+    virtual std::future<void> putAsync(
+            std::string path,
+            std::vector<char> data) const;
+
+    /* Asynchronous operations which pass their outcome to @p done, rather
+     * than returning a future, so that no thread need wait on them.
+     *
+     * The defaults run the synchronous operations as tasks of @p executor.
+     * Drivers whose transfers complete without holding a thread override
+     * them.
+     */
+
+    virtual void getBinaryThen(
+            std::string path,
+            Completion<std::vector<char>> done,
+            Executor& executor) const;
+
+    virtual void putThen(
+            std::string path,
+            std::vector<char> data,
+            Completion<void> done,
+            Executor& executor) const;
+
+    virtual void tryGetSizeThen(
+            std::string path,
+            Completion<std::unique_ptr<std::size_t>> done,
+            Executor& executor) const;
+
     /** Get the file size in bytes, if available. */
     virtual std::unique_ptr<std::size_t> tryGetSize(std::string path) const = 0;
 
+    /** Read @p path into @p data, whose previous contents are replaced,
+     * without throwing.  Reusing @p data across calls reuses its storage.
+     * On failure @p data is unspecified.
+     *
+     * The default wraps Driver::get, reporting any exception as
+     * Status::Code::Failed, so drivers which can tell why a read failed
+     * should override.
+     */
+    virtual Status tryRead(std::string path, std::vector<char>& data) const;
+
+    /** Look up the size in bytes of @p path without throwing.  On failure
+     * @p size is unchanged.
+     *
+     * The default wraps tryGetSize, so drivers which can tell why a lookup
+     * failed should override.
+     */
+    virtual Status tryReadSize(std::string path, std::size_t& size) const;
+
     /** Get the file size in bytes, or throw if it does not exist. */
     std::size_t getSize(std::string path) const;
 
+    /** True if @p path exists.
+     *
+     * The default checks whether tryGetSize finds it.
+     */
+    virtual bool exists(std::string path) const;
+
+    /** Get an opaque token, like an ETag, which changes whenever the
+     * contents of @p path do, or null if it does not exist.  Used to
+     * revalidate cached copies.
+     *
+     * The default is the size, so drivers which can tell apart contents of
+     * the same size should override.
+     */
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const;
+
+    /** Read @p path only if its version, as by tryGetVersion, is no longer
+     * @p version, for revalidating a copy of it.  An empty @p version
+     * matches nothing but files whose version is itself empty.
+     *
+     * The default looks up the version and then reads the file if it has
+     * changed, so drivers which can make conditional reads should override.
+     */
+    virtual ChangedData tryGetChanged(
+            std::string path,
+            const std::string& version) const;
+
+    /** Get the size in bytes of each of @p paths, in the same order, where
+     * any which could not be found are null.
+     *
+     * The default looks up each path in turn with tryGetSize, except that
+     * drivers whose listings report sizes answer directories holding many
+     * of the paths from a listing, as by tryGetSizesListed.  Drivers which
+     * can amortize lookups across many paths otherwise should override.
+     */
+    virtual std::vector<std::unique_ptr<std::size_t>> tryGetSizes(
+            const std::vector<std::string>& paths) const;
+
     /** Write string data. */
     void put(std::string path, const std::string& data) const;
 
+    /** Read @p path in sequential pieces, passing each to @p sink as it
+     * arrives so that the whole file need not be held in memory.  Throws
+     * ArbiterError if @p path cannot be read.
+     *
+     * The default reads the entire file and passes it in a single piece.
+     */
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink) const;
+
+    /** Write @p size bytes to @p path, pulled in sequential pieces from
+     * @p source, which fills up to the requested number of bytes of its
+     * buffer and returns the count filled.  Throws ArbiterError if
+     * @p source runs out early.
+     *
+     * The default feeds the pieces through putStream.
+     */
+    virtual void putFrom(
+            std::string path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size) const;
+
+    /** Read @p path directly into the caller's buffer of @p size bytes at
+     * @p data, returning the number of bytes read.  Throws ArbiterError if
+     * @p path cannot be read or holds more than @p size bytes, in which case
+     * the contents of the buffer are unspecified.
+     *
+     * The default collects the pieces of getStream into the buffer.
+     */
+    virtual std::size_t getInto(
+            std::string path,
+            char* data,
+            std::size_t size) const;
+
+    /** Read up to @p length bytes of @p path starting at byte @p offset.
+     * The result is shorter than @p length if the file ends first, and
+     * empty if @p offset is at or past its end.  Throws ArbiterError if
+     * @p path cannot be read.
+     *
+     * The default reads the whole file and returns the requested portion.
+     */
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const;
+
+    /** Download @p path to the local file @p localPath, replacing any file
+     * there, without holding the whole of it in memory on the way.  Throws
+     * ArbiterError if @p path cannot be read or @p localPath written.
+     *
+     * The default writes the pieces of getStream in turn.
+     */
+    virtual void getFile(std::string path, std::string localPath) const;
+
+    /** Read each of @p ranges of @p path, given as pairs of offset and
+     * length, returning their data in the same order, each shortened as by
+     * getRange.  Ranges which overlap, or are separated by at most @p gap
+     * bytes, are merged into a single read, and the merged reads are run
+     * concurrently on the threads of @p executor.  Throws ArbiterError if
+     * any of them cannot be read.
+     *
+     * The default makes each merged read with getRange.
+     */
+    virtual std::vector<std::vector<char>> getRanges(
+            std::string path,
+            const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+            std::size_t gap,
+            Executor& executor) const;
+
+    /** Begin a write to @p path whose data will be supplied in sequential
+     * pieces.
+     *
+     * The default buffers the data and performs a single put when it is
+     * complete, so drivers which can accept partial writes should override.
+     */
+    virtual std::unique_ptr<Writer> putStream(std::string path) const;
+
     /** Copy a file, where @p src and @p dst must both be of this driver
      * type.  Type-prefixes must be stripped from the input parameters.
      */
     virtual void copy(std::string src, std::string dst) const;
 
+    /** Copy each pair of source and destination paths, both of this driver
+     * type, using up to @p threads concurrent requests, and return the
+     * failure of each in the same order, where those which were copied are
+     * null.  Only throws if the copies could not be run at all.
+     *
+     * The default copies each pair with copy, so drivers which can copy
+     * many files in a single request should override.
+     */
+    virtual std::vector<std::exception_ptr> copyMany(
+            const std::vector<std::pair<std::string, std::string>>& pairs,
+            std::size_t threads) const;
+
+    /** Move a file, where @p src and @p dst must both be of this driver
+     * type.  Type-prefixes must be stripped from the input parameters.
+     *
+     * The default copies then removes @p src, so drivers which can rename
+     * natively should override.
+     */
+    virtual void move(std::string src, std::string dst) const;
+
+    /** Move each pair of source and destination paths, as copyMany.
+     *
+     * The default copies the pairs with copyMany, then removes the sources
+     * of those which were copied with removeMany, so batched copies and
+     * removals are used by drivers which support them.  A source which was
+     * copied but could not be removed is reported as a failure.
+     */
+    virtual std::vector<std::exception_ptr> moveMany(
+            const std::vector<std::pair<std::string, std::string>>& pairs,
+            std::size_t threads) const;
+
+    /** Remove the file at @p path.  Removing a file which does not exist is
+     * not an error.
+     *
+     * The default throws ArbiterError, so drivers which can remove files
+     * should override.
+     */
+    virtual void remove(std::string path) const;
+
+    /** Remove each of @p paths, using up to @p threads concurrent requests,
+     * and return the failure of each in the same order, where those which
+     * were removed are null.  Only throws if the removal could not be run
+     * at all.
+     *
+     * The default removes each path with remove, so drivers which can
+     * remove many files in a single request should override.
+     */
+    virtual std::vector<std::exception_ptr> removeMany(
+            const std::vector<std::string>& paths,
+            std::size_t threads) const;
+
     /** @brief Resolve a possibly globbed path.
      *
      * See Arbiter::resolve for details.
@@ -98,6 +559,89 @@ public:
             std::string path,
             bool verbose = false) const;
 
+    /** @brief Resolve a possibly globbed path, calling @p f with each result
+     * as it is found rather than collecting them all before returning.
+     *
+     * Calls to @p f are serialized, but for some drivers results do not
+     * arrive in sorted order.
+     */
+    void resolve(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose = false) const;
+
+    /** @brief Resolve a possibly globbed path into a compact PathList,
+     * sorted by path.
+     *
+     * See Arbiter::resolveList for details.
+     */
+    PathList resolveList(std::string path, bool verbose = false) const;
+
+    /** @brief Resolve a possibly globbed path, along with the metadata of
+     * each file which the listing provides.  Results are sorted by path.
+     *
+     * See Arbiter::resolveInfo for details.
+     */
+    std::vector<FileInfo> resolveInfo(
+            std::string path,
+            bool verbose = false) const;
+
+    /** @brief As resolveInfo, but calls @p f with each result as it is
+     * found, with the ordering of resolve.
+     */
+    void resolveInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose = false) const;
+
+    /** @brief As resolveInfo for the glob @p path, which must end with
+     * `*`, but only for the files whose paths, stripped of their type like
+     * @p after, sort after @p after.
+     *
+     * This suits prefixes to which files are only added with increasing
+     * names, whose new files may then be found without listing the old.
+     */
+    void resolveInfoAfter(
+            std::string path,
+            const std::string& after,
+            const std::function<void(FileInfo)>& f,
+            bool verbose = false) const;
+
+    /** @brief Resolve the share numbered @p shard, from zero, of @p shards
+     * shares of the glob @p path, which must end with `*`.  Results are
+     * sorted by path.
+     *
+     * Workers which each resolve a different share of the same path
+     * together resolve each of its files exactly once, without
+     * coordinating, as long as the files under it do not change until all
+     * of them are done.  See globShard.
+     */
+    std::vector<std::string> resolve(
+            std::string path,
+            std::size_t shard,
+            std::size_t shards,
+            bool verbose = false) const;
+
+    /** @brief Deliver the changes to the files matching @p path to @p f,
+     * until the returned Watch is destroyed.
+     *
+     * A @p path ending with a slash watches everything beneath it, and
+     * otherwise it is a glob, as for resolve, stripped of its type.  Calls
+     * to @p f are serialized, from a thread of the Watch, and must not
+     * throw.  Changes made while no Watch is active are not delivered.
+     *
+     * The default lists @p path every @p interval, comparing the sizes,
+     * versions, and modification times of its files with those of the
+     * previous listing, so that changes between listings which leave
+     * these unchanged are missed.  Drivers which are notified of changes
+     * should override.  See Capabilities::changeNotifications.
+     */
+    virtual std::unique_ptr<Watch> watch(
+            std::string path,
+            ChangeCallback f,
+            std::chrono::milliseconds interval =
+                std::chrono::seconds(60)) const;
+
 protected:
     /** @brief Resolve a wildcard path.
      *
@@ -117,15 +661,196 @@ protected:
      */
     virtual std::vector<std::string> glob(std::string path, bool verbose) const;
 
+    /** @brief Resolve a wildcard path, streaming the results to @p f.
+     *
+     * Semantics match glob(std::string, bool) const.  The default behavior
+     * forwards the results of that function, so drivers which can produce
+     * results incrementally, for example one page of a listing at a time,
+     * should override this version as well.
+     */
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const;
+
+    /** @brief Resolve a wildcard path into a PathList, which holds the
+     * prefix shared by its results once.
+     *
+     * Semantics otherwise match glob, and results need not be sorted.  The
+     * default collects the results of glob, so drivers whose listings may be
+     * very large should override to fill the list without building a string
+     * for each path.
+     */
+    virtual PathList globList(std::string path, bool verbose) const;
+
+    /** @brief Resolve a wildcard path, streaming each result to @p f along
+     * with such metadata as the listing provides.
+     *
+     * Semantics otherwise match glob.  The default reports the results of
+     * glob without metadata, so drivers whose listings include sizes,
+     * versions, or modification times should override.
+     */
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const;
+
+    /** @brief As globInfo, but only for files whose paths sort after
+     * @p after.  The default filters the whole listing, so drivers whose
+     * listings may begin after a given path should override.
+     */
+    virtual void globInfoAfter(
+            std::string path,
+            const std::string& after,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const;
+
+    /** @brief As globInfo, but only for the share numbered @p shard of
+     * @p shards shares of the files, which must depend on nothing but the
+     * files themselves.  The default lists every file and keeps those
+     * whose paths hash to @p shard, so drivers which can list part of a
+     * prefix should override.
+     */
+    virtual void globShard(
+            std::string path,
+            std::size_t shard,
+            std::size_t shards,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const;
+
+    /** A file, or a directory whose files all go to the same share, into
+     * which shardEntries splits a prefix.
+     */
+    struct ShardEntry
+    {
+        ShardEntry(FileInfo info, bool directory)
+            : info(std::move(info))
+            , directory(directory)
+        { }
+
+        /** As listed, or for a directory, its path with a trailing slash
+         * as a file within it would be resolved.
+         */
+        FileInfo info;
+        bool directory;
+    };
+
+    /** Lists the files directly within the directory @p dir, stripped of
+     * its type, to @p file, and its subdirectories, stripped of their
+     * types and with trailing slashes, to @p sub.
+     */
+    using LevelList = std::function<void(
+            const std::string& dir,
+            const std::function<void(FileInfo)>& file,
+            const std::function<void(std::string)>& sub)>;
+
+    /** Split the prefix @p dir, stripped of its type, into entries among
+     * which globShard may spread its shares, sorted by path.  Its levels
+     * are listed by @p list, and while there are fewer than @p shards
+     * entries, the directories of the deepest level are replaced by their
+     * contents, all of them at once so that every worker finds the same
+     * entries.  Unless @p recursive, only the files of @p dir are entries.
+     */
+    std::vector<ShardEntry> shardEntries(
+            const std::string& dir,
+            std::size_t shards,
+            bool recursive,
+            const LevelList& list) const;
+
+    /** The entries [begin, end) of @p count sorted entries which make up
+     * the share numbered @p shard of @p shards, so that each share is a
+     * run of consecutive paths.
+     */
+    static std::pair<std::size_t, std::size_t> shardRange(
+            std::size_t count,
+            std::size_t shard,
+            std::size_t shards);
+
+    /** @brief Resolve a path with wildcards before its end, as described
+     * by Glob, streaming each matching file to @p f along with such metadata
+     * as the listing provides.
+     *
+     * @p glob is matched against paths with their type-specifying prefix
+     * stripped.  The default lists the literal prefix of the pattern with
+     * globInfo, recursively if matches may lie in subdirectories of it, and
+     * filters the results, so drivers which can skip the directories which
+     * cannot contain matches should override.
+     */
+    virtual void globPattern(
+            const Glob& glob,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const;
+
     /**
      * @param path Path with the type-specifying prefix information stripped.
      * @param[out] data Empty vector in which to write resulting data.
      */
     virtual bool get(std::string path, std::vector<char>& data) const = 0;
+
+    /** As get, but into the string @p data, for get and tryGet.  The
+     * default reads with get and copies the result, so drivers which can
+     * receive directly into a string should override.
+     */
+    virtual bool getText(std::string path, std::string& data) const;
+
+    /** Looks up the sizes of many paths at once, as tryGetSizes. */
+    using SizesLookup = std::function<
+        std::vector<std::unique_ptr<std::size_t>>(
+                const std::vector<std::string>& paths)>;
+
+    /** As tryGetSizes, grouping @p paths by directory.  Each directory
+     * holding enough of them that a listing, whose pages cover many files
+     * for the cost of about one lookup, is cheaper than looking each of
+     * them up, is listed with globInfo.  The rest are looked up with
+     * tryGetSize, or if there is a @p lookup, by it in groups of up to
+     * @p batchSize.  Listings and lookups run on up to @p threads threads,
+     * borrowed from @p executor as by parallelFor.
+     *
+     * Only for drivers whose listings report sizes.  See
+     * Capabilities::listingMetadata.
+     */
+    std::vector<std::unique_ptr<std::size_t>> tryGetSizesListed(
+            const std::vector<std::string>& paths,
+            std::size_t threads = 1,
+            Executor* executor = nullptr,
+            const SizesLookup& lookup = SizesLookup(),
+            std::size_t batchSize = 1) const;
+
+    /** A sink which appends to the buffer of @p size bytes at @p data,
+     * tracking the number of bytes written in @p written, and which throws
+     * ArbiterError rather than overflow it.
+     */
+    static std::function<void(const char*, std::size_t)> bufferSink(
+            const std::string& path,
+            char* data,
+            std::size_t size,
+            std::size_t& written);
+
+    /** Merge @p ranges, as by getRanges, into reads given as [begin, end)
+     * pairs in order of offset, storing in @p readOf the index of the read
+     * which holds each range.
+     */
+    static std::vector<std::pair<std::size_t, std::size_t>> mergeRanges(
+            const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+            std::size_t gap,
+            std::vector<std::size_t>& readOf);
+
+    /** Slice the data of each of @p ranges from @p data, that read for each
+     * of @p reads as merged by mergeRanges.
+     */
+    static std::vector<std::vector<char>> splitRanges(
+            const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+            const std::vector<std::pair<std::size_t, std::size_t>>& reads,
+            const std::vector<std::size_t>& readOf,
+            const std::vector<std::vector<char>>& data);
 };
 
 typedef std::map<std::string, std::unique_ptr<Driver>> DriverMap;
 
+/** Wraps a driver, for instance in a cache, or returns it unchanged. */
+typedef std::function<std::unique_ptr<Driver>(std::unique_ptr<Driver>)>
+    DriverWrapper;
+
 } // namespace arbiter
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
@@ -0,0 +1,776 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/archive.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/glob.hpp>
+#include <arbiter/util/json.hpp>
+#endif
+
+#include <algorithm>
+
+#ifdef ARBITER_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+namespace
+{
+    const std::uint32_t zipLocalSignature(0x04034b50);
+    const std::uint32_t zipCentralSignature(0x02014b50);
+    const std::uint32_t zipEndSignature(0x06054b50);
+    const std::uint32_t zip64EndSignature(0x06064b50);
+    const std::uint32_t zip64LocatorSignature(0x07064b50);
+
+    const std::size_t zipLocalSize(30);
+    const std::size_t zipCentralSize(46);
+    const std::size_t zipEndSize(22);
+    const std::size_t zip64EndSize(56);
+    const std::size_t zip64LocatorSize(20);
+
+    // The end record may be followed by a comment of up to 64 KiB, and
+    // preceded by the ZIP64 locator.
+    const std::size_t zipTailSize(zipEndSize + 0xffff + zip64LocatorSize);
+
+    // The extra field of a local header may differ from that of the
+    // directory, so this much more is read along with it, in case it's
+    // longer.
+    const std::size_t zipLocalMargin(1024);
+
+    const std::size_t defaultArchiveCacheSize(64);
+    const std::size_t defaultArchiveChunkSize(4 * 1024 * 1024);
+
+    std::uint64_t zipRead(const char* p, const std::size_t bytes)
+    {
+        std::uint64_t value(0);
+        for (std::size_t i(bytes); i > 0; --i)
+        {
+            value = (value << 8) | static_cast<unsigned char>(p[i - 1]);
+        }
+        return value;
+    }
+
+    std::uint16_t zipU16(const char* p)
+    {
+        return static_cast<std::uint16_t>(zipRead(p, 2));
+    }
+
+    std::uint32_t zipU32(const char* p)
+    {
+        return static_cast<std::uint32_t>(zipRead(p, 4));
+    }
+
+    std::uint64_t zipU64(const char* p) { return zipRead(p, 8); }
+
+#ifdef ARBITER_ZLIB
+    // Inflates the raw deflated data of a member as it arrives.
+    class ZipInflater
+    {
+    public:
+        ZipInflater() : m_buffer(64 * 1024)
+        {
+            m_z.zalloc = Z_NULL;
+            m_z.zfree = Z_NULL;
+            m_z.opaque = Z_NULL;
+            m_z.next_in = Z_NULL;
+            m_z.avail_in = 0;
+
+            // Negative window bits for raw data, without a zlib header.
+            if (inflateInit2(&m_z, -15) != Z_OK)
+            {
+                throw ArbiterError("Could not initialize inflation");
+            }
+        }
+
+        ~ZipInflater() { inflateEnd(&m_z); }
+
+        // Inflate @p size bytes of @p data, passing the output to @p sink
+        // until it returns false, in which case this returns false.
+        bool write(
+                const char* data,
+                const std::size_t size,
+                const std::function<bool(const char*, std::size_t)>& sink)
+        {
+            m_z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            m_z.avail_in = static_cast<uInt>(size);
+
+            while (!m_done)
+            {
+                m_z.next_out = reinterpret_cast<Bytef*>(m_buffer.data());
+                m_z.avail_out = static_cast<uInt>(m_buffer.size());
+
+                const int code(inflate(&m_z, Z_NO_FLUSH));
+                if (code == Z_STREAM_END) m_done = true;
+                else if (code != Z_OK && code != Z_BUF_ERROR)
+                {
+                    throw ArbiterError("Invalid deflated data");
+                }
+
+                const std::size_t produced(m_buffer.size() - m_z.avail_out);
+                if (produced && !sink(m_buffer.data(), produced)) return false;
+
+                // All input is consumed, and all output is flushed.
+                if (!m_z.avail_in && m_z.avail_out) break;
+                if (code == Z_BUF_ERROR) break;
+            }
+
+            return true;
+        }
+
+        bool done() const { return m_done; }
+
+    private:
+        ZipInflater(const ZipInflater&);
+        ZipInflater& operator=(const ZipInflater&);
+
+        z_stream m_z;
+        std::vector<char> m_buffer;
+        bool m_done = false;
+    };
+#endif
+}
+
+Archive::Archive(
+        const Driver& driver,
+        const std::size_t cacheSize,
+        const std::size_t chunkSize)
+    : m_driver(driver)
+    , m_cacheSize((std::max)(cacheSize, std::size_t(1)))
+    , m_chunkSize(chunkSize)
+{
+    if (!m_chunkSize) throw ArbiterError("Invalid archive chunk size");
+}
+
+std::unique_ptr<Archive> Archive::create(
+        const Driver& driver,
+        const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    const json o(c.is_object() ? c : json::object());
+
+    return std::unique_ptr<Archive>(new Archive(
+                driver,
+                o.value("cacheSize", defaultArchiveCacheSize),
+                o.value("chunkSize", defaultArchiveChunkSize)));
+}
+
+std::string Archive::type() const
+{
+    return "zip+" + m_driver.type();
+}
+
+void Archive::put(const std::string path, const std::vector<char>&) const
+{
+    throw ArbiterError("Cannot write to archives: " + path);
+}
+
+std::unique_ptr<std::size_t> Archive::tryGetSize(const std::string path) const
+{
+    std::string archive;
+    DirectoryPtr dir;
+    const std::size_t i(find(path, archive, dir));
+
+    std::unique_ptr<std::size_t> size;
+    if (i != std::string::npos)
+    {
+        size.reset(new std::size_t(dir->members[i].size));
+    }
+    return size;
+}
+
+bool Archive::exists(const std::string path) const
+{
+    std::string archive;
+    DirectoryPtr dir;
+    return find(path, archive, dir) != std::string::npos;
+}
+
+void Archive::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    std::string archive;
+    DirectoryPtr dir;
+    const std::size_t i(find(path, archive, dir));
+    if (i == std::string::npos)
+    {
+        throw ArbiterError("Could not read file " + path);
+    }
+
+    read(archive, *dir, i, [&sink](const char* data, std::size_t size)
+    {
+        sink(data, size);
+        return true;
+    });
+}
+
+Capabilities Archive::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = m_driver.capabilities().rangedReads;
+    return c;
+}
+
+std::vector<char> Archive::getRange(
+        const std::string path,
+        const std::size_t offset,
+        std::size_t length) const
+{
+    std::string archive;
+    DirectoryPtr dir;
+    const std::size_t i(find(path, archive, dir));
+    if (i == std::string::npos)
+    {
+        throw ArbiterError("Could not read file " + path);
+    }
+
+    const Member& member(dir->members[i]);
+    if (offset >= member.size) return std::vector<char>();
+    length = (std::min<std::uint64_t>)(length, member.size - offset);
+
+    // Stored members are read in place.
+    if (member.method == 0 && !(member.flags & 1))
+    {
+        std::vector<char> head;
+        const std::uint64_t data(dataOffset(archive, *dir, i, head));
+        if (offset + length <= head.size())
+        {
+            return std::vector<char>(
+                    head.begin() + offset,
+                    head.begin() + offset + length);
+        }
+
+        std::vector<char> result(
+                m_driver.getRange(archive, data + offset, length));
+        if (result.size() != length)
+        {
+            throw ArbiterError("Truncated archive member " + path);
+        }
+        return result;
+    }
+
+    // Others are inflated from their beginning until the range is read.
+    std::vector<char> result;
+    result.reserve(length);
+    std::uint64_t position(0);
+
+    read(archive, *dir, i, [&](const char* data, std::size_t size)
+    {
+        const std::uint64_t end(position + size);
+        if (end > offset)
+        {
+            const std::size_t begin(
+                    offset > position ? offset - position : 0);
+            const std::size_t take(
+                    (std::min)(size - begin, length - result.size()));
+            result.insert(result.end(), data + begin, data + begin + take);
+        }
+        position = end;
+        return result.size() < length;
+    });
+
+    return result;
+}
+
+bool Archive::get(const std::string path, std::vector<char>& data) const
+{
+    std::string archive;
+    DirectoryPtr dir;
+    const std::size_t i(find(path, archive, dir));
+    if (i == std::string::npos) return false;
+
+    data.clear();
+    data.reserve(dir->members[i].size);
+    read(archive, *dir, i, [&data](const char* p, std::size_t size)
+    {
+        data.insert(data.end(), p, p + size);
+        return true;
+    });
+    return true;
+}
+
+std::vector<std::string> Archive::glob(
+        const std::string path,
+        const bool verbose) const
+{
+    std::vector<std::string> results;
+    globInfo(path, [&results](FileInfo info)
+    {
+        results.push_back(std::move(info.path));
+    }, verbose);
+    return results;
+}
+
+void Archive::glob(
+        const std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void Archive::globInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool) const
+{
+    std::string archive;
+    std::string base;
+    split(path, archive, base);
+    base.pop_back();
+
+    const bool recursive(base.size() && base.back() == '*');
+    if (recursive) base.pop_back();
+
+    scan(archive, base, [&](const Member& member)
+    {
+        if (!recursive && member.name.find('/', base.size()) !=
+                std::string::npos)
+        {
+            return;
+        }
+
+        FileInfo info(type() + "://" + archive + "!/" + member.name);
+        info.hasSize = true;
+        info.size = member.size;
+        f(std::move(info));
+    });
+}
+
+void Archive::globPattern(
+        const Glob& glob,
+        const std::function<void(FileInfo)>& f,
+        const bool) const
+{
+    std::string archive;
+    std::string rest;
+    split(glob.pattern(), archive, rest);
+    if (Glob::isPattern(archive) || archive.find('*') != std::string::npos)
+    {
+        throw ArbiterError("Cannot glob archives: " + glob.pattern());
+    }
+
+    const Glob within(rest);
+    scan(archive, within.prefix(), [&](const Member& member)
+    {
+        if (!within.match(member.name)) return;
+
+        FileInfo info(type() + "://" + archive + "!/" + member.name);
+        info.hasSize = true;
+        info.size = member.size;
+        f(std::move(info));
+    });
+}
+
+void Archive::split(
+        const std::string& path,
+        std::string& archive,
+        std::string& member)
+{
+    const std::size_t pos(path.find("!/"));
+    if (pos == std::string::npos)
+    {
+        throw ArbiterError("No archive member in " + path);
+    }
+
+    archive = path.substr(0, pos);
+    member = path.substr(pos + 2);
+}
+
+Archive::DirectoryPtr Archive::directory(const std::string& archive) const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it(m_directories.find(archive));
+        if (it != m_directories.end()) return it->second;
+    }
+
+    // Archives which don't exist are looked up again.
+    const DirectoryPtr dir(load(archive));
+    if (!dir) return dir;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_directories.size() >= m_cacheSize) m_directories.clear();
+    return m_directories.emplace(archive, dir).first->second;
+}
+
+Archive::DirectoryPtr Archive::load(const std::string& archive) const
+{
+    const std::unique_ptr<std::size_t> size(m_driver.tryGetSize(archive));
+    if (!size) return DirectoryPtr();
+
+    const std::uint64_t total(*size);
+    const std::uint64_t tailSize((std::min<std::uint64_t>)(total, zipTailSize));
+    const std::uint64_t tailOffset(total - tailSize);
+    const std::vector<char> tail(
+            m_driver.getRange(archive, tailOffset, tailSize));
+    if (tail.size() != tailSize)
+    {
+        throw ArbiterError("Truncated archive " + archive);
+    }
+
+    // Bytes of the archive, taken from its tail if they lie within it.
+    const auto slice([&](std::uint64_t offset, std::uint64_t length)
+        -> std::vector<char>
+    {
+        if (offset + length > total)
+        {
+            throw ArbiterError("Invalid archive " + archive);
+        }
+        if (offset >= tailOffset)
+        {
+            const auto begin(tail.begin() + (offset - tailOffset));
+            return std::vector<char>(begin, begin + length);
+        }
+
+        std::vector<char> data(m_driver.getRange(archive, offset, length));
+        if (data.size() != length)
+        {
+            throw ArbiterError("Truncated archive " + archive);
+        }
+        return data;
+    });
+
+    // The end record is the last one whose comment fits within the tail.
+    std::size_t end(std::string::npos);
+    for (std::size_t p(tail.size() + 1); p > zipEndSize; --p)
+    {
+        const std::size_t at(p - 1 - zipEndSize);
+        const char* e(tail.data() + at);
+        if (zipU32(e) == zipEndSignature &&
+                at + zipEndSize + zipU16(e + 20) <= tail.size())
+        {
+            end = at;
+            break;
+        }
+    }
+    if (end == std::string::npos)
+    {
+        throw ArbiterError("No ZIP directory in " + archive);
+    }
+
+    const char* e(tail.data() + end);
+    std::uint64_t count(zipU16(e + 10));
+    std::uint64_t cdSize(zipU32(e + 12));
+    std::uint64_t cdOffset(zipU32(e + 16));
+
+    if (count == 0xffff || cdSize == 0xffffffff || cdOffset == 0xffffffff)
+    {
+        if (end < zip64LocatorSize ||
+                zipU32(e - zip64LocatorSize) != zip64LocatorSignature)
+        {
+            throw ArbiterError("Invalid ZIP64 archive " + archive);
+        }
+
+        const std::vector<char> record(
+                slice(zipU64(e - zip64LocatorSize + 8), zip64EndSize));
+        if (zipU32(record.data()) != zip64EndSignature)
+        {
+            throw ArbiterError("Invalid ZIP64 archive " + archive);
+        }
+
+        count = zipU64(record.data() + 32);
+        cdSize = zipU64(record.data() + 40);
+        cdOffset = zipU64(record.data() + 48);
+    }
+
+    const std::vector<char> cd(slice(cdOffset, cdSize));
+
+    DirectoryPtr dir(std::make_shared<Directory>());
+    dir->size = total;
+
+    std::size_t p(0);
+    for (std::uint64_t n(0); n < count; ++n)
+    {
+        const char* h(cd.data() + p);
+        if (p + zipCentralSize > cd.size() || zipU32(h) != zipCentralSignature)
+        {
+            throw ArbiterError("Invalid ZIP directory in " + archive);
+        }
+
+        const std::size_t nameLength(zipU16(h + 28));
+        const std::size_t extraLength(zipU16(h + 30));
+        const std::size_t commentLength(zipU16(h + 32));
+        const std::size_t next(
+                p + zipCentralSize + nameLength + extraLength + commentLength);
+        if (next > cd.size())
+        {
+            throw ArbiterError("Invalid ZIP directory in " + archive);
+        }
+
+        Member member;
+        member.name.assign(h + zipCentralSize, nameLength);
+        member.flags = zipU16(h + 8);
+        member.method = zipU16(h + 10);
+        member.crc = zipU32(h + 16);
+        member.compressedSize = zipU32(h + 20);
+        member.size = zipU32(h + 24);
+        member.offset = zipU32(h + 42);
+
+        // The ZIP64 extra field holds, in order, those of the sizes and
+        // offset which don't fit in the fields above.
+        const char* x(h + zipCentralSize + nameLength);
+        const char* const xEnd(x + extraLength);
+        while (x + 4 <= xEnd)
+        {
+            const char* v(x + 4);
+            const char* const vEnd(v + zipU16(x + 2));
+            if (vEnd > xEnd) break;
+
+            if (zipU16(x) == 0x0001)
+            {
+                for (std::uint64_t* field : {
+                        &member.size,
+                        &member.compressedSize,
+                        &member.offset })
+                {
+                    if (*field == 0xffffffff && v + 8 <= vEnd)
+                    {
+                        *field = zipU64(v);
+                        v += 8;
+                    }
+                }
+            }
+
+            x = vEnd;
+        }
+
+        if (member.name.size() && member.name.back() != '/')
+        {
+            dir->members.push_back(std::move(member));
+        }
+        p = next;
+    }
+
+    std::stable_sort(
+            dir->members.begin(),
+            dir->members.end(),
+            [](const Member& a, const Member& b) { return a.name < b.name; });
+
+    return dir;
+}
+
+std::size_t Archive::find(
+        const std::string& path,
+        std::string& archive,
+        DirectoryPtr& dir) const
+{
+    std::string name;
+    split(path, archive, name);
+
+    dir = directory(archive);
+    if (!dir) return std::string::npos;
+
+    const auto it(std::lower_bound(
+            dir->members.begin(),
+            dir->members.end(),
+            name,
+            [](const Member& member, const std::string& name)
+            {
+                return member.name < name;
+            }));
+
+    if (it == dir->members.end() || it->name != name)
+    {
+        return std::string::npos;
+    }
+    return it - dir->members.begin();
+}
+
+std::uint64_t Archive::dataOffset(
+        const std::string& archive,
+        Directory& dir,
+        const std::size_t i,
+        std::vector<char>& head) const
+{
+    {
+        std::lock_guard<std::mutex> lock(dir.mutex);
+        const auto it(dir.data.find(i));
+        if (it != dir.data.end()) return it->second;
+    }
+
+    const Member& member(dir.members[i]);
+    if (member.offset >= dir.size)
+    {
+        throw ArbiterError("Invalid archive member " + member.name);
+    }
+
+    const std::uint64_t length((std::min<std::uint64_t>)(
+                dir.size - member.offset,
+                zipLocalSize + member.name.size() + zipLocalMargin +
+                    (std::min<std::uint64_t>)(
+                        member.compressedSize,
+                        m_chunkSize)));
+
+    const std::vector<char> local(
+            m_driver.getRange(archive, member.offset, length));
+    if (local.size() < zipLocalSize ||
+            zipU32(local.data()) != zipLocalSignature)
+    {
+        throw ArbiterError("Invalid archive member " + member.name);
+    }
+
+    const std::uint64_t skip(
+            zipLocalSize +
+            zipU16(local.data() + 26) +
+            zipU16(local.data() + 28));
+    const std::uint64_t offset(member.offset + skip);
+    if (offset + member.compressedSize > dir.size)
+    {
+        throw ArbiterError("Truncated archive member " + member.name);
+    }
+
+    head.clear();
+    if (skip < local.size())
+    {
+        head.assign(
+                local.begin() + skip,
+                local.begin() + (std::min<std::uint64_t>)(
+                    local.size(),
+                    skip + member.compressedSize));
+    }
+
+    std::lock_guard<std::mutex> lock(dir.mutex);
+    dir.data[i] = offset;
+    return offset;
+}
+
+void Archive::readRaw(
+        const std::string& archive,
+        Directory& dir,
+        const std::size_t i,
+        const std::function<bool(const char*, std::size_t)>& sink) const
+{
+    std::vector<char> head;
+    const std::uint64_t offset(dataOffset(archive, dir, i, head));
+    const Member& member(dir.members[i]);
+
+    if (head.size() && !sink(head.data(), head.size())) return;
+
+    std::uint64_t position(head.size());
+    while (position < member.compressedSize)
+    {
+        const std::uint64_t length((std::min<std::uint64_t>)(
+                    m_chunkSize,
+                    member.compressedSize - position));
+
+        const std::vector<char> chunk(
+                m_driver.getRange(archive, offset + position, length));
+        if (chunk.size() != length)
+        {
+            throw ArbiterError("Truncated archive member " + member.name);
+        }
+
+        position += length;
+        if (!sink(chunk.data(), chunk.size())) return;
+    }
+}
+
+void Archive::read(
+        const std::string& archive,
+        Directory& dir,
+        const std::size_t i,
+        const std::function<bool(const char*, std::size_t)>& sink) const
+{
+    const Member& member(dir.members[i]);
+    if (member.flags & 1)
+    {
+        throw ArbiterError("Cannot read encrypted member " + member.name);
+    }
+    if (member.method != 0 && member.method != 8)
+    {
+        throw ArbiterError(
+                "Unsupported compression method " +
+                std::to_string(member.method) + " of " + member.name);
+    }
+
+    std::uint64_t written(0);
+    bool complete(true);
+#ifdef ARBITER_ZLIB
+    uLong crc(crc32(0, Z_NULL, 0));
+#endif
+
+    const std::function<bool(const char*, std::size_t)> out(
+            [&](const char* data, std::size_t size) -> bool
+    {
+#ifdef ARBITER_ZLIB
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(data), size);
+#endif
+        written += size;
+        if (sink(data, size)) return true;
+
+        complete = false;
+        return false;
+    });
+
+    if (member.method == 0) readRaw(archive, dir, i, out);
+    else
+    {
+#ifdef ARBITER_ZLIB
+        ZipInflater inflater;
+        readRaw(archive, dir, i, [&](const char* data, std::size_t size)
+        {
+            return inflater.write(data, size, out);
+        });
+
+        if (complete && !inflater.done())
+        {
+            throw ArbiterError("Truncated archive member " + member.name);
+        }
+#else
+        throw ArbiterError("Cannot inflate archive members without zlib");
+#endif
+    }
+
+    if (!complete) return;
+    if (written != member.size)
+    {
+        throw ArbiterError("Invalid size of archive member " + member.name);
+    }
+#ifdef ARBITER_ZLIB
+    if (crc != member.crc)
+    {
+        throw ArbiterError("Invalid CRC of archive member " + member.name);
+    }
+#endif
+}
+
+void Archive::scan(
+        const std::string& archive,
+        const std::string& prefix,
+        const std::function<void(const Member&)>& f) const
+{
+    const DirectoryPtr dir(directory(archive));
+    if (!dir) return;
+
+    auto it(std::lower_bound(
+            dir->members.begin(),
+            dir->members.end(),
+            prefix,
+            [](const Member& member, const std::string& prefix)
+            {
+                return member.name < prefix;
+            }));
+
+    for ( ; it != dir->members.end(); ++it)
+    {
+        if (it->name.compare(0, prefix.size(), prefix) != 0) break;
+        f(*it);
+    }
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+/** @brief Reads of the members of ZIP archives stored by another driver,
+ * without reading the archives in full.
+ *
+ * Its type is `zip+` followed by the wrapped type, and paths are of the
+ * form `<archive>!/<member>`, as in `zip+s3://bucket/data.zip!/dir/a.csv`.
+ * The central directory of an archive is found with a ranged read of the
+ * end of the archive, and is kept, so that sizes, existence, and listings
+ * of its members cost nothing more.  Each member is then read with ranged
+ * reads of its own bytes, the first of which also holds its local header,
+ * and deflated members are inflated as they arrive.
+ *
+ * ZIP64 archives are supported, but not encrypted members, nor methods
+ * other than storage and deflation, and deflation requires zlib.  Archives
+ * are read-only, and one which is rewritten isn't seen to change by a
+ * driver which has already read its directory.
+ */
+class ARBITER_DLL Archive : public Driver
+{
+public:
+    /** Read the archives of @p driver, which must outlive this one, keeping
+     * the directories of up to @p cacheSize of them, and reading compressed
+     * members @p chunkSize bytes at a time.
+     */
+    Archive(const Driver& driver, std::size_t cacheSize, std::size_t chunkSize);
+
+    /** Create a driver for the archives of @p driver according to the
+     * stringified JSON @p j, which is the `archives` entry of the Arbiter
+     * configuration.  Its keys are:
+     *
+     * - `cacheSize`: the number of directories kept, by default 64.
+     * - `chunkSize`: the size of the reads of compressed members, by
+     *   default 4 MiB.
+     */
+    static std::unique_ptr<Archive> create(const Driver& driver, std::string j);
+
+    virtual std::string type() const override;
+    virtual bool isRemote() const override { return m_driver.isRemote(); }
+
+    using Driver::put;
+
+    /** Throws ArbiterError, since archives are read-only. */
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual bool exists(std::string path) const override;
+
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    /** Ranged reads of members, if the driver of the archives has them. */
+    virtual Capabilities capabilities() const override;
+
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    virtual void globPattern(
+            const Glob& glob,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    struct Member
+    {
+        std::string name;
+        std::uint16_t flags = 0;
+        std::uint16_t method = 0;
+        std::uint32_t crc = 0;
+        std::uint64_t compressedSize = 0;
+        std::uint64_t size = 0;
+        std::uint64_t offset = 0;
+    };
+
+    struct Directory
+    {
+        std::uint64_t size = 0;
+
+        // Sorted by name, without directories.
+        std::vector<Member> members;
+
+        // The offsets of the data of members whose local headers have been
+        // read, by index.
+        std::mutex mutex;
+        std::map<std::size_t, std::uint64_t> data;
+    };
+
+    using DirectoryPtr = std::shared_ptr<Directory>;
+
+    // The archive of @p path, and the member within it.
+    static void split(
+            const std::string& path,
+            std::string& archive,
+            std::string& member);
+
+    // The directory of @p archive, read first if need be, or null if the
+    // archive doesn't exist.
+    DirectoryPtr directory(const std::string& archive) const;
+    DirectoryPtr load(const std::string& archive) const;
+
+    // The index of the member of @p path, or npos if it doesn't exist.  Its
+    // archive and directory are placed in @p archive and @p dir.
+    std::size_t find(
+            const std::string& path,
+            std::string& archive,
+            DirectoryPtr& dir) const;
+
+    // The offset of the data of member @p i, reading its local header if it
+    // isn't yet known.  Any data read along with the header is placed in
+    // @p head.
+    std::uint64_t dataOffset(
+            const std::string& archive,
+            Directory& dir,
+            std::size_t i,
+            std::vector<char>& head) const;
+
+    // Pass the stored bytes of member @p i to @p sink, in order, until it
+    // returns false.
+    void readRaw(
+            const std::string& archive,
+            Directory& dir,
+            std::size_t i,
+            const std::function<bool(const char*, std::size_t)>& sink) const;
+
+    // Pass the contents of member @p i to @p sink, in order, until it
+    // returns false, inflating them if need be.  Contents read in full are
+    // checked against the size and CRC of the directory.
+    void read(
+            const std::string& archive,
+            Directory& dir,
+            std::size_t i,
+            const std::function<bool(const char*, std::size_t)>& sink) const;
+
+    // Pass each member of @p archive whose name begins with @p prefix to @p f.
+    void scan(
+            const std::string& archive,
+            const std::string& prefix,
+            const std::function<void(const Member&)>& f) const;
+
+    Archive(const Archive&);
+    Archive& operator=(const Archive&);
+
+    const Driver& m_driver;
+    const std::size_t m_cacheSize;
+    const std::size_t m_chunkSize;
+
+    mutable std::mutex m_mutex;
+    mutable std::map<std::string, DirectoryPtr> m_directories;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
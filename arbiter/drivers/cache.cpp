@@ -0,0 +1,590 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/cache.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/drivers/fs.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/sha256.hpp>
+#include <arbiter/util/transforms.hpp>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <random>
+#include <set>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+namespace
+{
+    const std::size_t defaultMaxSize(1024 * 1024 * 1024);
+
+    // Recency is persisted no more often than this many seconds per copy,
+    // so that hits don't each cost a write.
+    const std::int64_t accessResolution(60);
+
+    const std::size_t readChunkSize(1024 * 1024);
+
+    const std::ios_base::openmode copyMode(
+            std::ofstream::binary |
+            std::ofstream::out |
+            std::ofstream::trunc);
+
+    std::int64_t now() { return std::time(nullptr); }
+
+    // Drops the cached copy once the wrapped write completes.
+    class CacheWriter : public Writer
+    {
+    public:
+        CacheWriter(std::unique_ptr<Writer> writer, std::function<void()> done)
+            : m_writer(std::move(writer))
+            , m_done(done)
+        { }
+
+        virtual void write(const char* data, std::size_t size) override
+        {
+            m_writer->write(data, size);
+        }
+
+        virtual void done() override
+        {
+            m_writer->done();
+            m_done();
+        }
+
+    private:
+        std::unique_ptr<Writer> m_writer;
+        std::function<void()> m_done;
+    };
+}
+
+Cache::Cache(
+        std::unique_ptr<Driver> driver,
+        std::shared_ptr<Store> store,
+        const bool revalidate)
+    : m_driver(std::move(driver))
+    , m_store(std::move(store))
+    , m_revalidate(revalidate)
+{
+    if (!m_driver) throw ArbiterError("Cannot cache an empty driver");
+    if (!m_store) throw ArbiterError("Cannot cache without a store");
+}
+
+void Cache::wrap(DriverMap& drivers, const std::string s)
+{
+    const DriverWrapper w(wrapper(s));
+    if (!w) return;
+
+    for (auto& p : drivers) p.second = w(std::move(p.second));
+}
+
+DriverWrapper Cache::wrapper(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object()) return DriverWrapper();
+
+    std::shared_ptr<Store> store(std::make_shared<Store>(
+                c.value("dir", getTempPath() + "arbiter-cache/"),
+                c.value("maxSize", defaultMaxSize)));
+
+    const bool revalidate(c.value("revalidate", true));
+
+    std::set<std::string> types;
+    for (const json& type : c.value("types", json::array()))
+    {
+        types.insert(type.get<std::string>());
+    }
+
+    return [store, revalidate, types](std::unique_ptr<Driver> driver)
+    {
+        if (types.empty() ? driver->isRemote() : types.count(driver->type()))
+        {
+            driver.reset(new Cache(std::move(driver), store, revalidate));
+        }
+        return driver;
+    };
+}
+
+std::unique_ptr<std::size_t> Cache::tryGetSize(const std::string path) const
+{
+    return m_driver->tryGetSize(path);
+}
+
+std::vector<std::unique_ptr<std::size_t>> Cache::tryGetSizes(
+        const std::vector<std::string>& paths) const
+{
+    return m_driver->tryGetSizes(paths);
+}
+
+std::unique_ptr<std::string> Cache::tryGetVersion(const std::string path) const
+{
+    return m_driver->tryGetVersion(path);
+}
+
+void Cache::put(const std::string path, const std::vector<char>& data) const
+{
+    m_driver->put(path, data);
+    m_store->erase(key(path));
+}
+
+void Cache::putFrom(
+        const std::string path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size) const
+{
+    m_driver->putFrom(path, source, size);
+    m_store->erase(key(path));
+}
+
+void Cache::putParts(
+        const std::string path,
+        const char* const data,
+        const std::size_t size,
+        const std::size_t partSize) const
+{
+    m_driver->putParts(path, data, size, partSize);
+    m_store->erase(key(path));
+}
+
+std::unique_ptr<Writer> Cache::putStream(const std::string path) const
+{
+    const std::string k(key(path));
+    return std::unique_ptr<Writer>(new CacheWriter(
+                m_driver->putStream(path),
+                [this, k]() { m_store->erase(k); }));
+}
+
+void Cache::copy(const std::string src, const std::string dst) const
+{
+    m_driver->copy(src, dst);
+    m_store->erase(key(dst));
+}
+
+void Cache::remove(const std::string path) const
+{
+    m_driver->remove(path);
+    m_store->erase(key(path));
+}
+
+std::vector<std::exception_ptr> Cache::removeMany(
+        const std::vector<std::string>& paths,
+        const std::size_t threads) const
+{
+    auto errors(m_driver->removeMany(paths, threads));
+    for (const std::string& path : paths) m_store->erase(key(path));
+    return errors;
+}
+
+std::unique_ptr<Watch> Cache::watch(
+        const std::string path,
+        ChangeCallback f,
+        const std::chrono::milliseconds interval) const
+{
+    return m_driver->watch(path, [this, f](const ChangeEvent& event)
+    {
+        m_store->erase(key(Arbiter::stripType(event.info.path)));
+        f(event);
+    }, interval);
+}
+
+bool Cache::get(const std::string path, std::vector<char>& data) const
+{
+    // Our copy, if any, is revalidated and replaced if stale by a single
+    // conditional read.
+    const std::string k(key(path));
+    const auto cached(m_store->version(k));
+
+    ChangedData result;
+    if (!m_revalidate)
+    {
+        if (read(path, nullptr, data)) return true;
+        result.exists = true;
+    }
+    else
+    {
+        result = m_driver->tryGetChanged(path, cached ? *cached : "");
+        if (!result.exists)
+        {
+            m_store->erase(k);
+            return false;
+        }
+        if (!result.changed && read(path, &result.version, data)) return true;
+    }
+
+    // Our copy has gone, or was never there to compare.
+    if (!result.changed)
+    {
+        auto fetched(m_driver->tryGetBinary(path));
+        if (!fetched) return false;
+        result.data = std::move(*fetched);
+    }
+
+    keep(path, result.version, result.data);
+    data = std::move(result.data);
+    return true;
+}
+
+void Cache::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    const auto version(currentVersion(path));
+    if (!version) return m_driver->getStream(path, sink);
+
+    if (const auto local = find(path, *version))
+    {
+        std::ifstream stream(*local, std::ios::in | std::ios::binary);
+        if (stream.good())
+        {
+            std::vector<char> buffer(readChunkSize);
+            while (stream)
+            {
+                stream.read(buffer.data(), buffer.size());
+                if (stream.gcount()) sink(buffer.data(), stream.gcount());
+            }
+
+            if (!stream.eof())
+            {
+                throw ArbiterError("Error occurred reading cached " + path);
+            }
+            return;
+        }
+    }
+
+    const std::string temp(m_store->temp());
+    std::ofstream stream(temp, copyMode);
+    std::size_t size(0);
+
+    try
+    {
+        m_driver->getStream(path, [&](const char* data, std::size_t n)
+        {
+            if (stream.good()) stream.write(data, n);
+            size += n;
+            sink(data, n);
+        });
+    }
+    catch (...)
+    {
+        stream.close();
+        std::remove(temp.c_str());
+        throw;
+    }
+
+    stream.close();
+    if (stream.good()) m_store->insert(key(path), *version, temp, size);
+    else std::remove(temp.c_str());
+}
+
+std::vector<char> Cache::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    const auto version(currentVersion(path));
+
+    if (const auto local = version ? find(path, *version) : nullptr)
+    {
+        std::ifstream stream(*local, std::ios::in | std::ios::binary);
+        if (stream.good())
+        {
+            std::vector<char> data(length);
+            stream.seekg(offset);
+            stream.read(data.data(), length);
+
+            if (!stream.bad())
+            {
+                data.resize(stream.gcount());
+                return data;
+            }
+        }
+    }
+
+    return m_driver->getRange(path, offset, length);
+}
+
+std::vector<std::string> Cache::glob(std::string path, bool) const
+{
+    return m_driver->resolve(path);
+}
+
+void Cache::glob(
+        std::string path,
+        const std::function<void(std::string)>& f,
+        bool) const
+{
+    m_driver->resolve(path, f);
+}
+
+void Cache::globInfo(
+        std::string path,
+        const std::function<void(FileInfo)>& f,
+        bool) const
+{
+    m_driver->resolveInfo(path, f);
+}
+
+std::string Cache::key(const std::string& path) const
+{
+    return type() + "://" + path;
+}
+
+std::unique_ptr<std::string> Cache::currentVersion(
+        const std::string& path) const
+{
+    if (!m_revalidate) return makeUnique<std::string>();
+    return m_driver->tryGetVersion(path);
+}
+
+std::unique_ptr<std::string> Cache::find(
+        const std::string& path,
+        const std::string& version) const
+{
+    return m_store->find(key(path), m_revalidate ? &version : nullptr);
+}
+
+bool Cache::read(
+        const std::string& path,
+        const std::string* version,
+        std::vector<char>& data) const
+{
+    const auto local(m_store->find(key(path), version));
+    if (!local) return false;
+
+    std::ifstream stream(*local, std::ios::in | std::ios::binary);
+    if (!stream.good()) return false;
+
+    std::vector<char> copy(
+            (std::istreambuf_iterator<char>(stream)),
+            std::istreambuf_iterator<char>());
+    if (stream.bad()) return false;
+
+    data = std::move(copy);
+    return true;
+}
+
+void Cache::keep(
+        const std::string& path,
+        const std::string& version,
+        const std::vector<char>& data) const
+{
+    // The cache is only an optimization, so failing to populate it is fine.
+    const std::string temp(m_store->temp());
+    std::ofstream stream(temp, copyMode);
+    stream.write(data.data(), data.size());
+    stream.close();
+
+    if (stream.good()) m_store->insert(key(path), version, temp, data.size());
+    else std::remove(temp.c_str());
+}
+
+Cache::Store::Store(const std::string dir, const std::size_t maxSize)
+    : m_dir(([&dir]()
+    {
+        std::string s(expandTilde(dir));
+        if (s.size() && s.back() != '/') s += '/';
+        return s;
+    })())
+    , m_maxSize(maxSize)
+    , m_session(([]()
+    {
+        std::random_device random;
+        return std::to_string(random()) + "-" + std::to_string(random());
+    })())
+{
+    if (!mkdirp(m_dir))
+    {
+        throw ArbiterError("Could not create cache directory " + m_dir);
+    }
+
+    // Pick up copies left by previous runs, oldest first so that their
+    // recency carries over.
+    std::vector<std::pair<std::int64_t, std::string>> found;
+    Fs fs;
+
+    for (const std::string& metaPath : arbiter::glob(m_dir + "*.json"))
+    {
+        Entry entry;
+        std::string key;
+
+        try
+        {
+            const json meta(json::parse(fs.get(metaPath)));
+            key = meta.at("key").get<std::string>();
+            entry.version = meta.at("version").get<std::string>();
+            entry.size = meta.at("size").get<std::size_t>();
+            entry.accessed = meta.at("accessed").get<std::int64_t>();
+        }
+        catch (...)
+        {
+            std::remove(metaPath.c_str());
+            continue;
+        }
+
+        const auto size(fs.tryGetSize(dataPath(key)));
+        if (!size || *size != entry.size)
+        {
+            std::remove(metaPath.c_str());
+            std::remove(dataPath(key).c_str());
+            continue;
+        }
+
+        found.emplace_back(entry.accessed, key);
+        m_entries[key] = entry;
+        m_size += entry.size;
+    }
+
+    std::sort(found.begin(), found.end());
+    for (const auto& p : found)
+    {
+        m_entries[p.second].tick = ++m_tick;
+        m_lru[m_tick] = p.second;
+    }
+
+    // The size limit may have shrunk since the copies were made.
+    while (m_size > m_maxSize) remove(m_entries.find(m_lru.begin()->second));
+}
+
+std::unique_ptr<std::string> Cache::Store::find(
+        const std::string& key,
+        const std::string* version)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto it(m_entries.find(key));
+    if (it == m_entries.end()) return std::unique_ptr<std::string>();
+    if (version && it->second.version != *version)
+    {
+        return std::unique_ptr<std::string>();
+    }
+
+    touch(it);
+    return makeUnique<std::string>(dataPath(key));
+}
+
+std::unique_ptr<std::string> Cache::Store::version(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto it(m_entries.find(key));
+    if (it == m_entries.end()) return std::unique_ptr<std::string>();
+    return makeUnique<std::string>(it->second.version);
+}
+
+std::string Cache::Store::temp()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dir + "tmp-" + m_session + "-" + std::to_string(++m_temps);
+}
+
+void Cache::Store::insert(
+        const std::string& key,
+        const std::string& version,
+        const std::string& temp,
+        const std::size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto existing(m_entries.find(key));
+    if (existing != m_entries.end()) remove(existing);
+
+    if (size > m_maxSize)
+    {
+        std::remove(temp.c_str());
+        return;
+    }
+
+    while (m_size + size > m_maxSize)
+    {
+        remove(m_entries.find(m_lru.begin()->second));
+    }
+
+    if (std::rename(temp.c_str(), dataPath(key).c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+        return;
+    }
+
+    Entry& entry(m_entries[key]);
+    entry.version = version;
+    entry.size = size;
+    entry.tick = ++m_tick;
+    entry.accessed = now();
+
+    m_lru[entry.tick] = key;
+    m_size += size;
+
+    writeMeta(key, entry);
+}
+
+void Cache::Store::erase(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto it(m_entries.find(key));
+    if (it != m_entries.end()) remove(it);
+}
+
+std::string Cache::Store::dataPath(const std::string& key) const
+{
+    return m_dir + crypto::encodeAsHex(crypto::sha256(key));
+}
+
+void Cache::Store::writeMeta(const std::string& key, const Entry& entry) const
+{
+    const json meta {
+        { "key", key },
+        { "version", entry.version },
+        { "size", entry.size },
+        { "accessed", entry.accessed }
+    };
+
+    // A lost update only costs the recency of this copy.
+    try { Fs().put(dataPath(key) + ".json", meta.dump()); }
+    catch (...) { }
+}
+
+void Cache::Store::touch(const Entries::iterator it)
+{
+    Entry& entry(it->second);
+
+    m_lru.erase(entry.tick);
+    entry.tick = ++m_tick;
+    m_lru[entry.tick] = it->first;
+
+    if (now() - entry.accessed >= accessResolution)
+    {
+        entry.accessed = now();
+        writeMeta(it->first, entry);
+    }
+}
+
+void Cache::Store::remove(const Entries::iterator it)
+{
+    const std::string path(dataPath(it->first));
+    std::remove((path + ".json").c_str());
+    std::remove(path.c_str());
+
+    m_size -= it->second.size;
+    m_lru.erase(it->second.tick);
+    m_entries.erase(it);
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
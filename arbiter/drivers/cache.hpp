@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+/** @brief A size-bounded local disk cache in front of another driver.
+ *
+ * Reads are served from a local copy if one exists whose version, as given
+ * by Driver::tryGetVersion, still matches its source, and are otherwise
+ * fetched from the wrapped driver and kept for next time.  Whole reads
+ * check the version and fetch a changed file by a single conditional read,
+ * as by Driver::tryGetChanged, which for HTTP sources costs one request
+ * answered by a 304 if the copy is current.  The least
+ * recently used copies are evicted to stay within the size limit, and since
+ * the copies live on disk, they persist across runs.  Writes go to the
+ * wrapped driver, dropping any cached copy.
+ *
+ * See Cache::wrap for configuration.
+ */
+class ARBITER_DLL Cache : public Driver
+{
+public:
+    class Store;
+
+    /** Cache reads of @p driver in @p store.  Unless @p revalidate, copies
+     * are used without checking the version of their source, which suits
+     * data that never changes.
+     */
+    Cache(
+            std::unique_ptr<Driver> driver,
+            std::shared_ptr<Store> store,
+            bool revalidate = true);
+
+    /** Replace drivers within @p drivers by caches, sharing one Store,
+     * according to the stringified JSON @p j, which is the `cache` entry of
+     * the Arbiter configuration.  If @p j is not an object, nothing is
+     * cached.  Its keys are:
+     *
+     * - `dir`: the cache directory, by default `arbiter-cache` within the
+     *   temporary directory.
+     * - `maxSize`: the most bytes to keep, by default 1 GiB.
+     * - `revalidate`: if false, copies are used without checking the
+     *   version of their source.  True by default.
+     * - `types`: an array of the driver types to cache, by default all
+     *   remote drivers.
+     */
+    static void wrap(DriverMap& drivers, std::string j);
+
+    /** As Cache::wrap, but returns a function with which drivers may be
+     * wrapped one at a time, sharing a single cache.  Returns null if @p j
+     * is not an object.
+     */
+    static DriverWrapper wrapper(std::string j);
+
+    /** @brief The wrapped driver. */
+    const Driver& driver() const { return *m_driver; }
+
+    virtual const Driver* wrapped() const override { return m_driver.get(); }
+
+    virtual std::string type() const override { return m_driver->type(); }
+    virtual bool isRemote() const override { return m_driver->isRemote(); }
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual std::vector<std::unique_ptr<std::size_t>> tryGetSizes(
+            const std::vector<std::string>& paths) const override;
+
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual void putFrom(
+            std::string path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size) const override;
+
+    virtual void putParts(
+            std::string path,
+            const char* data,
+            std::size_t size,
+            std::size_t partSize) const override;
+
+    virtual std::unique_ptr<Writer> putStream(
+            std::string path) const override;
+
+    virtual void copy(std::string src, std::string dst) const override;
+
+    virtual void remove(std::string path) const override;
+
+    virtual std::vector<std::exception_ptr> removeMany(
+            const std::vector<std::string>& paths,
+            std::size_t threads) const override;
+
+    /** Forwards to the wrapped driver, dropping our copy of each changed
+     * file before its change is delivered.
+     */
+    virtual std::unique_ptr<Watch> watch(
+            std::string path,
+            ChangeCallback f,
+            std::chrono::milliseconds interval =
+                std::chrono::seconds(60)) const override;
+
+    /** Streams from the cached copy if there is one, and otherwise caches
+     * the data as it streams from the wrapped driver.
+     */
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    /** Reads from the cached copy if there is one, and otherwise from the
+     * wrapped driver without caching anything.
+     */
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    /** @brief The local copies, which may be shared by several caches. */
+    class ARBITER_DLL Store
+    {
+    public:
+        /** Keep at most @p maxSize bytes in @p dir, which is created if
+         * needed, picking up any copies already there.
+         */
+        Store(std::string dir, std::size_t maxSize);
+
+        /** The local path of the copy for @p key, if there is one and, if
+         * @p version is not null, it has that version.  The copy is marked
+         * as the most recently used.
+         */
+        std::unique_ptr<std::string> find(
+                const std::string& key,
+                const std::string* version);
+
+        /** The version of the copy for @p key, if there is one. */
+        std::unique_ptr<std::string> version(const std::string& key);
+
+        /** A new path in the cache directory to write a copy into. */
+        std::string temp();
+
+        /** Move the complete copy of @p size bytes at @p temp into place
+         * for @p key, evicting the least recently used copies to make room.
+         */
+        void insert(
+                const std::string& key,
+                const std::string& version,
+                const std::string& temp,
+                std::size_t size);
+
+        /** Drop the copy for @p key, if any. */
+        void erase(const std::string& key);
+
+    private:
+        struct Entry
+        {
+            std::string version;
+            std::size_t size = 0;
+            std::uint64_t tick = 0;
+            std::int64_t accessed = 0;
+        };
+
+        using Entries = std::map<std::string, Entry>;
+
+        std::string dataPath(const std::string& key) const;
+        void writeMeta(const std::string& key, const Entry& entry) const;
+        void touch(Entries::iterator it);
+        void remove(Entries::iterator it);
+
+        Store(const Store&);
+        Store& operator=(const Store&);
+
+        const std::string m_dir;
+        const std::size_t m_maxSize;
+
+        // Distinguishes our temporary files from those of other processes
+        // sharing the directory.
+        const std::string m_session;
+
+        std::mutex m_mutex;
+        std::size_t m_size = 0;
+        std::uint64_t m_tick = 0;
+        std::uint64_t m_temps = 0;
+
+        Entries m_entries;
+        std::map<std::uint64_t, std::string> m_lru;
+    };
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    std::string key(const std::string& path) const;
+
+    // The version of @p path, or null if it doesn't exist.  Without
+    // revalidation the source isn't consulted, and this is empty.
+    std::unique_ptr<std::string> currentVersion(const std::string& path) const;
+
+    // The local path of a usable copy of @p path at @p version.
+    std::unique_ptr<std::string> find(
+            const std::string& path,
+            const std::string& version) const;
+
+    // Read our copy of @p path into @p data, if there is one and, unless
+    // @p version is null, it has that version.
+    bool read(
+            const std::string& path,
+            const std::string* version,
+            std::vector<char>& data) const;
+
+    // Keep @p data as our copy of @p path at @p version.
+    void keep(
+            const std::string& path,
+            const std::string& version,
+            const std::vector<char>& data) const;
+
+    Cache(const Cache&);
+    Cache& operator=(const Cache&);
+
+    std::unique_ptr<Driver> m_driver;
+    std::shared_ptr<Store> m_store;
+    const bool m_revalidate;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,241 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/cas.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/sha256.hpp>
+#include <arbiter/util/transforms.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+namespace
+{
+    // Beyond this many, the digests known to be stored are forgotten, so
+    // that their blobs are looked up again.
+    const std::size_t maxStoredDigests(1 << 20);
+}
+
+ContentStore::ContentStore(const Driver& driver, const std::string root)
+    : m_driver(driver)
+    , m_root(root.size() && root.back() != '/' ? root + '/' : root)
+{ }
+
+std::unique_ptr<ContentStore> ContentStore::create(
+        const std::function<const Driver&(const std::string&)>& find,
+        const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object() || !c.count("root"))
+    {
+        throw ArbiterError("The cas configuration must have a root");
+    }
+
+    const std::string root(c.at("root").get<std::string>());
+    if (Arbiter::getType(root) == "cas")
+    {
+        throw ArbiterError("A content store cannot store itself: " + root);
+    }
+
+    return std::unique_ptr<ContentStore>(
+            new ContentStore(find(root), Arbiter::stripType(root)));
+}
+
+void ContentStore::put(
+        const std::string path,
+        const std::vector<char>& data) const
+{
+    const std::string digest(crypto::encodeAsHex(crypto::sha256(data)));
+    const std::string blob(blobPath(digest));
+
+    bool stored(false);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stored = m_stored.count(digest) > 0;
+    }
+
+    if (!stored)
+    {
+        if (!m_driver.tryGetSize(blob)) m_driver.put(blob, data);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stored.size() >= maxStoredDigests) m_stored.clear();
+        m_stored.insert(digest);
+    }
+
+    m_driver.put(namePath(path), digest + " " + std::to_string(data.size()));
+}
+
+std::unique_ptr<std::size_t> ContentStore::tryGetSize(
+        const std::string path) const
+{
+    std::unique_ptr<std::size_t> size;
+    if (auto ref = tryGetRef(path)) size.reset(new std::size_t(ref->size));
+    return size;
+}
+
+bool ContentStore::exists(const std::string path) const
+{
+    return m_driver.exists(namePath(path));
+}
+
+std::unique_ptr<std::string> ContentStore::tryGetVersion(
+        const std::string path) const
+{
+    std::unique_ptr<std::string> version;
+    if (auto ref = tryGetRef(path))
+    {
+        version.reset(new std::string(ref->digest));
+    }
+    return version;
+}
+
+void ContentStore::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    m_driver.getStream(blobPath(getRef(path).digest), sink);
+}
+
+Capabilities ContentStore::capabilities() const
+{
+    const Capabilities inner(m_driver.capabilities());
+
+    Capabilities c;
+    c.rangedReads = inner.rangedReads;
+    c.serverSideCopy = inner.serverSideCopy;
+    return c;
+}
+
+std::vector<char> ContentStore::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    return m_driver.getRange(blobPath(getRef(path).digest), offset, length);
+}
+
+void ContentStore::copy(const std::string src, const std::string dst) const
+{
+    m_driver.copy(namePath(src), namePath(dst));
+}
+
+void ContentStore::remove(const std::string path) const
+{
+    m_driver.remove(namePath(path));
+}
+
+std::string ContentStore::blobPath(const std::string& digest) const
+{
+    return m_root + "blobs/" + digest.substr(0, 2) + "/" + digest;
+}
+
+bool ContentStore::get(const std::string path, std::vector<char>& data) const
+{
+    const std::unique_ptr<Ref> ref(tryGetRef(path));
+    if (!ref) return false;
+
+    data = m_driver.getBinary(blobPath(ref->digest));
+    return true;
+}
+
+std::vector<std::string> ContentStore::glob(
+        const std::string path,
+        const bool verbose) const
+{
+    std::vector<std::string> results;
+    list(path, [&results](FileInfo info)
+    {
+        results.push_back(std::move(info.path));
+    }, verbose);
+    return results;
+}
+
+void ContentStore::glob(
+        const std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    list(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void ContentStore::globInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    list(path, f, verbose);
+}
+
+void ContentStore::globPattern(
+        const Glob& glob,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    list(glob.pattern(), f, verbose);
+}
+
+std::string ContentStore::namePath(const std::string& path) const
+{
+    return m_root + "names/" + path;
+}
+
+std::unique_ptr<ContentStore::Ref> ContentStore::tryGetRef(
+        const std::string& path) const
+{
+    std::unique_ptr<Ref> ref;
+
+    const auto data(m_driver.tryGetBinary(namePath(path)));
+    if (!data) return ref;
+
+    const std::string s(data->begin(), data->end());
+    const std::size_t space(s.find(' '));
+    if (space == std::string::npos)
+    {
+        throw ArbiterError("Invalid content store name: " + path);
+    }
+
+    ref.reset(new Ref());
+    ref->digest = s.substr(0, space);
+    ref->size = std::stoull(s.substr(space + 1));
+    return ref;
+}
+
+ContentStore::Ref ContentStore::getRef(const std::string& path) const
+{
+    if (auto ref = tryGetRef(path)) return *ref;
+    throw ArbiterError("Could not read file " + path);
+}
+
+void ContentStore::list(
+        const std::string& path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const std::string names(namePath(""));
+
+    // Sizes and versions are those of the names, not of their contents.
+    m_driver.resolveInfo(namePath(path), [&](FileInfo info)
+    {
+        const std::string stripped(Arbiter::stripType(info.path));
+        if (stripped.compare(0, names.size(), names) != 0) return;
+
+        f(FileInfo(type() + "://" + stripped.substr(names.size())));
+    }, verbose);
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+/** @brief A content-addressed store, in which files with the same contents
+ * are stored once.
+ *
+ * Paths are of the form `cas://<name>`.  The contents of each file are
+ * stored under the root of the store at `blobs/<xx>/<digest>`, where
+ * `<digest>` is the hex SHA-256 of the contents and `<xx>` its first two
+ * characters, and the file itself is a small object at `names/<name>`,
+ * which holds the digest and size of its contents.  A write whose contents
+ * are already stored costs a lookup of their blob in place of its upload,
+ * and nothing at all once this driver has seen the blob, besides the write
+ * of the name.
+ *
+ * Versions are the digests of the contents.  Copies and removals affect
+ * only names, so copies transfer nothing, and blobs are never removed,
+ * since other names may refer to them.  Listings are of names, and don't
+ * include sizes.
+ */
+class ARBITER_DLL ContentStore : public Driver
+{
+public:
+    /** Store files beneath @p root of @p driver, which must outlive this
+     * one.  @p root is stripped of its type.
+     */
+    ContentStore(const Driver& driver, std::string root);
+
+    /** Create a store according to the stringified JSON @p j, which is the
+     * `cas` entry of the Arbiter configuration, finding the driver of its
+     * root with @p find.  Its `root` key is the root of the store with its
+     * type, like `s3://bucket/store/`.
+     */
+    static std::unique_ptr<ContentStore> create(
+            const std::function<const Driver&(const std::string&)>& find,
+            std::string j);
+
+    virtual std::string type() const override { return "cas"; }
+
+    using Driver::put;
+
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual bool exists(std::string path) const override;
+
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    /** Ranged reads and copies, if the backing driver has them. */
+    virtual Capabilities capabilities() const override;
+
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    virtual void copy(std::string src, std::string dst) const override;
+
+    virtual void remove(std::string path) const override;
+
+    /** The path, stripped of its type, of the blob holding @p digest. */
+    std::string blobPath(const std::string& digest) const;
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    virtual void globPattern(
+            const Glob& glob,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    struct Ref
+    {
+        std::string digest;
+        std::size_t size = 0;
+    };
+
+    std::string namePath(const std::string& path) const;
+
+    // The contents to which @p path refers, or null if it doesn't exist.
+    std::unique_ptr<Ref> tryGetRef(const std::string& path) const;
+    Ref getRef(const std::string& path) const;
+
+    // Pass the names matching @p path, which may be globbed, to @p f.
+    void list(
+            const std::string& path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const;
+
+    ContentStore(const ContentStore&);
+    ContentStore& operator=(const ContentStore&);
+
+    const Driver& m_driver;
+    const std::string m_root;
+
+    // Digests whose blobs are known to be stored.
+    mutable std::mutex m_mutex;
+    mutable std::set<std::string> m_stored;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
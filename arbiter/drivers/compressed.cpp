@@ -0,0 +1,666 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/compressed.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/util.hpp>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef ARBITER_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef ARBITER_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+namespace
+{
+    using Sink = std::function<void(const char*, std::size_t)>;
+
+    // Size of the output buffers of the codecs, and of the largest input
+    // passed to them in one call.
+    const std::size_t codecChunkSize(64 * 1024);
+
+    const unsigned char gzipMagic[] = { 0x1f, 0x8b };
+    const unsigned char zstdMagic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+    class Encoder
+    {
+    public:
+        virtual ~Encoder() { }
+
+        // Compress @p size bytes, passing any output to @p sink.
+        virtual void write(
+                const char* data,
+                std::size_t size,
+                const Sink& sink) = 0;
+
+        // Pass the remaining output to @p sink.
+        virtual void finish(const Sink& sink) = 0;
+    };
+
+    class Decoder
+    {
+    public:
+        virtual ~Decoder() { }
+
+        // Decompress @p size bytes, passing any output to @p sink.
+        virtual void write(
+                const char* data,
+                std::size_t size,
+                const Sink& sink) = 0;
+
+        // True if the input so far ends at the end of a complete stream.
+        virtual bool done() const = 0;
+    };
+
+    class PassthroughDecoder : public Decoder
+    {
+    public:
+        virtual void write(
+                const char* data,
+                const std::size_t size,
+                const Sink& sink) override
+        {
+            if (size) sink(data, size);
+        }
+
+        virtual bool done() const override { return true; }
+    };
+
+#ifdef ARBITER_ZLIB
+    class GzipEncoder : public Encoder
+    {
+    public:
+        explicit GzipEncoder(const int level)
+            : m_buffer(codecChunkSize)
+        {
+            m_z.zalloc = Z_NULL;
+            m_z.zfree = Z_NULL;
+            m_z.opaque = Z_NULL;
+
+            // A window of 15 bits, plus 16 for a gzip rather than zlib header.
+            const int code(deflateInit2(
+                        &m_z,
+                        level,
+                        Z_DEFLATED,
+                        15 + 16,
+                        8,
+                        Z_DEFAULT_STRATEGY));
+
+            if (code != Z_OK)
+            {
+                throw ArbiterError("Could not initialize gzip compression");
+            }
+        }
+
+        ~GzipEncoder() { deflateEnd(&m_z); }
+
+        virtual void write(
+                const char* data,
+                std::size_t size,
+                const Sink& sink) override
+        {
+            while (size)
+            {
+                const std::size_t n((std::min)(size, codecChunkSize));
+                run(data, n, Z_NO_FLUSH, sink);
+                data += n;
+                size -= n;
+            }
+        }
+
+        virtual void finish(const Sink& sink) override
+        {
+            run(nullptr, 0, Z_FINISH, sink);
+        }
+
+    private:
+        void run(
+                const char* data,
+                const std::size_t size,
+                const int flush,
+                const Sink& sink)
+        {
+            m_z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            m_z.avail_in = static_cast<uInt>(size);
+
+            int code(Z_OK);
+            do
+            {
+                m_z.next_out = reinterpret_cast<Bytef*>(m_buffer.data());
+                m_z.avail_out = static_cast<uInt>(m_buffer.size());
+
+                code = deflate(&m_z, flush);
+                if (code == Z_STREAM_ERROR)
+                {
+                    throw ArbiterError("Could not compress data");
+                }
+
+                const std::size_t n(m_buffer.size() - m_z.avail_out);
+                if (n) sink(m_buffer.data(), n);
+            }
+            while (
+                    !m_z.avail_out ||
+                    (flush == Z_FINISH && code != Z_STREAM_END));
+        }
+
+        z_stream m_z;
+        std::vector<char> m_buffer;
+    };
+
+    class GzipDecoder : public Decoder
+    {
+    public:
+        GzipDecoder()
+            : m_buffer(codecChunkSize)
+        {
+            m_z.zalloc = Z_NULL;
+            m_z.zfree = Z_NULL;
+            m_z.opaque = Z_NULL;
+            m_z.avail_in = 0;
+            m_z.next_in = Z_NULL;
+
+            if (inflateInit2(&m_z, 15 + 16) != Z_OK)
+            {
+                throw ArbiterError("Could not initialize gzip decompression");
+            }
+        }
+
+        ~GzipDecoder() { inflateEnd(&m_z); }
+
+        virtual void write(
+                const char* data,
+                std::size_t size,
+                const Sink& sink) override
+        {
+            while (size)
+            {
+                const std::size_t n((std::min)(size, codecChunkSize));
+                run(data, n, sink);
+                data += n;
+                size -= n;
+            }
+        }
+
+        virtual bool done() const override { return m_done; }
+
+    private:
+        void run(const char* data, const std::size_t size, const Sink& sink)
+        {
+            m_z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            m_z.avail_in = static_cast<uInt>(size);
+
+            do
+            {
+                m_z.next_out = reinterpret_cast<Bytef*>(m_buffer.data());
+                m_z.avail_out = static_cast<uInt>(m_buffer.size());
+
+                const int code(inflate(&m_z, Z_NO_FLUSH));
+                if (code != Z_OK &&
+                    code != Z_STREAM_END &&
+                    code != Z_BUF_ERROR)
+                {
+                    throw ArbiterError("Could not decompress gzip data");
+                }
+
+                const std::size_t n(m_buffer.size() - m_z.avail_out);
+                if (n) sink(m_buffer.data(), n);
+
+                m_done = code == Z_STREAM_END;
+
+                // Concatenated gzip members are decoded as one stream.
+                if (m_done && m_z.avail_in) inflateReset(&m_z);
+            }
+            while (m_z.avail_in || !m_z.avail_out);
+        }
+
+        z_stream m_z;
+        std::vector<char> m_buffer;
+        bool m_done = false;
+    };
+#endif
+
+#ifdef ARBITER_ZSTD
+    class ZstdEncoder : public Encoder
+    {
+    public:
+        explicit ZstdEncoder(const int level)
+            : m_ctx(ZSTD_createCCtx())
+            , m_buffer(ZSTD_CStreamOutSize())
+        {
+            if (!m_ctx ||
+                ZSTD_isError(ZSTD_CCtx_setParameter(
+                        m_ctx,
+                        ZSTD_c_compressionLevel,
+                        level)))
+            {
+                ZSTD_freeCCtx(m_ctx);
+                throw ArbiterError("Could not initialize zstd compression");
+            }
+        }
+
+        ~ZstdEncoder() { ZSTD_freeCCtx(m_ctx); }
+
+        virtual void write(
+                const char* data,
+                const std::size_t size,
+                const Sink& sink) override
+        {
+            run(data, size, ZSTD_e_continue, sink);
+        }
+
+        virtual void finish(const Sink& sink) override
+        {
+            run(nullptr, 0, ZSTD_e_end, sink);
+        }
+
+    private:
+        void run(
+                const char* data,
+                const std::size_t size,
+                const ZSTD_EndDirective mode,
+                const Sink& sink)
+        {
+            ZSTD_inBuffer in = { data, size, 0 };
+
+            bool finished(false);
+            do
+            {
+                ZSTD_outBuffer out = { m_buffer.data(), m_buffer.size(), 0 };
+
+                const std::size_t remaining(
+                        ZSTD_compressStream2(m_ctx, &out, &in, mode));
+                if (ZSTD_isError(remaining))
+                {
+                    throw ArbiterError("Could not compress data");
+                }
+
+                if (out.pos) sink(m_buffer.data(), out.pos);
+
+                finished = mode == ZSTD_e_end ?
+                    remaining == 0 : in.pos == in.size;
+            }
+            while (!finished);
+        }
+
+        ZSTD_CCtx* const m_ctx;
+        std::vector<char> m_buffer;
+    };
+
+    class ZstdDecoder : public Decoder
+    {
+    public:
+        ZstdDecoder()
+            : m_ctx(ZSTD_createDCtx())
+            , m_buffer(ZSTD_DStreamOutSize())
+        {
+            if (!m_ctx)
+            {
+                throw ArbiterError("Could not initialize zstd decompression");
+            }
+        }
+
+        ~ZstdDecoder() { ZSTD_freeDCtx(m_ctx); }
+
+        virtual void write(
+                const char* data,
+                const std::size_t size,
+                const Sink& sink) override
+        {
+            ZSTD_inBuffer in = { data, size, 0 };
+
+            bool full(false);
+            while (in.pos < in.size || full)
+            {
+                ZSTD_outBuffer out = { m_buffer.data(), m_buffer.size(), 0 };
+
+                const std::size_t code(
+                        ZSTD_decompressStream(m_ctx, &out, &in));
+                if (ZSTD_isError(code))
+                {
+                    throw ArbiterError("Could not decompress zstd data");
+                }
+
+                if (out.pos) sink(m_buffer.data(), out.pos);
+
+                // Zero marks the end of a frame, after which concatenated
+                // frames may follow.
+                m_done = code == 0;
+                full = out.pos == out.size;
+            }
+        }
+
+        virtual bool done() const override { return m_done; }
+
+    private:
+        ZSTD_DCtx* const m_ctx;
+        std::vector<char> m_buffer;
+        bool m_done = false;
+    };
+#endif
+
+    std::unique_ptr<Encoder> makeEncoder(
+            const Compressed::Codec codec,
+            const int level)
+    {
+        switch (codec)
+        {
+#ifdef ARBITER_ZLIB
+            case Compressed::Codec::Gzip:
+                return std::unique_ptr<Encoder>(new GzipEncoder(level));
+#endif
+#ifdef ARBITER_ZSTD
+            case Compressed::Codec::Zstd:
+                return std::unique_ptr<Encoder>(new ZstdEncoder(level));
+#endif
+            default:
+                throw ArbiterError("Compression codec is not supported");
+        }
+    }
+
+    bool startsWith(
+            const std::vector<char>& data,
+            const unsigned char* magic,
+            const std::size_t size)
+    {
+        return data.size() >= size && !std::memcmp(data.data(), magic, size);
+    }
+
+    // Decodes data in any supported format, detected from its leading
+    // bytes, and passes through data in none of them.
+    class Decompressor
+    {
+    public:
+        void write(const char* data, const std::size_t size, const Sink& sink)
+        {
+            if (m_decoder)
+            {
+                m_decoder->write(data, size, sink);
+                return;
+            }
+
+            m_head.insert(m_head.end(), data, data + size);
+            if (m_head.size() >= sizeof(zstdMagic)) start(sink);
+        }
+
+        // Throws if the data ended partway through a compressed stream.
+        void finish(const Sink& sink)
+        {
+            if (!m_decoder) start(sink);
+            if (!m_decoder->done())
+            {
+                throw ArbiterError("Compressed data ended unexpectedly");
+            }
+        }
+
+    private:
+        void start(const Sink& sink)
+        {
+            if (startsWith(m_head, gzipMagic, sizeof(gzipMagic)))
+            {
+#ifdef ARBITER_ZLIB
+                m_decoder.reset(new GzipDecoder());
+#else
+                throw ArbiterError("Cannot decompress gzip data without zlib");
+#endif
+            }
+            else if (startsWith(m_head, zstdMagic, sizeof(zstdMagic)))
+            {
+#ifdef ARBITER_ZSTD
+                m_decoder.reset(new ZstdDecoder());
+#else
+                throw ArbiterError("Cannot decompress zstd data without zstd");
+#endif
+            }
+            else m_decoder.reset(new PassthroughDecoder());
+
+            m_decoder->write(m_head.data(), m_head.size(), sink);
+            m_head.clear();
+        }
+
+        std::vector<char> m_head;
+        std::unique_ptr<Decoder> m_decoder;
+    };
+
+    class CompressedWriter : public Writer
+    {
+    public:
+        CompressedWriter(
+                std::unique_ptr<Writer> writer,
+                std::unique_ptr<Encoder> encoder)
+            : m_writer(std::move(writer))
+            , m_encoder(std::move(encoder))
+            , m_sink([this](const char* data, std::size_t size)
+            {
+                m_writer->write(data, size);
+            })
+        { }
+
+        virtual void write(const char* data, std::size_t size) override
+        {
+            m_encoder->write(data, size, m_sink);
+        }
+
+        virtual void done() override
+        {
+            m_encoder->finish(m_sink);
+            m_writer->done();
+        }
+
+    private:
+        std::unique_ptr<Writer> m_writer;
+        std::unique_ptr<Encoder> m_encoder;
+        const Sink m_sink;
+    };
+
+    Sink appendTo(std::vector<char>& out)
+    {
+        return [&out](const char* data, std::size_t size)
+        {
+            out.insert(out.end(), data, data + size);
+        };
+    }
+}
+
+Compressed::Compressed(
+        const Driver& driver,
+        const Codec codec,
+        const int level)
+    : m_driver(driver)
+    , m_codec(codec)
+    , m_level(level)
+{
+    // Fail now, rather than on the first write, for codecs not in this build.
+    makeEncoder(m_codec, m_level);
+}
+
+std::unique_ptr<Compressed> Compressed::create(
+        const Driver& driver,
+        const std::string name,
+        const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+
+    Codec codec(Codec::Gzip);
+    int level(6);
+
+    if (name == "zstd")
+    {
+        codec = Codec::Zstd;
+        level = 3;
+    }
+    else if (name != "gz")
+    {
+        throw ArbiterError("Unknown compression codec: " + name);
+    }
+
+    if (c.is_object()) level = c.value("level", level);
+
+    return makeUnique<Compressed>(driver, codec, level);
+}
+
+std::vector<std::string> Compressed::codecs()
+{
+    std::vector<std::string> names;
+#ifdef ARBITER_ZLIB
+    names.push_back("gz");
+#endif
+#ifdef ARBITER_ZSTD
+    names.push_back("zstd");
+#endif
+    return names;
+}
+
+std::string Compressed::type() const
+{
+    return (m_codec == Codec::Zstd ? "zstd+" : "gz+") + m_driver.type();
+}
+
+void Compressed::put(
+        const std::string path,
+        const std::vector<char>& data) const
+{
+    std::vector<char> compressed;
+    const Sink sink(appendTo(compressed));
+
+    std::unique_ptr<Encoder> encoder(makeEncoder(m_codec, m_level));
+    encoder->write(data.data(), data.size(), sink);
+    encoder->finish(sink);
+
+    m_driver.put(path, compressed);
+}
+
+bool Compressed::get(const std::string path, std::vector<char>& data) const
+{
+    std::unique_ptr<std::vector<char>> compressed(m_driver.tryGetBinary(path));
+    if (!compressed) return false;
+
+    const Sink sink(appendTo(data));
+
+    Decompressor decompressor;
+    decompressor.write(compressed->data(), compressed->size(), sink);
+    decompressor.finish(sink);
+    return true;
+}
+
+std::unique_ptr<std::size_t> Compressed::tryGetSize(
+        const std::string path) const
+{
+    std::unique_ptr<std::vector<char>> compressed(m_driver.tryGetBinary(path));
+    if (!compressed) return std::unique_ptr<std::size_t>();
+
+    std::size_t size(0);
+    const Sink sink([&size](const char*, std::size_t n) { size += n; });
+
+    Decompressor decompressor;
+    decompressor.write(compressed->data(), compressed->size(), sink);
+    decompressor.finish(sink);
+    return makeUnique<std::size_t>(size);
+}
+
+bool Compressed::exists(const std::string path) const
+{
+    return m_driver.exists(path);
+}
+
+std::unique_ptr<std::string> Compressed::tryGetVersion(
+        const std::string path) const
+{
+    return m_driver.tryGetVersion(path);
+}
+
+void Compressed::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    Decompressor decompressor;
+    m_driver.getStream(path, [&decompressor, &sink](
+                const char* data,
+                std::size_t size)
+    {
+        decompressor.write(data, size, sink);
+    });
+    decompressor.finish(sink);
+}
+
+std::unique_ptr<Writer> Compressed::putStream(const std::string path) const
+{
+    return std::unique_ptr<Writer>(
+            new CompressedWriter(
+                m_driver.putStream(path),
+                makeEncoder(m_codec, m_level)));
+}
+
+void Compressed::copy(const std::string src, const std::string dst) const
+{
+    m_driver.copy(src, dst);
+}
+
+void Compressed::remove(const std::string path) const
+{
+    m_driver.remove(path);
+}
+
+std::vector<std::exception_ptr> Compressed::removeMany(
+        const std::vector<std::string>& paths,
+        const std::size_t threads) const
+{
+    return m_driver.removeMany(paths, threads);
+}
+
+std::vector<std::string> Compressed::glob(
+        const std::string path,
+        const bool verbose) const
+{
+    std::vector<std::string> results;
+    globInfo(path, [&results](FileInfo info)
+    {
+        results.push_back(std::move(info.path));
+    }, verbose);
+    return results;
+}
+
+void Compressed::globInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const std::string inner(m_driver.type() + "://");
+    const std::string outer(type() + "://");
+
+    m_driver.resolveInfo(path, [&](FileInfo info)
+    {
+        if (!info.path.compare(0, inner.size(), inner))
+        {
+            info.path = info.path.substr(inner.size());
+        }
+        info.path = outer + info.path;
+
+        info.hasSize = false;
+        info.size = 0;
+        f(std::move(info));
+    }, verbose);
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
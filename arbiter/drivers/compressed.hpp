@@ -0,0 +1,122 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+/** @brief Transparent compression of the files of another driver.
+ *
+ * Data written through this driver is compressed before it reaches the
+ * wrapped driver, and data read through it is decompressed as it arrives,
+ * so only compressed bytes are stored and transferred.  Its type is the
+ * codec followed by `+` and the wrapped type, for example `gz+s3`.
+ *
+ * Reads detect their format from the data, so files written with either
+ * codec, or not compressed at all, may be read through any codec.  Sizes
+ * are those of the decompressed data, which must be read in full to find
+ * them.  Copies, versions, and existence are those of the stored files.
+ */
+class ARBITER_DLL Compressed : public Driver
+{
+public:
+    enum class Codec
+    {
+        Gzip,
+        Zstd
+    };
+
+    /** Compress the files of @p driver, which must outlive this one, with
+     * @p codec at @p level.
+     */
+    Compressed(const Driver& driver, Codec codec, int level);
+
+    /** Compress the files of @p driver with the codec named @p name, which
+     * is one of Compressed::codecs, configured by the stringified JSON
+     * @p j.  This is the entry for the codec within the `compression` entry
+     * of the Arbiter configuration, whose `level` key sets the compression
+     * level, by default 6 for `gz` and 3 for `zstd`.
+     */
+    static std::unique_ptr<Compressed> create(
+            const Driver& driver,
+            std::string name,
+            std::string j);
+
+    /** The names of the codecs in this build: `gz` with zlib, and `zstd`
+     * with Zstandard.
+     */
+    static std::vector<std::string> codecs();
+
+    virtual std::string type() const override;
+    virtual bool isRemote() const override { return m_driver.isRemote(); }
+
+    using Driver::get;
+    using Driver::put;
+
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual bool exists(std::string path) const override;
+
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    virtual std::unique_ptr<Writer> putStream(std::string path) const override;
+
+    virtual void copy(std::string src, std::string dst) const override;
+
+    virtual void remove(std::string path) const override;
+
+    virtual std::vector<std::exception_ptr> removeMany(
+            const std::vector<std::string>& paths,
+            std::size_t threads) const override;
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    /** Listed sizes are those of the stored files, so they are omitted. */
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    const Driver& m_driver;
+    const Codec m_codec;
+    const int m_level;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -4,8 +4,11 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cstdlib>
 #include <functional>
+#include <map>
+#include <thread>
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/arbiter.hpp>
@@ -31,17 +34,193 @@ namespace
     const std::string getUrl(baseDropboxUrl + "2/files/download");
     const std::string putUrl(baseDropboxUrl + "2/files/upload");
 
+    // https://www.dropbox.com/developers/documentation/http/documentation
+    // #files-upload_session-start
+    const std::string sessionUrl(baseDropboxUrl + "2/files/upload_session");
+    const std::string startUrl(sessionUrl + "/start");
+    const std::string appendUrl(sessionUrl + "/append_v2");
+    const std::string finishUrl(sessionUrl + "/finish");
+    const std::string finishBatchUrl(
+            "https://api.dropboxapi.com/2/"
+            "files/upload_session/finish_batch_v2");
+
     const std::string listUrl("https://api.dropboxapi.com/2/files/list_folder");
     const std::string metaUrl("https://api.dropboxapi.com/2/files/get_metadata");
+    const std::string deleteUrl("https://api.dropboxapi.com/2/files/delete_v2");
     const std::string continueListUrl(listUrl + "/continue");
 
+    // https://www.dropbox.com/developers/documentation/http/documentation
+    // #files-copy_batch
+    const std::string copyUrl("https://api.dropboxapi.com/2/files/copy_v2");
+    const std::string copyBatchUrl(
+            "https://api.dropboxapi.com/2/files/copy_batch_v2");
+    const std::string copyCheckUrl(
+            "https://api.dropboxapi.com/2/files/copy_batch/check_v2");
+
+    // https://www.dropbox.com/developers/documentation/http/documentation
+    // #files-move_batch
+    const std::string moveUrl("https://api.dropboxapi.com/2/files/move_v2");
+    const std::string moveBatchUrl(
+            "https://api.dropboxapi.com/2/files/move_batch_v2");
+    const std::string moveCheckUrl(
+            "https://api.dropboxapi.com/2/files/move_batch/check_v2");
+
+    // Batch jobs are polled at this interval, which doubles up to its limit.
+    const std::chrono::milliseconds batchPollDelay(100);
+    const std::chrono::milliseconds batchPollLimit(2000);
+
     const auto ins([](unsigned char lhs, unsigned char rhs)
     {
         return std::tolower(lhs) == std::tolower(rhs);
     });
 
+    std::string dropboxLower(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+        return s;
+    }
+
     const std::string dirTag("folder");
     const std::string fileTag("file");
+
+    // Single requests are limited to 150 MB, and the chunks of a concurrent
+    // upload session other than the last must be a multiple of 4 MiB.
+    const std::size_t maxRequestSize(150 * 1000 * 1000);
+    const std::size_t dropboxChunkQuantum(4 * 1024 * 1024);
+
+    const std::size_t maxBatchSize(1000);
+
+    // The largest page of listing entries that may be requested.
+    const std::size_t listLimit(2000);
+
+    // Batched size lookups list any folder holding at least this many of
+    // the paths, instead of fetching the metadata of each.
+    const std::size_t listThreshold(16);
+
+    // Pulls the files, cursor, and continuation flag out of a listing page
+    // as it is parsed, without building a document for the whole page.
+    class DropboxListingSax : public nlohmann::json_sax<json>
+    {
+    public:
+        DropboxListingSax(
+                const std::function<void(const std::string&, std::size_t)>& f)
+            : m_f(f)
+        { }
+
+        bool hasEntries() const { return m_hasEntries; }
+        bool hasMore() const { return m_hasMore; }
+        const std::string& cursor() const { return m_cursor; }
+
+        bool null() override { return true; }
+        bool boolean(bool val) override
+        {
+            if (m_depth == 1 && m_key == "has_more") m_hasMore = val;
+            return true;
+        }
+        bool number_integer(number_integer_t val) override
+        {
+            return size(val);
+        }
+        bool number_unsigned(number_unsigned_t val) override
+        {
+            return size(val);
+        }
+        bool number_float(number_float_t, const string_t&) override
+        {
+            return true;
+        }
+
+        bool string(string_t& val) override
+        {
+            if (m_depth == 1 && m_key == "cursor") m_cursor = std::move(val);
+            else if (m_entries && m_depth == 3)
+            {
+                if (m_key == ".tag") m_tag = std::move(val);
+                else if (m_key == "path_lower") m_path = std::move(val);
+            }
+            return true;
+        }
+
+        bool key(string_t& val) override
+        {
+            if (m_depth == 1 || m_depth == 3) m_key = std::move(val);
+            return true;
+        }
+
+        bool start_object(std::size_t) override
+        {
+            ++m_depth;
+            return true;
+        }
+
+        bool end_object() override
+        {
+            if (m_entries && m_depth == 3)
+            {
+                // Only files are passed on.
+                if (m_tag.size() == fileTag.size() &&
+                        std::equal(
+                            m_tag.begin(),
+                            m_tag.end(),
+                            fileTag.begin(),
+                            ins))
+                {
+                    m_f(m_path, m_size);
+                }
+
+                m_tag.clear();
+                m_path.clear();
+                m_size = 0;
+            }
+            --m_depth;
+            return true;
+        }
+
+        bool start_array(std::size_t) override
+        {
+            if (m_depth == 1 && m_key == "entries")
+            {
+                m_entries = m_hasEntries = true;
+            }
+            ++m_depth;
+            return true;
+        }
+
+        bool end_array() override
+        {
+            if (--m_depth == 1) m_entries = false;
+            return true;
+        }
+
+        bool parse_error(
+                std::size_t,
+                const std::string&,
+                const nlohmann::detail::exception&) override
+        {
+            return false;
+        }
+
+    private:
+        bool size(const std::size_t val)
+        {
+            if (m_entries && m_depth == 3 && m_key == "size") m_size = val;
+            return true;
+        }
+
+        const std::function<void(const std::string&, std::size_t)>& m_f;
+
+        std::string m_key;
+        std::size_t m_depth = 0;
+        bool m_entries = false;
+        bool m_hasEntries = false;
+
+        std::string m_tag;
+        std::string m_path;
+        std::size_t m_size = 0;
+
+        std::string m_cursor;
+        bool m_hasMore = false;
+    };
 }
 
 namespace drivers
@@ -49,11 +228,30 @@ namespace drivers
 
 using namespace http;
 
-Dropbox::Dropbox(Pool& pool, const Dropbox::Auth& auth)
+Dropbox::Dropbox(
+        Pool& pool,
+        const Dropbox::Auth& auth,
+        const Dropbox::Config& config)
     : Http(pool)
     , m_auth(auth)
+    , m_config(config)
 { }
 
+Dropbox::Config::Config(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object()) return;
+
+    m_sessionThreshold = (std::min)(
+            c.value("sessionThreshold", m_sessionThreshold),
+            maxRequestSize);
+
+    const std::size_t chunkSize(c.value("chunkSize", m_chunkSize));
+    m_chunkSize = (std::min)(
+            (std::max)(chunkSize / dropboxChunkQuantum, std::size_t(1)),
+            maxRequestSize / dropboxChunkQuantum) * dropboxChunkQuantum;
+}
+
 std::unique_ptr<Dropbox> Dropbox::create(Pool& pool, const std::string s)
 {
     const json j(json::parse(s));
@@ -63,7 +261,8 @@ std::unique_ptr<Dropbox> Dropbox::create(Pool& pool, const std::string s)
         {
             return makeUnique<Dropbox>(
                     pool,
-                    Auth(j.at("token").get<std::string>()));
+                    Auth(j.at("token").get<std::string>()),
+                    Config(s));
         }
         else if (j.is_string())
         {
@@ -81,7 +280,6 @@ Headers Dropbox::httpGetHeaders() const
     headers["Authorization"] = "Bearer " + m_auth.token();
 
     headers["Transfer-Encoding"] = "";
-    headers["Expect"] = "";
 
     return headers;
 }
@@ -92,30 +290,49 @@ Headers Dropbox::httpPostHeaders() const
 
     headers["Authorization"] = "Bearer " + m_auth.token();
     headers["Transfer-Encoding"] = "chunked";
-    headers["Expect"] = "100-continue";
     headers["Content-Type"] = "application/json";
 
     return headers;
 }
 
-std::unique_ptr<std::size_t> Dropbox::tryGetSize(
-        const std::string rawPath) const
+Response Dropbox::getMetadata(const std::string rawPath) const
 {
-    std::unique_ptr<std::size_t> result;
-
     Headers headers(httpPostHeaders());
 
     json tx { { "path", "/" + sanitize(rawPath) } };
     const std::string f(tx.dump());
     const std::vector<char> postData(f.begin(), f.end());
 
-    Response res(Http::internalPost(metaUrl, postData, headers));
+    return Http::internalPost(metaUrl, postData, headers);
+}
+
+std::unique_ptr<std::string> Dropbox::tryGetVersion(
+        const std::string rawPath) const
+{
+    std::unique_ptr<std::string> result;
+    const Response res(getMetadata(rawPath));
 
     if (res.ok())
     {
-        const auto data(res.data());
+        const json rx(parseFields(res.str(), { "rev" }));
+        if (rx.count("rev"))
+        {
+            result = makeUnique<std::string>(rx.at("rev").get<std::string>());
+        }
+    }
 
-        json rx(json::parse(std::string(data.data(), data.size())));
+    return result;
+}
+
+std::unique_ptr<std::size_t> Dropbox::tryGetSize(
+        const std::string rawPath) const
+{
+    std::unique_ptr<std::size_t> result;
+    const Response res(getMetadata(rawPath));
+
+    if (res.ok())
+    {
+        const json rx(parseFields(res.str(), { "size" }));
         if (rx.count("size"))
         {
             result = makeUnique<std::size_t>(rx.at("size").get<uint64_t>());
@@ -125,11 +342,236 @@ std::unique_ptr<std::size_t> Dropbox::tryGetSize(
     return result;
 }
 
+void Dropbox::remove(const std::string rawPath) const
+{
+    const json tx { { "path", "/" + sanitize(rawPath) } };
+    const std::string f(tx.dump());
+    const std::vector<char> postData(f.begin(), f.end());
+
+    const Response res(
+            Http::internalPost(deleteUrl, postData, httpPostHeaders()));
+    if (res.ok()) return;
+
+    // A path which doesn't exist is reported as a lookup conflict.
+    const std::string message(res.str());
+    if (res.code() == 409 && message.find("not_found") != std::string::npos)
+    {
+        return;
+    }
+
+    throw ArbiterError("Couldn't Dropbox delete " + rawPath + ": " + message);
+}
+
+Capabilities Dropbox::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = true;
+    c.serverSideCopy = true;
+    c.delimiters = true;
+    c.listingMetadata = true;
+    return c;
+}
+
+struct Dropbox::Op
+{
+    const std::string& url;
+    const std::string& batchUrl;
+    const std::string& checkUrl;
+    const char* verb;
+};
+
+void Dropbox::copy(const std::string src, const std::string dst) const
+{
+    relocate(Op { copyUrl, copyBatchUrl, copyCheckUrl, "copy" }, src, dst);
+}
+
+std::vector<std::exception_ptr> Dropbox::copyMany(
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        const std::size_t threads) const
+{
+    return relocateMany(
+            Op { copyUrl, copyBatchUrl, copyCheckUrl, "copy" },
+            pairs,
+            threads);
+}
+
+void Dropbox::move(const std::string src, const std::string dst) const
+{
+    relocate(Op { moveUrl, moveBatchUrl, moveCheckUrl, "move" }, src, dst);
+}
+
+std::vector<std::exception_ptr> Dropbox::moveMany(
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        const std::size_t threads) const
+{
+    return relocateMany(
+            Op { moveUrl, moveBatchUrl, moveCheckUrl, "move" },
+            pairs,
+            threads);
+}
+
+void Dropbox::relocate(
+        const Op& op,
+        const std::string src,
+        const std::string dst) const
+{
+    const json tx {
+        { "from_path", "/" + sanitize(src) },
+        { "to_path", "/" + sanitize(dst) }
+    };
+    const std::string f(tx.dump());
+    const std::vector<char> postData(f.begin(), f.end());
+
+    const auto post([&]()
+    {
+        return Http::internalPost(op.url, postData, httpPostHeaders());
+    });
+    const auto fail([&](const std::string& message)
+    {
+        return ArbiterError(
+                "Couldn't Dropbox " + std::string(op.verb) + " " + src +
+                " to " + dst + ": " + message);
+    });
+
+    const Response res(post());
+    if (res.ok()) return;
+
+    // Neither copies nor moves overwrite, so an existing destination is
+    // removed first.
+    const std::string message(res.str());
+    if (res.code() == 409 && message.find("to/conflict") != std::string::npos)
+    {
+        remove(dst);
+        const Response retry(post());
+        if (retry.ok()) return;
+        throw fail(retry.str());
+    }
+
+    throw fail(message);
+}
+
+std::vector<std::exception_ptr> Dropbox::relocateMany(
+        const Op& op,
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        const std::size_t threads) const
+{
+    std::vector<std::exception_ptr> errors(pairs.size());
+
+    for (std::size_t begin(0); begin < pairs.size(); begin += maxBatchSize)
+    {
+        const std::size_t end((std::min)(begin + maxBatchSize, pairs.size()));
+        try
+        {
+            relocateBatch(op, pairs, begin, end, errors);
+        }
+        catch (...)
+        {
+            for (std::size_t i(begin); i < end; ++i)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    }
+
+    // Those which a batch failed to copy or move, most often because their
+    // destinations exist, are retried alone.
+    std::vector<std::size_t> failed;
+    for (std::size_t i(0); i < pairs.size(); ++i)
+    {
+        if (errors[i]) failed.push_back(i);
+    }
+
+    parallelFor(failed.size(), threads, [&](const std::size_t j)
+    {
+        const std::size_t i(failed[j]);
+        try
+        {
+            relocate(op, pairs[i].first, pairs[i].second);
+            errors[i] = nullptr;
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    }, m_pool.executor());
+
+    return errors;
+}
+
+void Dropbox::relocateBatch(
+        const Op& op,
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        const std::size_t begin,
+        const std::size_t end,
+        std::vector<std::exception_ptr>& errors) const
+{
+    json entries(json::array());
+    for (std::size_t i(begin); i < end; ++i)
+    {
+        entries.push_back({
+            { "from_path", "/" + sanitize(pairs[i].first) },
+            { "to_path", "/" + sanitize(pairs[i].second) }
+        });
+    }
+
+    json rx(json::parse(
+                rpc(op.batchUrl, json{ { "entries", entries } }.dump())));
+
+    // Batches run as a job, which is polled until it is done.
+    const std::string job(rx.value("async_job_id", std::string()));
+    std::chrono::milliseconds delay(batchPollDelay);
+    while (job.size() &&
+            (rx.value(".tag", "") == "async_job_id" ||
+             rx.value(".tag", "") == "in_progress"))
+    {
+        std::this_thread::sleep_for(delay);
+        delay = (std::min)(delay * 2, batchPollLimit);
+
+        rx = json::parse(
+                rpc(op.checkUrl, json{ { "async_job_id", job } }.dump()));
+    }
+
+    if (rx.value(".tag", "") != "complete")
+    {
+        throw ArbiterError(
+                "Dropbox batch " + std::string(op.verb) + " failed: " +
+                rx.dump());
+    }
+
+    const json& results(rx.at("entries"));
+    for (std::size_t i(begin); i < end; ++i)
+    {
+        const json& result(results.at(i - begin));
+        if (result.value(".tag", "") != "success")
+        {
+            errors[i] = std::make_exception_ptr(
+                    ArbiterError(
+                        "Couldn't Dropbox " + std::string(op.verb) + " " +
+                        pairs[i].first + " to " + pairs[i].second + ": " +
+                        result.dump()));
+        }
+    }
+}
+
+std::string Dropbox::rpc(const std::string& url, const std::string& body)
+    const
+{
+    const std::vector<char> postData(body.begin(), body.end());
+    const Response res(Http::internalPost(url, postData, httpPostHeaders()));
+    if (!res.ok())
+    {
+        throw ArbiterError(
+                "Server response: " + std::to_string(res.code()) + " - '" +
+                res.str() + "'");
+    }
+    return res.str();
+}
+
 bool Dropbox::get(
-        const std::string rawPath,
+        const std::string& rawPath,
         std::vector<char>& data,
-        const Headers userHeaders,
-        const Query query) const
+        const Headers& userHeaders,
+        const Query& query) const
 {
     const std::string path(sanitize(rawPath));
 
@@ -138,7 +580,7 @@ bool Dropbox::get(
     headers["Dropbox-API-Arg"] = json{{ "path", "/" + path }}.dump();
     headers.insert(userHeaders.begin(), userHeaders.end());
 
-    const Response res(Http::internalGet(getUrl, headers, query));
+    Response res(Http::internalGet(getUrl, headers, query));
 
     if (res.ok())
     {
@@ -146,38 +588,42 @@ bool Dropbox::get(
         {
             if (!res.headers().count("dropbox-api-result"))
             {
-                std::cout << "No dropbox-api-result header found" << std::endl;
+                logging::error("No dropbox-api-result header found");
                 return false;
             }
 
-            json rx;
-            try { rx = json::parse(res.headers().at("dropbox-api-result")); }
-            catch (...) { std::cout << "Failed to parse result" << std::endl; }
+            // The result describes the whole file, of which only its size
+            // is needed.
+            const json rx(
+                    parseFields(
+                        res.headers().at("dropbox-api-result"),
+                        { "size" }));
+            if (rx.is_null()) logging::error("Failed to parse result");
 
             if (!rx.is_null())
             {
                 if (!rx.count("size"))
                 {
-                    std::cout << "No size found in API result" << std::endl;
+                    logging::error("No size found in API result");
                     return false;
                 }
 
                 const std::size_t size(rx.at("size").get<std::size_t>());
-                data = res.data();
+                data = res.releaseData();
 
                 if (size == data.size()) return true;
                 else
                 {
-                    std::cout <<
-                            "Data size check failed - got " <<
-                            size << " of " << data.size() << " bytes." <<
-                            std::endl;
+                    logging::error(
+                            "Data size check failed - got " +
+                            std::to_string(size) + " of " +
+                            std::to_string(data.size()) + " bytes.");
                 }
             }
         }
         else
         {
-            data = res.data();
+            data = res.releaseData();
             return true;
         }
     }
@@ -186,22 +632,44 @@ bool Dropbox::get(
         const auto data(res.data());
         std::string message(data.data(), data.size());
 
-        std::cout <<
-                "Server response: " << res.code() << " - '" << message << "'" <<
-                std::endl;
+        logging::write(
+                res.code() == 404 ? LogLevel::Debug : LogLevel::Error,
+                "Server response: " + std::to_string(res.code()) + " - '" +
+                    message + "'");
     }
 
     return false;
 }
 
+bool Dropbox::get(
+        const std::string& path,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const Headers& headers,
+        const Query& query) const
+{
+    // Our reads are validated against the size reported by the API, so we
+    // can't pass any data along until it has all arrived.
+    std::vector<char> data;
+    if (!get(path, data, headers, query)) return false;
+
+    sink(data.data(), data.size());
+    return true;
+}
+
 void Dropbox::put(
-        const std::string rawPath,
+        const std::string& rawPath,
         const std::vector<char>& data,
-        const Headers userHeaders,
-        const Query query) const
+        const Headers& userHeaders,
+        const Query& query) const
 {
     const std::string path(sanitize(rawPath));
 
+    if (data.size() > m_config.sessionThreshold())
+    {
+        putSession(path, data, userHeaders, query);
+        return;
+    }
+
     Headers headers(httpGetHeaders());
     headers["Dropbox-API-Arg"] = json{{ "path", "/" + path }}.dump();
     headers["Content-Type"] = "application/octet-stream";
@@ -213,121 +681,305 @@ void Dropbox::put(
     if (!res.ok()) throw ArbiterError(res.str());
 }
 
-std::string Dropbox::continueFileInfo(std::string cursor) const
+void Dropbox::putSession(
+        const std::string path,
+        const std::vector<char>& data,
+        const Headers& userHeaders,
+        const Query& query) const
 {
-    Headers headers(httpPostHeaders());
+    // A concurrent session accepts its chunks in any order, but the one which
+    // closes the session must be sent last.
+    const json start{ { "close", false }, { "session_type", "concurrent" } };
+    const std::string id(
+            json::parse(
+                upload(
+                    startUrl,
+                    start.dump(),
+                    nullptr,
+                    0,
+                    userHeaders,
+                    query))
+            .at("session_id").get<std::string>());
+
+    const std::size_t chunkSize(m_config.chunkSize());
+    const std::size_t chunks((data.size() + chunkSize - 1) / chunkSize);
+
+    auto append([&](const std::size_t i, const bool close)
+    {
+        const std::size_t offset(i * chunkSize);
+        const json arg{
+            { "cursor", { { "session_id", id }, { "offset", offset } } },
+            { "close", close }
+        };
 
-    const std::string f(json{{ "cursor", cursor }}.dump());
-    std::vector<char> postData(f.begin(), f.end());
-    Response res(Http::internalPost(continueListUrl, postData, headers));
+        upload(
+                appendUrl,
+                arg.dump(),
+                data.data() + offset,
+                (std::min)(chunkSize, data.size() - offset),
+                userHeaders,
+                query);
+    });
 
-    if (res.ok())
+    parallelFor(chunks - 1, m_pool.size(), [&](const std::size_t i)
     {
-        return std::string(res.data().data(), res.data().size());
-    }
-    else
-    {
-        std::string message(res.data().data(), res.data().size());
-        throw ArbiterError(
-                "Server response: " + std::to_string(res.code()) + " - '" +
-                message + "'");
-    }
+        append(i, false);
+    }, m_pool.executor());
+    append(chunks - 1, true);
 
-    return std::string("");
+    const json finish{
+        { "cursor", { { "session_id", id }, { "offset", data.size() } } },
+        { "commit", { { "path", "/" + path } } }
+    };
+    upload(finishUrl, finish.dump(), nullptr, 0, userHeaders, query);
 }
 
-std::vector<std::string> Dropbox::glob(std::string path, bool verbose) const
+void Dropbox::putMany(
+        const std::vector<std::pair<std::string, std::vector<char>>>& files)
+    const
 {
-    std::vector<std::string> results;
-
-    path.pop_back();
-    const bool recursive(path.back() == '*');
-    if (recursive) path.pop_back();
-    if (path.back() == '/') path.pop_back();
+    // Large files get their own sessions, and the rest are uploaded into
+    // closed sessions to be committed in batches.
+    std::vector<std::size_t> small;
+    for (std::size_t i(0); i < files.size(); ++i)
+    {
+        if (files[i].second.size() <= m_config.sessionThreshold())
+        {
+            small.push_back(i);
+        }
+    }
+    std::vector<json> committed(small.size());
 
-    auto listPath = [this, recursive](std::string path)->std::string
+    parallelFor(files.size(), m_pool.size(), [&](const std::size_t i)
     {
-        Headers headers(httpPostHeaders());
+        const std::string path("/" + sanitize(files[i].first));
+        const std::vector<char>& data(files[i].second);
+
+        if (data.size() > m_config.sessionThreshold())
+        {
+            putSession(sanitize(files[i].first), data);
+            return;
+        }
+
+        const std::size_t slot(
+                std::lower_bound(small.begin(), small.end(), i) -
+                small.begin());
 
-        const json request {
-            { "path", "/" + path },
-            { "recursive", recursive },
-            { "include_media_info", false },
-            { "include_deleted", false }
+        const json start{ { "close", true } };
+        const std::string id(
+                json::parse(
+                    upload(startUrl, start.dump(), data.data(), data.size()))
+                .at("session_id").get<std::string>());
+
+        committed[slot] = json{
+            { "cursor", { { "session_id", id }, { "offset", data.size() } } },
+            { "commit", { { "path", path } } }
         };
-        const std::string f(request.dump());
-        std::vector<char> postData(f.begin(), f.end());
+    }, m_pool.executor());
 
-        // Can't fully qualify this protected method within the lambda due to a
-        // GCC bug: https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61148
-        Response res(internalPost(listUrl, postData, headers));
+    Headers headers(httpPostHeaders());
 
-        if (res.ok())
-        {
-            return std::string(res.data().data(), res.data().size());
-        }
-        else if (res.code() == 409)
-        {
-            return "";
-        }
-        else
+    for (std::size_t begin(0); begin < committed.size(); begin += maxBatchSize)
+    {
+        const auto first(committed.begin() + begin);
+        const auto last(
+                first + (std::min)(maxBatchSize, committed.size() - begin));
+
+        const json tx{ { "entries", std::vector<json>(first, last) } };
+        const std::string f(tx.dump());
+        const std::vector<char> postData(f.begin(), f.end());
+
+        const Response res(
+                Http::internalPost(finishBatchUrl, postData, headers));
+        if (!res.ok())
         {
-            std::string message(res.data().data(), res.data().size());
             throw ArbiterError(
                     "Server response: " + std::to_string(res.code()) + " - '" +
-                    message + "'");
+                    res.str() + "'");
         }
-    };
 
-    bool more(false);
-    std::string cursor("");
+        const json rx(json::parse(res.str()));
+        for (const json& entry : rx.at("entries"))
+        {
+            if (entry.value(".tag", "") != "success")
+            {
+                throw ArbiterError("Batch upload failed: " + entry.dump());
+            }
+        }
+    }
+}
 
-    auto processPath = [this, verbose, &results, &more, &cursor](std::string d)
+std::string Dropbox::upload(
+        const std::string url,
+        const std::string arg,
+        const char* data,
+        const std::size_t size,
+        const Headers& userHeaders,
+        const Query& query) const
+{
+    Headers headers(httpGetHeaders());
+    headers["Dropbox-API-Arg"] = arg;
+    headers["Content-Type"] = "application/octet-stream";
+
+    headers.insert(userHeaders.begin(), userHeaders.end());
+
+    // Chunks are sent from the caller's buffer rather than copied.
+    const Response res(Http::internalPost(url, data, size, headers, query));
+
+    if (!res.ok())
     {
-        if (d.empty()) return;
-        if (verbose) std::cout << '.';
+        throw ArbiterError(
+                "Server response: " + std::to_string(res.code()) + " - '" +
+                res.str() + "'");
+    }
 
-        const json j(json::parse(d));
-        if (!j.count("entries"))
-        {
-            throw ArbiterError("Returned JSON from Dropbox was null");
-        }
-        const json& entries(j.at("entries"));
-        if (!entries.is_array())
+    return res.str();
+}
+
+std::vector<std::unique_ptr<std::size_t>> Dropbox::tryGetSizes(
+        const std::vector<std::string>& paths) const
+{
+    std::vector<std::unique_ptr<std::size_t>> sizes(paths.size());
+
+    // Dropbox paths are case-insensitive, so group them by lowercased
+    // folder, which is how listings report them.
+    std::map<std::string, std::vector<std::size_t>> folders;
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        const std::string lower(dropboxLower(paths[i]));
+        const std::size_t slash(lower.rfind('/'));
+        folders[slash == std::string::npos ? "" : lower.substr(0, slash)]
+            .push_back(i);
+    }
+
+    std::vector<const std::string*> listed;
+    std::vector<std::size_t> single;
+    for (const auto& p : folders)
+    {
+        if (p.second.size() >= listThreshold) listed.push_back(&p.first);
+        else single.insert(single.end(), p.second.begin(), p.second.end());
+    }
+
+    const std::size_t total(listed.size() + single.size());
+    parallelFor(total, m_pool.size(), [&](const std::size_t i)
+    {
+        if (i >= listed.size())
         {
-            throw ArbiterError("Returned JSON from Dropbox was not an array");
+            const std::size_t index(single[i - listed.size()]);
+            sizes[index] = tryGetSize(paths[index]);
+            return;
         }
 
-        more = j.value("has_more", false);
-        cursor = j.value("cursor", "");
-
-        for (std::size_t i(0); i < entries.size(); ++i)
+        const std::string& folder(*listed[i]);
+        std::map<std::string, std::size_t> found;
+        list(folder, false, [&](const std::string& p, std::size_t size)
         {
-            const json& v(entries[i]);
-            const std::string tag(v.value(".tag", ""));
+            found[p] = size;
+        });
 
-            // Only insert files.
-            if (std::equal(tag.begin(), tag.end(), fileTag.begin(), ins))
+        for (const std::size_t index : folders.at(folder))
+        {
+            const auto it(found.find("/" + dropboxLower(paths[index])));
+            if (it != found.end())
             {
-                // Results already begin with a slash.
-                results.push_back(
-                        type() + ":/" + v.at("path_lower").get<std::string>());
+                sizes[index] = makeUnique<std::size_t>(it->second);
             }
         }
-    };
+    }, m_pool.executor());
 
-    processPath(listPath(path));
+    return sizes;
+}
 
-    if (more)
+std::vector<std::string> Dropbox::glob(std::string path, bool verbose) const
+{
+    std::vector<std::string> results;
+    glob(path, [&results](std::string p)
     {
-        do
+        results.push_back(std::move(p));
+    }, verbose);
+    return results;
+}
+
+void Dropbox::glob(
+        std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void Dropbox::globInfo(
+        std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    path.pop_back();
+    const bool recursive(path.size() && path.back() == '*');
+    if (recursive) path.pop_back();
+    if (path.size() && path.back() == '/') path.pop_back();
+
+    list(path, recursive, [this, &f](const std::string& p, std::size_t size)
+    {
+        // Results already begin with a slash.
+        FileInfo info(type() + ":/" + p);
+        info.hasSize = true;
+        info.size = size;
+        f(std::move(info));
+    }, verbose);
+}
+
+void Dropbox::list(
+        const std::string path,
+        const bool recursive,
+        const std::function<void(const std::string&, std::size_t)>& f,
+        const bool verbose) const
+{
+    // A recursive listing covers the whole tree below the path, so paging
+    // through it takes one round trip per page rather than per folder.  The
+    // root of the Dropbox is specified as an empty path.
+    json request {
+        { "path", path.size() ? "/" + path : "" },
+        { "recursive", recursive },
+        { "include_media_info", false },
+        { "include_deleted", false },
+        { "limit", listLimit }
+    };
+    std::string url(listUrl);
+    const Headers headers(httpPostHeaders());
+
+    while (true)
+    {
+        if (verbose) logging::debug("\tListing " + path);
+
+        const std::string tx(request.dump());
+        const std::vector<char> postData(tx.begin(), tx.end());
+        const Response res(Http::internalPost(url, postData, headers));
+
+        // A missing path has no matches.
+        if (res.code() == 409 && url == listUrl) return;
+        if (!res.ok())
+        {
+            throw ArbiterError(
+                    "Server response: " + std::to_string(res.code()) + " - '" +
+                    res.str() + "'");
+        }
+
+        DropboxListingSax sax(f);
+        const std::vector<char>& data(res.data());
+        if (!json::sax_parse(data.begin(), data.end(), &sax))
         {
-            processPath(continueFileInfo(cursor));
+            throw ArbiterError("Invalid JSON returned from Dropbox");
+        }
+        if (!sax.hasEntries())
+        {
+            throw ArbiterError("Returned JSON from Dropbox had no entries");
         }
-        while (more);
-    }
 
-    return results;
+        if (!sax.hasMore()) return;
+
+        request = json{ { "cursor", sax.cursor() } };
+        url = continueListUrl;
+    }
 }
 
 } // namespace drivers
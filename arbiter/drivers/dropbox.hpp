@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #ifndef ARBITER_IS_AMALGAMATION
@@ -24,20 +26,64 @@ class Dropbox : public Http
 {
 public:
     class Auth;
-    Dropbox(http::Pool& pool, const Auth& auth);
+    class Config;
+
+    Dropbox(
+            http::Pool& pool,
+            const Auth& auth,
+            const Config& config = Config());
 
     /** Try to construct a %Dropbox Driver.  @p j may be stringified JSON, in
      * which the key `token` will be used to construct the Dropbox auth, or
-     * may simply be the token string itself.
+     * may simply be the token string itself.  In the JSON form, upload
+     * settings may be given alongside the token.  See Dropbox::Config.
      */
     static std::unique_ptr<Dropbox> create(http::Pool& pool, std::string j);
 
     virtual std::string type() const override { return "dropbox"; }
+
+    /** All but multipart uploads, since upload sessions are sequential. */
+    virtual Capabilities capabilities() const override;
+
     virtual void put(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers,
-            http::Query query = http::Query()) const override;
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const override;
+
+    /** Upload several files, given as path and data pairs.  Each is sent in
+     * its own upload session, in parallel, and they are then committed
+     * together with one request per thousand files, which is far quicker
+     * than putting many small files one at a time.  Throws ArbiterError if
+     * any file could not be written.
+     */
+    void putMany(
+            const std::vector<std::pair<std::string, std::vector<char>>>&
+                files) const;
+
+    /** Copies within %Dropbox with `copy_v2`, so that no data passes
+     * through us.  An existing file at @p dst is replaced.
+     */
+    virtual void copy(std::string src, std::string dst) const override;
+
+    /** Copies with `copy_batch_v2` requests of up to a thousand pairs each,
+     * polling the asynchronous job of each until it is done.  Any pair which
+     * a batch fails to copy, as when its destination exists, is retried
+     * alone by copy, up to @p threads at a time.
+     */
+    virtual std::vector<std::exception_ptr> copyMany(
+            const std::vector<std::pair<std::string, std::string>>& pairs,
+            std::size_t threads) const override;
+
+    /** As copy, with `move_v2`. */
+    virtual void move(std::string src, std::string dst) const override;
+
+    /** As copyMany, with `move_batch_v2`. */
+    virtual std::vector<std::exception_ptr> moveMany(
+            const std::vector<std::pair<std::string, std::string>>& pairs,
+            std::size_t threads) const override;
+
+    virtual void remove(std::string path) const override;
 
     /** @brief %Dropbox authentication information. */
     class Auth
@@ -50,26 +96,127 @@ public:
         std::string m_token;
     };
 
+    /** @brief %Dropbox upload settings. */
+    class Config
+    {
+    public:
+        Config() { }
+        explicit Config(std::string s);
+
+        /** Uploads larger than this many bytes, which may not exceed the
+         * single-request limit of 150 MB, go through an upload session and
+         * are sent in chunks of chunkSize() bytes, which is a multiple of 4
+         * MiB, several at a time.
+         */
+        std::size_t sessionThreshold() const { return m_sessionThreshold; }
+        std::size_t chunkSize() const { return m_chunkSize; }
+
+    private:
+        std::size_t m_sessionThreshold = 32 * 1024 * 1024;
+        std::size_t m_chunkSize = 8 * 1024 * 1024;
+    };
+
 private:
     virtual bool get(
-            std::string path,
+            const std::string& path,
             std::vector<char>& data,
-            http::Headers headers,
-            http::Query query) const override;
+            const http::Headers& headers,
+            const http::Query& query) const override;
+
+    virtual bool get(
+            const std::string& path,
+            const std::function<void(const char*, std::size_t)>& sink,
+            const http::Headers& headers,
+            const http::Query& query) const override;
 
     virtual std::unique_ptr<std::size_t> tryGetSize(
             std::string path) const override;
 
+    /** The revision of the file. */
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    // The metadata of the file at @p path.
+    http::Response getMetadata(std::string path) const;
+
+    /** Folders holding many of the paths are answered by listing them,
+     * rather than querying the metadata of each path.
+     */
+    virtual std::vector<std::unique_ptr<std::size_t>> tryGetSizes(
+            const std::vector<std::string>& paths) const override;
+
     virtual std::vector<std::string> glob(
             std::string path,
             bool verbose) const override;
 
-    std::string continueFileInfo(std::string cursor) const;
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    /** Listings include the size of each file. */
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    // List the files within the folder @p path, or its whole tree if
+    // @p recursive, passing the lowercased path and size of each to @p f.
+    void list(
+            std::string path,
+            bool recursive,
+            const std::function<void(const std::string&, std::size_t)>& f,
+            bool verbose = false) const;
+
+    // Upload @p data in chunks through an upload session, each of whose
+    // requests carries @p headers and @p query.
+    void putSession(
+            std::string path,
+            const std::vector<char>& data,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
+    // The copies and moves of files are made alike, through the endpoints
+    // of an Op.
+    struct Op;
+
+    // Copy or move @p src to @p dst, replacing any existing file.
+    void relocate(const Op& op, std::string src, std::string dst) const;
+
+    std::vector<std::exception_ptr> relocateMany(
+            const Op& op,
+            const std::vector<std::pair<std::string, std::string>>& pairs,
+            std::size_t threads) const;
+
+    // Copy or move the pairs of @p pairs in [@p begin, @p end) with a
+    // single batch, setting the errors of those which fail in @p errors.
+    void relocateBatch(
+            const Op& op,
+            const std::vector<std::pair<std::string, std::string>>& pairs,
+            std::size_t begin,
+            std::size_t end,
+            std::vector<std::exception_ptr>& errors) const;
+
+    // POST the stringified JSON @p body to the API endpoint @p url,
+    // returning the response body, or throwing ArbiterError on failure.
+    std::string rpc(const std::string& url, const std::string& body) const;
+
+    // POST the @p size bytes at @p data to the content endpoint @p url with
+    // the stringified JSON argument @p arg, and any further @p headers and
+    // @p query, returning the response body.
+    std::string upload(
+            std::string url,
+            std::string arg,
+            const char* data,
+            std::size_t size,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
 
     http::Headers httpGetHeaders() const;
     http::Headers httpPostHeaders() const;
 
     Auth m_auth;
+    Config m_config;
 };
 
 } // namespace drivers
@@ -1,27 +1,59 @@
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/arbiter.hpp>
 #include <arbiter/drivers/fs.hpp>
+#include <arbiter/util/crc32c.hpp>
+#include <arbiter/util/executor.hpp>
+#include <arbiter/util/iocp.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/uring.hpp>
 #include <arbiter/util/util.hpp>
 #endif
 
 #ifndef ARBITER_WINDOWS
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
 #include <glob.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
-#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef ARBITER_WINDOWS
 #define UNICODE
 #include <Shlwapi.h>
 #include <iterator>
 #include <locale>
 #include <codecvt>
+#include <cwchar>
 #include <windows.h>
 #include <direct.h>
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <ios>
 #include <istream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <thread>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
@@ -33,6 +65,60 @@ namespace arbiter
 
 namespace
 {
+    // Times an operation over its lifetime, reporting it to @p log, if
+    // there is one, should it take long enough.  Without a log, this does
+    // nothing at all.
+    class SlowFsOp
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        SlowFsOp(
+                SlowLog* log,
+                const char* operation,
+                const std::string& path,
+                const std::uint64_t bytes = 0)
+            : m_log(log)
+            , m_operation(operation)
+            , m_path(path)
+            , m_bytes(bytes)
+            , m_start(log ? Clock::now() : Clock::time_point())
+        { }
+
+        ~SlowFsOp()
+        {
+            if (!m_log) return;
+
+            const Clock::duration elapsed(Clock::now() - m_start);
+            if (!m_log->slow(elapsed)) return;
+
+            try
+            {
+                SlowRequest req;
+                req.source = "file";
+                req.operation = m_operation;
+                req.path = m_path;
+                req.bytes = m_bytes;
+                req.elapsed = std::chrono::duration_cast<
+                    SlowRequest::Duration>(elapsed);
+                m_log->report(req);
+            }
+            catch (...) { }
+        }
+
+        void bytes(const std::uint64_t n) { m_bytes = n; }
+
+    private:
+        SlowFsOp(const SlowFsOp&);
+        SlowFsOp& operator=(const SlowFsOp&);
+
+        SlowLog* const m_log;
+        const char* const m_operation;
+        const std::string& m_path;
+        std::uint64_t m_bytes;
+        const Clock::time_point m_start;
+    };
+
     // Binary output, overwriting any existing file with a conflicting name.
     const std::ios_base::openmode binaryTruncMode(
             std::ofstream::binary |
@@ -58,18 +144,604 @@ namespace
             if (homeDrive && homePath) s = *homeDrive + *homePath;
         }
 #endif
-        if (s.empty()) std::cout << "No home directory found" << std::endl;
+        if (s.empty()) logging::warn("No home directory found");
 
         return s;
     }
+
+#ifndef ARBITER_WINDOWS
+    // The metadata of the file at @p path from its @p info, with a version
+    // from its size and modification time.
+    FileInfo statInfo(std::string path, const struct stat& info)
+    {
+#ifdef __APPLE__
+        const auto& modified(info.st_mtimespec);
+#else
+        const auto& modified(info.st_mtim);
+#endif
+
+        FileInfo file(std::move(path));
+        file.hasSize = true;
+        file.size = info.st_size;
+        file.version =
+            std::to_string(info.st_size) + ";" +
+            std::to_string(modified.tv_sec) + "." +
+            std::to_string(modified.tv_nsec);
+        file.modified = modified.tv_sec;
+        return file;
+    }
+#else
+    std::wstring toWide(const std::string& s)
+    {
+        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+        return converter.from_bytes(s);
+    }
+
+    std::string fromWide(const wchar_t* s)
+    {
+        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+        return converter.to_bytes(s);
+    }
+
+    // The metadata of the file at @p path from its directory entry, which
+    // carries its size and modification time, so that a listing needs no
+    // further lookups.
+    FileInfo findInfo(std::string path, const WIN32_FIND_DATAW& data)
+    {
+        // FILETIMEs count 100ns intervals since 1601.
+        const std::uint64_t ticks(
+                (std::uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) |
+                data.ftLastWriteTime.dwLowDateTime);
+
+        FileInfo file(std::move(path));
+        file.hasSize = true;
+        file.size =
+            (std::uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        file.modified = ticks / 10000000 - 11644473600LL;
+        return file;
+    }
+
+    // Pass each entry matching @p pattern, other than `.` and `..`, to
+    // @p f.  Short names, which we never use, are not looked up, and entries
+    // are fetched in large batches, which matters most on network shares.
+    void findEach(
+            const std::string& pattern,
+            const std::function<void(const WIN32_FIND_DATAW&)>& f)
+    {
+        WIN32_FIND_DATAW data;
+        const HANDLE h(::FindFirstFileExW(
+                    toWide(pattern).c_str(),
+                    FindExInfoBasic,
+                    &data,
+                    FindExSearchNameMatch,
+                    nullptr,
+                    FIND_FIRST_EX_LARGE_FETCH));
+        if (h == INVALID_HANDLE_VALUE) return;
+
+        do
+        {
+            const wchar_t* name(data.cFileName);
+            if (std::wcscmp(name, L".") && std::wcscmp(name, L"..")) f(data);
+        }
+        while (::FindNextFileW(h, &data));
+
+        ::FindClose(h);
+    }
+#endif
 }
 
 namespace drivers
 {
 
-std::unique_ptr<Fs> Fs::create()
+namespace
 {
-    return std::unique_ptr<Fs>(new Fs());
+    const std::size_t streamChunkSize(4 * 1024 * 1024);
+
+#ifdef __linux__
+    // Copy @p size bytes between descriptors without passing the data
+    // through user space: by sharing extents on filesystems which support
+    // reflinks, otherwise by copy_file_range, which may be offloaded to the
+    // storage, and failing that by sendfile.  Returns false if the copy
+    // could not be completed this way.
+    bool kernelCopy(const int in, const int out, const std::size_t size)
+    {
+#ifdef FICLONE
+        if (::ioctl(out, FICLONE, in) == 0) return true;
+#endif
+
+        std::size_t copied(0);
+
+#ifdef SYS_copy_file_range
+        while (copied < size)
+        {
+            const long n(::syscall(
+                        SYS_copy_file_range,
+                        in, nullptr, out, nullptr,
+                        size - copied, 0u));
+
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            copied += n;
+        }
+#endif
+
+        // Both the above and this advance the output offset, so this
+        // carries on from wherever copy_file_range stopped.
+        while (copied < size)
+        {
+            off_t offset(copied);
+            const ssize_t n(::sendfile(out, in, &offset, size - copied));
+
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            copied += n;
+        }
+
+        return copied == size;
+    }
+#endif
+
+    // A hidden sibling of @p path, unique across threads and processes, to
+    // be renamed over it once written.
+    std::string siblingTempPath(const std::string& path)
+    {
+        static std::atomic<unsigned long long> counter(0);
+
+#ifndef ARBITER_WINDOWS
+        const std::size_t start(path.find_last_of('/') + 1);
+        const unsigned long pid(::getpid());
+#else
+        const std::size_t start(path.find_last_of("/\\") + 1);
+        const unsigned long pid(::GetCurrentProcessId());
+#endif
+
+        return path.substr(0, start) + "." + path.substr(start) +
+            ".arbiter-" + std::to_string(pid) + "-" +
+            std::to_string(counter++);
+    }
+
+    std::string getDirectory(const std::string& path)
+    {
+        const std::size_t slash(path.find_last_of('/'));
+        if (slash == std::string::npos) return ".";
+        return slash ? path.substr(0, slash) : "/";
+    }
+
+#ifndef ARBITER_WINDOWS
+    bool flushData(const int fd)
+    {
+#ifdef __APPLE__
+        return ::fsync(fd) == 0;
+#else
+        return ::fdatasync(fd) == 0;
+#endif
+    }
+
+    bool writeAll(const int fd, const char* data, std::size_t size)
+    {
+        while (size)
+        {
+            const ssize_t n(::write(fd, data, size));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+
+            data += n;
+            size -= n;
+        }
+
+        return true;
+    }
+
+    // Page cache advice, which is only a hint, so failures are ignored.
+    void adviseSequential(const int fd)
+    {
+#ifdef POSIX_FADV_SEQUENTIAL
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    void dropCached(const int fd)
+    {
+#ifdef POSIX_FADV_DONTNEED
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    }
+
+    // O_DIRECT transfers need buffers, offsets, and lengths aligned to the
+    // logical block size of the device, which this covers in practice.
+    const std::size_t directAlignment(4096);
+
+    struct FreeAligned
+    {
+        void operator()(char* p) const { std::free(p); }
+    };
+
+    using AlignedBuffer = std::unique_ptr<char, FreeAligned>;
+
+    AlignedBuffer alignedBuffer(const std::size_t size)
+    {
+        void* p(nullptr);
+        if (::posix_memalign(&p, directAlignment, size))
+        {
+            throw std::bad_alloc();
+        }
+        return AlignedBuffer(static_cast<char*>(p));
+    }
+
+    // Switch @p fd to or from direct I/O, which bypasses the page cache.
+    // Fails for filesystems, like tmpfs, which don't support it.
+    bool setDirect(const int fd, const bool direct)
+    {
+#ifdef O_DIRECT
+        const int flags(::fcntl(fd, F_GETFL));
+        if (flags == -1) return false;
+        return ::fcntl(
+                fd,
+                F_SETFL,
+                direct ? flags | O_DIRECT : flags & ~O_DIRECT) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // Read @p fd from its start to its end in chunks of @p chunk bytes, each
+    // passed to @p sink.  With @p direct, the descriptor has been switched to
+    // direct I/O, and falls back to buffered reads should it be refused.
+    bool readChunks(
+            const int fd,
+            bool direct,
+            const std::size_t chunk,
+            const std::function<void(const char*, std::size_t)>& sink)
+    {
+        const AlignedBuffer buffer(alignedBuffer(chunk));
+        std::uint64_t offset(0);
+
+        while (true)
+        {
+            const ssize_t n(::pread(fd, buffer.get(), chunk, offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno == EINVAL && direct)
+            {
+                direct = false;
+                if (setDirect(fd, false)) continue;
+            }
+            if (n < 0) return false;
+            if (n == 0) return true;
+
+            sink(buffer.get(), n);
+            offset += n;
+        }
+    }
+
+    // Write all of @p data to @p fd, which has been switched to direct I/O,
+    // through an aligned buffer.  The unaligned tail, or everything should
+    // direct writes be refused, is written through the page cache.
+    bool writeDirect(const int fd, const char* data, std::size_t size)
+    {
+        const std::size_t chunk(4 * 1024 * 1024);
+        const AlignedBuffer buffer(alignedBuffer(chunk));
+
+        while (size >= directAlignment)
+        {
+            const std::size_t n(
+                    std::min(chunk, size - size % directAlignment));
+            std::copy(data, data + n, buffer.get());
+
+            const ssize_t w(::write(fd, buffer.get(), n));
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0 && errno == EINVAL) break;
+            if (w <= 0) return false;
+
+            data += w;
+            size -= w;
+
+            // Partial writes leave us unaligned.
+            if (static_cast<std::size_t>(w) % directAlignment) break;
+        }
+
+        return setDirect(fd, false) && writeAll(fd, data, size);
+    }
+#endif
+
+    class FsWriter : public Writer
+    {
+    public:
+        using Commit = std::function<void(const std::string&)>;
+
+        FsWriter(
+                std::string path,
+                std::string temp,
+                const bool durable,
+                Commit commit)
+            : m_path(path)
+            , m_temp(temp)
+            , m_durable(durable)
+            , m_commit(commit)
+            , m_stream(m_temp, binaryTruncMode)
+        {
+            if (!m_stream.good())
+            {
+                throw ArbiterError("Could not open " + m_path + " for writing");
+            }
+        }
+
+        ~FsWriter()
+        {
+            // Abandoned before completion, so leave any existing file be.
+            if (!m_done && m_temp != m_path) std::remove(m_temp.c_str());
+        }
+
+        virtual void write(const char* data, std::size_t size) override
+        {
+            m_stream.write(data, size);
+            check();
+        }
+
+        virtual void done() override
+        {
+            m_stream.close();
+            check();
+
+#ifndef ARBITER_WINDOWS
+            if (m_durable)
+            {
+                const int fd(::open(m_temp.c_str(), O_RDONLY | O_CLOEXEC));
+                const bool flushed(fd != -1 && flushData(fd));
+                if (fd != -1) ::close(fd);
+                if (!flushed)
+                {
+                    throw ArbiterError("Could not flush " + m_path);
+                }
+            }
+#endif
+
+            m_commit(m_temp);
+            m_done = true;
+        }
+
+    private:
+        void check()
+        {
+            if (!m_stream.good())
+            {
+                throw ArbiterError("Error occurred while writing " + m_path);
+            }
+        }
+
+        const std::string m_path;
+        const std::string m_temp;
+        const bool m_durable;
+        const Commit m_commit;
+        std::ofstream m_stream;
+        bool m_done = false;
+    };
+
+#ifdef __linux__
+    // Watches the directories beneath the literal prefix of a glob with
+    // inotify, adding those created while we watch.
+    class InotifyWatch : public Watch
+    {
+    public:
+        InotifyWatch(const std::string pattern, ChangeCallback f)
+            : m_glob(pattern)
+            , m_f(std::move(f))
+        {
+            const std::string& prefix(m_glob.prefix());
+            const std::string root(prefix.substr(0, prefix.rfind('/') + 1));
+
+            m_fd = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+            if (m_fd == -1 || ::pipe2(m_stop, O_CLOEXEC))
+            {
+                const std::string error(std::strerror(errno));
+                close();
+                throw ArbiterError("Could not watch " + pattern + ": " + error);
+            }
+
+            if (!add(root, false))
+            {
+                const std::string error(std::strerror(errno));
+                close();
+                throw ArbiterError("Could not watch " + pattern + ": " + error);
+            }
+
+            m_thread = std::thread([this]() { run(); });
+        }
+
+        ~InotifyWatch()
+        {
+            const char c(0);
+            if (::write(m_stop[1], &c, 1) != 1)
+            {
+                logging::error("Could not stop watching " + m_glob.pattern());
+            }
+            m_thread.join();
+            close();
+        }
+
+    private:
+        static const std::uint32_t mask =
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |
+            IN_CREATE | IN_ONLYDIR;
+
+        // Watch @p dir, which is empty or ends with a slash, and if we are
+        // recursive, its subdirectories.  If @p report is set, the files
+        // within them are reported as changed, since they may have been
+        // written before their directory was watched.
+        bool add(const std::string& dir, const bool report)
+        {
+            const std::string path(dir.empty() ? "." : dir);
+            const int wd(::inotify_add_watch(m_fd, path.c_str(), mask));
+            if (wd == -1) return false;
+            m_dirs[wd] = dir;
+
+            DIR* d(::opendir(path.c_str()));
+            if (!d) return true;
+
+            while (const dirent* entry = ::readdir(d))
+            {
+                const std::string name(entry->d_name);
+                if (name == "." || name == "..") continue;
+
+                const std::string child(dir + name);
+                struct stat info;
+                if (::stat(child.c_str(), &info) != 0) continue;
+
+                if (S_ISDIR(info.st_mode))
+                {
+                    if (m_glob.recursive() && m_glob.mayContain(child + "/"))
+                    {
+                        add(child + "/", report);
+                    }
+                }
+                else if (report && S_ISREG(info.st_mode))
+                {
+                    changed(child, info);
+                }
+            }
+
+            ::closedir(d);
+            return true;
+        }
+
+        void changed(const std::string& path, const struct stat& info)
+        {
+            if (!m_glob.match(path)) return;
+
+            ChangeEvent event;
+            event.info = statInfo(path, info);
+            m_f(event);
+        }
+
+        void removed(const std::string& path)
+        {
+            if (!m_glob.match(path)) return;
+
+            ChangeEvent event;
+            event.type = ChangeEvent::Type::Removed;
+            event.info = FileInfo(path);
+            m_f(event);
+        }
+
+        void run()
+        {
+            alignas(inotify_event) char buffer[64 * 1024];
+
+            pollfd fds[2] = { { m_fd, POLLIN, 0 }, { m_stop[0], POLLIN, 0 } };
+            while (true)
+            {
+                if (::poll(fds, 2, -1) < 0)
+                {
+                    if (errno == EINTR) continue;
+                    logging::error("Could not watch " + m_glob.pattern());
+                    return;
+                }
+                if (fds[1].revents) return;
+
+                ssize_t n;
+                while ((n = ::read(m_fd, buffer, sizeof(buffer))) > 0)
+                {
+                    for (char* p(buffer); p < buffer + n; )
+                    {
+                        const inotify_event& e(
+                                *reinterpret_cast<inotify_event*>(p));
+                        handle(e);
+                        p += sizeof(inotify_event) + e.len;
+                    }
+                }
+            }
+        }
+
+        void handle(const inotify_event& e)
+        {
+            if (e.mask & IN_Q_OVERFLOW)
+            {
+                logging::warn("Changes were lost to " + m_glob.pattern());
+                return;
+            }
+            if (e.mask & IN_IGNORED)
+            {
+                m_dirs.erase(e.wd);
+                return;
+            }
+
+            const auto it(m_dirs.find(e.wd));
+            if (it == m_dirs.end() || !e.len) return;
+
+            const std::string name(e.name);
+            const std::string path(it->second + name);
+
+            // The temporary files of atomic writes are seen only as they
+            // are renamed into place.
+            if (name.front() == '.' &&
+                    name.find(".arbiter-") != std::string::npos)
+            {
+                return;
+            }
+
+            if (e.mask & IN_ISDIR)
+            {
+                if ((e.mask & (IN_CREATE | IN_MOVED_TO)) &&
+                        m_glob.recursive() &&
+                        m_glob.mayContain(path + "/"))
+                {
+                    add(path + "/", true);
+                }
+            }
+            else if (e.mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+            {
+                struct stat info;
+                if (::stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+                {
+                    changed(path, info);
+                }
+            }
+            else if (e.mask & (IN_DELETE | IN_MOVED_FROM))
+            {
+                removed(path);
+            }
+        }
+
+        void close()
+        {
+            if (m_fd != -1) ::close(m_fd);
+            if (m_stop[0] != -1) ::close(m_stop[0]);
+            if (m_stop[1] != -1) ::close(m_stop[1]);
+        }
+
+        const Glob m_glob;
+        const ChangeCallback m_f;
+
+        int m_fd = -1;
+        int m_stop[2] = { -1, -1 };
+
+        // Watched directories by their watch descriptors, used only by our
+        // thread once it starts.
+        std::map<int, std::string> m_dirs;
+        std::thread m_thread;
+    };
+#endif
+}
+
+Fs::Config::Config(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object()) return;
+
+    m_atomic = c.value("atomic", m_atomic);
+    m_durable = c.value("durable", m_durable);
+    m_preallocate = c.value("preallocate", m_preallocate);
+    m_dropCache = c.value("dropCache", m_dropCache);
+    m_direct = c.value("direct", m_direct);
+    m_slowLog = SlowLog::create(c.value("slowLog", json()).dump());
+}
+
+Fs::Fs() { }
+Fs::Fs(const Config& config) : m_config(config) { }
+Fs::~Fs() { }
+
+std::unique_ptr<Fs> Fs::create(const std::string s)
+{
+    return std::unique_ptr<Fs>(new Fs(Config(s)));
 }
 
 std::unique_ptr<std::size_t> Fs::tryGetSize(std::string path) const
@@ -89,68 +761,601 @@ std::unique_ptr<std::size_t> Fs::tryGetSize(std::string path) const
     return size;
 }
 
-bool Fs::get(std::string path, std::vector<char>& data) const
+std::unique_ptr<std::string> Fs::tryGetVersion(std::string path) const
+{
+#ifndef ARBITER_WINDOWS
+    path = expandTilde(path);
+
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        return std::unique_ptr<std::string>();
+    }
+
+    return makeUnique<std::string>(statInfo(path, info).version);
+#else
+    return Driver::tryGetVersion(path);
+#endif
+}
+
+bool Fs::get(const std::string path, std::vector<char>& data) const
+{
+    return readWhole(path, data);
+}
+
+bool Fs::getText(const std::string path, std::string& data) const
+{
+    return readWhole(path, data);
+}
+
+template <typename Buffer>
+bool Fs::readWhole(std::string path, Buffer& data) const
+{
+    bool good(false);
+
+    path = expandTilde(path);
+    SlowFsOp op(m_config.slowLog(), "read", path);
+
+#ifndef ARBITER_WINDOWS
+    const int fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1) return false;
+
+    struct stat info;
+    if (::fstat(fd, &info) == 0)
+    {
+        const std::size_t size(info.st_size);
+        data.resize(size);
+
+        if (m_config.dropCache()) adviseSequential(fd);
+
+        if (useDirect(size) && setDirect(fd, true))
+        {
+            std::size_t pos(0);
+            good = readChunks(fd, true, streamChunkSize, [&](
+                        const char* d,
+                        std::size_t n)
+            {
+                if (pos + n > data.size()) data.resize(pos + n);
+                std::copy(d, d + n, &data[0] + pos);
+                pos += n;
+            });
+            data.resize(pos);
+        }
+        else
+        {
+            good = true;
+            std::size_t pos(0);
+            while (good && pos < size)
+            {
+                const ssize_t n(
+                        ::pread(fd, &data[0] + pos, size - pos, pos));
+                if (n < 0 && errno == EINTR) continue;
+                if (n == 0) break;
+                if (n < 0) good = false;
+                else pos += n;
+            }
+            data.resize(pos);
+        }
+
+        if (m_config.dropCache()) dropCached(fd);
+        op.bytes(data.size());
+    }
+
+    ::close(fd);
+#else
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+
+    if (stream.good())
+    {
+        stream.seekg(0, std::ios::end);
+        data.resize(static_cast<std::size_t>(stream.tellg()));
+        op.bytes(data.size());
+        stream.seekg(0, std::ios::beg);
+        stream.read(&data[0], data.size());
+        stream.close();
+        good = true;
+    }
+#endif
+
+    return good;
+}
+
+void Fs::put(std::string path, const std::vector<char>& data) const
+{
+    put(path, data.data(), data.size());
+}
+
+void Fs::put(
+        std::string path,
+        const char* const data,
+        const std::size_t size) const
+{
+    path = expandTilde(path);
+    SlowFsOp op(m_config.slowLog(), "write", path, size);
+    const std::string temp(m_config.atomic() ? siblingTempPath(path) : path);
+
+#ifndef ARBITER_WINDOWS
+    const int fd(::open(
+                temp.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0666));
+
+    if (fd == -1)
+    {
+        throw ArbiterError("Could not open " + path + " for writing");
+    }
+
+#ifdef __linux__
+    // Only a hint, so filesystems which can't reserve space carry on.
+    if (m_config.preallocate() && size)
+    {
+        ::fallocate(fd, 0, 0, size);
+    }
+#endif
+
+    bool good(
+            useDirect(size) && setDirect(fd, true) ?
+                writeDirect(fd, data, size) :
+                writeAll(fd, data, size));
+
+    // Dirty pages can't be dropped, so they are flushed first.
+    if (good && (m_config.durable() || m_config.dropCache()))
+    {
+        good = flushData(fd);
+    }
+    if (good && m_config.dropCache()) dropCached(fd);
+    good = ::close(fd) == 0 && good;
+#else
+    std::ofstream stream(temp, binaryTruncMode);
+
+    if (!stream.good())
+    {
+        throw ArbiterError("Could not open " + path + " for writing");
+    }
+
+    stream.write(data, size);
+    stream.close();
+    const bool good(stream.good());
+#endif
+
+    if (!good)
+    {
+        if (temp != path) std::remove(temp.c_str());
+        throw ArbiterError("Error occurred while writing " + path);
+    }
+
+    commit(temp, path);
+}
+
+void Fs::commit(const std::string& temp, const std::string& path) const
+{
+    if (temp != path)
+    {
+#ifndef ARBITER_WINDOWS
+        const bool moved(::rename(temp.c_str(), path.c_str()) == 0);
+#else
+        const bool moved(::MoveFileExA(
+                    temp.c_str(),
+                    path.c_str(),
+                    MOVEFILE_REPLACE_EXISTING));
+#endif
+
+        if (!moved)
+        {
+            std::remove(temp.c_str());
+            throw ArbiterError("Could not move " + temp + " to " + path);
+        }
+    }
+
+    if (m_config.durable())
+    {
+        std::lock_guard<std::mutex> lock(m_syncMutex);
+        m_unsynced.insert(getDirectory(path));
+    }
+}
+
+void Fs::sync() const
+{
+    std::set<std::string> dirs;
+
+    {
+        std::lock_guard<std::mutex> lock(m_syncMutex);
+        dirs.swap(m_unsynced);
+    }
+
+#ifndef ARBITER_WINDOWS
+    for (const std::string& dir : dirs)
+    {
+        const int fd(::open(dir.c_str(), O_RDONLY | O_CLOEXEC));
+        const bool synced(fd != -1 && ::fsync(fd) == 0);
+        if (fd != -1) ::close(fd);
+
+        if (!synced) throw ArbiterError("Could not sync " + dir);
+    }
+#endif
+}
+
+void Fs::getStream(
+        std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    path = expandTilde(path);
+    SlowFsOp op(m_config.slowLog(), "stream", path);
+
+#ifndef ARBITER_WINDOWS
+    const int fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1) throw ArbiterError("Could not read file " + path);
+
+    struct stat info;
+    const bool direct(
+            ::fstat(fd, &info) == 0 &&
+            useDirect(info.st_size) &&
+            setDirect(fd, true));
+
+    if (m_config.dropCache()) adviseSequential(fd);
+
+    std::uint64_t total(0);
+    bool good(false);
+    try
+    {
+        good = readChunks(fd, direct, streamChunkSize, [&](
+                    const char* d,
+                    std::size_t n)
+        {
+            sink(d, n);
+            total += n;
+        });
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+    op.bytes(total);
+
+    if (m_config.dropCache()) dropCached(fd);
+    ::close(fd);
+
+    if (!good) throw ArbiterError("Error occurred reading " + path);
+#else
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+
+    if (!stream.good()) throw ArbiterError("Could not read file " + path);
+
+    std::vector<char> buffer(streamChunkSize);
+    std::uint64_t total(0);
+
+    while (stream)
+    {
+        stream.read(buffer.data(), buffer.size());
+        if (stream.gcount()) sink(buffer.data(), stream.gcount());
+        total += stream.gcount();
+    }
+    op.bytes(total);
+
+    if (!stream.eof()) throw ArbiterError("Error occurred reading " + path);
+#endif
+}
+
+std::size_t Fs::getInto(
+        std::string path,
+        char* const data,
+        const std::size_t size) const
+{
+    path = expandTilde(path);
+    SlowFsOp op(m_config.slowLog(), "read", path);
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+
+    if (!stream.good()) throw ArbiterError("Could not read file " + path);
+
+    stream.read(data, size);
+    const std::size_t read(stream.gcount());
+    op.bytes(read);
+
+    if (stream.bad()) throw ArbiterError("Error occurred reading " + path);
+    if (read == size && stream.peek() != std::ifstream::traits_type::eof())
+    {
+        throw ArbiterError(
+                "Buffer of " + std::to_string(size) +
+                " bytes is too small for " + path);
+    }
+
+    return read;
+}
+
+std::unique_ptr<Writer> Fs::putStream(const std::string path) const
+{
+    const std::string full(expandTilde(path));
+    const std::string temp(m_config.atomic() ? siblingTempPath(full) : full);
+
+    return std::unique_ptr<Writer>(new FsWriter(
+                full,
+                temp,
+                m_config.durable(),
+                [this, full](const std::string& t) { commit(t, full); }));
+}
+
+Capabilities Fs::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = true;
+    c.serverSideCopy = true;
+    c.delimiters = true;
+    c.listingMetadata = true;
+#ifdef __linux__
+    c.changeNotifications = true;
+#endif
+    return c;
+}
+
+void Fs::copy(std::string src, std::string dst) const
+{
+    src = expandTilde(src);
+    dst = expandTilde(dst);
+
+#ifdef __linux__
+    {
+        const int in(::open(src.c_str(), O_RDONLY));
+        if (in == -1)
+        {
+            throw ArbiterError("Could not open " + src + " for reading");
+        }
+
+        const int out(::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666));
+        if (out == -1)
+        {
+            ::close(in);
+            throw ArbiterError("Could not open " + dst + " for writing");
+        }
+
+        struct stat info;
+        bool copied(
+                ::fstat(in, &info) == 0 &&
+                kernelCopy(in, out, info.st_size));
+
+        if (copied && m_config.dropCache())
+        {
+            copied = flushData(out);
+            dropCached(in);
+            dropCached(out);
+        }
+
+        ::close(in);
+        const bool closed(::close(out) == 0);
+
+        if (copied && closed) return;
+
+        // Otherwise fall back to copying in user space, which starts over
+        // from a truncated destination.
+    }
+#endif
+
+    std::ifstream instream(src, std::ifstream::in | std::ifstream::binary);
+    if (!instream.good())
+    {
+        throw ArbiterError("Could not open " + src + " for reading");
+    }
+    instream >> std::noskipws;
+
+    std::ofstream outstream(dst, binaryTruncMode);
+    if (!outstream.good())
+    {
+        throw ArbiterError("Could not open " + dst + " for writing");
+    }
+
+    outstream << instream.rdbuf();
+}
+
+void Fs::move(std::string src, std::string dst) const
+{
+    src = expandTilde(src);
+    dst = expandTilde(dst);
+
+#ifndef ARBITER_WINDOWS
+    if (::rename(src.c_str(), dst.c_str()) != 0)
+    {
+        if (errno != EXDEV)
+        {
+            throw ArbiterError("Could not move " + src + " to " + dst);
+        }
+
+        // Renames can't cross filesystems.
+        Driver::move(src, dst);
+    }
+#else
+    if (!::MoveFileExA(
+                src.c_str(),
+                dst.c_str(),
+                MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED))
+    {
+        throw ArbiterError("Could not move " + src + " to " + dst);
+    }
+#endif
+
+    if (m_config.durable())
+    {
+        std::lock_guard<std::mutex> lock(m_syncMutex);
+        m_unsynced.insert(getDirectory(src));
+        m_unsynced.insert(getDirectory(dst));
+    }
+}
+
+std::vector<std::exception_ptr> Fs::moveMany(
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        const std::size_t threads) const
+{
+    std::vector<std::exception_ptr> errors(pairs.size());
+    parallelFor(pairs.size(), threads, [&](const std::size_t i)
+    {
+        try { move(pairs[i].first, pairs[i].second); }
+        catch (...) { errors[i] = std::current_exception(); }
+    });
+    return errors;
+}
+
+void Fs::remove(std::string path) const
+{
+    path = expandTilde(path);
+    if (std::remove(path.c_str()) != 0 && errno != ENOENT)
+    {
+        throw ArbiterError("Could not remove " + path);
+    }
+}
+
+std::vector<char> Fs::getRange(
+        std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    path = expandTilde(path);
+    SlowFsOp op(m_config.slowLog(), "range", path);
+    std::vector<char> data;
+
+#ifndef ARBITER_WINDOWS
+    const int fd(::open(path.c_str(), O_RDONLY));
+    if (fd == -1) throw ArbiterError("Could not read file " + path);
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        throw ArbiterError("Could not stat " + path);
+    }
+
+    const std::size_t size(info.st_size);
+    if (offset >= size)
+    {
+        ::close(fd);
+        return data;
+    }
+    data.resize((std::min)(length, size - offset));
+    op.bytes(data.size());
+
+    // A positioned read may return less than requested, so continue until
+    // the range is filled or the file ends.
+    std::size_t read(0);
+    while (read < data.size())
+    {
+        const ssize_t n(::pread(
+                    fd,
+                    data.data() + read,
+                    data.size() - read,
+                    offset + read));
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0)
+        {
+            ::close(fd);
+            throw ArbiterError("Error occurred reading " + path);
+        }
+        if (n == 0) break;
+        read += n;
+    }
+
+    ::close(fd);
+#else
+    const auto size(tryGetSize(path));
+    if (!size) throw ArbiterError("Could not read file " + path);
+
+    if (offset >= *size) return data;
+    data.resize((std::min)(length, *size - offset));
+    op.bytes(data.size());
+
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    if (!stream.good()) throw ArbiterError("Could not read file " + path);
+
+    stream.seekg(offset, std::ios::beg);
+    stream.read(data.data(), data.size());
+    const std::size_t read(stream.gcount());
+
+    if (stream.bad()) throw ArbiterError("Error occurred reading " + path);
+#endif
+
+    data.resize(read);
+    return data;
+}
+
+std::unique_ptr<MappedFile> Fs::map(const std::string path) const
+{
+    return std::unique_ptr<MappedFile>(new MappedFile(path));
+}
+
+Uring* Fs::uring() const
+{
+    std::call_once(m_uringFlag, [this]() { m_uring = Uring::create(); });
+    return m_uring.get();
+}
+
+Iocp* Fs::iocp() const
 {
-    bool good(false);
-
-    path = expandTilde(path);
-    std::ifstream stream(path, std::ios::in | std::ios::binary);
-
-    if (stream.good())
-    {
-        stream.seekg(0, std::ios::end);
-        data.resize(static_cast<std::size_t>(stream.tellg()));
-        stream.seekg(0, std::ios::beg);
-        stream.read(data.data(), data.size());
-        stream.close();
-        good = true;
-    }
+    std::call_once(m_iocpFlag, [this]() { m_iocp = Iocp::create(); });
+    return m_iocp.get();
+}
 
-    return good;
+bool Fs::isAsync() const
+{
+    // The ring writes in place, so leave other write modes to the executor.
+    if (m_config.atomic() || m_config.durable()) return false;
+    return uring() != nullptr || iocp() != nullptr;
 }
 
-void Fs::put(std::string path, const std::vector<char>& data) const
+std::future<std::vector<char>> Fs::getBinaryAsync(const std::string path) const
 {
-    path = expandTilde(path);
-    std::ofstream stream(path, binaryTruncMode);
+    if (Uring* ring = uring()) return ring->read(expandTilde(path));
+    if (Iocp* port = iocp()) return port->read(expandTilde(path));
+    return Driver::getBinaryAsync(path);
+}
 
-    if (!stream.good())
+std::future<void> Fs::putAsync(
+        const std::string path,
+        std::vector<char> data) const
+{
+    if (Uring* ring = uring())
     {
-        throw ArbiterError("Could not open " + path + " for writing");
+        return ring->write(expandTilde(path), std::move(data));
     }
-
-    stream.write(data.data(), data.size());
-
-    if (!stream.good())
+    if (Iocp* port = iocp())
     {
-        throw ArbiterError("Error occurred while writing " + path);
+        return port->write(expandTilde(path), std::move(data));
     }
+    return Driver::putAsync(path, data);
 }
 
-void Fs::copy(std::string src, std::string dst) const
+std::vector<std::string> Fs::glob(std::string path, bool) const
 {
-    src = expandTilde(src);
-    dst = expandTilde(dst);
-
-    std::ifstream instream(src, std::ifstream::in | std::ifstream::binary);
-    if (!instream.good())
-    {
-        throw ArbiterError("Could not open " + src + " for reading");
-    }
-    instream >> std::noskipws;
+    return arbiter::glob(path);
+}
 
-    std::ofstream outstream(dst, binaryTruncMode);
-    if (!outstream.good())
-    {
-        throw ArbiterError("Could not open " + dst + " for writing");
-    }
+void Fs::glob(
+        std::string path,
+        const std::function<void(std::string)>& f,
+        bool) const
+{
+    arbiter::glob(path, f);
+}
 
-    outstream << instream.rdbuf();
+void Fs::globInfo(
+        std::string path,
+        const std::function<void(FileInfo)>& f,
+        bool) const
+{
+    arbiter::globInfo(path, f);
 }
 
-std::vector<std::string> Fs::glob(std::string path, bool verbose) const
+std::unique_ptr<Watch> Fs::watch(
+        std::string path,
+        ChangeCallback f,
+        const std::chrono::milliseconds interval) const
 {
-    return arbiter::glob(path);
+#ifdef __linux__
+    // Changes are notified as they are made, so nothing is polled.
+    (void)interval;
+    path = expandTilde(path);
+    if (path.size() && path.back() == '/') path += "**";
+    return std::unique_ptr<Watch>(new InotifyWatch(path, std::move(f)));
+#else
+    return Driver::watch(path, std::move(f), interval);
+#endif
 }
 
 } // namespace drivers
@@ -174,6 +1379,15 @@ bool mkdirp(std::string raw)
         return s;
     })());
 
+#ifndef ARBITER_WINDOWS
+    // Usually only the last component is missing, if any are, so try that
+    // before walking the whole path.
+    if (!::mkdir(dir.c_str(), S_IRWXU | S_IRGRP | S_IROTH) || errno == EEXIST)
+    {
+        return true;
+    }
+#endif
+
     auto it(dir.begin());
     const auto end(dir.cend());
 
@@ -200,6 +1414,22 @@ bool mkdirp(std::string raw)
 
 }
 
+bool DirectoryCache::mkdirp(const std::string dir)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_dirs.count(dir)) return true;
+    }
+
+    // Concurrent callers may both create the same directory, which is
+    // harmless, rather than serializing on the system calls.
+    if (!arbiter::mkdirp(dir)) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dirs.insert(dir);
+    return true;
+}
+
 bool remove(std::string filename)
 {
     filename = expandTilde(filename);
@@ -211,7 +1441,7 @@ namespace
 {
     struct Globs
     {
-        std::vector<std::string> files;
+        std::vector<FileInfo> files;
         std::vector<std::string> dirs;
     };
 
@@ -227,21 +1457,6 @@ template<typename C>
 		return s;
 	}
 
-#ifdef ARBITER_WINDOWS
-	bool icase_wchar_cmp(wchar_t a, wchar_t b)
-	{
-		return std::toupper(a, std::locale()) == std::toupper(b, std::locale());
-	}
-
-
-	bool icase_cmp(std::wstring const& s1, std::wstring const& s2)
-	{
-		return (s1.size() == s2.size()) &&
-			std::equal(s1.begin(), s1.end(), s2.begin(),
-				icase_wchar_cmp);
-	}
-#endif
-
     Globs globOne(std::string path)
     {
         Globs results;
@@ -258,7 +1473,10 @@ template<typename C>
 
             if (stat(val.c_str(), &info) == 0)
             {
-                if (S_ISREG(info.st_mode)) results.files.push_back(val);
+                if (S_ISREG(info.st_mode))
+                {
+                    results.files.push_back(statInfo(val, info));
+                }
                 else if (S_ISDIR(info.st_mode)) results.dirs.push_back(val);
             }
             else
@@ -269,58 +1487,158 @@ template<typename C>
 
         globfree(&buffer);
 #else
-		std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
-		std::wstring wide(converter.from_bytes(path));
+        // Like glob, match names within a single directory, with a trailing
+        // slash on those of subdirectories.
+        std::replace(path.begin(), path.end(), '\\', '/');
+        const std::size_t slash(path.rfind('/'));
+        const std::string dir(
+                slash == std::string::npos ? "" : path.substr(0, slash + 1));
+
+        findEach(path, [&](const WIN32_FIND_DATAW& data)
+        {
+            const std::string full(dir + fromWide(data.cFileName));
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                results.dirs.push_back(full + '/');
+            }
+            else results.files.push_back(findInfo(full, data));
+        });
+#endif
 
-		WIN32_FIND_DATAW data{};
-		LPCWSTR fname = wide.c_str();
-        HANDLE hFind(INVALID_HANDLE_VALUE);
-		hFind = FindFirstFileW(fname, &data);
+        return results;
+    }
+
+    // Recursive globs are generally bound by filesystem latency rather than
+    // CPU, particularly on network filesystems, so walk with several threads.
+    // Those of the executor of which the caller is a worker are borrowed, so
+    // the walk is as wide as it, and otherwise this many are started.
+    const std::size_t defaultWalkThreads(8);
+
+    std::size_t walkThreads()
+    {
+        const Executor* executor(Executor::current());
+        return executor ? executor->size() : defaultWalkThreads;
+    }
+
+#ifndef ARBITER_WINDOWS
 
-		if (hFind == (HANDLE)-1) return results; // bad filename
+    // Read the directory @p dir, which is empty or ends with a slash, passing
+    // each subdirectory, with a trailing slash, to @p onDir and the name of
+    // each regular file to @p onFile.  As with glob, hidden subdirectories
+    // are skipped.  Entry types come from readdir where the filesystem
+    // reports them, so most entries don't need a stat.
+    void readDir(
+            const std::string& dir,
+            const std::function<void(std::string)>& onDir,
+            const std::function<void(const char*)>& onFile)
+    {
+        DIR* d(::opendir(dir.empty() ? "." : dir.c_str()));
+        if (!d) return;
 
-        if (hFind != INVALID_HANDLE_VALUE )
+        while (const dirent* entry = ::readdir(d))
         {
-            do
-            {
-				if (icase_cmp(std::wstring(data.cFileName), L".") ||
-					icase_cmp(std::wstring(data.cFileName), L".."))
-					continue;
+            const char* name(entry->d_name);
+            unsigned char type(entry->d_type);
 
-				std::vector<wchar_t> buf(MAX_PATH);
-				wide.erase(std::remove(wide.begin(), wide.end(), '*'), wide.end());
+            // Follow symlinks, as stat does.
+            if (type == DT_UNKNOWN || type == DT_LNK)
+            {
+                struct stat info;
+                const std::string path(dir + name);
+                if (::stat(path.c_str(), &info) != 0) continue;
 
-				std::replace(wide.begin(), wide.end(), '\\', '/');
+                if (S_ISDIR(info.st_mode)) type = DT_DIR;
+                else if (S_ISREG(info.st_mode)) type = DT_REG;
+            }
 
-				std::copy(wide.begin(), wide.end(), buf.begin()	);
-                BOOL appended = PathAppendW(buf.data(), data.cFileName);
+            if (type == DT_DIR && name[0] != '.') onDir(dir + name + '/');
+            else if (type == DT_REG) onFile(name);
+        }
 
-				std::wstring output(buf.data(), wcslen( buf.data()));
+        ::closedir(d);
+    }
 
-                // Erase any \'s
-                output.erase(std::remove(output.begin(), output.end(), '\\'), output.end());
+    // Visit @p root and every directory beneath it in parallel, passing any
+    // files in each matching @p post to @p f, with their metadata if
+    // @p withInfo is true.
+    void walkGlob(
+            const std::string& root,
+            const std::string& post,
+            const bool withInfo,
+            const std::function<void(FileInfo)>& f)
+    {
+        // Patterns spanning directories are left to glob, but in the common
+        // case of matching names within each directory, the read which finds
+        // its subdirectories answers the pattern as well.
+        const bool simple(post.find('/') == std::string::npos);
+        std::mutex mutex;
+
+        parallelTraverse({ root }, walkThreads(), [&](
+                const std::string& dir,
+                const std::function<void(std::string)>& push)
+        {
+            std::vector<FileInfo> files;
+            readDir(dir, push, [&](const char* name)
+            {
+                if (!simple || ::fnmatch(post.c_str(), name, FNM_PERIOD))
+                {
+                    return;
+                }
 
-                if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                std::string path(dir + name);
+                struct stat info;
+                if (withInfo && ::stat(path.c_str(), &info) == 0)
                 {
-                    results.dirs.push_back(converter.to_bytes(output));
+                    files.push_back(statInfo(std::move(path), info));
+                }
+                else files.push_back(FileInfo(std::move(path)));
+            });
+
+            if (!simple) files = globOne(dir + post).files;
 
-                    output.append(L"/*");
-                    Globs more = globOne(converter.to_bytes(output));
-                    std::copy(more.dirs.begin(), more.dirs.end(), std::back_inserter(results.dirs));
-                    std::copy(more.files.begin(), more.files.end(), std::back_inserter(results.files));
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& file : files) f(std::move(file));
+        });
+    }
+#else
+    // As above, but each directory is read by a single enumeration, whose
+    // entries answer the pattern and carry the metadata of their files, so
+    // that it is given whether or not @p withInfo.
+    void walkGlob(
+            const std::string& root,
+            const std::string& post,
+            bool,
+            const std::function<void(FileInfo)>& f)
+    {
+        const bool simple(post.find('/') == std::string::npos);
+        const std::wstring pattern(toWide(post));
+        std::mutex mutex;
 
+        parallelTraverse({ root }, walkThreads(), [&](
+                const std::string& dir,
+                const std::function<void(std::string)>& push)
+        {
+            std::vector<FileInfo> files;
+            findEach(dir + '*', [&](const WIN32_FIND_DATAW& data)
+            {
+                const wchar_t* name(data.cFileName);
+                if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                {
+                    if (name[0] != L'.') push(dir + fromWide(name) + '/');
+                }
+                else if (simple && ::PathMatchSpecW(name, pattern.c_str()))
+                {
+                    files.push_back(findInfo(dir + fromWide(name), data));
                 }
+            });
 
-				results.files.push_back(
-					converter.to_bytes(output));
-            }
-            while (FindNextFileW(hFind, &data));
-        }
-		FindClose(hFind);
-#endif
+            if (!simple) files = globOne(dir + post).files;
 
-        return results;
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& file : files) f(std::move(file));
+        });
     }
+#endif
 
     std::vector<std::string> walk(std::string dir)
     {
@@ -335,45 +1653,136 @@ template<typename C>
 
         return paths;
     }
+
+    // Resolve @p path, as glob, passing the metadata of each file to @p f
+    // if @p withInfo is true, which only costs a stat where the directory
+    // listing does not already make one.
+    void globFiles(
+            std::string path,
+            const bool withInfo,
+            const std::function<void(FileInfo)>& f)
+    {
+        path = expandTilde(path);
+
+        if (path.find('*') == std::string::npos)
+        {
+            f(FileInfo(path));
+            return;
+        }
+
+        std::vector<std::string> dirs;
+
+        const std::size_t recPos(path.find("**"));
+        if (recPos != std::string::npos)
+        {
+            // Convert this recursive glob into multiple non-recursive ones.
+            const auto pre(path.substr(0, recPos));     // Cut off before '*'.
+            const auto post(path.substr(recPos + 1));   // Includes second '*'.
+
+#ifndef ARBITER_WINDOWS
+            if (pre.empty() || pre.back() == '/')
+#else
+            if (pre.empty() || isSlash(pre.back()))
+#endif
+            {
+                return walkGlob(pre, post, withInfo, f);
+            }
+
+            for (const auto d : walk(pre)) dirs.push_back(d + post);
+        }
+        else
+        {
+            dirs.push_back(path);
+        }
+
+        for (const auto& p : dirs)
+        {
+            Globs globs(globOne(p));
+            for (auto& file : globs.files) f(std::move(file));
+        }
+    }
 }
 
 std::vector<std::string> glob(std::string path)
 {
     std::vector<std::string> results;
+    glob(path, [&results](std::string p)
+    {
+        results.push_back(std::move(p));
+    });
 
-    path = expandTilde(path);
+    // Recursive globs are walked in parallel, so their results arrive in no
+    // particular order.
+    std::sort(results.begin(), results.end());
+    return results;
+}
 
-    if (path.find('*') == std::string::npos)
-    {
-        results.push_back(path);
-        return results;
-    }
+void glob(std::string path, const std::function<void(std::string)>& f)
+{
+    globFiles(path, false, [&f](FileInfo info) { f(std::move(info.path)); });
+}
+
+void globInfo(std::string path, const std::function<void(FileInfo)>& f)
+{
+    globFiles(path, true, f);
+}
 
-    std::vector<std::string> dirs;
+namespace drivers
+{
 
-    const std::size_t recPos(path.find("**"));
-    if (recPos != std::string::npos)
-    {
-        // Convert this recursive glob into multiple non-recursive ones.
-        const auto pre(path.substr(0, recPos));     // Cut off before the '*'.
-        const auto post(path.substr(recPos + 1));   // Includes the second '*'.
+void Fs::globShard(
+        std::string path,
+        const std::size_t shard,
+        const std::size_t shards,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    path = expandTilde(path);
+    path.pop_back();
+    const bool recursive(path.back() == '*');
+    if (recursive) path.pop_back();
 
-        for (const auto d : walk(pre)) dirs.push_back(d + post);
-    }
-    else
+    // A glob of names within a directory has no levels to split.
+#ifndef ARBITER_WINDOWS
+    if (path.size() && path.back() != '/')
+#else
+    if (path.size() && !isSlash(path.back()))
+#endif
     {
-        dirs.push_back(path);
+        Driver::globShard(
+                path + (recursive ? "**" : "*"),
+                shard,
+                shards,
+                f,
+                verbose);
+        return;
     }
 
-    for (const auto& p : dirs)
+    const std::vector<ShardEntry> entries(
+            shardEntries(path, shards, recursive, [](
+                    const std::string& dir,
+                    const std::function<void(FileInfo)>& file,
+                    const std::function<void(std::string)>& sub)
     {
-        Globs globs(globOne(p));
-        results.insert(results.end(), globs.files.begin(), globs.files.end());
-    }
+        Globs globs(globOne(dir + '*'));
+        for (auto& info : globs.files) file(std::move(info));
+        for (auto& d : globs.dirs) sub(std::move(d));
+    }));
+
+    // Paths are hashed within the directory, so that workers agree on
+    // their shares wherever it is mounted.
+    for (const ShardEntry& entry : entries)
+    {
+        const std::string name(entry.info.path.substr(path.size()));
+        if (crypto::crc32c(name) % shards != shard) continue;
 
-    return results;
+        if (!entry.directory) f(entry.info);
+        else globFiles(entry.info.path + "**", true, f);
+    }
 }
 
+} // namespace drivers
+
 std::string expandTilde(std::string in)
 {
     std::string out(in);
@@ -406,6 +1815,207 @@ std::string getTempPath()
     return tmp;
 }
 
+MappedFile::MappedFile(std::string path)
+{
+    path = expandTilde(path);
+
+#ifndef ARBITER_WINDOWS
+    const int fd(::open(path.c_str(), O_RDONLY));
+    if (fd == -1) throw ArbiterError("Could not open " + path);
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        throw ArbiterError("Could not stat " + path);
+    }
+
+    m_size = info.st_size;
+
+    // Mapping zero bytes is an error, so an empty file gets no mapping.  The
+    // mapping holds its own reference to the file, so we needn't keep it
+    // open.
+    if (m_size)
+    {
+        void* data(::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0));
+        if (data == MAP_FAILED)
+        {
+            ::close(fd);
+            throw ArbiterError("Could not map " + path);
+        }
+        m_data = static_cast<const char*>(data);
+    }
+
+    ::close(fd);
+#else
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+    const std::wstring wide(converter.from_bytes(path));
+
+    HANDLE file(::CreateFileW(
+                wide.c_str(),
+                GENERIC_READ,
+                FILE_SHARE_READ,
+                NULL,
+                OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL,
+                NULL));
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw ArbiterError("Could not open " + path);
+    }
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size))
+    {
+        ::CloseHandle(file);
+        throw ArbiterError("Could not stat " + path);
+    }
+
+    m_size = static_cast<std::size_t>(size.QuadPart);
+
+    if (m_size)
+    {
+        m_mapping = ::CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mapping)
+        {
+            m_data = static_cast<const char*>(
+                    ::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+
+        if (!m_data)
+        {
+            if (m_mapping) ::CloseHandle(m_mapping);
+            ::CloseHandle(file);
+            throw ArbiterError("Could not map " + path);
+        }
+    }
+
+    ::CloseHandle(file);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    if (!m_data) return;
+
+#ifndef ARBITER_WINDOWS
+    ::munmap(const_cast<char*>(m_data), m_size);
+#else
+    ::UnmapViewOfFile(m_data);
+    ::CloseHandle(m_mapping);
+#endif
+}
+
+WritableFile::WritableFile(std::string path, const std::size_t size)
+    : m_path(expandTilde(path))
+{
+#ifndef ARBITER_WINDOWS
+    m_fd = ::open(
+            m_path.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0666);
+    if (m_fd == -1)
+    {
+        throw ArbiterError("Could not open " + m_path + " for writing");
+    }
+
+    if (::ftruncate(m_fd, size) != 0)
+    {
+        ::close(m_fd);
+        throw ArbiterError("Could not size " + m_path);
+    }
+#else
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+    const std::wstring wide(converter.from_bytes(m_path));
+
+    HANDLE file(::CreateFileW(
+                wide.c_str(),
+                GENERIC_WRITE,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                NULL,
+                CREATE_ALWAYS,
+                FILE_ATTRIBUTE_NORMAL,
+                NULL));
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw ArbiterError("Could not open " + m_path + " for writing");
+    }
+
+    LARGE_INTEGER end;
+    end.QuadPart = size;
+    if (!::SetFilePointerEx(file, end, NULL, FILE_BEGIN) ||
+            !::SetEndOfFile(file))
+    {
+        ::CloseHandle(file);
+        throw ArbiterError("Could not size " + m_path);
+    }
+
+    m_handle = file;
+#endif
+}
+
+WritableFile::~WritableFile()
+{
+    try { close(); }
+    catch (...) { }
+}
+
+void WritableFile::write(
+        std::size_t offset,
+        const char* data,
+        std::size_t size) const
+{
+#ifndef ARBITER_WINDOWS
+    while (size)
+    {
+        const ssize_t n(::pwrite(m_fd, data, size, offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw ArbiterError("Could not write to " + m_path);
+
+        data += n;
+        size -= n;
+        offset += n;
+    }
+#else
+    while (size)
+    {
+        // Positioned by the OVERLAPPED offset rather than the shared file
+        // pointer, so that concurrent writes don't interfere.
+        OVERLAPPED position = { };
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(
+                static_cast<std::uint64_t>(offset) >> 32);
+
+        const DWORD request(static_cast<DWORD>(
+                    (std::min)(size, static_cast<std::size_t>(1 << 30))));
+        DWORD n(0);
+        if (!::WriteFile(m_handle, data, request, &n, &position) || !n)
+        {
+            throw ArbiterError("Could not write to " + m_path);
+        }
+
+        data += n;
+        size -= n;
+        offset += n;
+    }
+#endif
+}
+
+void WritableFile::close()
+{
+#ifndef ARBITER_WINDOWS
+    if (m_fd == -1) return;
+    const bool good(::close(m_fd) == 0);
+    m_fd = -1;
+#else
+    if (!m_handle) return;
+    const bool good(::CloseHandle(m_handle) != 0);
+    m_handle = nullptr;
+#endif
+
+    if (!good) throw ArbiterError("Could not close " + m_path);
+}
+
 LocalHandle::LocalHandle(const std::string localPath, const bool isRemote)
     : m_localPath(expandTilde(localPath))
     , m_erase(isRemote)
@@ -413,9 +2023,23 @@ LocalHandle::LocalHandle(const std::string localPath, const bool isRemote)
 
 LocalHandle::~LocalHandle()
 {
+    // Some platforms can't remove a file while it is mapped or open.
+    m_map.reset();
+    m_fill = nullptr;
     if (m_erase) remove(expandTilde(m_localPath));
 }
 
+const MappedFile& LocalHandle::map()
+{
+    if (!m_map) m_map.reset(new MappedFile(m_localPath));
+    return *m_map;
+}
+
+void LocalHandle::fill(const std::size_t offset, const std::size_t length) const
+{
+    if (m_fill) m_fill(offset, length);
+}
+
 } // namespace arbiter
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
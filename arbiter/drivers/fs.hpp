@@ -1,11 +1,22 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/driver.hpp>
 #endif
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/util/exports.hpp>
+#include <arbiter/util/slowlog.hpp>
 #endif
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
@@ -18,6 +29,8 @@ namespace arbiter
 
 class Arbiter;
 class Endpoint;
+class Iocp;
+class Uring;
 
 /**
  * \addtogroup fs
@@ -39,9 +52,118 @@ ARBITER_DLL std::string expandTilde(std::string path);
 /** @brief Get temporary path from environment. */
 ARBITER_DLL std::string getTempPath();
 
-/** @brief Resolve a possible wildcard path. */
+/** @brief Resolve a possible wildcard path, in sorted order. */
 ARBITER_DLL std::vector<std::string> glob(std::string path);
 
+/** @brief Resolve a possible wildcard path, calling @p f with each result as
+ * each directory is read.
+ */
+ARBITER_DLL void glob(
+        std::string path,
+        const std::function<void(std::string)>& f);
+
+/** @brief As glob, but with the size, version, and modification time of
+ * each file which is found.
+ */
+ARBITER_DLL void globInfo(
+        std::string path,
+        const std::function<void(FileInfo)>& f);
+
+/** @brief A read-only memory mapping of a local file.
+ *
+ * The contents are paged in from the OS page cache as they are touched
+ * rather than copied up front, so reading part of a large file costs only
+ * the part that is read.  The data is valid for the lifetime of the
+ * MappedFile, and should not be accessed if the file may be modified.
+ */
+class ARBITER_DLL MappedFile
+{
+public:
+    /** @brief Map @p path, throwing ArbiterError if it cannot be opened. */
+    explicit MappedFile(std::string path);
+    ~MappedFile();
+
+    /** @brief The mapped contents, which are null for an empty file. */
+    const char* data() const { return m_data; }
+
+    /** @brief The size of the mapped contents in bytes. */
+    std::size_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+
+#ifdef ARBITER_WINDOWS
+    void* m_mapping = nullptr;
+#endif
+};
+
+/** @brief A local file of fixed size whose pieces may be written at any
+ * offset, from many threads at once.
+ *
+ * The file is created, or truncated, at the given size on construction, so
+ * pieces may be written in any order without the file being extended as
+ * they arrive.
+ */
+class ARBITER_DLL WritableFile
+{
+public:
+    /** @brief Create @p path at @p size bytes, throwing ArbiterError if it
+     * cannot be created.
+     */
+    WritableFile(std::string path, std::size_t size);
+    ~WritableFile();
+
+    /** @brief Write @p size bytes of @p data at byte @p offset, throwing
+     * ArbiterError on failure.
+     */
+    void write(std::size_t offset, const char* data, std::size_t size) const;
+
+    /** @brief Close the file, throwing ArbiterError if any of its data
+     * could not be written.
+     */
+    void close();
+
+    std::string path() const { return m_path; }
+
+private:
+    WritableFile(const WritableFile&);
+    WritableFile& operator=(const WritableFile&);
+
+    const std::string m_path;
+
+#ifndef ARBITER_WINDOWS
+    int m_fd = -1;
+#else
+    void* m_handle = nullptr;
+#endif
+};
+
+/** @brief Remembers the directories it has created, so that writing many
+ * files into the same few directories creates each of them only once.
+ * Thread-safe.
+ */
+class ARBITER_DLL DirectoryCache
+{
+public:
+    DirectoryCache() { }
+
+    /** @brief As arbiter::mkdirp, but does nothing for a directory which
+     * has already been created through this cache.
+     */
+    bool mkdirp(std::string dir);
+
+private:
+    DirectoryCache(const DirectoryCache&);
+    DirectoryCache& operator=(const DirectoryCache&);
+
+    std::mutex m_mutex;
+    std::set<std::string> m_dirs;
+};
+
 /** @brief A scoped local filehandle for a possibly remote path.
  *
  * This is an RAII style pseudo-filehandle.  It manages the scope of a
@@ -82,11 +204,33 @@ public:
         return localPath();
     }
 
+    /** @brief Map the locally stored file for reading without copying it.
+     *
+     * The mapping is created on the first call and lives as long as this
+     * LocalHandle.  Throws ArbiterError if the file cannot be mapped.
+     */
+    const MappedFile& map();
+
+    /** @brief Download @p length bytes of the remote file starting at byte
+     * @p offset, for a handle of which only some ranges were downloaded.
+     *
+     * Does nothing for a handle of a whole file.  Thread-safe.  Throws
+     * ArbiterError if the range cannot be read.
+     */
+    void fill(std::size_t offset, std::size_t length) const;
+
+    /** @brief True if only some ranges of the file have been downloaded,
+     * in which case the rest reads as zeros.
+     */
+    bool sparse() const { return !!m_fill; }
+
 private:
     LocalHandle(std::string localPath, bool isRemote);
 
     const std::string m_localPath;
     bool m_erase;
+    std::unique_ptr<MappedFile> m_map;
+    std::function<void(std::size_t, std::size_t)> m_fill;
 };
 /** @} */
 
@@ -97,31 +241,243 @@ namespace drivers
 class ARBITER_DLL Fs : public Driver
 {
 public:
-    Fs() { }
+    class Config;
+
+    Fs();
+    explicit Fs(const Config& config);
+    ~Fs();
 
     using Driver::get;
+    using Driver::put;
 
-    static std::unique_ptr<Fs> create();
+    /** Construct a filesystem driver, where @p j may be stringified JSON
+     * with the write settings described by Fs::Config.
+     */
+    static std::unique_ptr<Fs> create(std::string j = "");
 
     virtual std::string type() const override { return "file"; }
 
     virtual std::unique_ptr<std::size_t> tryGetSize(
             std::string path) const override;
 
+    /** The size and modification time of the file. */
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
     virtual void put(
             std::string path,
             const std::vector<char>& data) const override;
 
+    /** Writes from the caller's buffer. */
+    virtual void put(
+            std::string path,
+            const char* data,
+            std::size_t size) const override;
+
     virtual std::vector<std::string> glob(
             std::string path,
             bool verbose) const override;
 
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    /** The entries of the levels of a directory are spread among the
+     * shares by a hash of their paths within it, and only the directories
+     * of a share are walked.
+     */
+    virtual void globShard(
+            std::string path,
+            std::size_t shard,
+            std::size_t shards,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    /** On Linux, watches with inotify, so that changes are delivered as
+     * they are made rather than found by polling, and the directories
+     * created beneath a recursive watch are watched as they appear.  Only
+     * changes made by this host are seen on network filesystems.
+     * Elsewhere, polls as does the default.
+     */
+    virtual std::unique_ptr<Watch> watch(
+            std::string path,
+            ChangeCallback f,
+            std::chrono::milliseconds interval =
+                std::chrono::seconds(60)) const override;
+
     virtual bool isRemote() const override { return false; }
 
+    /** Ranged reads, kernel copies, listings by directory which report
+     * sizes and times, and on Linux, notifications of changes.
+     */
+    virtual Capabilities capabilities() const override;
+
     virtual void copy(std::string src, std::string dst) const override;
 
+    /** Renames @p src to @p dst, replacing any existing file, and falls back
+     * to a copy and removal if they are on different filesystems.
+     */
+    virtual void move(std::string src, std::string dst) const override;
+
+    /** Renames each pair with move. */
+    virtual std::vector<std::exception_ptr> moveMany(
+            const std::vector<std::pair<std::string, std::string>>& pairs,
+            std::size_t threads) const override;
+
+    virtual void remove(std::string path) const override;
+
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    virtual std::size_t getInto(
+            std::string path,
+            char* data,
+            std::size_t size) const override;
+
+    virtual std::unique_ptr<Writer> putStream(
+            std::string path) const override;
+
+    /** Reads with a single positioned read. */
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    /** Map the file at @p path for reading without copying its contents
+     * into memory.  See MappedFile.
+     */
+    std::unique_ptr<MappedFile> map(std::string path) const;
+
+    /** True where the kernel supports io_uring, or on Windows, through
+     * which asynchronous reads and writes are then submitted from a single
+     * ring or completion port, created on first use, rather than each
+     * occupying a thread.  False for atomic or durable writes, which
+     * neither performs.
+     */
+    virtual bool isAsync() const override;
+
+    virtual std::future<std::vector<char>> getBinaryAsync(
+            std::string path) const override;
+
+    virtual std::future<void> putAsync(
+            std::string path,
+            std::vector<char> data) const override;
+
+    /** Flush to stable storage the directories into which files have been
+     * written durably since the last call, each only once regardless of how
+     * many files it received, after which those files will survive a crash.
+     * See Config::durable.
+     */
+    void sync() const;
+
+    /** The log of slow operations, if configured.  See Config::slowLog. */
+    SlowLog* slowLog() const { return m_config.slowLog(); }
+
+    /** @brief Filesystem settings, given by the `atomic`, `durable`,
+     * `preallocate`, `dropCache`, `direct`, and `slowLog` keys under `file`
+     * in the Arbiter configuration.
+     */
+    class Config
+    {
+    public:
+        Config() { }
+        explicit Config(std::string s);
+
+        /** If true, files are written to a hidden temporary file in the
+         * destination directory and renamed into place once complete, so
+         * that readers never observe a partially written file.
+         */
+        bool atomic() const { return m_atomic; }
+
+        /** If true, file data is flushed to stable storage before a write
+         * completes.  The directory entries of newly written files are
+         * flushed in batches by Fs::sync.  No effect on Windows.
+         */
+        bool durable() const { return m_durable; }
+
+        /** If true, space is reserved up front for writes whose size is
+         * known, which reduces fragmentation.  Linux only.
+         */
+        bool preallocate() const { return m_preallocate; }
+
+        /** If true, whole-file and streamed reads are advised to the kernel
+         * as sequential, and the pages of whole-file and streamed reads,
+         * writes from a buffer, and copies are dropped from the page cache
+         * once done, so that bulk transfers don't evict the working set of
+         * other processes.  Written data is flushed first, since dirty pages
+         * can't be dropped.  No effect on Windows.
+         */
+        bool dropCache() const { return m_dropCache; }
+
+        /** The size in bytes from which whole-file and streamed reads, and
+         * writes from a buffer, bypass the page cache entirely with O_DIRECT
+         * through aligned buffers, or zero, the default, to never do so.
+         * Filesystems which refuse direct I/O fall back to buffered I/O.
+         * Linux only.
+         */
+        std::uint64_t direct() const { return m_direct; }
+
+        /** The log of slow reads and writes, as described by
+         * SlowLog::create, or null if there is none.  Whole-file, ranged,
+         * and streamed reads and writes from a buffer are timed.
+         */
+        SlowLog* slowLog() const { return m_slowLog.get(); }
+
+    private:
+        bool m_atomic = false;
+        bool m_durable = false;
+        bool m_preallocate = false;
+        bool m_dropCache = false;
+        std::uint64_t m_direct = 0;
+
+        // Shared by the copies of this configuration.
+        std::shared_ptr<SlowLog> m_slowLog;
+    };
+
 protected:
     virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    /** Reads directly into the string. */
+    virtual bool getText(std::string path, std::string& data) const override;
+
+private:
+    // Read the whole file at @p path into @p data, a vector or string.
+    template <typename Buffer>
+    bool readWhole(std::string path, Buffer& data) const;
+
+    // Null if io_uring is unavailable.
+    Uring* uring() const;
+
+    // Null if not on Windows.
+    Iocp* iocp() const;
+
+    // True if a transfer of @p size bytes should use direct I/O.
+    bool useDirect(std::uint64_t size) const
+    {
+        return m_config.direct() && size >= m_config.direct();
+    }
+
+    // Move the completed file at @p temp, if it differs, to @p path.
+    void commit(const std::string& temp, const std::string& path) const;
+
+    const Config m_config;
+
+    mutable std::mutex m_syncMutex;
+    mutable std::set<std::string> m_unsynced;
+
+    mutable std::once_flag m_uringFlag;
+    mutable std::unique_ptr<Uring> m_uring;
+
+    mutable std::once_flag m_iocpFlag;
+    mutable std::unique_ptr<Iocp> m_iocp;
 };
 
 } // namespace drivers
@@ -2,6 +2,13 @@
 #include <arbiter/drivers/google.hpp>
 #endif
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #ifdef ARBITER_OPENSSL
@@ -21,7 +28,10 @@
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/arbiter.hpp>
 #include <arbiter/drivers/fs.hpp>
+#include <arbiter/util/crc32c.hpp>
+#include <arbiter/util/executor.hpp>
 #include <arbiter/util/json.hpp>
+#include <arbiter/util/probes.hpp>
 #include <arbiter/util/transforms.hpp>
 #endif
 
@@ -37,198 +47,1571 @@ namespace
 {
     std::mutex sslMutex;
 
-    const char baseGoogleUrl[] = "www.googleapis.com/storage/v1/";
-    const char uploadUrl[] = "www.googleapis.com/upload/storage/v1/";
+    // Tokens are refreshed in the background once they have less than this
+    // many seconds remaining.
+    constexpr int64_t refreshSeconds(60 * 5);
+
+    // If background refreshes have failed until a token is this close to
+    // expiring, block requests to refresh it instead.
+    constexpr int64_t gsExpirySeconds(60 * 2);
+
+    // Delay between failed background refreshes.
+    constexpr int64_t gsRetrySeconds(10);
+
+    const std::vector<char> gsEmpty;
+
+    // https://cloud.google.com/storage/docs/performing-resumable-uploads
+    const std::size_t gsChunkQuantum(256 * 1024);
+    const std::size_t chunkTries(3);
+
+    // https://cloud.google.com/storage/docs/composing-objects
+    const std::size_t maxComponents(32);
+
+    // https://cloud.google.com/storage/docs/batch
+    const std::size_t maxBatchCalls(100);
+
+    // https://cloud.google.com/storage/docs/json_api/v1/objects/rewrite
+    const std::size_t rewriteQuantum(1024 * 1024);
+
+    const char storageScope[] =
+        "https://www.googleapis.com/auth/devstorage.read_write";
+    const char pubsubScope[] = "https://www.googleapis.com/auth/pubsub";
+
+    // https://cloud.google.com/pubsub/docs/reference/rest
+    const char pubsubUrl[] = "pubsub.googleapis.com/v1/";
+
+    std::string gsHeader(const http::Headers& headers, const std::string& key)
+    {
+        const auto it(headers.find(key));
+        return it != headers.end() ? it->second : std::string();
+    }
+
+    // The headers of the lines of @p head.
+    http::Headers gsParseHeaders(const std::string& head)
+    {
+        http::Headers headers;
+
+        std::size_t line(0);
+        while (line < head.size())
+        {
+            std::size_t next(head.find("\r\n", line));
+            if (next == std::string::npos) next = head.size();
+
+            const std::string h(head.substr(line, next - line));
+            const std::size_t colon(h.find(':'));
+            if (colon != std::string::npos)
+            {
+                const std::size_t value(h.find_first_not_of(" \t", colon + 1));
+                headers[h.substr(0, colon)] =
+                    value == std::string::npos ? "" : h.substr(value);
+            }
+            line = next + 2;
+        }
+
+        return headers;
+    }
+
+    // The number of bytes committed to a resumable upload session, from the
+    // Range header of a 308 response, which is absent if none have been.
+    std::size_t committed(const http::Response& res)
+    {
+        const std::string range(gsHeader(res.headers(), "Range"));
+        const std::size_t dash(range.find('-'));
+        if (dash == std::string::npos) return 0;
+        return std::stoull(range.substr(dash + 1)) + 1;
+    }
+
+    // The X-Goog-Hash value carrying the CRC32C of @p data.
+    std::string crc32cHash(const std::vector<char>& data)
+    {
+        crypto::Crc32c crc;
+        crc.update(data);
+        return "crc32c=" + crypto::encodeBase64(crc.finalize());
+    }
+
     const http::Query altMediaQuery{ { "alt", "media" } };
 
     class GResource
     {
     public:
-        GResource(std::string path)
+        // The @p root of the API, see Config::endpoint, precedes the paths
+        // of our endpoints.
+        GResource(std::string path, std::string root)
+            : m_root(std::move(root))
+        {
+            const std::size_t split(path.find("/"));
+            m_bucket = path.substr(0, split) + "/";
+            if (split != std::string::npos) m_object = path.substr(split + 1);
+        }
+
+        const std::string& bucket() const { return m_bucket; }
+        const std::string& object() const { return m_object; }
+        static const char exclusions[];
+        std::string endpoint() const
+        {
+            // https://cloud.google.com/storage/docs/json_api/v1/
+            return
+                m_root + "storage/v1/b/" + bucket() +
+                "o/" + http::sanitize(object(), exclusions);
+        }
+
+        std::string uploadEndpoint() const
+        {
+            return m_root + "upload/storage/v1/b/" + bucket() + "o";
+        }
+
+        std::string listEndpoint() const
+        {
+            return m_root + "storage/v1/b/" + bucket() + "o";
+        }
+
+        // The path of the object within a batch request, which is relative
+        // to the host.
+        std::string batchPath() const
+        {
+            return
+                "/storage/v1/b/" + bucket() + "o/" +
+                http::sanitize(object(), exclusions);
+        }
+
+    private:
+        std::string m_root;
+        std::string m_bucket;
+        std::string m_object;
+
+    };
+    
+    // https://cloud.google.com/storage/docs/json_api/#encoding
+    const char GResource::exclusions[] = "!$&'()*+,;=:@";
+
+    // https://cloud.google.com/storage/docs/json_api/v1/objects/list
+    const http::Query listQuery{
+        { "fields", "items(name,size,updated),prefixes,nextPageToken" },
+        { "maxResults", "1000" }
+    };
+
+    // The pattern for the matchGlob of a listing, which matches at least
+    // the object names of the bucket-relative Glob @p pattern, or empty if
+    // it has syntax which the two read differently.  A whole level of `**`,
+    // which may match no levels at all, is loosened to match within one.
+    std::string matchGlobOf(std::string pattern)
+    {
+        if (pattern.find_first_of("{}\\") != std::string::npos) return "";
+
+        std::size_t pos(0);
+        while ((pos = pattern.find("[^", pos)) != std::string::npos)
+        {
+            pattern[++pos] = '!';
+        }
+        pos = 0;
+        while ((pos = pattern.find("/**/", pos)) != std::string::npos)
+        {
+            pattern.erase(pos + 3, 1);
+        }
+        return pattern;
+    }
+
+    // Pulls the objects, common prefixes, and the next page token out of a
+    // listing page as it is parsed, without building a document for the
+    // whole page.
+    class ListingSax : public nlohmann::json_sax<json>
+    {
+    public:
+        ListingSax(
+                const std::function<void(FileInfo)>& f,
+                const std::function<void(std::string)>& sub)
+            : m_f(f)
+            , m_sub(sub)
+        { }
+
+        const std::string& pageToken() const { return m_pageToken; }
+
+        bool null() override { return true; }
+        bool boolean(bool) override { return true; }
+        bool number_integer(number_integer_t) override { return true; }
+        bool number_unsigned(number_unsigned_t) override { return true; }
+        bool number_float(number_float_t, const string_t&) override
+        {
+            return true;
+        }
+
+        bool string(string_t& val) override
+        {
+            if (m_depth == 1 && m_key == "nextPageToken")
+            {
+                m_pageToken = std::move(val);
+            }
+            else if (m_prefixes && m_depth == 2)
+            {
+                if (m_sub) m_sub(std::move(val));
+            }
+            else if (m_items && m_depth == 3)
+            {
+                // Sizes are 64-bit integers, which the JSON API sends as
+                // strings.
+                if (m_key == "name") m_item.path = std::move(val);
+                else if (m_key == "size")
+                {
+                    m_item.hasSize = true;
+                    m_item.size = std::stoull(val);
+                }
+                else if (m_key == "updated")
+                {
+                    m_item.modified =
+                        Time(val, "%Y-%m-%dT%H:%M:%S").asUnix();
+                }
+            }
+            return true;
+        }
+
+        bool key(string_t& val) override
+        {
+            if (m_depth == 1 || m_depth == 3) m_key = std::move(val);
+            return true;
+        }
+
+        bool start_object(std::size_t) override
+        {
+            ++m_depth;
+            return true;
+        }
+
+        bool end_object() override
+        {
+            if (m_items && m_depth == 3)
+            {
+                m_f(std::move(m_item));
+                m_item = FileInfo();
+            }
+            --m_depth;
+            return true;
+        }
+
+        bool start_array(std::size_t) override
+        {
+            if (m_depth == 1 && m_key == "items") m_items = true;
+            if (m_depth == 1 && m_key == "prefixes") m_prefixes = true;
+            ++m_depth;
+            return true;
+        }
+
+        bool end_array() override
+        {
+            if (--m_depth == 1) m_items = m_prefixes = false;
+            return true;
+        }
+
+        bool parse_error(
+                std::size_t,
+                const std::string&,
+                const nlohmann::detail::exception&) override
+        {
+            return false;
+        }
+
+    private:
+        const std::function<void(FileInfo)> m_f;
+        const std::function<void(std::string)> m_sub;
+        FileInfo m_item;
+        std::string m_pageToken;
+        std::string m_key;
+        std::size_t m_depth = 0;
+        bool m_items = false;
+        bool m_prefixes = false;
+    };
+
+} // unnamed namespace
+
+namespace drivers
+{
+
+Google::Google(
+        http::Pool& pool,
+        std::unique_ptr<Auth> auth,
+        std::unique_ptr<Config> config)
+    : Https(pool)
+    , m_auth(std::move(auth))
+    , m_config(std::move(config))
+{ }
+
+std::unique_ptr<Google> Google::create(http::Pool& pool, const std::string s)
+{
+    if (auto auth = Auth::create(s))
+    {
+        return makeUnique<Google>(
+                pool,
+                std::move(auth),
+                makeUnique<Config>(s));
+    }
+
+    return std::unique_ptr<Google>();
+}
+
+Google::Config::Config(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object()) return;
+
+    m_resumableThreshold =
+        c.value("resumableThreshold", m_resumableThreshold);
+    m_compositeThreshold =
+        c.value("compositeThreshold", m_compositeThreshold);
+
+    const std::string checksum(c.value("checksum", std::string()));
+    if (checksum == "crc32c") m_crc32c = true;
+    else if (checksum.size())
+    {
+        throw ArbiterError("Unknown GCS checksum: " + checksum);
+    }
+
+    // Every chunk but the last must be a multiple of the quantum.
+    const std::size_t chunkSize(c.value("chunkSize", m_chunkSize));
+    m_chunkSize =
+        (std::max)(chunkSize / gsChunkQuantum, std::size_t(1)) * gsChunkQuantum;
+
+    const std::size_t rewriteChunkSize(c.value("rewriteChunkSize", 0ULL));
+    m_rewriteChunkSize = rewriteChunkSize ?
+        (std::max)(rewriteChunkSize / rewriteQuantum, std::size_t(1)) *
+            rewriteQuantum :
+        0;
+
+    const json notifications(c.value("notifications", json::object()));
+    m_subscription = notifications.value("subscription", std::string());
+    m_wait = notifications.value("wait", m_wait);
+
+    m_matchGlob = c.value("matchGlob", m_matchGlob);
+
+    m_endpoint = c.value("endpoint", m_endpoint);
+    if (m_endpoint.size() && m_endpoint.back() != '/') m_endpoint += '/';
+}
+
+http::Response Google::head(const std::string path) const
+{
+    http::Headers headers(m_auth->headers());
+    const GResource resource(path, m_config->endpoint());
+
+    drivers::Https https(m_pool);
+    return https.internalHead(resource.endpoint(), headers, altMediaQuery);
+}
+
+std::unique_ptr<std::string> Google::tryGetVersion(const std::string path) const
+{
+    return getVersion(head(path));
+}
+
+std::unique_ptr<std::size_t> Google::tryGetSize(const std::string path) const
+{
+    const auto res(head(path));
+
+    if (res.ok() && res.headers().count("Content-Length"))
+    {
+        const auto& s(res.headers().at("Content-Length"));
+        return makeUnique<std::size_t>(std::stoul(s));
+    }
+
+    return std::unique_ptr<std::size_t>();
+}
+
+std::vector<std::unique_ptr<std::size_t>> Google::tryGetSizes(
+        const std::vector<std::string>& paths) const
+{
+    return tryGetSizesListed(
+            paths,
+            m_pool.size(),
+            m_pool.executor(),
+            [this](const std::vector<std::string>& batch)
+            {
+                return getSizesBatch(batch);
+            },
+            maxBatchCalls);
+}
+
+std::vector<std::unique_ptr<std::size_t>> Google::getSizesBatch(
+        const std::vector<std::string>& paths) const
+{
+    std::vector<std::unique_ptr<std::size_t>> sizes(paths.size());
+    if (paths.size() == 1)
+    {
+        sizes.front() = tryGetSize(paths.front());
+        return sizes;
+    }
+
+    std::vector<std::string> calls;
+    for (const std::string& path : paths)
+    {
+        const GResource resource(path, m_config->endpoint());
+        calls.push_back(
+                "GET " + resource.batchPath() + "?fields=size "
+                "HTTP/1.1\r\n\r\n");
+    }
+
+    std::vector<http::Response> responses;
+    try
+    {
+        responses = batch(calls);
+    }
+    catch (...)
+    {
+        responses.assign(paths.size(), http::Response());
+    }
+
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        const http::Response& res(responses[i]);
+        if (res.code() == 404) continue;
+
+        // The size is a string, since it may exceed the range of a double.
+        if (res.ok())
+        {
+            try
+            {
+                const json j(json::parse(res.str()));
+                sizes[i] = makeUnique<std::size_t>(
+                        std::stoull(j.at("size").get<std::string>()));
+                continue;
+            }
+            catch (...) { }
+        }
+
+        // Calls which failed otherwise, like those which were throttled,
+        // are looked up again on their own.
+        sizes[i] = tryGetSize(paths[i]);
+    }
+
+    return sizes;
+}
+
+bool Google::get(
+        const std::string& path,
+        std::vector<char>& data,
+        const http::Headers& userHeaders,
+        const http::Query& query) const
+{
+    if (m_pool.chunkSize() && !userHeaders.count("Range"))
+    {
+        const auto size(tryGetSize(path));
+        if (size && shouldGetRanged(*size, userHeaders) &&
+                getRanged(path, data, userHeaders, query, *size))
+        {
+            return true;
+        }
+    }
+
+    http::Headers headers(m_auth->headers());
+    headers.insert(userHeaders.begin(), userHeaders.end());
+    http::Query q(altMediaQuery);
+    q.insert(query.begin(), query.end());
+    const GResource resource(path, m_config->endpoint());
+
+    drivers::Https https(m_pool);
+    auto res(https.internalGet(resource.endpoint(), headers, q));
+
+    if (res.ok())
+    {
+        data = res.releaseData();
+        return true;
+    }
+    else
+    {
+        logging::write(
+                res.code() == 404 ? LogLevel::Debug : LogLevel::Error,
+                "Failed get - " + std::to_string(res.code()) + ": " +
+                    res.str());
+        return false;
+    }
+}
+
+bool Google::get(
+        const std::string& path,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const http::Headers& userHeaders,
+        const http::Query& query) const
+{
+    http::Headers headers(m_auth->headers());
+    headers.insert(userHeaders.begin(), userHeaders.end());
+    http::Query q(altMediaQuery);
+    q.insert(query.begin(), query.end());
+    const GResource resource(path, m_config->endpoint());
+
+    drivers::Https https(m_pool);
+    auto res(https.internalGet(resource.endpoint(), sink, headers, q));
+
+    if (!res.ok())
+    {
+        logging::write(
+                res.code() == 404 ? LogLevel::Debug : LogLevel::Error,
+                "Failed get - " + std::to_string(res.code()) + ": " +
+                    res.str());
+    }
+    return res.ok();
+}
+
+void Google::put(
+        const std::string& path,
+        const std::vector<char>& data,
+        const http::Headers& userHeaders,
+        const http::Query& userQuery) const
+{
+    if (m_config->compositeThreshold() &&
+            data.size() > m_config->compositeThreshold())
+    {
+        putComposite(path, data, userHeaders, userQuery);
+    }
+    else if (m_config->resumableThreshold() &&
+            data.size() > m_config->resumableThreshold())
+    {
+        putResumable(path, data, userHeaders, userQuery);
+    }
+    else
+    {
+        putMedia(path, data, userHeaders, userQuery);
+    }
+}
+
+void Google::putMedia(
+        const std::string& path,
+        const std::vector<char>& data,
+        const http::Headers& userHeaders,
+        const http::Query& userQuery) const
+{
+    const GResource resource(path, m_config->endpoint());
+    const std::string url(resource.uploadEndpoint());
+
+    http::Headers headers(m_auth->headers());
+    headers.insert(userHeaders.begin(), userHeaders.end());
+
+    if (m_config->crc32c()) headers["X-Goog-Hash"] = crc32cHash(data);
+
+    http::Query query(userQuery);
+    query["uploadType"] = "media";
+    query["name"] = http::sanitize(resource.object(), GResource::exclusions);
+
+    drivers::Https https(m_pool);
+    const auto res(https.internalPost(url, data, headers, query));
+
+    if (!res.ok())
+    {
+        throw ArbiterError(
+                "Couldn't GCS upload to " + path + ": " +
+                std::to_string(res.code()) + ": " + res.str());
+    }
+}
+
+void Google::putResumable(
+        const std::string& path,
+        const std::vector<char>& data,
+        const http::Headers& userHeaders,
+        const http::Query& userQuery) const
+{
+    const GResource resource(path, m_config->endpoint());
+    const std::string total(std::to_string(data.size()));
+    drivers::Https https(m_pool);
+
+    http::Headers headers(m_auth->headers());
+    headers["X-Upload-Content-Length"] = total;
+    headers.insert(userHeaders.begin(), userHeaders.end());
+
+    http::Query query(userQuery);
+    query["uploadType"] = "resumable";
+    query["name"] = http::sanitize(resource.object(), GResource::exclusions);
+
+    const std::string url(resource.uploadEndpoint());
+    const auto start(https.internalPost(url, gsEmpty, headers, query));
+    const std::string session(gsHeader(start.headers(), "Location"));
+
+    if (!start.ok() || session.empty())
+    {
+        throw ArbiterError(
+                "Couldn't initiate GCS resumable upload to " + path + ": " +
+                std::to_string(start.code()) + ": " + start.str());
+    }
+
+    auto fail([&path](const http::Response& res)
+    {
+        throw ArbiterError(
+                "Couldn't GCS resumable upload to " + path + ": " +
+                std::to_string(res.code()) + ": " + res.str());
+    });
+
+    // Each chunk is acknowledged with a 308 until the final one completes the
+    // upload.  After a failure, we ask the server how much it has committed
+    // and continue from there.
+    std::size_t offset(0);
+    std::size_t failures(0);
+
+    const std::string hash(m_config->crc32c() ? crc32cHash(data) : "");
+
+    while (true)
+    {
+        const std::size_t end(
+                (std::min)(offset + m_config->chunkSize(), data.size()));
+
+        http::Headers chunkHeaders(m_auth->headers());
+        chunkHeaders["Content-Range"] =
+            "bytes " + std::to_string(offset) + "-" +
+            std::to_string(end - 1) + "/" + total;
+
+        // The final chunk commits the object, so carries its checksum.
+        if (end == data.size() && hash.size())
+        {
+            chunkHeaders["X-Goog-Hash"] = hash;
+        }
+
+        const auto res(
+                https.internalPut(
+                    session,
+                    data.data() + offset,
+                    end - offset,
+                    chunkHeaders));
+        if (res.ok()) return;
+        if (res.code() == 308)
+        {
+            // A chunk of which nothing more is committed has failed, though
+            // the session is intact.
+            const std::size_t next(committed(res));
+            if (next > offset) failures = 0;
+            else if (++failures >= chunkTries) fail(res);
+            offset = next;
+            continue;
+        }
+
+        // A 404 or 410 means the session itself is gone.
+        if (res.code() == 404 || res.code() == 410) fail(res);
+        if (++failures >= chunkTries) fail(res);
+
+        http::Headers statusHeaders(m_auth->headers());
+        statusHeaders["Content-Range"] = "bytes */" + total;
+
+        const auto status(https.internalPut(session, gsEmpty, statusHeaders));
+        if (status.ok()) return;
+        if (status.code() == 308) offset = committed(status);
+    }
+}
+
+void Google::putComposite(
+        const std::string& path,
+        const std::vector<char>& data,
+        const http::Headers& userHeaders,
+        const http::Query& userQuery) const
+{
+    const GResource resource(path, m_config->endpoint());
+    drivers::Https https(m_pool);
+
+    const std::size_t chunkSize(m_config->chunkSize());
+    const std::size_t components(
+            (std::max)(
+                std::size_t(2),
+                (std::min)(
+                    maxComponents,
+                    (data.size() + chunkSize - 1) / chunkSize)));
+    const std::size_t componentSize(
+            (data.size() + components - 1) / components);
+
+    // Components are named under a prefix of this upload alone, so that
+    // they collide neither with those of concurrent uploads of the same
+    // object nor with the objects of the bucket.
+    const std::string prefix(
+            resource.object() + ".arbiter-upload-" +
+            std::to_string(randomNumber()) + "/");
+
+    std::vector<std::string> names;
+    for (std::size_t i(0); i < components; ++i)
+    {
+        names.push_back(prefix + std::to_string(i));
+    }
+
+    // Components are temporary, so they are removed whether or not the
+    // upload succeeds.
+    auto cleanup([&]()
+    {
+        parallelFor(components, m_pool.size(), [&](const std::size_t i)
+        {
+            const GResource component(
+                    resource.bucket() + names[i],
+                    m_config->endpoint());
+            const auto res(
+                    https.internalDelete(
+                        component.endpoint(),
+                        m_auth->headers()));
+
+            if (!res.ok() && res.code() != 404)
+            {
+                logging::warn(
+                        "Failed to remove GCS upload component " + names[i] +
+                        ": " + std::to_string(res.code()));
+            }
+        }, m_pool.executor());
+    });
+
+    try
+    {
+        parallelFor(components, m_pool.size(), [&](const std::size_t i)
+        {
+            const std::size_t begin(
+                    (std::min)(i * componentSize, data.size()));
+            const std::size_t end(
+                    (std::min)(begin + componentSize, data.size()));
+            const std::vector<char> part(
+                    data.begin() + begin,
+                    data.begin() + end);
+
+            const std::string componentPath(resource.bucket() + names[i]);
+            if (m_config->resumableThreshold() &&
+                    part.size() > m_config->resumableThreshold())
+            {
+                putResumable(componentPath, part, userHeaders, userQuery);
+            }
+            else
+            {
+                putMedia(componentPath, part, userHeaders, userQuery);
+            }
+        }, m_pool.executor());
+
+        // https://cloud.google.com/storage/docs/json_api/v1/objects/compose
+        json sources(json::array());
+        for (const auto& name : names) sources.push_back({ { "name", name } });
+
+        const auto type(userHeaders.find("Content-Type"));
+        const json request {
+            { "sourceObjects", sources },
+            { "destination", {
+                { "contentType",
+                    type != userHeaders.end() ?
+                        type->second : "application/octet-stream" }
+            } }
+        };
+
+        const std::string body(request.dump());
+        http::Headers headers(m_auth->headers());
+        headers["Content-Type"] = "application/json";
+
+        const auto res(
+                https.internalPost(
+                    resource.endpoint() + "/compose",
+                    std::vector<char>(body.begin(), body.end()),
+                    headers));
+
+        if (!res.ok())
+        {
+            throw ArbiterError(
+                    "Couldn't compose GCS upload to " + path + ": " +
+                    std::to_string(res.code()) + ": " + res.str());
+        }
+    }
+    catch (...)
+    {
+        cleanup();
+        throw;
+    }
+
+    cleanup();
+}
+
+Capabilities Google::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = true;
+    c.serverSideCopy = true;
+    c.delimiters = true;
+    c.listingMetadata = true;
+    c.changeNotifications = !m_config->subscription().empty();
+    return c;
+}
+
+void Google::copy(const std::string src, const std::string dst) const
+{
+    rewrite(src, dst, "");
+}
+
+void Google::rewrite(
+        const std::string& src,
+        const std::string& dst,
+        const std::string& token) const
+{
+    const GResource from(src, m_config->endpoint());
+    const GResource to(dst, m_config->endpoint());
+    const std::string url(
+            from.endpoint() + "/rewriteTo/b/" + to.bucket() + "o/" +
+            http::sanitize(to.object(), GResource::exclusions));
+
+    http::Query query;
+    if (const std::size_t n = m_config->rewriteChunkSize())
+    {
+        query["maxBytesRewrittenPerCall"] = std::to_string(n);
+    }
+    if (token.size()) query["rewriteToken"] = token;
+
+    drivers::Https https(m_pool);
+    const std::string body("{}");
+
+    // Each call rewrites as much as it can in a bounded time, and returns
+    // a token from which the next resumes until the object is done.
+    while (true)
+    {
+        http::Headers headers(m_auth->headers());
+        headers["Content-Type"] = "application/json";
+
+        const auto res(
+                https.internalPost(
+                    url,
+                    std::vector<char>(body.begin(), body.end()),
+                    headers,
+                    query));
+
+        if (!res.ok())
+        {
+            throw ArbiterError(
+                    "Couldn't GCS copy " + src + " to " + dst + ": " +
+                    std::to_string(res.code()) + ": " + res.str());
+        }
+
+        const json j(json::parse(res.str()));
+        if (j.value("done", false)) return;
+
+        const std::string token(j.value("rewriteToken", std::string()));
+        if (token.empty())
+        {
+            throw ArbiterError("Incomplete GCS copy without a token: " + src);
+        }
+        query["rewriteToken"] = token;
+    }
+}
+
+void Google::remove(const std::string path) const
+{
+    const GResource resource(path, m_config->endpoint());
+
+    drivers::Https https(m_pool);
+    const auto res(
+            https.internalDelete(resource.endpoint(), m_auth->headers()));
+
+    if (!res.ok() && res.code() != 404)
+    {
+        throw ArbiterError("Couldn't GCS DELETE " + path + ": " + res.str());
+    }
+}
+
+std::vector<std::exception_ptr> Google::removeMany(
+        const std::vector<std::string>& paths,
+        const std::size_t threads) const
+{
+    std::vector<std::exception_ptr> errors(paths.size());
+    const std::size_t batches(
+            (paths.size() + maxBatchCalls - 1) / maxBatchCalls);
+
+    parallelFor(batches, threads, [&](const std::size_t b)
+    {
+        const std::size_t begin(b * maxBatchCalls);
+        const std::size_t end((std::min)(begin + maxBatchCalls, paths.size()));
+
+        try
+        {
+            const std::vector<std::string> failures(
+                    deleteBatch(std::vector<std::string>(
+                            paths.begin() + begin,
+                            paths.begin() + end)));
+
+            for (std::size_t i(begin); i < end; ++i)
+            {
+                if (failures[i - begin].empty()) continue;
+                errors[i] = std::make_exception_ptr(
+                        ArbiterError(
+                            "Couldn't GCS delete " + paths[i] + ": " +
+                            failures[i - begin]));
+            }
+        }
+        catch (...)
+        {
+            for (std::size_t i(begin); i < end; ++i)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    }, m_pool.executor());
+
+    return errors;
+}
+
+std::vector<std::exception_ptr> Google::copyMany(
+        const std::vector<std::pair<std::string, std::string>>& pairs,
+        const std::size_t threads) const
+{
+    std::vector<std::exception_ptr> errors(pairs.size());
+    const std::size_t batches(
+            (pairs.size() + maxBatchCalls - 1) / maxBatchCalls);
+
+    std::string query;
+    if (const std::size_t n = m_config->rewriteChunkSize())
+    {
+        query = "?maxBytesRewrittenPerCall=" + std::to_string(n);
+    }
+
+    parallelFor(batches, threads, [&](const std::size_t b)
+    {
+        const std::size_t begin(b * maxBatchCalls);
+        const std::size_t end((std::min)(begin + maxBatchCalls, pairs.size()));
+
+        std::vector<std::string> calls;
+        for (std::size_t i(begin); i < end; ++i)
         {
-            const std::size_t split(path.find("/"));
-            m_bucket = path.substr(0, split) + "/";
-            if (split != std::string::npos) m_object = path.substr(split + 1);
+            const GResource from(pairs[i].first, m_config->endpoint());
+            const GResource to(pairs[i].second, m_config->endpoint());
+            calls.push_back(
+                    "POST " + from.batchPath() + "/rewriteTo/b/" +
+                    to.bucket() + "o/" +
+                    http::sanitize(to.object(), GResource::exclusions) +
+                    query + " HTTP/1.1\r\n"
+                    "Content-Type: application/json\r\n"
+                    "Content-Length: 2\r\n\r\n{}");
         }
 
-        const std::string& bucket() const { return m_bucket; }
-        const std::string& object() const { return m_object; }
-        static const char exclusions[];
-        std::string endpoint() const
+        std::vector<http::Response> responses;
+        try
         {
-            // https://cloud.google.com/storage/docs/json_api/v1/
-            return
-                std::string(baseGoogleUrl) + "b/" + bucket() +
-                "o/" + http::sanitize(object(), exclusions);
+            responses = batch(calls);
         }
-
-        std::string uploadEndpoint() const
+        catch (...)
         {
-            return std::string(uploadUrl) + "b/" + bucket() + "o";
+            responses.assign(calls.size(), http::Response());
         }
 
-        std::string listEndpoint() const
+        for (std::size_t i(begin); i < end; ++i)
         {
-            return std::string(baseGoogleUrl) + "b/" + bucket() + "o";
-        }
+            const std::string& src(pairs[i].first);
+            const std::string& dst(pairs[i].second);
+            const http::Response& res(responses[i - begin]);
 
-    private:
-        std::string m_bucket;
-        std::string m_object;
+            try
+            {
+                std::string token;
+                if (res.ok())
+                {
+                    const json j(json::parse(res.str()));
+                    if (j.value("done", false)) continue;
+                    token = j.value("rewriteToken", std::string());
+                }
+                else if (res.code() && res.code() != 429 && res.code() < 500)
+                {
+                    throw ArbiterError(
+                            "Couldn't GCS copy " + src + " to " + dst + ": " +
+                            std::to_string(res.code()) + ": " + res.str());
+                }
+
+                // Unfinished rewrites are resumed on their own, as are
+                // those which went unanswered or were refused for now.
+                rewrite(src, dst, token);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    }, m_pool.executor());
 
-    };
-    
-    // https://cloud.google.com/storage/docs/json_api/#encoding
-    const char GResource::exclusions[] = "!$&'()*+,;=:@";
-    
-} // unnamed namespace
+    return errors;
+}
 
-namespace drivers
+std::vector<std::string> Google::deleteBatch(
+        const std::vector<std::string>& paths) const
 {
+    std::vector<std::string> calls;
+    for (const std::string& path : paths)
+    {
+        const GResource resource(path, m_config->endpoint());
+        calls.push_back(
+                "DELETE " + resource.batchPath() + " HTTP/1.1\r\n\r\n");
+    }
 
-Google::Google(http::Pool& pool, std::unique_ptr<Auth> auth)
-    : Https(pool)
-    , m_auth(std::move(auth))
-{ }
+    const std::vector<http::Response> responses(batch(calls));
+    std::vector<std::string> failures(paths.size());
 
-std::unique_ptr<Google> Google::create(http::Pool& pool, const std::string s)
-{
-    if (auto auth = Auth::create(s))
+    for (std::size_t i(0); i < paths.size(); ++i)
     {
-        return makeUnique<Google>(pool, std::move(auth));
+        // As for single removals, objects which don't exist are not errors.
+        const http::Response& res(responses[i]);
+        if (!res.code()) failures[i] = "No response";
+        else if (!res.ok() && res.code() != 404)
+        {
+            failures[i] = std::to_string(res.code()) + ": " + res.str();
+        }
     }
 
-    return std::unique_ptr<Google>();
+    return failures;
 }
 
-std::unique_ptr<std::size_t> Google::tryGetSize(const std::string path) const
+std::vector<http::Response> Google::batch(
+        const std::vector<std::string>& calls) const
 {
+    // Each call is an HTTP request of its own within a multipart body, and
+    // each response is matched to its call by the Content-ID.
+    const std::string boundary(
+            "arbiter-batch-" + std::to_string(randomNumber()));
+
+    std::string request;
+    for (std::size_t i(0); i < calls.size(); ++i)
+    {
+        request +=
+            "--" + boundary + "\r\n"
+            "Content-Type: application/http\r\n"
+            "Content-ID: <" + std::to_string(i) + ">\r\n\r\n" +
+            calls[i] + "\r\n";
+    }
+    request += "--" + boundary + "--\r\n";
+
     http::Headers headers(m_auth->headers());
-    const GResource resource(path);
+    headers["Content-Type"] = "multipart/mixed; boundary=" + boundary;
 
     drivers::Https https(m_pool);
     const auto res(
-            https.internalHead(resource.endpoint(), headers, altMediaQuery));
+            https.internalPost(
+                m_config->endpoint() + "batch/storage/v1",
+                std::vector<char>(request.begin(), request.end()),
+                headers));
 
-    if (res.ok() && res.headers().count("Content-Length"))
+    if (!res.ok())
     {
-        const auto& s(res.headers().at("Content-Length"));
-        return makeUnique<std::size_t>(std::stoul(s));
+        throw ArbiterError("Couldn't GCS batch request: " + res.str());
     }
 
-    return std::unique_ptr<std::size_t>();
+    return parseBatch(
+            gsHeader(res.headers(), "Content-Type"),
+            res.str(),
+            calls.size());
 }
 
-bool Google::get(
-        const std::string path,
-        std::vector<char>& data,
-        const http::Headers userHeaders,
-        const http::Query query) const
+std::vector<http::Response> Google::parseBatch(
+        const std::string& type,
+        const std::string& body,
+        const std::size_t count)
 {
-    http::Headers headers(m_auth->headers());
-    headers.insert(userHeaders.begin(), userHeaders.end());
-    const GResource resource(path);
-
-    drivers::Https https(m_pool);
-    const auto res(
-            https.internalGet(resource.endpoint(), headers, altMediaQuery));
-
-    if (res.ok())
+    const std::string param("boundary=");
+    const std::size_t pos(type.find(param));
+    if (pos == std::string::npos)
     {
-        data = res.data();
-        return true;
+        throw ArbiterError("Unexpected GCS batch response: " + type);
     }
-    else
+
+    std::string boundary(
+            type.substr(
+                pos + param.size(),
+                type.find(';', pos) - pos - param.size()));
+    if (boundary.size() && boundary.front() == '"')
     {
-        std::cout <<
-            "Failed get - " << res.code() << ": " << res.str() << std::endl;
-        return false;
+        boundary = boundary.substr(1, boundary.find('"', 1) - 1);
     }
-}
 
-void Google::put(
-        const std::string path,
-        const std::vector<char>& data,
-        const http::Headers userHeaders,
-        const http::Query userQuery) const
-{
-    const GResource resource(path);
-    const std::string url(resource.uploadEndpoint());
+    const std::string delimiter("--" + boundary);
+    const std::string blank("\r\n\r\n");
+    const std::string idPrefix("<response-");
 
-    http::Headers headers(m_auth->headers());
-    headers["Expect"] = "";
-    headers.insert(userHeaders.begin(), userHeaders.end());
+    std::vector<http::Response> responses(count);
 
-    http::Query query(userQuery);
-    query["uploadType"] = "media";
-    query["name"] = http::sanitize(resource.object(), GResource::exclusions);
+    std::size_t begin(body.find(delimiter));
+    while (begin != std::string::npos)
+    {
+        begin += delimiter.size();
+        if (!body.compare(begin, 2, "--")) break;
 
-    drivers::Https https(m_pool);
-    const auto res(https.internalPost(url, data, headers, query));
+        // The line break before the next delimiter belongs to it.
+        const std::size_t end(body.find(delimiter, begin));
+        std::string part(body.substr(begin, end - begin));
+        if (part.size() >= 2 && !part.compare(part.size() - 2, 2, "\r\n"))
+        {
+            part.resize(part.size() - 2);
+        }
+        begin = end;
+
+        // The headers of the part name the call it answers, and its body is
+        // the response, an HTTP status line, headers, and body of its own.
+        const std::size_t split(part.find(blank));
+        if (split == std::string::npos) continue;
+
+        const std::string id(
+                gsHeader(gsParseHeaders(part.substr(0, split)), "Content-ID"));
+        if (id.compare(0, idPrefix.size(), idPrefix) ||
+                id.size() < idPrefix.size() + 2 ||
+                id.back() != '>')
+        {
+            continue;
+        }
+
+        const std::string digits(
+                id.substr(idPrefix.size(), id.size() - idPrefix.size() - 1));
+        if (digits.find_first_not_of("0123456789") != std::string::npos)
+        {
+            continue;
+        }
+
+        const std::size_t index(std::stoull(digits));
+        if (index >= count) continue;
+
+        const std::string response(part.substr(split + blank.size()));
+        const std::size_t lineEnd((std::min)(
+                    response.find("\r\n"),
+                    response.size()));
+        const std::string line(response.substr(0, lineEnd));
+        const std::size_t space(line.find(' '));
+        if (line.compare(0, 5, "HTTP/") ||
+                space == std::string::npos ||
+                space + 4 > line.size() ||
+                !std::isdigit(line[space + 1]) ||
+                !std::isdigit(line[space + 2]) ||
+                !std::isdigit(line[space + 3]))
+        {
+            continue;
+        }
+
+        const int code(std::stoi(line.substr(space + 1, 3)));
+
+        std::size_t headEnd(response.find(blank, lineEnd));
+        const std::string head(
+                lineEnd < response.size() ?
+                    response.substr(lineEnd + 2, headEnd - lineEnd - 2) :
+                    std::string());
+        headEnd = headEnd == std::string::npos ?
+            response.size() : headEnd + blank.size();
+
+        responses[index] = http::Response(
+                code,
+                std::vector<char>(
+                    response.begin() + headEnd,
+                    response.end()),
+                gsParseHeaders(head));
+    }
+
+    return responses;
 }
 
 std::vector<std::string> Google::glob(std::string path, bool verbose) const
 {
     std::vector<std::string> results;
+    glob(path, [&results](std::string p)
+    {
+        results.push_back(std::move(p));
+    }, verbose);
+    return results;
+}
+
+void Google::glob(
+        std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void Google::globInfo(
+        std::string path,
+        const std::function<void(FileInfo)>& f,
+        bool) const
+{
+    path.pop_back();
+    const bool recursive(path.back() == '*');
+    if (recursive) path.pop_back();
+
+    const GResource resource(path, m_config->endpoint());
+
+    std::mutex mutex;
+    auto found([&mutex, &f](FileInfo info)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        f(std::move(info));
+    });
+
+    // Each prefix is listed with a delimiter, and for recursive globs the
+    // common prefixes it contains are then listed concurrently rather than
+    // paging through the entire subtree serially.
+    auto visit([&](
+                const std::string& listed,
+                const std::function<void(std::string)>& push)
+    {
+        list(resource.bucket(), listed, found, [&](std::string sub)
+        {
+            if (recursive) push(std::move(sub));
+        });
+    });
+
+    parallelTraverse(
+            { resource.object() },
+            recursive ? m_pool.size() : 1,
+            visit,
+            m_pool.executor());
+}
 
+void Google::globShard(
+        std::string path,
+        const std::size_t shard,
+        const std::size_t shards,
+        const std::function<void(FileInfo)>& f,
+        bool) const
+{
     path.pop_back();
     const bool recursive(path.back() == '*');
     if (recursive) path.pop_back();
 
-    const GResource resource(path);
-    const std::string url(resource.listEndpoint());
+    const GResource resource(path, m_config->endpoint());
+    const std::string& bucket(resource.bucket());
+
+    const std::vector<ShardEntry> entries(
+            shardEntries(path, shards, recursive, [&](
+                    const std::string& dir,
+                    const std::function<void(FileInfo)>& file,
+                    const std::function<void(std::string)>& sub)
+    {
+        list(
+                bucket,
+                dir.substr(bucket.size()),
+                file,
+                [&](std::string s) { sub(bucket + s); });
+    }));
+
+    const auto range(shardRange(entries.size(), shard, shards));
+    if (range.first == range.second) return;
+
+    const std::string root(type() + "://" + bucket);
+    auto key([&](const std::size_t i)
+    {
+        return i < entries.size() ?
+            entries[i].info.path.substr(root.size()) : "";
+    });
+
+    // Beneath a directory entry, every key sorts before the next entry.
+    list(
+            bucket,
+            resource.object(),
+            f,
+            [](std::string) { },
+            recursive ? "" : "/",
+            "",
+            key(range.first),
+            key(range.second));
+}
+
+void Google::globPattern(
+        const Glob& glob,
+        const std::function<void(FileInfo)>& f,
+        bool) const
+{
+    const std::string& prefix(glob.prefix());
+    const std::size_t slash(prefix.find('/'));
+    if (slash == std::string::npos)
+    {
+        throw ArbiterError(
+                "Bucket names may not be globbed: " + glob.pattern());
+    }
+
+    const GResource resource(prefix, m_config->endpoint());
+    const std::string& bucket(resource.bucket());
+    const std::string root(type() + "://");
+
+    std::mutex mutex;
+    auto found([&](FileInfo info)
+    {
+        if (!glob.match(info.path.substr(root.size()))) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        f(std::move(info));
+    });
+
+    const std::string matchGlob(
+            m_config->matchGlob() ?
+                matchGlobOf(glob.pattern().substr(slash + 1)) : "");
+    if (matchGlob.size())
+    {
+        list(bucket, resource.object(), found, nullptr, "", matchGlob);
+        return;
+    }
+
+    // Levels are listed with a delimiter, descending concurrently into only
+    // those common prefixes under which the pattern may match, each extended
+    // by whatever literal characters the pattern requires next.
+    auto visit([&](
+                const std::string& listed,
+                const std::function<void(std::string)>& push)
+    {
+        list(bucket, listed, found, [&](const std::string& sub)
+        {
+            const std::string path(bucket + sub);
+            if (glob.mayContain(path))
+            {
+                push(glob.extend(path).substr(bucket.size()));
+            }
+        });
+    });
+
+    parallelTraverse(
+            { resource.object() },
+            m_pool.size(),
+            visit,
+            m_pool.executor());
+}
+
+void Google::list(
+        const std::string& bucket,
+        const std::string& prefix,
+        const std::function<void(FileInfo)>& f,
+        const std::function<void(std::string)>& sub,
+        const std::string& delimiter,
+        const std::string& matchGlob,
+        const std::string& startOffset,
+        const std::string& endOffset) const
+{
+    const std::string url(
+            GResource(bucket, m_config->endpoint()).listEndpoint());
     std::string pageToken;
+    std::size_t page(0);
 
     drivers::Https https(m_pool);
-    http::Query query;
+    http::Query query(listQuery);
+
+    // GCS only compresses responses for user agents which say they accept
+    // gzip.
+    http::Headers compressed(http::acceptCompressed());
+    if (compressed.size()) compressed["User-Agent"] = "arbiter (gzip)";
 
     // When the delimiter is set to "/", then the response will contain a
-    // "prefixes" key in addition to the "items" key.  The "prefixes" key will
-    // contain the directories found, which we will ignore.
-    if (!recursive) query["delimiter"] = "/";
-    if (resource.object().size()) query["prefix"] = resource.object();
+    // "prefixes" key in addition to the "items" key, holding the common
+    // prefixes of the next level.
+    if (delimiter.size()) query["delimiter"] = delimiter;
+    if (prefix.size()) query["prefix"] = prefix;
+    if (matchGlob.size()) query["matchGlob"] = matchGlob;
+    if (startOffset.size()) query["startOffset"] = startOffset;
+    if (endOffset.size()) query["endOffset"] = endOffset;
+
+    const std::string typed(type() + "://" + bucket);
 
     do
     {
         if (pageToken.size()) query["pageToken"] = pageToken;
 
-        const auto res(https.internalGet(url, m_auth->headers(), query));
+        http::Headers headers(m_auth->headers());
+        headers.insert(compressed.begin(), compressed.end());
+        const auto res(https.internalGet(url, headers, query));
 
         if (!res.ok())
         {
             throw ArbiterError(std::to_string(res.code()) + ": " + res.str());
         }
 
-        const json j(json::parse(res.str()));
-        for (const json& item : j.at("items"))
+        ARBITER_PROBE(list__page, "gs", url.c_str(), page,
+                res.data().size());
+        ++page;
+
+        // Pages with no matches omit the items entirely.
+        ListingSax sax([&](FileInfo info)
+        {
+            info.path = typed + info.path;
+            f(std::move(info));
+        }, sub);
+
+        const auto& data(res.data());
+        if (!json::sax_parse(data.begin(), data.end(), &sax))
         {
-            results.push_back(
-                    type() + "://" +
-                    resource.bucket() + item.at("name").get<std::string>());
+            throw ArbiterError("Could not parse GCS listing: " + res.str());
         }
 
-        pageToken = j.value("nextPageToken", "");
+        pageToken = sax.pageToken();
     } while (pageToken.size());
-
-    return results;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Pulls from the subscription until destroyed, waiting between pulls which
+// find nothing.
+class Google::PubsubWatch : public Watch
+{
+public:
+    PubsubWatch(
+            const Google& google,
+            const std::string pattern,
+            ChangeCallback f)
+        : m_google(google)
+        , m_glob(pattern)
+        , m_f(std::move(f))
+        , m_url(pubsubUrl + google.m_config->subscription())
+    {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    ~PubsubWatch()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_done)
+        {
+            lock.unlock();
+            bool pulled(false);
+            try { pulled = pull(); }
+            catch (std::exception& e)
+            {
+                logging::warn(
+                        "Could not pull changes to " + m_glob.pattern() +
+                        ": " + e.what());
+            }
+            lock.lock();
+
+            if (!pulled)
+            {
+                m_cv.wait_for(
+                        lock,
+                        std::chrono::seconds(m_google.m_config->wait()),
+                        [this]() { return m_done; });
+            }
+        }
+    }
+
+    json post(const std::string& method, const json& body) const
+    {
+        http::Headers headers(m_google.m_auth->headers());
+        headers["Content-Type"] = "application/json";
+
+        const std::string data(body.dump());
+        drivers::Https https(m_google.m_pool);
+        const auto res(
+                https.internalPost(
+                    m_url + ":" + method,
+                    std::vector<char>(data.begin(), data.end()),
+                    headers));
+
+        if (!res.ok())
+        {
+            throw ArbiterError(
+                    "Couldn't Pub/Sub " + method + ": " +
+                    std::to_string(res.code()) + ": " + res.str());
+        }
+
+        return json::parse(res.str().size() ? res.str() : "{}");
+    }
+
+    // Returns true if any messages were pulled.
+    bool pull()
+    {
+        const json response(
+                post(
+                    "pull",
+                    json {
+                        { "maxMessages", 100 },
+                        { "returnImmediately", true }
+                    }));
+
+        json ackIds(json::array());
+        for (const json& received :
+                response.value("receivedMessages", json::array()))
+        {
+            try { deliver(received.at("message")); }
+            catch (std::exception& e)
+            {
+                logging::warn(
+                        std::string("Skipping invalid notification: ") +
+                        e.what());
+            }
+            ackIds.push_back(received.at("ackId"));
+        }
+
+        if (ackIds.empty()) return false;
+
+        post("acknowledge", json { { "ackIds", ackIds } });
+        return true;
+    }
+
+    // https://cloud.google.com/storage/docs/pubsub-notifications
+    void deliver(const json& message)
+    {
+        const json attributes(message.value("attributes", json::object()));
+        const std::string type(
+                attributes.value("eventType", std::string()));
+
+        const std::string path(
+                attributes.at("bucketId").get<std::string>() + "/" +
+                attributes.at("objectId").get<std::string>());
+        if (!m_glob.match(path)) return;
+
+        ChangeEvent event;
+        event.info.path = m_google.type() + "://" + path;
+
+        if (type == "OBJECT_FINALIZE")
+        {
+            // With the JSON_API_V1 payload, the data is the object.
+            const std::string data(
+                    crypto::decodeBase64(
+                        message.value("data", std::string())));
+            const json object(data.size() ? json::parse(data) : json());
+            if (object.is_object() && object.count("size"))
+            {
+                event.info.hasSize = true;
+                event.info.size =
+                    std::stoull(object.at("size").get<std::string>());
+            }
+        }
+        else if (type == "OBJECT_DELETE" || type == "OBJECT_ARCHIVE")
+        {
+            // Those which are overwritten are followed by their finalize.
+            if (attributes.count("overwrittenByGeneration")) return;
+            event.type = ChangeEvent::Type::Removed;
+        }
+        else return;
+
+        m_f(event);
+    }
+
+    const Google& m_google;
+    const Glob m_glob;
+    const ChangeCallback m_f;
+    const std::string m_url;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_done = false;
+    std::thread m_thread;
+};
+
+std::unique_ptr<Watch> Google::watch(
+        std::string path,
+        ChangeCallback f,
+        const std::chrono::milliseconds interval) const
+{
+    if (m_config->subscription().empty())
+    {
+        return Driver::watch(path, std::move(f), interval);
+    }
+
+    if (path.size() && path.back() == '/') path += "**";
+    return std::unique_ptr<Watch>(new PubsubWatch(*this, path, std::move(f)));
+}
+
 std::unique_ptr<Google::Auth> Google::Auth::create(const std::string s)
 {
     const json j(json::parse(s));
+
+    // Notifications are pulled with the same token as everything else.
+    std::string scope(storageScope);
+    if (j.is_object() && j.count("notifications"))
+    {
+        scope += std::string(" ") + pubsubScope;
+    }
+
+    const std::shared_ptr<CredentialCache> cache(CredentialCache::create(s));
+
     if (auto path = env("GOOGLE_APPLICATION_CREDENTIALS"))
     {
         if (const auto file = drivers::Fs().tryGet(*path))
         {
             try
             {
-                return makeUnique<Auth>(*file);
+                return makeUnique<Auth>(*file, scope, cache);
             }
             catch (const ArbiterError& e)
             {
-                std::cout << e.what() << std::endl;
+                logging::error(e.what());
                 return std::unique_ptr<Auth>();
             }
         }
@@ -238,43 +1621,123 @@ std::unique_ptr<Google::Auth> Google::Auth::create(const std::string s)
         const auto path(j.get<std::string>());
         if (const auto file = drivers::Fs().tryGet(path))
         {
-            return makeUnique<Auth>(*file);
+            return makeUnique<Auth>(*file, scope, cache);
         }
     }
     else if (j.is_object())
     {
-        return makeUnique<Auth>(s);
+        return makeUnique<Auth>(s, scope, cache);
     }
 
     return std::unique_ptr<Auth>();
 }
 
-Google::Auth::Auth(const std::string s)
+Google::Auth::Auth(
+        const std::string s,
+        const std::string scope,
+        const std::shared_ptr<CredentialCache> cache)
     : m_clientEmail(json::parse(s).at("client_email").get<std::string>())
     , m_privateKey(json::parse(s).at("private_key").get<std::string>())
+    , m_scope(scope)
+    , m_cache(cache)
+{
+    int64_t expiration(0);
+    if (m_cache)
+    {
+        if (auto token = m_cache->get(cacheKey(), gsExpirySeconds, expiration))
+        {
+            http::Headers authHeaders;
+            authHeaders["Authorization"] = "Bearer " + *token;
+            m_snapshot = std::make_shared<const Snapshot>(
+                    authHeaders,
+                    expiration);
+        }
+    }
+
+    if (!m_snapshot)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        refresh();
+    }
+
+    m_refresher = std::thread([this]() { run(); });
+}
+
+Google::Auth::~Auth()
 {
-    maybeRefresh();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+
+    m_cv.notify_all();
+    if (m_refresher.joinable()) m_refresher.join();
 }
 
 http::Headers Google::Auth::headers() const
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    maybeRefresh();
-    return m_headers;
+    std::shared_ptr<const Snapshot> current(std::atomic_load(&m_snapshot));
+
+    // Normally the background thread keeps our token fresh, so we only block
+    // here if it has been failing long enough that the token is about to
+    // expire.
+    if (current->expiration - Time().asUnix() < gsExpirySeconds)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        current = std::atomic_load(&m_snapshot);
+        if (current->expiration - Time().asUnix() < gsExpirySeconds)
+        {
+            current = refresh();
+        }
+    }
+
+    return current->headers;
+}
+
+void Google::Auth::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_done)
+    {
+        // Wake once our token is within the refresh window, and then try to
+        // replace it, backing off after failures.
+        const std::shared_ptr<const Snapshot> current(
+                std::atomic_load(&m_snapshot));
+        const int64_t remaining(current->expiration - Time().asUnix());
+
+        if (remaining >= refreshSeconds)
+        {
+            const std::chrono::seconds wait(remaining - refreshSeconds);
+            m_cv.wait_for(lock, wait);
+            continue;
+        }
+
+        // Back off after a failure, or if we're issued tokens which are
+        // already within our refresh window.
+        try
+        {
+            const auto next(refresh());
+            if (next->expiration - Time().asUnix() >= refreshSeconds) continue;
+        }
+        catch (...) { }
+
+        m_cv.wait_for(lock, std::chrono::seconds(gsRetrySeconds));
+    }
 }
 
-void Google::Auth::maybeRefresh() const
+std::shared_ptr<const Google::Auth::Snapshot> Google::Auth::refresh() const
 {
     using namespace crypto;
 
     const auto now(Time().asUnix());
-    if (m_expiration - now > 120) return;   // Refresh when under 2 mins left.
 
     // https://developers.google.com/identity/protocols/OAuth2ServiceAccount
     const json h { { "alg", "RS256" }, { "typ", "JWT" } };
     const json c {
         { "iss", m_clientEmail },
-        { "scope", "https://www.googleapis.com/auth/devstorage.read_write" },
+        { "scope", m_scope },
         { "aud", "https://www.googleapis.com/oauth2/v4/token" },
         { "iat", now },
         { "exp", now + 3600 }
@@ -293,12 +1756,11 @@ void Google::Auth::maybeRefresh() const
         "assertion=" + assertion;
     const std::vector<char> body(sbody.begin(), sbody.end());
 
-    const http::Headers headers { { "Expect", "" } };
     const std::string tokenRequestUrl("www.googleapis.com/oauth2/v4/token");
 
-    http::Pool pool;
-    drivers::Https https(pool);
-    const auto res(https.internalPost(tokenRequestUrl, body, headers));
+    if (!m_pool) m_pool.reset(new http::Pool());
+    drivers::Https https(*m_pool);
+    const auto res(https.internalPost(tokenRequestUrl, body));
 
     if (!res.ok())
     {
@@ -307,10 +1769,35 @@ void Google::Auth::maybeRefresh() const
                 "request came back with response: " + res.str());
     }
 
-    const json token(json::parse(res.str()));
-    m_headers["Authorization"] =
+    const json token(
+            parseFields(res.str(), { "access_token", "expires_in" }));
+
+    http::Headers authHeaders;
+    authHeaders["Authorization"] =
         "Bearer " + token.at("access_token").get<std::string>();
-    m_expiration = now + token.at("expires_in").get<int64_t>();
+
+    std::shared_ptr<const Snapshot> next(
+            std::make_shared<const Snapshot>(
+                authHeaders,
+                now + token.at("expires_in").get<int64_t>()));
+
+    std::atomic_store(&m_snapshot, next);
+
+    if (m_cache)
+    {
+        m_cache->put(
+                cacheKey(),
+                token.at("access_token").get<std::string>(),
+                next->expiration);
+    }
+
+    return next;
+}
+
+std::string Google::Auth::cacheKey() const
+{
+    // The key is hashed into a file name, so its secret isn't exposed.
+    return "gs:" + m_clientEmail + "\n" + m_scope + "\n" + m_privateKey;
 }
 
 std::string Google::Auth::sign(
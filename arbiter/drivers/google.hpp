@@ -2,9 +2,13 @@
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/drivers/http.hpp>
+#include <arbiter/util/credentials.hpp>
 #endif
 
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <thread>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
@@ -20,57 +24,342 @@ namespace drivers
 class Google : public Https
 {
     class Auth;
+    class Config;
 public:
-    Google(http::Pool& pool, std::unique_ptr<Auth> auth);
+    Google(
+            http::Pool& pool,
+            std::unique_ptr<Auth> auth,
+            std::unique_ptr<Config> config);
 
     static std::unique_ptr<Google> create(http::Pool& pool, std::string j);
 
     // Overrides.
     virtual std::string type() const override { return "gs"; }  // Match gsutil.
 
+    /** All but multipart uploads, which are written whole. */
+    virtual Capabilities capabilities() const override;
+
     virtual std::unique_ptr<std::size_t> tryGetSize(
             std::string path) const override;
 
-    /** Inherited from Drivers::Http. */
+    /** Directories holding many of the paths are listed, as by
+     * Driver::tryGetSizesListed, and the rest are looked up with batch
+     * requests of up to 100 metadata reads each.
+     */
+    virtual std::vector<std::unique_ptr<std::size_t>> tryGetSizes(
+            const std::vector<std::string>& paths) const override;
+
+    /** The ETag of the object. */
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    /** Inherited from Drivers::Http.  Large uploads may be resumable or
+     * composite, as configured.  See Google::Config.
+     */
     virtual void put(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers,
-            http::Query query) const override;
+            const http::Headers& headers,
+            const http::Query& query) const override;
+
+    /** Copies within GCS with the rewrite API, so that no data passes
+     * through us.  Large objects, or those which change location or storage
+     * class, may take many rewrite calls, each resuming from the token
+     * returned by the last.
+     */
+    virtual void copy(std::string src, std::string dst) const override;
+
+    /** Starts the rewrites with batch requests of up to 100 each, up to
+     * @p threads of which are in flight at a time.  Those which aren't
+     * done by their first call are resumed singly, as by copy, as are those
+     * refused for the moment.
+     */
+    virtual std::vector<std::exception_ptr> copyMany(
+            const std::vector<std::pair<std::string, std::string>>& pairs,
+            std::size_t threads) const override;
+
+    virtual void remove(std::string path) const override;
+
+    /** Removes the objects with batch requests of up to 100 deletions each,
+     * up to @p threads of which are in flight at a time.
+     */
+    virtual std::vector<std::exception_ptr> removeMany(
+            const std::vector<std::string>& paths,
+            std::size_t threads) const override;
+
+    /** With a configured subscription, pulls the Pub/Sub notifications of
+     * our buckets from it and acknowledges each message pulled, so the
+     * subscription must be dedicated to a single watch.  Events for the
+     * objects which don't match @p path are dropped.  Otherwise, polls as
+     * does the default.
+     */
+    virtual std::unique_ptr<Watch> watch(
+            std::string path,
+            ChangeCallback f,
+            std::chrono::milliseconds interval =
+                std::chrono::seconds(60)) const override;
+
+    /** The responses of the multipart/mixed @p body of a batch response,
+     * whose Content-Type is @p type, to each of @p count calls in order.
+     * Each part answers the call named by the `<response-N>` Content-ID of
+     * its headers, and those which are malformed or answer no call are
+     * dropped, leaving their calls with a code of zero.
+     */
+    static std::vector<http::Response> parseBatch(
+            const std::string& type,
+            const std::string& body,
+            std::size_t count);
 
 private:
+    class PubsubWatch;
+
+    // An authorized HEAD request for the object at @p path.
+    http::Response head(std::string path) const;
+
     /** Inherited from Drivers::Http. */
     virtual bool get(
-            std::string path,
+            const std::string& path,
             std::vector<char>& data,
-            http::Headers headers,
-            http::Query query) const override;
+            const http::Headers& headers,
+            const http::Query& query) const override;
+
+    virtual bool get(
+            const std::string& path,
+            const std::function<void(const char*, std::size_t)>& sink,
+            const http::Headers& headers,
+            const http::Query& query) const override;
 
     virtual std::vector<std::string> glob(
             std::string path,
             bool verbose) const override;
 
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    /** Listings include the size and modification time of each object.
+     * Recursive listings list each level with a delimiter, descending into
+     * the prefixes of each concurrently, up to the size of the pool at a
+     * time.
+     */
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    /** Only the levels of the bucket under which the pattern may match are
+     * listed, concurrently.  If so configured, see Config::matchGlob, the
+     * pattern is instead matched by GCS in a single listing.
+     */
+    virtual void globPattern(
+            const Glob& glob,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    /** Each share is a run of the keys of the prefix, split at the entries
+     * of its levels, which is listed by a single listing bounded by
+     * `startOffset` and `endOffset`.
+     */
+    virtual void globShard(
+            std::string path,
+            std::size_t shard,
+            std::size_t shards,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    // List the objects of @p bucket, which ends with a slash, from
+    // @p prefix, passing each to @p f and each common prefix to @p sub.
+    // With a @p delimiter, only one level is listed.  With a @p matchGlob,
+    // only the objects matching it are.  Unless they are empty, only the
+    // keys from @p startOffset and before @p endOffset are listed.
+    void list(
+            const std::string& bucket,
+            const std::string& prefix,
+            const std::function<void(FileInfo)>& f,
+            const std::function<void(std::string)>& sub,
+            const std::string& delimiter = "/",
+            const std::string& matchGlob = "",
+            const std::string& startOffset = "",
+            const std::string& endOffset = "") const;
+
+    // Upload in a single request.
+    void putMedia(
+            const std::string& path,
+            const std::vector<char>& data,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    // Upload via a resumable session in chunks, so that a failure need only
+    // resend from the last chunk which the server committed.
+    void putResumable(
+            const std::string& path,
+            const std::vector<char>& data,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    // Upload components of the data in parallel as temporary objects, and
+    // then compose them into the destination.
+    void putComposite(
+            const std::string& path,
+            const std::vector<char>& data,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    // Rewrite @p src to @p dst, resuming from the rewrite @p token if it is
+    // not empty.
+    void rewrite(
+            const std::string& src,
+            const std::string& dst,
+            const std::string& token) const;
+
+    // Send each of @p calls, an HTTP request line followed by any headers
+    // and body, within a single batch request, returning the response to
+    // each in the same order.  Those which went unanswered have a code of
+    // zero.
+    std::vector<http::Response> batch(
+            const std::vector<std::string>& calls) const;
+
+    // Remove @p paths with a single batch request, returning the error for
+    // each path which was not removed, or an empty string for those which
+    // were.
+    std::vector<std::string> deleteBatch(
+            const std::vector<std::string>& paths) const;
+
+    // Look up the sizes of @p paths with a single batch request, looking
+    // up singly those for which it fails.
+    std::vector<std::unique_ptr<std::size_t>> getSizesBatch(
+            const std::vector<std::string>& paths) const;
+
     std::unique_ptr<Auth> m_auth;
+    std::unique_ptr<Config> m_config;
+};
+
+/** Upload settings, which may be given alongside the credentials when the
+ * `gs` configuration is an object.
+ */
+class Google::Config
+{
+public:
+    Config(std::string s);
+
+    /** Uploads larger than this many bytes use a resumable upload, sent in
+     * chunks of chunkSize() bytes, which is a multiple of 256 KiB.  Zero
+     * disables resumable uploads.
+     */
+    std::size_t resumableThreshold() const { return m_resumableThreshold; }
+    std::size_t chunkSize() const { return m_chunkSize; }
+
+    /** Uploads larger than this many bytes are split into up to 32
+     * components of at least chunkSize() bytes, which are uploaded in
+     * parallel and then composed.  Zero, the default, disables composite
+     * uploads.
+     */
+    std::size_t compositeThreshold() const { return m_compositeThreshold; }
+
+    /** If true, from a `checksum` of `crc32c`, uploads carry their CRC32C,
+     * which GCS verifies before committing the object.
+     */
+    bool crc32c() const { return m_crc32c; }
+
+    /** The most bytes rewritten by each call of a copy, which is a multiple
+     * of 1 MiB, or zero, the default, to leave it to GCS.
+     */
+    std::size_t rewriteChunkSize() const { return m_rewriteChunkSize; }
+
+    /** The Pub/Sub subscription to the notifications of our buckets, from
+     * the `subscription` of a `notifications` object, like
+     * `projects/p/subscriptions/s`, or empty if watches poll.  Pulls which
+     * find nothing are repeated after wait() seconds, by default 5.
+     */
+    const std::string& subscription() const { return m_subscription; }
+    int wait() const { return m_wait; }
+
+    /** If true, from `matchGlob`, globs with wildcards are listed by a
+     * single listing of everything under their literal prefix, filtered by
+     * GCS with its `matchGlob` parameter, rather than by descending through
+     * the levels which may contain matches.  This suits patterns which
+     * match few of the objects beneath wide levels.  False by default.
+     */
+    bool matchGlob() const { return m_matchGlob; }
+
+    /** The root of the JSON API, from `endpoint`, beneath which lie its
+     * `storage/v1/`, `upload/storage/v1/`, and `batch/storage/v1` paths.
+     * Without a scheme, it is reached over HTTPS.  This is
+     * `www.googleapis.com/` by default, and may be set for an emulator, as
+     * `http://localhost:4443/`.
+     */
+    const std::string& endpoint() const { return m_endpoint; }
+
+private:
+    std::size_t m_resumableThreshold = 16 * 1024 * 1024;
+    std::size_t m_chunkSize = 8 * 1024 * 1024;
+    std::size_t m_compositeThreshold = 0;
+    bool m_crc32c = false;
+    std::size_t m_rewriteChunkSize = 0;
+    std::string m_subscription;
+    int m_wait = 5;
+    bool m_matchGlob = false;
+    std::string m_endpoint = "www.googleapis.com/";
 };
 
+// The current token is held in an immutable snapshot which readers load
+// without locking, and which a background thread replaces ahead of its
+// expiration.  With a credential cache, each token is stored there, and an
+// unexpired one found there spares the initial exchange.
 class Google::Auth
 {
 public:
-    Auth(std::string s);
+    // Authorize for @p scope, a space-separated list of OAuth scopes.
+    Auth(
+            std::string s,
+            std::string scope,
+            std::shared_ptr<CredentialCache> cache = nullptr);
+    ~Auth();
+
     static std::unique_ptr<Auth> create(std::string s);
 
     http::Headers headers() const;
 
 private:
-    void maybeRefresh() const;
+    struct Snapshot
+    {
+        Snapshot(const http::Headers& headers, int64_t expiration)
+            : headers(headers)
+            , expiration(expiration)
+        { }
+
+        const http::Headers headers;
+        const int64_t expiration;   // Unix time.
+    };
+
+    // Exchange a signed JWT for a new token, and publish it.  Requires
+    // m_mutex.
+    std::shared_ptr<const Snapshot> refresh() const;
+
+    // Body of the background refresh thread.
+    void run();
+
     std::string sign(std::string data, std::string privateKey) const;
 
+    // Our tokens are cached by our key and scope.
+    std::string cacheKey() const;
+
+    Auth(const Auth&);
+    Auth& operator=(const Auth&);
+
     const std::string m_clientEmail;
     const std::string m_privateKey;
-    mutable int64_t m_expiration = 0;   // Unix time.
-    mutable http::Headers m_headers;
+    const std::string m_scope;
+    const std::shared_ptr<CredentialCache> m_cache;
+
+    mutable std::shared_ptr<const Snapshot> m_snapshot;
+    mutable std::unique_ptr<http::Pool> m_pool;
+    bool m_done = false;
 
     mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_refresher;
 };
 
 } // namespace drivers
@@ -1,6 +1,8 @@
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/arbiter.hpp>
+#include <arbiter/drivers/fs.hpp>
 #include <arbiter/drivers/http.hpp>
+#include <arbiter/util/executor.hpp>
 #endif
 
 #ifdef ARBITER_WINDOWS
@@ -9,8 +11,11 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
-#include <iostream>
+#include <limits>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
@@ -24,6 +29,201 @@ namespace drivers
 
 using namespace http;
 
+namespace
+{
+    const std::size_t defaultStreamChunkSize(8 * 1024 * 1024);
+    const std::size_t streamWindow(4);
+
+    // A request for only the first byte of a file, whose response gives the
+    // size of the file in its Content-Range.
+    Headers firstByte()
+    {
+        Headers headers;
+        headers["Range"] = "bytes=0-0";
+        return headers;
+    }
+
+    // True if a HEAD response which gave no size may be followed by a ranged
+    // GET, which is unless the file is missing.  Servers which reject HEADs
+    // answer them variously, like 403 for presigned URLs, or 405.
+    bool mayProbe(const Response& res)
+    {
+        return res.code() != 404 && res.code() != 410;
+    }
+
+    // The conditions under which a GET may answer that a file still has
+    // @p version, which is either an ETag or its Last-Modified time and
+    // Content-Length, each followed by a semicolon, as made by getVersion.
+    Headers conditionsOf(const std::string& version)
+    {
+        Headers headers;
+        if (version.empty()) return headers;
+
+        if (version.back() != ';')
+        {
+            headers["If-None-Match"] = version;
+            return headers;
+        }
+
+        const std::string first(version.substr(0, version.find(';')));
+        if (first.find_first_not_of("0123456789") != std::string::npos)
+        {
+            headers["If-Modified-Since"] = first;
+        }
+        return headers;
+    }
+
+    // The scheme and authority of @p url, by which servers are told apart.
+    std::string originOf(const std::string& url)
+    {
+        const std::size_t scheme(url.find("://"));
+        return url.substr(
+                0,
+                url.find('/', scheme == std::string::npos ? 0 : scheme + 3));
+    }
+
+    // A piece of a ranged response, starting at @p begin within the file.
+    struct RangePiece
+    {
+        std::size_t begin;
+        const char* data;
+        std::size_t size;
+    };
+
+    // Parse a Content-Range of "bytes <first>-<last>/<total>" into the
+    // [begin, end) which it covers, and into @p total unless that is `*`.
+    bool parseContentRange(
+            const std::string& range,
+            std::size_t& begin,
+            std::size_t& end,
+            std::size_t& total)
+    {
+        const std::string prefix("bytes ");
+        const std::size_t dash(range.find('-'));
+        const std::size_t slash(range.find('/'));
+        if (range.compare(0, prefix.size(), prefix) ||
+                dash == std::string::npos ||
+                slash == std::string::npos ||
+                slash < dash ||
+                !std::isdigit(range[prefix.size()]) ||
+                !std::isdigit(range[dash + 1]))
+        {
+            return false;
+        }
+
+        begin = std::strtoull(range.c_str() + prefix.size(), nullptr, 10);
+        end = std::strtoull(range.c_str() + dash + 1, nullptr, 10) + 1;
+        if (slash + 1 < range.size() && std::isdigit(range[slash + 1]))
+        {
+            total = std::strtoull(range.c_str() + slash + 1, nullptr, 10);
+        }
+        return begin < end;
+    }
+
+    // The boundary of a multipart/byteranges Content-Type, or an empty
+    // string if @p type is another.
+    std::string boundaryOf(const std::string& type)
+    {
+        std::string lower(type);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+        const std::string multipart("multipart/byteranges");
+        const std::string param("boundary=");
+        const std::size_t pos(lower.find(param));
+        if (lower.compare(0, multipart.size(), multipart) ||
+                pos == std::string::npos)
+        {
+            return std::string();
+        }
+
+        std::string boundary(
+                type.substr(
+                    pos + param.size(),
+                    type.find(';', pos) - pos - param.size()));
+        while (boundary.size() && std::isspace(boundary.back()))
+        {
+            boundary.pop_back();
+        }
+        if (boundary.size() > 1 &&
+                boundary.front() == '"' && boundary.back() == '"')
+        {
+            boundary = boundary.substr(1, boundary.size() - 2);
+        }
+        return boundary;
+    }
+
+    // Split the multipart @p body delimited by @p boundary into the pieces
+    // named by the Content-Range of each part.  Returns false if a part is
+    // malformed.
+    bool splitParts(
+            const std::vector<char>& body,
+            const std::string& boundary,
+            std::vector<RangePiece>& pieces,
+            std::size_t& total)
+    {
+        const std::string delimiter("--" + boundary);
+        const std::string blank("\r\n\r\n");
+        const char* const last(body.data() + body.size());
+
+        const char* pos(
+                std::search(
+                    body.data(), last, delimiter.begin(), delimiter.end()));
+
+        while (pos != last)
+        {
+            pos += delimiter.size();
+            if (last - pos >= 2 && pos[0] == '-' && pos[1] == '-') break;
+
+            const char* data(
+                    std::search(pos, last, blank.begin(), blank.end()));
+            if (data == last) return false;
+
+            // The headers of the part, each on a line of its own.
+            std::size_t begin(0);
+            std::size_t end(0);
+            bool found(false);
+            const std::string head(pos, data);
+            std::size_t line(0);
+            while (line < head.size())
+            {
+                std::size_t next(head.find("\r\n", line));
+                if (next == std::string::npos) next = head.size();
+
+                const std::string h(head.substr(line, next - line));
+                const std::size_t colon(h.find(':'));
+                std::string name(h.substr(0, colon));
+                std::transform(
+                        name.begin(),
+                        name.end(),
+                        name.begin(),
+                        ::tolower);
+
+                if (colon != std::string::npos && name == "content-range")
+                {
+                    const std::size_t value(
+                            h.find_first_not_of(" \t", colon + 1));
+                    found =
+                        value != std::string::npos &&
+                        parseContentRange(h.substr(value), begin, end, total);
+                }
+                line = next + 2;
+            }
+
+            data += blank.size();
+            if (!found || std::size_t(last - data) < end - begin) return false;
+
+            pieces.push_back(RangePiece { begin, data, end - begin });
+            pos = std::search(
+                    data + (end - begin),
+                    last,
+                    delimiter.begin(),
+                    delimiter.end());
+        }
+
+        return true;
+    }
+}
+
 Http::Http(Pool& pool)
     : m_pool(pool)
 {
@@ -37,12 +237,266 @@ std::unique_ptr<Http> Http::create(Pool& pool)
     return std::unique_ptr<Http>(new Http(pool));
 }
 
+Capabilities Http::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = true;
+    return c;
+}
+
 std::unique_ptr<std::size_t> Http::tryGetSize(std::string path) const
+{
+    auto http(m_pool.acquire(typedPath(path)));
+    const Response res(http.head(typedPath(path)));
+
+    std::unique_ptr<std::size_t> size(sizeOf(res));
+    if (!size && mayProbe(res))
+    {
+        size = sizeOf(http.get(typedPath(path), firstByte()));
+    }
+    return size;
+}
+
+Status Http::tryReadSize(const std::string path, std::size_t& size) const
+{
+    if (!plain()) return Driver::tryReadSize(path, size);
+
+    try
+    {
+        auto http(m_pool.acquire(typedPath(path)));
+        const Response res(http.head(typedPath(path)));
+
+        const Status status(sizeStatus(res, size));
+        if (status.ok() || !mayProbe(res)) return status;
+        return sizeStatus(http.get(typedPath(path), firstByte()), size);
+    }
+    catch (...)
+    {
+        return Status(Status::Code::Failed);
+    }
+}
+
+std::vector<char> Http::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    std::vector<char> data;
+    if (!length) return data;
+
+    Headers headers;
+    headers["Range"] =
+        "bytes=" + std::to_string(offset) + "-" +
+        std::to_string(offset + length - 1);
+
+    if (!get(path, data, headers, Query()))
+    {
+        // A range starting past the end is unsatisfiable, which we report
+        // as an empty read rather than an error.
+        const auto size(tryGetSize(path));
+        if (size && offset >= *size) return std::vector<char>();
+        throw ArbiterError("Could not read from " + path);
+    }
+
+    // A server which ignores the Range header will respond with the full
+    // object, from which we can take the range ourselves.
+    if (data.size() > length)
+    {
+        if (offset >= data.size()) return std::vector<char>();
+        const std::size_t end(
+                offset + (std::min)(length, data.size() - offset));
+        data = std::vector<char>(data.begin() + offset, data.begin() + end);
+    }
+
+    return data;
+}
+
+std::vector<std::vector<char>> Http::getRanges(
+        const std::string path,
+        const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+        const std::size_t gap,
+        Executor& executor) const
+{
+    std::vector<std::size_t> readOf;
+    const std::vector<std::pair<std::size_t, std::size_t>> reads(
+            mergeRanges(ranges, gap, readOf));
+
+    bool multi(plain() && m_pool.multiRange() && reads.size() > 1);
+    if (multi)
+    {
+        std::lock_guard<std::mutex> lock(m_rangeMutex);
+        multi = !m_singleRange.count(originOf(typedPath(path)));
+    }
+
+    std::vector<std::vector<char>> data;
+    if (multi && getMultiRange(path, reads, data))
+    {
+        return splitRanges(ranges, reads, readOf, data);
+    }
+    return Driver::getRanges(path, ranges, gap, executor);
+}
+
+bool Http::getMultiRange(
+        const std::string& path,
+        const std::vector<std::pair<std::size_t, std::size_t>>& reads,
+        std::vector<std::vector<char>>& data) const
+{
+    std::string range;
+    for (const auto& read : reads)
+    {
+        range += (range.empty() ? "bytes=" : ",") +
+            std::to_string(read.first) + "-" +
+            std::to_string(read.second - 1);
+    }
+
+    Headers headers;
+    headers["Range"] = range;
+
+    const std::string url(typedPath(path));
+    const Response res(m_pool.acquire(url).get(url, headers, Query()));
+
+    // Until a Content-Range says otherwise, the file may be of any size.
+    std::size_t total((std::numeric_limits<std::size_t>::max)());
+    std::vector<RangePiece> pieces;
+    bool supported(true);
+
+    if (res.code() == 200)
+    {
+        // The whole file, from which we can take the reads ourselves.
+        supported = false;
+        total = res.data().size();
+        pieces.push_back(RangePiece { 0, res.data().data(), total });
+    }
+    else if (res.code() == 206)
+    {
+        const auto type(res.headers().find("Content-Type"));
+        const std::string boundary(
+                type != res.headers().end() ?
+                    boundaryOf(type->second) : std::string());
+
+        const auto single(res.headers().find("Content-Range"));
+        std::size_t begin(0);
+        std::size_t end(0);
+
+        if (boundary.size())
+        {
+            splitParts(res.data(), boundary, pieces, total);
+        }
+        else if (single != res.headers().end() &&
+                parseContentRange(single->second, begin, end, total) &&
+                end - begin == res.data().size())
+        {
+            // A single range, as from servers which coalesce those asked
+            // for, or which serve only the first.
+            pieces.push_back(
+                    RangePiece { begin, res.data().data(), end - begin });
+        }
+    }
+    else return false;
+
+    // Reads past the end of the file are empty, as by getRange.
+    std::vector<std::vector<char>> result(reads.size());
+    bool complete(true);
+    for (std::size_t i(0); i < reads.size() && complete; ++i)
+    {
+        const std::size_t begin(reads[i].first);
+        const std::size_t end((std::min)(reads[i].second, total));
+        if (begin >= end) continue;
+
+        const auto piece(
+                std::find_if(
+                    pieces.begin(),
+                    pieces.end(),
+                    [begin, end](const RangePiece& p)
+                    {
+                        return p.begin <= begin && end <= p.begin + p.size;
+                    }));
+
+        if (piece == pieces.end()) complete = false;
+        else result[i].assign(
+                piece->data + (begin - piece->begin),
+                piece->data + (end - piece->begin));
+    }
+
+    if (!supported || !complete)
+    {
+        std::lock_guard<std::mutex> lock(m_rangeMutex);
+        m_singleRange.insert(originOf(url));
+    }
+
+    if (complete) data = std::move(result);
+    return complete;
+}
+
+std::unique_ptr<std::string> Http::tryGetVersion(std::string path) const
+{
+    auto http(m_pool.acquire(typedPath(path)));
+    return getVersion(http.head(typedPath(path)));
+}
+
+ChangedData Http::tryGetChanged(
+        const std::string path,
+        const std::string& version) const
+{
+    if (!plain()) return Driver::tryGetChanged(path, version);
+
+    auto http(m_pool.acquire(typedPath(path)));
+    Response res(http.get(typedPath(path), conditionsOf(version), Query()));
+
+    ChangedData result;
+    if (res.code() == 304)
+    {
+        result.exists = true;
+        result.version = version;
+    }
+    else if (res.ok())
+    {
+        result.exists = true;
+        result.changed = true;
+        result.version = *getVersion(res);
+        result.data = res.releaseData();
+    }
+
+    return result;
+}
+
+std::unique_ptr<std::string> Http::getVersion(const Response& res)
+{
+    std::unique_ptr<std::string> version;
+    if (!res.ok()) return version;
+
+    const Headers& headers(res.headers());
+    if (headers.count("ETag"))
+    {
+        return makeUnique<std::string>(headers.at("ETag"));
+    }
+
+    version.reset(new std::string());
+    for (const std::string key : { "Last-Modified", "Content-Length" })
+    {
+        if (headers.count(key)) *version += headers.at(key) + ";";
+    }
+    return version;
+}
+
+std::unique_ptr<std::size_t> Http::sizeOf(const Response& res)
 {
     std::unique_ptr<std::size_t> size;
 
-    auto http(m_pool.acquire());
-    Response res(http.head(typedPath(path)));
+    // Ranged responses, including those refused since the file is empty,
+    // end their Content-Range with the size of the whole file, or with `*`
+    // if it is unknown.
+    if ((res.code() == 206 || res.code() == 416) &&
+            res.headers().count("Content-Range"))
+    {
+        const std::string& range(res.headers().at("Content-Range"));
+        const std::string total(range.substr(range.rfind('/') + 1));
+        if (total.size() && std::isdigit(total.front()))
+        {
+            size.reset(new std::size_t(std::stoull(total)));
+        }
+        return size;
+    }
 
     if (res.ok() && res.headers().count("Content-Length"))
     {
@@ -53,30 +507,168 @@ std::unique_ptr<std::size_t> Http::tryGetSize(std::string path) const
     return size;
 }
 
+Status Http::sizeStatus(const Response& res, std::size_t& size)
+{
+    if (const auto found = sizeOf(res))
+    {
+        size = *found;
+        return Status(Status::Code::Ok, res.code());
+    }
+
+    // A successful response which gave no size is no answer.
+    Status status(Status::fromHttp(res.code()));
+    if (status.ok()) status.code = Status::Code::Failed;
+    return status;
+}
+
+std::vector<std::unique_ptr<std::size_t>> Http::tryGetSizes(
+        const std::vector<std::string>& paths) const
+{
+    if (capabilities().listingMetadata)
+    {
+        return tryGetSizesListed(paths, m_pool.size(), m_pool.executor());
+    }
+
+    std::vector<std::unique_ptr<std::size_t>> sizes(paths.size());
+    parallelFor(paths.size(), m_pool.size(), [&](const std::size_t i)
+    {
+        sizes[i] = tryGetSize(paths[i]);
+    }, m_pool.executor());
+    return sizes;
+}
+
+void Http::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    const std::size_t chunkSize(
+            m_pool.chunkSize() ? m_pool.chunkSize() : defaultStreamChunkSize);
+
+    auto whole([&]()
+    {
+        if (!get(path, sink, Headers(), Query()))
+        {
+            throw ArbiterError("Could not read from " + path);
+        }
+    });
+
+    const auto size(tryGetSize(path));
+    if (!size || *size <= chunkSize) return whole();
+
+    const std::size_t chunks((*size + chunkSize - 1) / chunkSize);
+    const std::size_t window((std::min)(streamWindow, m_pool.size()));
+
+    for (std::size_t first(0); first < chunks; first += window)
+    {
+        const std::size_t n((std::min)(window, chunks - first));
+        std::vector<std::vector<char>> buffers(n);
+        std::atomic<bool> good(true);
+
+        parallelFor(n, n, [&](const std::size_t i)
+        {
+            const std::size_t begin((first + i) * chunkSize);
+            const std::size_t end((std::min)(begin + chunkSize, *size));
+
+            Headers headers;
+            headers["Range"] =
+                "bytes=" + std::to_string(begin) + "-" +
+                std::to_string(end - 1);
+
+            if (!get(path, buffers[i], headers, Query()) ||
+                    buffers[i].size() != end - begin)
+            {
+                good = false;
+            }
+        }, m_pool.executor());
+
+        if (!good)
+        {
+            // If ranges aren't supported, we find out before passing along
+            // any data and can fall back to a single read.
+            if (!first) return whole();
+            throw ArbiterError("Could not read from " + path);
+        }
+
+        for (const auto& b : buffers) sink(b.data(), b.size());
+    }
+}
+
+void Http::getFile(const std::string path, const std::string localPath) const
+{
+    const std::size_t chunkSize(
+            m_pool.chunkSize() ? m_pool.chunkSize() : defaultStreamChunkSize);
+
+    const auto size(tryGetSize(path));
+    if (!size || *size <= chunkSize) return Driver::getFile(path, localPath);
+
+    const std::size_t chunks((*size + chunkSize - 1) / chunkSize);
+    std::unique_ptr<WritableFile> file(new WritableFile(localPath, *size));
+
+    auto fetch([&](const std::size_t i)
+    {
+        const std::size_t begin(i * chunkSize);
+        const std::size_t end((std::min)(begin + chunkSize, *size));
+
+        Headers headers;
+        headers["Range"] =
+            "bytes=" + std::to_string(begin) + "-" + std::to_string(end - 1);
+
+        std::vector<char> data;
+        if (!get(path, data, headers, Query()) ||
+                data.size() != end - begin)
+        {
+            return false;
+        }
+
+        file->write(begin, data.data(), data.size());
+        return true;
+    });
+
+    // If ranges aren't supported, we find out from the first alone, rather
+    // than from every request in flight fetching the whole file.
+    if (!fetch(0))
+    {
+        file.reset();
+        return Driver::getFile(path, localPath);
+    }
+
+    std::atomic<bool> good(true);
+    parallelFor(chunks - 1, m_pool.size(), [&](const std::size_t i)
+    {
+        if (good && !fetch(i + 1)) good = false;
+    }, m_pool.executor());
+
+    if (!good) throw ArbiterError("Could not read from " + path);
+    file->close();
+}
+
 std::string Http::get(
-        std::string path,
-        Headers headers,
-        Query query) const
+        const std::string& path,
+        const Headers& headers,
+        const Query& query) const
 {
-    const auto data(getBinary(path, headers, query));
-    return std::string(data.begin(), data.end());
+    std::string data;
+    if (!getText(path, data, headers, query))
+    {
+        throw ArbiterError("Could not read from " + path);
+    }
+    return data;
 }
 
 std::unique_ptr<std::string> Http::tryGet(
-        std::string path,
-        Headers headers,
-        Query query) const
+        const std::string& path,
+        const Headers& headers,
+        const Query& query) const
 {
-    std::unique_ptr<std::string> result;
-    auto data(tryGetBinary(path, headers, query));
-    if (data) result.reset(new std::string(data->begin(), data->end()));
-    return result;
+    std::unique_ptr<std::string> data(new std::string());
+    if (!getText(path, *data, headers, query)) data.reset();
+    return data;
 }
 
 std::vector<char> Http::getBinary(
-        std::string path,
-        Headers headers,
-        Query query) const
+        const std::string& path,
+        const Headers& headers,
+        const Query& query) const
 {
     std::vector<char> data;
     if (!get(path, data, headers, query))
@@ -86,52 +678,344 @@ std::vector<char> Http::getBinary(
     return data;
 }
 
+void Http::getStream(
+        const std::string& path,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const Headers& headers,
+        const Query& query) const
+{
+    if (!get(path, sink, headers, query))
+    {
+        throw ArbiterError("Could not read from " + path);
+    }
+}
+
+void Http::putFrom(
+        const std::string path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size) const
+{
+    if (!plain()) return Driver::putFrom(path, source, size);
+
+    if (!internalPut(path, source, size).ok())
+    {
+        throw ArbiterError("Couldn't HTTP PUT to " + path);
+    }
+}
+
+std::size_t Http::getInto(
+        const std::string path,
+        char* const data,
+        const std::size_t size) const
+{
+    return getInto(path, data, size, Headers(), Query());
+}
+
+std::size_t Http::getInto(
+        const std::string& path,
+        char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query) const
+{
+    std::size_t written(0);
+    getStream(path, bufferSink(path, data, size, written), headers, query);
+    return written;
+}
+
 std::unique_ptr<std::vector<char>> Http::tryGetBinary(
-        std::string path,
-        Headers headers,
-        Query query) const
+        const std::string& path,
+        const Headers& headers,
+        const Query& query) const
 {
     std::unique_ptr<std::vector<char>> data(new std::vector<char>());
     if (!get(path, *data, headers, query)) data.reset();
     return data;
 }
 
+Status Http::tryRead(
+        const std::string& path,
+        std::vector<char>& data,
+        const Headers& headers,
+        const Query& query) const
+{
+    try
+    {
+        data.clear();
+        return getStatus(path, data, headers, query);
+    }
+    catch (...)
+    {
+        return Status(Status::Code::Failed);
+    }
+}
+
+void Http::remove(const std::string path) const
+{
+    const Response res(internalDelete(path));
+    if (!res.ok() && res.code() != 404)
+    {
+        throw ArbiterError("Couldn't HTTP DELETE " + path);
+    }
+}
+
+void Http::getBinaryThen(
+        const std::string path,
+        const Completion<std::vector<char>> done,
+        Executor& executor) const
+{
+    if (!plain() || m_pool.chunkSize())
+    {
+        return Driver::getBinaryThen(path, done, executor);
+    }
+
+    internalGetAsync(path, Headers(), Query(), 0, [path, done](
+                std::future<Response> f)
+    {
+        complete(done, [&]()->std::vector<char>
+        {
+            Response res(f.get());
+            if (!res.ok()) throw ArbiterError("Could not read file " + path);
+            return res.releaseData();
+        });
+    });
+}
+
+void Http::putThen(
+        const std::string path,
+        std::vector<char> data,
+        const Completion<void> done,
+        Executor& executor) const
+{
+    if (!plain())
+    {
+        return Driver::putThen(path, std::move(data), done, executor);
+    }
+
+    internalPutAsync(path, std::move(data), Headers(), Query(), [path, done](
+                std::future<Response> f)
+    {
+        complete(done, [&]()
+        {
+            if (!f.get().ok())
+            {
+                throw ArbiterError("Couldn't HTTP PUT to " + path);
+            }
+        });
+    });
+}
+
+void Http::tryGetSizeThen(
+        const std::string path,
+        const Completion<std::unique_ptr<std::size_t>> done,
+        Executor& executor) const
+{
+    if (!plain()) return Driver::tryGetSizeThen(path, done, executor);
+
+    internalHeadAsync(path, Headers(), Query(), [this, path, done](
+                std::future<Response> f)
+    {
+        std::unique_ptr<std::size_t> size;
+        bool probe(false);
+
+        try
+        {
+            const Response res(f.get());
+            size = sizeOf(res);
+            probe = !size && mayProbe(res);
+        }
+        catch (...)
+        {
+            const std::exception_ptr error(std::current_exception());
+            return complete(done, [error]() -> std::unique_ptr<std::size_t>
+            {
+                std::rethrow_exception(error);
+            });
+        }
+
+        if (!probe) return complete(done, [&]() { return std::move(size); });
+
+        internalGetAsync(path, firstByte(), Query(), 0, [done](
+                    std::future<Response> f)
+        {
+            complete(done, [&]() { return sizeOf(f.get()); });
+        });
+    });
+}
+
+void Http::put(
+        const std::string path,
+        const char* const data,
+        const std::size_t size) const
+{
+    if (!plain()) return Driver::put(path, data, size);
+
+    if (!internalPut(path, data, size).ok())
+    {
+        throw ArbiterError("Couldn't HTTP PUT to " + path);
+    }
+}
+
 void Http::put(
-        std::string path,
+        const std::string& path,
         const std::string& data,
-        const Headers headers,
-        const Query query) const
+        const Headers& headers,
+        const Query& query) const
 {
-    put(path, std::vector<char>(data.begin(), data.end()), headers, query);
+    // Drivers built upon this one override the put which takes a vector.
+    if (!plain())
+    {
+        return put(
+                path,
+                std::vector<char>(data.begin(), data.end()),
+                headers,
+                query);
+    }
+
+    if (!internalPut(path, data.data(), data.size(), headers, query).ok())
+    {
+        throw ArbiterError("Couldn't HTTP PUT to " + path);
+    }
 }
 
 bool Http::get(
-        std::string path,
+        const std::string& path,
         std::vector<char>& data,
-        const Headers headers,
-        const Query query) const
+        const Headers& headers,
+        const Query& query) const
 {
-    bool good(false);
+    return fetch(path, data, headers, query).ok();
+}
 
-    auto http(m_pool.acquire());
+Status Http::getStatus(
+        const std::string& path,
+        std::vector<char>& data,
+        const Headers& headers,
+        const Query& query) const
+{
+    if (!plain())
+    {
+        return get(path, data, headers, query) ?
+            Status() : Status(Status::Code::NotFound);
+    }
+    return fetch(path, data, headers, query);
+}
+
+Status Http::fetch(
+        const std::string& path,
+        std::vector<char>& data,
+        const Headers& headers,
+        const Query& query) const
+{
+    if (m_pool.chunkSize() && !headers.count("Range"))
+    {
+        const auto size(Http::tryGetSize(path));
+        if (size && shouldGetRanged(*size, headers) &&
+                getRanged(path, data, headers, query, *size))
+        {
+            return Status(Status::Code::Ok, 206);
+        }
+    }
+
+    auto http(m_pool.acquire(typedPath(path)));
     Response res(http.get(typedPath(path), headers, query));
 
-    if (res.ok())
+    if (res.ok()) data = res.releaseData();
+    return Status::fromHttp(res.code());
+}
+
+bool Http::get(
+        const std::string& path,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const Headers& headers,
+        const Query& query) const
+{
+    return internalGet(path, sink, headers, query).ok();
+}
+
+bool Http::getText(
+        const std::string& path,
+        std::string& data,
+        const Headers& headers,
+        const Query& query) const
+{
+    if (m_pool.chunkSize() && !headers.count("Range"))
     {
-        data = res.data();
-        good = true;
+        std::vector<char> binary;
+        if (!get(path, binary, headers, query)) return false;
+        data.assign(binary.begin(), binary.end());
+        return true;
     }
 
+    std::string result;
+    auto sink([&result](const char* d, std::size_t n) { result.append(d, n); });
+    if (!get(path, sink, headers, query)) return false;
+
+    data.swap(result);
+    return true;
+}
+
+bool Http::shouldGetRanged(
+        const std::size_t size,
+        const Headers& headers) const
+{
+    return
+        m_pool.chunkSize() &&
+        size > m_pool.chunkSize() &&
+        !headers.count("Range");
+}
+
+bool Http::getRanged(
+        const std::string& path,
+        std::vector<char>& data,
+        const Headers& headers,
+        const Query& query,
+        const std::size_t size) const
+{
+    const std::size_t chunkSize(m_pool.chunkSize());
+    const std::size_t chunks((size + chunkSize - 1) / chunkSize);
+
+    std::vector<char> result(size);
+    std::atomic<bool> good(true);
+
+    // Each range holds a pool handle only while it is being fetched, so
+    // more threads than handles would only wait.
+    parallelFor(chunks, m_pool.size(), [&](const std::size_t i)
+    {
+        if (!good) return;
+
+        const std::size_t begin(i * chunkSize);
+        const std::size_t end((std::min)(begin + chunkSize, size));
+
+        Headers rangeHeaders(headers);
+        rangeHeaders["Range"] =
+            "bytes=" + std::to_string(begin) + "-" + std::to_string(end - 1);
+
+        // A server which ignores the Range header will respond with the
+        // full object, which we treat as a failure of this read mode.
+        std::vector<char> chunk;
+        if (get(path, chunk, rangeHeaders, query) &&
+                chunk.size() == end - begin)
+        {
+            std::copy(chunk.begin(), chunk.end(), result.begin() + begin);
+        }
+        else good = false;
+
+        // Our ranges are alike in size, so their buffers are ideal for reuse.
+        if (auto buffers = m_pool.buffers()) buffers->release(std::move(chunk));
+    }, m_pool.executor());
+
+    if (good) data.swap(result);
     return good;
 }
 
 void Http::put(
-        const std::string path,
+        const std::string& path,
         const std::vector<char>& data,
-        const Headers headers,
-        const Query query) const
+        const Headers& headers,
+        const Query& query) const
 {
-    auto http(m_pool.acquire());
+    auto http(m_pool.acquire(typedPath(path)));
 
     if (!http.put(typedPath(path), data, headers, query).ok())
     {
@@ -140,67 +1024,229 @@ void Http::put(
 }
 
 void Http::post(
-        const std::string path,
+        const std::string& path,
         const std::string& data,
-        const Headers h,
-        const Query q) const
+        const Headers& h,
+        const Query& q) const
 {
-    return post(path, std::vector<char>(data.begin(), data.end()), h, q);
+    post(path, data.data(), data.size(), h, q);
 }
 
 void Http::post(
-        const std::string path,
+        const std::string& path,
         const std::vector<char>& data,
-        const Headers headers,
-        const Query query) const
+        const Headers& h,
+        const Query& q) const
+{
+    post(path, data.data(), data.size(), h, q);
+}
+
+void Http::post(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query) const
 {
-    auto http(m_pool.acquire());
-    auto res(http.post(typedPath(path), data, headers, query));
+    auto http(m_pool.acquire(typedPath(path)));
+    auto res(http.post(typedPath(path), data, size, headers, query));
 
     if (!res.ok())
     {
-        std::cout << res.str() << std::endl;
+        logging::error(res.str());
         throw ArbiterError("Couldn't HTTP POST to " + path);
     }
 }
 
 Response Http::internalGet(
-        const std::string path,
-        const Headers headers,
-        const Query query,
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
         const std::size_t reserve) const
 {
-    return m_pool.acquire().get(typedPath(path), headers, query, reserve);
+    const std::string url(typedPath(path));
+    return m_pool.acquire(url).get(url, headers, query, reserve);
+}
+
+Response Http::internalGet(
+        const std::string& path,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const Headers& headers,
+        const Query& query) const
+{
+    const std::string url(typedPath(path));
+    return m_pool.acquire(url).get(url, sink, headers, query);
 }
 
 Response Http::internalPut(
-        const std::string path,
+        const std::string& path,
         const std::vector<char>& data,
-        const Headers headers,
-        const Query query) const
+        const Headers& headers,
+        const Query& query) const
 {
-    return m_pool.acquire().put(typedPath(path), data, headers, query);
+    return internalPut(path, data.data(), data.size(), headers, query);
+}
+
+Response Http::internalPut(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query) const
+{
+    const std::string url(typedPath(path));
+    return m_pool.acquire(url).put(url, data, size, headers, query);
+}
+
+Response Http::internalPut(
+        const std::string& path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query) const
+{
+    const std::string url(typedPath(path));
+    return m_pool.acquire(url).put(url, source, size, headers, query);
 }
 
 Response Http::internalHead(
-        const std::string path,
-        const Headers headers,
-        const Query query) const
+        const std::string& path,
+        const Headers& headers,
+        const Query& query) const
 {
-    return m_pool.acquire().head(typedPath(path), headers, query);
+    const std::string url(typedPath(path));
+    return m_pool.acquire(url).head(url, headers, query);
+}
+
+Response Http::internalDelete(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query) const
+{
+    const std::string url(typedPath(path));
+    return m_pool.acquire(url).del(url, headers, query);
 }
 
 Response Http::internalPost(
-        const std::string path,
+        const std::string& path,
         const std::vector<char>& data,
         Headers headers,
-        const Query query) const
+        const Query& query) const
+{
+    return internalPost(path, data.data(), data.size(), headers, query);
+}
+
+Response Http::internalPost(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        Headers headers,
+        const Query& query) const
+{
+    if (!headers.count("Content-Length"))
+    {
+        headers["Content-Length"] = std::to_string(size);
+    }
+    const std::string url(typedPath(path));
+    return m_pool.acquire(url).post(url, data, size, headers, query);
+}
+
+Response Http::internalPost(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const std::function<void(const char*, std::size_t)>& sink,
+        Headers headers,
+        const Query& query) const
+{
+    if (!headers.count("Content-Length"))
+    {
+        headers["Content-Length"] = std::to_string(size);
+    }
+    const std::string url(typedPath(path));
+    return m_pool.acquire(url).post(url, data, size, sink, headers, query);
+}
+
+std::future<Response> Http::internalGetAsync(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const std::size_t reserve) const
+{
+    return m_pool.getAsync(typedPath(path), headers, query, reserve);
+}
+
+std::future<Response> Http::internalPutAsync(
+        const std::string& path,
+        std::vector<char> data,
+        const Headers& headers,
+        const Query& query) const
+{
+    return m_pool.putAsync(typedPath(path), std::move(data), headers, query);
+}
+
+std::future<Response> Http::internalHeadAsync(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query) const
+{
+    return m_pool.headAsync(typedPath(path), headers, query);
+}
+
+std::future<Response> Http::internalPostAsync(
+        const std::string& path,
+        std::vector<char> data,
+        Headers headers,
+        const Query& query) const
+{
+    if (!headers.count("Content-Length"))
+    {
+        headers["Content-Length"] = std::to_string(data.size());
+    }
+    return m_pool.postAsync(typedPath(path), std::move(data), headers, query);
+}
+
+void Http::internalGetAsync(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const std::size_t reserve,
+        const Completion<Response> done) const
+{
+    m_pool.getAsync(typedPath(path), headers, query, reserve, done);
+}
+
+void Http::internalPutAsync(
+        const std::string& path,
+        std::vector<char> data,
+        const Headers& headers,
+        const Query& query,
+        const Completion<Response> done) const
+{
+    m_pool.putAsync(typedPath(path), std::move(data), headers, query, done);
+}
+
+void Http::internalHeadAsync(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const Completion<Response> done) const
+{
+    m_pool.headAsync(typedPath(path), headers, query, done);
+}
+
+void Http::internalPostAsync(
+        const std::string& path,
+        std::vector<char> data,
+        Headers headers,
+        const Query& query,
+        const Completion<Response> done) const
 {
     if (!headers.count("Content-Length"))
     {
         headers["Content-Length"] = std::to_string(data.size());
     }
-    return m_pool.acquire().post(typedPath(path), data, headers, query);
+    m_pool.postAsync(typedPath(path), std::move(data), headers, query, done);
 }
 
 std::string Http::typedPath(const std::string& p) const
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <future>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/driver.hpp>
@@ -35,12 +39,58 @@ public:
     // Inherited from Driver.
     virtual std::string type() const override { return "http"; }
 
+    /** Ranged reads alone, by the `Range` header. */
+    virtual Capabilities capabilities() const override;
+
     /** By default, performs a HEAD request and returns the contents of the
-     * Content-Length header.
+     * Content-Length header.  If the HEAD is refused, other than because
+     * the file is missing, or gives no Content-Length, the size is taken
+     * from the Content-Range of a GET of its first byte.
      */
     virtual std::unique_ptr<std::size_t> tryGetSize(
             std::string path) const override;
 
+    /** Performs a HEAD request and returns the ETag header, or failing that
+     * the Last-Modified and Content-Length headers.
+     */
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    /** Performs a single GET, conditional on the ETag or Last-Modified time
+     * within @p version, to which a 304 response means the file is
+     * unchanged.  Drivers built upon this one use Driver::tryGetChanged.
+     */
+    virtual ChangedData tryGetChanged(
+            std::string path,
+            const std::string& version) const override;
+
+    /** Reads as by getBinary, reporting the code of the response which
+     * decided the read.  Drivers built upon this one report it if they
+     * override the protected getStatus.
+     */
+    virtual Status tryRead(
+            std::string path,
+            std::vector<char>& data) const override
+    {
+        return tryRead(path, data, http::Headers(), http::Query());
+    }
+
+    /** Looks up the size as by tryGetSize, reporting the code of the
+     * response which decided it.  Drivers built upon this one use
+     * Driver::tryReadSize.
+     */
+    virtual Status tryReadSize(
+            std::string path,
+            std::size_t& size) const override;
+
+    /** Looks up the paths concurrently with tryGetSize, up to the size of
+     * the pool at a time.  Derived drivers whose listings report sizes list
+     * the directories holding many of them instead, as by
+     * tryGetSizesListed.
+     */
+    virtual std::vector<std::unique_ptr<std::size_t>> tryGetSizes(
+            const std::vector<std::string>& paths) const override;
+
     virtual void put(
             std::string path,
             const std::vector<char>& data) const final override
@@ -48,6 +98,95 @@ public:
         put(path, data, http::Headers(), http::Query());
     }
 
+    /** Sends from the caller's buffer, unless this is a driver built upon
+     * this one, for which the data is copied for put.
+     */
+    virtual void put(
+            std::string path,
+            const char* data,
+            std::size_t size) const override;
+
+    /** Large files are read as a sequence of ranged GETs, a few of which are
+     * in flight at a time, so memory use is bounded by a small multiple of
+     * the pool's chunk size (or a default of 8 MiB if that is unset).  Other
+     * files are streamed by a single GET as their data arrives.
+     */
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    /** Plain HTTP and HTTPS upload by a single streamed PUT.  A PUT to the
+     * raw path would skip the addressing and authorization of the drivers
+     * built upon them, so unless they override, they upload as by
+     * Driver::putFrom.
+     */
+    virtual void putFrom(
+            std::string path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size) const override;
+
+    /** Reads by a single streamed GET, without first checking the size. */
+    virtual std::size_t getInto(
+            std::string path,
+            char* data,
+            std::size_t size) const override;
+
+    /** Reads by a single GET with a Range header. */
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    /** With the `http.multiRange` configuration, the merged reads of plain
+     * HTTP and HTTPS are requested by a single GET naming all of them, whose
+     * multipart/byteranges response is split into its parts.  Servers which
+     * answer with the whole file, or without some of the reads, are noted,
+     * and their later reads fall back to Driver::getRanges, as do those of
+     * the drivers built upon this one.
+     */
+    virtual std::vector<std::vector<char>> getRanges(
+            std::string path,
+            const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+            std::size_t gap,
+            Executor& executor) const override;
+
+    /** Large files are fetched as ranged GETs, up to the size of the pool
+     * at a time, each written to its place in the file as it arrives, so
+     * memory use is bounded by a chunk per request in flight.  Chunks are
+     * sized as for getStream.
+     */
+    virtual void getFile(
+            std::string path,
+            std::string localPath) const override;
+
+    /** Performs a DELETE request, where a 404 response is not an error. */
+    virtual void remove(std::string path) const override;
+
+    /** Driven by the transfer engine of our http::Pool, unless ranged GETs
+     * are configured, or for drivers built upon this one, which fall back
+     * to Driver::getBinaryThen.
+     */
+    virtual void getBinaryThen(
+            std::string path,
+            Completion<std::vector<char>> done,
+            Executor& executor) const override;
+
+    /** Driven by the transfer engine, as for getBinaryThen. */
+    virtual void putThen(
+            std::string path,
+            std::vector<char> data,
+            Completion<void> done,
+            Executor& executor) const override;
+
+    /** Driven by the transfer engine, as for getBinaryThen, and falling
+     * back to a ranged GET as for tryGetSize.
+     */
+    virtual void tryGetSizeThen(
+            std::string path,
+            Completion<std::unique_ptr<std::size_t>> done,
+            Executor& executor) const override;
+
     /* HTTP-specific driver methods follow.  Since many drivers (S3, Dropbox,
      * etc.) are built atop HTTP, we'll provide HTTP-specific methods for
      * derived classes to use in addition to the generic PUT/GET combinations.
@@ -58,34 +197,61 @@ public:
 
     /** Perform an HTTP GET request. */
     std::string get(
-            std::string path,
-            http::Headers headers = http::Headers(),
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
 
     /** Perform an HTTP GET request. */
     std::unique_ptr<std::string> tryGet(
-            std::string path,
-            http::Headers headers = http::Headers(),
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
 
     /** Perform an HTTP GET request. */
     std::vector<char> getBinary(
-            std::string path,
-            http::Headers headers,
-            http::Query query) const;
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query) const;
 
     /** Perform an HTTP GET request. */
     std::unique_ptr<std::vector<char>> tryGetBinary(
-            std::string path,
-            http::Headers headers,
-            http::Query query) const;
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    /** Perform an HTTP GET request without throwing.  See Driver::tryRead.
+     */
+    Status tryRead(
+            const std::string& path,
+            std::vector<char>& data,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    /** Perform an HTTP GET request, passing the response body to @p sink as
+     * it arrives.
+     */
+    void getStream(
+            const std::string& path,
+            const std::function<void(const char*, std::size_t)>& sink,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
+
+    /** Perform an HTTP GET request into the caller's buffer.  See
+     * Driver::getInto.
+     */
+    std::size_t getInto(
+            const std::string& path,
+            char* data,
+            std::size_t size,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     /** Perform an HTTP PUT request. */
     void put(
-            std::string path,
+            const std::string& path,
             const std::string& data,
-            http::Headers headers,
-            http::Query query) const;
+            const http::Headers& headers,
+            const http::Query& query) const;
 
     /** HTTP-derived Drivers should override this version of PUT to allow for
      * custom headers and query parameters.
@@ -93,57 +259,223 @@ public:
 
     /** Perform an HTTP PUT request. */
     virtual void put(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers,
-            http::Query query) const;
+            const http::Headers& headers,
+            const http::Query& query) const;
 
     void post(
-            std::string path,
+            const std::string& path,
             const std::string& data,
-            http::Headers headers,
-            http::Query query) const;
+            const http::Headers& headers,
+            const http::Query& query) const;
     void post(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers,
-            http::Query query) const;
+            const http::Headers& headers,
+            const http::Query& query) const;
+    void post(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const http::Headers& headers,
+            const http::Query& query) const;
 
     /* These operations are other HTTP-specific calls that derived drivers may
      * need for their underlying API use.
      */
     http::Response internalGet(
-            std::string path,
-            http::Headers headers = http::Headers(),
-            http::Query query = http::Query(),
+            const std::string& path,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query(),
             std::size_t reserve = 0) const;
 
+    /** Stream the body of a successful GET to @p sink as it arrives.  The
+     * returned Response holds the body only if the request failed.
+     */
+    http::Response internalGet(
+            const std::string& path,
+            const std::function<void(const char*, std::size_t)>& sink,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
     http::Response internalPut(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers = http::Headers(),
-            http::Query query = http::Query()) const;
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
+    /** Upload the @p size bytes at @p data without copying them. */
+    http::Response internalPut(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
+    /** Upload @p size bytes pulled from @p source.  See Driver::putFrom. */
+    http::Response internalPut(
+            const std::string& path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
 
     http::Response internalHead(
-            std::string path,
-            http::Headers headers = http::Headers(),
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
+    http::Response internalDelete(
+            const std::string& path,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
 
     http::Response internalPost(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
             http::Headers headers = http::Headers(),
-            http::Query query = http::Query()) const;
+            const http::Query& query = http::Query()) const;
+
+    http::Response internalPost(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            http::Headers headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
+    /** Stream the body of a successful POST to @p sink as it arrives.  The
+     * returned Response holds the body only if the request failed.
+     */
+    http::Response internalPost(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const std::function<void(const char*, std::size_t)>& sink,
+            http::Headers headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
+    /* Asynchronous counterparts of the internal operations above.  These
+     * are driven by the transfer engine of our http::Pool, so many requests
+     * may be in flight without occupying a thread each.
+     */
+    std::future<http::Response> internalGetAsync(
+            const std::string& path,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query(),
+            std::size_t reserve = 0) const;
+
+    std::future<http::Response> internalPutAsync(
+            const std::string& path,
+            std::vector<char> data,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
+    std::future<http::Response> internalHeadAsync(
+            const std::string& path,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
+    std::future<http::Response> internalPostAsync(
+            const std::string& path,
+            std::vector<char> data,
+            http::Headers headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
+
+    /* As above, but passing the response to @p done.  See http::Pool. */
+    void internalGetAsync(
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query,
+            std::size_t reserve,
+            Completion<http::Response> done) const;
+
+    void internalPutAsync(
+            const std::string& path,
+            std::vector<char> data,
+            const http::Headers& headers,
+            const http::Query& query,
+            Completion<http::Response> done) const;
+
+    void internalHeadAsync(
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query,
+            Completion<http::Response> done) const;
+
+    void internalPostAsync(
+            const std::string& path,
+            std::vector<char> data,
+            http::Headers headers,
+            const http::Query& query,
+            Completion<http::Response> done) const;
 
 protected:
     /** HTTP-derived Drivers should override this version of GET to allow for
      * custom headers and query parameters.
      */
     virtual bool get(
-            std::string path,
+            const std::string& path,
             std::vector<char>& data,
-            http::Headers headers,
-            http::Query query) const;
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    /** As above, but reporting the outcome by the code of the response
+     * which decided it, and throwing only for failures which precede a
+     * response.  The default calls the GET above for drivers built upon
+     * this one, which should override if they can tell why a read failed.
+     */
+    virtual Status getStatus(
+            const std::string& path,
+            std::vector<char>& data,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    /** As above, but passing the response body to @p sink as it arrives
+     * rather than collecting it.  Drivers which can't stream should
+     * override this to read in full and pass the result along in one piece.
+     * Returns false if the request failed, in which case nothing has been
+     * passed to @p sink.
+     */
+    virtual bool get(
+            const std::string& path,
+            const std::function<void(const char*, std::size_t)>& sink,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    /** The version, see Driver::tryGetVersion, described by the headers of
+     * a successful HEAD or GET response, or null if it was unsuccessful.
+     */
+    static std::unique_ptr<std::string> getVersion(const http::Response& res);
+
+    /** The size given by the Content-Length header of a successful response,
+     * or for a ranged response, by its Content-Range, or null if it was
+     * unsuccessful or gave no size.
+     */
+    static std::unique_ptr<std::size_t> sizeOf(const http::Response& res);
+
+    /** The outcome of a lookup of a size by @p res, as sizeOf, storing the
+     * size in @p size if it was found.
+     */
+    static Status sizeStatus(const http::Response& res, std::size_t& size);
+
+    /** True if a GET of @p size bytes with these @p headers should be split
+     * into concurrent ranged requests by getRanged.
+     */
+    bool shouldGetRanged(std::size_t size, const http::Headers& headers) const;
+
+    /** Fetch an object of known @p size as concurrent ranged GETs, each of
+     * the pool's chunk size, assembled in order into @p data.  Each range is
+     * requested via the virtual GET above with a Range header added, so
+     * derived drivers need only handle that header.  Returns false if any
+     * range could not be read in full, in which case @p data is unchanged.
+     */
+    bool getRanged(
+            const std::string& path,
+            std::vector<char>& data,
+            const http::Headers& headers,
+            const http::Query& query,
+            std::size_t size) const;
 
     http::Pool& m_pool;
 
@@ -155,7 +487,46 @@ private:
         return get(path, data, http::Headers(), http::Query());
     }
 
+    virtual bool getText(
+            std::string path,
+            std::string& data) const final override
+    {
+        return getText(path, data, http::Headers(), http::Query());
+    }
+
+    // Read into @p data as by the streaming GET, so that the body is
+    // received directly into the string.  Reads which would be split into
+    // ranges are collected as by the GET into a vector, and copied.
+    bool getText(
+            const std::string& path,
+            std::string& data,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    // The GET of plain HTTP and HTTPS.
+    Status fetch(
+            const std::string& path,
+            std::vector<char>& data,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
     std::string typedPath(const std::string& p) const;
+
+    // Read each of @p reads, as [begin, end) pairs in order of offset, by a
+    // single multi-range GET into @p data.  Returns false if they could not
+    // all be read, noting the server as unable to if its response shows it.
+    bool getMultiRange(
+            const std::string& path,
+            const std::vector<std::pair<std::size_t, std::size_t>>& reads,
+            std::vector<std::vector<char>>& data) const;
+
+    // The origins of servers found not to serve multi-range requests.
+    mutable std::mutex m_rangeMutex;
+    mutable std::set<std::string> m_singleRange;
+
+    // True for plain HTTP and HTTPS, whose requests need nothing added, as
+    // opposed to the drivers built upon them.
+    bool plain() const { return type() == "http" || type() == "https"; }
 };
 
 /** @brief HTTPS driver.  Identical to the HTTP driver except for its type
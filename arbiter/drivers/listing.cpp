@@ -0,0 +1,632 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/listing.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/drivers/fs.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/sha256.hpp>
+#include <arbiter/util/transforms.hpp>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <random>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+namespace
+{
+    const std::int64_t defaultListingTtl(3600);
+
+    // The first line of an index, which is followed by the time at which
+    // its prefix was listed.
+    const std::string indexHeader("arbiter-listing 1 ");
+
+    // Calls back once the wrapped write completes.
+    class ListingWriter : public Writer
+    {
+    public:
+        ListingWriter(
+                std::unique_ptr<Writer> writer,
+                std::function<void()> done)
+            : m_writer(std::move(writer))
+            , m_done(done)
+        { }
+
+        virtual void write(const char* data, std::size_t size) override
+        {
+            m_writer->write(data, size);
+        }
+
+        virtual void done() override
+        {
+            m_writer->done();
+            m_done();
+        }
+
+    private:
+        std::unique_ptr<Writer> m_writer;
+        std::function<void()> m_done;
+    };
+
+    // Paths are escaped so that each file takes exactly one line, in a way
+    // which keeps both their order and which are prefixes of which.
+    std::string escapeField(const std::string& s)
+    {
+        std::string out;
+        for (const char c : s)
+        {
+            if (c == '\\') out += "\\\\";
+            else if (c == '\t') out += "\\t";
+            else if (c == '\n') out += "\\n";
+            else out.push_back(c);
+        }
+        return out;
+    }
+
+    std::string unescapeField(const char* begin, const char* end)
+    {
+        std::string out;
+        for (const char* c(begin); c < end; ++c)
+        {
+            if (*c == '\\' && c + 1 < end)
+            {
+                ++c;
+                out.push_back(*c == 't' ? '\t' : *c == 'n' ? '\n' : *c);
+            }
+            else out.push_back(*c);
+        }
+        return out;
+    }
+
+    // A line of an index, which is its escaped path, size, modification
+    // time, and escaped version, separated by tabs.
+    struct Line
+    {
+        std::string key;
+        std::string rest;
+
+        bool operator<(const Line& other) const { return key < other.key; }
+    };
+
+    Line toLine(const FileInfo& info)
+    {
+        Line line;
+        line.key = escapeField(Arbiter::stripType(info.path));
+        line.rest =
+            (info.hasSize ? std::to_string(info.size) : std::string()) + "\t" +
+            std::to_string(info.modified) + "\t" +
+            escapeField(info.version);
+        return line;
+    }
+
+    // The end of the line beginning at @p pos, including its newline.
+    std::size_t lineEnd(const char* data, std::size_t size, std::size_t pos)
+    {
+        if (pos >= size) return size;
+        const void* nl(std::memchr(data + pos, '\n', size - pos));
+        return nl ? static_cast<const char*>(nl) - data + 1 : size;
+    }
+
+    // The offset of the first line of the body which is not before @p key.
+    std::size_t lowerBound(
+            const char* data,
+            const std::size_t size,
+            std::size_t lo,
+            const std::string& key)
+    {
+        std::size_t hi(size);
+        while (lo < hi)
+        {
+            std::size_t start(lo + (hi - lo) / 2);
+            while (start > lo && data[start - 1] != '\n') --start;
+
+            const std::size_t end(lineEnd(data, size, start));
+            const char* tab(static_cast<const char*>(
+                        std::memchr(data + start, '\t', end - start)));
+            const std::size_t length(
+                    tab ? tab - (data + start) : end - start);
+
+            if (std::string(data + start, length) < key) lo = end;
+            else hi = start;
+        }
+        return lo;
+    }
+}
+
+ListingIndex::ListingIndex(
+        std::unique_ptr<Driver> driver,
+        const std::string dir,
+        std::vector<Prefix> prefixes,
+        const std::chrono::seconds ttl)
+    : m_driver(std::move(driver))
+    , m_dir(([&dir]()
+    {
+        std::string s(expandTilde(dir));
+        if (s.size() && s.back() != '/') s += '/';
+        return s;
+    })())
+    , m_prefixes(std::move(prefixes))
+    , m_ttl(ttl)
+{
+    if (!m_driver) throw ArbiterError("Cannot index an empty driver");
+    if (!mkdirp(m_dir))
+    {
+        throw ArbiterError("Could not create listing directory " + m_dir);
+    }
+
+    for (const Prefix& prefix : m_prefixes)
+    {
+        m_states[prefix.path].reset(new State());
+    }
+}
+
+void ListingIndex::wrap(DriverMap& drivers, const std::string s)
+{
+    const DriverWrapper w(wrapper(s));
+    if (!w) return;
+
+    for (auto& p : drivers) p.second = w(std::move(p.second));
+}
+
+DriverWrapper ListingIndex::wrapper(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object()) return DriverWrapper();
+
+    const std::string dir(
+            c.value("dir", getTempPath() + "arbiter-listings/"));
+    const std::chrono::seconds ttl(c.value("ttl", defaultListingTtl));
+
+    // Prefixes by the type of their driver.
+    std::map<std::string, std::vector<Prefix>> prefixes;
+    for (const std::string key : { "prefixes", "appendOnly" })
+    {
+        for (const json& p : c.value(key, json::array()))
+        {
+            const std::string path(p.get<std::string>());
+
+            Prefix prefix;
+            prefix.path = Arbiter::stripType(path);
+            prefix.appendOnly = key == "appendOnly";
+            prefixes[Arbiter::getType(path)].push_back(prefix);
+        }
+    }
+
+    return [dir, ttl, prefixes](std::unique_ptr<Driver> driver)
+    {
+        const auto it(prefixes.find(driver->type()));
+        if (it != prefixes.end())
+        {
+            driver.reset(
+                    new ListingIndex(std::move(driver), dir, it->second, ttl));
+        }
+        return driver;
+    };
+}
+
+std::unique_ptr<std::size_t> ListingIndex::tryGetSize(
+        const std::string path) const
+{
+    return m_driver->tryGetSize(path);
+}
+
+std::vector<std::unique_ptr<std::size_t>> ListingIndex::tryGetSizes(
+        const std::vector<std::string>& paths) const
+{
+    return m_driver->tryGetSizes(paths);
+}
+
+bool ListingIndex::exists(const std::string path) const
+{
+    return m_driver->exists(path);
+}
+
+std::unique_ptr<std::string> ListingIndex::tryGetVersion(
+        const std::string path) const
+{
+    return m_driver->tryGetVersion(path);
+}
+
+void ListingIndex::put(
+        const std::string path,
+        const std::vector<char>& data) const
+{
+    m_driver->put(path, data);
+    touch(path, false);
+}
+
+void ListingIndex::putFrom(
+        const std::string path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size) const
+{
+    m_driver->putFrom(path, source, size);
+    touch(path, false);
+}
+
+void ListingIndex::putParts(
+        const std::string path,
+        const char* const data,
+        const std::size_t size,
+        const std::size_t partSize) const
+{
+    m_driver->putParts(path, data, size, partSize);
+    touch(path, false);
+}
+
+std::unique_ptr<Writer> ListingIndex::putStream(const std::string path) const
+{
+    return std::unique_ptr<Writer>(new ListingWriter(
+                m_driver->putStream(path),
+                [this, path]() { touch(path, false); }));
+}
+
+void ListingIndex::copy(const std::string src, const std::string dst) const
+{
+    m_driver->copy(src, dst);
+    touch(dst, false);
+}
+
+void ListingIndex::remove(const std::string path) const
+{
+    m_driver->remove(path);
+    touch(path, true);
+}
+
+std::vector<std::exception_ptr> ListingIndex::removeMany(
+        const std::vector<std::string>& paths,
+        const std::size_t threads) const
+{
+    auto errors(m_driver->removeMany(paths, threads));
+    for (const std::string& path : paths) touch(path, true);
+    return errors;
+}
+
+std::unique_ptr<Watch> ListingIndex::watch(
+        const std::string path,
+        ChangeCallback f,
+        const std::chrono::milliseconds interval) const
+{
+    return m_driver->watch(path, [this, f](const ChangeEvent& event)
+    {
+        touch(
+                Arbiter::stripType(event.info.path),
+                event.type == ChangeEvent::Type::Removed);
+        f(event);
+    }, interval);
+}
+
+void ListingIndex::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    m_driver->getStream(path, sink);
+}
+
+std::vector<char> ListingIndex::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    return m_driver->getRange(path, offset, length);
+}
+
+void ListingIndex::getFile(
+        const std::string path,
+        const std::string localPath) const
+{
+    m_driver->getFile(path, localPath);
+}
+
+std::string ListingIndex::indexPath(const std::string& path) const
+{
+    return m_dir +
+        crypto::encodeAsHex(crypto::sha256(type() + "://" + path)) + ".idx";
+}
+
+bool ListingIndex::get(const std::string path, std::vector<char>& data) const
+{
+    auto fetched(m_driver->tryGetBinary(path));
+    if (!fetched) return false;
+
+    data = std::move(*fetched);
+    return true;
+}
+
+std::vector<std::string> ListingIndex::glob(
+        const std::string path,
+        const bool verbose) const
+{
+    std::vector<std::string> results;
+    globInfo(path, [&results](FileInfo info)
+    {
+        results.push_back(std::move(info.path));
+    }, verbose);
+    return results;
+}
+
+void ListingIndex::glob(
+        const std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void ListingIndex::globInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    std::string base(path);
+    base.pop_back();
+
+    const bool recursive(base.size() && base.back() == '*');
+    if (recursive) base.pop_back();
+
+    const Prefix* prefix(prefixOf(base));
+    if (!prefix)
+    {
+        m_driver->resolveInfo(path, f, verbose);
+        return;
+    }
+
+    const Mapping file(index(*prefix, verbose));
+    const std::string root(isRemote() ? type() + "://" : "");
+
+    scan(*file, base, [&](FileInfo info)
+    {
+        if (recursive ||
+                info.path.find('/', root.size() + base.size()) ==
+                    std::string::npos)
+        {
+            f(std::move(info));
+        }
+    });
+}
+
+void ListingIndex::globInfoAfter(
+        const std::string path,
+        const std::string& after,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    m_driver->resolveInfoAfter(path, after, f, verbose);
+}
+
+void ListingIndex::globPattern(
+        const Glob& glob,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const Prefix* prefix(prefixOf(glob.prefix()));
+    if (!prefix)
+    {
+        m_driver->resolveInfo(glob.pattern(), f, verbose);
+        return;
+    }
+
+    const Mapping file(index(*prefix, verbose));
+    const std::string root(isRemote() ? type() + "://" : "");
+
+    scan(*file, glob.prefix(), [&](FileInfo info)
+    {
+        if (glob.match(info.path.substr(root.size()))) f(std::move(info));
+    });
+}
+
+const ListingIndex::Prefix* ListingIndex::prefixOf(
+        const std::string& path) const
+{
+    const Prefix* found(nullptr);
+    for (const Prefix& prefix : m_prefixes)
+    {
+        if (path.compare(0, prefix.path.size(), prefix.path) == 0 &&
+                (!found || prefix.path.size() > found->path.size()))
+        {
+            found = &prefix;
+        }
+    }
+    return found;
+}
+
+ListingIndex::Mapping ListingIndex::index(
+        const Prefix& prefix,
+        const bool verbose) const
+{
+    State& state(*m_states.at(prefix.path));
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    // An index left by an earlier run is used while it is fresh.
+    if (!state.file)
+    {
+        try
+        {
+            Mapping file(std::make_shared<MappedFile>(indexPath(prefix.path)));
+            const std::size_t end(lineEnd(file->data(), file->size(), 0));
+            const std::string header(file->data(), end);
+
+            if (header.compare(0, indexHeader.size(), indexHeader) == 0)
+            {
+                state.listed = std::stoll(header.substr(indexHeader.size()));
+                state.file = file;
+            }
+        }
+        catch (...) { }
+    }
+
+    if (!state.file ||
+            state.stale ||
+            state.invalid ||
+            std::int64_t(std::time(nullptr)) - state.listed >= m_ttl.count())
+    {
+        refresh(prefix, state, verbose);
+    }
+
+    return state.file;
+}
+
+void ListingIndex::refresh(
+        const Prefix& prefix,
+        State& state,
+        const bool verbose) const
+{
+    const std::int64_t listed(std::time(nullptr));
+    std::vector<Line> lines;
+
+    auto add([&lines](FileInfo info) { lines.push_back(toLine(info)); });
+
+    if (state.file && prefix.appendOnly && !state.invalid)
+    {
+        // Keep what we have, and list only what follows it.
+        const char* data(state.file->data());
+        const std::size_t size(state.file->size());
+
+        std::size_t pos(lineEnd(data, size, 0));
+        while (pos < size)
+        {
+            const std::size_t end(lineEnd(data, size, pos));
+            const char* tab(static_cast<const char*>(
+                        std::memchr(data + pos, '\t', end - pos)));
+            if (tab)
+            {
+                Line line;
+                line.key.assign(data + pos, tab);
+                line.rest.assign(tab + 1, data + end - 1);
+                lines.push_back(std::move(line));
+            }
+            pos = end;
+        }
+
+        const std::string after(
+                lines.size() ?
+                    unescapeField(
+                        lines.back().key.data(),
+                        lines.back().key.data() + lines.back().key.size()) :
+                    std::string());
+
+        if (after.size())
+        {
+            m_driver->resolveInfoAfter(prefix.path + "**", after, add, verbose);
+        }
+        else m_driver->resolveInfo(prefix.path + "**", add, verbose);
+    }
+    else m_driver->resolveInfo(prefix.path + "**", add, verbose);
+
+    std::sort(lines.begin(), lines.end());
+    lines.erase(
+            std::unique(
+                lines.begin(),
+                lines.end(),
+                [](const Line& a, const Line& b) { return a.key == b.key; }),
+            lines.end());
+
+    // Write a new index beside the old, and then replace it, so that
+    // mappings of the old remain valid.
+    const std::string path(indexPath(prefix.path));
+    const std::string temp(([&path]()
+    {
+        std::random_device random;
+        return path + "." + std::to_string(random()) + ".tmp";
+    })());
+
+    {
+        std::ofstream stream(temp, std::ofstream::binary | std::ofstream::out);
+        stream << indexHeader << listed << '\n';
+        for (const Line& line : lines)
+        {
+            stream << line.key << '\t' << line.rest << '\n';
+        }
+        stream.close();
+
+        if (!stream.good())
+        {
+            std::remove(temp.c_str());
+            throw ArbiterError("Could not write listing index " + temp);
+        }
+    }
+
+    state.file.reset();
+    if (std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+        throw ArbiterError("Could not replace listing index " + path);
+    }
+
+    state.file = std::make_shared<MappedFile>(path);
+    state.listed = listed;
+    state.stale = false;
+    state.invalid = false;
+}
+
+void ListingIndex::scan(
+        const MappedFile& file,
+        const std::string& path,
+        const std::function<void(FileInfo)>& f) const
+{
+    const char* data(file.data());
+    const std::size_t size(file.size());
+    const std::string key(escapeField(path));
+    const std::string root(isRemote() ? type() + "://" : "");
+
+    std::size_t pos(lowerBound(data, size, lineEnd(data, size, 0), key));
+    while (pos < size)
+    {
+        const std::size_t end(lineEnd(data, size, pos));
+        if (std::strncmp(data + pos, key.data(), key.size()) != 0) break;
+
+        // The fields of this line, which ends with a newline.
+        const char* fields[4] = { data + pos, nullptr, nullptr, nullptr };
+        for (std::size_t i(1); i < 4; ++i)
+        {
+            const char* from(fields[i - 1]);
+            fields[i] = static_cast<const char*>(
+                    std::memchr(from, '\t', data + end - from));
+            if (!fields[i]) throw ArbiterError("Invalid listing index");
+            ++fields[i];
+        }
+
+        FileInfo info(root + unescapeField(fields[0], fields[1] - 1));
+        if (fields[2] - 1 > fields[1])
+        {
+            info.hasSize = true;
+            info.size = std::stoull(std::string(fields[1], fields[2] - 1));
+        }
+        info.modified = std::stoll(std::string(fields[2], fields[3] - 1));
+        info.version = unescapeField(fields[3], data + end - 1);
+
+        f(std::move(info));
+        pos = end;
+    }
+}
+
+void ListingIndex::touch(const std::string& path, const bool removed) const
+{
+    const Prefix* prefix(prefixOf(path));
+    if (!prefix) return;
+
+    State& state(*m_states.at(prefix->path));
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (removed) state.invalid = true;
+    else state.stale = true;
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
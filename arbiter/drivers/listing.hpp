@@ -0,0 +1,239 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+class MappedFile;
+
+namespace drivers
+{
+
+/** @brief A persistent local index of the files under prefixes of another
+ * driver, from which globs within those prefixes are resolved.
+ *
+ * Each prefix is listed recursively into an index file, which holds a line
+ * per file, sorted by path, and is mapped into memory and searched, so
+ * that resolving any glob within a known prefix lists nothing remotely.
+ * Index files outlive the process, and are refreshed once they are older
+ * than their time to live: by listing the whole prefix again, or, for
+ * append-only prefixes, whose files are only ever added with names sorting
+ * after the last, by listing only the files after the last one indexed.
+ *
+ * Writes through this driver within a prefix have its index refreshed on
+ * its next use, where removals always list the whole prefix again.
+ * Changes made elsewhere are not seen until the index expires.
+ *
+ * See ListingIndex::wrapper for configuration.
+ */
+class ARBITER_DLL ListingIndex : public Driver
+{
+public:
+    /** @brief An indexed prefix. */
+    struct Prefix
+    {
+        /** The prefix, stripped of its type, like `bucket/dir/`. */
+        std::string path;
+
+        /** If true, refreshes list only the files after the last indexed. */
+        bool appendOnly = false;
+    };
+
+    /** Index @p prefixes of @p driver in files within @p dir, which is
+     * created if need be, and refresh them once they are @p ttl old.
+     */
+    ListingIndex(
+            std::unique_ptr<Driver> driver,
+            std::string dir,
+            std::vector<Prefix> prefixes,
+            std::chrono::seconds ttl);
+
+    /** Replace drivers within @p drivers by listing indexes according to
+     * the stringified JSON @p j, which is the `listings` entry of the
+     * Arbiter configuration.  If @p j is not an object, nothing is indexed.
+     * Its keys are:
+     *
+     * - `prefixes`: an array of the prefixes to index, with their types,
+     *   like `s3://bucket/dir/`.  Only drivers with indexed prefixes are
+     *   wrapped.
+     * - `appendOnly`: an array of further prefixes to index, which are
+     *   refreshed by listing only the files after the last one indexed.
+     * - `dir`: the directory of the index files, by default
+     *   `arbiter-listings` within the temporary directory.
+     * - `ttl`: the seconds after which an index is refreshed, by default
+     *   3600.  With zero, indexes are refreshed on each use, which for
+     *   append-only prefixes still lists only new files.
+     */
+    static void wrap(DriverMap& drivers, std::string j);
+
+    /** As ListingIndex::wrap, but returns a function with which drivers may
+     * be wrapped one at a time.  Returns null if @p j is not an object.
+     */
+    static DriverWrapper wrapper(std::string j);
+
+    virtual const Driver* wrapped() const override { return m_driver.get(); }
+
+    virtual std::string type() const override { return m_driver->type(); }
+    virtual bool isRemote() const override { return m_driver->isRemote(); }
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual std::vector<std::unique_ptr<std::size_t>> tryGetSizes(
+            const std::vector<std::string>& paths) const override;
+
+    virtual bool exists(std::string path) const override;
+
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual void putFrom(
+            std::string path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size) const override;
+
+    virtual void putParts(
+            std::string path,
+            const char* data,
+            std::size_t size,
+            std::size_t partSize) const override;
+
+    virtual std::unique_ptr<Writer> putStream(
+            std::string path) const override;
+
+    virtual void copy(std::string src, std::string dst) const override;
+
+    virtual void remove(std::string path) const override;
+
+    virtual std::vector<std::exception_ptr> removeMany(
+            const std::vector<std::string>& paths,
+            std::size_t threads) const override;
+
+    /** Forwards to the wrapped driver, marking the index of each changed
+     * file's prefix stale before its change is delivered.
+     */
+    virtual std::unique_ptr<Watch> watch(
+            std::string path,
+            ChangeCallback f,
+            std::chrono::milliseconds interval =
+                std::chrono::seconds(60)) const override;
+
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    virtual void getFile(
+            std::string path,
+            std::string localPath) const override;
+
+    /** The path of the index file of the prefix @p path. */
+    std::string indexPath(const std::string& path) const;
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    virtual void globInfoAfter(
+            std::string path,
+            const std::string& after,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    virtual void globPattern(
+            const Glob& glob,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    using Mapping = std::shared_ptr<const MappedFile>;
+
+    struct State
+    {
+        // Serializes loading and refreshing the index.
+        std::mutex mutex;
+
+        Mapping file;
+        std::int64_t listed = 0;
+
+        // Set by writes within the prefix, and by removals respectively.
+        bool stale = false;
+        bool invalid = false;
+    };
+
+    // The indexed prefix containing @p path, if any.
+    const Prefix* prefixOf(const std::string& path) const;
+
+    // The current index of @p prefix, refreshed first if need be.
+    Mapping index(const Prefix& prefix, bool verbose) const;
+
+    // List @p prefix into its index, whose current contents are in @p state.
+    void refresh(const Prefix& prefix, State& state, bool verbose) const;
+
+    // Pass each file of @p file whose path begins with @p path to @p f.
+    void scan(
+            const MappedFile& file,
+            const std::string& path,
+            const std::function<void(FileInfo)>& f) const;
+
+    // Note a write of @p path, which removed it if @p removed.
+    void touch(const std::string& path, bool removed) const;
+
+    ListingIndex(const ListingIndex&);
+    ListingIndex& operator=(const ListingIndex&);
+
+    std::unique_ptr<Driver> m_driver;
+    const std::string m_dir;
+    const std::vector<Prefix> m_prefixes;
+    const std::chrono::seconds m_ttl;
+
+    // By prefix path.
+    std::map<std::string, std::unique_ptr<State>> m_states;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,253 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/memory.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/cancel.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/util.hpp>
+#endif
+
+#include <algorithm>
+#include <thread>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+Memory::Memory(const std::chrono::milliseconds latency)
+    : m_latency(latency)
+    , m_version(0)
+{ }
+
+std::unique_ptr<Memory> Memory::create(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+
+    std::chrono::milliseconds latency(0);
+    if (c.is_object())
+    {
+        latency = std::chrono::milliseconds(c.value("latency", 0));
+    }
+
+    return makeUnique<Memory>(latency);
+}
+
+void Memory::put(const std::string path, const std::vector<char>& data) const
+{
+    wait();
+    store(path, std::make_shared<File>(data, ++m_version));
+}
+
+void Memory::put(const std::string path, std::vector<char>&& data) const
+{
+    wait();
+    store(path, std::make_shared<File>(std::move(data), ++m_version));
+}
+
+std::unique_ptr<std::size_t> Memory::tryGetSize(const std::string path) const
+{
+    wait();
+    if (const Shared file = find(path))
+    {
+        return makeUnique<std::size_t>(file->data.size());
+    }
+    return std::unique_ptr<std::size_t>();
+}
+
+std::unique_ptr<std::string> Memory::tryGetVersion(
+        const std::string path) const
+{
+    wait();
+    if (const Shared file = find(path))
+    {
+        return makeUnique<std::string>(std::to_string(file->version));
+    }
+    return std::unique_ptr<std::string>();
+}
+
+bool Memory::get(const std::string path, std::vector<char>& data) const
+{
+    wait();
+    const Shared file(find(path));
+    if (!file) return false;
+
+    data = file->data;
+    return true;
+}
+
+bool Memory::getText(const std::string path, std::string& data) const
+{
+    wait();
+    const Shared file(find(path));
+    if (!file) return false;
+
+    data.assign(file->data.begin(), file->data.end());
+    return true;
+}
+
+void Memory::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    wait();
+    const Shared file(at(path));
+    sink(file->data.data(), file->data.size());
+}
+
+std::size_t Memory::getInto(
+        const std::string path,
+        char* const data,
+        const std::size_t size) const
+{
+    wait();
+    const Shared file(at(path));
+    if (file->data.size() > size)
+    {
+        throw ArbiterError(
+                "Buffer of " + std::to_string(size) +
+                " bytes is too small for " + path);
+    }
+
+    std::copy(file->data.begin(), file->data.end(), data);
+    return file->data.size();
+}
+
+Capabilities Memory::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = true;
+    c.serverSideCopy = true;
+    c.delimiters = true;
+    c.listingMetadata = true;
+    return c;
+}
+
+std::vector<char> Memory::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    wait();
+    const Shared file(at(path));
+    const std::vector<char>& data(file->data);
+    if (offset >= data.size()) return std::vector<char>();
+
+    const std::size_t end(offset + (std::min)(length, data.size() - offset));
+    return std::vector<char>(data.begin() + offset, data.begin() + end);
+}
+
+void Memory::copy(const std::string src, const std::string dst) const
+{
+    wait();
+    store(dst, at(src));
+}
+
+void Memory::remove(const std::string path) const
+{
+    wait();
+    Shard& shard(shardOf(path));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.files.erase(path);
+}
+
+std::vector<std::string> Memory::glob(std::string path, bool verbose) const
+{
+    std::vector<std::string> results;
+    globInfo(path, [&results](FileInfo info)
+    {
+        results.push_back(std::move(info.path));
+    }, verbose);
+
+    std::sort(results.begin(), results.end());
+    return results;
+}
+
+void Memory::globInfo(
+        std::string path,
+        const std::function<void(FileInfo)>& f,
+        bool) const
+{
+    wait();
+
+    path.pop_back();
+    const bool recursive(path.size() && path.back() == '*');
+    if (recursive) path.pop_back();
+
+    // Matches are collected first so that @p f runs without a shard locked.
+    std::vector<FileInfo> results;
+
+    for (Shard& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& entry : shard.files)
+        {
+            const std::string& name(entry.first);
+            if (name.compare(0, path.size(), path)) continue;
+            if (!recursive && name.find('/', path.size()) != std::string::npos)
+            {
+                continue;
+            }
+
+            FileInfo info(type() + "://" + name);
+            info.hasSize = true;
+            info.size = entry.second->data.size();
+            info.version = std::to_string(entry.second->version);
+            results.push_back(std::move(info));
+        }
+    }
+
+    for (FileInfo& info : results) f(std::move(info));
+}
+
+Memory::Shard& Memory::shardOf(const std::string& path) const
+{
+    return m_shards[std::hash<std::string>()(path) % m_shards.size()];
+}
+
+Memory::Shared Memory::find(const std::string& path) const
+{
+    Shard& shard(shardOf(path));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it(shard.files.find(path));
+    return it != shard.files.end() ? it->second : Shared();
+}
+
+Memory::Shared Memory::at(const std::string& path) const
+{
+    if (Shared file = find(path)) return file;
+    throw ArbiterError("Could not read file " + path);
+}
+
+void Memory::store(const std::string& path, Shared file) const
+{
+    Shard& shard(shardOf(path));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.files[path] = std::move(file);
+}
+
+void Memory::wait() const
+{
+    if (!m_latency.count()) return;
+
+    // Like a remote transfer, the wait is cut short by cancellation.
+    if (const CancelToken* token = CancelScope::current())
+    {
+        if (!token->sleep(m_latency)) token->check();
+    }
+    else std::this_thread::sleep_for(m_latency);
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+/** @brief A driver which holds its files in memory, for `mem://` paths.
+ *
+ * Files live as long as the driver, so each Arbiter has its own.  Paths are
+ * spread over independently locked shards so that concurrent operations on
+ * different paths rarely contend, and reads share the stored data rather
+ * than holding a lock while copying it.  Globs behave like those of S3,
+ * treating `/` as the directory separator.
+ *
+ * The `mem` entry of the Arbiter configuration may contain a `latency`, in
+ * milliseconds, added to each operation to simulate a remote store, which
+ * like a remote transfer is cut short by cancellation of the CancelToken
+ * of the calling thread.
+ */
+class ARBITER_DLL Memory : public Driver
+{
+public:
+    explicit Memory(
+            std::chrono::milliseconds latency = std::chrono::milliseconds(0));
+
+    static std::unique_ptr<Memory> create(std::string j);
+
+    virtual std::string type() const override { return "mem"; }
+
+    using Driver::get;
+    using Driver::put;
+
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    /** Keeps @p data itself rather than a copy. */
+    virtual void put(
+            std::string path,
+            std::vector<char>&& data) const override;
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    /** Versions count the writes to this driver, so they differ for
+     * different contents of the same size.
+     */
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    virtual std::size_t getInto(
+            std::string path,
+            char* data,
+            std::size_t size) const override;
+
+    /** Ranged reads, copies, and listings by directory with sizes. */
+    virtual Capabilities capabilities() const override;
+
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    /** Copies share the data of their source. */
+    virtual void copy(std::string src, std::string dst) const override;
+
+    virtual void remove(std::string path) const override;
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+    virtual bool getText(std::string path, std::string& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    /** Listings include the size and version of each file. */
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    struct File
+    {
+        File(std::vector<char> data, std::uint64_t version)
+            : data(std::move(data))
+            , version(version)
+        { }
+
+        const std::vector<char> data;
+        const std::uint64_t version;
+    };
+
+    using Shared = std::shared_ptr<const File>;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, Shared> files;
+    };
+
+    Shard& shardOf(const std::string& path) const;
+
+    // The file at @p path, or null if there is none.
+    Shared find(const std::string& path) const;
+
+    // The file at @p path, or throw if there is none.
+    Shared at(const std::string& path) const;
+
+    void store(const std::string& path, Shared file) const;
+
+    // Simulate the latency of a remote store.
+    void wait() const;
+
+    Memory(const Memory&);
+    Memory& operator=(const Memory&);
+
+    const std::chrono::milliseconds m_latency;
+
+    mutable std::array<Shard, 16> m_shards;
+    mutable std::atomic<std::uint64_t> m_version;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,417 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/metadata.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/util.hpp>
+#endif
+
+#include <iterator>
+#include <set>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+namespace
+{
+    const double defaultTtl(60);
+    const double defaultNegativeTtl(10);
+    const std::size_t defaultMaxEntries(100000);
+
+    std::chrono::milliseconds toMillis(const double seconds)
+    {
+        return std::chrono::milliseconds(
+                static_cast<long long>(seconds * 1000.0));
+    }
+
+    // Calls back once the wrapped write completes.
+    class MetadataWriter : public Writer
+    {
+    public:
+        MetadataWriter(
+                std::unique_ptr<Writer> writer,
+                std::function<void()> done)
+            : m_writer(std::move(writer))
+            , m_done(done)
+        { }
+
+        virtual void write(const char* data, std::size_t size) override
+        {
+            m_writer->write(data, size);
+        }
+
+        virtual void done() override
+        {
+            m_writer->done();
+            m_done();
+        }
+
+    private:
+        std::unique_ptr<Writer> m_writer;
+        std::function<void()> m_done;
+    };
+}
+
+MetadataCache::MetadataCache(
+        std::unique_ptr<Driver> driver,
+        const std::chrono::milliseconds ttl,
+        const std::chrono::milliseconds negativeTtl,
+        const std::size_t maxEntries)
+    : m_driver(std::move(driver))
+    , m_ttl(ttl)
+    , m_negativeTtl(negativeTtl)
+    , m_maxEntries(maxEntries)
+{
+    if (!m_driver) throw ArbiterError("Cannot cache an empty driver");
+}
+
+void MetadataCache::wrap(DriverMap& drivers, const std::string s)
+{
+    const DriverWrapper w(wrapper(s));
+    if (!w) return;
+
+    for (auto& p : drivers) p.second = w(std::move(p.second));
+}
+
+DriverWrapper MetadataCache::wrapper(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object()) return DriverWrapper();
+
+    const auto ttl(toMillis(c.value("ttl", defaultTtl)));
+    const auto negativeTtl(
+            toMillis(c.value("negativeTtl", defaultNegativeTtl)));
+    const std::size_t maxEntries(c.value("maxEntries", defaultMaxEntries));
+
+    std::set<std::string> types;
+    for (const json& type : c.value("types", json::array()))
+    {
+        types.insert(type.get<std::string>());
+    }
+
+    return [ttl, negativeTtl, maxEntries, types](
+            std::unique_ptr<Driver> driver)
+    {
+        if (types.empty() ? driver->isRemote() : types.count(driver->type()))
+        {
+            driver.reset(
+                    new MetadataCache(
+                        std::move(driver),
+                        ttl,
+                        negativeTtl,
+                        maxEntries));
+        }
+        return driver;
+    };
+}
+
+std::unique_ptr<std::size_t> MetadataCache::tryGetSize(
+        const std::string path) const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const Entry* entry(find(path));
+        if (entry && !entry->exists) return std::unique_ptr<std::size_t>();
+        if (entry && entry->size) return makeUnique<std::size_t>(*entry->size);
+    }
+
+    std::unique_ptr<std::size_t> size(m_driver->tryGetSize(path));
+    insert(path, size.get());
+    return size;
+}
+
+bool MetadataCache::exists(const std::string path) const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (const Entry* entry = find(path)) return entry->exists;
+    }
+
+    return tryGetSize(path).get() != nullptr;
+}
+
+std::vector<std::unique_ptr<std::size_t>> MetadataCache::tryGetSizes(
+        const std::vector<std::string>& paths) const
+{
+    std::vector<std::unique_ptr<std::size_t>> sizes(paths.size());
+
+    // Look up only the paths which aren't answered by the cache, together.
+    std::vector<std::size_t> missing;
+    std::vector<std::string> lookups;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (std::size_t i(0); i < paths.size(); ++i)
+        {
+            const Entry* entry(find(paths[i]));
+            if (entry && !entry->exists) continue;
+            if (entry && entry->size)
+            {
+                sizes[i] = makeUnique<std::size_t>(*entry->size);
+                continue;
+            }
+
+            missing.push_back(i);
+            lookups.push_back(paths[i]);
+        }
+    }
+
+    if (lookups.empty()) return sizes;
+
+    auto found(m_driver->tryGetSizes(lookups));
+    for (std::size_t i(0); i < missing.size(); ++i)
+    {
+        insert(lookups[i], found[i].get());
+        sizes[missing[i]] = std::move(found[i]);
+    }
+
+    return sizes;
+}
+
+std::unique_ptr<std::string> MetadataCache::tryGetVersion(
+        const std::string path) const
+{
+    return m_driver->tryGetVersion(path);
+}
+
+void MetadataCache::put(
+        const std::string path,
+        const std::vector<char>& data) const
+{
+    erase(path);
+    m_driver->put(path, data);
+    erase(path);
+}
+
+void MetadataCache::putFrom(
+        const std::string path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size) const
+{
+    erase(path);
+    m_driver->putFrom(path, source, size);
+    erase(path);
+}
+
+void MetadataCache::putParts(
+        const std::string path,
+        const char* const data,
+        const std::size_t size,
+        const std::size_t partSize) const
+{
+    erase(path);
+    m_driver->putParts(path, data, size, partSize);
+    erase(path);
+}
+
+std::unique_ptr<Writer> MetadataCache::putStream(const std::string path) const
+{
+    erase(path);
+    return std::unique_ptr<Writer>(new MetadataWriter(
+                m_driver->putStream(path),
+                [this, path]() { erase(path); }));
+}
+
+void MetadataCache::copy(const std::string src, const std::string dst) const
+{
+    erase(dst);
+    m_driver->copy(src, dst);
+    erase(dst);
+}
+
+void MetadataCache::remove(const std::string path) const
+{
+    erase(path);
+    m_driver->remove(path);
+    erase(path);
+}
+
+std::vector<std::exception_ptr> MetadataCache::removeMany(
+        const std::vector<std::string>& paths,
+        const std::size_t threads) const
+{
+    for (const std::string& path : paths) erase(path);
+    auto errors(m_driver->removeMany(paths, threads));
+    for (const std::string& path : paths) erase(path);
+    return errors;
+}
+
+std::unique_ptr<Watch> MetadataCache::watch(
+        const std::string path,
+        ChangeCallback f,
+        const std::chrono::milliseconds interval) const
+{
+    return m_driver->watch(path, [this, f](const ChangeEvent& event)
+    {
+        erase(Arbiter::stripType(event.info.path));
+        f(event);
+    }, interval);
+}
+
+void MetadataCache::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    std::size_t size(0);
+    m_driver->getStream(path, [&](const char* data, std::size_t n)
+    {
+        size += n;
+        sink(data, n);
+    });
+    insert(path, &size);
+}
+
+std::vector<char> MetadataCache::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    return m_driver->getRange(path, offset, length);
+}
+
+void MetadataCache::getFile(
+        const std::string path,
+        const std::string localPath) const
+{
+    m_driver->getFile(path, localPath);
+}
+
+void MetadataCache::erase(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it(m_entries.find(path));
+    if (it == m_entries.end()) return;
+
+    m_order.erase(it->second.order);
+    m_entries.erase(it);
+}
+
+bool MetadataCache::get(const std::string path, std::vector<char>& data) const
+{
+    auto fetched(m_driver->tryGetBinary(path));
+    if (!fetched) return false;
+
+    const std::size_t size(fetched->size());
+    insert(path, &size);
+
+    data = std::move(*fetched);
+    return true;
+}
+
+std::vector<std::string> MetadataCache::glob(
+        const std::string path,
+        const bool verbose) const
+{
+    std::vector<std::string> results;
+    for (FileInfo& info : m_driver->resolveInfo(path, verbose))
+    {
+        insertListed(info.path, info.hasSize ? &info.size : nullptr);
+        results.push_back(std::move(info.path));
+    }
+    return results;
+}
+
+void MetadataCache::glob(
+        const std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void MetadataCache::globInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    m_driver->resolveInfo(path, [this, &f](FileInfo info)
+    {
+        insertListed(info.path, info.hasSize ? &info.size : nullptr);
+        f(std::move(info));
+    }, verbose);
+}
+
+const MetadataCache::Entry* MetadataCache::find(const std::string& path) const
+{
+    auto it(m_entries.find(path));
+    if (it == m_entries.end() || it->second.expires <= Clock::now())
+    {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void MetadataCache::insert(
+        const std::string& path,
+        const std::size_t* size) const
+{
+    Entry entry;
+    entry.exists = size != nullptr;
+    if (size) entry.size = makeUnique<std::size_t>(*size);
+    entry.expires = Clock::now() + (size ? m_ttl : m_negativeTtl);
+    insert(path, std::move(entry));
+}
+
+void MetadataCache::insertListed(
+        std::string path,
+        const std::size_t* size) const
+{
+    path = Arbiter::stripType(path);
+    if (size)
+    {
+        insert(path, size);
+        return;
+    }
+
+    {
+        // A listing tells us nothing more than a size we already have.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const Entry* entry(find(path));
+        if (entry && entry->size) return;
+    }
+
+    Entry entry;
+    entry.exists = true;
+    entry.expires = Clock::now() + m_ttl;
+    insert(path, std::move(entry));
+}
+
+void MetadataCache::insert(const std::string& path, Entry entry) const
+{
+    if (!m_maxEntries) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it(m_entries.find(path));
+    if (it != m_entries.end())
+    {
+        m_order.erase(it->second.order);
+        m_entries.erase(it);
+    }
+
+    while (m_entries.size() >= m_maxEntries)
+    {
+        m_entries.erase(m_order.front());
+        m_order.pop_front();
+    }
+
+    m_order.push_back(path);
+    entry.order = std::prev(m_order.end());
+    m_entries[path] = std::move(entry);
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
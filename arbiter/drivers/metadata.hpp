@@ -0,0 +1,202 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+/** @brief A time-bounded cache of the sizes of paths of another driver.
+ *
+ * Lookups by tryGetSize, tryGetSizes and exists are answered from the cache
+ * while their entries are fresh, including those of paths which were not
+ * found.  Entries are also recorded from complete reads, and from glob
+ * listings, including the sizes of paths where the listings provide them.
+ * Writes through this driver drop the entries of their destinations, but
+ * changes made elsewhere are not seen until the entries expire.
+ *
+ * See MetadataCache::wrap for configuration.
+ */
+class ARBITER_DLL MetadataCache : public Driver
+{
+public:
+    /** Cache lookups of @p driver for @p ttl, or @p negativeTtl for paths
+     * which were not found, keeping at most @p maxEntries entries.
+     */
+    MetadataCache(
+            std::unique_ptr<Driver> driver,
+            std::chrono::milliseconds ttl,
+            std::chrono::milliseconds negativeTtl,
+            std::size_t maxEntries);
+
+    /** Replace drivers within @p drivers by metadata caches according to the
+     * stringified JSON @p j, which is the `metadata` entry of the Arbiter
+     * configuration.  If @p j is not an object, nothing is cached.  Its keys
+     * are:
+     *
+     * - `ttl`: the seconds for which entries are used, by default 60.
+     * - `negativeTtl`: the seconds for which paths which were not found are
+     *   remembered, by default 10.
+     * - `maxEntries`: the most entries to keep, by default 100000.
+     * - `types`: an array of the driver types to cache, by default all
+     *   remote drivers.
+     */
+    static void wrap(DriverMap& drivers, std::string j);
+
+    /** As MetadataCache::wrap, but returns a function with which drivers
+     * may be wrapped one at a time.  Returns null if @p j is not an object.
+     */
+    static DriverWrapper wrapper(std::string j);
+
+    virtual const Driver* wrapped() const override { return m_driver.get(); }
+
+    virtual std::string type() const override { return m_driver->type(); }
+    virtual bool isRemote() const override { return m_driver->isRemote(); }
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual std::vector<std::unique_ptr<std::size_t>> tryGetSizes(
+            const std::vector<std::string>& paths) const override;
+
+    virtual bool exists(std::string path) const override;
+
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual void putFrom(
+            std::string path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size) const override;
+
+    virtual void putParts(
+            std::string path,
+            const char* data,
+            std::size_t size,
+            std::size_t partSize) const override;
+
+    virtual std::unique_ptr<Writer> putStream(
+            std::string path) const override;
+
+    virtual void copy(std::string src, std::string dst) const override;
+
+    virtual void remove(std::string path) const override;
+
+    virtual std::vector<std::exception_ptr> removeMany(
+            const std::vector<std::string>& paths,
+            std::size_t threads) const override;
+
+    /** Forwards to the wrapped driver, dropping the entry for each changed
+     * file before its change is delivered.
+     */
+    virtual std::unique_ptr<Watch> watch(
+            std::string path,
+            ChangeCallback f,
+            std::chrono::milliseconds interval =
+                std::chrono::seconds(60)) const override;
+
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    virtual void getFile(
+            std::string path,
+            std::string localPath) const override;
+
+    /** Drop the entry for @p path, if any. */
+    void erase(const std::string& path) const;
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        // Without a size, a path is known to exist only from a listing.
+        bool exists = false;
+        std::unique_ptr<std::size_t> size;
+        Clock::time_point expires;
+        std::list<std::string>::iterator order;
+    };
+
+    // The fresh entry for @p path, if any, which the caller must lock.
+    const Entry* find(const std::string& path) const;
+
+    // Record that @p path has @p size bytes, or, if it is null, that it was
+    // not found.
+    void insert(const std::string& path, const std::size_t* size) const;
+
+    // Record that @p path, as listed by a glob, exists, with @p size bytes
+    // if the listing included its size.
+    void insertListed(std::string path, const std::size_t* size) const;
+
+    void insert(const std::string& path, Entry entry) const;
+
+    MetadataCache(const MetadataCache&);
+    MetadataCache& operator=(const MetadataCache&);
+
+    std::unique_ptr<Driver> m_driver;
+    const std::chrono::milliseconds m_ttl;
+    const std::chrono::milliseconds m_negativeTtl;
+    const std::size_t m_maxEntries;
+
+    mutable std::mutex m_mutex;
+    mutable std::map<std::string, Entry> m_entries;
+
+    // Paths by when they were recorded, oldest first, for eviction.
+    mutable std::list<std::string> m_order;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,573 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/pack.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/drivers/fs.hpp>
+#include <arbiter/util/executor.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/sha256.hpp>
+#include <arbiter/util/transforms.hpp>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    // An index begins with this, followed by the number of files and of
+    // packs.  Then come the files, sorted by path, each with the offset and
+    // length of its path among the paths which follow them, its pack, and
+    // its offset and size within the pack.  Integers are little-endian.
+    const std::string packMagic("arbpack1");
+    const std::size_t packHeaderSize(24);
+    const std::size_t packEntrySize(32);
+
+    const std::size_t defaultPackGap(64 * 1024);
+
+    std::string packName(const std::uint32_t pack)
+    {
+        return "pack-" + std::to_string(pack);
+    }
+
+    void appendLittle(
+            std::vector<char>& out,
+            std::uint64_t value,
+            const std::size_t bytes)
+    {
+        for (std::size_t i(0); i < bytes; ++i)
+        {
+            out.push_back(static_cast<char>(value & 0xff));
+            value >>= 8;
+        }
+    }
+
+    std::uint64_t readLittle(const char* p, const std::size_t bytes)
+    {
+        std::uint64_t value(0);
+        for (std::size_t i(bytes); i > 0; --i)
+        {
+            value = (value << 8) | static_cast<unsigned char>(p[i - 1]);
+        }
+        return value;
+    }
+
+    // A view of a mapped index.
+    class PackIndex
+    {
+    public:
+        PackIndex(const char* data, const std::size_t size)
+            : m_data(data)
+        {
+            if (size < packHeaderSize ||
+                    std::memcmp(data, packMagic.data(), packMagic.size()))
+            {
+                throw ArbiterError("Invalid pack index");
+            }
+
+            m_count = readLittle(data + 8, 8);
+            m_strings = packHeaderSize + m_count * packEntrySize;
+            if (size < m_strings) throw ArbiterError("Truncated pack index");
+        }
+
+        std::size_t count() const { return m_count; }
+
+        std::string path(const std::size_t i) const
+        {
+            const char* e(entry(i));
+            return std::string(
+                    m_data + m_strings + readLittle(e, 8),
+                    readLittle(e + 8, 4));
+        }
+
+        std::uint32_t pack(std::size_t i) const
+        {
+            return static_cast<std::uint32_t>(readLittle(entry(i) + 12, 4));
+        }
+
+        std::uint64_t offset(std::size_t i) const
+        {
+            return readLittle(entry(i) + 16, 8);
+        }
+
+        std::uint64_t size(std::size_t i) const
+        {
+            return readLittle(entry(i) + 24, 8);
+        }
+
+        // The first file whose path is not before @p key.
+        std::size_t lowerBound(const std::string& key) const
+        {
+            std::size_t lo(0);
+            std::size_t hi(m_count);
+            while (lo < hi)
+            {
+                const std::size_t mid(lo + (hi - lo) / 2);
+                if (path(mid) < key) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+
+    private:
+        const char* entry(const std::size_t i) const
+        {
+            return m_data + packHeaderSize + i * packEntrySize;
+        }
+
+        const char* m_data;
+        std::size_t m_count = 0;
+        std::size_t m_strings = 0;
+    };
+}
+
+PackWriter::PackWriter(Endpoint endpoint, const std::size_t packSize)
+    : m_endpoint(endpoint)
+    , m_packSize(packSize)
+{ }
+
+void PackWriter::add(const std::string& path, const std::vector<char>& data)
+{
+    add(path, data.data(), data.size());
+}
+
+void PackWriter::add(const std::string& path, const std::string& data)
+{
+    add(path, data.data(), data.size());
+}
+
+void PackWriter::add(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size)
+{
+    if (m_closed) throw ArbiterError("Cannot add to a closed pack: " + path);
+
+    if (m_pack.size() && m_pack.size() + size > m_packSize) flush();
+
+    Entry entry;
+    entry.path = path;
+    entry.pack = m_packs;
+    entry.offset = m_pack.size();
+    entry.size = size;
+    m_entries.push_back(entry);
+
+    m_pack.insert(m_pack.end(), data, data + size);
+}
+
+void PackWriter::close()
+{
+    if (m_closed) return;
+    flush();
+
+    // Of files added more than once, the last is kept.
+    std::stable_sort(
+            m_entries.begin(),
+            m_entries.end(),
+            [](const Entry& a, const Entry& b) { return a.path < b.path; });
+
+    std::vector<Entry> entries;
+    for (std::size_t i(0); i < m_entries.size(); ++i)
+    {
+        if (i + 1 < m_entries.size() &&
+                m_entries[i + 1].path == m_entries[i].path)
+        {
+            continue;
+        }
+        entries.push_back(m_entries[i]);
+    }
+
+    std::vector<char> index(packMagic.begin(), packMagic.end());
+    appendLittle(index, entries.size(), 8);
+    appendLittle(index, m_packs, 8);
+
+    std::uint64_t offset(0);
+    for (const Entry& entry : entries)
+    {
+        appendLittle(index, offset, 8);
+        appendLittle(index, entry.path.size(), 4);
+        appendLittle(index, entry.pack, 4);
+        appendLittle(index, entry.offset, 8);
+        appendLittle(index, entry.size, 8);
+        offset += entry.path.size();
+    }
+    for (const Entry& entry : entries)
+    {
+        index.insert(index.end(), entry.path.begin(), entry.path.end());
+    }
+
+    m_endpoint.put("index", std::move(index));
+    m_entries.clear();
+    m_closed = true;
+}
+
+void PackWriter::flush()
+{
+    if (m_pack.empty()) return;
+
+    m_endpoint.put(packName(m_packs), std::move(m_pack));
+    m_pack = std::vector<char>();
+    ++m_packs;
+}
+
+namespace drivers
+{
+
+Packs::Packs(
+        std::map<std::string, Set> sets,
+        const std::string dir,
+        const std::size_t gap,
+        Executor& executor)
+    : m_sets(std::move(sets))
+    , m_dir(dir.size() && dir.back() != '/' ? dir + '/' : dir)
+    , m_gap(gap)
+    , m_executor(executor)
+{
+    for (const auto& set : m_sets) m_states[set.first].reset(new State());
+}
+
+Packs::~Packs() { }
+
+std::unique_ptr<Packs> Packs::create(
+        const std::function<const Driver&(const std::string&)>& find,
+        const std::string s,
+        Executor& executor)
+{
+    const json c(s.size() ? json::parse(s) : json());
+
+    const json names(c.value("sets", json::object()));
+    std::map<std::string, Set> sets;
+    for (const auto& entry : names.items())
+    {
+        if (entry.key().empty() || entry.key().find('/') != std::string::npos)
+        {
+            throw ArbiterError("Invalid pack set name: " + entry.key());
+        }
+
+        std::string path(entry.value().get<std::string>());
+        if (path.size() && path.back() != '/') path += '/';
+
+        Set set;
+        set.driver = &find(path);
+        set.path = path;
+        set.root = Arbiter::stripType(path);
+        sets[entry.key()] = set;
+    }
+
+    return std::unique_ptr<Packs>(new Packs(
+                sets,
+                c.value("dir", getTempPath() + "arbiter-packs/"),
+                c.value("gap", defaultPackGap),
+                executor));
+}
+
+void Packs::put(const std::string path, const std::vector<char>&) const
+{
+    throw ArbiterError("Cannot write to packs: " + path);
+}
+
+std::unique_ptr<std::size_t> Packs::tryGetSize(const std::string path) const
+{
+    std::unique_ptr<std::size_t> size;
+    if (auto entry = find(path)) size.reset(new std::size_t(entry->size));
+    return size;
+}
+
+bool Packs::exists(const std::string path) const
+{
+    return !!find(path);
+}
+
+Capabilities Packs::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = true;
+    return c;
+}
+
+std::vector<char> Packs::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    const std::unique_ptr<Entry> entry(find(path));
+    if (!entry) throw ArbiterError("Could not read file " + path);
+    if (offset >= entry->size) return std::vector<char>();
+
+    std::string rest;
+    const Set& set(split(path, rest));
+    return set.driver->getRange(
+            set.root + packName(entry->pack),
+            entry->offset + offset,
+            (std::min<std::uint64_t>)(length, entry->size - offset));
+}
+
+std::vector<std::unique_ptr<std::vector<char>>> Packs::tryGetMany(
+        const std::vector<std::string>& paths) const
+{
+    std::vector<std::unique_ptr<std::vector<char>>> results(paths.size());
+
+    // The paths read from each pack, by set and pack.
+    std::map<std::pair<std::string, std::uint32_t>, std::vector<std::size_t>>
+        groups;
+    std::vector<Entry> entries(paths.size());
+
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        const std::unique_ptr<Entry> entry(find(paths[i]));
+        if (!entry) continue;
+
+        results[i].reset(new std::vector<char>());
+        if (!entry->size) continue;
+
+        entries[i] = *entry;
+        const std::string name(paths[i].substr(0, paths[i].find('/')));
+        groups[std::make_pair(name, entry->pack)].push_back(i);
+    }
+
+    std::vector<const std::pair<
+        const std::pair<std::string, std::uint32_t>,
+        std::vector<std::size_t>>*> list;
+    for (const auto& group : groups) list.push_back(&group);
+
+    parallelFor(list.size(), m_executor.size(), [&](const std::size_t g)
+    {
+        const Set& set(m_sets.at(list[g]->first.first));
+        const std::vector<std::size_t>& indices(list[g]->second);
+
+        std::vector<std::pair<std::size_t, std::size_t>> ranges;
+        for (const std::size_t i : indices)
+        {
+            ranges.emplace_back(entries[i].offset, entries[i].size);
+        }
+
+        std::vector<std::vector<char>> data(
+                set.driver->getRanges(
+                    set.root + packName(list[g]->first.second),
+                    ranges,
+                    m_gap,
+                    m_executor));
+
+        for (std::size_t j(0); j < indices.size(); ++j)
+        {
+            *results[indices[j]] = std::move(data[j]);
+        }
+    }, &m_executor);
+
+    return results;
+}
+
+bool Packs::get(const std::string path, std::vector<char>& data) const
+{
+    const std::unique_ptr<Entry> entry(find(path));
+    if (!entry) return false;
+
+    data.clear();
+    if (!entry->size) return true;
+
+    std::string rest;
+    const Set& set(split(path, rest));
+    data = set.driver->getRange(
+            set.root + packName(entry->pack),
+            entry->offset,
+            entry->size);
+
+    if (data.size() != entry->size)
+    {
+        throw ArbiterError("Truncated pack of " + path);
+    }
+    return true;
+}
+
+std::vector<std::string> Packs::glob(
+        const std::string path,
+        const bool verbose) const
+{
+    std::vector<std::string> results;
+    globInfo(path, [&results](FileInfo info)
+    {
+        results.push_back(std::move(info.path));
+    }, verbose);
+    return results;
+}
+
+void Packs::glob(
+        const std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void Packs::globInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool) const
+{
+    std::string rest;
+    split(path, rest);
+    const std::string name(path.substr(0, path.find('/')));
+
+    std::string base(rest);
+    base.pop_back();
+
+    const bool recursive(base.size() && base.back() == '*');
+    if (recursive) base.pop_back();
+
+    scan(name, base, [&](const std::string& p, const Entry& entry)
+    {
+        if (!recursive && p.find('/', base.size()) != std::string::npos)
+        {
+            return;
+        }
+
+        FileInfo info(type() + "://" + name + "/" + p);
+        info.hasSize = true;
+        info.size = entry.size;
+        f(std::move(info));
+    });
+}
+
+void Packs::globPattern(
+        const Glob& glob,
+        const std::function<void(FileInfo)>& f,
+        const bool) const
+{
+    std::string rest;
+    split(glob.pattern(), rest);
+    const std::string name(
+            glob.pattern().substr(0, glob.pattern().find('/')));
+    const Glob within(rest);
+
+    scan(name, within.prefix(), [&](const std::string& p, const Entry& entry)
+    {
+        if (!within.match(p)) return;
+
+        FileInfo info(type() + "://" + name + "/" + p);
+        info.hasSize = true;
+        info.size = entry.size;
+        f(std::move(info));
+    });
+}
+
+const Packs::Set& Packs::split(
+        const std::string& path,
+        std::string& rest) const
+{
+    const std::size_t slash(path.find('/'));
+    const auto it(m_sets.find(path.substr(0, slash)));
+    if (it == m_sets.end()) throw ArbiterError("No pack set for " + path);
+
+    rest = slash == std::string::npos ? "" : path.substr(slash + 1);
+    return it->second;
+}
+
+Packs::Index Packs::index(const Set& set, const std::string& name) const
+{
+    State& state(*m_states.at(name));
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.index) return state.index;
+
+    if (!set.driver->isRemote())
+    {
+        state.index = std::make_shared<MappedFile>(
+                expandTilde(set.root + "index"));
+        return state.index;
+    }
+
+    // Fetch the index beside any earlier copy, and then replace it, so that
+    // mappings of that copy remain valid.
+    if (!mkdirp(m_dir))
+    {
+        throw ArbiterError("Could not create pack directory " + m_dir);
+    }
+
+    const std::string local(
+            m_dir + crypto::encodeAsHex(crypto::sha256(set.path)) + ".idx");
+    const std::string temp(([&local]()
+    {
+        std::random_device random;
+        return local + "." + std::to_string(random()) + ".tmp";
+    })());
+
+    const std::vector<char> data(set.driver->getBinary(set.root + "index"));
+    {
+        std::ofstream stream(
+                temp,
+                std::ofstream::binary | std::ofstream::out |
+                    std::ofstream::trunc);
+        stream.write(data.data(), data.size());
+        stream.close();
+        if (!stream.good())
+        {
+            std::remove(temp.c_str());
+            throw ArbiterError("Could not write pack index " + temp);
+        }
+    }
+
+    if (std::rename(temp.c_str(), local.c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+        throw ArbiterError("Could not replace pack index " + local);
+    }
+
+    state.index = std::make_shared<MappedFile>(local);
+    return state.index;
+}
+
+std::unique_ptr<Packs::Entry> Packs::find(const std::string& path) const
+{
+    std::string rest;
+    const Set& set(split(path, rest));
+    const Index file(index(set, path.substr(0, path.find('/'))));
+    const PackIndex view(file->data(), file->size());
+
+    std::unique_ptr<Entry> entry;
+    const std::size_t i(view.lowerBound(rest));
+    if (i < view.count() && view.path(i) == rest)
+    {
+        entry.reset(new Entry());
+        entry->pack = view.pack(i);
+        entry->offset = view.offset(i);
+        entry->size = view.size(i);
+    }
+    return entry;
+}
+
+void Packs::scan(
+        const std::string& name,
+        const std::string& prefix,
+        const std::function<void(const std::string&, const Entry&)>& f) const
+{
+    const Index file(index(m_sets.at(name), name));
+    const PackIndex view(file->data(), file->size());
+
+    for (std::size_t i(view.lowerBound(prefix)); i < view.count(); ++i)
+    {
+        const std::string p(view.path(i));
+        if (p.compare(0, prefix.size(), prefix) != 0) break;
+
+        Entry entry;
+        entry.pack = view.pack(i);
+        entry.offset = view.offset(i);
+        entry.size = view.size(i);
+        f(p, entry);
+    }
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/endpoint.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+class Executor;
+class MappedFile;
+
+/** @brief Writes many small files into a few large pack files beneath the
+ * root of an Endpoint, along with an index of where each one lies, so that
+ * storing them costs a request per pack rather than per file.
+ *
+ * Files are appended to the current pack, which is written as `pack-<n>`
+ * once the next file would take it beyond the pack size, and close writes
+ * the last pack and then the `index`.  The index is sorted by path, and
+ * holds for each file the pack, offset, and size at which its data lies,
+ * in a binary format which is searched in place, as by drivers::Packs.
+ * A file added more than once keeps its last data.
+ *
+ * Each root holds the packs of one writer, whose files aren't readable
+ * until it is closed.  Files which aren't written by close are lost.
+ */
+class ARBITER_DLL PackWriter
+{
+public:
+    /** Write packs of up to about @p packSize bytes beneath the root of
+     * @p endpoint.
+     */
+    explicit PackWriter(
+            Endpoint endpoint,
+            std::size_t packSize = 64 * 1024 * 1024);
+
+    /** Append @p data as the file @p path, relative to the root. */
+    void add(const std::string& path, const std::vector<char>& data);
+    void add(const std::string& path, const std::string& data);
+
+    /** Write what remains, and the index.  Nothing may be added after. */
+    void close();
+
+private:
+    struct Entry
+    {
+        std::string path;
+        std::uint32_t pack = 0;
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+    };
+
+    void add(const std::string& path, const char* data, std::size_t size);
+    void flush();
+
+    Endpoint m_endpoint;
+    const std::size_t m_packSize;
+
+    std::vector<char> m_pack;
+    std::uint32_t m_packs = 0;
+    std::vector<Entry> m_entries;
+    bool m_closed = false;
+};
+
+namespace drivers
+{
+
+/** @brief Reads of the files of named sets of packs, each written by a
+ * PackWriter.
+ *
+ * Paths are of the form `pack://<set>/<path>`.  The index of a set is
+ * fetched on first use into a local file, or used in place if its root is
+ * local, and is memory-mapped and searched there, so that sizes, existence,
+ * and listings cost no requests, and each read is a single ranged read of
+ * its pack.  Reads of many files at once by Packs::tryGetMany are merged
+ * into as few ranged reads as their positions allow.
+ *
+ * Packs are read-only, and a set whose packs are rewritten isn't seen to
+ * change by a driver which has already fetched its index.
+ */
+class ARBITER_DLL Packs : public Driver
+{
+public:
+    /** @brief A set of packs. */
+    struct Set
+    {
+        /** The driver of the root, which must outlive this one. */
+        const Driver* driver = nullptr;
+
+        /** The root of the packs, with its type, like `s3://bucket/dir/`. */
+        std::string path;
+
+        /** The root, stripped of its type. */
+        std::string root;
+    };
+
+    /** Read @p sets, by name, keeping fetched indexes within @p dir, and
+     * merging ranged reads of a pack separated by at most @p gap bytes,
+     * which are run on @p executor.
+     */
+    Packs(
+            std::map<std::string, Set> sets,
+            std::string dir,
+            std::size_t gap,
+            Executor& executor);
+
+    ~Packs();
+
+    /** Create a driver for the pack sets of the stringified JSON @p j,
+     * which is the `packs` entry of the Arbiter configuration, finding the
+     * driver of each root with @p find.  Its keys are:
+     *
+     * - `sets`: an object whose keys are the names of the sets, and whose
+     *   values are their roots, with their types, as given to PackWriter.
+     * - `dir`: the directory of fetched indexes, by default `arbiter-packs`
+     *   within the temporary directory.
+     * - `gap`: the most bytes between files of a pack read by
+     *   Packs::tryGetMany which are read together, by default 65536.
+     */
+    static std::unique_ptr<Packs> create(
+            const std::function<const Driver&(const std::string&)>& find,
+            std::string j,
+            Executor& executor);
+
+    virtual std::string type() const override { return "pack"; }
+
+    using Driver::put;
+
+    /** Throws ArbiterError, since packs are written with PackWriter. */
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual bool exists(std::string path) const override;
+
+    /** Ranged reads, as slices of the packs. */
+    virtual Capabilities capabilities() const override;
+
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    /** Read each of @p paths, with their types stripped, in the same order,
+     * where any which don't exist are null.  The reads of each pack are
+     * merged with Driver::getRanges, and the packs are read concurrently.
+     */
+    std::vector<std::unique_ptr<std::vector<char>>> tryGetMany(
+            const std::vector<std::string>& paths) const;
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    virtual void globPattern(
+            const Glob& glob,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    using Index = std::shared_ptr<const MappedFile>;
+
+    struct Entry
+    {
+        std::uint32_t pack = 0;
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+    };
+
+    struct State
+    {
+        std::mutex mutex;
+        Index index;
+    };
+
+    // The set named by @p path, whose remainder within the set is placed
+    // in @p rest.
+    const Set& split(const std::string& path, std::string& rest) const;
+
+    // The index of @p set, fetched first if need be.
+    Index index(const Set& set, const std::string& name) const;
+
+    // The entry of @p path within the set it names, if it has one.
+    std::unique_ptr<Entry> find(const std::string& path) const;
+
+    // Pass each file whose path, within the set of @p name, begins with
+    // @p prefix to @p f, with its path within the set.
+    void scan(
+            const std::string& name,
+            const std::string& prefix,
+            const std::function<void(const std::string&, const Entry&)>& f)
+        const;
+
+    Packs(const Packs&);
+    Packs& operator=(const Packs&);
+
+    const std::map<std::string, Set> m_sets;
+    const std::string m_dir;
+    const std::size_t m_gap;
+    Executor& m_executor;
+
+    // By set name.
+    std::map<std::string, std::unique_ptr<State>> m_states;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
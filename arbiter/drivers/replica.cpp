@@ -0,0 +1,623 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/replica.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/cancel.hpp>
+#include <arbiter/util/json.hpp>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <thread>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+namespace
+{
+    // The weight of each new sample of the latency of a replica.
+    const double latencyWeight(0.2);
+
+    // Every so many reads of a set, its least recently measured replica is
+    // tried first.
+    const std::size_t probeInterval(32);
+
+    // Failures beyond this many stop lengthening the cooldown.
+    const std::size_t maxBackoffs(6);
+
+    double toMs(const std::chrono::steady_clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    // Whether @p status found the file at @p path, throwing for failures
+    // other than its absence so that they count against the replica.
+    bool replicaFound(const Status& status, const std::string& path)
+    {
+        if (status.code == Status::Code::NotFound) return false;
+        if (!status)
+        {
+            throw ArbiterError(
+                    "Could not read replica " + path +
+                    (status.httpCode ?
+                        ": " + std::to_string(status.httpCode) : ""));
+        }
+        return true;
+    }
+
+    // A token for an attempt, inheriting the caller's deadline.
+    CancelToken attemptToken()
+    {
+        const CancelToken* outer(CancelScope::current());
+        return outer && outer->hasDeadline() ?
+            CancelToken(outer->deadline()) :
+            CancelToken();
+    }
+
+    // The state shared by a read and the hedge of it.
+    struct HedgeRace
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        bool primaryDone = false;
+
+        bool started = false;
+        bool done = false;
+        bool found = false;
+        std::vector<char> data;
+        std::exception_ptr error;
+        std::chrono::steady_clock::duration elapsed;
+    };
+}
+
+Replicated::Replicated(
+        std::map<std::string, std::vector<Replica>> sets,
+        const Options options)
+    : m_sets(std::move(sets))
+    , m_options(options)
+{
+    for (const auto& set : m_sets)
+    {
+        if (set.second.empty())
+        {
+            throw ArbiterError("Replica set " + set.first + " is empty");
+        }
+        m_health[set.first].replicas.resize(set.second.size());
+    }
+}
+
+std::unique_ptr<Replicated> Replicated::create(
+        const std::function<const Driver&(const std::string&)>& find,
+        const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+
+    Options options;
+    const json hedge(c.value("hedge", json(true)));
+    if (hedge.is_boolean()) options.hedge = hedge.get<bool>();
+    else if (hedge.is_object())
+    {
+        options.multiplier = hedge.value("multiplier", options.multiplier);
+        options.minDelay = std::chrono::milliseconds(
+                hedge.value("minDelay", options.minDelay.count()));
+        options.maxDelay = std::chrono::milliseconds(
+                hedge.value("maxDelay", options.maxDelay.count()));
+    }
+    if (options.maxDelay < options.minDelay)
+    {
+        options.maxDelay = options.minDelay;
+    }
+
+    options.cooldown = std::chrono::milliseconds(static_cast<std::int64_t>(
+            c.value("cooldown", 10.0) * 1000));
+
+    const json names(c.value("sets", json::object()));
+    std::map<std::string, std::vector<Replica>> sets;
+    for (const auto& set : names.items())
+    {
+        if (set.key().empty() || set.key().find('/') != std::string::npos)
+        {
+            throw ArbiterError("Invalid replica set name: " + set.key());
+        }
+
+        for (const json& r : set.value())
+        {
+            std::string path(r.get<std::string>());
+            if (path.size() && path.back() != '/') path += '/';
+            if (Arbiter::getType(path) == "replica")
+            {
+                throw ArbiterError("Replicas cannot nest: " + path);
+            }
+
+            Replica replica;
+            replica.driver = &find(path);
+            replica.path = path;
+            replica.root = Arbiter::stripType(path);
+            sets[set.key()].push_back(replica);
+        }
+    }
+
+    return std::unique_ptr<Replicated>(new Replicated(sets, options));
+}
+
+void Replicated::put(const std::string path, const std::vector<char>&) const
+{
+    throw ArbiterError("Cannot write to replicas: " + path);
+}
+
+std::unique_ptr<std::size_t> Replicated::tryGetSize(
+        const std::string path) const
+{
+    std::size_t size(0);
+    const bool found(failover(path, [&size](
+                const Replica& r,
+                const std::string& p)
+    {
+        return replicaFound(r.driver->tryReadSize(p, size), p);
+    }));
+    return found ? makeUnique<std::size_t>(size) : nullptr;
+}
+
+bool Replicated::exists(const std::string path) const
+{
+    return failover(path, [](const Replica& r, const std::string& p)
+    {
+        return r.driver->exists(p);
+    });
+}
+
+std::unique_ptr<std::string> Replicated::tryGetVersion(
+        const std::string path) const
+{
+    std::unique_ptr<std::string> version;
+    failover(path, [&version](const Replica& r, const std::string& p)
+    {
+        version = r.driver->tryGetVersion(p);
+        return !!version;
+    });
+    return version;
+}
+
+void Replicated::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    // Once any of the file has been passed along, another replica can't
+    // take over.
+    bool committed(false);
+    failover(path, [&](const Replica& r, const std::string& p)
+    {
+        r.driver->getStream(p, [&](const char* data, std::size_t size)
+        {
+            committed = true;
+            sink(data, size);
+        });
+        return true;
+    }, &committed);
+}
+
+Capabilities Replicated::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = true;
+    return c;
+}
+
+std::vector<char> Replicated::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    std::vector<char> data;
+    hedged(path, [offset, length](
+                const Replica& r,
+                const std::string& p,
+                std::vector<char>& out)
+    {
+        out = r.driver->getRange(p, offset, length);
+        return true;
+    }, data);
+    return data;
+}
+
+std::vector<std::string> Replicated::ranked(const std::string& name) const
+{
+    const auto it(m_sets.find(name));
+    if (it == m_sets.end()) throw ArbiterError("No replica set " + name);
+
+    std::vector<std::string> roots;
+    for (const std::size_t i : order(name, false))
+    {
+        roots.push_back(it->second[i].path);
+    }
+    return roots;
+}
+
+bool Replicated::get(const std::string path, std::vector<char>& data) const
+{
+    return hedged(path, [](
+                const Replica& r,
+                const std::string& p,
+                std::vector<char>& out)
+    {
+        return replicaFound(r.driver->tryRead(p, out), p);
+    }, data);
+}
+
+std::vector<std::string> Replicated::glob(
+        const std::string path,
+        const bool verbose) const
+{
+    std::vector<std::string> results;
+    list(path, [&results](FileInfo info)
+    {
+        results.push_back(std::move(info.path));
+    }, verbose);
+    return results;
+}
+
+void Replicated::glob(
+        const std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    list(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void Replicated::globInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    list(path, f, verbose);
+}
+
+void Replicated::globPattern(
+        const Glob& glob,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    list(glob.pattern(), f, verbose);
+}
+
+const std::vector<Replicated::Replica>& Replicated::split(
+        const std::string& path,
+        std::string& rest) const
+{
+    const std::size_t slash(path.find('/'));
+    const std::string name(path.substr(0, slash));
+
+    const auto it(m_sets.find(name));
+    if (it == m_sets.end()) throw ArbiterError("No replica set for " + path);
+
+    rest = slash == std::string::npos ? "" : path.substr(slash + 1);
+    return it->second;
+}
+
+std::vector<std::size_t> Replicated::order(
+        const std::string& name,
+        const bool read) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SetHealth& set(m_health.at(name));
+    const std::vector<Health>& health(set.replicas);
+    const Clock::time_point now(Clock::now());
+
+    std::vector<std::size_t> indices(health.size());
+    for (std::size_t i(0); i < indices.size(); ++i) indices[i] = i;
+
+    auto up([&](std::size_t i) { return health[i].downUntil <= now; });
+
+    std::stable_sort(
+            indices.begin(),
+            indices.end(),
+            [&](const std::size_t a, const std::size_t b)
+            {
+                const Health& x(health[a]);
+                const Health& y(health[b]);
+
+                if (up(a) != up(b)) return up(a);
+                if (!up(a)) return x.downUntil < y.downUntil;
+                if (x.measured != y.measured) return !x.measured;
+                return x.latency < y.latency;
+            });
+
+    if (read && ++set.reads % probeInterval == 0)
+    {
+        // Refresh the measurement of whichever healthy replica is stalest.
+        auto stalest(indices.begin());
+        for (auto it(indices.begin()); it != indices.end() && up(*it); ++it)
+        {
+            if (health[*it].measuredAt < health[*stalest].measuredAt)
+            {
+                stalest = it;
+            }
+        }
+        std::rotate(indices.begin(), stalest, stalest + 1);
+    }
+
+    return indices;
+}
+
+bool Replicated::failover(
+        const std::string& path,
+        const Attempt& f,
+        const bool* const committed) const
+{
+    std::string rest;
+    const std::vector<Replica>& replicas(split(path, rest));
+    const std::string name(path.substr(0, path.find('/')));
+
+    std::exception_ptr error;
+    for (const std::size_t i : order(name, true))
+    {
+        const Clock::time_point start(Clock::now());
+        try
+        {
+            const bool found(f(replicas[i], replicas[i].root + rest));
+            succeeded(name, i, Clock::now() - start);
+            if (found) return true;
+        }
+        catch (...)
+        {
+            CancelScope::check();
+            if (committed && *committed) throw;
+
+            failed(name, i);
+            error = std::current_exception();
+        }
+    }
+
+    if (error) std::rethrow_exception(error);
+    return false;
+}
+
+bool Replicated::hedged(
+        const std::string& path,
+        const Read& f,
+        std::vector<char>& data) const
+{
+    if (!m_options.hedge)
+    {
+        return failover(path, [&](const Replica& r, const std::string& p)
+        {
+            return f(r, p, data);
+        });
+    }
+
+    std::string rest;
+    const std::vector<Replica>& replicas(split(path, rest));
+    const std::string name(path.substr(0, path.find('/')));
+    const std::vector<std::size_t> ranked(order(name, true));
+
+    std::exception_ptr error;
+    std::size_t next(0);
+
+    while (next < ranked.size())
+    {
+        const std::size_t primary(ranked[next]);
+        const Replica& p(replicas[primary]);
+
+        // The last replica has none to hedge it.
+        if (next + 1 == ranked.size())
+        {
+            const Clock::time_point start(Clock::now());
+            try
+            {
+                const bool found(f(p, p.root + rest, data));
+                succeeded(name, primary, Clock::now() - start);
+                if (found) return true;
+            }
+            catch (...)
+            {
+                CancelScope::check();
+                failed(name, primary);
+                error = std::current_exception();
+            }
+            break;
+        }
+
+        const std::size_t backup(ranked[next + 1]);
+        const Replica& b(replicas[backup]);
+
+        const std::chrono::milliseconds delay(hedgeDelay(name, primary));
+        const CancelToken primaryToken(attemptToken());
+        const CancelToken backupToken(attemptToken());
+        HedgeRace race;
+
+        std::thread hedge([&]()
+        {
+            {
+                std::unique_lock<std::mutex> lock(race.mutex);
+                if (race.cv.wait_for(lock, delay, [&race]()
+                {
+                    return race.primaryDone;
+                }))
+                {
+                    return;
+                }
+                race.started = true;
+            }
+
+            std::vector<char> out;
+            bool found(false);
+            std::exception_ptr e;
+            const Clock::time_point start(Clock::now());
+
+            try
+            {
+                CancelScope scope(backupToken);
+                found = f(b, b.root + rest, out);
+            }
+            catch (...) { e = std::current_exception(); }
+
+            std::lock_guard<std::mutex> lock(race.mutex);
+            race.done = true;
+            race.found = found;
+            race.data = std::move(out);
+            race.error = e;
+            race.elapsed = Clock::now() - start;
+
+            if (!e && found) primaryToken.cancel();
+        });
+
+        bool found(false);
+        std::exception_ptr e;
+        const Clock::time_point start(Clock::now());
+
+        try
+        {
+            CancelScope scope(primaryToken);
+            found = f(p, p.root + rest, data);
+        }
+        catch (...) { e = std::current_exception(); }
+
+        const Clock::duration elapsed(Clock::now() - start);
+        {
+            std::lock_guard<std::mutex> lock(race.mutex);
+            race.primaryDone = true;
+            if (!e && found) backupToken.cancel();
+        }
+        race.cv.notify_all();
+        hedge.join();
+
+        CancelScope::check();
+
+        const bool won(race.done && !race.error && race.found);
+        if (!e)
+        {
+            succeeded(name, primary, elapsed);
+            if (found) return true;
+        }
+        else if (won)
+        {
+            // Cut short by the hedge, so it took at least this long.
+            measure(name, primary, elapsed);
+        }
+        else
+        {
+            failed(name, primary);
+            error = e;
+        }
+
+        if (race.started)
+        {
+            if (!race.error)
+            {
+                succeeded(name, backup, race.elapsed);
+                if (race.found)
+                {
+                    data = std::move(race.data);
+                    return true;
+                }
+            }
+            else
+            {
+                failed(name, backup);
+                error = race.error;
+            }
+            next += 2;
+        }
+        else next += 1;
+    }
+
+    if (error) std::rethrow_exception(error);
+    return false;
+}
+
+void Replicated::list(
+        const std::string& path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const std::string prefix(
+            type() + "://" + path.substr(0, path.find('/') + 1));
+
+    // Results are held until a replica has been listed in full, so that one
+    // which fails partway doesn't leave duplicates.
+    std::vector<FileInfo> results;
+    failover(path, [&](const Replica& r, const std::string& p)
+    {
+        results.clear();
+        r.driver->resolveInfo(p, [&](FileInfo info)
+        {
+            const std::string stripped(Arbiter::stripType(info.path));
+            if (stripped.compare(0, r.root.size(), r.root) != 0) return;
+
+            info.path = prefix + stripped.substr(r.root.size());
+            results.push_back(std::move(info));
+        }, verbose);
+        return true;
+    });
+
+    for (FileInfo& info : results) f(std::move(info));
+}
+
+std::chrono::milliseconds Replicated::hedgeDelay(
+        const std::string& name,
+        const std::size_t i) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Health& health(m_health.at(name).replicas.at(i));
+    if (!health.measured) return m_options.maxDelay;
+
+    const std::chrono::milliseconds delay(static_cast<std::int64_t>(
+                health.latency * m_options.multiplier));
+    return (std::min)(
+            (std::max)(delay, m_options.minDelay),
+            m_options.maxDelay);
+}
+
+void Replicated::measure(
+        const std::string& name,
+        const std::size_t i,
+        const Clock::duration d) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Health& health(m_health.at(name).replicas.at(i));
+
+    health.latency = health.measured ?
+        health.latency + latencyWeight * (toMs(d) - health.latency) :
+        toMs(d);
+    health.measured = true;
+    health.measuredAt = Clock::now();
+}
+
+void Replicated::succeeded(
+        const std::string& name,
+        const std::size_t i,
+        const Clock::duration d) const
+{
+    measure(name, i, d);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Health& health(m_health.at(name).replicas.at(i));
+    health.failures = 0;
+    health.downUntil = Clock::time_point();
+}
+
+void Replicated::failed(const std::string& name, const std::size_t i) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Health& health(m_health.at(name).replicas.at(i));
+
+    const std::size_t backoffs((std::min)(health.failures, maxBackoffs));
+    health.downUntil = Clock::now() + m_options.cooldown * (1 << backoffs);
+    ++health.failures;
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+/** @brief Reads of named sets of equivalent roots, like copies of a dataset
+ * in buckets of several regions and an HTTP mirror, from whichever copy
+ * answers fastest.
+ *
+ * Paths are of the form `replica://<set>/<path>`, and are read from
+ * `<path>` within one of the roots of the set.  Reads go first to the
+ * healthy replica with the lowest recent latency, as measured from the
+ * reads themselves, though replicas which have yet to be measured are
+ * tried first, and now and then the least recently measured one is, so
+ * that the measurements stay current.
+ *
+ * A whole-file or ranged read which hasn't completed within a few times
+ * the usual latency of its replica is hedged by the same read of the next
+ * replica, and whichever completes first is used, the other being
+ * cancelled.  Stalls are cut short where the replica's transfers observe
+ * cancellation, as HTTP ones do.  Each hedged read uses a thread of its
+ * own to wait on the hedge.
+ *
+ * A replica whose read fails is skipped in favor of the next, and is tried
+ * only after the others for a cooldown which doubles with each consecutive
+ * failure.  A file missing from one replica is looked for in the others,
+ * since replication may lag, so a file missing from all of them costs a
+ * lookup of each.  Globs list the first replica which can be listed.
+ * Replicas are read-only.
+ */
+class ARBITER_DLL Replicated : public Driver
+{
+public:
+    /** @brief One copy of a replica set. */
+    struct Replica
+    {
+        /** The driver of the copy, which must outlive this one. */
+        const Driver* driver = nullptr;
+
+        /** The root of the copy, with its type, like `s3://bucket/dir/`. */
+        std::string path;
+
+        /** The root of the copy, stripped of its type. */
+        std::string root;
+    };
+
+    /** @brief Tuning of the choice between replicas. */
+    struct Options
+    {
+        /** If false, reads are not hedged. */
+        bool hedge = true;
+
+        /** The multiple of the usual latency of a replica after which its
+         * reads are hedged.
+         */
+        double multiplier = 3;
+
+        /** Bounds of the delay before hedging, of which the upper is also
+         * used for replicas which have yet to be measured.
+         */
+        std::chrono::milliseconds minDelay = std::chrono::milliseconds(20);
+        std::chrono::milliseconds maxDelay = std::chrono::milliseconds(1000);
+
+        /** The time for which a replica is passed over after a failure,
+         * doubling with each consecutive failure.
+         */
+        std::chrono::milliseconds cooldown = std::chrono::milliseconds(10000);
+    };
+
+    /** Read the replica sets @p sets, by name, according to @p options. */
+    Replicated(
+            std::map<std::string, std::vector<Replica>> sets,
+            Options options);
+
+    /** Create a driver for the replica sets of the stringified JSON @p j,
+     * which is the `replicas` entry of the Arbiter configuration, finding
+     * the driver of each root with @p find.  Its keys are:
+     *
+     * - `sets`: an object whose keys are the names of the sets, and whose
+     *   values are arrays of their roots, with their types, like
+     *   `s3://bucket/dir/` or `https://mirror.example.com/dir/`.
+     * - `hedge`: false to disable hedging, or an object of its
+     *   `multiplier`, by default 3, and its `minDelay` and `maxDelay` in
+     *   milliseconds, by default 20 and 1000.
+     * - `cooldown`: the seconds for which a replica is passed over after a
+     *   failure, by default 10.
+     */
+    static std::unique_ptr<Replicated> create(
+            const std::function<const Driver&(const std::string&)>& find,
+            std::string j);
+
+    virtual std::string type() const override { return "replica"; }
+
+    using Driver::put;
+
+    /** Throws ArbiterError, since replicas are read-only. */
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual bool exists(std::string path) const override;
+
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    /** Ranged reads, from whichever replica serves them. */
+    virtual Capabilities capabilities() const override;
+
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    /** The roots of the set @p name, with their types, in the order in
+     * which reads would currently try them.
+     */
+    std::vector<std::string> ranked(const std::string& name) const;
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    virtual void globPattern(
+            const Glob& glob,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Makes an attempt at a replica, with the path within it, returning
+    // false if the file isn't there.
+    using Attempt =
+        std::function<bool(const Replica&, const std::string& path)>;
+
+    // As Attempt, but reading into its own buffer, so that two may race.
+    using Read = std::function<bool(
+            const Replica&,
+            const std::string& path,
+            std::vector<char>& data)>;
+
+    struct Health
+    {
+        // Recent latency, in milliseconds.
+        double latency = 0;
+        bool measured = false;
+        Clock::time_point measuredAt;
+
+        std::size_t failures = 0;
+        Clock::time_point downUntil;
+    };
+
+    struct SetHealth
+    {
+        std::vector<Health> replicas;
+        std::size_t reads = 0;
+    };
+
+    // The replicas of the set named by @p path, whose remainder within the
+    // set is placed in @p rest.
+    const std::vector<Replica>& split(
+            const std::string& path,
+            std::string& rest) const;
+
+    // The indices of the replicas of @p name in the order to try them,
+    // counting a read if @p read is set.
+    std::vector<std::size_t> order(const std::string& name, bool read) const;
+
+    // Try @p f at each replica of the set of @p path in turn until one
+    // finds the file, failing over on errors, which are rethrown if no
+    // replica answers.  Once @p committed is set, errors are rethrown at
+    // once.
+    bool failover(
+            const std::string& path,
+            const Attempt& f,
+            const bool* committed = nullptr) const;
+
+    // As failover, but hedging each attempt with the next replica.
+    bool hedged(
+            const std::string& path,
+            const Read& f,
+            std::vector<char>& data) const;
+
+    // Pass the listing of @p path, which may be globbed, to @p f.
+    void list(
+            const std::string& path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const;
+
+    std::chrono::milliseconds hedgeDelay(
+            const std::string& name,
+            std::size_t i) const;
+
+    void measure(const std::string& name, std::size_t i, Clock::duration d)
+        const;
+    void succeeded(const std::string& name, std::size_t i, Clock::duration d)
+        const;
+    void failed(const std::string& name, std::size_t i) const;
+
+    Replicated(const Replicated&);
+    Replicated& operator=(const Replicated&);
+
+    const std::map<std::string, std::vector<Replica>> m_sets;
+    const Options m_options;
+
+    mutable std::mutex m_mutex;
+    mutable std::map<std::string, SetHealth> m_health;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
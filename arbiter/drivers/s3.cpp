@@ -8,19 +8,25 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <deque>
 #include <functional>
-#include <iostream>
+#include <future>
+#include <map>
 #include <numeric>
 #include <sstream>
 #include <thread>
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/arbiter.hpp>
+#include <arbiter/drivers/compressed.hpp>
 #include <arbiter/drivers/fs.hpp>
 #include <arbiter/third/xml/xml.hpp>
+#include <arbiter/util/crc32c.hpp>
+#include <arbiter/util/executor.hpp>
 #include <arbiter/util/ini.hpp>
 #include <arbiter/util/json.hpp>
 #include <arbiter/util/md5.hpp>
+#include <arbiter/util/probes.hpp>
 #include <arbiter/util/sha256.hpp>
 #include <arbiter/util/transforms.hpp>
 #endif
@@ -39,6 +45,13 @@ namespace
     // Re-fetch credentials when there are less than 4 minutes remaining.  New
     // ones are guaranteed by AWS to be available within 5 minutes remaining.
     constexpr int64_t reauthSeconds(60 * 4);
+
+    // If background refreshes have failed until credentials are this close
+    // to expiring, block requests to fetch them instead.
+    constexpr int64_t expirySeconds(60);
+
+    // Delay between failed background refreshes.
+    constexpr int64_t retrySeconds(10);
 #endif
 
     // See:
@@ -53,44 +66,342 @@ namespace
     typedef Xml::xml_node<> XmlNode;
     const std::string badResponse("Unexpected contents in AWS response");
 
-    std::string toLower(const std::string& in)
+    // https://docs.aws.amazon.com/AmazonS3/latest/userguide/qfacts.html
+    const std::size_t minPartSize(5 * 1024 * 1024);
+    const std::size_t maxParts(10000);
+    const std::size_t partTries(3);
+
+    // The largest object which may be copied in a single request, and so
+    // the largest part of a multipart copy.
+    const std::size_t maxCopyPartSize(5ull * 1024 * 1024 * 1024);
+
+    // The longest that a presigned URL may be valid.
+    const int64_t maxPresignSeconds(60 * 60 * 24 * 7);
+
+    // The most keys which may be removed by a single DeleteObjects request.
+    const std::size_t maxDeleteKeys(1000);
+
+    // Sessions of directory buckets last five minutes, and are replaced
+    // within a minute of their expiration.
+    constexpr int64_t sessionRefreshSeconds(60);
+
+    std::string endpointsPath(const json& c)
+    {
+        if (const auto e = env("AWS_ENDPOINTS_FILE")) return *e;
+        if (c.count("endpointsFile"))
+        {
+            return c["endpointsFile"].get<std::string>();
+        }
+        return "~/.aws/endpoints.json";
+    }
+
+    // The availability zone of a directory bucket, named like
+    // <base>--<zone>--x-s3, or an empty string for other buckets.
+    std::string zoneOf(const std::string& bucket)
+    {
+        const std::string suffix("--x-s3");
+        if (bucket.size() <= suffix.size() ||
+                bucket.compare(
+                    bucket.size() - suffix.size(),
+                    suffix.size(),
+                    suffix) != 0)
+        {
+            return "";
+        }
+
+        const std::string rest(bucket.substr(0, bucket.size() - suffix.size()));
+        const std::size_t split(rest.rfind("--"));
+        return split != std::string::npos ? rest.substr(split + 2) : "";
+    }
+
+    // The fields of a line of an S3 Inventory CSV file, in which each field
+    // is quoted and any quotes within it are doubled.
+    std::vector<std::string> inventoryFields(const std::string& line)
     {
-        return std::accumulate(
-                in.begin(),
-                in.end(),
-                std::string(),
-                [](const std::string& out, const char c) -> std::string
+        std::vector<std::string> fields(1);
+        bool quoted(false);
+
+        for (std::size_t i(0); i < line.size(); ++i)
+        {
+            const char c(line[i]);
+            if (c == '"')
+            {
+                if (quoted && i + 1 < line.size() && line[i + 1] == '"')
                 {
-                    return out + static_cast<char>(::tolower(c));
-                });
+                    fields.back().push_back(c);
+                    ++i;
+                }
+                else quoted = !quoted;
+            }
+            else if (c == ',' && !quoted) fields.emplace_back();
+            else if (c != '\r' || quoted) fields.back().push_back(c);
+        }
+
+        return fields;
+    }
+
+    // Inventory and event notification keys are URL-encoded, with spaces as
+    // '+'.
+    std::string decodeKey(const std::string& key)
+    {
+        auto hex([](const char c) -> int
+        {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        });
+
+        std::string out;
+        for (std::size_t i(0); i < key.size(); ++i)
+        {
+            if (key[i] == '+') out.push_back(' ');
+            else if (key[i] == '%' && i + 2 < key.size() &&
+                    hex(key[i + 1]) >= 0 && hex(key[i + 2]) >= 0)
+            {
+                out.push_back(
+                        static_cast<char>(
+                            hex(key[i + 1]) * 16 + hex(key[i + 2])));
+                i += 2;
+            }
+            else out.push_back(key[i]);
+        }
+        return out;
+    }
+
+    std::string xmlEscape(const std::string& s)
+    {
+        std::string out;
+        for (const char c : s)
+        {
+            if (c == '&') out += "&amp;";
+            else if (c == '<') out += "&lt;";
+            else if (c == '>') out += "&gt;";
+            else if (c == '"') out += "&quot;";
+            else if (c == '\'') out += "&apos;";
+            else out.push_back(c);
+        }
+        return out;
+    }
+
+    // Header names are matched regardless of case, and some S3-compatible
+    // servers do not match the capitalization used by AWS.
+    std::string findHeader(const http::Headers& headers, const std::string& key)
+    {
+        const auto it(headers.find(key));
+        return it != headers.end() ? it->second : std::string();
+    }
+
+    // The offset of the body of @p res within its object, which is zero
+    // for a response which isn't ranged.
+    bool s3RangeBegin(const http::Response& res, std::size_t& begin)
+    {
+        begin = 0;
+        if (res.code() != 206) return true;
+
+        const std::string range(findHeader(res.headers(), "Content-Range"));
+        const std::string prefix("bytes ");
+        if (range.compare(0, prefix.size(), prefix) ||
+                range.size() == prefix.size() ||
+                !std::isdigit(range[prefix.size()]))
+        {
+            return false;
+        }
+
+        begin = std::stoull(range.substr(prefix.size()));
+        return true;
+    }
+
+    std::string toLower(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+        return s;
     }
 
     // Trims sequential whitespace into a single character, and trims all
     // leading and trailing whitespace.
     std::string trim(const std::string& in)
     {
-        std::string s = std::accumulate(
-                in.begin(),
-                in.end(),
-                std::string(),
-                [](const std::string& out, const char c) -> std::string
-                {
-                    if (
-                        std::isspace(c) &&
-                        (out.empty() || std::isspace(out.back())))
-                    {
-                        return out;
-                    }
-                    else
-                    {
-                        return out + c;
-                    }
-                });
+        std::string s;
+        s.reserve(in.size());
+
+        for (const char c : in)
+        {
+            if (!std::isspace(c) || (s.size() && !std::isspace(s.back())))
+            {
+                s.push_back(c);
+            }
+        }
 
         // Might have one trailing whitespace character.
         if (s.size() && std::isspace(s.back())) s.pop_back();
         return s;
     }
+
+    std::string toUpper(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+        return s;
+    }
+
+    // Decodes the binary event stream of an S3 Select response as it
+    // arrives, passing the payloads of its Records events to a sink.  Each
+    // message is a prelude of its total and header lengths and a CRC, its
+    // headers, its payload, and another CRC.  The CRCs are not checked,
+    // which leaves integrity to the transport as for unsigned payloads.
+    //
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/RESTSelectObjectAppendix.html
+    class SelectStream
+    {
+    public:
+        using Sink = std::function<void(const char*, std::size_t)>;
+
+        explicit SelectStream(const Sink& sink) : m_sink(sink) { }
+
+        void write(const char* data, const std::size_t size)
+        {
+            // Whole messages are decoded where they lie, and only a partial
+            // one is kept for the data which completes it.
+            if (m_partial.empty())
+            {
+                const std::size_t used(consume(data, size));
+                m_partial.assign(data + used, data + size);
+                return;
+            }
+
+            m_partial.insert(m_partial.end(), data, data + size);
+            const std::size_t used(consume(m_partial.data(), m_partial.size()));
+            m_partial.erase(m_partial.begin(), m_partial.begin() + used);
+        }
+
+        // True once the End event has arrived, without which the records
+        // may be incomplete.
+        bool ended() const { return m_ended; }
+
+    private:
+        static constexpr std::size_t prelude = 12;
+        static constexpr std::size_t trailer = 4;
+
+        static uint32_t readInt(const char* p, const std::size_t bytes)
+        {
+            uint32_t v(0);
+            for (std::size_t i(0); i < bytes; ++i)
+            {
+                v = (v << 8) | static_cast<uint8_t>(p[i]);
+            }
+            return v;
+        }
+
+        // Decode the whole messages at the front of @p data, returning the
+        // number of bytes they span.
+        std::size_t consume(const char* data, const std::size_t size)
+        {
+            std::size_t pos(0);
+            while (size - pos >= prelude)
+            {
+                const std::size_t total(readInt(data + pos, 4));
+                if (total < prelude + trailer) throw ArbiterError(badResponse);
+                if (size - pos < total) break;
+
+                message(data + pos, total);
+                pos += total;
+            }
+            return pos;
+        }
+
+        void message(const char* data, const std::size_t total)
+        {
+            const std::size_t headersLength(readInt(data + 4, 4));
+            if (prelude + headersLength + trailer > total)
+            {
+                throw ArbiterError(badResponse);
+            }
+
+            std::map<std::string, std::string> headers;
+            const char* p(data + prelude);
+            const char* const end(p + headersLength);
+
+            while (p < end)
+            {
+                const std::size_t nameLength(static_cast<uint8_t>(*p++));
+                if (end - p < std::ptrdiff_t(nameLength + 1))
+                {
+                    throw ArbiterError(badResponse);
+                }
+
+                const std::string name(p, nameLength);
+                p += nameLength;
+
+                // Values of types 6 and 7, byte arrays and strings, are
+                // prefixed by their lengths.  The rest are of fixed sizes.
+                const int type(*p++);
+                std::size_t length(0);
+                if (type == 6 || type == 7)
+                {
+                    if (end - p < 2) throw ArbiterError(badResponse);
+                    length = readInt(p, 2);
+                    p += 2;
+                }
+                else if (type == 2) length = 1;
+                else if (type == 3) length = 2;
+                else if (type == 4) length = 4;
+                else if (type == 5 || type == 8) length = 8;
+                else if (type == 9) length = 16;
+                else if (type != 0 && type != 1)
+                {
+                    throw ArbiterError(badResponse);
+                }
+
+                if (end - p < std::ptrdiff_t(length))
+                {
+                    throw ArbiterError(badResponse);
+                }
+                if (type == 7) headers[name] = std::string(p, length);
+                p += length;
+            }
+
+            if (headers[":message-type"] == "error")
+            {
+                throw ArbiterError(
+                        "S3 Select failed: " + headers[":error-code"] +
+                        ": " + headers[":error-message"]);
+            }
+
+            const std::string& event(headers[":event-type"]);
+            if (event == "Records")
+            {
+                m_sink(end, total - prelude - headersLength - trailer);
+            }
+            else if (event == "End") m_ended = true;
+        }
+
+        const Sink& m_sink;
+        std::vector<char> m_partial;
+        bool m_ended = false;
+    };
+
+    // Every signature formats the current time, which only changes once per
+    // second, so each thread keeps its formatted string for that second.  The
+    // date is its prefix.
+    struct SigningTime
+    {
+        std::time_t time = -1;
+        std::string dateTime;
+    };
+
+    const std::string& signingTime()
+    {
+        thread_local SigningTime cached;
+
+        const std::time_t now(std::time(nullptr));
+        if (now != cached.time)
+        {
+            cached.time = now;
+            cached.dateTime = Time(now).str(Time::iso8601NoSeparators);
+        }
+
+        return cached.dateTime;
+    }
 }
 
 namespace drivers
@@ -101,12 +412,13 @@ using namespace http;
 S3::S3(
         Pool& pool,
         std::string profile,
-        std::unique_ptr<Auth> auth,
+        std::shared_ptr<Auth> auth,
         std::unique_ptr<Config> config)
     : Http(pool)
     , m_profile(profile)
     , m_auth(std::move(auth))
     , m_config(std::move(config))
+    , m_signingKeys(new SigningKeys())
 { }
 
 std::vector<std::unique_ptr<S3>> S3::create(Pool& pool, const std::string s)
@@ -133,15 +445,42 @@ std::vector<std::unique_ptr<S3>> S3::create(Pool& pool, const std::string s)
     return result;
 }
 
-std::unique_ptr<S3> S3::createOne(Pool& pool, const std::string s)
+std::unique_ptr<S3> S3::createOne(
+        Pool& pool,
+        const std::string s,
+        Runtime* const runtime)
 {
     const json j(s.size() ? json::parse(s) : json());
     const std::string profile(extractProfile(j.dump()));
 
-    auto auth(Auth::create(j.dump(), profile));
+    const std::function<std::shared_ptr<Auth>()> discover([&]()
+    {
+        return std::shared_ptr<Auth>(Auth::create(j.dump(), profile));
+    });
+
+    // Keyed by the whole configuration, since its credentials may differ
+    // from those of another with the same profile.
+    const std::string key("s3:" + profile + ":" + j.dump());
+    const std::shared_ptr<Auth> auth(
+            runtime ? runtime->shared<Auth>(key, discover) : discover());
     if (!auth) return std::unique_ptr<S3>();
 
     std::unique_ptr<Config> config(new Config(j.dump(), profile));
+
+    // Connections are per bucket, so warming needs to know the buckets.
+    const json warming(j.is_object() ? j.value("warm", json()) : json());
+    if (warming.is_object())
+    {
+        std::vector<std::string> urls;
+        for (const auto& bucket : warming.value("buckets", json::array()))
+        {
+            const std::string b(bucket.get<std::string>() + "/");
+            urls.push_back(
+                    Resource(config->baseUrl(), b, config->region()).url());
+        }
+        pool.warm(urls, warming.value("count", std::size_t(1)));
+    }
+
     auto s3 = makeUnique<S3>(pool, profile, std::move(auth), std::move(config));
     return s3;
 }
@@ -239,12 +578,22 @@ std::unique_ptr<S3::Auth> S3::Auth::create(
                 config.value("allowInstanceProfile", false)) ||
             env("AWS_ALLOW_INSTANCE_PROFILE"))
     {
+        // With a credential cache, a process started shortly after another
+        // skips the instance metadata entirely.
+        const std::shared_ptr<CredentialCache> cache(
+                CredentialCache::create(s));
+        const std::string cacheKey("s3:" + profile + ":" + config.dump());
+        if (cache)
+        {
+            if (auto auth = restore(cache, cacheKey)) return auth;
+        }
+
         http::Pool pool;
         drivers::Http httpDriver(pool);
 
         if (const auto iamRole = httpDriver.tryGet(credBase))
         {
-            return makeUnique<Auth>(*iamRole);
+            return makeUnique<Auth>(*iamRole, cache, cacheKey);
         }
     }
 #endif
@@ -253,13 +602,54 @@ std::unique_ptr<S3::Auth> S3::Auth::create(
 }
 
 S3::Config::Config(const std::string s, const std::string profile)
-    : m_region(extractRegion(s, profile))
-    , m_baseUrl(extractBaseUrl(s, m_region))
+    : m_json(s)
+    , m_region(extractRegion(s, profile))
+    , m_hostStyle(extractHostStyle(s, HostStyle()))
+    , m_baseUrl(extractBaseUrl(s, m_region, m_hostStyle))
+    , m_dnsSuffix(extractDnsSuffix(s))
 {
     const json c(s.size() ? json::parse(s) : json());
     if (c.is_null()) return;
 
-    m_precheck = c.value("precheck", false);
+    m_endpoint = c.value("endpoint", std::string()).size() > 0;
+
+    const json buckets(c.value("buckets", json::object()));
+    for (const auto& b : buckets.items())
+    {
+        const HostStyle style(extractHostStyle(b.value().dump(), m_hostStyle));
+        m_bucketStyles[b.key()] = style;
+        m_bucketUrls[b.key()] = extractBaseUrl(s, m_region, style);
+    }
+
+    m_unsignedPayload =
+        c.value("unsignedPayload", false) || env("AWS_UNSIGNED_PAYLOAD");
+    m_partGets = c.value("partGets", false);
+
+    const std::string checksum(c.value("checksum", std::string()));
+    if (checksum == "crc32c") m_crc32c = true;
+    else if (checksum.size())
+    {
+        throw ArbiterError("Unknown S3 checksum: " + checksum);
+    }
+
+    m_multipartThreshold =
+        c.value("multipartThreshold", m_multipartThreshold);
+    m_partSize = (std::max)(c.value("partSize", m_partSize), minPartSize);
+    m_copyPartSize = (std::min)(
+            (std::max)(c.value("copyPartSize", m_copyPartSize), minPartSize),
+            maxCopyPartSize);
+
+    const json inventories(c.value("inventory", json::object()));
+    for (const auto& i : inventories.items())
+    {
+        m_inventories[i.key()] =
+            Arbiter::stripType(i.value().get<std::string>());
+    }
+
+    const json notifications(c.value("notifications", json::object()));
+    m_queue = notifications.value("queue", std::string());
+    m_queueRegion = notifications.value("region", m_region);
+    m_queueWait = notifications.value("wait", m_queueWait);
 
     if (c.value("sse", false)|| env("AWS_SSE"))
     {
@@ -284,10 +674,82 @@ S3::Config::Config(const std::string s, const std::string profile)
         }
         else
         {
-            std::cout << "s3.headers expected to be object - skipping" <<
-                std::endl;
+            logging::warn("s3.headers expected to be object - skipping");
+        }
+    }
+
+    m_readHeaders = m_baseHeaders;
+    m_readHeaders.erase("x-amz-server-side-encryption");
+}
+
+std::string S3::Config::baseUrl(
+        const std::string& bucket,
+        const std::string& region) const
+{
+    const std::string zone(zoneOf(bucket));
+    if (zone.size() && !m_endpoint)
+    {
+        return "s3express-" + zone + "." + region + "." + m_dnsSuffix;
+    }
+
+    if (region == m_region)
+    {
+        const auto it(m_bucketUrls.find(bucket));
+        return it != m_bucketUrls.end() ? it->second : m_baseUrl;
+    }
+
+    const auto it(m_bucketStyles.find(bucket));
+    return extractBaseUrl(
+            m_json,
+            region,
+            it != m_bucketStyles.end() ? it->second : m_hostStyle);
+}
+
+const std::string* S3::Config::inventory(const std::string& bucket) const
+{
+    const auto it(m_inventories.find(bucket));
+    return it != m_inventories.end() ? &it->second : nullptr;
+}
+
+std::string S3::Config::extractDnsSuffix(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+
+    std::string dnsSuffix("amazonaws.com");
+
+    drivers::Fs fsDriver;
+    if (std::unique_ptr<std::string> e = fsDriver.tryGet(endpointsPath(c)))
+    {
+        const json ep(json::parse(*e));
+        for (const auto& partition : ep["partitions"])
+        {
+            if (partition.count("dnsSuffix"))
+            {
+                dnsSuffix = partition["dnsSuffix"].get<std::string>();
+            }
         }
     }
+
+    if (dnsSuffix.size() && dnsSuffix.back() != '/') dnsSuffix += '/';
+    return dnsSuffix;
+}
+
+S3::Config::HostStyle S3::Config::extractHostStyle(
+        const std::string s,
+        HostStyle style)
+{
+    const json c(s.size() ? json::parse(s) : json());
+
+    if (const auto e = env("AWS_USE_DUALSTACK_ENDPOINT"))
+    {
+        style.dualstack = *e == "true";
+    }
+
+    if (!c.is_object()) return style;
+
+    style.accelerate = c.value("accelerate", style.accelerate);
+    style.dualstack = c.value("dualstack", style.dualstack);
+    return style;
 }
 
 std::string S3::Config::extractRegion(
@@ -328,7 +790,7 @@ std::string S3::Config::extractRegion(
 
     if (c.value("verbose", false))
     {
-        std::cout << "Region not found - defaulting to us-east-1" << std::endl;
+        logging::info("Region not found - defaulting to us-east-1");
     }
 
     return "us-east-1";
@@ -336,7 +798,8 @@ std::string S3::Config::extractRegion(
 
 std::string S3::Config::extractBaseUrl(
         const std::string s,
-        const std::string region)
+        const std::string region,
+        const HostStyle style)
 {
     const json c(s.size() ? json::parse(s) : json());
 
@@ -348,21 +811,10 @@ std::string S3::Config::extractBaseUrl(
         return path.back() == '/' ? path : path + '/';
     }
 
-    std::string endpointsPath("~/.aws/endpoints.json");
-
-    if (const auto e = env("AWS_ENDPOINTS_FILE"))
-    {
-        endpointsPath = *e;
-    }
-    else if (c.count("endpointsFile"))
-    {
-        endpointsPath = c["endpointsFile"].get<std::string>();
-    }
-
     std::string dnsSuffix("amazonaws.com");
 
     drivers::Fs fsDriver;
-    if (std::unique_ptr<std::string> e = fsDriver.tryGet(endpointsPath))
+    if (std::unique_ptr<std::string> e = fsDriver.tryGet(endpointsPath(c)))
     {
         const json ep(json::parse(*e));
 
@@ -378,7 +830,8 @@ std::string S3::Config::extractBaseUrl(
 
             for (const auto& r : endpoints.items())
             {
-                if (r.key() == region &&
+                if (!style.accelerate && !style.dualstack &&
+                        r.key() == region &&
                         endpoints.value("region", json::object())
                             .count("hostname"))
                 {
@@ -391,205 +844,2364 @@ std::string S3::Config::extractBaseUrl(
 
     if (dnsSuffix.size() && dnsSuffix.back() != '/') dnsSuffix += '/';
 
+    // Transfer Acceleration hosts are global, routing requests through the
+    // nearest edge location to the region of the bucket, for which requests
+    // are still signed.
+    if (style.accelerate)
+    {
+        return std::string("s3-accelerate.") +
+            (style.dualstack ? "dualstack." : "") + dnsSuffix;
+    }
+
+    // Dual-stack hosts are regional, and resolve to IPv6 as well as IPv4.
+    if (style.dualstack) return "s3.dualstack." + region + "." + dnsSuffix;
+
     // https://docs.aws.amazon.com/general/latest/gr/rande.html#s3_region
     if (region == "us-east-1") return "s3." + dnsSuffix;
     else return "s3-" + region + "." + dnsSuffix;
 }
 
-S3::AuthFields S3::Auth::fields() const
-{
-#ifdef ARBITER_CURL
-    if (m_role)
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
+S3::Auth::Auth(
+        const std::string access,
+        const std::string hidden,
+        const std::string token)
+    : m_snapshot(
+            std::make_shared<const Snapshot>(
+                AuthFields(access, hidden, token),
+                Time()))
+{ }
 
-        const Time now;
-        if (!m_expiration || *m_expiration - now < reauthSeconds)
-        {
-            http::Pool pool;
-            drivers::Http httpDriver(pool);
+S3::Auth::Auth(
+        const std::string iamRole,
+        const std::shared_ptr<CredentialCache> cache,
+        const std::string cacheKey)
+    : m_role(makeUnique<std::string>(iamRole))
+    , m_cache(cache)
+    , m_cacheKey(cacheKey)
+{ }
 
-            const json creds(json::parse(httpDriver.get(credBase + *m_role)));
-            m_access = creds.at("AccessKeyId").get<std::string>();
-            m_hidden = creds.at("SecretAccessKey").get<std::string>();
-            m_token = creds.at("Token").get<std::string>();
-            m_expiration.reset(
-                    new Time(
-                        creds.at("Expiration").get<std::string>(),
-                        arbiter::Time::iso8601));
+std::unique_ptr<S3::Auth> S3::Auth::restore(
+        const std::shared_ptr<CredentialCache> cache,
+        const std::string cacheKey)
+{
+    std::unique_ptr<Auth> auth;
 
-            if (*m_expiration - now < reauthSeconds)
-            {
-                throw ArbiterError("Got invalid instance profile credentials");
-            }
-        }
+#ifdef ARBITER_CURL
+    int64_t expiration(0);
+    const auto cached(cache->get(cacheKey, expirySeconds, expiration));
+    if (!cached) return auth;
 
-        // If we're using an IAM role, make sure to create this before
-        // releasing the lock.
-        return S3::AuthFields(m_access, m_hidden, m_token);
+    try
+    {
+        const json creds(json::parse(*cached));
+        auth = makeUnique<Auth>(
+                creds.at("role").get<std::string>(),
+                cache,
+                cacheKey);
+        auth->m_snapshot = std::make_shared<const Snapshot>(
+                AuthFields(
+                    creds.at("access").get<std::string>(),
+                    creds.at("hidden").get<std::string>(),
+                    creds.at("token").get<std::string>()),
+                Time(expiration));
+    }
+    catch (...)
+    {
+        return std::unique_ptr<Auth>();
     }
+
+    // Since fields() won't need to fetch, the refresher starts here.
+    Auth* const self(auth.get());
+    auth->m_refresher = std::thread([self]() { self->run(); });
 #endif
 
-    return S3::AuthFields(m_access, m_hidden, m_token);
+    return auth;
 }
 
-std::string S3::type() const
+S3::Auth::~Auth()
 {
-    if (m_profile == "default") return "s3";
-    else return m_profile + "@s3";
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+
+    m_cv.notify_all();
+    if (m_refresher.joinable()) m_refresher.join();
 }
 
-std::unique_ptr<std::size_t> S3::tryGetSize(std::string rawPath) const
+S3::AuthFields S3::Auth::fields() const
 {
-    std::unique_ptr<std::size_t> size;
-
-    Headers headers(m_config->baseHeaders());
-    headers.erase("x-amz-server-side-encryption");
+    std::shared_ptr<const Snapshot> current(std::atomic_load(&m_snapshot));
 
-    const Resource resource(m_config->baseUrl(), rawPath);
-    const ApiV4 apiV4(
-            "HEAD",
-            m_config->region(),
-            resource,
-            m_auth->fields(),
-            Query(),
-            headers,
-            empty);
+#ifdef ARBITER_CURL
+    // Normally the background thread keeps our credentials fresh, so we only
+    // block here for the first fetch, or if the refresher has been failing
+    // long enough that our credentials are about to expire.
+    if (m_role &&
+            (!current || current->expiration - Time() < expirySeconds))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
 
-    drivers::Http http(m_pool);
-    Response res(http.internalHead(resource.url(), apiV4.headers()));
+        current = std::atomic_load(&m_snapshot);
+        if (!current || current->expiration - Time() < expirySeconds)
+        {
+            current = refresh();
+        }
 
-    if (res.ok() && res.headers().count("Content-Length"))
-    {
-        const std::string& str(res.headers().at("Content-Length"));
-        size.reset(new std::size_t(std::stoul(str)));
+        if (!m_refresher.joinable())
+        {
+            m_refresher = std::thread([this]() { run(); });
+        }
     }
+#endif
 
-    return size;
+    if (!current) throw ArbiterError("No S3 credentials available");
+    return current->fields;
 }
 
-bool S3::get(
-        const std::string rawPath,
-        std::vector<char>& data,
-        const Headers userHeaders,
-        const Query query) const
+std::shared_ptr<const S3::Auth::Snapshot> S3::Auth::refresh() const
 {
-    Headers headers(m_config->baseHeaders());
-    headers.erase("x-amz-server-side-encryption");
-    headers.insert(userHeaders.begin(), userHeaders.end());
+#ifdef ARBITER_CURL
+    if (!m_pool) m_pool.reset(new http::Pool());
+    drivers::Http httpDriver(*m_pool);
+
+    const json creds(json::parse(httpDriver.get(credBase + *m_role)));
+
+    std::shared_ptr<const Snapshot> next(
+            std::make_shared<const Snapshot>(
+                AuthFields(
+                    creds.at("AccessKeyId").get<std::string>(),
+                    creds.at("SecretAccessKey").get<std::string>(),
+                    creds.at("Token").get<std::string>()),
+                Time(
+                    creds.at("Expiration").get<std::string>(),
+                    arbiter::Time::iso8601)));
+
+    if (next->expiration - Time() < reauthSeconds)
+    {
+        throw ArbiterError("Got invalid instance profile credentials");
+    }
 
-    std::unique_ptr<std::size_t> size(
-            m_config->precheck() && !headers.count("Range") ?
-                tryGetSize(rawPath) : nullptr);
+    std::atomic_store(&m_snapshot, next);
 
-    const Resource resource(m_config->baseUrl(), rawPath);
-    const ApiV4 apiV4(
-            "GET",
-            m_config->region(),
-            resource,
-            m_auth->fields(),
+    if (m_cache)
+    {
+        const json cached {
+            { "role", *m_role },
+            { "access", next->fields.access() },
+            { "hidden", next->fields.hidden() },
+            { "token", next->fields.token() }
+        };
+        m_cache->put(m_cacheKey, cached.dump(), next->expiration.asUnix());
+    }
+
+    return next;
+#else
+    throw ArbiterError("Cannot fetch instance profile credentials");
+#endif
+}
+
+void S3::Auth::run() const
+{
+#ifdef ARBITER_CURL
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_done)
+    {
+        // Wake once our credentials are within the reauthorization window,
+        // and then try to replace them, backing off after failures.
+        const std::shared_ptr<const Snapshot> current(
+                std::atomic_load(&m_snapshot));
+        const int64_t remaining(current->expiration - Time());
+
+        if (remaining >= reauthSeconds)
+        {
+            const std::chrono::seconds wait(remaining - reauthSeconds);
+            m_cv.wait_for(lock, wait);
+            continue;
+        }
+
+        try
+        {
+            refresh();
+        }
+        catch (...)
+        {
+            m_cv.wait_for(lock, std::chrono::seconds(retrySeconds));
+        }
+    }
+#endif
+}
+
+std::string S3::type() const
+{
+    if (m_profile == "default") return "s3";
+    else return m_profile + "@s3";
+}
+
+Capabilities S3::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = true;
+    c.serverSideCopy = true;
+    c.multipart = true;
+    c.delimiters = true;
+    c.listingMetadata = true;
+    c.changeNotifications = !m_config->queue().empty();
+    return c;
+}
+
+std::string S3::typeOf(const std::string j)
+{
+    const std::string profile(extractProfile(j));
+    if (profile == "default") return "s3";
+    else return profile + "@s3";
+}
+
+S3::Resource S3::resourceOf(const std::string& path) const
+{
+    const std::size_t split(path.find('/'));
+    const std::shared_ptr<const Resource> bucket(
+            bucketResource(path.substr(0, split)));
+    return bucket->child(
+            split != std::string::npos ? path.substr(split + 1) : "");
+}
+
+std::shared_ptr<const S3::Resource> S3::bucketResource(
+        const std::string& bucket) const
+{
+    std::lock_guard<std::mutex> lock(m_locationsMutex);
+
+    std::shared_ptr<const Resource>& resource(m_buckets[bucket]);
+    if (resource) return resource;
+
+    const auto it(m_locations.find(bucket));
+    if (it != m_locations.end())
+    {
+        resource = std::make_shared<Resource>(
+                it->second.baseUrl,
+                bucket,
+                it->second.region);
+    }
+    else
+    {
+        // Buckets may be configured for hosts other than those of the
+        // profile.
+        const std::string& region(m_config->region());
+        resource = std::make_shared<Resource>(
+                m_config->baseUrl(bucket, region),
+                bucket,
+                region);
+    }
+    return resource;
+}
+
+bool S3::located(const std::string& path) const
+{
+    const Resource resource(resourceOf(path));
+
+    std::lock_guard<std::mutex> lock(m_locationsMutex);
+    return m_locations.count(resource.bucket()) > 0;
+}
+
+bool S3::learnRegion(const Resource& resource, const Response& res) const
+{
+    // A bucket outside the region for which a request is signed is reported
+    // by a PermanentRedirect, or an AuthorizationHeaderMalformed error,
+    // either of which names its region.
+    const std::string region(
+            res.code() == 301 || res.code() == 307 || res.code() == 400 ?
+                findHeader(res.headers(), "x-amz-bucket-region") : "");
+
+    const bool moved(region.size() && region != resource.region());
+    if (!moved && !res.ok()) return false;
+
+    const Location location(moved ?
+            Location { region, m_config->baseUrl(resource.bucket(), region) } :
+            Location { resource.region(), resource.baseUrl() });
+
+    std::lock_guard<std::mutex> lock(m_locationsMutex);
+    if (moved)
+    {
+        m_locations[resource.bucket()] = location;
+        m_buckets.erase(resource.bucket());
+    }
+    else m_locations.insert(std::make_pair(resource.bucket(), location));
+    return moved;
+}
+
+Response S3::request(
+        const std::string& path,
+        const std::function<Response(const Resource&)>& send) const
+{
+    const Resource resource(resourceOf(path));
+    Response res(send(resource));
+    if (learnRegion(resource, res)) res = send(resourceOf(path));
+    return res;
+}
+
+void S3::requestAsync(
+        const std::string& path,
+        const std::function<void(const Resource&, Completion<Response>)> send,
+        const Completion<Response> done) const
+{
+    const Resource resource(resourceOf(path));
+    send(resource, [this, path, send, done, resource](std::future<Response> f)
+    {
+        Response res;
+        try
+        {
+            res = f.get();
+        }
+        catch (...)
+        {
+            const std::exception_ptr error(std::current_exception());
+            return complete(done, [error]() -> Response
+            {
+                std::rethrow_exception(error);
+            });
+        }
+
+        if (learnRegion(resource, res)) return send(resourceOf(path), done);
+        complete(done, [&]() { return std::move(res); });
+    });
+}
+
+struct S3::Session
+{
+    Session(AuthFields fields, Time expiration)
+        : fields(fields)
+        , expiration(expiration)
+    { }
+
+    const AuthFields fields;
+    const Time expiration;
+};
+
+S3::AuthFields S3::fields(const Resource& resource) const
+{
+    if (!resource.express()) return m_auth->fields();
+
+    // Requests for directory buckets wait while a session is replaced,
+    // which happens once every few minutes for each bucket.
+    std::lock_guard<std::mutex> lock(m_sessionsMutex);
+    std::shared_ptr<const Session>& session(m_sessions[resource.bucket()]);
+
+    if (!session || session->expiration - Time() < sessionRefreshSeconds)
+    {
+        session = createSession(resource.bucket());
+    }
+
+    return session->fields;
+}
+
+std::shared_ptr<const S3::Session> S3::createSession(
+        const std::string& bucket) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/API_CreateSession.html
+    Headers headers(m_config->readHeaders());
+
+    Query query;
+    query["session"] = "";
+
+    // The session is created with, and signed by, our own credentials.
+    const Response res(request(bucket + "/", [&](const Resource& resource)
+    {
+        const ApiV4 apiV4(
+                "GET",
+                resource.region(),
+                resource,
+                m_auth->fields(),
+                *m_signingKeys,
+                query,
+                headers,
+                empty);
+
+        drivers::Http http(m_pool);
+        return http.internalGet(
+                resource.url(),
+                apiV4.headers(),
+                apiV4.query());
+    }));
+
+    std::vector<char> body(res.data());
+    body.push_back('\0');
+
+    std::unique_ptr<Session> session;
+    Xml::xml_document<> xml;
+
+    try
+    {
+        xml.parse<0>(body.data());
+
+        XmlNode* top(xml.first_node("CreateSessionResult"));
+        XmlNode* creds(top ? top->first_node("Credentials") : nullptr);
+        XmlNode* access(creds ? creds->first_node("AccessKeyId") : nullptr);
+        XmlNode* hidden(creds ? creds->first_node("SecretAccessKey") : nullptr);
+        XmlNode* token(creds ? creds->first_node("SessionToken") : nullptr);
+        XmlNode* expiration(creds ? creds->first_node("Expiration") : nullptr);
+
+        // Fractional seconds of the expiration are ignored.
+        if (access && hidden && token && expiration)
+        {
+            session.reset(
+                    new Session(
+                        AuthFields(
+                            access->value(),
+                            hidden->value(),
+                            token->value(),
+                            true),
+                        Time(expiration->value(), "%Y-%m-%dT%H:%M:%S")));
+        }
+    }
+    catch (Xml::parse_error&) { }
+
+    if (!res.ok() || !session)
+    {
+        throw ArbiterError(
+                "Couldn't create S3 session for " + bucket + ": " + res.str());
+    }
+
+    return std::shared_ptr<const Session>(std::move(session));
+}
+
+Response S3::head(const std::string rawPath) const
+{
+    Headers headers(m_config->readHeaders());
+
+    return request(rawPath, [&](const Resource& resource)
+    {
+        const ApiV4 apiV4(
+                "HEAD",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                Query(),
+                headers,
+                empty);
+
+        drivers::Http http(m_pool);
+        return http.internalHead(resource.url(), apiV4.headers());
+    });
+}
+
+std::unique_ptr<std::size_t> S3::tryGetSize(const std::string rawPath) const
+{
+    return sizeOf(head(rawPath));
+}
+
+Status S3::tryReadSize(const std::string rawPath, std::size_t& size) const
+{
+    try
+    {
+        return sizeStatus(head(rawPath), size);
+    }
+    catch (...)
+    {
+        return Status(Status::Code::Failed);
+    }
+}
+
+std::unique_ptr<std::string> S3::tryGetVersion(const std::string rawPath) const
+{
+    return getVersion(head(rawPath));
+}
+
+bool S3::get(
+        const std::string& rawPath,
+        std::vector<char>& data,
+        const Headers& userHeaders,
+        const Query& query) const
+{
+    return getStatus(rawPath, data, userHeaders, query).ok();
+}
+
+Status S3::getStatus(
+        const std::string& rawPath,
+        std::vector<char>& data,
+        const Headers& userHeaders,
+        const Query& query) const
+{
+    Headers headers(m_config->readHeaders());
+    headers.insert(userHeaders.begin(), userHeaders.end());
+
+    if (m_config->partGets() && query.empty() && !headers.count("Range"))
+    {
+        Status status;
+        if (getParts(rawPath, data, headers, status)) return status;
+    }
+
+    std::unique_ptr<std::size_t> size(
+            m_pool.chunkSize() && query.empty() &&
+            !headers.count("Range") ?
+                tryGetSize(rawPath) : nullptr);
+
+    if (size && shouldGetRanged(*size, headers) &&
+            getRanged(rawPath, data, userHeaders, query, *size))
+    {
+        return Status(Status::Code::Ok, 206);
+    }
+
+    Response res(request(rawPath, [&](const Resource& resource)
+    {
+        const ApiV4 apiV4(
+                "GET",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                query,
+                headers,
+                empty);
+
+        drivers::Http http(m_pool);
+        return http.internalGet(
+                resource.url(),
+                apiV4.headers(),
+                apiV4.query(),
+                size ? *size : 0);
+    }));
+
+    if (res.ok()) data = res.releaseData();
+    else
+    {
+        logging::write(
+                res.code() == 404 ? LogLevel::Debug : LogLevel::Error,
+                std::to_string(res.code()) + ": " + res.str());
+    }
+    return Status::fromHttp(res.code());
+}
+
+bool S3::getParts(
+        const std::string& rawPath,
+        std::vector<char>& data,
+        const Headers& headers,
+        Status& status) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/API_GetObject.html
+    auto fetch([&](const std::size_t number, const Headers& partHeaders)
+    {
+        Query query;
+        query["partNumber"] = std::to_string(number);
+
+        return request(rawPath, [&](const Resource& resource)
+        {
+            const ApiV4 apiV4(
+                    "GET",
+                    resource.region(),
+                    resource,
+                    fields(resource),
+                    *m_signingKeys,
+                    query,
+                    partHeaders,
+                    empty);
+
+            drivers::Http http(m_pool);
+            return http.internalGet(
+                    resource.url(),
+                    apiV4.headers(),
+                    apiV4.query());
+        });
+    });
+
+    Response first(fetch(1, headers));
+    if (first.code() == 404)
+    {
+        logging::debug("404: " + first.str());
+        status = Status::fromHttp(first.code());
+        return true;
+    }
+
+    // Servers which don't read by part number are read as usual.
+    if (!first.ok()) return false;
+
+    const std::string count(
+            findHeader(first.headers(), "x-amz-mp-parts-count"));
+    const std::size_t parts(count.size() ? std::stoul(count) : 1);
+    const std::unique_ptr<std::size_t> size(sizeOf(first));
+
+    std::size_t begin(0);
+    if (!size || !s3RangeBegin(first, begin) || begin) return false;
+
+    std::vector<char> result(first.releaseData());
+    if (parts <= 1)
+    {
+        if (result.size() != *size) return false;
+
+        data.swap(result);
+        status = Status(Status::Code::Ok, first.code());
+        return true;
+    }
+
+    // Each part is placed by its Content-Range, since parts needn't be
+    // alike in size.
+    std::atomic<std::size_t> bytes(result.size());
+    if (result.size() > *size) return false;
+    result.resize(*size);
+
+    // Every part must be of the same version of the object as the first.
+    Headers partHeaders(headers);
+    const std::string etag(findHeader(first.headers(), "ETag"));
+    if (etag.size()) partHeaders["If-Match"] = etag;
+
+    std::atomic<bool> good(true);
+    parallelFor(parts - 1, m_pool.size(), [&](const std::size_t i)
+    {
+        if (!good) return;
+
+        const Response res(fetch(i + 2, partHeaders));
+        const std::vector<char>& part(res.data());
+
+        std::size_t offset(0);
+        if (res.code() == 206 &&
+                s3RangeBegin(res, offset) &&
+                offset + part.size() <= result.size())
+        {
+            std::copy(part.begin(), part.end(), result.begin() + offset);
+            bytes += part.size();
+        }
+        else good = false;
+    }, m_pool.executor());
+
+    if (!good || bytes != *size) return false;
+
+    data.swap(result);
+    status = Status(Status::Code::Ok, 206);
+    return true;
+}
+
+bool S3::get(
+        const std::string& rawPath,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const Headers& userHeaders,
+        const Query& query) const
+{
+    Headers headers(m_config->readHeaders());
+    headers.insert(userHeaders.begin(), userHeaders.end());
+
+    // Only the body of a successful response reaches the sink, so a request
+    // refused for its region may be made again.
+    Response res(request(rawPath, [&](const Resource& resource)
+    {
+        const ApiV4 apiV4(
+                "GET",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                query,
+                headers,
+                empty);
+
+        drivers::Http http(m_pool);
+        return http.internalGet(
+                resource.url(),
+                sink,
+                apiV4.headers(),
+                apiV4.query());
+    }));
+
+    if (!res.ok())
+    {
+        logging::write(
+                res.code() == 404 ? LogLevel::Debug : LogLevel::Error,
+                std::to_string(res.code()) + ": " + res.str());
+    }
+    return res.ok();
+}
+
+void S3::put(
+        const std::string& rawPath,
+        const std::vector<char>& data,
+        const Headers& userHeaders,
+        const Query& query) const
+{
+    putData(rawPath, data.data(), data.size(), userHeaders, query);
+}
+
+void S3::put(
+        const std::string rawPath,
+        const char* const data,
+        const std::size_t size) const
+{
+    putData(rawPath, data, size, Headers(), Query());
+}
+
+void S3::putData(
+        const std::string& rawPath,
+        const char* const data,
+        const std::size_t size,
+        const Headers& userHeaders,
+        const Query& query) const
+{
+    if (m_config->multipartThreshold() &&
+            size > m_config->multipartThreshold())
+    {
+        return putMultipart(
+                rawPath,
+                data,
+                size,
+                m_config->partSize(),
+                userHeaders,
+                query);
+    }
+
+    Headers headers(m_config->baseHeaders());
+    headers.insert(userHeaders.begin(), userHeaders.end());
+
+    if (Arbiter::getExtension(rawPath) == "json")
+    {
+        headers["Content-Type"] = "application/json";
+    }
+
+    const std::string hash(payloadHash(data, size, headers));
+    Response res(request(rawPath, [&](const Resource& resource)
+    {
+        const ApiV4 apiV4(
+                "PUT",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                query,
+                headers,
+                hash);
+
+        drivers::Http http(m_pool);
+        return http.internalPut(
+                resource.url(),
+                data,
+                size,
+                apiV4.headers(),
+                apiV4.query());
+    }));
+
+    if (!res.ok())
+    {
+        throw ArbiterError(
+                "Couldn't S3 PUT to " + rawPath + ": " +
+                std::string(res.data().data(), res.data().size()));
+    }
+}
+
+void S3::getBinaryThen(
+        const std::string rawPath,
+        const Completion<std::vector<char>> done,
+        Executor& executor) const
+{
+    if (m_pool.chunkSize() || m_config->partGets())
+    {
+        return Driver::getBinaryThen(rawPath, done, executor);
+    }
+
+    Headers headers(m_config->readHeaders());
+
+    requestAsync(rawPath, [this, headers](
+                const Resource& resource,
+                Completion<Response> sent)
+    {
+        const ApiV4 apiV4(
+                "GET",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                Query(),
+                headers,
+                empty);
+
+        drivers::Http http(m_pool);
+        http.internalGetAsync(
+                resource.url(),
+                apiV4.headers(),
+                apiV4.query(),
+                0,
+                sent);
+    },
+    [rawPath, done](std::future<Response> f)
+    {
+        complete(done, [&]()->std::vector<char>
+        {
+            Response res(f.get());
+            if (!res.ok()) throw ArbiterError("Could not read file " + rawPath);
+            return res.releaseData();
+        });
+    });
+}
+
+void S3::putThen(
+        const std::string rawPath,
+        std::vector<char> data,
+        const Completion<void> done,
+        Executor& executor) const
+{
+    if (m_config->multipartThreshold() &&
+            data.size() > m_config->multipartThreshold())
+    {
+        return Driver::putThen(rawPath, std::move(data), done, executor);
+    }
+
+    Headers headers(m_config->baseHeaders());
+    if (Arbiter::getExtension(rawPath) == "json")
+    {
+        headers["Content-Type"] = "application/json";
+    }
+
+    const std::string hash(payloadHash(data.data(), data.size(), headers));
+
+    // The data is handed off with the request, so until the region of the
+    // bucket is known, a copy is sent in case it must be sent again.
+    const bool keep(!located(rawPath));
+    const auto body(std::make_shared<std::vector<char>>(std::move(data)));
+
+    const auto send([this, headers, hash, body, keep](
+                const Resource& resource,
+                Completion<Response> sent)
+    {
+        const ApiV4 apiV4(
+                "PUT",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                Query(),
+                headers,
+                hash);
+
+        drivers::Http http(m_pool);
+        http.internalPutAsync(
+                resource.url(),
+                keep ? *body : std::move(*body),
+                apiV4.headers(),
+                apiV4.query(),
+                sent);
+    });
+
+    const Completion<Response> finish([rawPath, done](std::future<Response> f)
+    {
+        complete(done, [&]()
+        {
+            const Response res(f.get());
+            if (!res.ok())
+            {
+                throw ArbiterError(
+                        "Couldn't S3 PUT to " + rawPath + ": " +
+                        std::string(res.data().data(), res.data().size()));
+            }
+        });
+    });
+
+    if (keep) requestAsync(rawPath, send, finish);
+    else send(resourceOf(rawPath), finish);
+}
+
+void S3::tryGetSizeThen(
+        const std::string rawPath,
+        const Completion<std::unique_ptr<std::size_t>> done,
+        Executor&) const
+{
+    Headers headers(m_config->readHeaders());
+
+    requestAsync(rawPath, [this, headers](
+                const Resource& resource,
+                Completion<Response> sent)
+    {
+        const ApiV4 apiV4(
+                "HEAD",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                Query(),
+                headers,
+                empty);
+
+        drivers::Http http(m_pool);
+        http.internalHeadAsync(resource.url(), apiV4.headers(), Query(), sent);
+    },
+    [done](std::future<Response> f)
+    {
+        complete(done, [&]() { return sizeOf(f.get()); });
+    });
+}
+
+void S3::putFrom(
+        const std::string rawPath,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size) const
+{
+    // The source can't be read again, so until the region of the bucket is
+    // known, the data is buffered for put, which may send it again.  So is
+    // data to be checksummed, whose checksum is sent ahead of it.
+    if (!m_config->unsignedPayload() || m_config->crc32c() ||
+            (m_config->multipartThreshold() &&
+                size > m_config->multipartThreshold()) ||
+            !located(rawPath))
+    {
+        return Driver::putFrom(rawPath, source, size);
+    }
+
+    const Resource resource(resourceOf(rawPath));
+
+    Headers headers(m_config->baseHeaders());
+    if (Arbiter::getExtension(rawPath) == "json")
+    {
+        headers["Content-Type"] = "application/json";
+    }
+
+    const ApiV4 apiV4(
+            "PUT",
+            resource.region(),
+            resource,
+            fields(resource),
+            *m_signingKeys,
+            Query(),
+            headers,
+            ApiV4::unsignedPayload);
+
+    drivers::Http http(m_pool);
+    Response res(
+            http.internalPut(
+                resource.url(),
+                source,
+                size,
+                apiV4.headers(),
+                apiV4.query()));
+
+    if (!res.ok())
+    {
+        throw ArbiterError(
+                "Couldn't S3 PUT to " + rawPath + ": " +
+                std::string(res.data().data(), res.data().size()));
+    }
+}
+
+std::string S3::payloadHash(
+        const char* const data,
+        const std::size_t size,
+        Headers& headers) const
+{
+    const bool sign(!m_config->unsignedPayload());
+    const bool verify(m_pool.verify());
+
+    // Copies have no body of their own to checksum.
+    const bool crc(m_config->crc32c() && !headers.count("x-amz-copy-source"));
+
+    // Every digest is fed each chunk while it's in cache, so verification
+    // costs no extra pass over the data.
+    const std::size_t chunk(64 * 1024);
+    crypto::Sha256 sha;
+    crypto::Md5 md5;
+    crypto::Crc32c crc32c;
+
+    for (std::size_t pos(0); (sign || verify || crc) && pos < size; )
+    {
+        const std::size_t n((std::min)(chunk, size - pos));
+        if (sign) sha.update(data + pos, n);
+        if (verify) md5.update(data + pos, n);
+        if (crc) crc32c.update(data + pos, n);
+        pos += n;
+    }
+
+    if (verify) headers["Content-MD5"] = crypto::encodeBase64(md5.finalize());
+    if (crc)
+    {
+        headers["x-amz-checksum-crc32c"] =
+            crypto::encodeBase64(crc32c.finalize());
+    }
+    return sign ? crypto::encodeAsHex(sha.finalize()) : ApiV4::unsignedPayload;
+}
+
+void S3::putParts(
+        const std::string rawPath,
+        const char* const data,
+        const std::size_t size,
+        std::size_t partSize) const
+{
+    partSize = (std::max)(partSize, minPartSize);
+    if (size <= partSize) return Driver::put(rawPath, data, size);
+
+    putMultipart(rawPath, data, size, partSize, Headers(), Query());
+}
+
+void S3::putMultipart(
+        const std::string& rawPath,
+        const char* const data,
+        const std::size_t size,
+        std::size_t partSize,
+        const Headers& userHeaders,
+        const Query& userQuery) const
+{
+    // Initiation learns the region of the bucket if need be, so the parts
+    // are addressed after it.
+    const std::string uploadId(
+            initiateMultipart(rawPath, userHeaders, userQuery, true));
+    const Resource resource(resourceOf(rawPath));
+
+    partSize = (std::max)(partSize, (size + maxParts - 1) / maxParts);
+    const std::size_t count((size + partSize - 1) / partSize);
+
+    std::vector<Part> parts(count);
+
+    try
+    {
+        parallelFor(count, m_pool.size(), [&](const std::size_t i)
+        {
+            const std::size_t begin(i * partSize);
+            const std::size_t end((std::min)(begin + partSize, size));
+
+            parts[i] = putPart(
+                    resource,
+                    uploadId,
+                    i + 1,
+                    data + begin,
+                    end - begin);
+        }, m_pool.executor());
+
+        completeMultipart(resource, uploadId, parts);
+    }
+    catch (...)
+    {
+        abortMultipart(resource, uploadId);
+        throw;
+    }
+}
+
+std::string S3::initiateMultipart(
+        const std::string& rawPath,
+        const Headers& userHeaders,
+        const Query& userQuery,
+        const bool checksummed) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/mpUploadInitiate.html
+    Headers headers(m_config->baseHeaders());
+    headers.insert(userHeaders.begin(), userHeaders.end());
+
+    if (checksummed && m_config->crc32c())
+    {
+        headers["x-amz-checksum-algorithm"] = "CRC32C";
+    }
+
+    if (Arbiter::getExtension(rawPath) == "json")
+    {
+        headers["Content-Type"] = "application/json";
+    }
+
+    Query query(userQuery);
+    query["uploads"] = "";
+
+    Response res(request(rawPath, [&](const Resource& resource)
+    {
+        const ApiV4 apiV4(
+                "POST",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                query,
+                headers,
+                empty);
+
+        drivers::Http http(m_pool);
+        return http.internalPost(
+                resource.url(),
+                empty,
+                apiV4.headers(),
+                apiV4.query());
+    }));
+
+    std::vector<char> body(res.releaseData());
+    body.push_back('\0');
+    const std::string message(body.data());
+
+    std::string uploadId;
+    Xml::xml_document<> xml;
+
+    try
+    {
+        xml.parse<0>(body.data());
+        if (XmlNode* top = xml.first_node("InitiateMultipartUploadResult"))
+        {
+            XmlNode* id(top->first_node("UploadId"));
+            if (id) uploadId = id->value();
+        }
+    }
+    catch (Xml::parse_error&) { }
+
+    if (!res.ok() || uploadId.empty())
+    {
+        throw ArbiterError(
+                "Couldn't initiate S3 multipart upload to " + rawPath + ": " +
+                message);
+    }
+
+    return uploadId;
+}
+
+S3::Part S3::putPart(
+        const Resource& resource,
+        const std::string& uploadId,
+        const std::size_t number,
+        const char* const data,
+        const std::size_t size) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/mpUploadUploadPart.html
+    drivers::Http http(m_pool);
+
+    // Parts inherit their encryption settings from the initiating request,
+    // and S3 rejects them if the SSE header is repeated.
+    Headers headers(m_config->readHeaders());
+
+    Query query;
+    query["partNumber"] = std::to_string(number);
+    query["uploadId"] = uploadId;
+
+    // A failed part is retried on its own, re-signed each time since the
+    // signature is time-sensitive.
+    const std::string hash(payloadHash(data, size, headers));
+
+    Response res;
+    for (std::size_t tries(0); tries < partTries; ++tries)
+    {
+        const ApiV4 apiV4(
+                "PUT",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                query,
+                headers,
+                hash);
+
+        res = http.internalPut(
+                resource.url(),
+                data,
+                size,
+                apiV4.headers(),
+                apiV4.query());
+
+        if (res.ok()) break;
+    }
+
+    const std::string etag(findHeader(res.headers(), "ETag"));
+
+    if (!res.ok() || etag.empty())
+    {
+        throw ArbiterError(
+                "Couldn't S3 PUT part " + std::to_string(number) + " of " +
+                resource.object() + ": " + res.str());
+    }
+
+    Part result;
+    result.etag = etag;
+    if (m_config->crc32c())
+    {
+        result.checksum = headers.at("x-amz-checksum-crc32c");
+    }
+    return result;
+}
+
+std::string S3::copyPart(
+        const Resource& resource,
+        const std::string& uploadId,
+        const std::size_t number,
+        const std::string& source,
+        const std::size_t begin,
+        const std::size_t end) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/API_UploadPartCopy.html
+    drivers::Http http(m_pool);
+
+    Headers headers(m_config->readHeaders());
+    headers["x-amz-copy-source"] = source;
+    headers["x-amz-copy-source-range"] =
+        "bytes=" + std::to_string(begin) + "-" + std::to_string(end - 1);
+
+    Query query;
+    query["partNumber"] = std::to_string(number);
+    query["uploadId"] = uploadId;
+
+    Response res;
+    std::string etag;
+
+    for (std::size_t tries(0); tries < partTries && etag.empty(); ++tries)
+    {
+        const ApiV4 apiV4(
+                "PUT",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                query,
+                headers,
+                empty);
+
+        res = http.internalPut(
+                resource.url(),
+                empty,
+                apiV4.headers(),
+                apiV4.query());
+
+        if (!res.ok()) continue;
+
+        // As for completions, a copy may fail after its 200 status has been
+        // sent, in which case the body holds an error rather than a result.
+        std::vector<char> body(res.data());
+        body.push_back('\0');
+
+        Xml::xml_document<> xml;
+        try
+        {
+            xml.parse<0>(body.data());
+            if (XmlNode* top = xml.first_node("CopyPartResult"))
+            {
+                if (XmlNode* node = top->first_node("ETag"))
+                {
+                    etag = node->value();
+                }
+            }
+        }
+        catch (Xml::parse_error&) { }
+    }
+
+    if (etag.empty())
+    {
+        throw ArbiterError(
+                "Couldn't S3 copy part " + std::to_string(number) + " of " +
+                resource.object() + ": " + res.str());
+    }
+
+    return etag;
+}
+
+void S3::completeMultipart(
+        const Resource& resource,
+        const std::string& uploadId,
+        const std::vector<Part>& parts) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/mpUploadComplete.html
+    drivers::Http http(m_pool);
+
+    std::string complete("<CompleteMultipartUpload>");
+    for (std::size_t i(0); i < parts.size(); ++i)
+    {
+        complete +=
+            "<Part><PartNumber>" + std::to_string(i + 1) + "</PartNumber>" +
+            "<ETag>" + parts[i].etag + "</ETag>";
+        if (parts[i].checksum.size())
+        {
+            complete +=
+                "<ChecksumCRC32C>" + parts[i].checksum + "</ChecksumCRC32C>";
+        }
+        complete += "</Part>";
+    }
+    complete += "</CompleteMultipartUpload>";
+
+    const std::vector<char> data(complete.begin(), complete.end());
+
+    Query query;
+    query["uploadId"] = uploadId;
+
+    Headers headers(m_config->readHeaders());
+    headers["Content-Type"] = "application/xml";
+
+    const ApiV4 apiV4(
+            "POST",
+            resource.region(),
+            resource,
+            fields(resource),
+            *m_signingKeys,
             query,
             headers,
-            empty);
+            data);
+
+    Response res(
+            http.internalPost(
+                resource.url(),
+                data,
+                apiV4.headers(),
+                apiV4.query()));
+
+    // A completion request may fail after its 200 status has been sent, in
+    // which case the error is reported in the response body.
+    const std::string result(res.str());
+    if (!res.ok() || result.find("<Error>") != std::string::npos)
+    {
+        throw ArbiterError(
+                "Couldn't complete S3 multipart upload to " +
+                resource.object() + ": " + result);
+    }
+}
+
+void S3::abortMultipart(
+        const Resource& resource,
+        const std::string& uploadId) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/API_AbortMultipartUpload.html
+    try
+    {
+        drivers::Http http(m_pool);
+
+        Query query;
+        query["uploadId"] = uploadId;
+
+        const ApiV4 apiV4(
+                "DELETE",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                query,
+                m_config->readHeaders(),
+                empty);
+
+        const Response res(
+                http.internalDelete(
+                    resource.url(),
+                    apiV4.headers(),
+                    apiV4.query()));
+
+        if (!res.ok() && res.code() != 404)
+        {
+            logging::warn(
+                    "Couldn't abort S3 multipart upload to " +
+                    resource.object() + ": " + res.str());
+        }
+    }
+    catch (const std::exception& e)
+    {
+        logging::warn(
+                "Couldn't abort S3 multipart upload to " +
+                resource.object() + ": " + e.what());
+    }
+}
+
+/** Streams a write into a multipart upload, which is only initiated once the
+ * data has grown beyond the multipart threshold.  Up to a handful of parts
+ * are uploaded concurrently while further data is written, so memory use is
+ * bounded by a few part sizes regardless of the total size.
+ */
+class S3::MultipartWriter : public Writer
+{
+public:
+    MultipartWriter(const S3& s3, std::string path)
+        : m_s3(s3)
+        , m_path(path)
+        , m_resource(s3.resourceOf(path))
+        , m_partSize(s3.m_config->partSize())
+        , m_threshold(s3.m_config->multipartThreshold())
+    { }
+
+    ~MultipartWriter()
+    {
+        // Our in-flight parts reference us, so wait for them regardless.
+        for (auto& f : m_pending) if (f.valid()) f.wait();
+
+        // An upload which was never completed, because it failed or was
+        // abandoned, would otherwise keep its parts.
+        if (m_uploadId.size() && !m_completed)
+        {
+            m_s3.abortMultipart(m_resource, m_uploadId);
+        }
+    }
+
+    virtual void write(const char* data, std::size_t size) override
+    {
+        m_buffer.insert(m_buffer.end(), data, data + size);
+
+        if (m_uploadId.empty())
+        {
+            if (!m_threshold || m_buffer.size() <= m_threshold) return;
+            m_uploadId =
+                m_s3.initiateMultipart(m_path, Headers(), Query(), true);
+            m_resource = m_s3.resourceOf(m_path);
+        }
+
+        while (m_buffer.size() >= m_partSize) sendPart();
+    }
+
+    virtual void done() override
+    {
+        if (m_uploadId.empty())
+        {
+            m_s3.put(m_path, m_buffer, Headers(), Query());
+            return;
+        }
+
+        if (m_buffer.size()) sendPart();
+        while (m_pending.size()) collect();
+
+        m_s3.completeMultipart(m_resource, m_uploadId, m_parts);
+        m_completed = true;
+    }
+
+private:
+    void sendPart()
+    {
+        const std::size_t size((std::min)(m_partSize, m_buffer.size()));
+        auto part(std::make_shared<std::vector<char>>(
+                    m_buffer.begin(), m_buffer.begin() + size));
+        m_buffer.erase(m_buffer.begin(), m_buffer.begin() + size);
+
+        const std::size_t number(m_parts.size() + m_pending.size() + 1);
+        if (number > maxParts)
+        {
+            throw ArbiterError("Too many parts for S3 upload to " + m_path);
+        }
+
+        while (m_pending.size() >= maxPendingParts) collect();
+
+        m_pending.push_back(
+                std::async(std::launch::async, [this, number, part]()
+                {
+                    return m_s3.putPart(
+                            m_resource,
+                            m_uploadId,
+                            number,
+                            part->data(),
+                            part->size());
+                }));
+    }
+
+    void collect()
+    {
+        m_parts.push_back(m_pending.front().get());
+        m_pending.pop_front();
+    }
+
+    static constexpr std::size_t maxPendingParts = 4;
+
+    const S3& m_s3;
+    const std::string m_path;
+    // Readdressed once the upload is initiated, which may have learned the
+    // region of its bucket.
+    Resource m_resource;
+    const std::size_t m_partSize;
+    const std::size_t m_threshold;
+
+    std::string m_uploadId;
+    bool m_completed = false;
+    std::vector<char> m_buffer;
+    std::vector<Part> m_parts;
+    std::deque<std::future<Part>> m_pending;
+};
+
+std::unique_ptr<Writer> S3::putStream(const std::string rawPath) const
+{
+    return std::unique_ptr<Writer>(new MultipartWriter(*this, rawPath));
+}
+
+void S3::copy(const std::string src, const std::string dst) const
+{
+    // Large sources are copied in parallel parts, which is also the only
+    // way to copy those over 5 GB.
+    if (m_config->multipartThreshold())
+    {
+        const std::unique_ptr<std::size_t> size(tryGetSize(src));
+        if (size && *size > m_config->multipartThreshold())
+        {
+            copyMultipart(src, dst, *size);
+            return;
+        }
+    }
+
+    Headers headers;
+    const Resource resource(resourceOf(src));
+    headers["x-amz-copy-source"] = resource.bucket() + '/' + resource.object();
+    put(dst, std::vector<char>(), headers, Query());
+}
+
+void S3::copyMultipart(
+        const std::string& src,
+        const std::string& dst,
+        const std::size_t size) const
+{
+    const Resource source(resourceOf(src));
+    const std::string copySource(source.bucket() + '/' + source.object());
+
+    const std::string uploadId(
+            initiateMultipart(dst, Headers(), Query(), false));
+    const Resource resource(resourceOf(dst));
+
+    std::size_t partSize(m_config->copyPartSize());
+    partSize = (std::max)(partSize, (size + maxParts - 1) / maxParts);
+    const std::size_t count((size + partSize - 1) / partSize);
+
+    std::vector<Part> parts(count);
+
+    try
+    {
+        parallelFor(count, m_pool.size(), [&](const std::size_t i)
+        {
+            const std::size_t begin(i * partSize);
+            const std::size_t end((std::min)(begin + partSize, size));
+
+            parts[i].etag =
+                copyPart(resource, uploadId, i + 1, copySource, begin, end);
+        }, m_pool.executor());
+
+        completeMultipart(resource, uploadId, parts);
+    }
+    catch (...)
+    {
+        abortMultipart(resource, uploadId);
+        throw;
+    }
+}
+
+void S3::remove(const std::string rawPath) const
+{
+    Headers headers(m_config->readHeaders());
+
+    const Response res(request(rawPath, [&](const Resource& resource)
+    {
+        const ApiV4 apiV4(
+                "DELETE",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                Query(),
+                headers,
+                empty);
+
+        drivers::Http http(m_pool);
+        return http.internalDelete(
+                resource.url(),
+                apiV4.headers(),
+                apiV4.query());
+    }));
+
+    if (!res.ok() && res.code() != 404)
+    {
+        throw ArbiterError("Couldn't S3 DELETE " + rawPath + ": " + res.str());
+    }
+}
+
+std::vector<std::exception_ptr> S3::removeMany(
+        const std::vector<std::string>& paths,
+        const std::size_t threads) const
+{
+    std::vector<std::exception_ptr> errors(paths.size());
+
+    // Indices of the paths within each bucket.
+    std::map<std::string, std::vector<std::size_t>> buckets;
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        const std::size_t split(paths[i].find('/'));
+        if (split == std::string::npos || split + 1 == paths[i].size())
+        {
+            errors[i] = std::make_exception_ptr(
+                    ArbiterError("Cannot remove S3 bucket " + paths[i]));
+        }
+        else buckets[paths[i].substr(0, split)].push_back(i);
+    }
+
+    struct Batch
+    {
+        std::string bucket;
+        std::vector<std::size_t> indices;
+    };
+
+    std::vector<Batch> batches;
+    for (const auto& bucket : buckets)
+    {
+        const std::vector<std::size_t>& indices(bucket.second);
+        for (std::size_t pos(0); pos < indices.size(); pos += maxDeleteKeys)
+        {
+            const std::size_t end(
+                    (std::min)(pos + maxDeleteKeys, indices.size()));
+            batches.push_back(Batch {
+                    bucket.first,
+                    std::vector<std::size_t>(
+                        indices.begin() + pos,
+                        indices.begin() + end) });
+        }
+    }
+
+    parallelFor(batches.size(), threads, [&](const std::size_t b)
+    {
+        const Batch& batch(batches[b]);
+        try
+        {
+            std::vector<std::string> keys;
+            for (const std::size_t i : batch.indices)
+            {
+                keys.push_back(paths[i].substr(batch.bucket.size() + 1));
+            }
+
+            const std::vector<std::string> failures(
+                    deleteObjects(batch.bucket, keys));
+
+            for (std::size_t j(0); j < keys.size(); ++j)
+            {
+                if (failures[j].empty()) continue;
+                errors[batch.indices[j]] = std::make_exception_ptr(
+                        ArbiterError(
+                            "Couldn't S3 delete " + paths[batch.indices[j]] +
+                            ": " + failures[j]));
+            }
+        }
+        catch (...)
+        {
+            for (const std::size_t i : batch.indices)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    }, m_pool.executor());
+
+    return errors;
+}
+
+std::vector<std::string> S3::deleteObjects(
+        const std::string& bucket,
+        const std::vector<std::string>& keys) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/API_DeleteObjects.html
+    //
+    // Quiet responses list only the keys which could not be removed.
+    std::string deletion("<Delete><Quiet>true</Quiet>");
+    for (const std::string& key : keys)
+    {
+        deletion += "<Object><Key>" + xmlEscape(key) + "</Key></Object>";
+    }
+    deletion += "</Delete>";
+
+    const std::vector<char> data(deletion.begin(), deletion.end());
+
+    Query query;
+    query["delete"] = "";
+
+    // A Content-MD5 is required for this request whether or not the pool
+    // verifies transfers.
+    Headers headers(m_config->readHeaders());
+    headers["Content-Type"] = "application/xml";
+    headers["Content-MD5"] = crypto::encodeBase64(crypto::md5(deletion));
+
+    Response res(request(bucket + "/", [&](const Resource& resource)
+    {
+        const ApiV4 apiV4(
+                "POST",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                query,
+                headers,
+                data);
+
+        drivers::Http http(m_pool);
+        return http.internalPost(
+                resource.url(),
+                data,
+                apiV4.headers(),
+                apiV4.query());
+    }));
+
+    if (!res.ok())
+    {
+        throw ArbiterError(
+                "Couldn't S3 delete objects from " + bucket + ": " +
+                res.str());
+    }
+
+    std::vector<char> body(res.releaseData());
+    body.push_back('\0');
+
+    Xml::xml_document<> xml;
+    try
+    {
+        xml.parse<0>(body.data());
+    }
+    catch (Xml::parse_error&)
+    {
+        throw ArbiterError("Could not parse S3 response.");
+    }
+
+    XmlNode* top(xml.first_node("DeleteResult"));
+    if (!top) throw ArbiterError(badResponse);
+
+    std::map<std::string, std::string> messages;
+    for (
+            XmlNode* node(top->first_node("Error"));
+            node;
+            node = node->next_sibling("Error"))
+    {
+        XmlNode* key(node->first_node("Key"));
+        if (!key) throw ArbiterError(badResponse);
+
+        std::string message("Unknown error");
+        if (XmlNode* code = node->first_node("Code")) message = code->value();
+        if (XmlNode* text = node->first_node("Message"))
+        {
+            message += std::string(": ") + text->value();
+        }
+        messages[key->value()] = message;
+    }
+
+    std::vector<std::string> failures(keys.size());
+    for (std::size_t i(0); i < keys.size(); ++i)
+    {
+        const auto it(messages.find(keys[i]));
+        if (it != messages.end()) failures[i] = it->second;
+    }
+    return failures;
+}
+
+std::string S3::queueRequest(
+        const std::string& action,
+        const std::string& body) const
+{
+    const Resource resource(
+            Resource::forService(
+                m_config->queue(),
+                m_config->queueRegion(),
+                "sqs"));
+
+    Headers headers;
+    headers["Content-Type"] = "application/x-amz-json-1.0";
+    headers["X-Amz-Target"] = "AmazonSQS." + action;
+
+    const std::vector<char> data(body.begin(), body.end());
+    const ApiV4 apiV4(
+            "POST",
+            resource.region(),
+            resource,
+            m_auth->fields(),
+            *m_signingKeys,
+            Query(),
+            headers,
+            data);
 
     drivers::Http http(m_pool);
-    Response res(
-            http.internalGet(
+    const Response res(
+            http.internalPost(
                 resource.url(),
+                data,
                 apiV4.headers(),
-                apiV4.query(),
-                size ? *size : 0));
+                apiV4.query()));
 
-    if (res.ok())
+    if (!res.ok())
     {
-        data = res.data();
-        return true;
+        throw ArbiterError(
+                "Couldn't SQS " + action + " on " + m_config->queue() + ": " +
+                res.str());
     }
-    else
+
+    return std::string(res.data().begin(), res.data().end());
+}
+
+// Receives from the queue until destroyed, one long poll at a time.
+class S3::QueueWatch : public Watch
+{
+public:
+    QueueWatch(const S3& s3, const std::string pattern, ChangeCallback f)
+        : m_s3(s3)
+        , m_glob(pattern)
+        , m_f(std::move(f))
+    {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    ~QueueWatch()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+private:
+    bool done()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_done;
+    }
+
+    void run()
+    {
+        while (!done())
+        {
+            try { receive(); }
+            catch (std::exception& e)
+            {
+                logging::warn(
+                        "Could not receive changes to " + m_glob.pattern() +
+                        ": " + e.what());
+
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait_for(
+                        lock,
+                        std::chrono::seconds(1),
+                        [this]() { return m_done; });
+            }
+        }
+    }
+
+    void receive()
+    {
+        const std::string& queue(m_s3.m_config->queue());
+
+        json request;
+        request["QueueUrl"] = queue;
+        request["MaxNumberOfMessages"] = 10;
+        request["WaitTimeSeconds"] = m_s3.m_config->queueWait();
+
+        const json response(
+                json::parse(
+                    m_s3.queueRequest("ReceiveMessage", request.dump())));
+
+        json entries(json::array());
+        for (const json& message : response.value("Messages", json::array()))
+        {
+            try
+            {
+                deliver(json::parse(message.at("Body").get<std::string>()));
+            }
+            catch (std::exception& e)
+            {
+                logging::warn(
+                        std::string("Skipping invalid notification: ") +
+                        e.what());
+            }
+
+            json entry;
+            entry["Id"] = std::to_string(entries.size());
+            entry["ReceiptHandle"] = message.at("ReceiptHandle");
+            entries.push_back(entry);
+        }
+
+        if (entries.empty()) return;
+
+        json deletion;
+        deletion["QueueUrl"] = queue;
+        deletion["Entries"] = entries;
+        m_s3.queueRequest("DeleteMessageBatch", deletion.dump());
+    }
+
+    void deliver(const json& body)
+    {
+        // Notifications fanned out by SNS wrap the S3 event as a string.
+        if (body.value("Type", std::string()) == "Notification")
+        {
+            deliver(json::parse(body.at("Message").get<std::string>()));
+            return;
+        }
+
+        // Others, like the s3:TestEvent sent when notifications are
+        // configured, have no records.
+        for (const json& record : body.value("Records", json::array()))
+        {
+            const std::string name(record.value("eventName", std::string()));
+            const json& s3(record.at("s3"));
+            const json& object(s3.at("object"));
+
+            const std::string path(
+                    s3.at("bucket").at("name").get<std::string>() + "/" +
+                    decodeKey(object.at("key").get<std::string>()));
+            if (!m_glob.match(path)) continue;
+
+            ChangeEvent event;
+            event.info.path = m_s3.type() + "://" + path;
+
+            if (name.compare(0, 13, "ObjectCreated") == 0)
+            {
+                event.info.hasSize = object.count("size") > 0;
+                event.info.size = object.value("size", std::size_t(0));
+                const std::string etag(object.value("eTag", std::string()));
+                if (etag.size()) event.info.version = "\"" + etag + "\"";
+            }
+            else if (name.compare(0, 13, "ObjectRemoved") == 0)
+            {
+                event.type = ChangeEvent::Type::Removed;
+            }
+            else continue;
+
+            m_f(event);
+        }
+    }
+
+    const S3& m_s3;
+    const Glob m_glob;
+    const ChangeCallback m_f;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_done = false;
+    std::thread m_thread;
+};
+
+std::unique_ptr<Watch> S3::watch(
+        std::string path,
+        ChangeCallback f,
+        const std::chrono::milliseconds interval) const
+{
+    if (m_config->queue().empty())
+    {
+        return Driver::watch(path, std::move(f), interval);
+    }
+
+    if (path.size() && path.back() == '/') path += "**";
+    return std::unique_ptr<Watch>(new QueueWatch(*this, path, std::move(f)));
+}
+
+std::string S3::presign(
+        const std::string rawPath,
+        const std::string verb,
+        const std::chrono::seconds expiry) const
+{
+    if (expiry.count() <= 0 || expiry.count() > maxPresignSeconds)
+    {
+        throw ArbiterError("S3 presigned URLs must expire within 7 days");
+    }
+
+    const Resource resource(resourceOf(rawPath));
+    const ApiV4 apiV4(
+            verb,
+            resource.region(),
+            resource,
+            fields(resource),
+            *m_signingKeys,
+            expiry.count());
+
+    // The query is already encoded.
+    std::string url(resource.url());
+    char separator('?');
+    for (const auto& q : apiV4.query())
+    {
+        url += separator + q.first + '=' + q.second;
+        separator = '&';
+    }
+    return url;
+}
+
+void S3::select(
+        const std::string rawPath,
+        const std::string& expression,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const std::string j) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/API_SelectObjectContent.html
+    const json parsed(j.size() ? json::parse(j) : json());
+    const json c(parsed.is_object() ? parsed : json::object());
+
+    const std::string format(c.value("format", std::string("csv")));
+    const std::string output(c.value("output", format));
+    const std::string delimiter(c.value("delimiter", std::string(",")));
+
+    auto serialization([&](const std::string& f, const bool input)
+    {
+        if (f == "csv")
+        {
+            std::string csv("<CSV>");
+            if (input)
+            {
+                csv += "<FileHeaderInfo>" +
+                    toUpper(c.value("header", std::string("none"))) +
+                    "</FileHeaderInfo>";
+            }
+            return csv + "<FieldDelimiter>" + xmlEscape(delimiter) +
+                "</FieldDelimiter></CSV>";
+        }
+        if (f == "json")
+        {
+            if (!input) return std::string("<JSON></JSON>");
+            return "<JSON><Type>" +
+                toUpper(c.value("type", std::string("lines"))) +
+                "</Type></JSON>";
+        }
+        throw ArbiterError("Unknown S3 Select format: " + f);
+    });
+
+    std::string body(
+            "<SelectObjectContentRequest>"
+            "<Expression>" + xmlEscape(expression) + "</Expression>"
+            "<ExpressionType>SQL</ExpressionType>"
+            "<InputSerialization><CompressionType>" +
+            toUpper(c.value("compression", std::string("none"))) +
+            "</CompressionType>" + serialization(format, true) +
+            "</InputSerialization>"
+            "<OutputSerialization>" + serialization(output, false) +
+            "</OutputSerialization>");
+
+    if (c.count("scanStart") || c.count("scanEnd"))
+    {
+        body += "<ScanRange>";
+        if (c.count("scanStart"))
+        {
+            body += "<Start>" +
+                std::to_string(c["scanStart"].get<uint64_t>()) + "</Start>";
+        }
+        if (c.count("scanEnd"))
+        {
+            body += "<End>" +
+                std::to_string(c["scanEnd"].get<uint64_t>()) + "</End>";
+        }
+        body += "</ScanRange>";
+    }
+    body += "</SelectObjectContentRequest>";
+
+    const std::vector<char> data(body.begin(), body.end());
+
+    Query query;
+    query["select"] = "";
+    query["select-type"] = "2";
+
+    Headers headers(m_config->readHeaders());
+    headers["Content-Type"] = "application/xml";
+
+    SelectStream stream(sink);
+    const std::function<void(const char*, std::size_t)> decode(
+            [&stream](const char* d, std::size_t n) { stream.write(d, n); });
+
+    Response res(request(rawPath, [&](const Resource& resource)
+    {
+        const ApiV4 apiV4(
+                "POST",
+                resource.region(),
+                resource,
+                fields(resource),
+                *m_signingKeys,
+                query,
+                headers,
+                data);
+
+        drivers::Http http(m_pool);
+        return http.internalPost(
+                resource.url(),
+                data.data(),
+                data.size(),
+                decode,
+                apiV4.headers(),
+                apiV4.query());
+    }));
+
+    if (!res.ok())
+    {
+        throw ArbiterError(
+                "Couldn't S3 Select from " + rawPath + ": " + res.str());
+    }
+
+    if (!stream.ended())
+    {
+        throw ArbiterError("Incomplete S3 Select result from " + rawPath);
+    }
+}
+
+std::vector<char> S3::select(
+        const std::string rawPath,
+        const std::string& expression,
+        const std::string j) const
+{
+    std::vector<char> records;
+    select(rawPath, expression, [&records](const char* d, std::size_t n)
+    {
+        records.insert(records.end(), d, d + n);
+    }, j);
+    return records;
+}
+
+std::vector<std::string> S3::glob(std::string path, bool verbose) const
+{
+    std::vector<std::string> results;
+    glob(path, [&results](std::string p)
     {
-        std::cout << res.code() << ": " << res.str() << std::endl;
-        return false;
+        results.push_back(std::move(p));
+    }, verbose);
+
+    // Sub-prefixes may complete in any order.
+    std::sort(results.begin(), results.end());
+    return results;
+}
+
+void S3::glob(
+        std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void S3::globInfo(
+        std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    path.pop_back();
+
+    const bool recursive(path.back() == '*');
+    if (recursive) path.pop_back();
+
+    const Resource resource(resourceOf(path));
+    const std::string& bucket(resource.bucket());
+    const std::string& object(resource.object());
+
+    if (const std::string* location = m_config->inventory(bucket))
+    {
+        const std::size_t slash(path.find('/'));
+        globInventory(
+                *location,
+                bucket,
+                slash != std::string::npos ? path.substr(slash + 1) : "",
+                recursive,
+                f);
+        return;
     }
+
+    listTree(bucket, object, recursive, f, nullptr, verbose);
+}
+
+PathList S3::globList(std::string path, const bool verbose) const
+{
+    const std::string original(path);
+
+    path.pop_back();
+    const bool recursive(path.back() == '*');
+    if (recursive) path.pop_back();
+
+    const Resource resource(resourceOf(path));
+    const std::string& bucket(resource.bucket());
+    const std::string& object(resource.object());
+
+    if (m_config->inventory(bucket)) return Http::globList(original, verbose);
+
+    // Every key begins with the directory of the listed prefix, which is
+    // held once by the list.
+    const std::size_t dir(object.rfind('/') + 1);
+    PathList results(type() + "://" + bucket + "/" + object.substr(0, dir));
+
+    listTree(bucket, object, recursive, nullptr, [&](const char* key)
+    {
+        results.pushSuffix(key + dir, std::strlen(key + dir));
+    }, verbose);
+
+    return results;
 }
 
-void S3::put(
-        const std::string rawPath,
-        const std::vector<char>& data,
-        const Headers userHeaders,
-        const Query query) const
+void S3::listTree(
+        const std::string& bucket,
+        const std::string& prefix,
+        const bool recursive,
+        const std::function<void(FileInfo)>& f,
+        const std::function<void(const char*)>& keys,
+        const bool verbose) const
 {
-    const Resource resource(m_config->baseUrl(), rawPath);
-
-    Headers headers(m_config->baseHeaders());
-    headers.insert(userHeaders.begin(), userHeaders.end());
+    std::mutex mutex;
+    auto found([&mutex, &f](FileInfo info)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        f(std::move(info));
+    });
+    auto foundKey([&mutex, &keys](const char* key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        keys(key);
+    });
 
-    if (Arbiter::getExtension(rawPath) == "json")
+    // Each prefix is listed with a delimiter, and for recursive globs the
+    // common prefixes it contains are then listed concurrently rather than
+    // paging through the entire subtree serially.
+    auto visit([&](
+                const std::string& listed,
+                const std::function<void(std::string)>& push)
     {
-        headers["Content-Type"] = "application/json";
-    }
+        list(
+                bucket,
+                listed,
+                found,
+                [&](std::string sub) { if (recursive) push(std::move(sub)); },
+                verbose,
+                "/",
+                "",
+                keys ?
+                    std::function<void(const char*)>(foundKey) :
+                    std::function<void(const char*)>());
+    });
 
-    const ApiV4 apiV4(
-            "PUT",
-            m_config->region(),
-            resource,
-            m_auth->fields(),
-            query,
-            headers,
-            data);
+    parallelTraverse(
+            { prefix },
+            recursive ? m_pool.size() : 1,
+            visit,
+            m_pool.executor());
+}
 
-    drivers::Http http(m_pool);
-    Response res(
-            http.internalPut(
-                resource.url(),
-                data,
-                apiV4.headers(),
-                apiV4.query()));
+void S3::globInfoAfter(
+        std::string path,
+        const std::string& after,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    path.pop_back();
 
-    if (!res.ok())
+    const bool recursive(path.back() == '*');
+    if (recursive) path.pop_back();
+
+    const Resource resource(resourceOf(path));
+    const std::string& bucket(resource.bucket());
+
+    if (m_config->inventory(bucket) ||
+            after.compare(0, bucket.size() + 1, bucket + "/") != 0)
     {
-        throw ArbiterError(
-                "Couldn't S3 PUT to " + rawPath + ": " +
-                std::string(res.data().data(), res.data().size()));
+        Http::globInfoAfter(path + (recursive ? "**" : "*"), after, f, verbose);
+        return;
     }
-}
 
-void S3::copy(const std::string src, const std::string dst) const
-{
-    Headers headers;
-    const Resource resource(m_config->baseUrl(), src);
-    headers["x-amz-copy-source"] = resource.bucket() + '/' + resource.object();
-    put(dst, std::vector<char>(), headers, Query());
+    list(
+            bucket,
+            resource.object(),
+            f,
+            [](std::string) { },
+            verbose,
+            recursive ? "" : "/",
+            after.substr(bucket.size() + 1));
 }
 
-std::vector<std::string> S3::glob(std::string path, bool verbose) const
+void S3::globShard(
+        std::string path,
+        const std::size_t shard,
+        const std::size_t shards,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
 {
-    std::vector<std::string> results;
     path.pop_back();
 
     const bool recursive(path.back() == '*');
     if (recursive) path.pop_back();
 
-    // https://docs.aws.amazon.com/AmazonS3/latest/API/RESTBucketGET.html
-    const Resource resource(m_config->baseUrl(), path);
+    const Resource resource(resourceOf(path));
     const std::string& bucket(resource.bucket());
-    const std::string& object(resource.object());
 
-    Query query;
+    if (m_config->inventory(bucket))
+    {
+        Http::globShard(
+                path + (recursive ? "**" : "*"),
+                shard,
+                shards,
+                f,
+                verbose);
+        return;
+    }
+
+    const std::vector<ShardEntry> entries(
+            shardEntries(path, shards, recursive, [&](
+                    const std::string& dir,
+                    const std::function<void(FileInfo)>& file,
+                    const std::function<void(std::string)>& sub)
+    {
+        list(
+                bucket,
+                dir.substr(bucket.size() + 1),
+                file,
+                [&](std::string s) { sub(bucket + "/" + s); },
+                verbose);
+    }));
+
+    // The files among the entries were listed along with them.
+    const auto range(shardRange(entries.size(), shard, shards));
+    for (std::size_t i(range.first); i < range.second; ++i)
+    {
+        const ShardEntry& entry(entries[i]);
+        if (!entry.directory) f(entry.info);
+        else globInfo(Arbiter::stripType(entry.info.path) + "**", f, verbose);
+    }
+}
+
+void S3::globPattern(
+        const Glob& glob,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const std::string& prefix(glob.prefix());
+    const std::size_t slash(prefix.find('/'));
+    if (slash == std::string::npos)
+    {
+        throw ArbiterError(
+                "Bucket names may not be globbed: " + glob.pattern());
+    }
 
-    if (object.size()) query["prefix"] = object;
+    const std::string bucket(prefix.substr(0, slash));
+    const std::string root(type() + "://");
+
+    std::mutex mutex;
+    auto found([&](FileInfo info)
+    {
+        if (!glob.match(info.path.substr(root.size()))) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        f(std::move(info));
+    });
+
+    if (const std::string* location = m_config->inventory(bucket))
+    {
+        globInventory(
+                *location,
+                bucket,
+                prefix.substr(slash + 1),
+                true,
+                found);
+        return;
+    }
+
+    // Levels are listed with a delimiter, descending concurrently into only
+    // those common prefixes under which the pattern may match, each extended
+    // by whatever literal characters the pattern requires next.
+    auto visit([&](
+                const std::string& listed,
+                const std::function<void(std::string)>& push)
+    {
+        list(bucket, listed, found, [&](const std::string& sub)
+        {
+            const std::string path(bucket + "/" + sub);
+            if (glob.mayContain(path))
+            {
+                push(glob.extend(path).substr(bucket.size() + 1));
+            }
+        }, verbose);
+    });
+
+    parallelTraverse(
+            { prefix.substr(slash + 1) },
+            m_pool.size(),
+            visit,
+            m_pool.executor());
+}
+
+void S3::list(
+        const std::string& bucket,
+        const std::string& prefix,
+        const std::function<void(FileInfo)>& f,
+        const std::function<void(std::string)>& sub,
+        const bool verbose,
+        const std::string& delimiter,
+        const std::string& startAfter,
+        const std::function<void(const char*)>& keys) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/API_ListObjectsV2.html
+    Query query;
+    query["list-type"] = "2";
+    if (delimiter.size()) query["delimiter"] = delimiter;
+    if (prefix.size()) query["prefix"] = prefix;
+    if (startAfter.size()) query["start-after"] = startAfter;
 
     bool more(false);
     std::vector<char> data;
+    std::size_t page(0);
 
     do
     {
-        if (verbose) std::cout << "." << std::flush;
+        if (verbose) logging::debug("\tListing " + bucket + "/" + prefix);
 
-        if (!get(resource.bucket() + "/", data, Headers(), query))
+        if (!get(bucket + "/", data, http::acceptCompressed(), query))
         {
-            throw ArbiterError("Couldn't S3 GET " + resource.bucket());
+            throw ArbiterError("Couldn't S3 GET " + bucket);
         }
 
+        ARBITER_PROBE(list__page, "s3", bucket.c_str(), page, data.size());
+        ++page;
+
         data.push_back('\0');
 
         Xml::xml_document<> xml;
@@ -603,88 +3215,296 @@ std::vector<std::string> S3::glob(std::string path, bool verbose) const
             throw ArbiterError("Could not parse S3 response.");
         }
 
-        if (XmlNode* topNode = xml.first_node("ListBucketResult"))
+        XmlNode* topNode(xml.first_node("ListBucketResult"));
+        if (!topNode) throw ArbiterError(badResponse);
+
+        more = false;
+        if (XmlNode* truncNode = topNode->first_node("IsTruncated"))
         {
-            if (XmlNode* truncNode = topNode->first_node("IsTruncated"))
-            {
-                std::string t(truncNode->value());
-                std::transform(t.begin(), t.end(), t.begin(), ::tolower);
+            std::string t(truncNode->value());
+            std::transform(t.begin(), t.end(), t.begin(), ::tolower);
+
+            more = (t == "true");
+        }
+
+        for (
+                XmlNode* conNode(topNode->first_node("Contents"));
+                conNode;
+                conNode = conNode->next_sibling("Contents"))
+        {
+            XmlNode* keyNode(conNode->first_node("Key"));
+            if (!keyNode) throw ArbiterError(badResponse);
 
-                more = (t == "true");
+            if (keys)
+            {
+                keys(keyNode->value());
+                continue;
             }
 
-            if (XmlNode* conNode = topNode->first_node("Contents"))
+            FileInfo info(type() + "://" + bucket + "/" + keyNode->value());
+
+            if (XmlNode* sizeNode = conNode->first_node("Size"))
             {
-                for ( ; conNode; conNode = conNode->next_sibling())
-                {
-                    if (XmlNode* keyNode = conNode->first_node("Key"))
-                    {
-                        std::string key(keyNode->value());
-                        const bool isSubdir(
-                                key.find('/', object.size()) !=
-                                std::string::npos);
-
-                        // The prefix may contain slashes (i.e. is a sub-dir)
-                        // but we only want to traverse into subdirectories
-                        // beyond the prefix if recursive is true.
-                        if (recursive || !isSubdir)
-                        {
-                            results.push_back(
-                                    type() + "://" + bucket + "/" + key);
-                        }
-
-                        if (more)
-                        {
-                            query["marker"] =
-                                object + key.substr(object.size());
-                        }
-                    }
-                    else
-                    {
-                        throw ArbiterError(badResponse);
-                    }
-                }
+                info.hasSize = true;
+                info.size = std::stoull(sizeNode->value());
             }
-            else
+            if (XmlNode* etagNode = conNode->first_node("ETag"))
             {
-                throw ArbiterError(badResponse);
+                info.version = etagNode->value();
+            }
+            if (XmlNode* timeNode = conNode->first_node("LastModified"))
+            {
+                // Fractional seconds and the zone suffix are ignored.
+                info.modified =
+                    Time(timeNode->value(), "%Y-%m-%dT%H:%M:%S").asUnix();
             }
+
+            f(std::move(info));
         }
-        else
+
+        for (
+                XmlNode* preNode(topNode->first_node("CommonPrefixes"));
+                preNode;
+                preNode = preNode->next_sibling("CommonPrefixes"))
+        {
+            XmlNode* p(preNode->first_node("Prefix"));
+            if (!p) throw ArbiterError(badResponse);
+            sub(p->value());
+        }
+
+        if (more)
         {
-            throw ArbiterError(badResponse);
+            XmlNode* next(topNode->first_node("NextContinuationToken"));
+            if (!next) throw ArbiterError(badResponse);
+            query["continuation-token"] = next->value();
         }
 
         xml.clear();
     }
     while (more);
+}
 
-    return results;
+void S3::globInventory(
+        const std::string& location,
+        const std::string& bucket,
+        const std::string& prefix,
+        const bool recursive,
+        const std::function<void(FileInfo)>& f) const
+{
+    // https://docs.aws.amazon.com/AmazonS3/latest/userguide/storage-inventory-location.html
+    const json manifest(json::parse(Driver::get(inventoryManifest(location))));
+
+    const std::string format(manifest.value("fileFormat", std::string()));
+    if (format != "CSV")
+    {
+        throw ArbiterError(
+                "Unsupported S3 Inventory format " + format +
+                ": only CSV inventories may be read");
+    }
+
+    // The schema names the columns of the files, like "Bucket, Key, Size".
+    std::map<std::string, std::size_t> columns;
+    {
+        std::istringstream schema(manifest.at("fileSchema").get<std::string>());
+        std::string name;
+        for (std::size_t i(0); std::getline(schema, name, ','); ++i)
+        {
+            name.erase(0, name.find_first_not_of(' '));
+            name.erase(name.find_last_not_of(' ') + 1);
+            columns[name] = i;
+        }
+    }
+
+    const std::size_t none(std::string::npos);
+    auto column([&columns, none](const std::string& name)
+    {
+        const auto it(columns.find(name));
+        return it != columns.end() ? it->second : none;
+    });
+
+    const std::size_t keyColumn(column("Key"));
+    if (keyColumn == none) throw ArbiterError("S3 Inventory has no keys");
+
+    const std::size_t sizeColumn(column("Size"));
+    const std::size_t etagColumn(column("ETag"));
+    const std::size_t modifiedColumn(column("LastModifiedDate"));
+    const std::size_t latestColumn(column("IsLatest"));
+    const std::size_t deletedColumn(column("IsDeleteMarker"));
+
+    std::string destination(
+            manifest.at("destinationBucket").get<std::string>());
+    const std::string arn("arn:aws:s3:::");
+    if (destination.compare(0, arn.size(), arn) == 0)
+    {
+        destination.erase(0, arn.size());
+    }
+
+    const json& files(manifest.at("files"));
+
+    // Each file is gzipped CSV, which is decompressed as it arrives.
+    const Compressed gzip(*this, Compressed::Codec::Gzip, 6);
+    std::mutex mutex;
+
+    auto row([&](const std::string& line)
+    {
+        const std::vector<std::string> fields(inventoryFields(line));
+        auto field([&fields, none](const std::size_t i) -> std::string
+        {
+            return i != none && i < fields.size() ? fields[i] : "";
+        });
+
+        if (keyColumn >= fields.size()) return;
+        if (field(latestColumn) == "false") return;
+        if (field(deletedColumn) == "true") return;
+
+        const std::string key(decodeKey(fields[keyColumn]));
+        if (key.compare(0, prefix.size(), prefix) != 0) return;
+        if (!recursive && key.find('/', prefix.size()) != none) return;
+
+        FileInfo info(type() + "://" + bucket + "/" + key);
+
+        const std::string size(field(sizeColumn));
+        if (size.size())
+        {
+            info.hasSize = true;
+            info.size = std::stoull(size);
+        }
+
+        const std::string etag(field(etagColumn));
+        if (etag.size()) info.version = "\"" + etag + "\"";
+
+        const std::string modified(field(modifiedColumn));
+        if (modified.size())
+        {
+            info.modified = Time(modified, "%Y-%m-%dT%H:%M:%S").asUnix();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        f(std::move(info));
+    });
+
+    parallelFor(files.size(), m_pool.size(), [&](const std::size_t i)
+    {
+        std::string partial;
+        gzip.getStream(
+                destination + "/" + files[i].at("key").get<std::string>(),
+                [&](const char* data, const std::size_t size)
+        {
+            partial.append(data, size);
+
+            std::size_t begin(0);
+            std::size_t end(0);
+            while ((end = partial.find('\n', begin)) != none)
+            {
+                row(partial.substr(begin, end - begin));
+                begin = end + 1;
+            }
+            partial.erase(0, begin);
+        });
+
+        if (partial.size()) row(partial);
+    }, m_pool.executor());
+}
+
+std::string S3::inventoryManifest(const std::string& location) const
+{
+    if (Arbiter::getExtension(location) == "json") return location;
+
+    std::string dir(location);
+    if (dir.back() != '/') dir.push_back('/');
+
+    const std::size_t slash(dir.find('/'));
+    const std::string bucket(dir.substr(0, slash));
+    const std::string prefix(dir.substr(slash + 1));
+
+    // Each delivery is in a directory named by its time, like
+    // 2024-01-31T01-00Z/, so these sort in the order they were made.
+    std::vector<std::string> deliveries;
+
+    list(bucket, prefix, [](FileInfo) { }, [&](std::string delivery)
+    {
+        if (delivery.size() > prefix.size() &&
+                std::isdigit(delivery[prefix.size()]))
+        {
+            deliveries.push_back(std::move(delivery));
+        }
+    }, false);
+
+    std::sort(deliveries.rbegin(), deliveries.rend());
+
+    // A delivery is complete once its manifest has been written.
+    for (const std::string& delivery : deliveries)
+    {
+        const std::string manifest(bucket + "/" + delivery + "manifest.json");
+        if (tryGetSize(manifest)) return manifest;
+    }
+
+    throw ArbiterError("No S3 Inventory manifest under " + location);
 }
 
+const std::string S3::ApiV4::unsignedPayload("UNSIGNED-PAYLOAD");
+
 S3::ApiV4::ApiV4(
-        const std::string verb,
+        const std::string& verb,
         const std::string& region,
         const Resource& resource,
         const S3::AuthFields authFields,
+        SigningKeys& signingKeys,
         const Query& query,
         const Headers& headers,
         const std::vector<char>& data)
+    : ApiV4(
+            verb,
+            region,
+            resource,
+            authFields,
+            signingKeys,
+            query,
+            headers,
+            crypto::encodeAsHex(crypto::sha256(data)))
+{ }
+
+S3::ApiV4::ApiV4(
+        const std::string& verb,
+        const std::string& region,
+        const Resource& resource,
+        const S3::AuthFields authFields,
+        SigningKeys& signingKeys,
+        const Query& query,
+        const Headers& headers,
+        const std::string payloadHash)
     : m_authFields(authFields)
     , m_region(region)
-    , m_time()
+    , m_service(resource.service())
+    , m_dateTime(signingTime())
+    , m_date(m_dateTime.substr(0, 8))
+    , m_signingKey(
+            signingKeys.get(m_authFields, m_date, m_region, m_service))
+    , m_payloadHash(payloadHash)
     , m_headers(headers)
-    , m_query(query)
+    , m_query()
     , m_signedHeadersString()
 {
+    ARBITER_PROBE(sign__start, verb.c_str());
+
+    // Our query is sent as-is, so encode it to match the canonical request.
+    std::string key;
+    for (const auto& q : query)
+    {
+        sanitize(q.first, "", key);
+        sanitize(q.second, "", m_query[key]);
+    }
+
     m_headers["Host"] = resource.host();
-    m_headers["X-Amz-Date"] = m_time.str(Time::iso8601NoSeparators);
+    m_headers["X-Amz-Date"] = m_dateTime;
     if (m_authFields.token().size())
     {
-        m_headers["X-Amz-Security-Token"] = m_authFields.token();
+        const std::string name(
+                m_authFields.session() ?
+                    "x-amz-s3session-token" : "X-Amz-Security-Token");
+        m_headers[name] = m_authFields.token();
     }
-    m_headers["X-Amz-Content-Sha256"] =
-            crypto::encodeAsHex(crypto::sha256(data));
+    m_headers["X-Amz-Content-Sha256"] = m_payloadHash;
 
     if (verb == "PUT" || verb == "POST")
     {
@@ -692,44 +3512,38 @@ S3::ApiV4::ApiV4(
         {
             m_headers["Content-Type"] = "application/octet-stream";
         }
+        // Expect is left unsigned, for our Curl to set by the upload size.
         m_headers.erase("Transfer-Encoding");
         m_headers.erase("Expect");
     }
 
-    const Headers normalizedHeaders(
-            std::accumulate(
-                m_headers.begin(),
-                m_headers.end(),
-                Headers(),
-                [](const Headers& in, const Headers::value_type& h)
-                {
-                    Headers out(in);
-                    out[toLower(h.first)] = trim(h.second);
-                    return out;
-                }));
+    // Canonical headers are lowercased and trimmed, and sorted by name.
+    Headers normalizedHeaders;
+    std::size_t namesSize(0);
+    std::size_t valuesSize(0);
+    for (const auto& h : m_headers)
+    {
+        normalizedHeaders[toLower(h.first)] = trim(h.second);
+        namesSize += h.first.size() + 2;
+        valuesSize += h.second.size();
+    }
 
-    m_canonicalHeadersString =
-            std::accumulate(
-                normalizedHeaders.begin(),
-                normalizedHeaders.end(),
-                std::string(),
-                [](const std::string& in, const Headers::value_type& h)
-                {
-                    return in + h.first + ':' + h.second + '\n';
-                });
-
-    m_signedHeadersString =
-            std::accumulate(
-                normalizedHeaders.begin(),
-                normalizedHeaders.end(),
-                std::string(),
-                [](const std::string& in, const Headers::value_type& h)
-                {
-                    return in + (in.empty() ? "" : ";") + h.first;
-                });
+    m_canonicalHeadersString.reserve(namesSize + valuesSize);
+    m_signedHeadersString.reserve(namesSize);
+
+    for (const auto& h : normalizedHeaders)
+    {
+        m_canonicalHeadersString.append(h.first);
+        m_canonicalHeadersString.push_back(':');
+        m_canonicalHeadersString.append(h.second);
+        m_canonicalHeadersString.push_back('\n');
+
+        if (m_signedHeadersString.size()) m_signedHeadersString += ";";
+        m_signedHeadersString.append(h.first);
+    }
 
     const std::string canonicalRequest(
-            buildCanonicalRequest(verb, resource, query, data));
+            buildCanonicalRequest(verb, resource));
 
     const std::string stringToSign(buildStringToSign(canonicalRequest));
 
@@ -737,39 +3551,97 @@ S3::ApiV4::ApiV4(
 
     m_headers["Authorization"] =
             getAuthHeader(m_signedHeadersString, signature);
+
+    ARBITER_PROBE(sign__done, verb.c_str());
 }
 
-std::string S3::ApiV4::buildCanonicalRequest(
-        const std::string verb,
+S3::ApiV4::ApiV4(
+        const std::string& verb,
+        const std::string& region,
         const Resource& resource,
-        const Query& query,
-        const std::vector<char>& data) const
+        const S3::AuthFields authFields,
+        SigningKeys& signingKeys,
+        const int64_t expiry)
+    : m_authFields(authFields)
+    , m_region(region)
+    , m_service(resource.service())
+    , m_dateTime(signingTime())
+    , m_date(m_dateTime.substr(0, 8))
+    , m_signingKey(
+            signingKeys.get(m_authFields, m_date, m_region, m_service))
+    , m_payloadHash(unsignedPayload)
+    , m_headers()
+    , m_query()
+    , m_signedHeadersString("host")
 {
-    const std::string canonicalUri("/" + resource.object());
+    // https://docs.aws.amazon.com/AmazonS3/latest/API/sigv4-query-string-auth.html
+    Query query;
+    query["X-Amz-Algorithm"] = "AWS4-HMAC-SHA256";
+    query["X-Amz-Credential"] =
+        m_authFields.access() + '/' +
+        m_date + "/" + m_region + "/" + m_service + "/aws4_request";
+    query["X-Amz-Date"] = m_dateTime;
+    query["X-Amz-Expires"] = std::to_string(expiry);
+    query["X-Amz-SignedHeaders"] = m_signedHeadersString;
+    if (m_authFields.token().size())
+    {
+        const std::string name(
+                m_authFields.session() ?
+                    "X-Amz-S3session-Token" : "X-Amz-Security-Token");
+        query[name] = m_authFields.token();
+    }
 
-    auto canonicalizeQuery([](const std::string& s, const Query::value_type& q)
+    std::string key;
+    for (const auto& q : query)
     {
-        const std::string keyVal(
-                sanitize(q.first, "") + '=' +
-                sanitize(q.second, ""));
+        sanitize(q.first, "", key);
+        sanitize(q.second, "", m_query[key]);
+    }
 
-        return s + (s.size() ? "&" : "") + keyVal;
-    });
+    m_headers["Host"] = resource.host();
+    m_canonicalHeadersString = "host:" + resource.host() + "\n";
+
+    const std::string canonicalRequest(
+            buildCanonicalRequest(verb, resource));
 
-    const std::string canonicalQuery(
-            std::accumulate(
-                query.begin(),
-                query.end(),
-                std::string(),
-                canonicalizeQuery));
+    m_query["X-Amz-Signature"] =
+        calculateSignature(buildStringToSign(canonicalRequest));
+}
 
-    return
-        line(verb) +
-        line(canonicalUri) +
-        line(canonicalQuery) +
-        line(m_canonicalHeadersString) +
-        line(m_signedHeadersString) +
-        crypto::encodeAsHex(crypto::sha256(data));
+std::string S3::ApiV4::buildCanonicalRequest(
+        const std::string verb,
+        const Resource& resource) const
+{
+    const std::string& object(resource.object());
+
+    // Our query has already been encoded, and is sorted by encoded key as
+    // required.
+    std::size_t querySize(0);
+    for (const auto& q : m_query) querySize += q.first.size() + q.second.size();
+
+    std::string canonical;
+    canonical.reserve(
+            verb.size() + object.size() + querySize + 2 * m_query.size() +
+            m_canonicalHeadersString.size() + m_signedHeadersString.size() +
+            m_payloadHash.size() + 8);
+
+    canonical.append(verb).push_back('\n');
+    canonical.push_back('/');
+    canonical.append(object).push_back('\n');
+
+    for (auto it(m_query.begin()); it != m_query.end(); ++it)
+    {
+        if (it != m_query.begin()) canonical.push_back('&');
+        canonical.append(it->first).push_back('=');
+        canonical.append(it->second);
+    }
+    canonical.push_back('\n');
+
+    canonical.append(m_canonicalHeadersString).push_back('\n');
+    canonical.append(m_signedHeadersString).push_back('\n');
+    canonical.append(m_payloadHash);
+
+    return canonical;
 }
 
 std::string S3::ApiV4::buildStringToSign(
@@ -777,26 +3649,55 @@ std::string S3::ApiV4::buildStringToSign(
 {
     return
         line("AWS4-HMAC-SHA256") +
-        line(m_time.str(Time::iso8601NoSeparators)) +
-        line(m_time.str(Time::dateNoSeparators) +
-                "/" + m_region + "/s3/aws4_request") +
+        line(m_dateTime) +
+        line(m_date + "/" + m_region + "/" + m_service + "/aws4_request") +
         crypto::encodeAsHex(crypto::sha256(canonicalRequest));
 }
 
 std::string S3::ApiV4::calculateSignature(
         const std::string& stringToSign) const
 {
-    const std::string kDate(
-            crypto::hmacSha256(
-                "AWS4" + m_authFields.hidden(),
-                m_time.str(Time::dateNoSeparators)));
+    return crypto::encodeAsHex(crypto::hmacSha256(m_signingKey, stringToSign));
+}
+
+std::string S3::SigningKeys::get(
+        const AuthFields& fields,
+        const std::string& date,
+        const std::string& region,
+        const std::string& service)
+{
+    const std::pair<std::string, std::string> id(
+            fields.hidden(),
+            region + '/' + service);
 
-    const std::string kRegion(crypto::hmacSha256(kDate, m_region));
-    const std::string kService(crypto::hmacSha256(kRegion, "s3"));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (date == m_date)
+        {
+            auto it(m_keys.find(id));
+            if (it != m_keys.end()) return it->second;
+        }
+    }
+
+    const std::string kDate(
+            crypto::hmacSha256("AWS4" + fields.hidden(), date));
+    const std::string kRegion(crypto::hmacSha256(kDate, region));
+    const std::string kService(crypto::hmacSha256(kRegion, service));
     const std::string kSigning(
             crypto::hmacSha256(kService, "aws4_request"));
 
-    return crypto::encodeAsHex(crypto::hmacSha256(kSigning, stringToSign));
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Keys from previous days are never needed again.  A straggling request
+    // signed just before midnight is served, but its key isn't kept.
+    if (date > m_date)
+    {
+        m_date = date;
+        m_keys.clear();
+    }
+    if (date == m_date) m_keys[id] = kSigning;
+
+    return kSigning;
 }
 
 std::string S3::ApiV4::getAuthHeader(
@@ -806,23 +3707,28 @@ std::string S3::ApiV4::getAuthHeader(
     return
         std::string("AWS4-HMAC-SHA256 ") +
         "Credential=" + m_authFields.access() + '/' +
-            m_time.str(Time::dateNoSeparators) + "/" +
-            m_region + "/s3/aws4_request, " +
+            m_date + "/" + m_region + "/" + m_service + "/aws4_request, " +
         "SignedHeaders=" + signedHeadersString + ", " +
         "Signature=" + signature;
 }
 
-S3::Resource::Resource(std::string base, std::string fullPath)
+S3::Resource::Resource(
+        std::string base,
+        const std::string& fullPath,
+        std::string region)
     : m_baseUrl(base)
+    , m_region(region)
     , m_bucket()
     , m_object()
     , m_virtualHosted(true)
 {
-    fullPath = sanitize(fullPath);
-    const std::size_t split(fullPath.find("/"));
+    std::string sanitized;
+    sanitize(fullPath, "/", sanitized);
+    const std::size_t split(sanitized.find("/"));
 
-    m_bucket = fullPath.substr(0, split);
-    if (split != std::string::npos) m_object = fullPath.substr(split + 1);
+    m_bucket = sanitized.substr(0, split);
+    if (split != std::string::npos) m_object = sanitized.substr(split + 1);
+    m_express = !zoneOf(m_bucket).empty();
 
     // Always use virtual-host style paths.  We'll use HTTP for our back-end
     // calls to allow this.  If we were to use HTTPS on the back-end, then we
@@ -830,48 +3736,57 @@ S3::Resource::Resource(std::string base, std::string fullPath)
     // '.' characters.
     //
     // m_virtualHosted = m_bucket.find_first_of('.') == std::string::npos;
-}
-
-std::string S3::Resource::baseUrl() const
-{
-    return m_baseUrl;
-}
 
-std::string S3::Resource::bucket() const
-{
-    return m_virtualHosted ? m_bucket : "";
-}
+    // Pop slash.
+    const std::string authority(m_baseUrl.substr(0, m_baseUrl.size() - 1));
 
-std::string S3::Resource::url() const
-{
     if (m_virtualHosted)
     {
-        return "http://" + m_bucket + "." + m_baseUrl + m_object;
+        m_path = m_object;
+        m_url = "http://" + m_bucket + "." + m_baseUrl + m_object;
+        m_host = m_bucket + "." + authority;
     }
     else
     {
-        return "https://" + m_baseUrl + m_bucket + "/" + m_object;
+        // We can't use virtual-host style paths if the bucket contains dots.
+        m_path = m_bucket + "/" + m_object;
+        m_url = "https://" + m_baseUrl + m_bucket + "/" + m_object;
+        m_host = authority;
     }
 }
 
-std::string S3::Resource::object() const
+S3::Resource S3::Resource::forService(
+        const std::string& url,
+        const std::string region,
+        const std::string service)
 {
-    // We can't use virtual-host style paths if the bucket contains dots.
-    if (m_virtualHosted) return m_object;
-    else return m_bucket + "/" + m_object;
+    const std::size_t scheme(url.find("://"));
+    const std::size_t start(scheme == std::string::npos ? 0 : scheme + 3);
+    const std::size_t slash(url.find('/', start));
+
+    Resource resource;
+    resource.m_region = region;
+    resource.m_service = service;
+    resource.m_host = url.substr(start, slash - start);
+    resource.m_url =
+        (scheme == std::string::npos ? "https://" : url.substr(0, start)) +
+        resource.m_host + "/";
+    resource.m_baseUrl = resource.m_host + "/";
+    return resource;
 }
 
-std::string S3::Resource::host() const
+S3::Resource S3::Resource::child(const std::string& path) const
 {
-    if (m_virtualHosted)
-    {
-        // Pop slash.
-        return m_bucket + "." + m_baseUrl.substr(0, m_baseUrl.size() - 1);
-    }
-    else
-    {
-        return m_baseUrl.substr(0, m_baseUrl.size() - 1);
-    }
+    Resource resource(*this);
+    sanitize(path, "/", resource.m_object);
+    resource.m_path += resource.m_object;
+    resource.m_url += resource.m_object;
+    return resource;
+}
+
+std::string S3::Resource::bucket() const
+{
+    return m_virtualHosted ? m_bucket : "";
 }
 
 } // namespace drivers
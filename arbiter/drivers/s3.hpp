@@ -1,11 +1,17 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/credentials.hpp>
 #include <arbiter/util/time.hpp>
 #include <arbiter/util/util.hpp>
 #include <arbiter/drivers/http.hpp>
@@ -19,10 +25,23 @@ namespace ARBITER_CUSTOM_NAMESPACE
 namespace arbiter
 {
 
+class Runtime;
+
 namespace drivers
 {
 
-/** @brief Amazon %S3 driver. */
+/** @brief Amazon %S3 driver.
+ *
+ * Requests for buckets outside the configured region are refused by S3,
+ * which names the region of the bucket.  That region is remembered, so the
+ * refused request and those which follow it are signed and addressed for it,
+ * and a single driver serves buckets in any region.
+ *
+ * Directory buckets of S3 Express One Zone, named with an `--x-s3` suffix,
+ * are addressed by the zonal hosts of their availability zones.  Requests
+ * for them are signed with session credentials from CreateSession, which
+ * are kept per bucket and replaced shortly before they expire.
+ */
 class S3 : public Http
 {
     class Auth;
@@ -33,7 +52,7 @@ public:
     S3(
             http::Pool& pool,
             std::string profile,
-            std::unique_ptr<Auth> auth,
+            std::shared_ptr<Auth> auth,
             std::unique_ptr<Config> config);
 
     /** Try to construct an S3 driver.  The configuration/credential discovery
@@ -43,31 +62,257 @@ public:
      *      - Well-known files or their environment overrides, like
      *          `~/.aws/credentials` or the file at AWS_CREDENTIAL_FILE.
      *      - EC2 instance profile.
+     *
+     * If the configuration contains a `warm` object, connections to each of
+     * its `buckets` are opened ahead of their first use, `count` of each, as
+     * by http::Pool::warm.
+     *
+     * Unless an `endpoint` is configured, setting `accelerate` addresses
+     * buckets by their Transfer Acceleration hosts, and setting `dualstack`,
+     * or AWS_USE_DUALSTACK_ENDPOINT to `true`, by their dual-stack hosts.
+     * Either may be overridden for single buckets by the objects of a
+     * `buckets` object, keyed by bucket name.
+     *
+     * An `inventory` object, keyed by bucket name, answers globs within
+     * those buckets from their S3 Inventory rather than by listing them.
+     * Each value locates an inventory by its `manifest.json`, or by the
+     * directory of its configuration, under which the newest delivery with
+     * a manifest is read.
+     *
+     * A `notifications` object, with the `queue` URL of an SQS queue to
+     * which the event notifications of our buckets are delivered, and the
+     * optional `region` of that queue, if not ours, and `wait` in seconds
+     * of each receive, by default 20, lets watch receive changes from that
+     * queue rather than poll listings.
      */
     static std::vector<std::unique_ptr<S3>> create(
             http::Pool& pool,
             std::string j);
 
-    static std::unique_ptr<S3> createOne(http::Pool& pool, std::string j);
+    /** As above, for the single profile of @p j.  With a @p runtime, the
+     * credentials of the profile are kept by it, so that the drivers of
+     * every Arbiter sharing it discover and refresh them once.
+     */
+    static std::unique_ptr<S3> createOne(
+            http::Pool& pool,
+            std::string j,
+            Runtime* runtime = nullptr);
+
+    /** The type of the driver which createOne would construct from @p j,
+     * which is known without discovering its credentials.
+     */
+    static std::string typeOf(std::string j);
 
     // Overrides.
     virtual std::string type() const override;
 
+    /** All of them, though notifications of changes only with a
+     * configured queue.
+     */
+    virtual Capabilities capabilities() const override;
+
+    /** With a configured queue, receives the S3 event notifications from
+     * it, directly or by way of SNS, and deletes each message received,
+     * so the queue must be dedicated to a single watch.  Events for the
+     * objects which don't match @p path are dropped.  Otherwise, polls as
+     * does the default.
+     */
+    virtual std::unique_ptr<Watch> watch(
+            std::string path,
+            ChangeCallback f,
+            std::chrono::milliseconds interval =
+                std::chrono::seconds(60)) const override;
+
     virtual std::unique_ptr<std::size_t> tryGetSize(
             std::string path) const override;
 
+    /** Looks up the size by a HEAD, reporting its code. */
+    virtual Status tryReadSize(
+            std::string path,
+            std::size_t& size) const override;
+
+    /** The ETag of the object. */
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    /** A URL for @p verb requests of the object at @p path, which are
+     * authorized by its query string until @p expiry from now, of at most
+     * seven days, so that it may be handed to processes without
+     * credentials and used without signing.  It is addressed as our own
+     * requests are, for the region of the bucket if that has been learned.
+     * A URL signed with temporary credentials, including the sessions of
+     * directory buckets, expires with them if that is sooner.
+     */
+    std::string presign(
+            std::string path,
+            std::string verb = "GET",
+            std::chrono::seconds expiry = std::chrono::seconds(3600)) const;
+
+    /** Query the CSV or JSON object at @p path with the SQL @p expression
+     * via S3 Select, passing the records of the result to @p sink as they
+     * arrive, so that only those records are transferred.  The stringified
+     * JSON @p j describes the object and the result, with keys:
+     *
+     * - `format`, `csv` by default, or `json`
+     * - `output`, the format of the records, by default that of the object
+     * - `header`, for CSV, whether its first line names the columns: `use`,
+     *   `ignore`, or `none`, the default
+     * - `delimiter`, the CSV field delimiter, by default a comma
+     * - `type`, for JSON, `lines`, the default, or `document`
+     * - `compression`, `none` by default, `gzip`, or `bzip2`
+     * - `scanStart` and `scanEnd`, the range of bytes of an uncompressed
+     *   object whose records are scanned, by default all of them
+     *
+     * Errors reported partway through the result are thrown, after the
+     * records which preceded them have been passed to @p sink.
+     */
+    void select(
+            std::string path,
+            const std::string& expression,
+            const std::function<void(const char*, std::size_t)>& sink,
+            std::string j = "") const;
+
+    /** As above, returning the records of the result. */
+    std::vector<char> select(
+            std::string path,
+            const std::string& expression,
+            std::string j = "") const;
+
     /** Inherited from Drivers::Http. */
     virtual void put(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers,
-            http::Query query) const override;
+            const http::Headers& headers,
+            const http::Query& query) const override;
+
+    /** Sends from the caller's buffer, without copying it, as do the parts
+     * of a multipart upload.
+     */
+    virtual void put(
+            std::string path,
+            const char* data,
+            std::size_t size) const override;
 
     virtual void copy(std::string src, std::string dst) const override;
 
+    virtual void remove(std::string path) const override;
+
+    /** Removes the objects of each bucket with DeleteObjects requests of up
+     * to 1000 keys each, up to @p threads of which are in flight at a time.
+     */
+    virtual std::vector<std::exception_ptr> removeMany(
+            const std::vector<std::string>& paths,
+            std::size_t threads) const override;
+
+    /** Data larger than the multipart threshold is streamed as a multipart
+     * upload.
+     */
+    virtual std::unique_ptr<Writer> putStream(
+            std::string path) const override;
+
+    /** Data larger than @p partSize, which is raised to the smallest part
+     * that S3 accepts, is uploaded as a multipart upload regardless of the
+     * multipart threshold.
+     */
+    virtual void putParts(
+            std::string path,
+            const char* data,
+            std::size_t size,
+            std::size_t partSize) const override;
+
+    /** With unsigned payloads configured, uploads up to the multipart
+     * threshold are streamed as a single PUT.  Otherwise the payload must be
+     * hashed before it is sent, so the generic buffered implementation is
+     * used.
+     */
+    virtual void putFrom(
+            std::string path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size) const override;
+
+    /** Signed requests driven by the transfer engine of our http::Pool,
+     * except for ranged or part-wise GETs and multipart uploads, which fall
+     * back to Driver::getBinaryThen and Driver::putThen.
+     */
+    virtual void getBinaryThen(
+            std::string path,
+            Completion<std::vector<char>> done,
+            Executor& executor) const override;
+
+    virtual void putThen(
+            std::string path,
+            std::vector<char> data,
+            Completion<void> done,
+            Executor& executor) const override;
+
+    virtual void tryGetSizeThen(
+            std::string path,
+            Completion<std::unique_ptr<std::size_t>> done,
+            Executor& executor) const override;
+
 private:
     static std::string extractProfile(std::string j);
 
+    // A signed HEAD request for the object at @p path.
+    http::Response head(std::string path) const;
+
+    // The value to sign for an upload of the @p size bytes at @p data, which
+    // is their SHA-256 or, if so configured, UNSIGNED-PAYLOAD.  If the pool
+    // verifies transfers, their Content-MD5 is added to @p headers in the
+    // same pass, as is their CRC32C if uploads are so checksummed.
+    std::string payloadHash(
+            const char* data,
+            std::size_t size,
+            http::Headers& headers) const;
+
+    // Upload the @p size bytes at @p data, which are sent from the caller's
+    // buffer, as a multipart upload if beyond the multipart threshold.
+    void putData(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    // Upload the @p size bytes at @p data in parallel parts of about
+    // @p partSize bytes via the S3 multipart upload API.
+    void putMultipart(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            std::size_t partSize,
+            const http::Headers& headers,
+            const http::Query& query) const;
+
+    // Read @p path by part number, see Config::partGets, fetching its first
+    // part and then the rest in parallel.  Returns false, leaving @p data
+    // and @p status unchanged, if it should be read otherwise.
+    bool getParts(
+            const std::string& path,
+            std::vector<char>& data,
+            const http::Headers& headers,
+            Status& status) const;
+
+    // Copy the @p size bytes of @p src to @p dst in parallel parts via the
+    // S3 multipart upload API, without transferring the data.
+    void copyMultipart(
+            const std::string& src,
+            const std::string& dst,
+            std::size_t size) const;
+
+    // Remove @p keys from @p bucket with a single DeleteObjects request,
+    // returning the error message for each key which was not removed, or
+    // an empty string for those which were.
+    std::vector<std::string> deleteObjects(
+            const std::string& bucket,
+            const std::vector<std::string>& keys) const;
+
+    // Make the SQS @p action, like ReceiveMessage, on our queue, with the
+    // JSON @p body, returning the JSON response.
+    std::string queueRequest(
+            const std::string& action,
+            const std::string& body) const;
+
     /*
     static std::unique_ptr<Config> extractConfig(
             std::string j,
@@ -76,65 +321,310 @@ private:
             */
     /** Inherited from Drivers::Http. */
     virtual bool get(
-            std::string path,
+            const std::string& path,
             std::vector<char>& data,
-            http::Headers headers,
-            http::Query query) const override;
+            const http::Headers& headers,
+            const http::Query& query) const override;
+
+    virtual Status getStatus(
+            const std::string& path,
+            std::vector<char>& data,
+            const http::Headers& headers,
+            const http::Query& query) const override;
+
+    virtual bool get(
+            const std::string& path,
+            const std::function<void(const char*, std::size_t)>& sink,
+            const http::Headers& headers,
+            const http::Query& query) const override;
 
     virtual std::vector<std::string> glob(
             std::string path,
             bool verbose) const override;
 
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    /** Keys are packed into the list as each page is parsed. */
+    virtual PathList globList(std::string path, bool verbose) const override;
+
+    /** Listings include the size, ETag, and modification time of each
+     * object.  For a bucket with a configured inventory, they are those of
+     * the current objects as of its latest delivery.
+     */
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    /** Only the objects after @p after are listed, without a delimiter for
+     * recursive globs.
+     */
+    virtual void globInfoAfter(
+            std::string path,
+            const std::string& after,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    /** Each share is a run of the keys of the prefix, split at the entries
+     * of its levels, whose directories are listed as by globInfo.
+     */
+    virtual void globShard(
+            std::string path,
+            std::size_t shard,
+            std::size_t shards,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    /** Only the levels of the bucket under which the pattern may match are
+     * listed, concurrently.
+     */
+    virtual void globPattern(
+            const Glob& glob,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
     class ApiV4;
     class Resource;
+    class MultipartWriter;
+    class QueueWatch;
+    class SigningKeys;
+    struct Session;
+
+    // An uploaded part, with its checksum if uploads are checksummed.
+    struct Part
+    {
+        std::string etag;
+        std::string checksum;
+    };
+
+    // Multipart upload operations, returning the upload ID and part
+    // respectively.  Parts are numbered from 1.  Uploads of data rather
+    // than copies are @p checksummed, if so configured.  Uploads which
+    // fail are aborted, so that their parts aren't kept, which is only
+    // logged if it fails in turn.
+    std::string initiateMultipart(
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query,
+            bool checksummed) const;
+    Part putPart(
+            const Resource& resource,
+            const std::string& uploadId,
+            std::size_t number,
+            const char* data,
+            std::size_t size) const;
+    std::string copyPart(
+            const Resource& resource,
+            const std::string& uploadId,
+            std::size_t number,
+            const std::string& source,
+            std::size_t begin,
+            std::size_t end) const;
+    void completeMultipart(
+            const Resource& resource,
+            const std::string& uploadId,
+            const std::vector<Part>& parts) const;
+    void abortMultipart(
+            const Resource& resource,
+            const std::string& uploadId) const;
+
+    // List the objects of @p bucket from @p prefix, passing each to @p f
+    // and each common prefix to @p sub.  With a @p delimiter, only one level
+    // is listed.  If @p startAfter is not empty, only the keys after it are.
+    // If @p keys is given, it is passed each key in place of @p f, without
+    // building its FileInfo.
+    void list(
+            const std::string& bucket,
+            const std::string& prefix,
+            const std::function<void(FileInfo)>& f,
+            const std::function<void(std::string)>& sub,
+            bool verbose,
+            const std::string& delimiter = "/",
+            const std::string& startAfter = "",
+            const std::function<void(const char*)>& keys = nullptr) const;
+
+    // List the objects of @p bucket under @p prefix as list does, one level
+    // at a time, descending concurrently into the common prefixes of each
+    // if @p recursive.  Calls to @p f and @p keys are serialized.
+    void listTree(
+            const std::string& bucket,
+            const std::string& prefix,
+            bool recursive,
+            const std::function<void(FileInfo)>& f,
+            const std::function<void(const char*)>& keys,
+            bool verbose) const;
+
+    // List the objects of @p bucket under @p prefix, recursively if
+    // @p recursive, from its S3 Inventory at @p location, whose files are
+    // read in parallel.
+    void globInventory(
+            const std::string& location,
+            const std::string& bucket,
+            const std::string& prefix,
+            bool recursive,
+            const std::function<void(FileInfo)>& f) const;
+
+    // The path of the newest manifest of the inventory at @p location.
+    std::string inventoryManifest(const std::string& location) const;
+
+    // The resource at @p path, addressed to and signed for the region of its
+    // bucket if that has been learned, and otherwise the configured region.
+    // Built from the template of its bucket, so that only the object key
+    // is encoded per request.
+    Resource resourceOf(const std::string& path) const;
+
+    // The resource of @p bucket alone, from which those of its objects are
+    // built, made once and rebuilt only if the bucket's region is learned.
+    std::shared_ptr<const Resource> bucketResource(const std::string& bucket)
+        const;
+
+    // True if the region of the bucket of @p path has been confirmed by a
+    // successful request, so that uploads which cannot be sent again need
+    // not risk a request being refused for its region.
+    bool located(const std::string& path) const;
+
+    // Learn the region of the bucket of @p resource from @p res, returning
+    // true if @p res refused the request because the bucket is in another
+    // region, in which case the request should be signed for it and sent
+    // again.
+    bool learnRegion(const Resource& resource, const http::Response& res)
+        const;
+
+    // The credentials with which to sign requests for @p resource, which for
+    // a directory bucket are those of its session, created if need be.
+    AuthFields fields(const Resource& resource) const;
+
+    // Create a session for the directory bucket @p bucket.
+    std::shared_ptr<const Session> createSession(const std::string& bucket)
+        const;
+
+    // Make a request with @p send for the resource at @p path, and if it is
+    // refused for the region of its bucket, make it once more for the region
+    // named by the refusal.
+    http::Response request(
+            const std::string& path,
+            const std::function<http::Response(const Resource&)>& send) const;
+
+    // As above, but for requests made on the transfer engine of our pool,
+    // whose responses are passed to @p done.
+    void requestAsync(
+            const std::string& path,
+            std::function<void(const Resource&, Completion<http::Response>)>
+                send,
+            Completion<http::Response> done) const;
 
     std::string m_profile;
-    std::unique_ptr<Auth> m_auth;
+    std::shared_ptr<Auth> m_auth;
     std::unique_ptr<Config> m_config;
+    std::unique_ptr<SigningKeys> m_signingKeys;
+
+    // Buckets whose regions have been confirmed or learned, with the region
+    // and base URL of each.
+    struct Location
+    {
+        std::string region;
+        std::string baseUrl;
+    };
+
+    mutable std::map<std::string, Location> m_locations;
+    mutable std::mutex m_locationsMutex;
+
+    // Templates of the resources of each bucket, guarded by the mutex above.
+    mutable std::map<std::string, std::shared_ptr<const Resource>> m_buckets;
+
+    // Sessions of directory buckets, by bucket.
+    mutable std::map<std::string, std::shared_ptr<const Session>> m_sessions;
+    mutable std::mutex m_sessionsMutex;
 };
 
 class S3::AuthFields
 {
 public:
-    AuthFields(std::string access, std::string hidden, std::string token = "")
-        : m_access(access), m_hidden(hidden), m_token(token)
+    AuthFields(
+            std::string access,
+            std::string hidden,
+            std::string token = "",
+            bool session = false)
+        : m_access(access)
+        , m_hidden(hidden)
+        , m_token(token)
+        , m_session(session)
     { }
 
     const std::string& access() const { return m_access; }
     const std::string& hidden() const { return m_hidden; }
     const std::string& token() const { return m_token; }
 
+    // True for the session credentials of a directory bucket, whose token
+    // is sent as x-amz-s3session-token.
+    bool session() const { return m_session; }
+
 private:
     std::string m_access;
     std::string m_hidden;
     std::string m_token;
+    bool m_session;
 };
 
+// Credentials are held in an immutable snapshot which readers load without
+// locking.  For an IAM role, the first call to fields() fetches them, after
+// which a background thread replaces them ahead of their expiration.  With
+// a credential cache, each fetch is stored under a key, and a process which
+// finds unexpired credentials there starts with them instead.
 class S3::Auth
 {
 public:
-    Auth(std::string access, std::string hidden, std::string token = "")
-        : m_access(access)
-        , m_hidden(hidden)
-        , m_token(token)
-    { }
-
-    Auth(std::string iamRole)
-        : m_role(makeUnique<std::string>(iamRole))
-    { }
+    Auth(std::string access, std::string hidden, std::string token = "");
+    Auth(
+            std::string iamRole,
+            std::shared_ptr<CredentialCache> cache = nullptr,
+            std::string cacheKey = "");
+    ~Auth();
 
     static std::unique_ptr<Auth> create(std::string j, std::string profile);
 
+    // An IAM role and its credentials from @p cache, or null if it doesn't
+    // hold unexpired ones under @p cacheKey.
+    static std::unique_ptr<Auth> restore(
+            std::shared_ptr<CredentialCache> cache,
+            std::string cacheKey);
+
     AuthFields fields() const;
 
 private:
-    mutable std::string m_access;
-    mutable std::string m_hidden;
-    mutable std::string m_token;
+    struct Snapshot
+    {
+        Snapshot(AuthFields fields, Time expiration)
+            : fields(fields)
+            , expiration(expiration)
+        { }
+
+        const AuthFields fields;
+        const Time expiration;
+    };
+
+    // Fetch and publish new instance profile credentials.  Requires m_mutex.
+    std::shared_ptr<const Snapshot> refresh() const;
+
+    // Body of the background refresh thread.
+    void run() const;
+
+    Auth(const Auth&);
+    Auth& operator=(const Auth&);
+
+    mutable std::shared_ptr<const Snapshot> m_snapshot;
 
     std::unique_ptr<std::string> m_role;
-    mutable std::unique_ptr<Time> m_expiration;
+    const std::shared_ptr<CredentialCache> m_cache;
+    const std::string m_cacheKey;
+    mutable std::unique_ptr<http::Pool> m_pool;
+    mutable bool m_done = false;
     mutable std::mutex m_mutex;
+    mutable std::condition_variable m_cv;
+    mutable std::thread m_refresher;
 };
 
 class S3::Config
@@ -144,17 +634,111 @@ public:
 
     const std::string& region() const { return m_region; }
     const std::string& baseUrl() const { return m_baseUrl; }
+
+    /** The base URL for @p bucket in @p region.  This is the configured
+     * endpoint if there is one, the zonal host of a directory bucket, and
+     * otherwise the Transfer Acceleration or dual-stack host if either is
+     * enabled for the bucket, by its entry in `buckets` or else for the
+     * whole profile.
+     */
+    std::string baseUrl(
+            const std::string& bucket,
+            const std::string& region) const;
+
     const http::Headers& baseHeaders() const { return m_baseHeaders; }
-    bool precheck() const { return m_precheck; }
+
+    /** The base headers without the server-side encryption header, which
+     * is only sent with uploads.  Built once, for the requests which
+     * upload nothing.
+     */
+    const http::Headers& readHeaders() const { return m_readHeaders; }
+
+    /** If true, upload bodies are signed as `UNSIGNED-PAYLOAD` rather than
+     * hashed, which saves a pass over the data but leaves its integrity to
+     * the transport, so this should only be used over TLS.
+     */
+    bool unsignedPayload() const { return m_unsignedPayload; }
+
+    /** If true, from `partGets`, whole objects are read by part number.
+     * The first part is fetched without a HEAD, and its response gives the
+     * number of parts, which are then fetched in parallel, aligned to the
+     * parts in which the object was uploaded.  Objects uploaded whole are
+     * a single part, so they cost one GET.
+     */
+    bool partGets() const { return m_partGets; }
+
+    /** If true, from a `checksum` of `crc32c`, uploads carry their CRC32C,
+     * which S3 verifies.  With unsignedPayload() this gives end-to-end
+     * integrity for the cost of a CRC32C pass rather than a SHA-256 one.
+     */
+    bool crc32c() const { return m_crc32c; }
+
+    /** Uploads larger than this many bytes use the multipart API, split into
+     * parts of partSize() bytes.  Zero disables multipart uploads.
+     */
+    std::size_t multipartThreshold() const { return m_multipartThreshold; }
+    std::size_t partSize() const { return m_partSize; }
+
+    /** Copies larger than multipartThreshold() are split into parts of this
+     * many bytes, which are copied in parallel on the server.
+     */
+    std::size_t copyPartSize() const { return m_copyPartSize; }
+
+    /** The location of the S3 Inventory of @p bucket, without its protocol,
+     * or null if globs within it are listed.
+     */
+    const std::string* inventory(const std::string& bucket) const;
+
+    /** The URL of the SQS queue of event notifications, or empty if there
+     * is none, and its region and the seconds for which receives wait.
+     */
+    const std::string& queue() const { return m_queue; }
+    const std::string& queueRegion() const { return m_queueRegion; }
+    int queueWait() const { return m_queueWait; }
 
 private:
+    // Which of the alternative S3 hosts to address.
+    struct HostStyle
+    {
+        bool accelerate = false;
+        bool dualstack = false;
+    };
+
     static std::string extractRegion(std::string j, std::string profile);
-    static std::string extractBaseUrl(std::string j, std::string region);
+    static std::string extractDnsSuffix(std::string j);
+    static HostStyle extractHostStyle(std::string j, HostStyle base);
+    static std::string extractBaseUrl(
+            std::string j,
+            std::string region,
+            HostStyle style);
 
+    const std::string m_json;
     const std::string m_region;
+    const HostStyle m_hostStyle;
     const std::string m_baseUrl;
+    const std::string m_dnsSuffix;
+    bool m_endpoint = false;
+
+    // Buckets configured with their own host styles, and their base URLs in
+    // our region.
+    std::map<std::string, HostStyle> m_bucketStyles;
+    std::map<std::string, std::string> m_bucketUrls;
+
+    // Inventory locations, by the bucket they list.
+    std::map<std::string, std::string> m_inventories;
+
+    std::string m_queue;
+    std::string m_queueRegion;
+    int m_queueWait = 20;
+
     http::Headers m_baseHeaders;
-    bool m_precheck;
+    http::Headers m_readHeaders;
+    bool m_unsignedPayload = false;
+    bool m_partGets = false;
+    bool m_crc32c = false;
+    std::size_t m_multipartThreshold = 64 * 1024 * 1024;
+    std::size_t m_partSize = 16 * 1024 * 1024;
+    std::size_t m_copyPartSize = 256 * 1024 * 1024;
 };
 
 
@@ -162,33 +746,121 @@ private:
 class S3::Resource
 {
 public:
-    Resource(std::string baseUrl, std::string fullPath);
+    Resource(
+            std::string baseUrl,
+            const std::string& fullPath,
+            std::string region);
+
+    /** The endpoint of another service, like SQS, at the root of the host
+     * of @p url, signed for @p service in @p region.
+     */
+    static Resource forService(
+            const std::string& url,
+            std::string region,
+            std::string service);
+
+    /** The resource at the object path @p path within this one, which is
+     * that of a bucket alone.  As constructing it from the full path, but
+     * encoding only @p path.
+     */
+    Resource child(const std::string& path) const;
 
-    std::string url() const;
-    std::string host() const;
-    std::string baseUrl() const;
+    const std::string& url() const { return m_url; }
+    const std::string& host() const { return m_host; }
+    const std::string& baseUrl() const { return m_baseUrl; }
     std::string bucket() const;
-    std::string object() const;
+    const std::string& object() const { return m_path; }
+
+    /** The region for which requests for this resource are signed. */
+    const std::string& region() const { return m_region; }
+
+    /** True if the bucket is an S3 Express One Zone directory bucket. */
+    bool express() const { return m_express; }
+
+    /** The service name for which requests are signed. */
+    std::string service() const
+    {
+        if (m_service.size()) return m_service;
+        return m_express ? "s3express" : "s3";
+    }
 
 private:
+    Resource() : m_virtualHosted(false), m_express(false) { }
+
     std::string m_baseUrl;
+    std::string m_region;
     std::string m_bucket;
     std::string m_object;
     bool m_virtualHosted;
+    bool m_express;
+    std::string m_service;
+
+    // The path is sanitized once, and the forms derived from it are built
+    // up front since each is used several times per request.
+    std::string m_path;
+    std::string m_url;
+    std::string m_host;
+};
+
+// Derived SigV4 signing keys depend only on the credentials, date, region,
+// and service, so they are cached rather than recomputed with four chained
+// HMACs for every request.
+class S3::SigningKeys
+{
+public:
+    // Returns the signing key for @p fields on @p date, formatted as
+    // Time::dateNoSeparators, in @p region, for @p service.
+    std::string get(
+            const AuthFields& fields,
+            const std::string& date,
+            const std::string& region,
+            const std::string& service);
+
+private:
+    // Keyed by secret key and scope, all for m_date.
+    std::string m_date;
+    std::map<std::pair<std::string, std::string>, std::string> m_keys;
+    std::mutex m_mutex;
 };
 
 class S3::ApiV4
 {
 public:
     ApiV4(
-            std::string verb,
+            const std::string& verb,
             const std::string& region,
             const Resource& resource,
             const S3::AuthFields authFields,
+            SigningKeys& signingKeys,
             const http::Query& query,
             const http::Headers& headers,
             const std::vector<char>& data);
 
+    // Sign with a precomputed @p payloadHash, which is the hex SHA-256 of
+    // the body or unsignedPayload.
+    ApiV4(
+            const std::string& verb,
+            const std::string& region,
+            const Resource& resource,
+            const S3::AuthFields authFields,
+            SigningKeys& signingKeys,
+            const http::Query& query,
+            const http::Headers& headers,
+            std::string payloadHash);
+
+    // Sign by the query string rather than by headers, for a presigned URL
+    // which is valid for @p expiry seconds.  Only the host is signed, and
+    // the payload is unsigned.
+    ApiV4(
+            const std::string& verb,
+            const std::string& region,
+            const Resource& resource,
+            const S3::AuthFields authFields,
+            SigningKeys& signingKeys,
+            int64_t expiry);
+
+    static const std::string unsignedPayload;
+
     const http::Headers& headers() const { return m_headers; }
     const http::Query& query() const { return m_query; }
 
@@ -200,9 +872,7 @@ public:
 private:
     std::string buildCanonicalRequest(
             std::string verb,
-            const Resource& resource,
-            const http::Query& query,
-            const std::vector<char>& data) const;
+            const Resource& resource) const;
 
     std::string buildStringToSign(
             const std::string& canonicalRequest) const;
@@ -216,7 +886,13 @@ private:
 
     const S3::AuthFields m_authFields;
     const std::string m_region;
-    const Time m_time;
+    const std::string m_service;
+    // The request time, as Time::iso8601NoSeparators and
+    // Time::dateNoSeparators respectively.
+    const std::string m_dateTime;
+    const std::string m_date;
+    const std::string m_signingKey;
+    const std::string m_payloadHash;
 
     http::Headers m_headers;
     http::Query m_query;
@@ -0,0 +1,453 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/shard.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/crc32c.hpp>
+#include <arbiter/util/executor.hpp>
+#include <arbiter/util/json.hpp>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+namespace
+{
+    const std::size_t defaultShardCount(16);
+    const std::size_t defaultShardThreads(8);
+
+    std::string withSlash(std::string s)
+    {
+        if (s.size() && s.back() != '/') s += '/';
+        return s;
+    }
+}
+
+Sharded::Sharded(
+        std::unique_ptr<Driver> driver,
+        std::vector<Prefix> prefixes,
+        const std::size_t threads)
+    : m_driver(std::move(driver))
+    , m_prefixes(std::move(prefixes))
+    , m_threads((std::max)(threads, std::size_t(1)))
+{
+    if (!m_driver) throw ArbiterError("Cannot shard an empty driver");
+
+    for (const Prefix& prefix : m_prefixes)
+    {
+        if (!prefix.count || prefix.roots.empty())
+        {
+            throw ArbiterError("Invalid sharding of " + prefix.path);
+        }
+    }
+}
+
+void Sharded::wrap(DriverMap& drivers, const std::string s)
+{
+    const DriverWrapper w(wrapper(s));
+    if (!w) return;
+
+    for (auto& p : drivers) p.second = w(std::move(p.second));
+}
+
+DriverWrapper Sharded::wrapper(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object()) return DriverWrapper();
+
+    const std::size_t threads(c.value("threads", defaultShardThreads));
+
+    // Prefixes by the type of their driver.
+    std::map<std::string, std::vector<Prefix>> prefixes;
+    for (const json& p : c.value("prefixes", json::array()))
+    {
+        const std::string path(p.at("path").get<std::string>());
+        const std::string type(Arbiter::getType(path));
+
+        Prefix prefix;
+        prefix.path = withSlash(Arbiter::stripType(path));
+        prefix.count = p.value("count", defaultShardCount);
+
+        for (const json& r : p.value("roots", json::array({ path })))
+        {
+            const std::string root(r.get<std::string>());
+            if (Arbiter::getType(root) != type)
+            {
+                throw ArbiterError(
+                        "Shard root " + root + " is not of type " + type);
+            }
+            prefix.roots.push_back(withSlash(Arbiter::stripType(root)));
+        }
+
+        prefixes[type].push_back(prefix);
+    }
+
+    return [threads, prefixes](std::unique_ptr<Driver> driver)
+    {
+        const auto it(prefixes.find(driver->type()));
+        if (it != prefixes.end())
+        {
+            driver.reset(new Sharded(std::move(driver), it->second, threads));
+        }
+        return driver;
+    };
+}
+
+std::future<std::vector<char>> Sharded::getBinaryAsync(
+        const std::string path) const
+{
+    return m_driver->getBinaryAsync(physical(path));
+}
+
+std::future<void> Sharded::putAsync(
+        const std::string path,
+        std::vector<char> data) const
+{
+    return m_driver->putAsync(physical(path), std::move(data));
+}
+
+void Sharded::getBinaryThen(
+        const std::string path,
+        const Completion<std::vector<char>> done,
+        Executor& executor) const
+{
+    m_driver->getBinaryThen(physical(path), done, executor);
+}
+
+void Sharded::putThen(
+        const std::string path,
+        std::vector<char> data,
+        const Completion<void> done,
+        Executor& executor) const
+{
+    m_driver->putThen(physical(path), std::move(data), done, executor);
+}
+
+void Sharded::tryGetSizeThen(
+        const std::string path,
+        const Completion<std::unique_ptr<std::size_t>> done,
+        Executor& executor) const
+{
+    m_driver->tryGetSizeThen(physical(path), done, executor);
+}
+
+std::unique_ptr<std::size_t> Sharded::tryGetSize(const std::string path) const
+{
+    return m_driver->tryGetSize(physical(path));
+}
+
+std::vector<std::unique_ptr<std::size_t>> Sharded::tryGetSizes(
+        const std::vector<std::string>& paths) const
+{
+    std::vector<std::string> physicals;
+    physicals.reserve(paths.size());
+    for (const std::string& path : paths) physicals.push_back(physical(path));
+    return m_driver->tryGetSizes(physicals);
+}
+
+bool Sharded::exists(const std::string path) const
+{
+    return m_driver->exists(physical(path));
+}
+
+std::unique_ptr<std::string> Sharded::tryGetVersion(
+        const std::string path) const
+{
+    return m_driver->tryGetVersion(physical(path));
+}
+
+ChangedData Sharded::tryGetChanged(
+        const std::string path,
+        const std::string& version) const
+{
+    return m_driver->tryGetChanged(physical(path), version);
+}
+
+void Sharded::put(
+        const std::string path,
+        const std::vector<char>& data) const
+{
+    m_driver->put(physical(path), data);
+}
+
+void Sharded::put(
+        const std::string path,
+        const char* const data,
+        const std::size_t size) const
+{
+    m_driver->put(physical(path), data, size);
+}
+
+void Sharded::put(const std::string path, std::vector<char>&& data) const
+{
+    m_driver->put(physical(path), std::move(data));
+}
+
+void Sharded::putParts(
+        const std::string path,
+        const char* const data,
+        const std::size_t size,
+        const std::size_t partSize) const
+{
+    m_driver->putParts(physical(path), data, size, partSize);
+}
+
+void Sharded::putFrom(
+        const std::string path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size) const
+{
+    m_driver->putFrom(physical(path), source, size);
+}
+
+std::unique_ptr<Writer> Sharded::putStream(const std::string path) const
+{
+    return m_driver->putStream(physical(path));
+}
+
+void Sharded::copy(const std::string src, const std::string dst) const
+{
+    m_driver->copy(physical(src), physical(dst));
+}
+
+void Sharded::remove(const std::string path) const
+{
+    m_driver->remove(physical(path));
+}
+
+std::vector<std::exception_ptr> Sharded::removeMany(
+        const std::vector<std::string>& paths,
+        const std::size_t threads) const
+{
+    std::vector<std::string> physicals;
+    physicals.reserve(paths.size());
+    for (const std::string& path : paths) physicals.push_back(physical(path));
+    return m_driver->removeMany(physicals, threads);
+}
+
+void Sharded::getStream(
+        const std::string path,
+        const std::function<void(const char*, std::size_t)>& sink) const
+{
+    m_driver->getStream(physical(path), sink);
+}
+
+std::size_t Sharded::getInto(
+        const std::string path,
+        char* const data,
+        const std::size_t size) const
+{
+    return m_driver->getInto(physical(path), data, size);
+}
+
+std::vector<char> Sharded::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    return m_driver->getRange(physical(path), offset, length);
+}
+
+std::vector<std::vector<char>> Sharded::getRanges(
+        const std::string path,
+        const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+        const std::size_t gap,
+        Executor& executor) const
+{
+    return m_driver->getRanges(physical(path), ranges, gap, executor);
+}
+
+void Sharded::getFile(
+        const std::string path,
+        const std::string localPath) const
+{
+    m_driver->getFile(physical(path), localPath);
+}
+
+std::string Sharded::physical(const std::string& path) const
+{
+    const Prefix* prefix(prefixOf(path));
+    if (!prefix) return path;
+
+    const std::string rest(path.substr(prefix->path.size()));
+    return shardRoot(*prefix, crypto::crc32c(rest) % prefix->count) + rest;
+}
+
+bool Sharded::get(const std::string path, std::vector<char>& data) const
+{
+    auto fetched(m_driver->tryGetBinary(physical(path)));
+    if (!fetched) return false;
+
+    data = std::move(*fetched);
+    return true;
+}
+
+std::vector<std::string> Sharded::glob(
+        const std::string path,
+        const bool verbose) const
+{
+    std::vector<std::string> results;
+    globInfo(path, [&results](FileInfo info)
+    {
+        results.push_back(std::move(info.path));
+    }, verbose);
+    return results;
+}
+
+void Sharded::glob(
+        const std::string path,
+        const std::function<void(std::string)>& f,
+        const bool verbose) const
+{
+    globInfo(path, [&f](FileInfo info) { f(std::move(info.path)); }, verbose);
+}
+
+void Sharded::globInfo(
+        const std::string path,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const Prefix* prefix(prefixOf(path.substr(0, path.find('*'))));
+    if (!prefix)
+    {
+        m_driver->resolveInfo(path, f, verbose);
+        return;
+    }
+
+    const std::string rest(path.substr(prefix->path.size()));
+    each(*prefix, [&](
+                const std::string& root,
+                const std::function<void(FileInfo)>& found)
+    {
+        m_driver->resolveInfo(root + rest, found, verbose);
+    }, f);
+}
+
+void Sharded::globInfoAfter(
+        const std::string path,
+        const std::string& after,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const Prefix* prefix(prefixOf(path.substr(0, path.find('*'))));
+    if (!prefix)
+    {
+        m_driver->resolveInfoAfter(path, after, f, verbose);
+        return;
+    }
+
+    // Each shard holds its files in the order of their logical paths.
+    const std::string& base(prefix->path);
+    if (after.compare(0, base.size(), base) != 0 && after > base) return;
+
+    const std::string rest(path.substr(base.size()));
+    const std::string afterRest(
+            after.size() > base.size() ? after.substr(base.size()) : "");
+
+    each(*prefix, [&](
+                const std::string& root,
+                const std::function<void(FileInfo)>& found)
+    {
+        if (afterRest.size())
+        {
+            m_driver->resolveInfoAfter(
+                    root + rest,
+                    root + afterRest,
+                    found,
+                    verbose);
+        }
+        else m_driver->resolveInfo(root + rest, found, verbose);
+    }, f);
+}
+
+void Sharded::globPattern(
+        const Glob& glob,
+        const std::function<void(FileInfo)>& f,
+        const bool verbose) const
+{
+    const Prefix* prefix(prefixOf(glob.prefix()));
+    if (!prefix)
+    {
+        m_driver->resolveInfo(glob.pattern(), f, verbose);
+        return;
+    }
+
+    const std::string rest(glob.pattern().substr(prefix->path.size()));
+    each(*prefix, [&](
+                const std::string& root,
+                const std::function<void(FileInfo)>& found)
+    {
+        m_driver->resolveInfo(root + rest, found, verbose);
+    }, f);
+}
+
+const Sharded::Prefix* Sharded::prefixOf(const std::string& path) const
+{
+    const Prefix* found(nullptr);
+    for (const Prefix& prefix : m_prefixes)
+    {
+        if (path.compare(0, prefix.path.size(), prefix.path) == 0 &&
+                (!found || prefix.path.size() > found->path.size()))
+        {
+            found = &prefix;
+        }
+    }
+    return found;
+}
+
+std::string Sharded::shardRoot(const Prefix& prefix, const std::size_t i) const
+{
+    // Names are fixed-width hex, so that shards list in order.
+    int width(1);
+    for (std::size_t n(prefix.count - 1); n >= 16; n /= 16) ++width;
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%0*zx", width, i);
+    return prefix.roots[i % prefix.roots.size()] + name + "/";
+}
+
+void Sharded::each(
+        const Prefix& prefix,
+        const std::function<void(
+            const std::string& root,
+            const std::function<void(FileInfo)>& found)>& list,
+        const std::function<void(FileInfo)>& f) const
+{
+    const std::string type(isRemote() ? m_driver->type() + "://" : "");
+    std::mutex mutex;
+
+    parallelFor(prefix.count, m_threads, [&](const std::size_t i)
+    {
+        const std::string root(shardRoot(prefix, i));
+        list(root, [&](FileInfo info)
+        {
+            // Anything listed beside the shard's files isn't one of them.
+            const std::size_t skip(type.size() + root.size());
+            if (info.path.compare(type.size(), root.size(), root) != 0) return;
+
+            info.path = type + prefix.path + info.path.substr(skip);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            f(std::move(info));
+        });
+    });
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+/** @brief Spreads the files under prefixes of another driver across hashed
+ * shard prefixes, so that request rates which are limited per prefix, like
+ * those of S3, scale with the number of shards.
+ *
+ * A file at a logical path within a sharded prefix is stored at the
+ * physical path made of the root of its shard, the shard's name, and the
+ * remainder of the logical path.  Its shard is chosen by a hash of that
+ * remainder, and shards are assigned to roots in turn, which are by
+ * default the prefix itself but may be within other buckets.  For
+ * example, with 16 shards, `s3://bucket/tiles/a/b.laz` might be stored at
+ * `s3://bucket/tiles/7/a/b.laz`.
+ *
+ * Reads and writes of logical paths are made at their physical paths.
+ * Globs within a sharded prefix list every shard concurrently and report
+ * logical paths, in no particular order.  Globs of which a sharded prefix
+ * is only a part, and the driver-specific operations reached through
+ * Arbiter::getHttpDriver, see the physical layout.
+ *
+ * See Sharded::wrapper for configuration.
+ */
+class ARBITER_DLL Sharded : public Driver
+{
+public:
+    /** @brief A sharded prefix. */
+    struct Prefix
+    {
+        /** The logical prefix, stripped of its type, like `bucket/dir/`. */
+        std::string path;
+
+        /** The number of shards. */
+        std::size_t count = 1;
+
+        /** The physical roots, stripped of their types, among which the
+         * shards are spread in turn.
+         */
+        std::vector<std::string> roots;
+    };
+
+    /** Shard @p prefixes of @p driver, listing up to @p threads shards at
+     * once.
+     */
+    Sharded(
+            std::unique_ptr<Driver> driver,
+            std::vector<Prefix> prefixes,
+            std::size_t threads);
+
+    /** Replace drivers within @p drivers by sharding drivers according to
+     * the stringified JSON @p j, which is the `shards` entry of the Arbiter
+     * configuration.  If @p j is not an object, nothing is sharded.  Its
+     * keys are:
+     *
+     * - `prefixes`: an array of objects, each with a logical `path` with
+     *   its type, like `s3://bucket/tiles/`, a `count` of shards, by
+     *   default 16, and optionally an array of physical `roots` of the same
+     *   type, like `s3://bucket-a/tiles/`, by default the `path` itself.
+     *   Only drivers with sharded prefixes are wrapped.
+     * - `threads`: the most shards listed at once by a glob, by default 8.
+     *
+     * Changing the count or roots of a prefix moves its files, which are
+     * not found again until they are rewritten.
+     */
+    static void wrap(DriverMap& drivers, std::string j);
+
+    /** As Sharded::wrap, but returns a function with which drivers may be
+     * wrapped one at a time.  Returns null if @p j is not an object.
+     */
+    static DriverWrapper wrapper(std::string j);
+
+    virtual const Driver* wrapped() const override { return m_driver.get(); }
+
+    virtual std::string type() const override { return m_driver->type(); }
+    virtual bool isRemote() const override { return m_driver->isRemote(); }
+    virtual bool isAsync() const override { return m_driver->isAsync(); }
+
+    virtual std::future<std::vector<char>> getBinaryAsync(
+            std::string path) const override;
+
+    virtual std::future<void> putAsync(
+            std::string path,
+            std::vector<char> data) const override;
+
+    virtual void getBinaryThen(
+            std::string path,
+            Completion<std::vector<char>> done,
+            Executor& executor) const override;
+
+    virtual void putThen(
+            std::string path,
+            std::vector<char> data,
+            Completion<void> done,
+            Executor& executor) const override;
+
+    virtual void tryGetSizeThen(
+            std::string path,
+            Completion<std::unique_ptr<std::size_t>> done,
+            Executor& executor) const override;
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual std::vector<std::unique_ptr<std::size_t>> tryGetSizes(
+            const std::vector<std::string>& paths) const override;
+
+    virtual bool exists(std::string path) const override;
+
+    virtual std::unique_ptr<std::string> tryGetVersion(
+            std::string path) const override;
+
+    virtual ChangedData tryGetChanged(
+            std::string path,
+            const std::string& version) const override;
+
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual void put(
+            std::string path,
+            const char* data,
+            std::size_t size) const override;
+
+    virtual void put(
+            std::string path,
+            std::vector<char>&& data) const override;
+
+    virtual void putParts(
+            std::string path,
+            const char* data,
+            std::size_t size,
+            std::size_t partSize) const override;
+
+    virtual void putFrom(
+            std::string path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size) const override;
+
+    virtual std::unique_ptr<Writer> putStream(
+            std::string path) const override;
+
+    virtual void copy(std::string src, std::string dst) const override;
+
+    virtual void remove(std::string path) const override;
+
+    virtual std::vector<std::exception_ptr> removeMany(
+            const std::vector<std::string>& paths,
+            std::size_t threads) const override;
+
+    virtual void getStream(
+            std::string path,
+            const std::function<void(const char*, std::size_t)>& sink)
+        const override;
+
+    virtual std::size_t getInto(
+            std::string path,
+            char* data,
+            std::size_t size) const override;
+
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    virtual std::vector<std::vector<char>> getRanges(
+            std::string path,
+            const std::vector<std::pair<std::size_t, std::size_t>>& ranges,
+            std::size_t gap,
+            Executor& executor) const override;
+
+    virtual void getFile(
+            std::string path,
+            std::string localPath) const override;
+
+    /** The physical path, stripped of its type, at which the logical
+     * @p path is stored.  Paths outside of sharded prefixes are unchanged.
+     */
+    std::string physical(const std::string& path) const;
+
+protected:
+    virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override;
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    virtual void globInfoAfter(
+            std::string path,
+            const std::string& after,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+    virtual void globPattern(
+            const Glob& glob,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override;
+
+private:
+    // The sharded prefix containing @p path, if any.
+    const Prefix* prefixOf(const std::string& path) const;
+
+    // The physical prefix of shard @p i of @p prefix, ending with a slash.
+    std::string shardRoot(const Prefix& prefix, std::size_t i) const;
+
+    // Call @p list with the physical prefix of each shard of @p prefix,
+    // concurrently, and pass what it lists to @p f with logical paths.
+    void each(
+            const Prefix& prefix,
+            const std::function<void(
+                const std::string& root,
+                const std::function<void(FileInfo)>& found)>& list,
+            const std::function<void(FileInfo)>& f) const;
+
+    Sharded(const Sharded&);
+    Sharded& operator=(const Sharded&);
+
+    std::unique_ptr<Driver> m_driver;
+    const std::vector<Prefix> m_prefixes;
+    const std::size_t m_threads;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
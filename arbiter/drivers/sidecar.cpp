@@ -0,0 +1,124 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/drivers/sidecar.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/http.hpp>
+#include <arbiter/util/util.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace drivers
+{
+
+namespace
+{
+    // Requests reach the daemon by its socket, so their host is only a
+    // placeholder.
+    const std::string sidecarRoot("http://sidecar/");
+}
+
+Sidecar::Sidecar(http::Pool& pool, const std::string type)
+    : m_type(type)
+    , m_http(pool)
+{ }
+
+std::unique_ptr<Sidecar> Sidecar::create(
+        http::Pool& pool,
+        const std::string type)
+{
+    return makeUnique<Sidecar>(pool, type);
+}
+
+Capabilities Sidecar::capabilities() const
+{
+    Capabilities c;
+    c.rangedReads = true;
+    return c;
+}
+
+std::string Sidecar::url(const std::string& path) const
+{
+    return sidecarRoot + m_type + "/" + http::sanitize(path);
+}
+
+bool Sidecar::get(const std::string path, std::vector<char>& data) const
+{
+    std::unique_ptr<std::vector<char>> result(
+            m_http.tryGetBinary(url(path), http::Headers(), http::Query()));
+    if (!result) return false;
+    data = std::move(*result);
+    return true;
+}
+
+void Sidecar::put(const std::string path, const std::vector<char>& data) const
+{
+    m_http.put(url(path), data);
+}
+
+void Sidecar::put(
+        const std::string path,
+        const char* const data,
+        const std::size_t size) const
+{
+    m_http.put(url(path), data, size);
+}
+
+std::unique_ptr<std::size_t> Sidecar::tryGetSize(const std::string path) const
+{
+    return m_http.tryGetSize(url(path));
+}
+
+std::vector<char> Sidecar::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    return m_http.getRange(url(path), offset, length);
+}
+
+void Sidecar::remove(const std::string path) const
+{
+    m_http.remove(url(path));
+}
+
+std::vector<std::string> Sidecar::glob(
+        const std::string path,
+        bool) const
+{
+    const http::Response res(
+            m_http.internalGet(url(path), http::Headers(), { { "list", "" } }));
+
+    if (!res.ok())
+    {
+        throw ArbiterError(
+                "Could not list " + m_type + "://" + path + ": " + res.str());
+    }
+
+    // The daemon lists one path per line.
+    std::vector<std::string> results;
+    const std::string body(res.str());
+    std::size_t begin(0);
+    while (begin < body.size())
+    {
+        std::size_t end(body.find('\n', begin));
+        if (end == std::string::npos) end = body.size();
+        if (end > begin) results.push_back(body.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return results;
+}
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
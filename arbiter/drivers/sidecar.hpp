@@ -0,0 +1,98 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/driver.hpp>
+#include <arbiter/drivers/http.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace http { class Pool; }
+
+namespace drivers
+{
+
+/** @brief Reaches the drivers of a type through a SidecarServer.
+ *
+ * Many processes on a host may share one daemon which owns the HTTP
+ * connections, caches, and coalesced reads of an Arbiter, rather than each
+ * holding their own.  An Arbiter whose configuration has a `sidecar` entry,
+ * like `{ "socket": "/run/arbiter.sock", "types": ["s3", "gs"] }`, reaches
+ * paths of the named types through this driver, whose requests go to the
+ * daemon over its Unix domain socket.
+ *
+ * Reads, ranged reads, sizes, writes, removals, and globs are forwarded,
+ * and the rest are built upon them as for any driver.
+ */
+class ARBITER_DLL Sidecar : public Driver
+{
+public:
+    /** Forward paths of @p type through @p pool, which connects to the
+     * daemon's socket.
+     */
+    Sidecar(http::Pool& pool, std::string type);
+
+    static std::unique_ptr<Sidecar> create(
+            http::Pool& pool,
+            std::string type);
+
+    virtual std::string type() const override { return m_type; }
+
+    virtual Capabilities capabilities() const override;
+
+    using Driver::get;
+    using Driver::put;
+
+    virtual void put(
+            std::string path,
+            const std::vector<char>& data) const override;
+
+    virtual void put(
+            std::string path,
+            const char* data,
+            std::size_t size) const override;
+
+    virtual std::unique_ptr<std::size_t> tryGetSize(
+            std::string path) const override;
+
+    virtual std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    virtual void remove(std::string path) const override;
+
+    virtual std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override;
+
+private:
+    virtual bool get(
+            std::string path,
+            std::vector<char>& data) const override;
+
+    // The URL by which the daemon serves @p path.
+    std::string url(const std::string& path) const;
+
+    const std::string m_type;
+    const Http m_http;
+};
+
+} // namespace drivers
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
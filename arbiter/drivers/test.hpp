@@ -42,6 +42,29 @@ private:
         for (auto& p : results) p = type() + "://" + p;
         return results;
     }
+
+    virtual void glob(
+            std::string path,
+            const std::function<void(std::string)>& f,
+            bool verbose) const override
+    {
+        Fs::glob(path, [this, &f](std::string p)
+        {
+            f(type() + "://" + p);
+        }, verbose);
+    }
+
+    virtual void globInfo(
+            std::string path,
+            const std::function<void(FileInfo)>& f,
+            bool verbose) const override
+    {
+        Fs::globInfo(path, [this, &f](FileInfo info)
+        {
+            info.path = type() + "://" + info.path;
+            f(std::move(info));
+        }, verbose);
+    }
 };
 
 } // namespace drivers
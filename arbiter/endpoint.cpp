@@ -4,6 +4,8 @@
 #include <arbiter/arbiter.hpp>
 #include <arbiter/driver.hpp>
 #include <arbiter/drivers/fs.hpp>
+#include <arbiter/util/executor.hpp>
+#include <arbiter/util/prefetch.hpp>
 #include <arbiter/util/sha256.hpp>
 #include <arbiter/util/transforms.hpp>
 #include <arbiter/util/util.hpp>
@@ -25,11 +27,40 @@ namespace
         if (path.back() != '/') path.push_back('/');
         return path;
     }
+
+    // Take the contents of @p data, which is only copied if other callers
+    // share it.
+    std::vector<char> takeData(std::shared_ptr<std::vector<char>>& data)
+    {
+        if (data.use_count() == 1) return std::move(*data);
+        return *data;
+    }
+
+    // The concatenation of @p a and @p b, allocated once.
+    std::string concatPath(const std::string& a, const std::string& b)
+    {
+        std::string s;
+        s.reserve(a.size() + b.size());
+        s.append(a);
+        s.append(b);
+        return s;
+    }
 }
 
-Endpoint::Endpoint(const Driver& driver, const std::string root)
+Endpoint::Endpoint(
+        const Driver& driver,
+        const std::string root,
+        Executor* executor,
+        std::shared_ptr<Tracer> tracer,
+        Prefetcher* prefetcher)
     : m_driver(driver)
     , m_root(expandTilde(postfixSlash(root)))
+    , m_prefixedRoot(
+            (driver.isRemote() ? driver.type() + "://" : "") + m_root)
+    , m_typedRoot(driver.type() + "://" + m_root)
+    , m_executor(executor)
+    , m_tracer(std::move(tracer))
+    , m_prefetcher(prefetcher)
 { }
 
 std::string Endpoint::root() const
@@ -39,7 +70,7 @@ std::string Endpoint::root() const
 
 std::string Endpoint::prefixedRoot() const
 {
-    return softPrefix() + root();
+    return m_prefixedRoot;
 }
 
 std::string Endpoint::type() const
@@ -63,7 +94,7 @@ bool Endpoint::isHttpDerived() const
 }
 
 std::unique_ptr<LocalHandle> Endpoint::getLocalHandle(
-        const std::string subpath) const
+        const std::string& subpath) const
 {
     std::unique_ptr<LocalHandle> handle;
 
@@ -77,10 +108,12 @@ std::unique_ptr<LocalHandle> Endpoint::getLocalHandle(
 
         const std::string local(tmp + basename);
 
-        drivers::Fs fs;
-        fs.put(local, getBinary(subpath));
-
+        // The handle is created first so that a failed download is removed.
         handle.reset(new LocalHandle(local, true));
+
+        TraceSpan span(m_tracer.get(), m_driver, "getFile", fullPath(subpath));
+        m_driver.getFile(fullPath(subpath), handle->localPath());
+        span.done();
     }
     else
     {
@@ -90,159 +123,433 @@ std::unique_ptr<LocalHandle> Endpoint::getLocalHandle(
     return handle;
 }
 
-std::string Endpoint::get(const std::string subpath) const
+std::string Endpoint::get(const std::string& subpath) const
 {
-    return m_driver.get(fullPath(subpath));
+    TraceSpan span(m_tracer.get(), m_driver, "get", fullPath(subpath));
+    std::string data;
+    std::shared_ptr<std::vector<char>> prefetched;
+    if (takePrefetched(subpath, prefetched))
+    {
+        if (!prefetched)
+        {
+            throw ArbiterError("Could not read file " + fullPath(subpath));
+        }
+        data.assign(prefetched->begin(), prefetched->end());
+    }
+    else data = m_driver.get(fullPath(subpath));
+    span.done(data.size());
+    return data;
 }
 
-std::unique_ptr<std::string> Endpoint::tryGet(const std::string subpath)
+std::unique_ptr<std::string> Endpoint::tryGet(const std::string& subpath)
     const
 {
-    return m_driver.tryGet(fullPath(subpath));
+    TraceSpan span(m_tracer.get(), m_driver, "tryGet", fullPath(subpath));
+    std::unique_ptr<std::string> data;
+    std::shared_ptr<std::vector<char>> prefetched;
+    if (takePrefetched(subpath, prefetched))
+    {
+        if (prefetched)
+        {
+            data.reset(new std::string(prefetched->begin(), prefetched->end()));
+        }
+    }
+    else data = m_driver.tryGet(fullPath(subpath));
+    span.done(data ? data->size() : 0);
+    return data;
 }
 
-std::vector<char> Endpoint::getBinary(const std::string subpath) const
+std::vector<char> Endpoint::getBinary(const std::string& subpath) const
 {
-    return m_driver.getBinary(fullPath(subpath));
+    TraceSpan span(m_tracer.get(), m_driver, "getBinary", fullPath(subpath));
+    std::vector<char> data;
+    std::shared_ptr<std::vector<char>> prefetched;
+    if (takePrefetched(subpath, prefetched))
+    {
+        if (!prefetched)
+        {
+            throw ArbiterError("Could not read file " + fullPath(subpath));
+        }
+        data = takeData(prefetched);
+    }
+    else data = m_driver.getBinary(fullPath(subpath));
+    span.done(data.size());
+    return data;
 }
 
 std::unique_ptr<std::vector<char>> Endpoint::tryGetBinary(
-        const std::string subpath) const
+        const std::string& subpath) const
+{
+    TraceSpan span(
+            m_tracer.get(),
+            m_driver,
+            "tryGetBinary",
+            fullPath(subpath));
+    std::unique_ptr<std::vector<char>> data;
+    std::shared_ptr<std::vector<char>> prefetched;
+    if (takePrefetched(subpath, prefetched))
+    {
+        if (prefetched)
+        {
+            data.reset(new std::vector<char>(takeData(prefetched)));
+        }
+    }
+    else data = m_driver.tryGetBinary(fullPath(subpath));
+    span.done(data ? data->size() : 0);
+    return data;
+}
+
+Status Endpoint::tryRead(
+        const std::string& subpath,
+        std::vector<char>& data) const
 {
-    return m_driver.tryGetBinary(fullPath(subpath));
+    TraceSpan span(m_tracer.get(), m_driver, "tryRead", fullPath(subpath));
+    Status status;
+    std::shared_ptr<std::vector<char>> prefetched;
+    if (takePrefetched(subpath, prefetched))
+    {
+        if (prefetched) data = takeData(prefetched);
+        else status = Status(Status::Code::NotFound);
+    }
+    else status = m_driver.tryRead(fullPath(subpath), data);
+    span.done(status.ok() ? data.size() : 0);
+    return status;
 }
 
-std::size_t Endpoint::getSize(const std::string subpath) const
+void Endpoint::getStream(
+        const std::string& subpath,
+        const std::function<void(const char*, std::size_t)>& sink) const
 {
-    return m_driver.getSize(fullPath(subpath));
+    TraceSpan span(m_tracer.get(), m_driver, "getStream", fullPath(subpath));
+    if (!m_tracer)
+    {
+        m_driver.getStream(fullPath(subpath), sink);
+        return;
+    }
+
+    std::size_t bytes(0);
+    m_driver.getStream(
+            fullPath(subpath),
+            [&sink, &bytes](const char* data, std::size_t size)
+            {
+                sink(data, size);
+                bytes += size;
+            });
+    span.done(bytes);
+}
+
+std::size_t Endpoint::getInto(
+        const std::string& subpath,
+        char* const data,
+        const std::size_t size) const
+{
+    TraceSpan span(m_tracer.get(), m_driver, "getInto", fullPath(subpath));
+    const std::size_t read(m_driver.getInto(fullPath(subpath), data, size));
+    span.done(read);
+    return read;
+}
+
+std::vector<char> Endpoint::getRange(
+        const std::string& subpath,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    TraceSpan span(m_tracer.get(), m_driver, "getRange", fullPath(subpath));
+    span.range(offset, length);
+    std::vector<char> data(
+            m_driver.getRange(fullPath(subpath), offset, length));
+    span.done(data.size());
+    return data;
+}
+
+std::size_t Endpoint::getSize(const std::string& subpath) const
+{
+    TraceSpan span(m_tracer.get(), m_driver, "getSize", fullPath(subpath));
+    const std::size_t size(m_driver.getSize(fullPath(subpath)));
+    span.done();
+    return size;
 }
 
 std::unique_ptr<std::size_t> Endpoint::tryGetSize(
-        const std::string subpath) const
+        const std::string& subpath) const
 {
-    return m_driver.tryGetSize(fullPath(subpath));
+    TraceSpan span(m_tracer.get(), m_driver, "tryGetSize", fullPath(subpath));
+    std::unique_ptr<std::size_t> size(m_driver.tryGetSize(fullPath(subpath)));
+    span.done();
+    return size;
 }
 
-void Endpoint::put(const std::string subpath, const std::string& data) const
+Status Endpoint::tryReadSize(
+        const std::string& subpath,
+        std::size_t& size) const
 {
+    TraceSpan span(m_tracer.get(), m_driver, "tryReadSize", fullPath(subpath));
+    const Status status(m_driver.tryReadSize(fullPath(subpath), size));
+    span.done();
+    return status;
+}
+
+void Endpoint::put(const std::string& subpath, const std::string& data) const
+{
+    TraceSpan span(
+            m_tracer.get(),
+            m_driver,
+            "put",
+            fullPath(subpath),
+            data.size());
+    if (m_prefetcher) m_prefetcher->erase(prefetchKey(subpath));
     m_driver.put(fullPath(subpath), data);
+    span.done();
 }
 
 void Endpoint::put(
-        const std::string subpath,
+        const std::string& subpath,
         const std::vector<char>& data) const
 {
+    TraceSpan span(
+            m_tracer.get(),
+            m_driver,
+            "put",
+            fullPath(subpath),
+            data.size());
+    if (m_prefetcher) m_prefetcher->erase(prefetchKey(subpath));
     m_driver.put(fullPath(subpath), data);
+    span.done();
+}
+
+void Endpoint::put(
+        const std::string& subpath,
+        std::vector<char>&& data) const
+{
+    TraceSpan span(
+            m_tracer.get(),
+            m_driver,
+            "put",
+            fullPath(subpath),
+            data.size());
+    if (m_prefetcher) m_prefetcher->erase(prefetchKey(subpath));
+    m_driver.put(fullPath(subpath), std::move(data));
+    span.done();
+}
+
+void Endpoint::prefetch(const std::vector<std::string>& subpaths) const
+{
+    if (!m_prefetcher)
+    {
+        throw ArbiterError("No prefetcher available for this endpoint");
+    }
+
+    std::vector<std::string> keys;
+    keys.reserve(subpaths.size());
+    for (const std::string& subpath : subpaths)
+    {
+        keys.push_back(prefetchKey(subpath));
+    }
+
+    m_prefetcher->prefetch(keys);
+}
+
+std::future<std::string> Endpoint::getAsync(const std::string& subpath) const
+{
+    return executor().async([this, subpath]() { return get(subpath); });
+}
+
+std::future<std::vector<char>> Endpoint::getBinaryAsync(
+        const std::string& subpath) const
+{
+    if (!m_tracer && m_driver.isAsync())
+    {
+        return m_driver.getBinaryAsync(fullPath(subpath));
+    }
+
+    return executor().async([this, subpath]() { return getBinary(subpath); });
+}
+
+std::future<std::size_t> Endpoint::getSizeAsync(
+        const std::string& subpath) const
+{
+    return executor().async([this, subpath]() { return getSize(subpath); });
+}
+
+std::future<void> Endpoint::putAsync(
+        const std::string& subpath,
+        const std::string data) const
+{
+    return putAsync(subpath, std::vector<char>(data.begin(), data.end()));
+}
+
+std::future<void> Endpoint::putAsync(
+        const std::string& subpath,
+        std::vector<char> data) const
+{
+    if (!m_tracer && m_driver.isAsync())
+    {
+        return m_driver.putAsync(fullPath(subpath), std::move(data));
+    }
+
+    auto shared(std::make_shared<std::vector<char>>(std::move(data)));
+    return executor().async([this, subpath, shared]()
+    {
+        put(subpath, std::move(*shared));
+    });
 }
 
 std::string Endpoint::get(
-        const std::string subpath,
-        const http::Headers headers,
-        const http::Query query) const
+        const std::string& subpath,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
     return getHttpDriver().get(fullPath(subpath), headers, query);
 }
 
 std::unique_ptr<std::string> Endpoint::tryGet(
-        const std::string subpath,
-        const http::Headers headers,
-        const http::Query query) const
+        const std::string& subpath,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
     return getHttpDriver().tryGet(fullPath(subpath), headers, query);
 }
 
 std::vector<char> Endpoint::getBinary(
-        const std::string subpath,
-        const http::Headers headers,
-        const http::Query query) const
+        const std::string& subpath,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
     return getHttpDriver().getBinary(fullPath(subpath), headers, query);
 }
 
 std::unique_ptr<std::vector<char>> Endpoint::tryGetBinary(
-        const std::string subpath,
-        const http::Headers headers,
-        const http::Query query) const
+        const std::string& subpath,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
     return getHttpDriver().tryGetBinary(fullPath(subpath), headers, query);
 }
 
+void Endpoint::getStream(
+        const std::string& subpath,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const http::Headers& headers,
+        const http::Query& query) const
+{
+    getHttpDriver().getStream(fullPath(subpath), sink, headers, query);
+}
+
+std::size_t Endpoint::getInto(
+        const std::string& subpath,
+        char* const data,
+        const std::size_t size,
+        const http::Headers& headers,
+        const http::Query& query) const
+{
+    return getHttpDriver().getInto(
+            fullPath(subpath),
+            data,
+            size,
+            headers,
+            query);
+}
+
 void Endpoint::put(
-        const std::string path,
+        const std::string& path,
         const std::string& data,
-        const http::Headers headers,
-        const http::Query query) const
+        const http::Headers& headers,
+        const http::Query& query) const
 {
     getHttpDriver().put(path, data, headers, query);
 }
 
 void Endpoint::put(
-        const std::string path,
+        const std::string& path,
         const std::vector<char>& data,
-        const http::Headers headers,
-        const http::Query query) const
+        const http::Headers& headers,
+        const http::Query& query) const
 {
     getHttpDriver().put(path, data, headers, query);
 }
 
 http::Response Endpoint::httpGet(
-        std::string path,
-        http::Headers headers,
-        http::Query query,
+        const std::string& path,
+        const http::Headers& headers,
+        const http::Query& query,
         const std::size_t reserve) const
 {
     return getHttpDriver().internalGet(fullPath(path), headers, query, reserve);
 }
 
 http::Response Endpoint::httpPut(
-        std::string path,
+        const std::string& path,
         const std::vector<char>& data,
-        http::Headers headers,
-        http::Query query) const
+        const http::Headers& headers,
+        const http::Query& query) const
 {
     return getHttpDriver().internalPut(fullPath(path), data, headers, query);
 }
 
 http::Response Endpoint::httpHead(
-        std::string path,
-        http::Headers headers,
-        http::Query query) const
+        const std::string& path,
+        const http::Headers& headers,
+        const http::Query& query) const
 {
     return getHttpDriver().internalHead(fullPath(path), headers, query);
 }
 
 http::Response Endpoint::httpPost(
-        std::string path,
+        const std::string& path,
         const std::vector<char>& data,
-        http::Headers headers,
-        http::Query query) const
+        const http::Headers& headers,
+        const http::Query& query) const
 {
     return getHttpDriver().internalPost(fullPath(path), data, headers, query);
 }
 
 std::string Endpoint::fullPath(const std::string& subpath) const
 {
-    return m_root + subpath;
+    return concatPath(m_root, subpath);
 }
 
 std::string Endpoint::prefixedFullPath(const std::string& subpath) const
 {
-     return softPrefix() + fullPath(subpath);
+    return concatPath(m_prefixedRoot, subpath);
+}
+
+Endpoint Endpoint::getSubEndpoint(const std::string& subpath) const
+{
+    return Endpoint(
+            m_driver,
+            fullPath(subpath),
+            m_executor,
+            m_tracer,
+            m_prefetcher);
+}
+
+std::string Endpoint::prefetchKey(const std::string& subpath) const
+{
+    return concatPath(m_typedRoot, subpath);
 }
 
-Endpoint Endpoint::getSubEndpoint(std::string subpath) const
+bool Endpoint::takePrefetched(
+        const std::string& subpath,
+        std::shared_ptr<std::vector<char>>& data) const
 {
-    return Endpoint(m_driver, m_root + subpath);
+    return m_prefetcher && m_prefetcher->take(prefetchKey(subpath), data);
 }
 
-std::string Endpoint::softPrefix() const
+Executor& Endpoint::executor() const
 {
-    return isRemote() ? type() + "://" : "";
+    if (!m_executor)
+    {
+        throw ArbiterError("No executor available for asynchronous operation");
+    }
+
+    return *m_executor;
 }
 
 const drivers::Http* Endpoint::tryGetHttpDriver() const
 {
-    return dynamic_cast<const drivers::Http*>(&m_driver);
+    const Driver* driver(&m_driver);
+    while (const Driver* inner = driver->wrapped()) driver = inner;
+    return dynamic_cast<const drivers::Http*>(driver);
 }
 
 const drivers::Http& Endpoint::getHttpDriver() const
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+#include <future>
 #include <string>
 #include <vector>
 #include <memory>
@@ -8,6 +10,7 @@
 
 #include <arbiter/drivers/fs.hpp>
 #include <arbiter/util/exports.hpp>
+#include <arbiter/util/trace.hpp>
 #include <arbiter/util/types.hpp>
 
 #endif
@@ -24,6 +27,8 @@ namespace drivers { class Http; }
 namespace http { class Pool; }
 
 class Driver;
+class Executor;
+class Prefetcher;
 
 /** @brief A utility class to drive usage from a common root directory.
  *
@@ -67,83 +72,157 @@ public:
     bool isHttpDerived() const;
 
     /** See Arbiter::getLocalHandle. */
-    std::unique_ptr<LocalHandle> getLocalHandle(std::string subpath) const;
+    std::unique_ptr<LocalHandle> getLocalHandle(const std::string& subpath) const;
 
     /** Passthrough to Driver::get. */
-    std::string get(std::string subpath) const;
+    std::string get(const std::string& subpath) const;
 
     /** Passthrough to Driver::tryGet. */
-    std::unique_ptr<std::string> tryGet(std::string subpath) const;
+    std::unique_ptr<std::string> tryGet(const std::string& subpath) const;
 
     /** Passthrough to Driver::getBinary. */
-    std::vector<char> getBinary(std::string subpath) const;
+    std::vector<char> getBinary(const std::string& subpath) const;
 
     /** Passthrough to Driver::tryGetBinary. */
-    std::unique_ptr<std::vector<char>> tryGetBinary(std::string subpath) const;
+    std::unique_ptr<std::vector<char>> tryGetBinary(const std::string& subpath) const;
+
+    /** Passthrough to Driver::tryRead. */
+    Status tryRead(const std::string& subpath, std::vector<char>& data) const;
+
+    /** Passthrough to Driver::getStream. */
+    void getStream(
+            const std::string& subpath,
+            const std::function<void(const char*, std::size_t)>& sink) const;
+
+    /** Passthrough to Driver::getInto. */
+    std::size_t getInto(
+            const std::string& subpath,
+            char* data,
+            std::size_t size) const;
+
+    /** Passthrough to Driver::getRange. */
+    std::vector<char> getRange(
+            const std::string& subpath,
+            std::size_t offset,
+            std::size_t length) const;
 
     /** Passthrough to Driver::getSize. */
-    std::size_t getSize(std::string subpath) const;
+    std::size_t getSize(const std::string& subpath) const;
 
     /** Passthrough to Driver::tryGetSize. */
-    std::unique_ptr<std::size_t> tryGetSize(std::string subpath) const;
+    std::unique_ptr<std::size_t> tryGetSize(const std::string& subpath) const;
+
+    /** Passthrough to Driver::tryReadSize. */
+    Status tryReadSize(const std::string& subpath, std::size_t& size) const;
 
     /** Passthrough to Driver::put(std::string, const std::string&) const. */
-    void put(std::string subpath, const std::string& data) const;
+    void put(const std::string& subpath, const std::string& data) const;
 
     /** Passthrough to
      * Driver::put(std::string, const std::vector<char>&) const.
      */
-    void put(std::string subpath, const std::vector<char>& data) const;
+    void put(const std::string& subpath, const std::vector<char>& data) const;
+
+    /** Passthrough to
+     * Driver::put(std::string, std::vector<char>&&) const.
+     */
+    void put(const std::string& subpath, std::vector<char>&& data) const;
+
+    /** See Arbiter::prefetch.  Subsequent reads of these subpaths through
+     * this Endpoint, or of the corresponding paths through its Arbiter, are
+     * served from the prefetched data.
+     */
+    void prefetch(const std::vector<std::string>& subpaths) const;
+
+    // Asynchronous passthroughs, see Arbiter::getAsync.
+
+    /** Asynchronous Endpoint::get. */
+    std::future<std::string> getAsync(const std::string& subpath) const;
+
+    /** Asynchronous Endpoint::getBinary. */
+    std::future<std::vector<char>> getBinaryAsync(const std::string& subpath) const;
+
+    /** Asynchronous Endpoint::getSize. */
+    std::future<std::size_t> getSizeAsync(const std::string& subpath) const;
+
+    /** Asynchronous Endpoint::put. */
+    std::future<void> putAsync(const std::string& subpath, std::string data) const;
+
+    /** Asynchronous Endpoint::put. */
+    std::future<void> putAsync(
+            const std::string& subpath,
+            std::vector<char> data) const;
 
     // HTTP-specific passthroughs.
 
     /** Passthrough to
-     * drivers::Http::get(std::string, http::Headers, http::Query) const. */
+     * drivers::Http::get(const std::string&, const http::Headers&, const http::Query&) const.
+     */
     std::string get(
-            std::string subpath,
-            http::Headers headers,
-            http::Query = http::Query()) const;
+            const std::string& subpath,
+            const http::Headers& headers,
+            const http::Query& = http::Query()) const;
 
     /** Passthrough to
-     * drivers::Http::tryGet(std::string, http::Headers, http::Query) const. */
+     * drivers::Http::tryGet(const std::string&, const http::Headers&, const http::Query&) const.
+     */
     std::unique_ptr<std::string> tryGet(
-            std::string subpath,
-            http::Headers headers,
-            http::Query = http::Query()) const;
+            const std::string& subpath,
+            const http::Headers& headers,
+            const http::Query& = http::Query()) const;
 
     /** Passthrough to
-     * drivers::Http::getBinary(std::string, http::Headers, http::Query) const.
+     * drivers::Http::getBinary(const std::string&, const http::Headers&, const http::Query&) const.
      */
     std::vector<char> getBinary(
-            std::string path,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     /** Passthrough to
-     * drivers::Http::tryGetBinary(std::string, http::Headers, http::Query) const.
+     * drivers::Http::tryGetBinary(const std::string&, const http::Headers&, const http::Query&) const.
      */
     std::unique_ptr<std::vector<char>> tryGetBinary(
-            std::string path,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
+
+    /** Passthrough to
+     * drivers::Http::getStream(const std::string&, const std::function<void(const char*, std::size_t)>&, const http::Headers&, const http::Query&) const.
+     */
+    void getStream(
+            const std::string& path,
+            const std::function<void(const char*, std::size_t)>& sink,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     /** Passthrough to
-     * drivers::Http::put(std::string, const std::string&, http::Headers, http::Query) const.
+     * drivers::Http::getInto(const std::string&, char*, std::size_t, const http::Headers&, const http::Query&) const.
+     */
+    std::size_t getInto(
+            const std::string& path,
+            char* data,
+            std::size_t size,
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
+
+    /** Passthrough to
+     * drivers::Http::put(const std::string&, const std::string&, const http::Headers&, const http::Query&) const.
      */
     void put(
-            std::string path,
+            const std::string& path,
             const std::string& data,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     /** Passthrough to
-     * drivers::Http::put(std::string, const std::vector<char>&, http::Headers, http::Query) const.
+     * drivers::Http::put(const std::string&, const std::vector<char>&, const http::Headers&, const http::Query&) const.
      */
     void put(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers,
-            http::Query query = http::Query()) const;
+            const http::Headers& headers,
+            const http::Query& query = http::Query()) const;
 
     // Endpoint specifics.
 
@@ -158,43 +237,64 @@ public:
     std::string prefixedFullPath(const std::string& subpath) const;
 
     /** Get a further nested subpath relative to this Endpoint's root. */
-    Endpoint getSubEndpoint(std::string subpath) const;
+    Endpoint getSubEndpoint(const std::string& subpath) const;
 
     http::Response httpGet(
-            std::string path,
-            http::Headers headers = http::Headers(),
-            http::Query query = http::Query(),
+            const std::string& path,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query(),
             std::size_t reserve = 0) const;
 
     http::Response httpPut(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers = http::Headers(),
-            http::Query query = http::Query()) const;
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
 
     http::Response httpHead(
-            std::string path,
-            http::Headers headers = http::Headers(),
-            http::Query query = http::Query()) const;
+            const std::string& path,
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
 
     http::Response httpPost(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            http::Headers headers = http::Headers(),
-            http::Query query = http::Query()) const;
+            const http::Headers& headers = http::Headers(),
+            const http::Query& query = http::Query()) const;
 
 private:
-    Endpoint(const Driver& driver, std::string root);
+    Endpoint(
+            const Driver& driver,
+            std::string root,
+            Executor* executor = nullptr,
+            std::shared_ptr<Tracer> tracer = std::shared_ptr<Tracer>(),
+            Prefetcher* prefetcher = nullptr);
+
+    Executor& executor() const;
 
-    // If `isRemote()`, returns the type and delimiter, otherwise returns an
-    // empty string.
-    std::string softPrefix() const;
+    // The key of @p subpath for our Prefetcher, as used by Arbiter.
+    std::string prefetchKey(const std::string& subpath) const;
+
+    // If @p subpath has been prefetched, set @p data to it, which is null if
+    // it doesn't exist, and return true.
+    bool takePrefetched(
+            const std::string& subpath,
+            std::shared_ptr<std::vector<char>>& data) const;
 
     const drivers::Http* tryGetHttpDriver() const;
     const drivers::Http& getHttpDriver() const;
 
     const Driver& m_driver;
     std::string m_root;
+
+    // Our root prefixed as by prefixedRoot, and by our type and delimiter,
+    // to which subpaths are appended for prefixedFullPath and prefetchKey.
+    std::string m_prefixedRoot;
+    std::string m_typedRoot;
+
+    Executor* m_executor;
+    std::shared_ptr<Tracer> m_tracer;
+    Prefetcher* m_prefetcher;
 };
 
 } // namespace arbiter
@@ -0,0 +1,266 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/replay.hpp>
+
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    using ReplayClock = std::chrono::steady_clock;
+
+    enum class ReplayKind { None, Read, Range, Size, Write, Remove };
+
+    ReplayKind replayKind(const RecordedOp& op)
+    {
+        const std::string& o(op.operation);
+        if (o == "getRange" || o == "getRanges") return ReplayKind::Range;
+        if (o == "getSize" || o == "tryGetSize" || o == "tryReadSize")
+        {
+            return ReplayKind::Size;
+        }
+        if (o == "get" || o == "getBinary" || o == "tryGet" ||
+                o == "tryGetBinary" || o == "tryRead" || o == "getInto")
+        {
+            return ReplayKind::Read;
+        }
+        if (o == "put" || o == "putFrom") return ReplayKind::Write;
+        if (o == "remove") return ReplayKind::Remove;
+        return ReplayKind::None;
+    }
+
+    bool replayOrder(const RecordedOp& a, const RecordedOp& b)
+    {
+        return a.start < b.start;
+    }
+
+    double replaySeconds(const ReplayClock::duration d)
+    {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    double replayPercentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty()) return 0;
+        return sorted[std::min<std::size_t>(
+                sorted.size() - 1,
+                static_cast<std::size_t>(p * sorted.size()))];
+    }
+}
+
+Replayer::Replayer(
+        const Arbiter& arbiter,
+        const std::string root,
+        const std::string s)
+    : m_arbiter(arbiter)
+    , m_root(root)
+{
+    const json c(s.size() ? json::parse(s) : json::object());
+    if (!c.is_null())
+    {
+        m_speed = c.value("speed", m_speed);
+        m_threads = c.value("threads", m_threads);
+        m_prepare = c.value("prepare", m_prepare);
+    }
+
+    if (m_speed < 0) throw ArbiterError("Replay speed may not be negative");
+    if (m_root.size() && m_root.back() != '/') m_root += '/';
+}
+
+std::string Replayer::pathOf(const std::uint64_t path) const
+{
+    char name[17];
+    std::snprintf(
+            name,
+            sizeof(name),
+            "%016llx",
+            static_cast<unsigned long long>(path));
+    return m_root + name;
+}
+
+std::size_t Replayer::concurrency(const std::vector<RecordedOp>& ops)
+{
+    // Sweep the starts and ends in time order, with ends first at ties.
+    std::vector<std::pair<std::uint64_t, int>> edges;
+    edges.reserve(ops.size() * 2);
+    for (const RecordedOp& op : ops)
+    {
+        edges.emplace_back(op.start, 1);
+        edges.emplace_back(op.start + op.duration, -1);
+    }
+    std::sort(edges.begin(), edges.end());
+
+    int busy(0);
+    int peak(0);
+    for (const auto& edge : edges)
+    {
+        busy += edge.second;
+        peak = (std::max)(peak, busy);
+    }
+    return peak;
+}
+
+void Replayer::prepare(const std::vector<RecordedOp>& unordered) const
+{
+    std::vector<RecordedOp> ops(unordered);
+    std::stable_sort(ops.begin(), ops.end(), replayOrder);
+
+    std::set<std::uint64_t> written;
+    std::map<std::uint64_t, std::size_t> needed;
+
+    for (const RecordedOp& op : ops)
+    {
+        const ReplayKind kind(replayKind(op));
+        if (kind == ReplayKind::Write) written.insert(op.path);
+        else if (
+                (kind == ReplayKind::Read || kind == ReplayKind::Range) &&
+                !op.failed &&
+                op.bytes &&
+                !written.count(op.path))
+        {
+            std::size_t& size(needed[op.path]);
+            size = (std::max)(size, op.bytes);
+            if (kind == ReplayKind::Range)
+            {
+                size = (std::max)(size, op.offset + op.length);
+            }
+        }
+    }
+
+    for (const auto& entry : needed)
+    {
+        m_arbiter.put(
+                pathOf(entry.first),
+                std::vector<char>(entry.second, 0));
+    }
+}
+
+bool Replayer::issue(const RecordedOp& op) const
+{
+    const std::string path(pathOf(op.path));
+
+    switch (replayKind(op))
+    {
+        case ReplayKind::Read:
+            return !!m_arbiter.tryGetBinary(path);
+        case ReplayKind::Range:
+            return !m_arbiter.getRange(path, op.offset, op.length).empty();
+        case ReplayKind::Size:
+            return !!m_arbiter.tryGetSize(path);
+        case ReplayKind::Write:
+            m_arbiter.put(path, std::vector<char>(op.bytes, 0));
+            return true;
+        case ReplayKind::Remove:
+            m_arbiter.remove(path);
+            return true;
+        default:
+            return false;
+    }
+}
+
+ReplayResult Replayer::replay(std::vector<RecordedOp> ops) const
+{
+    ReplayResult result;
+
+    std::stable_sort(ops.begin(), ops.end(), replayOrder);
+    if (m_prepare) prepare(ops);
+
+    std::vector<RecordedOp> issued;
+    issued.reserve(ops.size());
+    for (RecordedOp& op : ops)
+    {
+        if (replayKind(op) == ReplayKind::None) ++result.skipped;
+        else issued.push_back(std::move(op));
+    }
+
+    result.ops = issued.size();
+    result.threads = m_threads ? m_threads : concurrency(issued);
+    result.threads = (std::max<std::size_t>)(result.threads, 1);
+    if (issued.empty()) return result;
+
+    const std::uint64_t first(issued.front().start);
+    std::vector<double> latencies(issued.size(), 0);
+    std::atomic<std::size_t> next(0);
+    std::atomic<std::size_t> failures(0);
+
+    std::mutex mutex;
+    ReplayClock::duration lag(0);
+
+    const ReplayClock::time_point begin(ReplayClock::now());
+
+    auto work([&]()
+    {
+        ReplayClock::duration worst(0);
+
+        std::size_t i;
+        while ((i = next++) < issued.size())
+        {
+            const RecordedOp& op(issued[i]);
+
+            if (m_speed > 0)
+            {
+                const ReplayClock::time_point due(
+                        begin +
+                        std::chrono::duration_cast<ReplayClock::duration>(
+                            std::chrono::duration<double, std::micro>(
+                                (op.start - first) / m_speed)));
+                std::this_thread::sleep_until(due);
+                worst = (std::max)(worst, ReplayClock::now() - due);
+            }
+
+            const ReplayClock::time_point start(ReplayClock::now());
+            bool ok(false);
+            try
+            {
+                ok = issue(op) || !op.bytes;
+            }
+            catch (...) { }
+
+            latencies[i] = replaySeconds(ReplayClock::now() - start);
+            if (!ok && !op.failed) ++failures;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        lag = (std::max)(lag, worst);
+    });
+
+    std::vector<std::thread> threads;
+    for (std::size_t t(0); t < result.threads; ++t) threads.emplace_back(work);
+    for (std::thread& t : threads) t.join();
+
+    result.seconds = replaySeconds(ReplayClock::now() - begin);
+    result.failures = failures;
+    result.lag = replaySeconds(lag);
+
+    std::sort(latencies.begin(), latencies.end());
+    result.p50 = replayPercentile(latencies, 0.5);
+    result.p90 = replayPercentile(latencies, 0.9);
+    result.p99 = replayPercentile(latencies, 0.99);
+    result.max = latencies.back();
+
+    return result;
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
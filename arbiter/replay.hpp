@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/exports.hpp>
+#include <arbiter/util/record.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief The outcome of a Replayer::replay. */
+struct ARBITER_DLL ReplayResult
+{
+    /** Operations issued, and those of them which threw or found nothing
+     * where the recording found something.
+     */
+    std::size_t ops = 0;
+    std::size_t failures = 0;
+
+    /** Recorded operations which have no replayable equivalent, like
+     * listings, and so were not issued.
+     */
+    std::size_t skipped = 0;
+
+    /** Threads which issued the operations. */
+    std::size_t threads = 0;
+
+    /** Time from the first operation to the end of the last. */
+    double seconds = 0;
+
+    /** Percentiles of the latency of the issued operations, in seconds. */
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+
+    /** The longest any operation started after its scheduled time, in
+     * seconds.  A large lag means that the replay couldn't keep up with
+     * the recording, so its latencies are those of a lighter load.
+     */
+    double lag = 0;
+};
+
+/** @brief Replays a workload recorded by a Recorder against an Arbiter.
+ *
+ * Since recordings hold hashes rather than paths, each recorded path is
+ * replayed as a file named by its hash beneath a root, which may be of any
+ * driver.  Operations are issued at their recorded times, scaled by a
+ * speed, by as many threads as were at once busy in the recording, so
+ * that the replay has its concurrency as well as its timing.
+ *
+ * Whole and ranged reads, sizes, writes, and removals are replayed.  Other
+ * operations are counted as skipped.
+ */
+class ARBITER_DLL Replayer
+{
+public:
+    /** Replay against @p arbiter, which must outlive us, beneath @p root.
+     * The stringified JSON @p j is an object with the optional keys:
+     *      - `speed`, the factor by which the recording is sped up, by
+     *        default 1.  If 0, operations are issued as fast as possible.
+     *      - `threads`, by default the peak concurrency of the recording
+     *      - `prepare`, by default true, to write the files which the
+     *        recording reads before it writes them, as by prepare
+     */
+    Replayer(const Arbiter& arbiter, std::string root, std::string j = "");
+
+    /** Replay @p ops, which needn't be in order. */
+    ReplayResult replay(std::vector<RecordedOp> ops) const;
+
+    /** Write, with zeroes, each file which @p ops read successfully before
+     * writing it, as large as the largest of those reads needs it to be.
+     */
+    void prepare(const std::vector<RecordedOp>& ops) const;
+
+    /** The path at which recorded operations on @p path are replayed. */
+    std::string pathOf(std::uint64_t path) const;
+
+    /** The greatest number of @p ops which overlap in time. */
+    static std::size_t concurrency(const std::vector<RecordedOp>& ops);
+
+private:
+    // Returns false if the operation found nothing.
+    bool issue(const RecordedOp& op) const;
+
+    const Arbiter& m_arbiter;
+    std::string m_root;
+    double m_speed = 1;
+    std::size_t m_threads = 0;
+    bool m_prepare = true;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
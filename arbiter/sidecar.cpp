@@ -0,0 +1,531 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/sidecar.hpp>
+
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+
+#ifndef ARBITER_WINDOWS
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+#ifndef ARBITER_WINDOWS
+
+namespace
+{
+#ifdef MSG_NOSIGNAL
+    const int sidecarSendFlags(MSG_NOSIGNAL);
+#else
+    const int sidecarSendFlags(0);
+#endif
+
+    // Requests are buffered whole, so those with larger headers or bodies
+    // are refused.  The largest body is that of the largest single upload
+    // to S3.
+    const std::size_t sidecarMaxHead(64 * 1024);
+    const std::uint64_t sidecarMaxBody(5ULL * 1024 * 1024 * 1024);
+
+    struct SidecarRequest
+    {
+        std::string method;
+        std::string path;
+        bool list = false;
+        std::map<std::string, std::string> headers;
+        std::vector<char> body;
+
+        std::string header(const std::string& name) const
+        {
+            const auto it(headers.find(name));
+            return it != headers.end() ? it->second : std::string();
+        }
+    };
+
+    std::string sidecarDecode(const std::string& s)
+    {
+        std::string out;
+        out.reserve(s.size());
+
+        for (std::size_t i(0); i < s.size(); ++i)
+        {
+            if (s[i] == '%' && i + 2 < s.size())
+            {
+                const std::string hex(s.substr(i + 1, 2));
+                out.push_back(
+                        static_cast<char>(
+                            std::strtoul(hex.c_str(), nullptr, 16)));
+                i += 2;
+            }
+            else out.push_back(s[i]);
+        }
+
+        return out;
+    }
+
+    // Parse the decimal @p s, of up to 19 digits so that it can't overflow.
+    bool sidecarNumber(const std::string& s, std::uint64_t& value)
+    {
+        if (s.empty() || s.size() > 19 ||
+                s.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+        value = std::strtoull(s.c_str(), nullptr, 10);
+        return true;
+    }
+
+    // A single byte range: bytes=<first>-<last>, bytes=<first>- to the end,
+    // or bytes=-<suffix> for the last bytes.  Only the suffix form lacks a
+    // first byte.
+    struct SidecarRange
+    {
+        bool hasFirst = false;
+        bool hasLast = false;
+        std::uint64_t first = 0;
+        std::uint64_t last = 0;
+    };
+
+    bool sidecarParseRange(const std::string& s, SidecarRange& range)
+    {
+        const std::string unit("bytes=");
+        const std::size_t dash(s.find('-'));
+        if (s.compare(0, unit.size(), unit) || dash == std::string::npos)
+        {
+            return false;
+        }
+
+        const std::string first(s.substr(unit.size(), dash - unit.size()));
+        const std::string last(s.substr(dash + 1));
+        range.hasFirst = !first.empty();
+        range.hasLast = !last.empty();
+
+        if (range.hasFirst && !sidecarNumber(first, range.first)) return false;
+        if (range.hasLast && !sidecarNumber(last, range.last)) return false;
+        if (!range.hasFirst) return range.hasLast;
+        return !range.hasLast || range.first <= range.last;
+    }
+
+    bool sidecarSend(const int fd, const char* data, std::size_t size)
+    {
+        while (size)
+        {
+            const ssize_t n(::send(fd, data, size, sidecarSendFlags));
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool sidecarRespond(
+            const int fd,
+            const int code,
+            const std::map<std::string, std::string>& headers,
+            const char* body,
+            const std::size_t size,
+            const bool head = false)
+    {
+        std::string reason("OK");
+        if (code == 206) reason = "Partial Content";
+        else if (code == 400) reason = "Bad Request";
+        else if (code == 403) reason = "Forbidden";
+        else if (code == 404) reason = "Not Found";
+        else if (code == 405) reason = "Method Not Allowed";
+        else if (code == 413) reason = "Payload Too Large";
+        else if (code == 416) reason = "Range Not Satisfiable";
+        else if (code == 431) reason = "Request Header Fields Too Large";
+        else if (code == 500) reason = "Internal Server Error";
+
+        std::string out(
+                "HTTP/1.1 " + std::to_string(code) + " " + reason + "\r\n");
+        for (const auto& h : headers)
+        {
+            out += h.first + ": " + h.second + "\r\n";
+        }
+        out += "Content-Length: " + std::to_string(size) + "\r\n\r\n";
+
+        if (!sidecarSend(fd, out.data(), out.size())) return false;
+        return head || sidecarSend(fd, body, size);
+    }
+
+    bool sidecarRespond(const int fd, const int code, const std::string& body)
+    {
+        return sidecarRespond(fd, code, { }, body.data(), body.size());
+    }
+}
+
+SidecarServer::SidecarServer(
+        const Arbiter& arbiter,
+        const std::string path,
+        const unsigned mode)
+    : m_arbiter(arbiter)
+    , m_path(path)
+    , m_done(false)
+    , m_requests(0)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (m_path.empty() || m_path.size() >= sizeof(addr.sun_path))
+    {
+        throw ArbiterError("Invalid sidecar socket path: " + m_path);
+    }
+    std::copy(m_path.begin(), m_path.end(), addr.sun_path);
+
+    // A socket left by a server which didn't shut down cleanly would
+    // otherwise keep us from binding, but one which still accepts
+    // connections belongs to a running server, and anything else isn't
+    // ours to remove.
+    struct stat st;
+    if (::lstat(m_path.c_str(), &st) == 0)
+    {
+        bool stale(false);
+        if (S_ISSOCK(st.st_mode))
+        {
+            const int probe(::socket(AF_UNIX, SOCK_STREAM, 0));
+            if (probe >= 0)
+            {
+                stale = ::connect(probe, (sockaddr*)&addr, sizeof(addr)) &&
+                    errno == ECONNREFUSED;
+                ::close(probe);
+            }
+        }
+
+        if (!stale || ::unlink(m_path.c_str()))
+        {
+            throw ArbiterError("Sidecar socket path is in use: " + m_path);
+        }
+    }
+
+    // Connections are refused until we listen, so none arrive before the
+    // socket has its permissions.
+    m_listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listener < 0 ||
+            ::bind(m_listener, (sockaddr*)&addr, sizeof(addr)) ||
+            ::chmod(m_path.c_str(), mode) ||
+            ::listen(m_listener, 128))
+    {
+        if (m_listener >= 0) ::close(m_listener);
+        throw ArbiterError("Could not listen on " + m_path);
+    }
+
+    m_thread = std::thread([this]() { accept(); });
+}
+
+SidecarServer::~SidecarServer()
+{
+    m_done = true;
+    ::shutdown(m_listener, SHUT_RDWR);
+    m_thread.join();
+    ::close(m_listener);
+    ::unlink(m_path.c_str());
+
+    // Wake connections waiting for their next request, and wait for them to
+    // close.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (const int fd : m_connections) ::shutdown(fd, SHUT_RDWR);
+    m_cv.wait(lock, [this]() { return m_connections.empty(); });
+}
+
+void SidecarServer::accept()
+{
+    while (true)
+    {
+        const int fd(::accept(m_listener, nullptr, nullptr));
+        if (m_done)
+        {
+            if (fd >= 0) ::close(fd);
+            return;
+        }
+        if (fd < 0) continue;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_connections.insert(fd);
+        std::thread([this, fd]()
+        {
+            serve(fd);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ::close(fd);
+            m_connections.erase(fd);
+            m_cv.notify_all();
+        }).detach();
+    }
+}
+
+void SidecarServer::serve(const int fd)
+{
+    std::string buffer;
+    std::vector<char> chunk(64 * 1024);
+
+    auto fill([&]()
+    {
+        const ssize_t n(::recv(fd, chunk.data(), chunk.size(), 0));
+        if (n <= 0) return false;
+        buffer.append(chunk.data(), n);
+        return true;
+    });
+
+    while (true)
+    {
+        std::size_t end;
+        while ((end = buffer.find("\r\n\r\n")) == std::string::npos)
+        {
+            if (buffer.size() > sidecarMaxHead)
+            {
+                sidecarRespond(fd, 431, "Headers too large");
+                return;
+            }
+            if (!fill()) return;
+        }
+
+        const std::string head(buffer.substr(0, end));
+        buffer.erase(0, end + 4);
+
+        SidecarRequest req;
+
+        std::size_t lineEnd(head.find("\r\n"));
+        const std::string line(head.substr(0, lineEnd));
+        const std::size_t sp(line.find(' '));
+        req.method = line.substr(0, sp);
+        const std::string target(
+                line.substr(sp + 1, line.find(' ', sp + 1) - sp - 1));
+
+        while (lineEnd != std::string::npos)
+        {
+            const std::size_t next(head.find("\r\n", lineEnd + 2));
+            const std::string h(head.substr(lineEnd + 2, next - lineEnd - 2));
+            const std::size_t colon(h.find(':'));
+            if (colon != std::string::npos)
+            {
+                std::string name(h.substr(0, colon));
+                std::transform(
+                        name.begin(),
+                        name.end(),
+                        name.begin(),
+                        ::tolower);
+
+                const std::size_t value(h.find_first_not_of(" \t", colon + 1));
+                req.headers[name] =
+                    value != std::string::npos ? h.substr(value) : "";
+            }
+            lineEnd = next;
+        }
+
+        if (req.header("expect") == "100-continue")
+        {
+            const std::string cont("HTTP/1.1 100 Continue\r\n\r\n");
+            if (!sidecarSend(fd, cont.data(), cont.size())) return;
+        }
+
+        // Without a body which we can read, the next request can't be found,
+        // so the connection is closed.
+        const std::string length(req.header("content-length"));
+        std::uint64_t size(0);
+        if (length.size() && !sidecarNumber(length, size))
+        {
+            sidecarRespond(fd, 400, "Invalid Content-Length");
+            return;
+        }
+        if (size > sidecarMaxBody)
+        {
+            sidecarRespond(fd, 413, "Body too large");
+            return;
+        }
+
+        while (buffer.size() < size)
+        {
+            if (!fill()) return;
+        }
+        req.body.assign(buffer.data(), buffer.data() + size);
+        buffer.erase(0, size);
+
+        ++m_requests;
+
+        // Targets are /<type>/<path>, with an optional query.
+        const std::size_t query(target.find('?'));
+        const std::string resource(sidecarDecode(target.substr(1, query - 1)));
+        const std::size_t slash(resource.find('/'));
+        if (query != std::string::npos)
+        {
+            const std::string q(target.substr(query + 1));
+            req.list = q == "list" || q.compare(0, 5, "list=") == 0;
+        }
+
+        if (target.empty() || target[0] != '/' ||
+                slash == std::string::npos || !slash)
+        {
+            if (!sidecarRespond(fd, 400, "Invalid target")) return;
+            continue;
+        }
+        req.path =
+            resource.substr(0, slash) + "://" + resource.substr(slash + 1);
+
+        bool sent(false);
+        try
+        {
+            if (!m_arbiter.hasDriver(req.path) ||
+                    !m_arbiter.isRemote(req.path))
+            {
+                sent = sidecarRespond(fd, 403, "Not served: " + req.path);
+            }
+            else if (req.method == "GET" && req.list)
+            {
+                std::string body;
+                for (const std::string& p : m_arbiter.resolve(req.path))
+                {
+                    body += p + "\n";
+                }
+                sent = sidecarRespond(fd, 200, body);
+            }
+            else if (req.method == "GET" && req.header("range").size())
+            {
+                // Only single ranges, of which those open at either end are
+                // resolved against the size of the file.
+                SidecarRange range;
+                std::unique_ptr<std::size_t> size;
+                if (!sidecarParseRange(req.header("range"), range))
+                {
+                    sent = sidecarRespond(fd, 400, "Invalid range");
+                }
+                else if ((!range.hasFirst || !range.hasLast) &&
+                        !(size = m_arbiter.tryGetSize(req.path)))
+                {
+                    sent = sidecarRespond(fd, 404, "Not found");
+                }
+                else
+                {
+                    std::uint64_t first(range.first);
+                    std::uint64_t count(0);
+                    if (!range.hasFirst)
+                    {
+                        count = (std::min<std::uint64_t>)(range.last, *size);
+                        first = *size - count;
+                    }
+                    else if (!range.hasLast)
+                    {
+                        count = first < *size ? *size - first : 0;
+                    }
+                    else count = range.last - first + 1;
+
+                    const std::vector<char> data(
+                            count ?
+                                m_arbiter.getRange(req.path, first, count) :
+                                std::vector<char>());
+
+                    if (data.empty())
+                    {
+                        sent = sidecarRespond(fd, 416, "Empty range");
+                    }
+                    else sent = sidecarRespond(
+                            fd,
+                            206,
+                            {
+                                {
+                                    "Content-Range",
+                                    "bytes " + std::to_string(first) + "-" +
+                                    std::to_string(first + data.size() - 1) +
+                                    "/" +
+                                    (size ? std::to_string(*size) : "*")
+                                }
+                            },
+                            data.data(),
+                            data.size());
+                }
+            }
+            else if (req.method == "GET")
+            {
+                const std::unique_ptr<std::vector<char>> data(
+                        m_arbiter.tryGetBinary(req.path));
+
+                if (data)
+                {
+                    sent = sidecarRespond(
+                            fd, 200, { }, data->data(), data->size());
+                }
+                else sent = sidecarRespond(fd, 404, "Not found");
+            }
+            else if (req.method == "HEAD")
+            {
+                const std::unique_ptr<std::size_t> size(
+                        m_arbiter.tryGetSize(req.path));
+
+                if (size)
+                {
+                    sent = sidecarRespond(fd, 200, { }, nullptr, *size, true);
+                }
+                else sent = sidecarRespond(fd, 404, { }, nullptr, 0, true);
+            }
+            else if (req.method == "PUT")
+            {
+                m_arbiter.put(req.path, std::move(req.body));
+                sent = sidecarRespond(fd, 200, "");
+            }
+            else if (req.method == "DELETE")
+            {
+                m_arbiter.remove(req.path);
+                sent = sidecarRespond(fd, 200, "");
+            }
+            else sent = sidecarRespond(fd, 405, "Unsupported: " + req.method);
+        }
+        catch (const std::exception& e)
+        {
+            sent = sidecarRespond(
+                    fd,
+                    500,
+                    { },
+                    e.what(),
+                    std::strlen(e.what()),
+                    req.method == "HEAD");
+        }
+
+        if (!sent) return;
+    }
+}
+
+#else
+
+SidecarServer::SidecarServer(
+        const Arbiter& arbiter,
+        const std::string path,
+        unsigned)
+    : m_arbiter(arbiter)
+    , m_path(path)
+    , m_done(false)
+    , m_requests(0)
+{
+    throw ArbiterError("Sidecar servers are not available on Windows");
+}
+
+SidecarServer::~SidecarServer() { }
+
+void SidecarServer::accept() { }
+void SidecarServer::serve(int) { }
+
+#endif
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
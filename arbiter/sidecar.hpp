@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/arbiter.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief Serves the remote drivers of an Arbiter to other processes.
+ *
+ * A daemon running this server owns the HTTP connections, caches, and
+ * coalesced reads of its Arbiter on behalf of every process on the host
+ * which reaches it through a drivers::Sidecar, so that concurrent reads of
+ * the same file by many workers are downloaded once.
+ *
+ * Requests arrive over a Unix domain socket as plain HTTP/1.1, on
+ * connections which are kept open between them, with targets of the form
+ * `/<type>/<path>`:
+ *      - GET reads a file, or with a `Range` header, a single range of it,
+ *        which may be open at either end, as `bytes=100-` or `bytes=-100`
+ *      - GET with a `list` query resolves a glob, one path per line
+ *      - HEAD gives the size of a file as its Content-Length
+ *      - PUT writes a file, and DELETE removes one
+ *
+ * Only remote paths are served, so nothing of the daemon's own filesystem
+ * is exposed, but every request, PUT and DELETE included, is made with the
+ * daemon's credentials.  Access is governed by the permissions of the
+ * socket, which by default only its owner may use.  Bodies are sent
+ * straight from the buffers read by the Arbiter.  Requests are buffered
+ * whole, so those with more than 64 KiB of headers or 5 GiB of body are
+ * refused, and their connections closed.
+ *
+ * Not available on Windows.
+ */
+class ARBITER_DLL SidecarServer
+{
+public:
+    /** Serve @p arbiter, which must outlive us, on the socket at @p path,
+     * with the permissions @p mode.  A socket left there by an earlier
+     * server is replaced, but if anything else is there, including the
+     * socket of a server which is still running, throws ArbiterError.
+     */
+    SidecarServer(
+            const Arbiter& arbiter,
+            std::string path,
+            unsigned mode = 0600);
+
+    /** Stop listening, wait for open connections to close, and remove our
+     * socket.
+     */
+    ~SidecarServer();
+
+    /** The path of our socket. */
+    const std::string& path() const { return m_path; }
+
+    /** The number of requests served. */
+    std::size_t requests() const { return m_requests; }
+
+private:
+    SidecarServer(const SidecarServer&);
+    SidecarServer& operator=(const SidecarServer&);
+
+    void accept();
+    void serve(int fd);
+
+    const Arbiter& m_arbiter;
+    const std::string m_path;
+    int m_listener = -1;
+
+    std::atomic<bool> m_done;
+    std::atomic<std::size_t> m_requests;
+    std::thread m_thread;
+
+    // Open connections, each served by a detached thread.
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::set<int> m_connections;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
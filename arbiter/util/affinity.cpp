@@ -0,0 +1,118 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/affinity.hpp>
+
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+Affinity::Affinity(std::vector<unsigned> cpus)
+    : m_cpus(std::move(cpus))
+{
+    std::sort(m_cpus.begin(), m_cpus.end());
+    m_cpus.erase(std::unique(m_cpus.begin(), m_cpus.end()), m_cpus.end());
+}
+
+Affinity Affinity::create(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+
+    if (c.is_null()) return Affinity();
+    if (c.is_string()) return Affinity(parse(c.get<std::string>()));
+    if (c.is_array()) return Affinity(c.get<std::vector<unsigned>>());
+    if (c.is_object() && c.count("node"))
+    {
+        return node(c.at("node").get<unsigned>());
+    }
+
+    throw ArbiterError("Invalid affinity: " + c.dump());
+}
+
+Affinity Affinity::node(const unsigned n)
+{
+    const std::string path(
+            "/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+
+    std::ifstream file(path);
+    std::string list;
+    if (!file || !std::getline(file, list) || parse(list).empty())
+    {
+        throw ArbiterError("No CPUs found for NUMA node " + std::to_string(n));
+    }
+
+    return Affinity(parse(list));
+}
+
+std::vector<unsigned> Affinity::parse(const std::string& list)
+{
+    std::vector<unsigned> cpus;
+
+    std::istringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        item.erase(
+                std::remove_if(item.begin(), item.end(), ::isspace),
+                item.end());
+        if (item.empty()) continue;
+
+        const std::size_t dash(item.find('-'));
+        if (item.find_first_not_of("0123456789-") != std::string::npos ||
+                dash == 0 || dash + 1 == item.size())
+        {
+            throw ArbiterError("Invalid CPU list: " + list);
+        }
+
+        const unsigned first(std::stoul(item.substr(0, dash)));
+        const unsigned last(
+                dash == std::string::npos ?
+                    first : std::stoul(item.substr(dash + 1)));
+        if (last < first) throw ArbiterError("Invalid CPU list: " + list);
+
+        for (unsigned cpu(first); cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+bool Affinity::apply() const
+{
+    if (m_cpus.empty()) return false;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const unsigned cpu : m_cpus)
+    {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+
+    return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    return false;
+#endif
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
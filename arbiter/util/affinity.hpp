@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief A set of CPUs to which threads may be pinned.
+ *
+ * Pinning the threads which move data to the CPUs of the NUMA node nearest
+ * the network interface keeps their work, and under the first-touch policy
+ * of Linux, the buffers they fill, local to that node.  Buffers are only
+ * given pages once written, so a response body received by a pinned thread
+ * lands in that thread's node.
+ *
+ * Pinning is only supported on Linux.  Elsewhere it does nothing.
+ */
+class ARBITER_DLL Affinity
+{
+public:
+    /** No CPUs, which leaves threads where the scheduler puts them. */
+    Affinity() { }
+
+    explicit Affinity(std::vector<unsigned> cpus);
+
+    /** Create from the stringified JSON @p j, which is null, for no
+     * pinning, or one of:
+     *
+     * - an array of CPU numbers, like `[0, 1, 2, 3]`
+     * - a string listing CPUs and ranges of them, like `"0-7,16-23"`
+     * - an object `{ "node": n }`, for the CPUs of NUMA node n
+     *
+     * Throws ArbiterError if @p j is not one of these, or names a NUMA node
+     * which doesn't exist.
+     */
+    static Affinity create(std::string j);
+
+    /** The CPUs of NUMA node @p node, as listed by sysfs. */
+    static Affinity node(unsigned node);
+
+    /** Parse a CPU list like `"0-7,16-23"`. */
+    static std::vector<unsigned> parse(const std::string& list);
+
+    bool empty() const { return m_cpus.empty(); }
+    const std::vector<unsigned>& cpus() const { return m_cpus; }
+
+    /** Pin the calling thread to our CPUs.  Returns true if it was pinned,
+     * or false if we are empty or pinning failed or is unsupported.
+     */
+    bool apply() const;
+
+private:
+    std::vector<unsigned> m_cpus;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
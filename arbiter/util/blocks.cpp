@@ -0,0 +1,624 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/blocks.hpp>
+
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <thread>
+
+#ifndef ARBITER_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const std::size_t defaultBlockSize(256 * 1024);
+    const std::size_t defaultBlockCacheSize(256 * 1024 * 1024);
+    const std::size_t defaultBlockShards(16);
+    const std::size_t defaultSharedSlots(1024);
+
+    // The header of a SharedBlocks file, padded to a cache line, whose magic
+    // number is set once the rest has been written.
+    struct SharedHeader
+    {
+        std::atomic<std::uint64_t> magic;
+        std::atomic<std::uint64_t> blockSize;
+        std::atomic<std::uint64_t> slots;
+    };
+
+    const std::uint64_t sharedMagic(0x4152424c4f434b31ULL);
+    const std::uint64_t sharedInitializing(1);
+    const std::size_t sharedAlign(64);
+
+    std::size_t alignShared(const std::size_t n)
+    {
+        return (n + sharedAlign - 1) / sharedAlign * sharedAlign;
+    }
+
+    // FNV-1a, which unlike std::hash is the same in every process, and
+    // never zero, which marks an empty slot.
+    std::uint64_t sharedKeyOf(const std::string& key)
+    {
+        std::uint64_t h(0xcbf29ce484222325ULL);
+        for (const char c : key)
+        {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x100000001b3ULL;
+        }
+        return h | 1;
+    }
+}
+
+struct SharedBlocks::Slot
+{
+    // Even when stable, and odd while being written.  Zero if never written.
+    std::atomic<std::uint64_t> generation;
+    std::atomic<std::uint64_t> key;
+    std::atomic<std::uint64_t> index;
+    std::atomic<std::uint64_t> size;
+
+    // The block follows.
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+#ifndef ARBITER_WINDOWS
+
+SharedBlocks::SharedBlocks(
+        const std::string path,
+        const std::size_t blockSize,
+        const std::size_t slots)
+    : m_path(path)
+    , m_blockSize(blockSize)
+    , m_slots(slots)
+    , m_stride(alignShared(sizeof(Slot) + blockSize))
+    , m_bytes(alignShared(sizeof(SharedHeader)) + m_stride * slots)
+{
+    if (!m_blockSize || !m_slots)
+    {
+        throw ArbiterError("Shared blocks need a block size and slots");
+    }
+
+    const int fd(::open(m_path.c_str(), O_RDWR | O_CREAT, 0600));
+    if (fd < 0) throw ArbiterError("Could not open shared blocks " + m_path);
+
+    // Every attaching process extends the file to the same size, and the
+    // new bytes read as zero, which is an empty slot.
+    struct stat st;
+    if (::fstat(fd, &st) ||
+            (static_cast<std::size_t>(st.st_size) < m_bytes &&
+                ::ftruncate(fd, m_bytes)))
+    {
+        ::close(fd);
+        throw ArbiterError("Could not size shared blocks " + m_path);
+    }
+
+    void* data(::mmap(
+                nullptr,
+                m_bytes,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED,
+                fd,
+                0));
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        throw ArbiterError("Could not map shared blocks " + m_path);
+    }
+    m_data = static_cast<char*>(data);
+
+    // The first to attach records the layout, which the rest must match.
+    SharedHeader& header(*reinterpret_cast<SharedHeader*>(m_data));
+    std::uint64_t magic(0);
+    if (header.magic.compare_exchange_strong(magic, sharedInitializing))
+    {
+        header.blockSize = m_blockSize;
+        header.slots = m_slots;
+        header.magic.store(sharedMagic, std::memory_order_release);
+        magic = sharedMagic;
+    }
+
+    for (int i(0); i < 1000 && magic == sharedInitializing; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        magic = header.magic.load(std::memory_order_acquire);
+    }
+
+    if (magic != sharedMagic ||
+            header.blockSize != m_blockSize ||
+            header.slots != m_slots)
+    {
+        ::munmap(m_data, m_bytes);
+        throw ArbiterError(
+                "Shared blocks " + m_path + " have another layout");
+    }
+}
+
+SharedBlocks::~SharedBlocks()
+{
+    ::munmap(m_data, m_bytes);
+}
+
+#else
+
+SharedBlocks::SharedBlocks(
+        const std::string path,
+        const std::size_t blockSize,
+        const std::size_t slots)
+    : m_path(path)
+    , m_blockSize(blockSize)
+    , m_slots(slots)
+{
+    throw ArbiterError("Shared blocks are not available on Windows");
+}
+
+SharedBlocks::~SharedBlocks() { }
+
+#endif
+
+SharedBlocks::Slot& SharedBlocks::slot(const std::size_t i) const
+{
+    return *reinterpret_cast<Slot*>(
+            m_data + alignShared(sizeof(SharedHeader)) + i * m_stride);
+}
+
+SharedBlocks::Slot& SharedBlocks::slot(
+        const std::uint64_t key,
+        const std::size_t index) const
+{
+    std::uint64_t h(key ^ (index * 0x9e3779b97f4a7c15ULL));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return slot(h % m_slots);
+}
+
+bool SharedBlocks::read(
+        const std::string& key,
+        const std::size_t index,
+        std::vector<char>& out) const
+{
+    const std::uint64_t k(sharedKeyOf(key));
+    Slot& s(slot(k, index));
+
+    const std::uint64_t before(s.generation.load(std::memory_order_acquire));
+    if (!before || before % 2) return false;
+
+    const std::size_t size(s.size.load(std::memory_order_relaxed));
+    if (s.key.load(std::memory_order_relaxed) != k ||
+            s.index.load(std::memory_order_relaxed) != index ||
+            size > m_blockSize)
+    {
+        return false;
+    }
+
+    const std::size_t start(out.size());
+    out.resize(start + size);
+    std::memcpy(out.data() + start, s.data(), size);
+
+    // A writer which claimed the slot while we copied it has changed its
+    // generation, in which case our copy may be torn.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s.generation.load(std::memory_order_relaxed) != before)
+    {
+        out.resize(start);
+        return false;
+    }
+    return true;
+}
+
+void SharedBlocks::write(
+        const std::string& key,
+        const std::size_t index,
+        const char* const data,
+        const std::size_t size)
+{
+    if (size > m_blockSize) return;
+
+    const std::uint64_t k(sharedKeyOf(key));
+    Slot& s(slot(k, index));
+
+    std::uint64_t generation(s.generation.load(std::memory_order_relaxed));
+    if (generation % 2) return;
+    if (!s.generation.compare_exchange_strong(generation, generation + 1))
+    {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s.key.store(k, std::memory_order_relaxed);
+    s.index.store(index, std::memory_order_relaxed);
+    s.size.store(size, std::memory_order_relaxed);
+    std::memcpy(s.data(), data, size);
+
+    s.generation.store(generation + 2, std::memory_order_release);
+}
+
+void SharedBlocks::erase(const std::string& key)
+{
+    const std::uint64_t k(sharedKeyOf(key));
+
+    for (std::size_t i(0); i < m_slots; ++i)
+    {
+        Slot& s(slot(i));
+        if (s.key.load(std::memory_order_relaxed) != k) continue;
+
+        // A slot being written is for whichever block claimed it, which if
+        // it is one of ours, is as current as the erase.
+        std::uint64_t generation(s.generation.load(std::memory_order_relaxed));
+        if (generation % 2) continue;
+        if (!s.generation.compare_exchange_strong(generation, generation + 1))
+        {
+            continue;
+        }
+
+        if (s.key.load(std::memory_order_relaxed) == k)
+        {
+            s.key.store(0, std::memory_order_relaxed);
+        }
+        s.generation.store(generation + 2, std::memory_order_release);
+    }
+}
+
+BlockCache::BlockCache(
+        const std::size_t blockSize,
+        const std::size_t maxSize,
+        const std::size_t shards,
+        std::unique_ptr<SharedBlocks> shared)
+    : m_blockSize(blockSize)
+    , m_shardMaxSize(maxSize / (std::max)(shards, std::size_t(1)))
+    , m_shared(std::move(shared))
+    , m_sharedHits(0)
+{
+    if (!m_blockSize) throw ArbiterError("Block size must be positive");
+    if (m_shared && m_shared->blockSize() != m_blockSize)
+    {
+        throw ArbiterError("Shared blocks must match the block size");
+    }
+
+    m_shards.resize((std::max)(shards, std::size_t(1)));
+    for (auto& s : m_shards) s.reset(new Shard());
+}
+
+std::unique_ptr<BlockCache> BlockCache::create(const std::string s)
+{
+    const json j(s.size() ? json::parse(s) : json());
+    if (!j.is_object()) return std::unique_ptr<BlockCache>();
+
+    const std::size_t blockSize(j.value("blockSize", defaultBlockSize));
+
+    std::unique_ptr<SharedBlocks> shared;
+    const json table(j.value("shared", json()));
+    if (table.is_object())
+    {
+        shared.reset(
+                new SharedBlocks(
+                    table.at("path").get<std::string>(),
+                    blockSize,
+                    table.value("slots", defaultSharedSlots)));
+    }
+
+    return std::unique_ptr<BlockCache>(
+            new BlockCache(
+                blockSize,
+                j.value("maxSize", defaultBlockCacheSize),
+                j.value("shards", defaultBlockShards),
+                std::move(shared)));
+}
+
+std::vector<char> BlockCache::get(
+        const std::string& key,
+        const std::size_t offset,
+        const std::size_t length,
+        const Fetch& fetch)
+{
+    std::vector<char> result;
+    if (!length) return result;
+
+    const std::size_t first(offset / m_blockSize);
+    const std::size_t last((offset + length - 1) / m_blockSize);
+
+    // Each block is one we have, one which somebody else is fetching, or one
+    // which we have claimed to fetch ourselves.
+    struct Slot
+    {
+        Block block;
+        std::shared_future<Block> future;
+        std::unique_ptr<std::promise<Block>> promise;
+        std::uint64_t serial = 0;
+    };
+
+    std::vector<Slot> slots;
+
+    for (std::size_t i(first); i <= last; ++i)
+    {
+        const Id id(key, i);
+        Shard& s(shard(id));
+        Slot slot;
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+
+            auto it(s.entries.find(id));
+            if (it != s.entries.end())
+            {
+                s.lru.splice(s.lru.end(), s.lru, it->second.lru);
+                slot.block = it->second.block;
+                ++s.hits;
+            }
+            else
+            {
+                auto p(s.pending.find(id));
+                if (p != s.pending.end())
+                {
+                    slot.future = p->second.future;
+                    ++s.hits;
+                }
+                else
+                {
+                    ++s.misses;
+                    slot.promise.reset(new std::promise<Block>());
+                    slot.serial = ++s.serial;
+                    s.pending[id] = Shard::Pending {
+                        slot.promise->get_future().share(),
+                        slot.serial
+                    };
+                }
+            }
+        }
+
+        // A short block is the last of its object.
+        const bool end(slot.block && slot.block->size() < m_blockSize);
+        slots.push_back(std::move(slot));
+        if (end) break;
+    }
+
+    // Resolve the blocks in order, so we only ever wait on fetches of
+    // earlier blocks than those we have yet to fetch, and so that nothing is
+    // fetched beyond the end of the object.
+    bool ended(false);
+    std::size_t i(0);
+
+    try
+    {
+        while (i < slots.size())
+        {
+            Slot& slot(slots[i]);
+
+            if (!slot.promise)
+            {
+                if (!ended && !slot.block) slot.block = slot.future.get();
+                ++i;
+            }
+            else
+            {
+                // Fetch each run of consecutive blocks we claimed at once.
+                std::size_t end(i + 1);
+                while (end < slots.size() && slots[end].promise) ++end;
+
+                std::vector<char> data;
+                if (!ended && m_shared)
+                {
+                    data = fetchShared(key, first + i, end - i, fetch);
+                }
+                else if (!ended)
+                {
+                    data = fetch((first + i) * m_blockSize,
+                            (end - i) * m_blockSize);
+                }
+
+                for (std::size_t j(i); j < end; ++j)
+                {
+                    const std::size_t begin(
+                            (std::min)((j - i) * m_blockSize, data.size()));
+                    const std::size_t stop(
+                            (std::min)(begin + m_blockSize, data.size()));
+
+                    Block block(std::make_shared<const std::vector<char>>(
+                                data.begin() + begin,
+                                data.begin() + stop));
+
+                    // Blocks past the end which we didn't fetch are empty,
+                    // but aren't known to be, so they aren't cached.
+                    insert(Id(key, first + j), slots[j].serial,
+                            ended ? Block() : block);
+
+                    slots[j].promise->set_value(block);
+                    slots[j].promise.reset();
+                    slots[j].block = block;
+                }
+
+                i = end;
+            }
+
+            if (slots[i - 1].block &&
+                    slots[i - 1].block->size() < m_blockSize)
+            {
+                ended = true;
+            }
+        }
+    }
+    catch (...)
+    {
+        // Fail any fetches we claimed but didn't complete, so that nobody
+        // waits on them forever.
+        for (std::size_t j(0); j < slots.size(); ++j)
+        {
+            if (!slots[j].promise) continue;
+            insert(Id(key, first + j), slots[j].serial, Block());
+            slots[j].promise->set_exception(std::current_exception());
+        }
+
+        throw;
+    }
+
+    result.reserve((std::min)(length, slots.size() * m_blockSize));
+
+    for (std::size_t j(0); j < slots.size() && slots[j].block; ++j)
+    {
+        const std::vector<char>& block(*slots[j].block);
+        const std::size_t base((first + j) * m_blockSize);
+        const std::size_t begin(offset > base ? offset - base : 0);
+        const std::size_t end((std::min)(block.size(), offset + length - base));
+
+        if (begin < end)
+        {
+            result.insert(
+                    result.end(),
+                    block.begin() + begin,
+                    block.begin() + end);
+        }
+
+        if (block.size() < m_blockSize) break;
+    }
+
+    return result;
+}
+
+std::vector<char> BlockCache::fetchShared(
+        const std::string& key,
+        const std::size_t index,
+        const std::size_t count,
+        const Fetch& fetch)
+{
+    std::vector<char> data;
+
+    std::size_t found(0);
+    while (found < count && m_shared->read(key, index + found, data))
+    {
+        ++found;
+        ++m_sharedHits;
+
+        // A short block is the last of its object.
+        if (data.size() < found * m_blockSize) return data;
+    }
+    if (found == count) return data;
+
+    const std::vector<char> fetched(
+            fetch(
+                (index + found) * m_blockSize,
+                (count - found) * m_blockSize));
+
+    for (std::size_t i(0); i < count - found; ++i)
+    {
+        const std::size_t begin(i * m_blockSize);
+        if (begin > fetched.size()) break;
+
+        const std::size_t size(
+                (std::min)(m_blockSize, fetched.size() - begin));
+        m_shared->write(key, index + found + i, fetched.data() + begin, size);
+        if (size < m_blockSize) break;
+    }
+
+    data.insert(data.end(), fetched.begin(), fetched.end());
+    return data;
+}
+
+void BlockCache::erase(const std::string& key)
+{
+    if (m_shared) m_shared->erase(key);
+
+    const Id begin(key, 0);
+
+    for (auto& p : m_shards)
+    {
+        Shard& s(*p);
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        auto it(s.entries.lower_bound(begin));
+        while (it != s.entries.end() && it->first.first == key)
+        {
+            s.size -= it->second.block->size();
+            s.lru.erase(it->second.lru);
+            it = s.entries.erase(it);
+        }
+
+        auto pending(s.pending.lower_bound(begin));
+        while (pending != s.pending.end() && pending->first.first == key)
+        {
+            pending = s.pending.erase(pending);
+        }
+    }
+}
+
+std::uint64_t BlockCache::hits() const
+{
+    std::uint64_t n(0);
+    for (const auto& p : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        n += p->hits;
+    }
+    return n;
+}
+
+std::uint64_t BlockCache::misses() const
+{
+    std::uint64_t n(0);
+    for (const auto& p : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        n += p->misses;
+    }
+    return n;
+}
+
+BlockCache::Shard& BlockCache::shard(const Id& id)
+{
+    std::size_t h(std::hash<std::string>()(id.first));
+    h ^= id.second + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return *m_shards[h % m_shards.size()];
+}
+
+void BlockCache::insert(
+        const Id& id,
+        const std::uint64_t serial,
+        const Block block)
+{
+    Shard& s(shard(id));
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto p(s.pending.find(id));
+    if (p == s.pending.end() || p->second.serial != serial) return;
+    s.pending.erase(p);
+
+    if (!block || block->size() > m_shardMaxSize) return;
+
+    while (s.size + block->size() > m_shardMaxSize && !s.lru.empty())
+    {
+        auto it(s.entries.find(s.lru.front()));
+        s.size -= it->second.block->size();
+        s.entries.erase(it);
+        s.lru.pop_front();
+    }
+
+    s.lru.push_back(id);
+    Shard::Entry& entry(s.entries[id]);
+    entry.block = block;
+    entry.lru = std::prev(s.lru.end());
+    s.size += block->size();
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
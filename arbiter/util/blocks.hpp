@@ -0,0 +1,235 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief A table of blocks in a memory-mapped file, shared by every
+ * process on a host which attaches to it.
+ *
+ * Each block of an object maps to one slot of the table, by a hash of its
+ * key and index, so a block fetched by one process may be read by the
+ * others without fetching it again.  Slots are claimed without locks: a
+ * writer moves the generation counter of a slot from even to odd with a
+ * compare-and-swap, fills the slot, and makes its generation even again,
+ * while a reader copies a slot out and keeps the copy only if its
+ * generation was even and unchanged throughout.  Neither waits for a slot
+ * which is being written, which is only ever a miss.
+ *
+ * Every process must use the same block size and number of slots, which
+ * are recorded in the file.  A slot whose writer died while filling it stays
+ * unused until the file is recreated.
+ */
+class ARBITER_DLL SharedBlocks
+{
+public:
+    /** Attach to the table at @p path, creating it with @p slots slots of
+     * @p blockSize bytes if it doesn't exist.  Throws ArbiterError if it
+     * exists with another layout, or on Windows.
+     */
+    SharedBlocks(std::string path, std::size_t blockSize, std::size_t slots);
+    ~SharedBlocks();
+
+    /** Append block @p index of the object identified by @p key to @p out,
+     * returning false if the table doesn't hold it.
+     */
+    bool read(
+            const std::string& key,
+            std::size_t index,
+            std::vector<char>& out) const;
+
+    /** Store the @p size bytes at @p data, at most a block, as block
+     * @p index of the object identified by @p key, unless its slot is being
+     * written by someone else.
+     */
+    void write(
+            const std::string& key,
+            std::size_t index,
+            const char* data,
+            std::size_t size);
+
+    /** Drop every block of the object identified by @p key. */
+    void erase(const std::string& key);
+
+    const std::string& path() const { return m_path; }
+    std::size_t blockSize() const { return m_blockSize; }
+    std::size_t slots() const { return m_slots; }
+
+private:
+    struct Slot;
+
+    Slot& slot(std::size_t i) const;
+    Slot& slot(std::uint64_t key, std::size_t index) const;
+
+    SharedBlocks(const SharedBlocks&);
+    SharedBlocks& operator=(const SharedBlocks&);
+
+    const std::string m_path;
+    const std::size_t m_blockSize;
+    const std::size_t m_slots;
+    std::size_t m_stride = 0;
+    std::size_t m_bytes = 0;
+    char* m_data = nullptr;
+};
+
+/** @brief An in-memory cache of fixed-size blocks of remote objects.
+ *
+ * Objects are divided into aligned blocks of a fixed size, so that
+ * overlapping ranged reads of the same object share the blocks they have in
+ * common, and each block is fetched at most once while it stays cached.
+ * Blocks are held in independently locked shards, each evicting its least
+ * recently used blocks to stay within its share of the memory budget.
+ * Concurrent misses for the same block are coalesced into a single fetch.
+ *
+ * Cached blocks are assumed to be unchanging, so writes to an object must
+ * be followed by a call to BlockCache::erase.
+ *
+ * Blocks missing from the cache may also be looked for in SharedBlocks, in
+ * which those fetched are then published for other processes.
+ */
+class ARBITER_DLL BlockCache
+{
+public:
+    /** Fetch up to @p length bytes of an object starting at byte @p offset,
+     * returning fewer only at the end of the object.
+     */
+    using Fetch = std::function<std::vector<char>(
+            std::size_t offset,
+            std::size_t length)>;
+
+    /** Cache blocks of @p blockSize bytes, using at most @p maxSize bytes in
+     * total across @p shards shards.
+     */
+    BlockCache(
+            std::size_t blockSize,
+            std::size_t maxSize,
+            std::size_t shards,
+            std::unique_ptr<SharedBlocks> shared =
+                std::unique_ptr<SharedBlocks>());
+
+    /** Create from the stringified JSON @p j, which is the `blocks` entry of
+     * the Arbiter configuration.  If @p j is not an object, returns null.
+     * Its keys are `blockSize`, by default 256 KiB, `maxSize`, by default
+     * 256 MiB, and `shards`, by default 16.  A `shared` entry, like
+     * `{ "path": "/dev/shm/arbiter-blocks", "slots": 1024 }`, attaches to
+     * SharedBlocks at `path`, of 1024 slots by default.
+     */
+    static std::unique_ptr<BlockCache> create(std::string j);
+
+    /** Read up to @p length bytes starting at byte @p offset of the object
+     * identified by @p key, using @p fetch to read the blocks which are not
+     * already cached.  Errors from @p fetch are propagated, and nothing is
+     * cached for the blocks it failed to read.
+     */
+    std::vector<char> get(
+            const std::string& key,
+            std::size_t offset,
+            std::size_t length,
+            const Fetch& fetch);
+
+    /** Drop all blocks of the object identified by @p key, including those
+     * in our SharedBlocks.
+     */
+    void erase(const std::string& key);
+
+    std::size_t blockSize() const { return m_blockSize; }
+
+    /** Blocks found in the cache, or already being fetched, since its
+     * creation, and those which had to be fetched.
+     */
+    std::uint64_t hits() const;
+    std::uint64_t misses() const;
+
+    /** Misses which were found in our SharedBlocks rather than fetched. */
+    std::uint64_t sharedHits() const { return m_sharedHits; }
+
+    /** Our SharedBlocks, or null if we have none. */
+    const SharedBlocks* shared() const { return m_shared.get(); }
+
+private:
+    using Block = std::shared_ptr<const std::vector<char>>;
+    using Id = std::pair<std::string, std::size_t>;
+
+    struct Shard
+    {
+        struct Entry
+        {
+            Block block;
+            std::list<Id>::iterator lru;
+        };
+
+        std::mutex mutex;
+        std::size_t size = 0;
+
+        // Ordered by key, so all blocks of an object are adjacent.
+        std::map<Id, Entry> entries;
+        std::list<Id> lru;
+
+        // Fetches in progress, numbered so that one which was superseded by
+        // an erase is not cached when it completes.
+        struct Pending
+        {
+            std::shared_future<Block> future;
+            std::uint64_t serial;
+        };
+
+        std::map<Id, Pending> pending;
+        std::uint64_t serial = 0;
+
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+    };
+
+    Shard& shard(const Id& id);
+
+    // Complete fetch @p serial of block @p id, caching @p block if the fetch
+    // is still current.
+    void insert(const Id& id, std::uint64_t serial, Block block);
+
+    // Read the @p count blocks of @p key from block @p index, taking those
+    // we can from our SharedBlocks, fetching the rest with @p fetch, and
+    // publishing those we fetched.
+    std::vector<char> fetchShared(
+            const std::string& key,
+            std::size_t index,
+            std::size_t count,
+            const Fetch& fetch);
+
+    BlockCache(const BlockCache&);
+    BlockCache& operator=(const BlockCache&);
+
+    const std::size_t m_blockSize;
+    const std::size_t m_shardMaxSize;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    const std::unique_ptr<SharedBlocks> m_shared;
+    std::atomic<std::uint64_t> m_sharedHits;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
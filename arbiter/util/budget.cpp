@@ -0,0 +1,117 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/budget.hpp>
+
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/types.hpp>
+#include <arbiter/util/util.hpp>
+#endif
+
+#include <algorithm>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+MemoryBudget::Reservation::Reservation(Reservation&& other)
+    : m_budget(other.m_budget)
+    , m_size(other.m_size)
+{
+    other.m_budget = nullptr;
+    other.m_size = 0;
+}
+
+MemoryBudget::Reservation& MemoryBudget::Reservation::operator=(
+        Reservation&& other)
+{
+    if (this != &other)
+    {
+        release();
+        std::swap(m_budget, other.m_budget);
+        std::swap(m_size, other.m_size);
+    }
+    return *this;
+}
+
+void MemoryBudget::Reservation::release()
+{
+    if (m_budget && m_size) m_budget->release(m_size);
+    m_budget = nullptr;
+    m_size = 0;
+}
+
+MemoryBudget::MemoryBudget(const std::size_t limit)
+    : m_limit(limit)
+{
+    if (!m_limit) throw ArbiterError("Memory budget must be positive");
+}
+
+std::unique_ptr<MemoryBudget> MemoryBudget::create(const std::string s)
+{
+    const json j(s.size() ? json::parse(s) : json());
+
+    std::size_t limit(0);
+    if (auto v = env("ARBITER_MEMORY_BUDGET")) limit = std::stoull(*v);
+    else if (j.is_object()) limit = j.value("budget", std::size_t(0));
+
+    if (!limit) return std::unique_ptr<MemoryBudget>();
+    return std::unique_ptr<MemoryBudget>(new MemoryBudget(limit));
+}
+
+MemoryBudget::Reservation MemoryBudget::reserve(std::size_t size)
+{
+    size = (std::min)(size, m_limit);
+    if (!size) return Reservation();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const std::uint64_t ticket(m_nextTicket++);
+
+    auto ready([&]()
+    {
+        return ticket == m_serving && m_used + size <= m_limit;
+    });
+
+    if (!ready())
+    {
+        ++m_waits;
+        m_cv.wait(lock, ready);
+    }
+
+    m_used += size;
+    ++m_serving;
+
+    // The next in line may fit as well.
+    m_cv.notify_all();
+
+    return Reservation(*this, size);
+}
+
+void MemoryBudget::release(const std::size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_used -= size;
+    }
+    m_cv.notify_all();
+}
+
+std::size_t MemoryBudget::used() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_used;
+}
+
+std::uint64_t MemoryBudget::waits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_waits;
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
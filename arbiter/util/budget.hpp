@@ -0,0 +1,114 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief A process-wide limit on the bytes held by transfers in flight.
+ *
+ * Each transfer reserves the bytes it will hold before it allocates them,
+ * and releases them when it completes.  Once the budget is exhausted, new
+ * reservations wait, in the order requested, until enough is released.  A
+ * reservation larger than the whole budget is reduced to the budget, so it
+ * proceeds alone rather than waiting forever.
+ *
+ * Reservations are held only for the duration of a transfer, never while
+ * its data waits to be consumed, so that a reader can't wait on data which
+ * only it would release.
+ */
+class ARBITER_DLL MemoryBudget
+{
+public:
+    /** @brief Bytes held against a MemoryBudget, which are released on
+     * destruction.
+     */
+    class ARBITER_DLL Reservation
+    {
+        friend class MemoryBudget;
+
+    public:
+        /** An empty reservation, holding nothing. */
+        Reservation() { }
+        Reservation(Reservation&& other);
+        Reservation& operator=(Reservation&& other);
+        ~Reservation() { release(); }
+
+        /** Bytes held. */
+        std::size_t size() const { return m_size; }
+
+        /** Release the bytes held, if any, before destruction. */
+        void release();
+
+    private:
+        Reservation(MemoryBudget& budget, std::size_t size)
+            : m_budget(&budget)
+            , m_size(size)
+        { }
+
+        Reservation(const Reservation&);
+        Reservation& operator=(const Reservation&);
+
+        MemoryBudget* m_budget = nullptr;
+        std::size_t m_size = 0;
+    };
+
+    /** Allow at most @p limit bytes to be reserved at once. */
+    explicit MemoryBudget(std::size_t limit);
+
+    /** Create from the stringified JSON @p j, which is the `memory` entry of
+     * the Arbiter configuration, whose `budget` key is the limit in bytes.
+     * The ARBITER_MEMORY_BUDGET environment variable takes precedence.  If
+     * neither sets a nonzero limit, returns null, for no limit.
+     */
+    static std::unique_ptr<MemoryBudget> create(std::string j);
+
+    /** Reserve @p size bytes, waiting until they are available. */
+    Reservation reserve(std::size_t size);
+
+    /** The limit, in bytes. */
+    std::size_t limit() const { return m_limit; }
+
+    /** Bytes currently reserved. */
+    std::size_t used() const;
+
+    /** The number of reservations which have had to wait. */
+    std::uint64_t waits() const;
+
+private:
+    MemoryBudget(const MemoryBudget&);
+    MemoryBudget& operator=(const MemoryBudget&);
+
+    void release(std::size_t size);
+
+    const std::size_t m_limit;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::size_t m_used = 0;
+    std::uint64_t m_waits = 0;
+
+    // Waiters are served in order of their tickets.
+    std::uint64_t m_nextTicket = 0;
+    std::uint64_t m_serving = 0;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
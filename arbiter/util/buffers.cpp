@@ -0,0 +1,123 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/buffers.hpp>
+
+#include <arbiter/util/json.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+namespace http
+{
+
+namespace
+{
+    // The exponent of the smallest power of two of at least @p size bytes.
+    std::size_t ceilLog2(const std::size_t size)
+    {
+        std::size_t c(0);
+        while ((std::size_t(1) << c) < size) ++c;
+        return c;
+    }
+
+    // The exponent of the largest power of two of at most @p size bytes.
+    std::size_t floorLog2(std::size_t size)
+    {
+        std::size_t c(0);
+        while (size >>= 1) ++c;
+        return c;
+    }
+}
+
+SlabPool::SlabPool(const std::size_t maxIdle)
+    : m_maxIdle(maxIdle)
+{ }
+
+std::shared_ptr<SlabPool> SlabPool::create(const std::string s)
+{
+    const json j(s.size() ? json::parse(s) : json());
+
+    if (j.is_boolean() && j.get<bool>()) return std::make_shared<SlabPool>();
+    if (!j.is_object()) return std::shared_ptr<SlabPool>();
+
+    return std::make_shared<SlabPool>(
+            j.value("maxIdle", std::size_t(256 * 1024 * 1024)));
+}
+
+std::vector<char> SlabPool::acquire(const std::size_t size)
+{
+    std::size_t c(ceilLog2(size));
+    if (c < minClass) c = minClass;
+
+    std::vector<char> buffer;
+
+    if (c <= maxClass)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& list(m_free[c - minClass]);
+        if (list.size())
+        {
+            buffer.swap(list.back());
+            list.pop_back();
+            m_idle -= buffer.capacity();
+            ++m_hits;
+            return buffer;
+        }
+        ++m_misses;
+        buffer.reserve(std::size_t(1) << c);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_misses;
+        buffer.reserve(size);
+    }
+
+    return buffer;
+}
+
+void SlabPool::release(std::vector<char> buffer)
+{
+    // A buffer belongs to the largest class which it can hold, so that any
+    // buffer of a class can serve every request of that class.
+    const std::size_t capacity(buffer.capacity());
+    const std::size_t c(floorLog2(capacity));
+    if (c < minClass || c > maxClass) return;
+
+    buffer.clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idle + capacity > m_maxIdle) return;
+
+    m_free[c - minClass].push_back(std::move(buffer));
+    m_idle += capacity;
+}
+
+std::size_t SlabPool::idle() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle;
+}
+
+std::uint64_t SlabPool::hits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+std::uint64_t SlabPool::misses() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+} // namespace http
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
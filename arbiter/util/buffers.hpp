@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+namespace http
+{
+
+/** @brief A BufferPool of size-classed buffers.
+ *
+ * Buffers are grouped into classes by powers of two, from 64 KiB to 64 MiB,
+ * and each request is served by a buffer of the smallest class which holds
+ * it, so that buffers are interchangeable among responses of similar sizes
+ * and the heap sees a few distinct allocation sizes rather than one per
+ * response.  Requests outside of these classes are allocated exactly and
+ * not kept.  Released buffers are kept for reuse up to a total idle size,
+ * beyond which they are freed.
+ */
+class ARBITER_DLL SlabPool : public BufferPool
+{
+public:
+    /** Keep at most @p maxIdle bytes of released buffers. */
+    explicit SlabPool(std::size_t maxIdle = 256 * 1024 * 1024);
+
+    /** Create from the stringified JSON @p j, which is the `buffers` entry
+     * of the `http` configuration.  If @p j is `true` or an object, returns
+     * a pool, whose `maxIdle` may be given in bytes, and otherwise returns
+     * null.
+     */
+    static std::shared_ptr<SlabPool> create(std::string j);
+
+    virtual std::vector<char> acquire(std::size_t size) override;
+    virtual void release(std::vector<char> buffer) override;
+
+    /** Bytes of released buffers currently kept for reuse. */
+    std::size_t idle() const;
+
+    /** Requests which were served by a kept buffer, and those which were
+     * not.
+     */
+    std::uint64_t hits() const;
+    std::uint64_t misses() const;
+
+private:
+    static constexpr std::size_t minClass = 16;
+    static constexpr std::size_t maxClass = 26;
+    static constexpr std::size_t classes = maxClass - minClass + 1;
+
+    const std::size_t m_maxIdle;
+
+    mutable std::mutex m_mutex;
+    std::array<std::vector<std::vector<char>>, classes> m_free;
+    std::size_t m_idle = 0;
+    std::uint64_t m_hits = 0;
+    std::uint64_t m_misses = 0;
+};
+
+} // namespace http
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,109 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/cancel.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const CancelToken*& currentToken()
+    {
+        thread_local const CancelToken* token(nullptr);
+        return token;
+    }
+}
+
+CancelToken::CancelToken()
+    : m_state(std::make_shared<State>())
+{ }
+
+CancelToken::CancelToken(const Clock::time_point deadline)
+    : m_state(std::make_shared<State>())
+{
+    m_state->hasDeadline = true;
+    m_state->deadline = deadline;
+}
+
+void CancelToken::cancel() const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->cancelled = true;
+    }
+
+    m_state->cv.notify_all();
+}
+
+bool CancelToken::cancelled() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->cancelled ||
+        (m_state->hasDeadline && Clock::now() >= m_state->deadline);
+}
+
+void CancelToken::check() const
+{
+    if (cancelled()) throw CancelledError("Operation cancelled");
+}
+
+bool CancelToken::hasDeadline() const
+{
+    return m_state->hasDeadline;
+}
+
+CancelToken::Clock::time_point CancelToken::deadline() const
+{
+    return m_state->deadline;
+}
+
+bool CancelToken::sleep(const Clock::duration d) const
+{
+    Clock::time_point until(Clock::now() + d);
+    if (m_state->hasDeadline && m_state->deadline < until)
+    {
+        until = m_state->deadline;
+    }
+
+    std::unique_lock<std::mutex> lock(m_state->mutex);
+    m_state->cv.wait_until(lock, until, [this]()
+    {
+        return m_state->cancelled;
+    });
+
+    return !m_state->cancelled &&
+        (!m_state->hasDeadline || Clock::now() < m_state->deadline);
+}
+
+CancelScope::CancelScope(CancelToken token)
+    : m_token(std::move(token))
+    , m_previous(currentToken())
+{
+    currentToken() = &m_token;
+}
+
+CancelScope::~CancelScope()
+{
+    currentToken() = m_previous;
+}
+
+const CancelToken* CancelScope::current()
+{
+    return currentToken();
+}
+
+void CancelScope::check()
+{
+    if (const CancelToken* token = current()) token->check();
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief Thrown by an operation which was abandoned because its
+ * CancelToken was cancelled or reached its deadline.
+ */
+class CancelledError : public ArbiterError
+{
+public:
+    CancelledError(std::string msg) : ArbiterError(msg) { }
+};
+
+/** @brief A handle by which abandoned work may be stopped.
+ *
+ * Copies of a token share their state, so any copy may cancel the work
+ * observing the others.  A token may also carry an absolute deadline, after
+ * which it counts as cancelled.
+ *
+ * Work observes the token made current on its thread by a CancelScope.
+ * HTTP transfers started under a token are aborted as soon as it is
+ * cancelled, rather than running until their low-speed timeout, and retries
+ * stop waiting.  The token is carried along to asynchronous operations and
+ * to the threads of concurrent operations like Arbiter::copy.
+ */
+class ARBITER_DLL CancelToken
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /** A token without a deadline. */
+    CancelToken();
+
+    /** A token which is cancelled at @p deadline. */
+    explicit CancelToken(Clock::time_point deadline);
+
+    /** A token which is cancelled after @p timeout from now. */
+    template <typename Duration>
+    static CancelToken after(Duration timeout)
+    {
+        return CancelToken(Clock::now() + timeout);
+    }
+
+    /** Cancel the work observing this token. */
+    void cancel() const;
+
+    /** True if this token has been cancelled or its deadline has passed. */
+    bool cancelled() const;
+
+    /** Throw CancelledError if this token has been cancelled. */
+    void check() const;
+
+    /** True if this token has a deadline. */
+    bool hasDeadline() const;
+
+    /** The deadline of this token, if it has one.  See hasDeadline. */
+    Clock::time_point deadline() const;
+
+    /** Wait for @p d, returning early with false if this token is
+     * cancelled first.
+     */
+    bool sleep(Clock::duration d) const;
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool cancelled = false;
+        bool hasDeadline = false;
+        Clock::time_point deadline;
+    };
+
+    std::shared_ptr<State> m_state;
+};
+
+/** @brief Makes a CancelToken current on the calling thread for its
+ * lifetime.  Scopes nest, restoring the previous token when destroyed.
+ */
+class ARBITER_DLL CancelScope
+{
+public:
+    explicit CancelScope(CancelToken token);
+    ~CancelScope();
+
+    /** The current token of the calling thread, or null if there is none. */
+    static const CancelToken* current();
+
+    /** Throw CancelledError if the current token has been cancelled. */
+    static void check();
+
+private:
+    CancelScope(const CancelScope&);
+    CancelScope& operator=(const CancelScope&);
+
+    CancelToken m_token;
+    const CancelToken* m_previous;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,178 @@
+#pragma once
+
+// Awaitable operations for C++20 coroutines.  This header is optional, and
+// not included by arbiter.hpp, since the rest of the library requires only
+// C++11.
+
+#if !defined(__cpp_impl_coroutine)
+#error "arbiter/util/coro.hpp requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/arbiter.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+namespace coro
+{
+
+/** @brief Awaits an asynchronous operation which passes its outcome to a
+ * Completion.
+ *
+ * Awaiting starts the operation and suspends the awaiting coroutine until
+ * it completes.  The coroutine is then resumed as a task of an Executor
+ * rather than on the thread which completed the operation, which for HTTP
+ * requests is the one thread of the transfer engine.  Errors are rethrown
+ * into the coroutine.
+ *
+ * Each Awaitable may be awaited once.
+ */
+template <typename T>
+class Awaitable
+{
+public:
+    using Start = std::function<void(Completion<T>)>;
+
+    Awaitable(Start start, Executor& executor)
+        : m_start(std::move(start))
+        , m_executor(executor)
+    { }
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        // The coroutine may be resumed, and this destroyed, before start
+        // returns, so nothing of ours may be touched after it is called.
+        Start start(std::move(m_start));
+        Executor* executor(&m_executor);
+
+        start([this, handle, executor](std::future<T> result)
+        {
+            m_result = std::move(result);
+            executor->post([handle]() { handle.resume(); });
+        });
+    }
+
+    T await_resume() { return m_result.get(); }
+
+private:
+    Start m_start;
+    Executor& m_executor;
+    std::future<T> m_result;
+};
+
+/* Awaitable counterparts of the Arbiter operations of the same names.  The
+ * awaiting coroutine is resumed on @p executor, or if that is null, on the
+ * Executor of @p a.  Both must outlive the operation.
+ */
+
+inline Awaitable<std::vector<char>> getBinary(
+        const Arbiter& a,
+        std::string path,
+        Executor* executor = nullptr)
+{
+    return Awaitable<std::vector<char>>(
+            [&a, path](Completion<std::vector<char>> done)
+            {
+                a.getBinaryAsync(path, std::move(done));
+            },
+            executor ? *executor : a.executor());
+}
+
+inline Awaitable<std::string> get(
+        const Arbiter& a,
+        std::string path,
+        Executor* executor = nullptr)
+{
+    return Awaitable<std::string>(
+            [&a, path](Completion<std::string> done)
+            {
+                a.getBinaryAsync(path, [done](
+                            std::future<std::vector<char>> result)
+                {
+                    complete(done, [&]()
+                    {
+                        const std::vector<char> data(result.get());
+                        return std::string(data.begin(), data.end());
+                    });
+                });
+            },
+            executor ? *executor : a.executor());
+}
+
+inline Awaitable<std::size_t> getSize(
+        const Arbiter& a,
+        std::string path,
+        Executor* executor = nullptr)
+{
+    return Awaitable<std::size_t>(
+            [&a, path](Completion<std::size_t> done)
+            {
+                a.getSizeAsync(path, std::move(done));
+            },
+            executor ? *executor : a.executor());
+}
+
+inline Awaitable<void> put(
+        const Arbiter& a,
+        std::string path,
+        std::vector<char> data,
+        Executor* executor = nullptr)
+{
+    auto shared(std::make_shared<std::vector<char>>(std::move(data)));
+    return Awaitable<void>(
+            [&a, path, shared](Completion<void> done)
+            {
+                a.putAsync(path, std::move(*shared), std::move(done));
+            },
+            executor ? *executor : a.executor());
+}
+
+inline Awaitable<void> put(
+        const Arbiter& a,
+        std::string path,
+        const std::string& data,
+        Executor* executor = nullptr)
+{
+    return put(
+            a,
+            std::move(path),
+            std::vector<char>(data.begin(), data.end()),
+            executor);
+}
+
+inline Awaitable<std::vector<std::string>> resolve(
+        const Arbiter& a,
+        std::string path,
+        Executor* executor = nullptr)
+{
+    return Awaitable<std::vector<std::string>>(
+            [&a, path](Completion<std::vector<std::string>> done)
+            {
+                a.resolveAsync(path, std::move(done));
+            },
+            executor ? *executor : a.executor());
+}
+
+} // namespace coro
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
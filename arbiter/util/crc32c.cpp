@@ -0,0 +1,189 @@
+#include <cstdint>
+#include <cstring>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/crc32c.hpp>
+#endif
+
+// Checksums are computed with the CRC32 instructions of the CPU if it has
+// them, falling back to the portable table-driven implementation below.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define ARBITER_CRC32C_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define ARBITER_CRC32C_ARM
+#include <arm_acle.h>
+#   ifdef __linux__
+#   include <sys/auxv.h>
+#   include <asm/hwcap.h>
+#   endif
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+namespace crypto
+{
+namespace
+{
+
+// The Castagnoli polynomial, bit-reversed.
+const uint32_t crcPolynomial(0x82f63b78);
+
+// Slicing-by-8 tables, where entry i of table j is the CRC of byte i
+// followed by j zero bytes.
+struct CrcTables
+{
+    CrcTables()
+    {
+        for (uint32_t i(0); i < 256; ++i)
+        {
+            uint32_t c(i);
+            for (int b(0); b < 8; ++b) c = (c >> 1) ^ ((c & 1) * crcPolynomial);
+            t[0][i] = c;
+        }
+
+        for (uint32_t i(0); i < 256; ++i)
+        {
+            for (int j(1); j < 8; ++j)
+            {
+                t[j][i] = (t[j - 1][i] >> 8) ^ t[0][t[j - 1][i] & 0xff];
+            }
+        }
+    }
+
+    uint32_t t[8][256];
+};
+
+// Update the raw, uninverted checksum @p c with @p size bytes of @p data.
+using CrcKernel = uint32_t (*)(uint32_t c, const uint8_t* data, std::size_t);
+
+uint32_t crcPortable(uint32_t c, const uint8_t* p, std::size_t n)
+{
+    static const CrcTables tables;
+    const uint32_t (&t)[8][256](tables.t);
+
+    for ( ; n >= 8; n -= 8, p += 8)
+    {
+        c ^= p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+        c =
+            t[7][c & 0xff] ^ t[6][(c >> 8) & 0xff] ^
+            t[5][(c >> 16) & 0xff] ^ t[4][c >> 24] ^
+            t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+
+    for ( ; n; --n, ++p) c = (c >> 8) ^ t[0][(c ^ *p) & 0xff];
+    return c;
+}
+
+#ifdef ARBITER_CRC32C_X86
+// SSE4.2, which checksums eight bytes per instruction on 64-bit targets.
+__attribute__((target("sse4.2")))
+uint32_t crcX86(uint32_t c, const uint8_t* p, std::size_t n)
+{
+#ifdef __x86_64__
+    uint64_t wide(c);
+    for ( ; n >= 8; n -= 8, p += 8)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        wide = _mm_crc32_u64(wide, v);
+    }
+    c = static_cast<uint32_t>(wide);
+#endif
+
+    for ( ; n >= 4; n -= 4, p += 4)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u32(c, v);
+    }
+
+    for ( ; n; --n, ++p) c = _mm_crc32_u8(c, *p);
+    return c;
+}
+
+bool haveCrcX86()
+{
+    unsigned a(0), b(0), c(0), d(0);
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+    return c & (1u << 20);
+}
+#endif
+
+#ifdef ARBITER_CRC32C_ARM
+// ARMv8 CRC32 instructions.
+uint32_t crcArm(uint32_t c, const uint8_t* p, std::size_t n)
+{
+    for ( ; n >= 8; n -= 8, p += 8)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        c = __crc32cd(c, v);
+    }
+
+    for ( ; n; --n, ++p) c = __crc32cb(c, *p);
+    return c;
+}
+
+bool haveCrcArm()
+{
+#ifdef __linux__
+    return getauxval(AT_HWCAP) & HWCAP_CRC32;
+#else
+    return true;
+#endif
+}
+#endif
+
+CrcKernel selectCrcKernel()
+{
+#ifdef ARBITER_CRC32C_X86
+    if (haveCrcX86()) return crcX86;
+#endif
+#ifdef ARBITER_CRC32C_ARM
+    if (haveCrcArm()) return crcArm;
+#endif
+    return crcPortable;
+}
+
+} // unnamed namespace
+
+uint32_t crc32c(const char* data, const std::size_t size, const uint32_t crc)
+{
+    // The CPU is only inspected once.
+    static const CrcKernel kernel(selectCrcKernel());
+
+    const uint8_t* p(reinterpret_cast<const uint8_t*>(data));
+    return ~kernel(~crc, p, size);
+}
+
+uint32_t crc32c(const std::string& data)
+{
+    return crc32c(data.data(), data.size());
+}
+
+std::string Crc32c::finalize()
+{
+    std::string result(4, 0);
+    for (std::size_t i(0); i < 4; ++i)
+    {
+        result[i] = static_cast<char>((m_crc >> (24 - 8 * i)) & 0xff);
+    }
+
+    m_crc = 0;
+    return result;
+}
+
+} // namespace crypto
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
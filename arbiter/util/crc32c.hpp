@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+namespace crypto
+{
+
+/** The CRC-32C (Castagnoli) checksum of @p size bytes of @p data, continuing
+ * from @p crc, the checksum of whatever preceded them.  Computed with the
+ * CRC32 instructions of SSE4.2 or ARMv8 where the CPU has them.
+ */
+ARBITER_DLL uint32_t crc32c(
+        const char* data,
+        std::size_t size,
+        uint32_t crc = 0);
+
+ARBITER_DLL uint32_t crc32c(const std::string& data);
+
+/** @brief Incremental CRC-32C, for data which is checksummed as it arrives
+ * rather than buffered in full.
+ */
+class ARBITER_DLL Crc32c
+{
+public:
+    /** Checksum the next @p size bytes of the message. */
+    void update(const char* data, std::size_t size)
+    {
+        m_crc = crc32c(data, size, m_crc);
+    }
+
+    void update(const std::string& data) { update(data.data(), data.size()); }
+    void update(const std::vector<char>& data)
+    {
+        update(data.data(), data.size());
+    }
+
+    /** The 4-byte big-endian checksum of the message passed to update since
+     * construction or the previous finalize, after which the checksum is
+     * reset to begin a new message.
+     */
+    std::string finalize();
+
+private:
+    uint32_t m_crc = 0;
+};
+
+} // namespace crypto
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,195 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/credentials.hpp>
+
+#include <arbiter/drivers/fs.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/sha256.hpp>
+#include <arbiter/util/time.hpp>
+#include <arbiter/util/transforms.hpp>
+#include <arbiter/util/types.hpp>
+#include <arbiter/util/util.hpp>
+#endif
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+#ifndef ARBITER_WINDOWS
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    // Read the whole of @p path, unless it may have been written or read
+    // by another user.
+    std::unique_ptr<std::string> credentialRead(const std::string& path)
+    {
+#ifndef ARBITER_WINDOWS
+        const int fd(::open(path.c_str(), O_RDONLY | O_NOFOLLOW));
+        if (fd < 0) return std::unique_ptr<std::string>();
+
+        struct stat st;
+        if (::fstat(fd, &st) ||
+                !S_ISREG(st.st_mode) ||
+                st.st_uid != ::geteuid() ||
+                (st.st_mode & 077))
+        {
+            ::close(fd);
+            return std::unique_ptr<std::string>();
+        }
+
+        std::unique_ptr<std::string> data(new std::string());
+        char buffer[4096];
+        ssize_t n(0);
+        while ((n = ::read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            data->append(buffer, n);
+        }
+        ::close(fd);
+
+        if (n < 0) data.reset();
+        return data;
+#else
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        if (!stream.good()) return std::unique_ptr<std::string>();
+        return makeUnique<std::string>(
+                std::istreambuf_iterator<char>(stream),
+                std::istreambuf_iterator<char>());
+#endif
+    }
+
+    // Write @p data to the new file @p path, readable only by us.
+    bool credentialWrite(const std::string& path, const std::string& data)
+    {
+#ifndef ARBITER_WINDOWS
+        const int fd(
+                ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600));
+        if (fd < 0) return false;
+
+        std::size_t done(0);
+        while (done < data.size())
+        {
+            const ssize_t n(
+                    ::write(fd, data.data() + done, data.size() - done));
+            if (n <= 0) break;
+            done += n;
+        }
+
+        return !::close(fd) && done == data.size();
+#else
+        std::ofstream stream(path, std::ios::out | std::ios::binary);
+        stream << data;
+        stream.close();
+        return stream.good();
+#endif
+    }
+}
+
+CredentialCache::CredentialCache(const std::string dir)
+    : m_dir(expandTilde(dir.size() && dir.back() != '/' ? dir + '/' : dir))
+{
+    if (m_dir.empty())
+    {
+        throw ArbiterError("Credential cache directory may not be empty");
+    }
+
+#ifndef ARBITER_WINDOWS
+    // A directory which we create is closed to others.  One which exists
+    // is left as it is, since each entry is closed to others anyway.
+    struct stat st;
+    const bool existed(::stat(m_dir.c_str(), &st) == 0);
+#endif
+
+    if (!mkdirp(m_dir))
+    {
+        throw ArbiterError("Could not create credential cache " + m_dir);
+    }
+
+#ifndef ARBITER_WINDOWS
+    if (!existed) ::chmod(m_dir.c_str(), 0700);
+#endif
+}
+
+std::shared_ptr<CredentialCache> CredentialCache::create(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+
+    std::string dir;
+    if (c.is_object()) dir = c.value("credentialCache", std::string());
+    if (dir.empty())
+    {
+        if (auto e = env("ARBITER_CREDENTIAL_CACHE")) dir = *e;
+    }
+
+    if (dir.empty()) return std::shared_ptr<CredentialCache>();
+    return std::make_shared<CredentialCache>(dir);
+}
+
+std::string CredentialCache::pathOf(const std::string& key) const
+{
+    return m_dir + crypto::encodeAsHex(crypto::sha256(key)) + ".json";
+}
+
+std::unique_ptr<std::string> CredentialCache::get(
+        const std::string& key,
+        const int64_t minRemaining,
+        int64_t& expiration) const
+{
+    std::unique_ptr<std::string> result;
+
+    const std::unique_ptr<std::string> data(credentialRead(pathOf(key)));
+    if (!data) return result;
+
+    try
+    {
+        const json entry(json::parse(*data));
+        expiration = entry.at("expiration").get<int64_t>();
+        if (expiration - Time().asUnix() > minRemaining)
+        {
+            result = makeUnique<std::string>(
+                    entry.at("value").get<std::string>());
+        }
+    }
+    catch (...) { }
+
+    return result;
+}
+
+void CredentialCache::put(
+        const std::string& key,
+        const std::string& value,
+        const int64_t expiration) const
+{
+    const json entry { { "expiration", expiration }, { "value", value } };
+
+    const std::string path(pathOf(key));
+    const std::string temp(([&path]()
+    {
+        std::random_device random;
+        return path + "." + std::to_string(random()) + ".tmp";
+    })());
+
+    if (!credentialWrite(temp, entry.dump()) ||
+            std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+    }
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief An on-disk cache of temporary credentials, so that short-lived
+ * processes reuse those fetched by their predecessors rather than each
+ * fetching their own.
+ *
+ * Each entry is a string with the Unix time at which it expires, in a
+ * file of its own named by a hash of its key, which should include any
+ * secret from which the credentials were derived.  The directory is
+ * created readable only by its owner, and each file is written that way,
+ * to a temporary file which is renamed into place.  On POSIX systems, an
+ * entry is ignored unless its file is owned by us and unreadable by others.
+ *
+ * The cache is best effort: failures to read or write it are ignored, and
+ * the credentials are fetched as if it didn't exist.
+ */
+class ARBITER_DLL CredentialCache
+{
+public:
+    /** Cache within the local directory @p dir, which is created if need
+     * be.
+     */
+    explicit CredentialCache(std::string dir);
+
+    /** The cache configured by the `credentialCache` directory of the
+     * stringified JSON driver configuration @p j, or else by the
+     * environment variable `ARBITER_CREDENTIAL_CACHE`, or null if neither
+     * is set.
+     */
+    static std::shared_ptr<CredentialCache> create(std::string j);
+
+    /** The value stored for @p key, if it expires more than @p minRemaining
+     * seconds from now, with its expiration in @p expiration.
+     */
+    std::unique_ptr<std::string> get(
+            const std::string& key,
+            int64_t minRemaining,
+            int64_t& expiration) const;
+
+    /** Store @p value for @p key until the Unix time @p expiration. */
+    void put(
+            const std::string& key,
+            const std::string& value,
+            int64_t expiration) const;
+
+    const std::string& dir() const { return m_dir; }
+
+private:
+    std::string pathOf(const std::string& key) const;
+
+    const std::string m_dir;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -1,19 +1,26 @@
 #include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
+#include <future>
 #include <ios>
-#include <iostream>
+#include <sstream>
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/util/curl.hpp>
 #include <arbiter/util/http.hpp>
+#include <arbiter/util/log.hpp>
+#include <arbiter/util/md5.hpp>
+#include <arbiter/util/probes.hpp>
+#include <arbiter/util/transforms.hpp>
 #include <arbiter/util/util.hpp>
 #include <arbiter/util/json.hpp>
 
 
-#ifdef ARBITER_ZLIB
-#include <arbiter/third/gzip/decompress.hpp>
 #endif
 
+#ifdef ARBITER_ZLIB
+#include <zlib.h>
 #endif
 
 #ifdef ARBITER_CURL
@@ -30,20 +37,107 @@ namespace arbiter
 namespace http
 {
 
-namespace
+struct PutData
 {
-#ifdef ARBITER_CURL
-    struct PutData
+    PutData(const char* data, std::size_t size)
+        : data(data)
+        , size(size)
+        , offset(0)
+    { }
+
+    const char* data;
+    std::size_t size;
+    std::size_t offset;
+};
+
+#ifdef ARBITER_ZLIB
+// Incremental gzip/zlib decoder, so that compressed bodies are decoded as
+// they arrive rather than buffered and decoded in a second full-size pass.
+class Inflater
+{
+public:
+    Inflater()
+        : m_buffer(64 * 1024)
     {
-        PutData(const std::vector<char>& data)
-            : data(data)
-            , offset(0)
-        { }
+        m_z.zalloc = Z_NULL;
+        m_z.zfree = Z_NULL;
+        m_z.opaque = Z_NULL;
+        m_z.avail_in = 0;
+        m_z.next_in = Z_NULL;
+
+        // Automatically detect a gzip or zlib header.
+        if (inflateInit2(&m_z, 15 + 32) != Z_OK)
+        {
+            throw ArbiterError("Could not initialize decompression");
+        }
+    }
 
-        const std::vector<char>& data;
-        std::size_t offset;
-    };
+    ~Inflater() { inflateEnd(&m_z); }
+
+    // Decode @p size bytes of input, passing decoded output to @p out.
+    template <typename F>
+    void write(const char* data, const std::size_t size, F out)
+    {
+        m_z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        m_z.avail_in = static_cast<uInt>(size);
+
+        do
+        {
+            m_z.next_out = reinterpret_cast<Bytef*>(m_buffer.data());
+            m_z.avail_out = static_cast<uInt>(m_buffer.size());
+
+            const int code(inflate(&m_z, Z_NO_FLUSH));
+            if (code != Z_OK && code != Z_STREAM_END && code != Z_BUF_ERROR)
+            {
+                throw ArbiterError("Could not decompress response");
+            }
+
+            const std::size_t n(m_buffer.size() - m_z.avail_out);
+            if (n) out(m_buffer.data(), n);
+
+            m_done = code == Z_STREAM_END;
+
+            // Concatenated gzip members are decoded as one stream.
+            if (m_done && m_z.avail_in) inflateReset(&m_z);
+        }
+        while (m_z.avail_in || !m_z.avail_out);
+    }
+
+    // True if the input seen so far ends at the end of a complete stream.
+    bool done() const { return m_done; }
+
+    // Decode the whole of the encoded body @p raw.
+    static std::vector<char> decode(const std::vector<char>& raw)
+    {
+        std::vector<char> out;
+        out.reserve(raw.size() * 4);
+
+        Inflater inflater;
+        auto append([&out](const char* d, std::size_t n)
+        {
+            out.insert(out.end(), d, d + n);
+        });
+        inflater.write(raw.data(), raw.size(), append);
+
+        if (!inflater.done())
+        {
+            throw ArbiterError("Compressed response was truncated");
+        }
+        return out;
+    }
+
+private:
+    z_stream m_z;
+    std::vector<char> m_buffer;
+    bool m_done = false;
+};
+#else
+class Inflater { };
+#endif
 
+namespace
+{
+#ifdef ARBITER_CURL
     std::size_t getCb(
             const char* in,
             std::size_t size,
@@ -68,8 +162,8 @@ namespace
         const std::size_t fullBytes(
                 (std::min)(
                     size * num,
-                    in->data.size() - in->offset));
-        std::memcpy(out, in->data.data() + in->offset, fullBytes);
+                    in->size - in->offset));
+        std::memcpy(out, in->data + in->offset, fullBytes);
 
         in->offset += fullBytes;
         return fullBytes;
@@ -83,26 +177,121 @@ namespace
     {
         const std::size_t fullBytes(size * num);
 
-        std::string data(buffer, fullBytes);
-        data.erase(std::remove(data.begin(), data.end(), '\n'), data.end());
-        data.erase(std::remove(data.begin(), data.end(), '\r'), data.end());
+        const char* begin(buffer);
+        const char* end(buffer + fullBytes);
+        while (end != begin && (end[-1] == '\n' || end[-1] == '\r')) --end;
 
-        const std::size_t split(data.find_first_of(":"));
+        // A status line begins a new response, as after a redirect, whose
+        // headers replace those of the last.
+        if (end - begin >= 5 && std::memcmp(begin, "HTTP/", 5) == 0)
+        {
+            out->clear();
+            return fullBytes;
+        }
 
         // No colon means it isn't a header with data.
-        if (split == std::string::npos) return fullBytes;
+        const char* colon(
+                static_cast<const char*>(std::memchr(begin, ':', end - begin)));
+        if (!colon) return fullBytes;
+
+        const char* value(colon + 1);
+        while (value != end && (*value == ' ' || *value == '\t')) ++value;
+        while (end != value && (end[-1] == ' ' || end[-1] == '\t')) --end;
+
+        // Repeated headers are combined into a list, as they may be.
+        std::string key(begin, colon);
+        auto it(out->find(key));
+        if (it == out->end())
+        {
+            out->emplace(std::move(key), std::string(value, end));
+        }
+        else it->second.append(",").append(value, end);
 
-        const std::string key(data.substr(0, split));
-        const std::string val(data.substr(split + 1, data.size()));
+        return fullBytes;
+    }
 
-        (*out)[key] = val;
+    // The value of the header @p name, or null.
+    const std::string* headerValue(
+            const http::Headers& headers,
+            const std::string& name)
+    {
+        const auto it(headers.find(name));
+        return it != headers.end() ? &it->second : nullptr;
+    }
 
-        return fullBytes;
+    // The MD5 which a complete body should have according to its @p headers,
+    // or an empty string if they don't claim one.  Sets @p hex if it is hex
+    // encoded, rather than base64.
+    std::string expectedMd5(const http::Headers& headers, bool& hex)
+    {
+        hex = false;
+
+        if (const std::string* v = headerValue(headers, "Content-MD5"))
+        {
+            return *v;
+        }
+
+        // Google lists its hashes in one header, like "crc32c=...,md5=...".
+        if (const std::string* v = headerValue(headers, "x-goog-hash"))
+        {
+            std::size_t pos(0);
+            while (pos < v->size())
+            {
+                std::size_t end(v->find(',', pos));
+                if (end == std::string::npos) end = v->size();
+
+                std::string entry(v->substr(pos, end - pos));
+                while (entry.size() && entry.front() == ' ') entry.erase(0, 1);
+                if (entry.compare(0, 4, "md5=") == 0) return entry.substr(4);
+
+                pos = end + 1;
+            }
+        }
+
+        // The ETag of an S3 object is the hex MD5 of its body, unless it was
+        // uploaded in parts or encrypted with KMS or customer keys.
+        if (!headerValue(headers, "x-amz-request-id")) return std::string();
+
+        const std::string* sse(
+                headerValue(headers, "x-amz-server-side-encryption"));
+        if (sse && sse->compare(0, 7, "aws:kms") == 0) return std::string();
+        if (headerValue(
+                    headers,
+                    "x-amz-server-side-encryption-customer-algorithm"))
+        {
+            return std::string();
+        }
+
+        const std::string* etag(headerValue(headers, "ETag"));
+        if (!etag) return std::string();
+
+        std::string md5(*etag);
+        md5.erase(std::remove(md5.begin(), md5.end(), '"'), md5.end());
+        if (md5.size() != 32) return std::string();
+
+        for (char& c : md5)
+        {
+            if (!std::isxdigit(static_cast<unsigned char>(c)))
+            {
+                return std::string();
+            }
+            c = static_cast<char>(::tolower(c));
+        }
+
+        hex = true;
+        return md5;
     }
 
-    std::size_t eatLogging(void *out, size_t size, size_t num, void *in)
+    // True if our curl can speak HTTP/3, falling back to earlier versions
+    // for servers which don't, as it can from 7.88.
+    bool http3Available()
     {
-        return size * num;
+#if LIBCURL_VERSION_NUM >= 0x075800
+        return (curl_version_info(CURLVERSION_NOW)->features &
+                CURL_VERSION_HTTP3) != 0;
+#else
+        return false;
+#endif
     }
 
 #else
@@ -110,19 +299,41 @@ namespace
 #endif // ARBITER_CURL
 } // unnamed namespace
 
-Curl::Curl(const std::string s)
+std::shared_ptr<const CurlConfig> CurlConfig::create(const std::string s)
 {
+    std::shared_ptr<CurlConfig> config(new CurlConfig());
+    CurlConfig& cfg(*config);
+
 #ifdef ARBITER_CURL
     const json c(s.size() ? json::parse(s) : json::object());
 
-    m_curl = curl_easy_init();
-
     // Configurable entries are:
     //      - timeout           (CURLOPT_LOW_SPEED_TIME)
     //      - followRedirect    (CURLOPT_FOLLOWLOCATION)
     //      - caBundle          (CURLOPT_CAPATH)
     //      - caInfo            (CURLOPT_CAINFO)
     //      - verifyPeer        (CURLOPT_SSL_VERIFYPEER)
+    //      - http2             (CURLOPT_HTTP_VERSION, CURLOPT_PIPEWAIT)
+    //      - http3             (CURLOPT_HTTP_VERSION, CURLOPT_PIPEWAIT)
+    //      - verify            (check response bodies against their MD5)
+    //      - expectThreshold   (upload size above which we send
+    //                          `Expect: 100-continue`)
+    //      - bandwidth         (CURLOPT_MAX_RECV_SPEED_LARGE and
+    //                          CURLOPT_MAX_SEND_SPEED_LARGE, from the
+    //                          `recv` and `send` of its `transfer` entry)
+    //      - proxy             (CURLOPT_PROXY)
+    //      - unixSocket        (CURLOPT_UNIX_SOCKET_PATH)
+    //      - connectTimeout    (CURLOPT_CONNECTTIMEOUT_MS)
+    //      - ipResolve         (CURLOPT_IPRESOLVE)
+    //      - dnsCacheTimeout   (CURLOPT_DNS_CACHE_TIMEOUT)
+    //      - bufferSize        (CURLOPT_BUFFERSIZE)
+    //      - uploadBufferSize  (CURLOPT_UPLOAD_BUFFERSIZE)
+    //      - tcpNoDelay        (CURLOPT_TCP_NODELAY)
+    //      - tcpKeepAlive      (CURLOPT_TCP_KEEPALIVE, and from its `idle`
+    //                          and `interval` if it is an object,
+    //                          CURLOPT_TCP_KEEPIDLE and CURLOPT_TCP_KEEPINTVL)
+    //
+    // Each may be set for the drivers of a single type via `http.pools`.
 
     using Keys = std::vector<std::string>;
     auto find([](const Keys& keys)->std::unique_ptr<std::string>
@@ -138,38 +349,101 @@ Curl::Curl(const std::string s)
 
     if (!c.is_null())
     {
-        m_verbose = c.value("verbose", false);
+        cfg.verbose = c.value("verbose", false);
         const auto& h(c.value("http", json::object()));
 
         if (!h.is_null())
         {
             if (h.count("timeout"))
             {
-                m_timeout = h["timeout"].get<long>();
+                cfg.timeout = h["timeout"].get<long>();
             }
 
             if (h.count("followRedirect"))
             {
-                m_followRedirect = h["followRedirect"].get<bool>();
+                cfg.followRedirect = h["followRedirect"].get<bool>();
             }
 
             if (h.count("caBundle"))
             {
-                m_caPath = mk(h["caBundle"].get<std::string>());
+                cfg.caPath = mk(h["caBundle"].get<std::string>());
             }
             else if (h.count("caPath"))
             {
-                m_caPath = mk(h["caPath"].get<std::string>());
+                cfg.caPath = mk(h["caPath"].get<std::string>());
             }
 
             if (h.count("caInfo"))
             {
-                m_caInfo = mk(h["caInfo"].get<std::string>());
+                cfg.caInfo = mk(h["caInfo"].get<std::string>());
             }
 
             if (h.count("verifyPeer"))
             {
-                m_verifyPeer = h["verifyPeer"].get<bool>();
+                cfg.verifyPeer = h["verifyPeer"].get<bool>();
+            }
+
+            if (h.count("http2"))
+            {
+                cfg.http2 = h["http2"].get<bool>();
+            }
+
+            if (h.count("http3"))
+            {
+                cfg.http3 = h["http3"].get<bool>();
+            }
+
+            if (h.count("verify"))
+            {
+                cfg.verify = h["verify"].get<bool>();
+            }
+
+            if (h.count("expectThreshold"))
+            {
+                cfg.expectThreshold = h["expectThreshold"].get<std::size_t>();
+            }
+
+            if (h.count("proxy"))
+            {
+                cfg.proxy = mk(h["proxy"].get<std::string>());
+            }
+
+            if (h.count("unixSocket"))
+            {
+                cfg.unixSocket = mk(h["unixSocket"].get<std::string>());
+            }
+
+            cfg.connectTimeout = h.value(
+                    "connectTimeout",
+                    cfg.connectTimeout);
+            cfg.ipResolve = h.value("ipResolve", cfg.ipResolve);
+            cfg.dnsCacheTimeout = h.value(
+                    "dnsCacheTimeout",
+                    cfg.dnsCacheTimeout);
+            cfg.bufferSize = h.value("bufferSize", 0L);
+            cfg.uploadBufferSize = h.value("uploadBufferSize", 0L);
+            cfg.tcpNoDelay = h.value("tcpNoDelay", true);
+
+            const json keepAlive(h.value("tcpKeepAlive", json()));
+            cfg.tcpKeepAlive =
+                keepAlive.is_object() ||
+                (keepAlive.is_boolean() && keepAlive.get<bool>());
+            if (keepAlive.is_object())
+            {
+                cfg.tcpKeepIdle = keepAlive.value("idle", cfg.tcpKeepIdle);
+                cfg.tcpKeepInterval =
+                    keepAlive.value("interval", cfg.tcpKeepInterval);
+            }
+
+            const json bandwidth(h.value("bandwidth", json::object()));
+            const json transfer(
+                    bandwidth.is_object() ?
+                        bandwidth.value("transfer", json::object()) :
+                        json::object());
+            if (transfer.is_object())
+            {
+                cfg.maxRecvSpeed = transfer.value("recv", std::uint64_t(0));
+                cfg.maxSendSpeed = transfer.value("send", std::uint64_t(0));
             }
         }
     }
@@ -189,27 +463,85 @@ Curl::Curl(const std::string s)
     };
     Keys caPathKeys{ "CURL_CA_PATH", "CURL_CA_BUNDLE", "ARBITER_CA_PATH" };
     Keys caInfoKeys{ "CURL_CAINFO", "CURL_CA_INFO", "ARBITER_CA_INFO" };
+    Keys http2Keys{ "ARBITER_HTTP2" };
+    Keys http3Keys{ "ARBITER_HTTP3" };
+    Keys verifyBodyKeys{ "ARBITER_HTTP_VERIFY" };
+    Keys expectKeys{ "ARBITER_HTTP_EXPECT_THRESHOLD" };
+    Keys unixSocketKeys{ "ARBITER_HTTP_UNIX_SOCKET" };
+    Keys ipResolveKeys{ "ARBITER_HTTP_IP_RESOLVE" };
+
+    if (auto v = find(verboseKeys)) cfg.verbose = !!std::stol(*v);
+    if (auto v = find(timeoutKeys)) cfg.timeout = std::stol(*v);
+    if (auto v = find(redirKeys)) cfg.followRedirect = !!std::stol(*v);
+    if (auto v = find(verifyKeys)) cfg.verifyPeer = !!std::stol(*v);
+    if (auto v = find(caPathKeys)) cfg.caPath = mk(*v);
+    if (auto v = find(caInfoKeys)) cfg.caInfo = mk(*v);
+    if (auto v = find(http2Keys)) cfg.http2 = !!std::stol(*v);
+    if (auto v = find(http3Keys)) cfg.http3 = !!std::stol(*v);
+    if (auto v = find(verifyBodyKeys)) cfg.verify = !!std::stol(*v);
+    if (auto v = find(expectKeys)) cfg.expectThreshold = std::stoull(*v);
+    if (auto v = find(unixSocketKeys)) cfg.unixSocket = mk(*v);
+    if (auto v = find(ipResolveKeys)) cfg.ipResolve = *v;
+
+    if (cfg.ipResolve != "v4" && cfg.ipResolve != "v6" &&
+            cfg.ipResolve != "any")
+    {
+        throw ArbiterError("Invalid http.ipResolve: " + cfg.ipResolve);
+    }
 
-    if (auto v = find(verboseKeys)) m_verbose = !!std::stol(*v);
-    if (auto v = find(timeoutKeys)) m_timeout = std::stol(*v);
-    if (auto v = find(redirKeys)) m_followRedirect = !!std::stol(*v);
-    if (auto v = find(verifyKeys)) m_verifyPeer = !!std::stol(*v);
-    if (auto v = find(caPathKeys)) m_caPath = mk(*v);
-    if (auto v = find(caInfoKeys)) m_caInfo = mk(*v);
+    // Without QUIC in our curl, the nearest we can offer is HTTP/2.
+    if (cfg.http3 && !http3Available())
+    {
+        static bool warned(false);
+        if (!warned)
+        {
+            warned = true;
+            logging::warn(
+                    "HTTP/3 requested, but curl was built without it: "
+                    "using HTTP/2 where available");
+        }
+        cfg.http3 = false;
+        cfg.http2 = true;
+    }
 
     static bool logged(false);
-    if (m_verbose && !logged)
+    if (cfg.verbose && !logged)
     {
         logged = true;
-        std::cout << "Curl config:" << std::boolalpha <<
-            "\n\ttimeout: " << m_timeout << "s" <<
-            "\n\tfollowRedirect: " << m_followRedirect <<
-            "\n\tverifyPeer: " << m_verifyPeer <<
-            "\n\tcaBundle: " << (m_caPath ? *m_caPath : "(default)") <<
-            "\n\tcaInfo: " << (m_caInfo ? *m_caInfo : "(default)") <<
-            std::endl;
+        std::ostringstream ss;
+        ss << "Curl config:" << std::boolalpha <<
+            "\n\ttimeout: " << cfg.timeout << "s" <<
+            "\n\tfollowRedirect: " << cfg.followRedirect <<
+            "\n\tverifyPeer: " << cfg.verifyPeer <<
+            "\n\thttp2: " << cfg.http2 <<
+            "\n\thttp3: " << cfg.http3 <<
+            "\n\tverify: " << cfg.verify <<
+            "\n\texpectThreshold: " << cfg.expectThreshold <<
+            "\n\tcaBundle: " << (cfg.caPath ? *cfg.caPath : "(default)") <<
+            "\n\tcaInfo: " << (cfg.caInfo ? *cfg.caInfo : "(default)") <<
+            "\n\tproxy: " << (cfg.proxy ? *cfg.proxy : "(default)") <<
+            "\n\tunixSocket: " <<
+                (cfg.unixSocket ? *cfg.unixSocket : "(none)") <<
+            "\n\tconnectTimeout: " << cfg.connectTimeout << "ms" <<
+            "\n\tipResolve: " << cfg.ipResolve <<
+            "\n\tdnsCacheTimeout: " << cfg.dnsCacheTimeout << "s" <<
+            "\n\tbufferSize: " << cfg.bufferSize <<
+            "\n\tuploadBufferSize: " << cfg.uploadBufferSize <<
+            "\n\ttcpNoDelay: " << cfg.tcpNoDelay <<
+            "\n\ttcpKeepAlive: " << cfg.tcpKeepAlive;
+        logging::info(ss.str());
     }
 #endif
+
+    return config;
+}
+
+Curl::Curl(std::shared_ptr<const CurlConfig> config)
+    : m_config(std::move(config))
+{
+#ifdef ARBITER_CURL
+    m_curl = curl_easy_init();
+#endif
 }
 
 Curl::~Curl()
@@ -221,239 +553,1179 @@ Curl::~Curl()
 #endif
 }
 
-void Curl::init(
-        const std::string rawPath,
-        const Headers& headers,
-        const Query& query)
+void Curl::configure()
 {
 #ifdef ARBITER_CURL
-    // Reset our curl instance and header list.
-    curl_slist_free_all(m_headers);
-    m_headers = nullptr;
-
-    // Set path.
-    const std::string path(rawPath + buildQueryString(query));
-    curl_easy_setopt(m_curl, CURLOPT_URL, path.c_str());
-
     // Needed for multithreaded Curl usage.
     curl_easy_setopt(m_curl, CURLOPT_NOSIGNAL, 1L);
 
-    // Substantially faster DNS lookups without IPv6.
-    curl_easy_setopt(m_curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+    if (m_share) curl_easy_setopt(m_curl, CURLOPT_SHARE, m_share->get());
+
+    // Substantially faster DNS lookups without IPv6, by default.
+    // Restricting the family would also keep curl from using a Unix domain
+    // socket.
+    if (!m_config->unixSocket)
+    {
+        const std::string& family(m_config->ipResolve);
+        curl_easy_setopt(
+                m_curl,
+                CURLOPT_IPRESOLVE,
+                family == "v4" ? CURL_IPRESOLVE_V4 :
+                family == "v6" ? CURL_IPRESOLVE_V6 :
+                CURL_IPRESOLVE_WHATEVER);
+    }
 
     // Don't wait forever.  Use the low-speed options instead of the timeout
     // option to make the timeout a sliding window instead of an absolute.
     curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
-    curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_TIME, m_timeout);
+    curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_TIME, m_config->timeout);
 
-    curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT_MS, 2000L);
+    curl_easy_setopt(
+            m_curl,
+            CURLOPT_CONNECTTIMEOUT_MS,
+            m_config->connectTimeout);
     curl_easy_setopt(m_curl, CURLOPT_ACCEPTTIMEOUT_MS, 2000L);
+    curl_easy_setopt(
+            m_curl,
+            CURLOPT_DNS_CACHE_TIMEOUT,
+            m_config->dnsCacheTimeout);
 
     auto toLong([](bool b) { return b ? 1L : 0L; });
 
-    // Configuration options.
-    curl_easy_setopt(m_curl, CURLOPT_VERBOSE, toLong(m_verbose));
-    curl_easy_setopt(m_curl, CURLOPT_FOLLOWLOCATION, toLong(m_followRedirect));
-    curl_easy_setopt(m_curl, CURLOPT_SSL_VERIFYPEER, toLong(m_verifyPeer));
-    if (m_caPath) curl_easy_setopt(m_curl, CURLOPT_CAPATH, m_caPath->c_str());
-    if (m_caInfo) curl_easy_setopt(m_curl, CURLOPT_CAINFO, m_caInfo->c_str());
-
-    // Insert supplied headers.
-    for (const auto& h : headers)
+    // Larger buffers mean fewer callbacks per byte on fast links.  Curl
+    // clamps them to its own limits.
+    if (m_config->bufferSize)
     {
-        m_headers = curl_slist_append(
-                m_headers,
-                (h.first + ": " + h.second).c_str());
+        curl_easy_setopt(m_curl, CURLOPT_BUFFERSIZE, m_config->bufferSize);
+    }
+#if LIBCURL_VERSION_NUM >= 0x073E00
+    if (m_config->uploadBufferSize)
+    {
+        curl_easy_setopt(
+                m_curl,
+                CURLOPT_UPLOAD_BUFFERSIZE,
+                m_config->uploadBufferSize);
     }
-#else
-    throw ArbiterError(fail);
 #endif
-}
 
-int Curl::perform()
-{
-#ifdef ARBITER_CURL
-    long httpCode(0);
+    curl_easy_setopt(m_curl, CURLOPT_TCP_NODELAY, toLong(m_config->tcpNoDelay));
+    if (m_config->tcpKeepAlive)
+    {
+        curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPIDLE, m_config->tcpKeepIdle);
+        curl_easy_setopt(
+                m_curl,
+                CURLOPT_TCP_KEEPINTVL,
+                m_config->tcpKeepInterval);
+    }
 
-    const auto code(curl_easy_perform(m_curl));
-    curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &httpCode);
-    curl_easy_reset(m_curl);
+    // Configuration options.
+    const CurlConfig& c(*m_config);
+    curl_easy_setopt(m_curl, CURLOPT_VERBOSE, toLong(c.verbose));
+    curl_easy_setopt(m_curl, CURLOPT_FOLLOWLOCATION, toLong(c.followRedirect));
+    curl_easy_setopt(m_curl, CURLOPT_SSL_VERIFYPEER, toLong(c.verifyPeer));
+    if (c.caPath) curl_easy_setopt(m_curl, CURLOPT_CAPATH, c.caPath->c_str());
+    if (c.caInfo) curl_easy_setopt(m_curl, CURLOPT_CAINFO, c.caInfo->c_str());
+    if (c.proxy) curl_easy_setopt(m_curl, CURLOPT_PROXY, c.proxy->c_str());
+    if (c.unixSocket)
+    {
+        curl_easy_setopt(
+                m_curl,
+                CURLOPT_UNIX_SOCKET_PATH,
+                c.unixSocket->c_str());
+    }
 
-    if (code != CURLE_OK) httpCode = 500;
+    if (c.maxRecvSpeed)
+    {
+        curl_easy_setopt(
+                m_curl,
+                CURLOPT_MAX_RECV_SPEED_LARGE,
+                static_cast<curl_off_t>(c.maxRecvSpeed));
+    }
+    if (c.maxSendSpeed)
+    {
+        curl_easy_setopt(
+                m_curl,
+                CURLOPT_MAX_SEND_SPEED_LARGE,
+                static_cast<curl_off_t>(c.maxSendSpeed));
+    }
 
-    return httpCode;
-#else
-    throw ArbiterError(fail);
+    if (c.http3)
+    {
+#if LIBCURL_VERSION_NUM >= 0x075800
+        // Try QUIC for HTTPS, falling back to HTTP/2 or HTTP/1.1 over TCP if
+        // the server doesn't answer it, as across lossy links where a lost
+        // packet would otherwise stall every stream of a TCP connection.
+        curl_easy_setopt(
+                m_curl,
+                CURLOPT_HTTP_VERSION,
+                static_cast<long>(CURL_HTTP_VERSION_3));
+        curl_easy_setopt(m_curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+    }
+    else if (c.http2)
+    {
+        // Negotiate HTTP/2 over TLS, falling back to HTTP/1.1 if the server
+        // doesn't offer it.  Waiting for an existing connection to confirm
+        // multiplexing, rather than opening another, lets many concurrent
+        // transfers share a few connections when driven by the async engine.
+        curl_easy_setopt(
+                m_curl,
+                CURLOPT_HTTP_VERSION,
+                static_cast<long>(CURL_HTTP_VERSION_2TLS));
+        curl_easy_setopt(m_curl, CURLOPT_PIPEWAIT, 1L);
+    }
+
+    // Set up callback and data pointer for received headers.
+    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, headerLineCb);
+    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, this);
+
+    m_configured = true;
 #endif
 }
 
-Response Curl::get(
-        std::string path,
-        Headers headers,
-        Query query,
-        const std::size_t reserve)
+void Curl::init(
+        const std::string& rawPath,
+        const Headers& headers,
+        const Query& query)
 {
 #ifdef ARBITER_CURL
-    std::vector<char> data;
+    // The options of the handle itself persist between transfers, so that
+    // only those of the request need to be set.  The share is attached by
+    // our pool after construction, so this waits for the first transfer.
+    if (!m_configured) configure();
 
-    if (reserve) data.reserve(reserve);
-
-    init(path, headers, query);
+    m_streamed = false;
 
-    // Register callback function and data pointer to consume the result.
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, getCb);
-    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &data);
+    // Set path.
+    const std::string path(rawPath + buildQueryString(query));
+    curl_easy_setopt(m_curl, CURLOPT_URL, path.c_str());
 
-    // Insert all headers into the request.
-    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+    // Undo the method-specific options of the previous transfer.  Going
+    // back to GET also clears CURLOPT_NOBODY and CURLOPT_UPLOAD.
+    curl_easy_setopt(m_curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, nullptr);
+    curl_easy_setopt(m_curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(m_curl, CURLOPT_TIMEOUT_MS, 0L);
 
-    // Set up callback and data pointer for received headers.
-    Headers receivedHeaders;
-    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, headerCb);
-    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &receivedHeaders);
+    // Successive requests often carry the same headers, in which case their
+    // list is kept rather than rebuilt.
+    if (!m_headers || headers != m_listedHeaders)
+    {
+        curl_slist_free_all(m_headers);
+        m_headers = nullptr;
 
-    // Run the command.
-    const int httpCode(perform());
+        std::string line;
+        for (const auto& h : headers)
+        {
+            line.assign(h.first).append(": ").append(h.second);
+            m_headers = curl_slist_append(m_headers, line.c_str());
+        }
+        m_listedHeaders = headers;
+    }
 
-    for (auto& h : receivedHeaders)
+    // Abort if our caller's work is cancelled, and don't run past its
+    // deadline.
+    m_cancel.reset();
+    if (const CancelToken* token = CancelScope::current())
     {
-        std::string& v(h.second);
-        while (v.size() && v.front() == ' ') v = v.substr(1);
-        while (v.size() && v.back() == ' ') v.pop_back();
+        m_cancel.reset(new CancelToken(*token));
+
+        // Round up, so that a timeout is seen as the deadline passing.
+        if (m_cancel->hasDeadline())
+        {
+            const auto remaining(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        m_cancel->deadline() - CancelToken::Clock::now()));
+            curl_easy_setopt(
+                    m_curl,
+                    CURLOPT_TIMEOUT_MS,
+                    static_cast<long>((std::max)(
+                            remaining.count() + 1,
+                            std::chrono::milliseconds::rep(1))));
+        }
     }
 
-    if (receivedHeaders["Content-Encoding"] == "gzip")
+    // Watch our progress to observe cancellation, to pace our transfer
+    // within the bandwidth of our pool, and to report it to our caller.
+    m_received = 0;
+    m_sent = 0;
+    m_progress = ProgressScope::current();
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+    if (m_cancel || m_recvLimit || m_sendLimit || m_progress)
     {
-#ifdef ARBITER_ZLIB
-        std::string s(gzip::decompress(data.data(), data.size()));
-        data.assign(s.begin(), s.end());
-#else
-        throw ArbiterError("Cannot decompress zlib");
-#endif
+        curl_easy_setopt(m_curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(m_curl, CURLOPT_XFERINFOFUNCTION, progressCb);
+        curl_easy_setopt(m_curl, CURLOPT_XFERINFODATA, this);
     }
-
-    return Response(httpCode, data, receivedHeaders);
+#endif
 #else
     throw ArbiterError(fail);
 #endif
 }
 
-Response Curl::head(std::string path, Headers headers, Query query)
+int Curl::progressCb(
+        Curl* curl,
+        const std::int64_t,
+        const std::int64_t received,
+        const std::int64_t,
+        const std::int64_t sent)
 {
-#ifdef ARBITER_CURL
-    std::vector<char> data;
-
-    init(path, headers, query);
+    // Nonzero aborts the transfer.
+    const CancelToken* token(curl->m_cancel.get());
+    if (token && token->cancelled()) return 1;
 
-    // Register callback function and data pointer to consume the result.
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, getCb);
-    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &data);
+    RateLimit::Clock::duration pause(0);
+    if (curl->m_recvLimit && received > curl->m_received)
+    {
+        pause += curl->m_recvLimit->take(received - curl->m_received);
+    }
+    if (curl->m_sendLimit && sent > curl->m_sent)
+    {
+        pause += curl->m_sendLimit->take(sent - curl->m_sent);
+    }
+    if (Progress* progress = curl->m_progress)
+    {
+        // Called about once a second even without data, so that a stall is
+        // still reported.
+        if (received > curl->m_received)
+        {
+            progress->add(received - curl->m_received);
+        }
+        else progress->poll();
+    }
 
-    // Insert all headers into the request.
-    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+    curl->m_received = received;
+    curl->m_sent = sent;
 
-    // Set up callback and data pointer for received headers.
-    Headers receivedHeaders;
-    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, headerCb);
-    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &receivedHeaders);
+    // Pausing here holds back the transfer, and in the async engine, every
+    // transfer with it, which is as it should be since the limit is shared.
+    if (pause.count())
+    {
+        if (token) return token->sleep(pause) ? 0 : 1;
+        std::this_thread::sleep_for(pause);
+    }
 
-    // Specify a HEAD request.
-    curl_easy_setopt(m_curl, CURLOPT_NOBODY, 1L);
+    return 0;
+}
 
-    // Run the command.
-    const int httpCode(perform());
-    return Response(httpCode, data, receivedHeaders);
+bool Curl::transient() const
+{
+#ifdef ARBITER_CURL
+    switch (m_error)
+    {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+#if LIBCURL_VERSION_NUM >= 0x072200
+        case CURLE_HTTP2:
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073100
+        case CURLE_HTTP2_STREAM:
+#endif
+            return true;
+        default:
+            return false;
+    }
 #else
-    throw ArbiterError(fail);
+    return false;
 #endif
 }
 
-Response Curl::put(
-        std::string path,
-        const std::vector<char>& data,
-        Headers headers,
-        Query query)
+Response Curl::perform()
 {
 #ifdef ARBITER_CURL
-    init(path, headers, query);
-
-    std::unique_ptr<PutData> putData(new PutData(data));
-
-    // Register callback function and data pointer to create the request.
-    curl_easy_setopt(m_curl, CURLOPT_READFUNCTION, putCb);
-    curl_easy_setopt(m_curl, CURLOPT_READDATA, putData.get());
+    int code(CURLE_OK);
 
-    // Insert all headers into the request.
-    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
-
-    // Specify that this is a PUT request.
-    curl_easy_setopt(m_curl, CURLOPT_PUT, 1L);
-
-    // Must use this for binary data, otherwise curl will use strlen(), which
-    // will likely be incorrect.
-    curl_easy_setopt(
-            m_curl,
-            CURLOPT_INFILESIZE_LARGE,
-            static_cast<curl_off_t>(data.size()));
+    ARBITER_PROBE(http__start, m_curl);
 
-    // Hide Curl's habit of printing things to console even with verbose set
-    // to false.
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, eatLogging);
+    if (m_multi)
+    {
+        std::promise<int> promise;
+        std::future<int> future(promise.get_future());
+        m_multi->add(m_curl, [&promise](int c) { promise.set_value(c); });
+        code = future.get();
+    }
+    else
+    {
+        code = curl_easy_perform(m_curl);
+    }
 
-    // Run the command.
-    const int httpCode(perform());
-    return Response(httpCode);
+    return finish(code);
 #else
     throw ArbiterError(fail);
 #endif
 }
 
-Response Curl::post(
-        std::string path,
-        const std::vector<char>& data,
-        Headers headers,
-        Query query)
+Response Curl::finish(const int code)
 {
 #ifdef ARBITER_CURL
-    init(path, headers, query);
+    long httpCode(0);
 
-    std::unique_ptr<PutData> putData(new PutData(data));
-    std::vector<char> writeData;
+    curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &httpCode);
 
-    // Register callback function and data pointer to create the request.
-    curl_easy_setopt(m_curl, CURLOPT_READFUNCTION, putCb);
-    curl_easy_setopt(m_curl, CURLOPT_READDATA, putData.get());
+    Transfer transfer;
 
-    // Register callback function and data pointer to consume the result.
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, getCb);
-    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &writeData);
+    char* url(nullptr);
+    curl_easy_getinfo(m_curl, CURLINFO_EFFECTIVE_URL, &url);
+    if (url) transfer.url = url;
 
-    // Insert all headers into the request.
-    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+#if LIBCURL_VERSION_NUM >= 0x073D00
+    auto time([this](CURLINFO info)
+    {
+        curl_off_t t(0);
+        curl_easy_getinfo(m_curl, info, &t);
+        return Transfer::Duration(t);
+    });
 
-    // Set up callback and data pointer for received headers.
-    Headers receivedHeaders;
-    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, headerCb);
-    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &receivedHeaders);
+    transfer.dns = time(CURLINFO_NAMELOOKUP_TIME_T);
+    transfer.connect = time(CURLINFO_CONNECT_TIME_T);
+    transfer.tls = time(CURLINFO_APPCONNECT_TIME_T);
+    transfer.firstByte = time(CURLINFO_STARTTRANSFER_TIME_T);
+    transfer.total = time(CURLINFO_TOTAL_TIME_T);
+#else
+    auto time([this](CURLINFO info)
+    {
+        double t(0);
+        curl_easy_getinfo(m_curl, info, &t);
+        return Transfer::Duration(static_cast<long long>(t * 1000000));
+    });
 
-    // Specify that this is a POST request.
-    curl_easy_setopt(m_curl, CURLOPT_POST, 1L);
+    transfer.dns = time(CURLINFO_NAMELOOKUP_TIME);
+    transfer.connect = time(CURLINFO_CONNECT_TIME);
+    transfer.tls = time(CURLINFO_APPCONNECT_TIME);
+    transfer.firstByte = time(CURLINFO_STARTTRANSFER_TIME);
+    transfer.total = time(CURLINFO_TOTAL_TIME);
+#endif
+
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t sent(0), received(0);
+    curl_easy_getinfo(m_curl, CURLINFO_SIZE_UPLOAD_T, &sent);
+    curl_easy_getinfo(m_curl, CURLINFO_SIZE_DOWNLOAD_T, &received);
+#else
+    double sent(0), received(0);
+    curl_easy_getinfo(m_curl, CURLINFO_SIZE_UPLOAD, &sent);
+    curl_easy_getinfo(m_curl, CURLINFO_SIZE_DOWNLOAD, &received);
+#endif
+    transfer.bytesSent = static_cast<std::uint64_t>(sent);
+    transfer.bytesReceived = static_cast<std::uint64_t>(received);
+
+    m_error = code;
+    m_partialCode = code != CURLE_OK && m_receiving ? httpCode : 0;
+    if (code != CURLE_OK) httpCode = 500;
+
+    ARBITER_PROBE(http__done, m_curl, httpCode, code,
+            static_cast<long long>(transfer.total.count()));
+
+    if (code == CURLE_OK && m_md5)
+    {
+        const std::string digest(m_md5->finalize());
+        const std::string actual(
+                m_expectedHex ?
+                    crypto::encodeAsHex(digest) :
+                    crypto::encodeBase64(digest));
+
+        // A corrupted body is treated like a dropped connection, so that it
+        // may be retried.
+        if (actual != m_expectedMd5)
+        {
+            if (m_config->verbose)
+            {
+                logging::warn("MD5 mismatch for " + transfer.url);
+            }
+
+            m_error = CURLE_RECV_ERROR;
+            httpCode = 500;
+            m_data.clear();
+        }
+    }
+
+    if (code != CURLE_OK && m_cancel && m_cancel->cancelled() &&
+            !m_callbackError)
+    {
+        m_callbackError = std::make_exception_ptr(
+                CancelledError("Transfer cancelled"));
+    }
+
+#ifdef ARBITER_ZLIB
+    if (code == CURLE_OK && m_inflater && !m_inflater->done())
+    {
+        m_callbackError = std::make_exception_ptr(
+                ArbiterError("Compressed response was truncated"));
+    }
+#endif
+
+    // Hand our receive buffer off to the Response without copying it.
+    Response res(
+            httpCode,
+            std::move(m_data),
+            std::move(m_receivedHeaders),
+            std::move(transfer),
+            m_buffers);
+
+#ifdef ARBITER_ZLIB
+    if (m_deferDecode) res.decoder(Inflater::decode);
+#endif
+
+    // Reset our per-transfer state.
+    m_data.clear();
+    m_receivedHeaders.clear();
+    m_putData.reset();
+    m_decode = false;
+    m_inflater.reset();
+    m_deferDecode = false;
+    m_md5.reset();
+    m_expectedMd5.clear();
+    m_receiving = false;
+    m_sink = nullptr;
+    m_source = nullptr;
+    m_streaming = false;
+    m_onResponse = nullptr;
+    m_cancel.reset();
+
+    if (m_callbackError)
+    {
+        std::exception_ptr e(m_callbackError);
+        m_callbackError = nullptr;
+        std::rethrow_exception(e);
+    }
+
+    return res;
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+void Curl::reserve(const std::size_t size)
+{
+    if (m_data.capacity() >= size) return;
+
+    if (m_buffers && m_data.empty())
+    {
+        if (m_data.capacity()) m_buffers->release(std::move(m_data));
+        m_data = m_buffers->acquire(size);
+    }
+    else m_data.reserve(size);
+}
+
+void Curl::prepareGet(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const std::size_t reserve)
+{
+#ifdef ARBITER_CURL
+    if (reserve) this->reserve(reserve);
+
+    init(path, headers, query);
+
+    // Register callback function and data pointer to consume the result.
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, bodyCb);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
+
+    // Insert all headers into the request.
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+
+    m_decode = true;
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+void Curl::prepareGet(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const std::function<void(const char*, std::size_t)>& sink)
+{
+#ifdef ARBITER_CURL
+    init(path, headers, query);
+
+    m_sink = &sink;
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, bodyCb);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
+
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+
+    m_decode = true;
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+std::size_t Curl::bodyCb(
+        const char* in,
+        const std::size_t size,
+        const std::size_t num,
+        Curl* curl)
+{
+    return curl->receive(in, size * num);
+}
+
+std::size_t Curl::receive(const char* data, const std::size_t size)
+{
+#ifdef ARBITER_CURL
+    try
+    {
+        if (!m_receiving)
+        {
+            m_receiving = true;
+
+            // Headers are complete by the time the body arrives, so we can
+            // now tell whether this body belongs to the caller, and whether
+            // it needs decoding.
+            long httpCode(0);
+            curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &httpCode);
+            m_streaming = m_sink && httpCode / 100 == 2;
+            if (m_config->verify && httpCode == 200) startVerify();
+
+            // A streamed body must be decoded as it arrives, but a buffered
+            // one is left for the Response to decode, so that the CPU time
+            // isn't spent holding our handle, or in the async engine, every
+            // transfer's I/O thread.
+            const auto it(m_receivedHeaders.find("Content-Encoding"));
+            if (m_decode && it != m_receivedHeaders.end() &&
+                    it->second == "gzip")
+            {
+#ifdef ARBITER_ZLIB
+                if (m_streaming) m_inflater.reset(new Inflater());
+                else m_deferDecode = true;
+#else
+                throw ArbiterError("Cannot decompress zlib");
+#endif
+            }
+
+            // Size the buffer for the whole body from its Content-Length,
+            // rather than growing it as the pieces arrive.  The decoded
+            // size of a streamed encoded body is unknown.
+            const std::string* length(
+                    headerValue(m_receivedHeaders, "Content-Length"));
+            if (!m_streaming && !m_inflater && length)
+            {
+                reserve(
+                        m_data.size() +
+                        std::strtoull(length->c_str(), nullptr, 10));
+            }
+        }
+
+        if (m_md5) m_md5->update(data, size);
+
+#ifdef ARBITER_ZLIB
+        if (m_inflater)
+        {
+            m_inflater->write(data, size, [this](const char* d, std::size_t n)
+            {
+                deliver(d, n);
+            });
+            return size;
+        }
+#endif
+
+        deliver(data, size);
+    }
+    catch (...)
+    {
+        // Returning a short count aborts the transfer, after which the
+        // exception is rethrown to the caller by finish.
+        m_callbackError = std::current_exception();
+        return 0;
+    }
+#endif
+    return size;
+}
+
+void Curl::startVerify()
+{
+    m_expectedMd5 = expectedMd5(m_receivedHeaders, m_expectedHex);
+    if (m_expectedMd5.size()) m_md5.reset(new crypto::Md5());
+}
+
+std::size_t Curl::headerLineCb(
+        const char* in,
+        const std::size_t size,
+        const std::size_t num,
+        Curl* curl)
+{
+#ifdef ARBITER_CURL
+    if (curl->m_onResponse)
+    {
+        const std::function<void()> f(std::move(curl->m_onResponse));
+        curl->m_onResponse = nullptr;
+        f();
+    }
+
+    return headerCb(in, size, num, &curl->m_receivedHeaders);
+#else
+    return 0;
+#endif
+}
+
+void Curl::deliver(const char* data, const std::size_t size)
+{
+    if (m_streaming)
+    {
+        m_streamed = true;
+        (*m_sink)(data, size);
+    }
+    else
+    {
+        m_data.insert(m_data.end(), data, data + size);
+    }
+}
+
+void Curl::prepareHead(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query)
+{
+#ifdef ARBITER_CURL
+    init(path, headers, query);
+
+    // Register callback function and data pointer to consume the result.
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, getCb);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_data);
+
+    // Insert all headers into the request.
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+
+    // Specify a HEAD request.
+    curl_easy_setopt(m_curl, CURLOPT_NOBODY, 1L);
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+void Curl::prepareDelete(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query)
+{
+#ifdef ARBITER_CURL
+    init(path, headers, query);
+
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, getCb);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_data);
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+    curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+Headers Curl::expect(const Headers& headers, const std::size_t size) const
+{
+    // Waiting for a `100 Continue` costs a round trip, but lets a request
+    // which will be refused, like one whose signature has expired, fail
+    // before its body is sent, which is only worthwhile for large bodies.
+    if (headers.count("Expect")) return headers;
+
+    Headers result(headers);
+    const std::size_t threshold(m_config->expectThreshold);
+    result["Expect"] = threshold && size > threshold ? "100-continue" : "";
+    return result;
+}
+
+void Curl::preparePut(
+        const std::string& path,
+        const std::vector<char>& data,
+        const Headers& headers,
+        const Query& query)
+{
+    preparePut(path, data.data(), data.size(), headers, query);
+}
+
+void Curl::preparePut(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query)
+{
+#ifdef ARBITER_CURL
+    init(path, expect(headers, size), query);
+
+    m_putData.reset(new PutData(data, size));
+
+    // Register callback function and data pointer to create the request.
+    curl_easy_setopt(m_curl, CURLOPT_READFUNCTION, putCb);
+    curl_easy_setopt(m_curl, CURLOPT_READDATA, m_putData.get());
+
+    // Insert all headers into the request.
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+
+    // Specify that this is a PUT request.
+    curl_easy_setopt(m_curl, CURLOPT_PUT, 1L);
 
     // Must use this for binary data, otherwise curl will use strlen(), which
     // will likely be incorrect.
     curl_easy_setopt(
             m_curl,
             CURLOPT_INFILESIZE_LARGE,
-            static_cast<curl_off_t>(data.size()));
+            static_cast<curl_off_t>(size));
 
-    // Run the command.
-    const int httpCode(perform());
-    return Response(httpCode, writeData, receivedHeaders);
+    // Capture the response body rather than letting Curl print it to the
+    // console even with verbose set to false.
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, getCb);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_data);
 #else
     throw ArbiterError(fail);
 #endif
 }
 
+void Curl::preparePut(
+        const std::string& path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query)
+{
+#ifdef ARBITER_CURL
+    init(path, expect(headers, size), query);
+
+    m_source = &source;
+    curl_easy_setopt(m_curl, CURLOPT_READFUNCTION, sourceCb);
+    curl_easy_setopt(m_curl, CURLOPT_READDATA, this);
+
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+    curl_easy_setopt(m_curl, CURLOPT_PUT, 1L);
+    curl_easy_setopt(
+            m_curl,
+            CURLOPT_INFILESIZE_LARGE,
+            static_cast<curl_off_t>(size));
+
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, getCb);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_data);
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+std::size_t Curl::sourceCb(
+        char* out,
+        const std::size_t size,
+        const std::size_t num,
+        Curl* curl)
+{
+    return curl->send(out, size * num);
+}
+
+std::size_t Curl::send(char* const out, const std::size_t size)
+{
+#ifdef ARBITER_CURL
+    try
+    {
+        const std::size_t n((*m_source)(out, size));
+        if (n) m_streamed = true;
+        return n;
+    }
+    catch (...)
+    {
+        m_callbackError = std::current_exception();
+        return CURL_READFUNC_ABORT;
+    }
+#else
+    return 0;
+#endif
+}
+
+void Curl::preparePost(
+        const std::string& path,
+        const std::vector<char>& data,
+        const Headers& headers,
+        const Query& query)
+{
+    preparePost(path, data.data(), data.size(), headers, query);
+}
+
+void Curl::preparePost(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query)
+{
+#ifdef ARBITER_CURL
+    init(path, expect(headers, size), query);
+
+    m_putData.reset(new PutData(data, size));
+
+    // Register callback function and data pointer to create the request.
+    curl_easy_setopt(m_curl, CURLOPT_READFUNCTION, putCb);
+    curl_easy_setopt(m_curl, CURLOPT_READDATA, m_putData.get());
+
+    // Register callback function and data pointer to consume the result.
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, getCb);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_data);
+
+    // Insert all headers into the request.
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+
+    // Specify that this is a POST request.
+    curl_easy_setopt(m_curl, CURLOPT_POST, 1L);
+
+    // Must use this for binary data, otherwise curl will use strlen(), which
+    // will likely be incorrect.  Without it, a POST body from our read
+    // callback is also sent chunked, contradicting any Content-Length header
+    // and desynchronizing a reused connection.
+    curl_easy_setopt(
+            m_curl,
+            CURLOPT_POSTFIELDSIZE_LARGE,
+            static_cast<curl_off_t>(size));
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+void Curl::preparePost(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query,
+        const std::function<void(const char*, std::size_t)>& sink)
+{
+#ifdef ARBITER_CURL
+    preparePost(path, data, size, headers, query);
+
+    m_sink = &sink;
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, bodyCb);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+Response Curl::get(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const std::size_t reserve)
+{
+    prepareGet(path, headers, query, reserve);
+    return perform();
+}
+
+Response Curl::get(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const std::function<void(const char*, std::size_t)>& sink)
+{
+    prepareGet(path, headers, query, sink);
+    return perform();
+}
+
+Response Curl::put(
+        const std::string& path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query)
+{
+    preparePut(path, source, size, headers, query);
+    return perform();
+}
+
+Response Curl::head(const std::string& path, const Headers& headers, const Query& query)
+{
+    prepareHead(path, headers, query);
+    return perform();
+}
+
+Response Curl::del(const std::string& path, const Headers& headers, const Query& query)
+{
+    prepareDelete(path, headers, query);
+    return perform();
+}
+
+Response Curl::put(
+        const std::string& path,
+        const std::vector<char>& data,
+        const Headers& headers,
+        const Query& query)
+{
+    return put(path, data.data(), data.size(), headers, query);
+}
+
+Response Curl::put(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query)
+{
+    preparePut(path, data, size, headers, query);
+    return perform();
+}
+
+Response Curl::post(
+        const std::string& path,
+        const std::vector<char>& data,
+        const Headers& headers,
+        const Query& query)
+{
+    return post(path, data.data(), data.size(), headers, query);
+}
+
+Response Curl::post(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query)
+{
+    preparePost(path, data, size, headers, query);
+    return perform();
+}
+
+Response Curl::post(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query,
+        const std::function<void(const char*, std::size_t)>& sink)
+{
+    preparePost(path, data, size, headers, query, sink);
+    return perform();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Multi::Multi(Affinity affinity)
+{
+#ifdef ARBITER_CURL
+    m_multi = curl_multi_init();
+    if (!m_multi) throw ArbiterError("Could not create curl multi handle");
+
+    // Allow HTTP/2 transfers from handles which opt in to share connections.
+    curl_multi_setopt(m_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    m_thread = std::thread([this, affinity]()
+    {
+        affinity.apply();
+        run();
+    });
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+Multi::~Multi()
+{
+#ifdef ARBITER_CURL
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+
+    wake();
+    m_thread.join();
+
+    curl_multi_cleanup(m_multi);
+#endif
+}
+
+void Multi::add(
+        CURL* easy,
+        Callback done,
+        const std::chrono::milliseconds delay)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.emplace_back(easy, done, Clock::now() + delay);
+    }
+
+    wake();
+}
+
+void Multi::cancel(CURL* easy)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // A transfer which has already completed has nothing to cancel, and
+        // its handle may soon be reused for another.
+        const bool pending(std::any_of(
+                m_pending.begin(),
+                m_pending.end(),
+                [easy](const Pending& p) { return p.easy == easy; }));
+        if (!pending && !m_active.count(easy)) return;
+
+        m_cancels.push_back(easy);
+    }
+
+    wake();
+}
+
+void Multi::wake()
+{
+#ifdef ARBITER_CURL
+#if LIBCURL_VERSION_NUM >= 0x074400
+    curl_multi_wakeup(m_multi);
+#endif
+#endif
+}
+
+void Multi::run()
+{
+#ifdef ARBITER_CURL
+    int running(0);
+    int remaining(0);
+
+    while (true)
+    {
+        // Wait no longer than the time until our next delayed transfer.
+        int timeout(1000);
+        std::vector<Callback> cancelled;
+        std::vector<Callback> unadded;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (CURL* easy : m_cancels)
+            {
+                auto active(m_active.find(easy));
+                if (active != m_active.end())
+                {
+                    curl_multi_remove_handle(m_multi, easy);
+                    cancelled.push_back(active->second);
+                    m_active.erase(active);
+                }
+
+                auto pending(std::find_if(
+                        m_pending.begin(),
+                        m_pending.end(),
+                        [easy](const Pending& p) { return p.easy == easy; }));
+                if (pending != m_pending.end())
+                {
+                    cancelled.push_back(pending->done);
+                    m_pending.erase(pending);
+                }
+            }
+            m_cancels.clear();
+
+            // Outstanding transfers are run to completion unless cancelled,
+            // so our owner's handles are never left attached to this engine.
+            if (m_done && m_pending.empty() && m_active.empty() &&
+                    cancelled.empty())
+            {
+                break;
+            }
+
+            const Clock::time_point now(Clock::now());
+
+            auto it(m_pending.begin());
+            while (it != m_pending.end())
+            {
+                if (it->start <= now)
+                {
+                    // A transfer which can't be added would never complete.
+                    if (curl_multi_add_handle(m_multi, it->easy) == CURLM_OK)
+                    {
+                        m_active[it->easy] = it->done;
+                    }
+                    else unadded.push_back(it->done);
+                    it = m_pending.erase(it);
+                }
+                else
+                {
+                    const auto wait(
+                            std::chrono::duration_cast<
+                                std::chrono::milliseconds>(it->start - now));
+                    timeout = (std::min)(
+                            timeout,
+                            static_cast<int>(wait.count()) + 1);
+                    ++it;
+                }
+            }
+        }
+
+        for (Callback& done : cancelled) done(CURLE_ABORTED_BY_CALLBACK);
+        for (Callback& done : unadded) done(CURLE_FAILED_INIT);
+
+        curl_multi_perform(m_multi, &running);
+
+        while (CURLMsg* msg = curl_multi_info_read(m_multi, &remaining))
+        {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            CURL* easy(msg->easy_handle);
+            const int code(msg->data.result);
+            curl_multi_remove_handle(m_multi, easy);
+
+            Callback done;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it(m_active.find(easy));
+                done = it->second;
+                m_active.erase(it);
+
+                // Any cancellation of this transfer arrived too late.
+                m_cancels.erase(
+                        std::remove(m_cancels.begin(), m_cancels.end(), easy),
+                        m_cancels.end());
+            }
+
+            // This may add more transfers, so we can't hold our lock here.
+            done(code);
+        }
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_poll(m_multi, nullptr, 0, timeout, nullptr);
+#else
+        curl_multi_wait(m_multi, nullptr, 0, (std::min)(timeout, 50), nullptr);
+#endif
+    }
+#endif
+}
+
+Share::Share()
+#ifdef ARBITER_CURL
+    : m_mutexes(CURL_LOCK_DATA_LAST)
+#endif
+{
+#ifdef ARBITER_CURL
+    m_share = curl_share_init();
+    if (!m_share) throw ArbiterError("Could not create curl share handle");
+
+    curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, &Share::lock);
+    curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, &Share::unlock);
+    curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+#else
+    throw ArbiterError(fail);
+#endif
+}
+
+Share::~Share()
+{
+#ifdef ARBITER_CURL
+    curl_share_cleanup(m_share);
+#endif
+}
+
+void Share::lock(CURL*, const int data, int, void* user)
+{
+    static_cast<Share*>(user)->m_mutexes.at(data).lock();
+}
+
+void Share::unlock(CURL*, const int data, void* user)
+{
+    static_cast<Share*>(user)->m_mutexes.at(data).unlock();
+}
+
 } // namepace http
 } // namespace arbiter
 
@@ -1,12 +1,24 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/affinity.hpp>
+#include <arbiter/util/cancel.hpp>
 #include <arbiter/util/exports.hpp>
+#include <arbiter/util/progress.hpp>
+#include <arbiter/util/rate.hpp>
 #include <arbiter/util/types.hpp>
 #endif
 
@@ -14,6 +26,8 @@
 #include <curl/curl.h>
 #else
 typedef void CURL;
+typedef void CURLM;
+typedef void CURLSH;
 #endif
 
 struct curl_slist;
@@ -25,64 +39,449 @@ namespace ARBITER_CUSTOM_NAMESPACE
 
 namespace arbiter
 {
+
+namespace crypto
+{
+class Md5;
+}
+
 namespace http
 {
 
 /** @cond arbiter_internal */
 
 class Pool;
+class Multi;
+class Share;
+class Inflater;
+struct PutData;
+
+// Settings shared by every handle of a pool, which are parsed once from
+// the Arbiter configuration and the environment, and not changed after.
+struct ARBITER_DLL CurlConfig
+{
+    static constexpr long defaultHttpTimeout = 5;
+    static constexpr std::size_t defaultExpectThreshold = 1024 * 1024;
+    static constexpr long defaultConnectTimeout = 2000;
+
+    // Create from the stringified JSON @p j of the Arbiter configuration,
+    // whose `http` entry holds all but `verbose`.
+    static std::shared_ptr<const CurlConfig> create(std::string j);
+
+    bool verbose = false;
+    long timeout = defaultHttpTimeout;
+    bool followRedirect = true;
+    bool verifyPeer = true;
+    bool http2 = false;
+
+    // Try HTTP/3 over QUIC, falling back to HTTP/2 or HTTP/1.1.  Without
+    // HTTP/3 support in curl, this is cleared and http2 set instead.
+    bool http3 = false;
+    bool verify = false;
+
+    // Uploads of more bytes than this ask for a `100 Continue` before
+    // sending their bodies, and others don't, unless they set `Expect`
+    // themselves.  Zero means no upload asks.
+    std::size_t expectThreshold = defaultExpectThreshold;
+
+    // Per-transfer limits in bytes per second, or zero for none.
+    std::uint64_t maxRecvSpeed = 0;
+    std::uint64_t maxSendSpeed = 0;
+
+    // Milliseconds to wait for a connection to be established.
+    long connectTimeout = defaultConnectTimeout;
+
+    // The address family to which host names are resolved, one of "v4",
+    // "v6", or "any".  Resolving only IPv4 is substantially faster where
+    // IPv6 lookups are slow to fail.
+    std::string ipResolve = "v4";
+
+    // Seconds for which resolved names are cached, or -1 for ever.
+    long dnsCacheTimeout = 60;
+
+    // Sizes in bytes of the buffers of received and sent data, which bound
+    // the data handled per callback, or zero for those of curl.
+    long bufferSize = 0;
+    long uploadBufferSize = 0;
+
+    // TCP options.  Idle connections are probed after tcpKeepIdle seconds,
+    // and then every tcpKeepInterval seconds, if tcpKeepAlive is set.
+    bool tcpNoDelay = true;
+    bool tcpKeepAlive = false;
+    long tcpKeepIdle = 60;
+    long tcpKeepInterval = 60;
+
+    std::unique_ptr<std::string> caPath;
+    std::unique_ptr<std::string> caInfo;
+
+    // Route requests through this proxy, like a node-local cache, rather
+    // than any set by the environment.
+    std::unique_ptr<std::string> proxy;
+
+    // Connect over this Unix domain socket instead of TCP, while requests
+    // still name their hosts as usual.
+    std::unique_ptr<std::string> unixSocket;
+};
 
 class ARBITER_DLL Curl
 {
     friend class Pool;
+    friend class Resource;
 
-    static constexpr std::size_t defaultHttpTimeout = 5;
 
 public:
     ~Curl();
 
     http::Response get(
-            std::string path,
-            Headers headers,
-            Query query,
+            const std::string& path,
+            const Headers& headers,
+            const Query& query,
             std::size_t reserve);
 
-    http::Response head(std::string path, Headers headers, Query query);
+    /** Stream the body of a successful GET to @p sink as it arrives.  The
+     * body of an unsuccessful response is instead kept in the Response.
+     */
+    http::Response get(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query,
+            const std::function<void(const char*, std::size_t)>& sink);
+
+    http::Response head(const std::string& path, const Headers& headers, const Query& query);
+
+    http::Response del(const std::string& path, const Headers& headers, const Query& query);
 
     http::Response put(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            Headers headers,
-            Query query);
+            const Headers& headers,
+            const Query& query);
+
+    /** Upload the @p size bytes at @p data, which are sent from where they
+     * lie rather than copied.
+     */
+    http::Response put(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const Headers& headers,
+            const Query& query);
 
     http::Response post(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            Headers headers,
-            Query query);
+            const Headers& headers,
+            const Query& query);
+
+    /** POST the @p size bytes at @p data, without copying them. */
+    http::Response post(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const Headers& headers,
+            const Query& query);
+
+    /** As above, but streaming the body of a successful response to
+     * @p sink as it arrives, as for get.
+     */
+    http::Response post(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const Headers& headers,
+            const Query& query,
+            const std::function<void(const char*, std::size_t)>& sink);
+
+    /** Upload @p size bytes pulled from @p source, which fills up to the
+     * requested number of bytes of its buffer and returns the count filled,
+     * so the body need not be held in memory.
+     */
+    http::Response put(
+            const std::string& path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size,
+            const Headers& headers,
+            const Query& query);
 
 private:
-    Curl(std::string j);
+    Curl(std::shared_ptr<const CurlConfig> config);
+
+    // Set the options of the handle which persist between transfers.
+    void configure();
+
+    void init(const std::string& path, const Headers& headers, const Query& query);
+
+    // The @p headers of an upload of @p size bytes, with `Expect` set by
+    // our expectThreshold unless they already have one.
+    Headers expect(const Headers& headers, std::size_t size) const;
+
+    // These set up a transfer on our easy handle without running it.  Any
+    // referenced upload data must outlive the transfer.
+    void prepareGet(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query,
+            std::size_t reserve);
+    void prepareGet(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query,
+            const std::function<void(const char*, std::size_t)>& sink);
+    void prepareHead(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query);
+    void prepareDelete(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query);
+    void preparePut(
+            const std::string& path,
+            const std::vector<char>& data,
+            const Headers& headers,
+            const Query& query);
+    void preparePut(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const Headers& headers,
+            const Query& query);
+    void preparePut(
+            const std::string& path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size,
+            const Headers& headers,
+            const Query& query);
+    void preparePost(
+            const std::string& path,
+            const std::vector<char>& data,
+            const Headers& headers,
+            const Query& query);
+    void preparePost(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const Headers& headers,
+            const Query& query);
+    void preparePost(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const Headers& headers,
+            const Query& query,
+            const std::function<void(const char*, std::size_t)>& sink);
+
+    // Runs a prepared transfer to completion on the calling thread, or via
+    // the transfer engine if one has been attached.
+    http::Response perform();
+
+    // Collects the result of a prepared transfer which has completed with
+    // the given CURLcode, and resets the handle for its next use.
+    http::Response finish(int code);
+
+    // Write callback for GET bodies, which forwards to receive.  Bodies
+    // are decoded, if necessary, as they arrive, and then passed to deliver.
+    static std::size_t bodyCb(
+            const char* in,
+            std::size_t size,
+            std::size_t num,
+            Curl* curl);
+    std::size_t receive(const char* data, std::size_t size);
+    void deliver(const char* data, std::size_t size);
 
-    void init(std::string path, const Headers& headers, const Query& query);
+    // Header callback, which notes the start of the response before
+    // collecting the header.
+    static std::size_t headerLineCb(
+            const char* in,
+            std::size_t size,
+            std::size_t num,
+            Curl* curl);
 
-    // Returns HTTP status code.
-    int perform();
+    // Read callback for streamed uploads, which forwards to send.
+    static std::size_t sourceCb(
+            char* out,
+            std::size_t size,
+            std::size_t num,
+            Curl* curl);
+    std::size_t send(char* out, std::size_t size);
+
+    // Progress callback, which aborts the transfer if it is cancelled and
+    // pauses it as needed to keep within our pool's bandwidth.
+    static int progressCb(
+            Curl* curl,
+            std::int64_t,
+            std::int64_t received,
+            std::int64_t,
+            std::int64_t sent);
+
+    // Ensure the receive buffer can hold @p size bytes, taking it from our
+    // BufferPool if there is one and the buffer is still empty.
+    void reserve(std::size_t size);
+
+    // Begin checking the body of a successful response against the MD5
+    // claimed by its headers, if they claim one.
+    void startVerify();
+
+    // True if the last transfer failed without a response, in which case its
+    // Response carries a 500 status.
+    bool failed() const { return m_error != 0; }
+
+    // True if the failure of the last transfer, if any, was of a kind which
+    // might succeed if retried, like a timeout or a dropped connection.
+    bool transient() const;
 
     Curl(const Curl&);
     Curl& operator=(const Curl&);
 
     CURL* m_curl = nullptr;
     curl_slist* m_headers = nullptr;
+    Headers m_listedHeaders;
+    bool m_configured = false;
+    Multi* m_multi = nullptr;
+    Share* m_share = nullptr;
 
-    bool m_verbose = false;
-    long m_timeout = defaultHttpTimeout;
-    bool m_followRedirect = true;
-    bool m_verifyPeer = true;
-    std::unique_ptr<std::string> m_caPath;
-    std::unique_ptr<std::string> m_caInfo;
+    // The bandwidth limits shared by every handle of our pool, if any, and
+    // the bytes of the current transfer charged to them so far.
+    RateLimit* m_recvLimit = nullptr;
+    RateLimit* m_sendLimit = nullptr;
+    std::int64_t m_received = 0;
+    std::int64_t m_sent = 0;
 
+    int m_error = 0;
+
+    // The status of the last transfer if it failed after its body began
+    // to arrive, in which case the body of its Response is a prefix of the
+    // one which was sent, or zero otherwise.
+    long m_partialCode = 0;
+
+    const std::shared_ptr<const CurlConfig> m_config;
+
+    // Per-transfer state, populated by the prepare functions.
+    std::unique_ptr<PutData> m_putData;
     std::vector<char> m_data;
+    Headers m_receivedHeaders;
+    std::shared_ptr<BufferPool> m_buffers;
+    bool m_decode = false;
+    bool m_receiving = false;
+    std::unique_ptr<Inflater> m_inflater;
+
+    // Set if a buffered body is gzipped, in which case it is received as is
+    // and decoded by the Response once our handle is released, rather than
+    // by the transfer while it holds the handle.
+    bool m_deferDecode = false;
+
+    // When verifying, the MD5 of the body as it arrives, before any decoding,
+    // and the digest claimed by the headers: hex for an S3 ETag, otherwise
+    // base64.
+    std::unique_ptr<crypto::Md5> m_md5;
+    std::string m_expectedMd5;
+    bool m_expectedHex = false;
+
+    // For streamed GETs, the destination of a successful body, and for
+    // streamed uploads, the origin of the request body.  Once any data has
+    // passed through either, the transfer can't be transparently retried.
+    const std::function<void(const char*, std::size_t)>* m_sink = nullptr;
+    const std::function<std::size_t(char*, std::size_t)>* m_source = nullptr;
+    bool m_streaming = false;
+    bool m_streamed = false;
+    std::exception_ptr m_callbackError;
+
+    // If set, called from the transfer as soon as its response begins to
+    // arrive, for a single transfer.
+    std::function<void()> m_onResponse;
+
+    // The token current when the transfer was prepared, if any, whose
+    // cancellation aborts the transfer.
+    std::unique_ptr<CancelToken> m_cancel;
+
+    // The Progress current when the transfer was prepared, if any, which
+    // counts the bytes we receive.
+    Progress* m_progress = nullptr;
+};
+
+/** Event-driven transfer engine built atop the curl multi interface.  A
+ * single I/O thread drives every in-flight transfer, so the number of
+ * concurrent requests is bounded by the number of easy handles rather than by
+ * the number of threads blocked on the network.  The I/O thread may be pinned
+ * with an Affinity, so that the buffers which it fills are first touched,
+ * and so allocated, on its NUMA node.
+ */
+class ARBITER_DLL Multi
+{
+public:
+    // Called from the I/O thread with the CURLcode of a completed transfer.
+    using Callback = std::function<void(int code)>;
+
+    explicit Multi(Affinity affinity = Affinity());
+    ~Multi();
+
+    // Begin driving the prepared @p easy handle, after an optional @p delay.
+    // Its @p done callback should be brief since it blocks the progress of
+    // all other transfers.
+    void add(
+            CURL* easy,
+            Callback done,
+            std::chrono::milliseconds delay = std::chrono::milliseconds(0));
+
+    // Abandon the transfer of @p easy, if it hasn't already completed, in
+    // which case its callback is called with an aborted code.
+    void cancel(CURL* easy);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending
+    {
+        Pending(CURL* easy, Callback done, Clock::time_point start)
+            : easy(easy), done(done), start(start)
+        { }
+
+        CURL* easy;
+        Callback done;
+        Clock::time_point start;
+    };
+
+    void run();
+    void wake();
+
+    Multi(const Multi&);
+    Multi& operator=(const Multi&);
+
+    CURLM* m_multi = nullptr;
+
+    std::vector<Pending> m_pending;
+    std::map<CURL*, Callback> m_active;
+    std::vector<CURL*> m_cancels;
+    bool m_done = false;
+
+    std::mutex m_mutex;
+    std::thread m_thread;
+};
+
+/** A curl share object through which easy handles pool their DNS cache, TLS
+ * sessions, and connections, so that many handles talking to the same host
+ * don't each pay for their own lookups and handshakes.  Must outlive every
+ * handle which uses it.
+ */
+class ARBITER_DLL Share
+{
+public:
+    Share();
+    ~Share();
+
+    CURLSH* get() { return m_share; }
+
+private:
+    static void lock(CURL*, int data, int access, void* user);
+    static void unlock(CURL*, int data, void* user);
+
+    Share(const Share&);
+    Share& operator=(const Share&);
+
+    CURLSH* m_share = nullptr;
+
+    // One lock per curl_lock_data value.
+    std::vector<std::mutex> m_mutexes;
 };
 
 /** @endcond */
@@ -0,0 +1,359 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/executor.hpp>
+
+#include <arbiter/util/cancel.hpp>
+#include <arbiter/util/priority.hpp>
+#include <arbiter/util/progress.hpp>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    // Wrap @p f to run under the priority of the calling thread, and its
+    // cancellation token and Progress if it has them.
+    std::function<void()> inherit(std::function<void()> f)
+    {
+        const Priority p(PriorityScope::current());
+        if (p != Priority::Normal)
+        {
+            const std::function<void()> g(std::move(f));
+            f = [p, g]() { PriorityScope scope(p); g(); };
+        }
+
+        if (const CancelToken* token = CancelScope::current())
+        {
+            const CancelToken t(*token);
+            const std::function<void()> g(std::move(f));
+            f = [t, g]() { CancelScope scope(t); g(); };
+        }
+
+        if (Progress* progress = ProgressScope::current())
+        {
+            const std::function<void()> g(std::move(f));
+            f = [progress, g]() { ProgressScope scope(progress); g(); };
+        }
+
+        return f;
+    }
+
+    // Run @p f on a new thread in the context of the calling thread.
+    std::thread spawn(const std::function<void()>& f)
+    {
+        return std::thread(inherit(f));
+    }
+
+    // The Executor, and the index of its worker, whose thread this is.
+    struct Self
+    {
+        Executor* executor = nullptr;
+        std::size_t id = 0;
+    };
+
+    Self& self()
+    {
+        thread_local Self s;
+        return s;
+    }
+
+    // Run @p run on the calling thread and on up to @p helpers others,
+    // returning once every run which has begun is complete.  Helpers are
+    // borrowed from @p executor if there is one, in which case any which
+    // haven't begun by the time the calling thread finishes are abandoned,
+    // since waiting for them might wait on the very thread that's waiting.
+    void fanOut(
+            Executor* executor,
+            const std::size_t helpers,
+            const std::function<void()>& run)
+    {
+        if (!executor) executor = Executor::current();
+
+        if (!executor)
+        {
+            std::vector<std::thread> pool;
+            for (std::size_t i(0); i < helpers; ++i) pool.push_back(spawn(run));
+
+            run();
+            for (auto& t : pool) t.join();
+            return;
+        }
+
+        // Shared with the helpers, which may begin after we've returned.
+        struct Join
+        {
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::size_t active = 0;
+            bool finished = false;
+            const std::function<void()>* run = nullptr;
+        };
+
+        auto join(std::make_shared<Join>());
+        join->run = &run;
+
+        const std::size_t n((std::min)(helpers, executor->size()));
+        for (std::size_t i(0); i < n; ++i)
+        {
+            executor->post([join]()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(join->mutex);
+                    if (join->finished) return;
+                    ++join->active;
+                }
+
+                (*join->run)();
+
+                std::lock_guard<std::mutex> lock(join->mutex);
+                --join->active;
+                join->cv.notify_all();
+            });
+        }
+
+        run();
+
+        std::unique_lock<std::mutex> lock(join->mutex);
+        join->finished = true;
+        join->cv.wait(lock, [&join]() { return !join->active; });
+    }
+}
+
+Executor::Executor(const std::size_t threads, Affinity affinity)
+    : m_size((std::max)(threads, std::size_t(1)))
+    , m_affinity(std::move(affinity))
+    , m_pending(0)
+{
+    for (std::size_t i(0); i < m_size; ++i)
+    {
+        m_workers.emplace_back(new Worker());
+    }
+}
+
+Executor::~Executor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+
+    m_cv.notify_all();
+    for (auto& t : m_threads) t.join();
+}
+
+Executor* Executor::current()
+{
+    return self().executor;
+}
+
+void Executor::post(std::function<void()> task)
+{
+    // Carry the priority and cancellation token of the caller along to its
+    // task.
+    task = inherit(std::move(task));
+
+    const Self& s(self());
+    if (s.executor == this)
+    {
+        Worker& worker(*m_workers[s.id]);
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+        ++m_pending;
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+        ++m_pending;
+
+        if (m_threads.empty())
+        {
+            for (std::size_t i(0); i < m_size; ++i)
+            {
+                m_threads.emplace_back([this, i]() { work(i); });
+            }
+        }
+    }
+
+    // An idle worker checks for pending tasks while holding the lock, so
+    // taking it here ensures that it either sees our task or is woken.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_cv.notify_one();
+}
+
+bool Executor::next(const std::size_t id, Task& task)
+{
+    {
+        Worker& own(*m_workers[id]);
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.tasks.size())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_tasks.size())
+        {
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (std::size_t i(1); i < m_size; ++i)
+    {
+        Worker& other(*m_workers[(id + i) % m_size]);
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (other.tasks.size())
+        {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Executor::work(const std::size_t id)
+{
+    self().executor = this;
+    self().id = id;
+    m_affinity.apply();
+
+    Task task;
+    while (true)
+    {
+        if (next(id, task))
+        {
+            --m_pending;
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        // Drain all remaining work before exiting.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_done || m_pending; });
+        if (m_done && !m_pending) return;
+    }
+}
+
+void parallelFor(
+        const std::size_t n,
+        const std::size_t threads,
+        const std::function<void(std::size_t)>& f,
+        Executor* executor)
+{
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr error;
+    std::mutex mutex;
+
+    const std::function<void()> run([&]()
+    {
+        for (std::size_t i(next++); i < n; i = next++)
+        {
+            try
+            {
+                CancelScope::check();
+                f(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+                next = n;
+            }
+        }
+    });
+
+    // The calling thread makes up one of the total.
+    const std::size_t total((std::min)((std::max)(threads, std::size_t(1)), n));
+    if (total > 1) fanOut(executor, total - 1, run);
+    else run();
+
+    if (error) std::rethrow_exception(error);
+}
+
+void parallelTraverse(
+        std::vector<std::string> roots,
+        const std::size_t threads,
+        const Visitor& visit,
+        Executor* executor)
+{
+    std::deque<std::string> pending(roots.begin(), roots.end());
+    std::size_t active(0);
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    const std::function<void(std::string)> push([&](std::string node)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(node));
+        }
+        cv.notify_one();
+    });
+
+    const std::function<void()> run([&]()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true)
+        {
+            // With nothing pending, we're finished only once no running
+            // visit remains which might submit more.
+            cv.wait(lock, [&]() { return error || pending.size() || !active; });
+            if (error || pending.empty()) break;
+
+            const std::string node(std::move(pending.front()));
+            pending.pop_front();
+            ++active;
+
+            lock.unlock();
+            try
+            {
+                CancelScope::check();
+                visit(node, push);
+                lock.lock();
+            }
+            catch (...)
+            {
+                lock.lock();
+                if (!error) error = std::current_exception();
+            }
+            --active;
+        }
+
+        cv.notify_all();
+    });
+
+    if (threads > 1) fanOut(executor, threads - 1, run);
+    else run();
+
+    if (error) std::rethrow_exception(error);
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
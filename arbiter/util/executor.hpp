@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/affinity.hpp>
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief A fixed-size, work-stealing pool of worker threads.
+ *
+ * Tasks posted from outside of the pool are started in submission order.
+ * Those posted by a task are kept by its worker, which runs the most recent
+ * first while they are likely to be warm in its cache, and an idle worker
+ * steals the oldest of them from a busy one.  Worker threads are not started
+ * until the first task is submitted, so an unused Executor costs nothing.
+ * Destruction waits for all submitted tasks to complete.
+ *
+ * An Arbiter runs its asynchronous operations, and the concurrent parts of
+ * its other operations, on a single Executor, so that many operations
+ * running at once share its threads rather than each starting their own.
+ *
+ * Workers may be pinned to a set of CPUs with an Affinity, applied as each
+ * worker starts.
+ */
+class ARBITER_DLL Executor
+{
+public:
+    explicit Executor(
+            std::size_t threads,
+            Affinity affinity = Affinity());
+    ~Executor();
+
+    /** Run @p task on a worker thread, under the CancelToken and Priority
+     * of the calling thread.
+     */
+    void post(std::function<void()> task);
+
+    /** Run @p f on a worker thread, returning a future for its result.  Any
+     * exception thrown by @p f is propagated through the future.
+     */
+    template <typename F>
+    auto async(F f) -> std::future<decltype(f())>
+    {
+        using Result = decltype(f());
+        auto task(std::make_shared<std::packaged_task<Result()>>(f));
+        std::future<Result> future(task->get_future());
+        post([task]() { (*task)(); });
+        return future;
+    }
+
+    /** Number of worker threads. */
+    std::size_t size() const { return m_size; }
+
+    /** The Executor of which the calling thread is a worker, or null. */
+    static Executor* current();
+
+private:
+    using Task = std::function<void()>;
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void work(std::size_t id);
+
+    // Take the next task for worker @p id: its own newest, or else the
+    // oldest posted from outside, or else the oldest of another worker.
+    bool next(std::size_t id, Task& task);
+
+    Executor(const Executor&);
+    Executor& operator=(const Executor&);
+
+    const std::size_t m_size;
+    const Affinity m_affinity;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // Tasks posted from outside of the pool, and the count of tasks queued
+    // anywhere, by which idle workers know to look for work.
+    std::deque<Task> m_tasks;
+    std::atomic<std::size_t> m_pending;
+    bool m_done = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::thread> m_threads;
+};
+
+/** Receives the outcome of an asynchronous operation as a ready future, so
+ * that errors are propagated as they are by the future-returning variants.
+ * It may be called on an internal thread, such as that of the HTTP transfer
+ * engine, so it should hand off its work rather than block.
+ */
+template <typename T>
+using Completion = std::function<void(std::future<T>)>;
+
+namespace detail
+{
+    template <typename T, typename F>
+    void settle(std::promise<T>& promise, F& f) { promise.set_value(f()); }
+
+    template <typename F>
+    void settle(std::promise<void>& promise, F& f)
+    {
+        f();
+        promise.set_value();
+    }
+}
+
+/** Run @p f on the calling thread, passing its result, or any exception it
+ * throws, to @p done.
+ */
+template <typename T, typename F>
+void complete(const Completion<T>& done, F f)
+{
+    std::promise<T> promise;
+
+    try { detail::settle(promise, f); }
+    catch (...) { promise.set_exception(std::current_exception()); }
+
+    done(promise.get_future());
+}
+
+/** Run @p f for each index in [0, @p n) using up to @p threads threads, one
+ * of which is the calling thread.  Returns once every index has completed.
+ * If any invocation throws, remaining indices are skipped and the first
+ * exception is rethrown here.  Each thread observes the CancelToken of the
+ * calling thread, and remaining indices are likewise skipped once it is
+ * cancelled.
+ *
+ * The other threads are borrowed from @p executor, or if it is null, from
+ * the Executor of which the calling thread is a worker, and only if there is
+ * neither are threads started for the purpose.  Borrowed workers join in as
+ * they come free, and the calling thread doesn't wait for those which don't
+ * in time, so this may be nested freely within tasks of the same Executor.
+ */
+ARBITER_DLL void parallelFor(
+        std::size_t n,
+        std::size_t threads,
+        const std::function<void(std::size_t)>& f,
+        Executor* executor = nullptr);
+
+/** Visit each of @p roots, and every node discovered along the way, using up
+ * to @p threads threads, one of which is the calling thread.  The visitor
+ * receives a node and a function with which it may submit further nodes.
+ * Returns once no nodes remain.  Visiting order is unspecified.  If any
+ * visit throws, remaining nodes are skipped and the first exception is
+ * rethrown here.  Cancellation, and the use of @p executor, are as for
+ * parallelFor.
+ */
+using Visitor = std::function<void(
+        const std::string& node,
+        const std::function<void(std::string)>& push)>;
+
+ARBITER_DLL void parallelTraverse(
+        std::vector<std::string> roots,
+        std::size_t threads,
+        const Visitor& visit,
+        Executor* executor = nullptr);
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
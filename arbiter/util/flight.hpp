@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @cond arbiter_internal */
+
+/** Coalesces concurrent calls for the same key, so that while one caller
+ * is computing the result for a key, any others asking for it wait and
+ * share that result rather than computing it again.  Exceptions are shared
+ * in the same way.  Results are not kept once every caller has them.
+ *
+ * Since results are copied to each caller, @p T should be cheap to copy.
+ */
+template <typename T>
+class SingleFlight
+{
+public:
+    SingleFlight() { }
+
+    /** The result of @p f, or of the call for @p key already in flight. */
+    T run(const std::string& key, const std::function<T()>& f)
+    {
+        std::shared_future<T> future;
+        std::unique_ptr<std::promise<T>> promise;
+        std::uint64_t serial(0);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it(m_flights.find(key));
+            if (it != m_flights.end()) future = it->second.future;
+            else
+            {
+                promise.reset(new std::promise<T>());
+                future = promise->get_future().share();
+                serial = ++m_serial;
+                m_flights[key] = Flight { future, serial };
+            }
+        }
+
+        if (promise)
+        {
+            try { promise->set_value(f()); }
+            catch (...) { promise->set_exception(std::current_exception()); }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it(m_flights.find(key));
+            if (it != m_flights.end() && it->second.serial == serial)
+            {
+                m_flights.erase(it);
+            }
+        }
+
+        return future.get();
+    }
+
+    /** Let later calls for @p key start afresh rather than joining the call
+     * in flight, for instance because its result is known to be stale.
+     */
+    void forget(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_flights.erase(key);
+    }
+
+private:
+    struct Flight
+    {
+        std::shared_future<T> future;
+        std::uint64_t serial;
+    };
+
+    SingleFlight(const SingleFlight&);
+    SingleFlight& operator=(const SingleFlight&);
+
+    std::mutex m_mutex;
+    std::map<std::string, Flight> m_flights;
+    std::uint64_t m_serial = 0;
+};
+
+/** @endcond */
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
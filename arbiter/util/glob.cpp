@@ -0,0 +1,219 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/glob.hpp>
+
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+Glob::Glob(const std::string pattern)
+    : m_pattern(pattern)
+{
+    const std::size_t n(pattern.size());
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        const char c(pattern[i]);
+        Token token;
+        token.type = Token::Type::Literal;
+
+        if (c == '*')
+        {
+            std::size_t end(i);
+            while (end < n && pattern[end] == '*') ++end;
+
+            if (end - i == 1) token.type = Token::Type::Star;
+            else if (
+                    (i == 0 || pattern[i - 1] == '/') &&
+                    end < n && pattern[end] == '/')
+            {
+                // A whole level, whose trailing slash is part of it.
+                token.type = Token::Type::Levels;
+                ++end;
+            }
+            else token.type = Token::Type::Globstar;
+
+            i = end - 1;
+        }
+        else if (c == '?') token.type = Token::Type::One;
+        else if (c == '[')
+        {
+            std::size_t pos(i + 1);
+            if (pos < n && (pattern[pos] == '!' || pattern[pos] == '^'))
+            {
+                token.negate = true;
+                ++pos;
+            }
+
+            // A ']' which opens the set is a member of it.
+            const std::size_t close(pattern.find(']', pos + 1));
+            if (pos >= n || close == std::string::npos)
+            {
+                throw ArbiterError("Unclosed '[' in glob: " + pattern);
+            }
+
+            for (std::size_t j(pos); j < close; ++j)
+            {
+                if (j + 2 < close && pattern[j + 1] == '-')
+                {
+                    for (int k(pattern[j]); k <= pattern[j + 2]; ++k)
+                    {
+                        token.chars.push_back(static_cast<char>(k));
+                    }
+                    j += 2;
+                }
+                else token.chars.push_back(pattern[j]);
+            }
+
+            token.type = Token::Type::One;
+            i = close;
+        }
+        else token.chars.assign(1, c);
+
+        m_tokens.push_back(token);
+    }
+
+    std::size_t i(0);
+    for ( ; i < m_tokens.size(); ++i)
+    {
+        if (m_tokens[i].type != Token::Type::Literal) break;
+        m_prefix += m_tokens[i].chars;
+    }
+
+    for ( ; i < m_tokens.size(); ++i)
+    {
+        const Token& t(m_tokens[i]);
+        if (t.type == Token::Type::Globstar ||
+                t.type == Token::Type::Levels ||
+                (t.type == Token::Type::Literal && t.chars == "/"))
+        {
+            m_recursive = true;
+        }
+    }
+}
+
+bool Glob::isPattern(const std::string& path)
+{
+    const std::size_t last(path.find_last_not_of('*'));
+    return last != std::string::npos && path.find('*') < last;
+}
+
+bool Glob::match(const std::string& path) const
+{
+    const States states(run(path));
+    return std::binary_search(states.begin(), states.end(), m_tokens.size());
+}
+
+bool Glob::mayContain(const std::string& path) const
+{
+    return !run(path).empty();
+}
+
+std::string Glob::extend(const std::string& path) const
+{
+    std::string result(path);
+    States states(run(path));
+
+    while (
+            states.size() == 1 &&
+            states.front() < m_tokens.size() &&
+            m_tokens[states.front()].type == Token::Type::Literal)
+    {
+        result += m_tokens[states.front()].chars;
+        states = close(States { states.front() + 1 });
+    }
+
+    return result;
+}
+
+Glob::States Glob::close(States states) const
+{
+    for (std::size_t i(0); i < states.size(); ++i)
+    {
+        const std::size_t s(states[i]);
+        if (s < m_tokens.size() &&
+                m_tokens[s].type != Token::Type::Literal &&
+                m_tokens[s].type != Token::Type::One &&
+                std::find(states.begin(), states.end(), s + 1) == states.end())
+        {
+            states.push_back(s + 1);
+        }
+    }
+
+    std::sort(states.begin(), states.end());
+    return states;
+}
+
+Glob::States Glob::step(const States& states, const char c) const
+{
+    States next;
+
+    for (const std::size_t s : states)
+    {
+        if (s == m_tokens.size()) continue;
+
+        const Token& t(m_tokens[s]);
+        if (!accepts(t, c)) continue;
+
+        switch (t.type)
+        {
+            case Token::Type::Literal:
+            case Token::Type::One:
+                next.push_back(s + 1);
+                break;
+            case Token::Type::Levels:
+                next.push_back(s);
+                if (c == '/') next.push_back(s + 1);
+                break;
+            default:
+                next.push_back(s);
+                break;
+        }
+    }
+
+    std::sort(next.begin(), next.end());
+    next.erase(std::unique(next.begin(), next.end()), next.end());
+    return close(next);
+}
+
+Glob::States Glob::run(const std::string& path) const
+{
+    States states(close(States { 0 }));
+    for (const char c : path)
+    {
+        states = step(states, c);
+        if (states.empty()) break;
+    }
+    return states;
+}
+
+bool Glob::accepts(const Token& t, const char c) const
+{
+    switch (t.type)
+    {
+        case Token::Type::Literal:
+            return c == t.chars.front();
+        case Token::Type::One:
+            return c != '/' &&
+                (t.chars.empty() ||
+                    (t.chars.find(c) != std::string::npos) != t.negate);
+        case Token::Type::Star:
+            return c != '/';
+        default:
+            return true;
+    }
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
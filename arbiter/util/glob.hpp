@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief A compiled glob pattern, matched against whole paths.
+ *
+ * Within a pattern, `*` matches any characters but `/`, `?` matches any
+ * one character but `/`, and `[...]` matches one character of a set, which
+ * may contain ranges like `a-z` and is negated by a leading `!` or `^`.  A
+ * `**` matches any characters including `/`, and as a whole directory
+ * level, like `a/ ** /b` without the spaces, matches zero or more levels.
+ * Other characters match themselves.
+ *
+ * Besides matching whole paths, a pattern answers whether a directory may
+ * contain matches, and which literal characters must follow one, so that a
+ * listing may descend only into the directories it needs, addressing each
+ * by as long a prefix as possible.
+ */
+class ARBITER_DLL Glob
+{
+public:
+    /** Compile @p pattern, throwing ArbiterError for an unclosed `[`. */
+    explicit Glob(std::string pattern);
+
+    /** True if @p path has a wildcard other than a trailing `*` or `**`,
+     * which alone means a listing of its prefix.  Only such paths are
+     * resolved by matching with a Glob.
+     */
+    static bool isPattern(const std::string& path);
+
+    const std::string& pattern() const { return m_pattern; }
+
+    /** The literal characters with which every match begins. */
+    const std::string& prefix() const { return m_prefix; }
+
+    /** True if matches may have a `/` after prefix(), so that they are not
+     * all found by a listing of a single directory.
+     */
+    bool recursive() const { return m_recursive; }
+
+    /** True if the whole of @p path matches. */
+    bool match(const std::string& path) const;
+
+    /** True if some path beginning with @p path may match. */
+    bool mayContain(const std::string& path) const;
+
+    /** @p path, followed by the literal characters with which every match
+     * beginning with it continues.
+     */
+    std::string extend(const std::string& path) const;
+
+private:
+    struct Token
+    {
+        enum class Type
+        {
+            // A single character, which is in @p chars.
+            Literal,
+
+            // One character other than '/', within @p chars if it is not
+            // empty, or outside of them if @p negate is set.
+            One,
+
+            // Any run of characters other than '/'.
+            Star,
+
+            // Any run of characters.
+            Globstar,
+
+            // Nothing, or any run of characters ending with '/'.
+            Levels
+        };
+
+        Type type;
+        std::string chars;
+        bool negate = false;
+    };
+
+    using States = std::vector<std::size_t>;
+
+    // The states reached from @p states without consuming a character.
+    States close(States states) const;
+
+    // The states reached from @p states by consuming @p c.
+    States step(const States& states, char c) const;
+
+    // The states reached from the start by consuming @p path.
+    States run(const std::string& path) const;
+
+    bool accepts(const Token& token, char c) const;
+
+    std::string m_pattern;
+    std::vector<Token> m_tokens;
+    std::string m_prefix;
+    bool m_recursive = false;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -1,18 +1,22 @@
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/util/http.hpp>
+#include <arbiter/util/buffers.hpp>
 #include <arbiter/util/json.hpp>
+#include <arbiter/util/probes.hpp>
+#include <arbiter/util/time.hpp>
+#include <arbiter/util/util.hpp>
 #endif
 
 #ifdef ARBITER_CURL
 #include <curl/curl.h>
 #endif
 
+#include <algorithm>
 #include <cctype>
-#include <iomanip>
+#include <cstdlib>
 #include <iostream>
 #include <numeric>
-#include <set>
-#include <sstream>
+#include <thread>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
@@ -24,30 +28,265 @@ namespace arbiter
 namespace http
 {
 
-std::string sanitize(const std::string path, const std::string excStr)
+namespace
 {
-    static const std::set<char> unreserved = { '-', '.', '_', '~' };
-    const std::set<char> exclusions(excStr.begin(), excStr.end());
-    std::ostringstream result;
-    result.fill('0');
-    result << std::hex;
-
-    for (const auto c : path)
+    // Characters which are never percent-encoded: the RFC 3986 unreserved
+    // set of alphanumerics and "-._~".
+    struct UnreservedTable
     {
-        if (std::isalnum(c) || unreserved.count(c) || exclusions.count(c))
+        UnreservedTable()
         {
-            result << c;
+            for (int c(0); c < 256; ++c)
+            {
+                values[c] = std::isalnum(c) ||
+                    c == '-' || c == '.' || c == '_' || c == '~';
+            }
         }
-        else
+
+        bool values[256];
+    };
+
+    const UnreservedTable& unreservedTable()
+    {
+        static const UnreservedTable table;
+        return table;
+    }
+}
+
+void sanitize(
+        const std::string& path,
+        const std::string& exclusions,
+        std::string& out)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    const bool* const unreserved(unreservedTable().values);
+
+    out.clear();
+    out.reserve(path.size() + path.size() / 2);
+
+    const char* pos(path.data());
+    const char* const end(pos + path.size());
+
+    while (pos < end)
+    {
+        // Copy each run of characters which need no encoding in one step.
+        const char* run(pos);
+        while (
+                run < end &&
+                (unreserved[static_cast<uint8_t>(*run)] ||
+                 exclusions.find(*run) != std::string::npos))
         {
-            result << std::uppercase;
-            result << '%' << std::setw(2) <<
-                static_cast<int>(static_cast<uint8_t>(c));
-            result << std::nouppercase;
+            ++run;
         }
+
+        out.append(pos, run);
+        if (run == end) break;
+
+        const uint8_t u(static_cast<uint8_t>(*run));
+        const char encoded[3] = { '%', hex[u >> 4], hex[u & 0xf] };
+        out.append(encoded, 3);
+        pos = run + 1;
     }
+}
+
+std::string sanitize(const std::string& path, const std::string& exclusions)
+{
+    std::string result;
+    sanitize(path, exclusions, result);
+    return result;
+}
+
+namespace
+{
+    // The scheme and authority of a URL, which together determine which
+    // connections may serve it.
+    std::string hostOf(const std::string& url)
+    {
+        const std::size_t scheme(url.find("://"));
+        const std::size_t start(scheme == std::string::npos ? 0 : scheme + 3);
+        return url.substr(0, url.find_first_of("/?", start));
+    }
+
+    // The response to a request refused by the open circuit of @p host.
+    Response circuitOpen(const std::string& host)
+    {
+        const std::string body("Circuit open for " + host);
+        return Response(503, std::vector<char>(body.begin(), body.end()));
+    }
+
+    // Resumes a GET whose body was cut short, as when a stalled transfer
+    // times out, from the last byte received rather than from the start.
+    // The rest is asked for as a range of the same version of the object,
+    // by its ETag, so that the pieces belong together.
+    class GetResumption
+    {
+    public:
+        explicit GetResumption(const Headers& headers)
+            : m_headers(headers)
+        {
+            // Only a whole body, or a single range of one with a first byte,
+            // is resumed, and not for a request already conditional on its
+            // ETag.
+            const auto range(headers.find("Range"));
+            if (headers.count("If-Match")) m_enabled = false;
+            else if (range != headers.end())
+            {
+                const std::string& r(range->second);
+                const std::string prefix("bytes=");
+                const std::size_t dash(r.find('-'));
+                m_ranged = true;
+                m_enabled =
+                    !r.compare(0, prefix.size(), prefix) &&
+                    dash != std::string::npos &&
+                    dash > prefix.size() &&
+                    r.find(',') == std::string::npos;
+
+                if (m_enabled)
+                {
+                    m_first = std::strtoull(
+                            r.c_str() + prefix.size(), nullptr, 10);
+                    m_last = r.substr(dash + 1);
+                }
+            }
+        }
+
+        // The headers of the next attempt.
+        Headers headers() const
+        {
+            if (!m_offset) return m_headers;
+
+            Headers h(m_headers);
+            h["Range"] =
+                "bytes=" + std::to_string(m_first + m_offset) + "-" + m_last;
+            h["If-Match"] = m_etag;
+            return h;
+        }
+
+        bool resuming() const { return m_offset != 0; }
+        bool ranged() const { return m_ranged; }
+        std::size_t offset() const { return m_offset; }
+
+        // Count @p n more bytes of the body as received.
+        void advance(std::size_t n) { m_offset += n; }
+
+        // True if an attempt cut short with the status @p code and response
+        // @p headers may be resumed, which for the first attempt of a run
+        // requires a strong ETag to hold the rest to.
+        bool resumable(const long code, const Headers& headers)
+        {
+            if (!m_enabled || headers.count("Content-Encoding")) return false;
+            if (m_etag.size()) return code == 206 || (code == 200 && !m_ranged);
+            if (code != (m_ranged ? 206 : 200)) return false;
+
+            const auto etag(headers.find("ETag"));
+            if (etag == headers.end() || etag->second.empty() ||
+                    !etag->second.compare(0, 2, "W/"))
+            {
+                return false;
+            }
+            m_etag = etag->second;
+            return true;
+        }
+
+        // The response to return from the attempt which received @p res,
+        // for a buffered body.  If the attempt was cut short after its body
+        // began with status @p partial, what arrived is kept, and otherwise
+        // the body of a resumed attempt is joined to what came before.
+        Response complete(Response res, const long partial)
+        {
+            if (partial)
+            {
+                // A server ignoring our range starts over.
+                if (partial == 200) reset();
+
+                if (!resumable(partial, res.headers())) reset();
+                else
+                {
+                    if (!m_offset)
+                    {
+                        m_code = partial;
+                        m_responseHeaders = res.headers();
+                    }
+                    const std::vector<char> data(res.releaseData());
+                    m_data.insert(m_data.end(), data.begin(), data.end());
+                    m_offset = m_data.size();
+                }
+                return res;
+            }
 
-    return result.str();
+            if (!m_offset) return res;
+
+            if (res.code() == 206)
+            {
+                const std::vector<char>& rest(res.data());
+                m_data.insert(m_data.end(), rest.begin(), rest.end());
+                Response whole(
+                        m_code,
+                        std::move(m_data),
+                        std::move(m_responseHeaders),
+                        res.transfer());
+                reset();
+                return whole;
+            }
+
+            // The object changed since our run began, so it is retried from
+            // the start.
+            if (res.code() == 412)
+            {
+                reset();
+                const std::string body("Changed while resuming");
+                return Response(
+                        500,
+                        std::vector<char>(body.begin(), body.end()));
+            }
+
+            if (res.ok()) reset();
+            return res;
+        }
+
+    private:
+        void reset()
+        {
+            m_offset = 0;
+            m_etag.clear();
+            m_data.clear();
+            m_responseHeaders.clear();
+        }
+
+        const Headers m_headers;
+        bool m_enabled = true;
+        bool m_ranged = false;
+        std::uint64_t m_first = 0;
+        std::string m_last;
+
+        std::size_t m_offset = 0;
+        std::string m_etag;
+
+        // For a buffered body, what has arrived so far, and the status and
+        // headers of the attempt which began it.
+        std::vector<char> m_data;
+        long m_code = 0;
+        Headers m_responseHeaders;
+    };
+
+    // The stride of each Priority, from the @p weights of the `http.priority`
+    // configuration.
+    std::array<std::uint64_t, priorities> strides(const json& weights)
+    {
+        const std::uint64_t w[priorities] = {
+            weights.value("interactive", std::uint64_t(16)),
+            weights.value("normal", std::uint64_t(4)),
+            weights.value("bulk", std::uint64_t(1))
+        };
+
+        std::array<std::uint64_t, priorities> result;
+        for (std::size_t p(0); p < priorities; ++p)
+        {
+            result[p] = (std::uint64_t(1) << 20) /
+                (std::max)(w[p], std::uint64_t(1));
+        }
+        return result;
+    }
 }
 
 std::string buildQueryString(const Query& query)
@@ -63,15 +302,26 @@ std::string buildQueryString(const Query& query)
             });
 }
 
+Headers acceptCompressed()
+{
+    Headers headers;
+#ifdef ARBITER_ZLIB
+    headers["Accept-Encoding"] = "gzip";
+#endif
+    return headers;
+}
+
 Resource::Resource(
         Pool& pool,
         Curl& curl,
         const std::size_t id,
-        const std::size_t retry)
+        const RetryPolicy& retry,
+        const std::chrono::steady_clock::duration wait)
     : m_pool(pool)
     , m_curl(curl)
     , m_id(id)
     , m_retry(retry)
+    , m_wait(wait)
 { }
 
 Resource::~Resource()
@@ -80,118 +330,1790 @@ Resource::~Resource()
 }
 
 Response Resource::get(
-        const std::string path,
-        const Headers headers,
-        const Query query,
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
         const std::size_t reserve)
 {
-    return exec([this, path, headers, query, reserve]()->Response
+    GetResumption resume(headers);
+
+    return exec("GET", path, [this, &resume, path, query, reserve]()->Response
+    {
+        const Headers headers(resume.headers());
+        if (!m_pool.m_hedge)
+        {
+            Response res(m_curl.get(path, headers, query, reserve));
+            return resume.complete(std::move(res), m_curl.m_partialCode);
+        }
+
+        Response res(
+                m_pool.hedge(
+                    m_curl,
+                    hostOf(path),
+                    [&path, &headers, &query, reserve](Curl& curl)
+                    {
+                        curl.prepareGet(path, headers, query, reserve);
+                    },
+                    m_substituted));
+
+        // A substituted response is only ever one which was received.
+        return resume.complete(
+                std::move(res),
+                m_substituted ? 0 : m_curl.m_partialCode);
+    });
+}
+
+Response Resource::get(
+        const std::string& path,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const Headers& headers,
+        const Query& query)
+{
+    GetResumption resume(headers);
+
+    return exec("GET", path, [this, &resume, path, &sink, query]()->Response
     {
-        return m_curl.get(path, headers, query, reserve);
+        const bool resuming(resume.resuming());
+        bool started(false);
+        std::size_t skip(0);
+
+        const std::function<void(const char*, std::size_t)> forward(
+                [&](const char* data, const std::size_t size)
+        {
+            // A server ignoring our range sends the whole body again, of
+            // which the caller has already had the start.
+            if (!started && resuming &&
+                    !m_curl.m_receivedHeaders.count("Content-Range"))
+            {
+                if (resume.ranged())
+                {
+                    throw ArbiterError("Could not resume " + path);
+                }
+                skip = resume.offset();
+            }
+            started = true;
+
+            const std::size_t skipped((std::min)(skip, size));
+            skip -= skipped;
+            if (size > skipped)
+            {
+                sink(data + skipped, size - skipped);
+                resume.advance(size - skipped);
+            }
+        });
+
+        Response res(m_curl.get(path, resume.headers(), query, forward));
+
+        // Nothing the caller has had is sent to it again, so a transfer cut
+        // short may be retried after all.
+        if (m_curl.m_partialCode &&
+                resume.resumable(m_curl.m_partialCode, res.headers()))
+        {
+            m_curl.m_streamed = false;
+        }
+        return res;
     });
 }
 
 Response Resource::head(
-        const std::string path,
-        const Headers headers,
-        const Query query)
+        const std::string& path,
+        const Headers& headers,
+        const Query& query)
 {
-    return exec([this, path, headers, query]()->Response
+    return exec("HEAD", path, [this, path, headers, query]()->Response
     {
         return m_curl.head(path, headers, query);
     });
 }
 
+Response Resource::del(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query)
+{
+    return exec("DELETE", path, [this, path, headers, query]()->Response
+    {
+        return m_curl.del(path, headers, query);
+    });
+}
+
 Response Resource::put(
-        std::string path,
+        const std::string& path,
         const std::vector<char>& data,
-        const Headers headers,
-        const Query query)
+        const Headers& headers,
+        const Query& query)
 {
-    return exec([this, path, &data, headers, query]()->Response
+    return put(path, data.data(), data.size(), headers, query);
+}
+
+Response Resource::put(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query)
+{
+    auto f([this, path, data, size, headers, query]()->Response
     {
-        return m_curl.put(path, data, headers, query);
+        return m_curl.put(path, data, size, headers, query);
     });
+    return exec("PUT", path, f);
 }
 
 Response Resource::post(
-        std::string path,
+        const std::string& path,
         const std::vector<char>& data,
-        const Headers headers,
-        const Query query)
+        const Headers& headers,
+        const Query& query)
+{
+    return post(path, data.data(), data.size(), headers, query);
+}
+
+Response Resource::post(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query)
+{
+    auto f([this, path, data, size, headers, query]()->Response
+    {
+        return m_curl.post(path, data, size, headers, query);
+    });
+    return exec("POST", path, f);
+}
+
+Response Resource::post(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size,
+        const std::function<void(const char*, std::size_t)>& sink,
+        const Headers& headers,
+        const Query& query)
+{
+    auto f([this, path, data, size, &sink, headers, query]()->Response
+    {
+        return m_curl.post(path, data, size, headers, query, sink);
+    });
+    return exec("POST", path, f);
+}
+
+Response Resource::put(
+        const std::string& path,
+        const std::function<std::size_t(char*, std::size_t)>& source,
+        const std::size_t size,
+        const Headers& headers,
+        const Query& query)
 {
-    return exec([this, path, &data, headers, query]()->Response
+    auto f([this, path, &source, size, headers, query]()->Response
     {
-        return m_curl.post(path, data, headers, query);
+        return m_curl.put(path, source, size, headers, query);
     });
+    return exec("PUT", path, f);
 }
 
-Response Resource::exec(std::function<Response()> f)
+Response Resource::exec(
+        const char* const method,
+        const std::string& path,
+        std::function<Response()> f)
 {
-    Response res;
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start(Clock::now());
+
+    RetryPolicy::Duration delay(0);
     std::size_t tries(0);
 
-    do
+    CircuitBreaker* const breaker(m_pool.breaker());
+    Throttle* const throttle(m_pool.throttle());
+    const std::string host(
+            breaker || throttle ? hostOf(path) : std::string());
+    if (!m_pool.admit(host, false)) return circuitOpen(host);
+
+    // A cancellation cuts our waits short.
+    auto sleep([](const RetryPolicy::Duration d)
+    {
+        if (!d.count()) return;
+        if (const CancelToken* token = CancelScope::current())
+        {
+            if (!token->sleep(d)) token->check();
+        }
+        else std::this_thread::sleep_for(d);
+    });
+
+    // The elapsed time includes the wait for our handle.
+    auto report([&](const Response& res)
     {
-        res = f();
+        if (!m_pool.m_slowLog) return;
+        m_pool.recordSlow(
+                method,
+                path,
+                res,
+                tries,
+                Clock::now() - start + m_wait,
+                m_wait);
+    });
+
+    for ( ; ; ++tries)
+    {
+        CancelScope::check();
+
+        // Wait out any pause of our host, whoever was throttled.
+        if (throttle) sleep(throttle->remaining(host));
+
+        Response res(f());
+        if (!m_substituted) m_pool.record(m_curl, res);
+        if (throttle) m_pool.recordThrottle(host, res);
+
+        // A substituted response is only ever one which was received.
+        const bool retry(
+                (!m_substituted && m_curl.failed()) ?
+                    m_curl.transient() : m_retry.retryable(res));
+        if (breaker) breaker->record(host, retry);
+
+        if (tries >= m_retry.count() || m_curl.m_streamed || !retry)
+        {
+            report(res);
+            return res;
+        }
+
+        delay = m_retry.delay(delay);
+        const RetryPolicy::Duration wait(
+                throttle ?
+                    (std::max)(delay, throttle->remaining(host)) : delay);
+        if ((m_retry.deadline().count() &&
+                    Clock::now() + wait - start > m_retry.deadline()) ||
+                !m_pool.admit(host, true))
+        {
+            report(res);
+            return res;
+        }
+
+        m_pool.recordRetry();
+        ARBITER_PROBE(http__retry, method, path.c_str(), tries + 1,
+                res.code(), static_cast<long long>(wait.count()));
+
+        sleep(wait);
     }
-    while (res.serverError() && tries++ < m_retry);
+}
 
-    return res;
+///////////////////////////////////////////////////////////////////////////////
+
+RetryPolicy::RetryPolicy(const std::size_t count, const std::string s)
+    : m_count(count)
+{
+    const json c(s.size() ? json::parse(s) : json::object());
+    if (!c.is_object()) return;
+
+    m_count = c.value("count", m_count);
+    m_baseDelay = Duration(c.value("baseDelay", m_baseDelay.count()));
+    m_maxDelay = Duration(c.value("maxDelay", m_maxDelay.count()));
+    m_deadline = Duration(c.value("deadline", m_deadline.count()));
+
+    if (m_maxDelay < m_baseDelay) m_maxDelay = m_baseDelay;
+}
+
+bool RetryPolicy::retryable(const Response& res) const
+{
+    return res.serverError() || res.code() == 429;
+}
+
+RetryPolicy::Duration RetryPolicy::delay(const Duration previous) const
+{
+    // Decorrelated jitter: a random delay between the base and three times
+    // the previous delay, capped at the maximum.
+    const auto lo(m_baseDelay.count());
+    const auto hi((std::max)(lo, previous.count() * 3));
+    const auto range(static_cast<uint64_t>(hi - lo) + 1);
+
+    const Duration next(
+            lo + static_cast<Duration::rep>(randomNumber() % range));
+    return (std::min)(next, m_maxDelay);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-Pool::Pool(
-        const std::size_t concurrent,
-        const std::size_t retry,
+ConcurrencyLimit::ConcurrencyLimit(
+        const std::size_t initial,
         const std::string s)
-    : m_curls(concurrent)
-    , m_available(concurrent)
-    , m_retry(retry)
-    , m_mutex()
-    , m_cv()
+    : m_max(initial * 8)
+    , m_value(initial)
+    , m_lastDecrease()
 {
-#ifdef ARBITER_CURL
-    curl_global_init(CURL_GLOBAL_ALL);
+    const json c(s.size() ? json::parse(s) : json());
+    if (c.is_object())
+    {
+        m_min = (std::max)(c.value("min", m_min), std::size_t(1));
+        m_max = c.value("max", m_max);
+    }
 
-    const json config(s.size() ? json::parse(s) : json::object());
+    m_max = (std::max)(m_max, m_min);
+    m_value = (std::min)((std::max)(m_value, double(m_min)), double(m_max));
+}
 
-    for (std::size_t i(0); i < concurrent; ++i)
+bool ConcurrencyLimit::update(const Response& res)
+{
+    // Only one decrease is applied per interval, since many requests will
+    // already be in flight by the time we hear of throttling.
+    static const std::chrono::milliseconds decreaseInterval(500);
+
+    if (res.code() == 503 || res.code() == 429)
     {
-        m_available[i] = i;
-        m_curls[i].reset(new Curl(config.dump()));
+        const Clock::time_point now(Clock::now());
+        if (now - m_lastDecrease > decreaseInterval)
+        {
+            m_lastDecrease = now;
+            m_value = (std::max)(m_value * 0.7, double(m_min));
+        }
+        return false;
     }
-#endif
+
+    if (res.serverError() || m_value >= m_max) return false;
+
+    const std::size_t before(get());
+    m_value = (std::min)(m_value + 1.0 / m_value, double(m_max));
+    return get() > before;
 }
 
-Pool::~Pool() { }
+///////////////////////////////////////////////////////////////////////////////
 
-Resource Pool::acquire()
+HedgePolicy::HedgePolicy(const std::string s)
 {
-    if (m_curls.empty())
+    const json c(s.size() ? json::parse(s) : json());
+    if (c.is_object())
     {
-        throw std::runtime_error("Cannot acquire from empty pool");
+        m_percentile = c.value("percentile", m_percentile);
+        m_minDelay = Duration(c.value("minDelay", m_minDelay.count()));
+        m_maxDelay = Duration(c.value("maxDelay", m_maxDelay.count()));
+        m_samples = c.value("samples", m_samples);
     }
 
-    std::unique_lock<std::mutex> lock(m_mutex);
-    m_cv.wait(lock, [this]()->bool { return !m_available.empty(); });
+    m_percentile = (std::min)((std::max)(m_percentile, 0.0), 100.0);
+    m_samples = (std::max)(m_samples, std::size_t(1));
+    if (m_maxDelay < m_minDelay) m_maxDelay = m_minDelay;
+}
 
-    const std::size_t id(m_available.back());
-    Curl& curl(*m_curls[id]);
+HedgePolicy::Duration HedgePolicy::delay() const
+{
+    // Too few times to say much about the tail, so be conservative.
+    const std::size_t enough((std::min)(m_samples, std::size_t(20)));
+    if (m_times.size() < enough) return m_maxDelay;
 
-    m_available.pop_back();
+    std::vector<Duration> times(m_times);
+    const std::size_t i(
+            (std::min)(
+                static_cast<std::size_t>(times.size() * m_percentile / 100),
+                times.size() - 1));
+    std::nth_element(times.begin(), times.begin() + i, times.end());
 
-    return Resource(*this, curl, id, m_retry);
+    return (std::min)((std::max)(times[i], m_minDelay), m_maxDelay);
 }
 
-void Pool::release(const std::size_t id)
+void HedgePolicy::record(const Duration firstByte)
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    m_available.push_back(id);
-    lock.unlock();
+    if (m_times.size() < m_samples) m_times.push_back(firstByte);
+    else m_times[m_next] = firstByte;
+
+    m_next = (m_next + 1) % m_samples;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CircuitBreaker::CircuitBreaker(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (c.is_object())
+    {
+        m_threshold = c.value("threshold", m_threshold);
+        m_cooldown = Duration(c.value("cooldown", m_cooldown.count()));
+        m_retryRatio = c.value("retryRatio", m_retryRatio);
+        m_retryBurst = c.value("retryBurst", m_retryBurst);
+    }
+
+    m_threshold = (std::max)(m_threshold, std::size_t(1));
+    m_retryRatio = (std::max)(m_retryRatio, 0.0);
+    m_retryBurst = (std::max)(m_retryBurst, 0.0);
+}
+
+CircuitBreaker::Host& CircuitBreaker::host(const std::string& name)
+{
+    auto it(m_hosts.find(name));
+    if (it == m_hosts.end())
+    {
+        it = m_hosts.insert(std::make_pair(name, Host())).first;
+        it->second.tokens = m_retryBurst;
+    }
+    return it->second;
+}
+
+bool CircuitBreaker::admit(Host& h)
+{
+    if (h.state == State::Closed) return true;
+
+    const Clock::time_point now(Clock::now());
+    if (h.state == State::Open)
+    {
+        if (now - h.opened < m_cooldown) return false;
+        h.state = State::HalfOpen;
+    }
+    else if (now - h.probed < m_cooldown)
+    {
+        // A probe is in flight.
+        return false;
+    }
+
+    // Let through a probe, or another if the last one never reported back.
+    h.probed = now;
+    return true;
+}
+
+bool CircuitBreaker::allow(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Host& h(host(name));
+    if (!admit(h)) return false;
+
+    h.tokens = (std::min)(h.tokens + m_retryRatio, m_retryBurst);
+    return true;
+}
+
+bool CircuitBreaker::retry(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Host& h(host(name));
+    if (h.tokens < 1 || !admit(h)) return false;
+
+    h.tokens -= 1;
+    return true;
+}
+
+void CircuitBreaker::record(const std::string& name, const bool failed)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Host& h(host(name));
+
+    if (!failed)
+    {
+        h.state = State::Closed;
+        h.failures = 0;
+        return;
+    }
+
+    // Failures of requests begun before the circuit opened don't prolong
+    // its cooldown.
+    ++h.failures;
+    if (h.state == State::HalfOpen ||
+            (h.state == State::Closed && h.failures >= m_threshold))
+    {
+        h.state = State::Open;
+        h.opened = Clock::now();
+    }
+}
+
+CircuitBreaker::State CircuitBreaker::state(const std::string& name) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it(m_hosts.find(name));
+    return it != m_hosts.end() ? it->second.state : State::Closed;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Throttle::Throttle(const std::string s)
+{
+    const json c(s.size() ? json::parse(s) : json());
+    if (c.is_object())
+    {
+        m_pause = Duration(c.value("pause", m_pause.count()));
+        m_maxPause = Duration(c.value("maxPause", m_maxPause.count()));
+    }
+
+    m_pause = (std::max)(m_pause, Duration(1));
+    m_maxPause = (std::max)(m_maxPause, m_pause);
+}
+
+bool Throttle::record(const std::string& name, const Response& res)
+{
+    const Duration after(retryAfter(res));
+    const bool throttled(
+            res.code() == 429 ||
+            res.code() == 503 ||
+            (res.serverError() && after.count()));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!throttled)
+    {
+        const auto it(m_hosts.find(name));
+        if (it != m_hosts.end()) it->second.streak = 0;
+        return false;
+    }
+
+    Host& h(m_hosts[name]);
+    const Clock::time_point now(Clock::now());
+
+    // Responses to requests sent before the pause began say nothing new,
+    // unless they ask for longer.
+    if (now < h.until && !after.count()) return true;
+
+    Duration pause(after);
+    if (!pause.count())
+    {
+        const std::size_t doublings((std::min)(h.streak, std::size_t(16)));
+        pause = m_pause * (std::size_t(1) << doublings);
+        ++h.streak;
+    }
+    pause = (std::min)(pause, m_maxPause);
+
+    h.until = (std::max)(h.until, now + pause);
+    return true;
+}
+
+Throttle::Duration Throttle::remaining(const std::string& name) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it(m_hosts.find(name));
+    if (it == m_hosts.end()) return Duration(0);
+
+    const Clock::time_point now(Clock::now());
+    if (it->second.until <= now) return Duration(0);
+
+    // Round up, so that the pause has passed once this has been waited.
+    return std::chrono::duration_cast<Duration>(
+            it->second.until - now) + Duration(1);
+}
+
+Throttle::Duration Throttle::retryAfter(const Response& res)
+{
+    const Headers& headers(res.headers());
+    auto it(headers.find("Retry-After"));
+    if (it == headers.end()) it = headers.find("retry-after");
+    if (it == headers.end() || it->second.empty()) return Duration(0);
+
+    const std::string& value(it->second);
+    if (std::all_of(value.begin(), value.end(), ::isdigit))
+    {
+        return Duration(std::strtoull(value.c_str(), nullptr, 10) * 1000);
+    }
+
+    try
+    {
+        const std::int64_t seconds(
+                Time(value, "%a, %d %b %Y %H:%M:%S GMT") - Time());
+        return Duration((std::max)(seconds, std::int64_t(0)) * 1000);
+    }
+    catch (...)
+    {
+        return Duration(0);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct Pool::Request
+{
+    using Clock = std::chrono::steady_clock;
+
+    Request(std::string host, std::function<void(Curl&)> prepare)
+        : host(host)
+        , prepare(prepare)
+        , priority(static_cast<std::size_t>(PriorityScope::current()))
+        , created(Clock::now())
+        , progress(ProgressScope::current())
+    {
+        if (const CancelToken* token = CancelScope::current())
+        {
+            cancel.reset(new CancelToken(*token));
+        }
+    }
+
+    std::string host;
+    std::function<void(Curl&)> prepare;
+    std::promise<Response> promise;
+    std::size_t tries = 0;
+
+    // For the slow log.
+    const char* method = "GET";
+    Clock::time_point started;
+
+    // If set, the future of the promise is held here and handed to this
+    // once the promise is satisfied, rather than returned to the caller.
+    Completion<Response> done;
+    std::future<Response> future;
+
+    void finish(Response res)
+    {
+        promise.set_value(std::move(res));
+        if (done) done(std::move(future));
+    }
+
+    void fail(std::exception_ptr error)
+    {
+        promise.set_exception(error);
+        if (done) done(std::move(future));
+    }
+
+    std::vector<char> data;
+    std::size_t priority;
+
+    Clock::time_point created;
+    RetryPolicy::Duration delay = RetryPolicy::Duration(0);
+
+    // The token of the caller, which is made current while each attempt is
+    // prepared, since that may happen on another thread.
+    std::unique_ptr<CancelToken> cancel;
+
+    // Likewise the Progress of the caller, if any.
+    Progress* progress;
+};
+
+Pool::FreeList::FreeList(const std::size_t capacity)
+    : m_head(none)
+    , m_next(new std::atomic<std::uint32_t>[capacity])
+{ }
+
+void Pool::FreeList::push(const std::size_t id)
+{
+    std::uint64_t head(m_head.load());
+    std::uint64_t next(0);
+    do
+    {
+        m_next[id] = static_cast<std::uint32_t>(head);
+        next = ((head >> 32) + 1) << 32 | id;
+    }
+    while (!m_head.compare_exchange_weak(head, next));
+}
+
+bool Pool::FreeList::pop(std::size_t& id)
+{
+    std::uint64_t head(m_head.load());
+    std::uint64_t next(0);
+    do
+    {
+        const std::uint32_t top(static_cast<std::uint32_t>(head));
+        if (top == none) return false;
+
+        id = top;
+        next = ((head >> 32) + 1) << 32 | m_next[top];
+    }
+    while (!m_head.compare_exchange_weak(head, next));
+
+    return true;
+}
+
+bool Pool::FreeList::empty() const
+{
+    return static_cast<std::uint32_t>(m_head.load()) == none;
+}
+
+bool Pool::Host::queued() const
+{
+    return std::any_of(
+            queues.begin(),
+            queues.end(),
+            [](const std::deque<std::shared_ptr<Request>>& q)
+            {
+                return !q.empty();
+            });
+}
+
+Pool::Pool(
+        const std::size_t concurrent,
+        const std::size_t retry,
+        const std::string s)
+    : m_curls()
+    , m_size(0)
+    , m_shrinking(false)
+    , m_available()
+    , m_inFlight(0)
+    , m_waiting(0)
+    , m_retry(
+            retry,
+            ([&s]()
+            {
+                const json c(s.size() ? json::parse(s) : json::object());
+                if (!c.is_object()) return json().dump();
+                return c.value("http", json::object())
+                    .value("retry", json()).dump();
+            })())
+    , m_waits(new std::atomic<std::uint64_t>[PoolStats::waitBuckets])
+    , m_mutex()
+    , m_cv()
+{
+    for (std::size_t i(0); i < PoolStats::waitBuckets; ++i) m_waits[i] = 0;
+
+    m_pending.fill(0);
+    m_pass.fill(0);
+    m_stride = strides(json::object());
+
+#ifdef ARBITER_CURL
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    const json config(s.size() ? json::parse(s) : json::object());
+
+    const json http(
+            config.is_object() ?
+                config.value("http", json::object()) : json::object());
+
+    if (auto v = env("ARBITER_HTTP_ASYNC")) m_async = !!std::stol(*v);
+    else m_async = http.value("async", false);
+
+    if (auto v = env("ARBITER_HTTP_CHUNK_SIZE")) m_chunkSize = std::stoul(*v);
+    else m_chunkSize = http.value("chunkSize", std::size_t(0));
+
+    m_multiRange = http.value("multiRange", false);
+    m_perHost = http.value("perHost", std::size_t(0));
+
+    const json affinity(
+            config.is_object() ?
+                config.value("affinity", json::object()) : json::object());
+    if (affinity.is_object())
+    {
+        m_ioAffinity = Affinity::create(affinity.value("io", json()).dump());
+    }
+    m_slowLog = SlowLog::create(http.value("slowLog", json()).dump());
+
+    const json priority(http.value("priority", json()));
+    if (priority.is_object()) m_stride = strides(priority);
+
+    // Handles share their settings, which are parsed only once.
+    m_curlConfig = CurlConfig::create(config.dump());
+    m_verify = m_curlConfig->verify;
+
+    const json adaptive(http.value("adaptive", json()));
+    if (adaptive.is_object() || (adaptive.is_boolean() && adaptive.get<bool>()))
+    {
+        m_limit.reset(new ConcurrencyLimit(concurrent, adaptive.dump()));
+    }
+
+    const json hedge(http.value("hedge", json()));
+    if (hedge.is_object() || (hedge.is_boolean() && hedge.get<bool>()))
+    {
+        m_hedge.reset(new HedgePolicy(hedge.dump()));
+    }
+
+    const json breaker(http.value("breaker", json()));
+    if (breaker.is_object() || (breaker.is_boolean() && breaker.get<bool>()))
+    {
+        m_breaker.reset(new CircuitBreaker(breaker.dump()));
+    }
+
+    const json throttle(http.value("throttle", json()));
+    if (!throttle.is_boolean() || throttle.get<bool>())
+    {
+        m_throttle.reset(new Throttle(throttle.dump()));
+    }
+
+    if (http.value("share", true)) m_share.reset(new Share());
+
+    const json bandwidth(http.value("bandwidth", json()));
+    if (bandwidth.is_object())
+    {
+        if (const std::uint64_t recv = bandwidth.value("recv", 0ULL))
+        {
+            m_recvLimit.reset(new RateLimit(recv));
+        }
+        if (const std::uint64_t send = bandwidth.value("send", 0ULL))
+        {
+            m_sendLimit.reset(new RateLimit(send));
+        }
+    }
+
+    m_buffers = SlabPool::create(http.value("buffers", json()).dump());
+
+    // With an adaptive limit, we need enough handles for its maximum.
+    // Otherwise we leave room to grow.
+    const std::size_t handles(m_limit ? m_limit->max() : concurrent);
+    const std::size_t capacity(
+            m_limit ?
+                handles :
+                (std::max)(
+                    handles,
+                    http.value("maxConcurrency", std::size_t(1024))));
+
+    m_curls.resize(capacity);
+    m_handleHosts.resize(capacity);
+
+    if (!m_perHost && !m_limit && m_share)
+    {
+        m_free.reset(new FreeList(capacity));
+    }
+
+    // An adaptive limit creates the rest of its handles as it grows.
+    const std::size_t created(m_limit ? m_limit->get() : handles);
+    for (std::size_t id(capacity); id > created; --id)
+    {
+        m_spare.push_back(id - 1);
+    }
+    for (std::size_t id(0); id < created; ++id) add(id);
+    m_size = handles;
+
+    const json warming(http.value("warm", json()));
+    if (warming.is_object())
+    {
+        warm(
+                warming.value("urls", std::vector<std::string>()),
+                warming.value("count", std::size_t(1)));
+    }
+#endif
+}
+
+Pool::~Pool() { }
+
+void Pool::buffers(std::shared_ptr<BufferPool> buffers)
+{
+    m_buffers = buffers;
+    for (auto& curl : m_curls)
+    {
+        if (curl) curl->m_buffers = m_buffers;
+    }
+}
+
+void Pool::resize(const std::size_t concurrent)
+{
+    if (!concurrent) throw ArbiterError("Pool must have at least one handle");
+    if (m_limit)
+    {
+        throw ArbiterError("Cannot resize a pool with an adaptive limit");
+    }
+    if (concurrent > m_curls.size())
+    {
+        throw ArbiterError(
+                "Cannot grow pool beyond its maxConcurrency of " +
+                std::to_string(m_curls.size()));
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_size = concurrent;
+
+    while (m_live < concurrent)
+    {
+        const std::size_t id(m_spare.back());
+        m_spare.pop_back();
+        add(id);
+    }
+
+    // Idle handles are retired right away, and those in flight as they are
+    // released.
+    std::size_t id(0);
+    while (m_live > concurrent)
+    {
+        if (m_free)
+        {
+            if (!m_free->pop(id)) break;
+        }
+        else
+        {
+            if (m_available.empty()) break;
+            id = m_available.front();
+            m_available.erase(m_available.begin());
+        }
+        retire(id);
+    }
+    m_shrinking = m_live > m_size;
+
+    serve(lock);
+}
+
+void Pool::add(const std::size_t id)
+{
+    std::unique_ptr<Curl> curl(new Curl(m_curlConfig));
+    curl->m_share = m_share.get();
+    curl->m_recvLimit = m_recvLimit.get();
+    curl->m_sendLimit = m_sendLimit.get();
+    curl->m_buffers = m_buffers;
+    if (m_async) curl->m_multi = &multi();
+
+    m_curls[id] = std::move(curl);
+    ++m_live;
+
+    if (m_free) m_free->push(id);
+    else m_available.push_back(id);
+}
+
+bool Pool::retire(const std::size_t id)
+{
+    if (m_live <= m_size) return false;
+
+    m_curls[id].reset();
+    m_handleHosts[id].clear();
+    m_spare.push_back(id);
+    --m_live;
+
+    m_shrinking = m_live > m_size;
+    return true;
+}
+
+Resource Pool::acquire(const std::string url)
+{
+    if (m_curls.empty())
+    {
+        throw std::runtime_error("Cannot acquire from empty pool");
+    }
+
+    // While others are waiting, a free handle is theirs to hand out by
+    // priority rather than ours to take.
+    std::size_t id(0);
+    if (m_free && !m_waiting && m_free->pop(id))
+    {
+        ++m_inFlight;
+        recordWait(std::chrono::steady_clock::duration(0));
+        return Resource(*this, *m_curls[id], id, m_retry);
+    }
+
+    const auto begin(std::chrono::steady_clock::now());
+    const std::size_t p(static_cast<std::size_t>(PriorityScope::current()));
+    Waiter waiter(hostOf(url));
+    ARBITER_PROBE(acquire__start, this, waiter.host.c_str());
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_waiters[p].push_back(&waiter);
+    enqueue(p);
+    serve(lock);
+    m_cv.wait(lock, [&waiter]() { return waiter.granted; });
+    lock.unlock();
+
+    const auto wait(std::chrono::steady_clock::now() - begin);
+    recordWait(wait);
+    ARBITER_PROBE(acquire__done, this, waiter.id, static_cast<long long>(
+            std::chrono::duration_cast<std::chrono::microseconds>(wait)
+                .count()));
+    return Resource(*this, *m_curls[waiter.id], waiter.id, m_retry, wait);
+}
+
+void Pool::release(const std::size_t id)
+{
+    if (m_free)
+    {
+        --m_inFlight;
+
+        if (m_shrinking)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (retire(id)) return;
+        }
+
+        m_free->push(id);
+
+        // Having pushed our handle before checking for waiters, either we
+        // see them here or they see our handle.
+        if (!m_waiting) return;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        serve(lock);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    --m_inFlight;
+
+    auto it(m_hosts.find(m_handleHosts[id]));
+    if (!--it->second.inFlight && !it->second.queued()) m_hosts.erase(it);
+
+    if (!retire(id)) m_available.push_back(id);
+
+    serve(lock);
+}
+
+void Pool::record(const Curl& curl, const Response& res)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        if (curl.failed()) ++m_stats.failures;
+        else ++m_stats.codes[res.code()];
+        m_stats.bytesSent += res.transfer().bytesSent;
+        m_stats.bytesReceived += res.transfer().bytesReceived;
+    }
+
+    if (!m_limit) return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_limit->update(res)) return;
+
+    // Our limit has grown, so more requests may be able to start.
+    serve(lock);
+}
+
+Response Pool::hedge(
+        Curl& curl,
+        const std::string& host,
+        const std::function<void(Curl&)>& prepare,
+        bool& substituted)
+{
+    // The progress of our transfers, which is updated from the I/O thread.
+    struct Race
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool started = false;
+        bool done[2] = { false, false };
+        int codes[2] = { 0, 0 };
+    };
+
+    substituted = false;
+
+    Multi& engine(multi());
+    auto race(std::make_shared<Race>());
+    Curl* curls[2] = { &curl, nullptr };
+
+    auto run([&engine, race](Curl& c, const int i)
+    {
+        engine.add(c.m_curl, [race, i](int code)
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            race->done[i] = true;
+            race->codes[i] = code;
+            race->cv.notify_all();
+        });
+    });
+
+    HedgePolicy::Duration delay(0);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        delay = m_hedge->delay();
+    }
+
+    prepare(curl);
+    curl.m_onResponse = [race]()
+    {
+        std::lock_guard<std::mutex> lock(race->mutex);
+        race->started = true;
+        race->cv.notify_all();
+    };
+    run(curl, 0);
+
+    std::unique_lock<std::mutex> lock(race->mutex);
+    race->cv.wait_for(lock, delay, [&race]()
+    {
+        return race->started || race->done[0];
+    });
+    bool hedged(!race->started && !race->done[0]);
+    lock.unlock();
+
+    // Only hedge with a handle which is free right now and not owed to
+    // any waiting request: waiting for one would only add to the latency
+    // we're trying to avoid.
+    std::size_t id(0);
+    if (hedged)
+    {
+        std::lock_guard<std::mutex> poolLock(m_mutex);
+        hedged = !m_waiting && take(host, id);
+    }
+
+    if (hedged)
+    {
+        std::lock_guard<std::mutex> statsLock(m_statsMutex);
+        ++m_stats.hedges;
+    }
+
+    if (hedged)
+    {
+        curls[1] = m_curls[id].get();
+
+        try
+        {
+            prepare(*curls[1]);
+            run(*curls[1], 1);
+        }
+        catch (...)
+        {
+            release(id);
+            hedged = false;
+        }
+    }
+
+    // The first transfer to complete without error wins, and if neither
+    // does, the original is the one reported.
+    int winner(-1);
+    lock.lock();
+    race->cv.wait(lock, [&race, &winner, hedged]()
+    {
+        for (int i(0); i < (hedged ? 2 : 1); ++i)
+        {
+            if (race->done[i] && !race->codes[i])
+            {
+                winner = i;
+                return true;
+            }
+        }
+        return race->done[0] && (!hedged || race->done[1]);
+    });
+    if (winner < 0) winner = 0;
+    const int loser(1 - winner);
+    lock.unlock();
+
+    if (hedged)
+    {
+        engine.cancel(curls[loser]->m_curl);
+
+        lock.lock();
+        race->cv.wait(lock, [&race, loser]() { return race->done[loser]; });
+        lock.unlock();
+
+        // The losing response is discarded, but its handle must be reset.
+        try { curls[loser]->finish(race->codes[loser]); }
+        catch (...) { }
+    }
+
+    Response res(0, std::vector<char>());
+    try
+    {
+        res = curls[winner]->finish(race->codes[winner]);
+    }
+    catch (...)
+    {
+        if (hedged) release(id);
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> poolLock(m_mutex);
+        if (!curls[winner]->failed())
+        {
+            m_hedge->record(
+                    std::chrono::duration_cast<HedgePolicy::Duration>(
+                        res.transfer().firstByte));
+        }
+    }
+
+    if (winner)
+    {
+        std::lock_guard<std::mutex> statsLock(m_statsMutex);
+        ++m_stats.hedgesWon;
+    }
+
+    if (winner)
+    {
+        record(*curls[1], res);
+        substituted = true;
+    }
+
+    if (hedged) release(id);
+    return res;
+}
+
+void Pool::recordSlow(
+        const char* const method,
+        const std::string& url,
+        const Response& res,
+        const std::size_t retries,
+        const std::chrono::steady_clock::duration elapsed,
+        const std::chrono::steady_clock::duration wait)
+{
+    if (!m_slowLog->slow(elapsed)) return;
+
+    using Duration = SlowRequest::Duration;
+
+    SlowRequest req;
+    req.source = "http";
+    req.operation = method;
+    req.path = url;
+    const std::string host(hostOf(url));
+    const std::size_t scheme(host.find("://"));
+    req.host = scheme == std::string::npos ? host : host.substr(scheme + 3);
+    req.code = res.code();
+    req.retries = retries;
+    req.transfer = res.transfer();
+    req.bytes = req.transfer.bytesSent + req.transfer.bytesReceived;
+    req.elapsed = std::chrono::duration_cast<Duration>(elapsed);
+    req.wait = std::chrono::duration_cast<Duration>(wait);
+    m_slowLog->report(req);
+}
+
+void Pool::recordRetry()
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    ++m_stats.retries;
+}
+
+bool Pool::admit(const std::string& host, const bool retry)
+{
+    if (!m_breaker) return true;
+    if (retry ? m_breaker->retry(host) : m_breaker->allow(host)) return true;
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    ++(retry ? m_stats.retriesDenied : m_stats.rejected);
+    return false;
+}
+
+void Pool::recordThrottle(const std::string& host, const Response& res)
+{
+    if (!m_throttle || !m_throttle->record(host, res)) return;
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    ++m_stats.throttled;
+}
+
+void Pool::recordWait(const std::chrono::steady_clock::duration wait)
+{
+    const auto us(
+            std::chrono::duration_cast<std::chrono::microseconds>(wait)
+                .count());
+
+    std::size_t bucket(0);
+    while (bucket < PoolStats::waitBuckets - 1 && (1LL << bucket) <= us)
+    {
+        ++bucket;
+    }
+
+    ++m_waits[bucket];
+}
+
+PoolStats Pool::stats() const
+{
+    PoolStats stats;
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        stats = m_stats;
+    }
+
+    for (std::size_t i(0); i < PoolStats::waitBuckets; ++i)
+    {
+        stats.waits[i] = m_waits[i];
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.inFlight = m_inFlight;
+    stats.queued = m_waiting;
+    return stats;
+}
+
+std::string PoolStats::toJson() const
+{
+    json j;
+
+    json w(json::array());
+    for (std::size_t i(0); i < waits.size(); ++i)
+    {
+        if (!waits[i]) continue;
+        const bool last(i == waits.size() - 1);
+        w.push_back({
+            { "lessThanMicros", last ? json() : json(1ULL << i) },
+            { "count", waits[i] }
+        });
+    }
+    j["waits"] = w;
+
+    json c(json::object());
+    for (const auto& p : codes) c[std::to_string(p.first)] = p.second;
+    j["codes"] = c;
+
+    j["inFlight"] = inFlight;
+    j["queued"] = queued;
+    j["failures"] = failures;
+    j["retries"] = retries;
+    j["hedges"] = hedges;
+    j["hedgesWon"] = hedgesWon;
+    j["rejected"] = rejected;
+    j["retriesDenied"] = retriesDenied;
+    j["throttled"] = throttled;
+    j["bytesSent"] = bytesSent;
+    j["bytesReceived"] = bytesReceived;
+
+    return j.dump();
+}
+
+std::size_t Pool::concurrency() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limit ? m_limit->get() : m_size.load();
+}
+
+bool Pool::canStart() const
+{
+    if (m_free) return !m_free->empty();
+    if (m_limit)
+    {
+        return (m_available.size() || m_spare.size()) &&
+            m_inFlight < m_limit->get();
+    }
+    return !m_available.empty();
+}
+
+bool Pool::canStart(const std::string& host) const
+{
+    if (!canStart()) return false;
+    if (!m_perHost) return true;
+
+    const auto it(m_hosts.find(host));
+    return it == m_hosts.end() || it->second.inFlight < m_perHost;
+}
+
+bool Pool::take(const std::string& host, std::size_t& id)
+{
+    if (m_free)
+    {
+        if (!m_free->pop(id)) return false;
+        ++m_inFlight;
+        return true;
+    }
+
+    if (!canStart(host)) return false;
+    if (m_available.empty())
+    {
+        const std::size_t spare(m_spare.back());
+        m_spare.pop_back();
+        add(spare);
+    }
+
+    // Prefer the most recently released handle which last spoke to this
+    // host, and otherwise the handle released longest ago, which is the
+    // least likely to be holding a connection worth keeping.
+    auto it(std::find_if(
+            m_available.rbegin(),
+            m_available.rend(),
+            [this, &host](std::size_t id)
+            {
+                return m_handleHosts[id] == host;
+            }));
+
+    id = it != m_available.rend() ? *it : m_available.front();
+    m_available.erase(std::find(m_available.begin(), m_available.end(), id));
+
+    m_handleHosts[id] = host;
+    ++m_hosts[host].inFlight;
+    ++m_inFlight;
+
+    return true;
+}
+
+void Pool::enqueue(const std::size_t p)
+{
+    if (!m_pending[p]) m_pass[p] = (std::max)(m_pass[p], m_lastPass);
+    ++m_pending[p];
+
+    // Count ourselves as waiting before looking for a free handle, so that
+    // a lock-free release either leaves its handle for us or sees us.
+    ++m_waiting;
+}
+
+void Pool::serve(std::unique_lock<std::mutex>& lock)
+{
+    bool granted(false);
+
+    while (m_waiting && canStart())
+    {
+        // The waiting priorities in the order they are due, with ties going
+        // to the more urgent.
+        std::array<std::size_t, priorities> order;
+        std::size_t n(0);
+        for (std::size_t p(0); p < priorities; ++p)
+        {
+            if (m_pending[p]) order[n++] = p;
+        }
+        std::stable_sort(
+                order.begin(),
+                order.begin() + n,
+                [this](std::size_t a, std::size_t b)
+                {
+                    return m_pass[a] < m_pass[b];
+                });
+
+        std::shared_ptr<Request> next;
+        std::size_t id(0);
+        bool served(false);
+
+        for (std::size_t i(0); i < n && !served; ++i)
+        {
+            const std::size_t p(order[i]);
+
+            if (serveQueued(p, next, id)) served = true;
+            else if (serveWaiter(p)) served = granted = true;
+
+            if (served)
+            {
+                m_lastPass = m_pass[p];
+                m_pass[p] += m_stride[p];
+                --m_pending[p];
+                --m_waiting;
+            }
+        }
+
+        // With per-host limits, a handle may be free with none of its
+        // waiters able to use it.
+        if (!served) break;
+
+        if (next)
+        {
+            lock.unlock();
+            start(id, next);
+            lock.lock();
+        }
+    }
+
+    if (granted) m_cv.notify_all();
+}
+
+bool Pool::serveQueued(
+        const std::size_t p,
+        std::shared_ptr<Request>& next,
+        std::size_t& id)
+{
+    // Serve hosts round-robin, beginning after the last one served, so that
+    // a deep queue for one host can't hold up all the others.
+    auto it(m_hosts.upper_bound(m_lastServed[p]));
+
+    for (std::size_t i(0); i < m_hosts.size(); ++i, ++it)
+    {
+        if (it == m_hosts.end()) it = m_hosts.begin();
+
+        auto& queue(it->second.queues[p]);
+        if (queue.size() && take(it->first, id))
+        {
+            next = queue.front();
+            queue.pop_front();
+            recordWait(Request::Clock::now() - next->created);
+            m_lastServed[p] = it->first;
+
+            // Without per-host limits, hosts are only tracked while queued.
+            if (m_free && !it->second.queued()) m_hosts.erase(it);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Pool::serveWaiter(const std::size_t p)
+{
+    auto& waiters(m_waiters[p]);
+    for (auto it(waiters.begin()); it != waiters.end(); ++it)
+    {
+        Waiter& waiter(**it);
+        if (take(waiter.host, waiter.id))
+        {
+            waiter.granted = true;
+            waiters.erase(it);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::future<Response> Pool::getAsync(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const std::size_t reserve)
+{
+    return dispatch(getRequest(path, headers, query, reserve));
+}
+
+std::future<Response> Pool::headAsync(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query)
+{
+    return dispatch(headRequest(path, headers, query));
+}
+
+std::future<Response> Pool::putAsync(
+        const std::string& path,
+        std::vector<char> data,
+        const Headers& headers,
+        const Query& query)
+{
+    return dispatch(putRequest(path, std::move(data), headers, query));
+}
+
+std::future<Response> Pool::postAsync(
+        const std::string& path,
+        std::vector<char> data,
+        const Headers& headers,
+        const Query& query)
+{
+    return dispatch(postRequest(path, std::move(data), headers, query));
+}
+
+void Pool::getAsync(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const std::size_t reserve,
+        Completion<Response> done)
+{
+    dispatch(getRequest(path, headers, query, reserve), done);
+}
+
+void Pool::headAsync(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        Completion<Response> done)
+{
+    dispatch(headRequest(path, headers, query), done);
+}
+
+void Pool::putAsync(
+        const std::string& path,
+        std::vector<char> data,
+        const Headers& headers,
+        const Query& query,
+        Completion<Response> done)
+{
+    dispatch(putRequest(path, std::move(data), headers, query), done);
+}
+
+void Pool::postAsync(
+        const std::string& path,
+        std::vector<char> data,
+        const Headers& headers,
+        const Query& query,
+        Completion<Response> done)
+{
+    dispatch(postRequest(path, std::move(data), headers, query), done);
+}
+
+std::shared_ptr<Pool::Request> Pool::getRequest(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query,
+        const std::size_t reserve) const
+{
+    return std::make_shared<Request>(
+        hostOf(path),
+        [path, headers, query, reserve](Curl& curl)
+        {
+            curl.prepareGet(path, headers, query, reserve);
+        });
+}
+
+std::shared_ptr<Pool::Request> Pool::headRequest(
+        const std::string& path,
+        const Headers& headers,
+        const Query& query) const
+{
+    auto req(std::make_shared<Request>(
+        hostOf(path),
+        [path, headers, query](Curl& curl)
+        {
+            curl.prepareHead(path, headers, query);
+        }));
+    req->method = "HEAD";
+    return req;
+}
+
+std::shared_ptr<Pool::Request> Pool::putRequest(
+        const std::string& path,
+        std::vector<char> data,
+        const Headers& headers,
+        const Query& query) const
+{
+    auto req(std::make_shared<Request>(hostOf(path), nullptr));
+    req->method = "PUT";
+    req->data = std::move(data);
+
+    // The request owns its upload data, so a raw pointer back to it from its
+    // own preparation function is safe.
+    Request* raw(req.get());
+    req->prepare = [raw, path, headers, query](Curl& curl)
+    {
+        curl.preparePut(path, raw->data, headers, query);
+    };
+
+    return req;
+}
+
+std::shared_ptr<Pool::Request> Pool::postRequest(
+        const std::string& path,
+        std::vector<char> data,
+        const Headers& headers,
+        const Query& query) const
+{
+    auto req(std::make_shared<Request>(hostOf(path), nullptr));
+    req->method = "POST";
+    req->data = std::move(data);
+
+    Request* raw(req.get());
+    req->prepare = [raw, path, headers, query](Curl& curl)
+    {
+        curl.preparePost(path, raw->data, headers, query);
+    };
+
+    return req;
+}
+
+std::future<void> Pool::warm(
+        const std::vector<std::string>& urls,
+        const std::size_t count)
+{
+    using Futures = std::vector<std::future<Response>>;
+    auto futures(std::make_shared<Futures>());
+
+    for (const std::string& url : urls)
+    {
+        for (std::size_t i(0); i < count; ++i)
+        {
+            auto req(std::make_shared<Request>(
+                hostOf(url),
+                [url](Curl& curl)
+                {
+                    curl.prepareHead(url, Headers(), Query());
+                }));
+
+            // A warming request is worthless once it has failed.
+            req->tries = m_retry.count();
+            futures->push_back(dispatch(req));
+        }
+    }
+
+    return std::async(std::launch::deferred, [futures]()
+    {
+        for (auto& f : *futures) f.wait();
+    });
+}
+
+Multi& Pool::multi()
+{
+    std::lock_guard<std::mutex> lock(m_multiMutex);
+    if (!m_multi) m_multi.reset(new Multi(m_ioAffinity));
+    return *m_multi;
+}
+
+std::future<Response> Pool::dispatch(
+        std::shared_ptr<Request> req,
+        Completion<Response> done)
+{
+    if (m_curls.empty())
+    {
+        throw std::runtime_error("Cannot acquire from empty pool");
+    }
+
+    // Make sure the engine exists before any handle is checked out.
+    multi();
+
+    std::future<Response> future(req->promise.get_future());
+    if (done)
+    {
+        req->done = done;
+        req->future = std::move(future);
+    }
+
+    if (!admit(req->host, false))
+    {
+        req->finish(circuitOpen(req->host));
+        return future;
+    }
+
+    // Requests join the back of the queue for their host and priority, and
+    // are started right away if a handle is free and nothing is due first.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_hosts[req->host].queues[req->priority].push_back(req);
+    enqueue(req->priority);
+    serve(lock);
+
+    return future;
+}
+
+void Pool::start(
+        const std::size_t id,
+        std::shared_ptr<Request> req,
+        const RetryPolicy::Duration delay)
+{
+    Curl& curl(*m_curls[id]);
+    if (req->started == Request::Clock::time_point())
+    {
+        req->started = Request::Clock::now();
+    }
+
+    try
+    {
+        ProgressScope progress(req->progress);
+        if (req->cancel)
+        {
+            CancelScope scope(*req->cancel);
+            req->prepare(curl);
+        }
+        else req->prepare(curl);
+    }
+    catch (...)
+    {
+        release(id);
+        req->fail(std::current_exception());
+        return;
+    }
+
+    // Nothing is sent to a paused host.
+    const RetryPolicy::Duration wait(
+            m_throttle ?
+                (std::max)(delay, m_throttle->remaining(req->host)) : delay);
+
+    ARBITER_PROBE(http__start, curl.m_curl);
+    multi().add(curl.m_curl, [this, id, req, &curl](int code)
+    {
+        Response res;
+
+        try
+        {
+            res = curl.finish(code);
+            record(curl, res);
+            recordThrottle(req->host, res);
+
+            const bool failed(
+                    curl.failed() ? curl.transient() : m_retry.retryable(res));
+            if (m_breaker) m_breaker->record(req->host, failed);
+
+            if (failed && req->tries < m_retry.count())
+            {
+                // The I/O thread can't sleep, so the engine delays the
+                // restart of this transfer instead, by at least any pause
+                // of its host.
+                req->delay = m_retry.delay(req->delay);
+                const bool expired(
+                        (m_retry.deadline().count() &&
+                            Request::Clock::now() + req->delay - req->created >
+                                m_retry.deadline()) ||
+                        (req->cancel && req->cancel->cancelled()));
+
+                if (!expired && admit(req->host, true))
+                {
+                    recordRetry();
+                    ++req->tries;
+                    start(id, req, req->delay);
+                    return;
+                }
+            }
+
+        }
+        catch (...)
+        {
+            release(id);
+            req->fail(std::current_exception());
+            return;
+        }
+
+        if (m_slowLog)
+        {
+            recordSlow(
+                    req->method,
+                    res.transfer().url,
+                    res,
+                    req->tries,
+                    Request::Clock::now() - req->created,
+                    req->started - req->created);
+        }
+
+        // The handle is released first, so that a completion which
+        // dispatches another request may have it.
+        release(id);
+
+        if (m_compute && res.encoded())
+        {
+            m_compute->post([req, res]() mutable
+            {
+                try { res.decode(); }
+                catch (...)
+                {
+                    req->fail(std::current_exception());
+                    return;
+                }
+                req->finish(std::move(res));
+            });
+            return;
+        }
 
-    m_cv.notify_one();
+        req->finish(std::move(res));
+    }, wait);
 }
 
 } // namepace http
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -11,7 +17,10 @@
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/util/curl.hpp>
+#include <arbiter/util/executor.hpp>
 #include <arbiter/util/exports.hpp>
+#include <arbiter/util/priority.hpp>
+#include <arbiter/util/slowlog.hpp>
 #include <arbiter/util/types.hpp>
 #endif
 
@@ -22,13 +31,24 @@ namespace ARBITER_CUSTOM_NAMESPACE
 
 namespace arbiter
 {
+
 namespace http
 {
 
 /** Perform URI percent-encoding, without encoding characters included in
  * @p exclusions.
  */
-ARBITER_DLL std::string sanitize(std::string path, std::string exclusions = "/");
+ARBITER_DLL std::string sanitize(
+        const std::string& path,
+        const std::string& exclusions = "/");
+
+/** Percent-encode @p path as with sanitize, writing the result into @p out,
+ * whose capacity is reused across calls.
+ */
+ARBITER_DLL void sanitize(
+        const std::string& path,
+        const std::string& exclusions,
+        std::string& out);
 
 /** Build a query string from key-value pairs.  If @p query is empty, the
  * result is an empty string.  Otherwise, the result will start with the
@@ -36,46 +56,417 @@ ARBITER_DLL std::string sanitize(std::string path, std::string exclusions = "/")
  */
 ARBITER_DLL std::string buildQueryString(const http::Query& query);
 
+/** Headers negotiating a gzipped response, for GETs whose bodies compress
+ * well, like listings.  Responses are decoded as they arrive, whether or
+ * not the server compressed them.  Empty if built without zlib.
+ */
+ARBITER_DLL http::Headers acceptCompressed();
+
+/** @brief A snapshot of the activity of an http::Pool since its creation. */
+struct ARBITER_DLL PoolStats
+{
+    /** Number of buckets in the wait histogram. */
+    static constexpr std::size_t waitBuckets = 26;
+
+    /** Histogram of the time requests spent waiting for a handle, either in
+     * Pool::acquire or in the queue of asynchronous requests.  Bucket `i`
+     * counts waits of less than `2^i` microseconds, and the last bucket also
+     * counts any longer waits.
+     */
+    std::vector<std::uint64_t> waits = std::vector<std::uint64_t>(waitBuckets);
+
+    /** Requests currently in flight, and those awaiting a handle, either in
+     * Pool::acquire or queued asynchronously.
+     */
+    std::size_t inFlight = 0;
+    std::size_t queued = 0;
+
+    /** Completed attempts, including retries, by HTTP status code. */
+    std::map<int, std::uint64_t> codes;
+
+    /** Attempts which failed without a response, like timeouts. */
+    std::uint64_t failures = 0;
+
+    /** Attempts which were retried. */
+    std::uint64_t retries = 0;
+
+    /** GETs which were hedged, and those won by the hedging request. */
+    std::uint64_t hedges = 0;
+    std::uint64_t hedgesWon = 0;
+
+    /** Requests failed fast by an open circuit, and retries refused by the
+     * retry budget.  See CircuitBreaker.
+     */
+    std::uint64_t rejected = 0;
+    std::uint64_t retriesDenied = 0;
+
+    /** Throttled responses, which paused their hosts.  See Throttle. */
+    std::uint64_t throttled = 0;
+
+    /** Bytes sent and received on the wire, excluding headers. */
+    std::uint64_t bytesSent = 0;
+    std::uint64_t bytesReceived = 0;
+
+    /** Serialize as a JSON object. */
+    std::string toJson() const;
+};
+
 /** @cond arbiter_internal */
 
 class ARBITER_DLL Pool;
 
+/** Policy for retrying failed requests, configured by the `http.retry`
+ * object, whose optional entries are:
+ *      - count         Maximum number of retries.
+ *      - baseDelay     Minimum delay before a retry, in milliseconds.
+ *      - maxDelay      Maximum delay before a retry, in milliseconds.
+ *      - deadline      If nonzero, no retry will be started more than this
+ *                      many milliseconds after the first attempt.
+ *
+ * Server errors, 429 responses, and transient connection failures are
+ * retried.  Delays grow exponentially with decorrelated jitter, so that many
+ * clients throttled at once do not retry in lockstep.
+ */
+class ARBITER_DLL RetryPolicy
+{
+public:
+    using Duration = std::chrono::milliseconds;
+
+    RetryPolicy(std::size_t count, std::string j = "");
+
+    /** True if a request which received the response @p res should be
+     * retried.  This does not apply to requests which failed to receive a
+     * response at all, for which see Curl::transient.
+     */
+    bool retryable(const http::Response& res) const;
+
+    /** Returns the delay before the next retry, given the @p previous delay,
+     * which is zero before the first retry.
+     */
+    Duration delay(Duration previous) const;
+
+    std::size_t count() const { return m_count; }
+    Duration deadline() const { return m_deadline; }
+
+private:
+    std::size_t m_count;
+    Duration m_baseDelay = Duration(100);
+    Duration m_maxDelay = Duration(20000);
+    Duration m_deadline = Duration(0);
+};
+
+/** Adaptive limit on the number of requests in flight, configured by the
+ * `http.adaptive` entry, which is either `true` or an object whose optional
+ * entries are:
+ *      - min       Lower bound of the limit, defaulting to 1.
+ *      - max       Upper bound of the limit, defaulting to eight times the
+ *                  initial pool size.
+ *
+ * The limit is adjusted by additive-increase, multiplicative-decrease: each
+ * successful response raises it by 1/limit, so it grows by about one for
+ * each round of requests, and a throttling response (503 or 429) cuts it by
+ * 30%.  A burst of throttling responses counts as a single decrease.
+ */
+class ARBITER_DLL ConcurrencyLimit
+{
+public:
+    ConcurrencyLimit(std::size_t initial, std::string j);
+
+    std::size_t get() const { return static_cast<std::size_t>(m_value); }
+    std::size_t max() const { return m_max; }
+
+    /** Adjust the limit for the outcome @p res of a request.  Returns true
+     * if the limit was raised.
+     */
+    bool update(const http::Response& res);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::size_t m_min = 1;
+    std::size_t m_max;
+    double m_value;
+    Clock::time_point m_lastDecrease;
+};
+
+/** Policy for hedging GET requests on a slow start, configured by the
+ * `http.hedge` entry, which is either `true` or an object whose optional
+ * entries are:
+ *      - percentile    Percentile of recent times to first byte beyond which
+ *                      a GET is hedged, defaulting to 95.
+ *      - minDelay      Lower bound of the delay before hedging, in
+ *                      milliseconds, defaulting to 10.
+ *      - maxDelay      Upper bound of the delay, in milliseconds, which is
+ *                      also used until enough times have been seen,
+ *                      defaulting to 1000.
+ *      - samples       Number of recent times kept, defaulting to 256.
+ *
+ * A GET whose response hasn't begun to arrive within the delay is duplicated
+ * on another handle, if one is free.  Whichever transfer completes first is
+ * used, and the other is cancelled.
+ */
+class ARBITER_DLL HedgePolicy
+{
+public:
+    using Duration = std::chrono::milliseconds;
+
+    explicit HedgePolicy(std::string j);
+
+    /** The current delay before a GET is hedged. */
+    Duration delay() const;
+
+    /** Record the time to first byte of a completed GET. */
+    void record(Duration firstByte);
+
+private:
+    double m_percentile = 95;
+    Duration m_minDelay = Duration(10);
+    Duration m_maxDelay = Duration(1000);
+
+    // A ring of the most recent times.
+    std::vector<Duration> m_times;
+    std::size_t m_next = 0;
+    std::size_t m_samples = 256;
+};
+
+/** Per-host circuit breaker and retry budget, configured by the
+ * `http.breaker` entry, which is either `true` or an object whose optional
+ * entries are:
+ *      - threshold     Consecutive failed attempts to a host after which its
+ *                      circuit opens, defaulting to 5.
+ *      - cooldown      Milliseconds for which an open circuit fails requests
+ *                      without attempting them, defaulting to 5000.
+ *      - retryRatio    Retries earned by each request to a host, defaulting
+ *                      to 0.1, so that retries add at most 10% to its load.
+ *      - retryBurst    Retries which may be spent at once, and with which
+ *                      each host begins, defaulting to 10.
+ *
+ * Failed attempts are those which would be retried: server errors, 429
+ * responses, and transient connection failures.  Once the cooldown of an
+ * open circuit has passed, it is half-open: a single probe is let through,
+ * whose success closes the circuit and whose failure opens it again, while
+ * other requests continue to fail fast.  Requests refused by an open
+ * circuit receive a 503 response without reaching the host.
+ */
+class ARBITER_DLL CircuitBreaker
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Duration = std::chrono::milliseconds;
+
+    enum class State { Closed, Open, HalfOpen };
+
+    explicit CircuitBreaker(std::string j);
+
+    /** True if a first attempt of a request to @p host may be made now,
+     * which earns it a share of a retry.
+     */
+    bool allow(const std::string& host);
+
+    /** True if a failed request to @p host may be retried now, spending a
+     * retry from its budget.
+     */
+    bool retry(const std::string& host);
+
+    /** Record the outcome of an attempt to @p host. */
+    void record(const std::string& host, bool failed);
+
+    /** The state of the circuit of @p host. */
+    State state(const std::string& host) const;
+
+private:
+    struct Host
+    {
+        State state = State::Closed;
+        std::size_t failures = 0;
+        double tokens = 0;
+        Clock::time_point opened;
+        Clock::time_point probed;
+    };
+
+    // Requires m_mutex to be held.  True if an attempt to @p h may be made,
+    // moving an open circuit whose cooldown has passed to half-open and
+    // letting through its probe.
+    bool admit(Host& h);
+
+    Host& host(const std::string& name);
+
+    std::size_t m_threshold = 5;
+    Duration m_cooldown = Duration(5000);
+    double m_retryRatio = 0.1;
+    double m_retryBurst = 10;
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Host> m_hosts;
+};
+
+/** Per-host pauses after throttling, configured by the `http.throttle`
+ * entry, which is either `false`, to disable them, or an object whose
+ * optional entries are:
+ *      - pause         Milliseconds for which a host is first paused,
+ *                      defaulting to 100, which doubles with each
+ *                      consecutive pause.
+ *      - maxPause      Longest pause, including those asked for by
+ *                      Retry-After, defaulting to 30000.
+ *
+ * Throttled responses are 429s, 503s, and other server errors which carry
+ * a Retry-After header.  The pause is that of the header, in seconds or as
+ * an HTTP date, if there is one.  While a host is paused, every request to
+ * it through the pool, from any thread and including retries, waits for the
+ * pause to end before it is sent, so that they all back off together.
+ * Throttled responses to requests sent before a pause began don't lengthen
+ * it, and a response which isn't throttled resets the next pause of its
+ * host to the shortest.
+ */
+class ARBITER_DLL Throttle
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Duration = std::chrono::milliseconds;
+
+    explicit Throttle(std::string j);
+
+    /** Record the response @p res from @p host, returning true if it was
+     * throttled.
+     */
+    bool record(const std::string& host, const Response& res);
+
+    /** The remainder of the pause of @p host, or zero if it isn't paused. */
+    Duration remaining(const std::string& host) const;
+
+    /** The delay asked for by the Retry-After header of @p res, or zero if
+     * it has none.
+     */
+    static Duration retryAfter(const Response& res);
+
+private:
+    struct Host
+    {
+        Clock::time_point until;
+        std::size_t streak = 0;
+    };
+
+    Duration m_pause = Duration(100);
+    Duration m_maxPause = Duration(30000);
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Host> m_hosts;
+};
+
 class ARBITER_DLL Resource
 {
 public:
-    Resource(Pool& pool, Curl& curl, std::size_t id, std::size_t retry);
+    Resource(
+            Pool& pool,
+            Curl& curl,
+            std::size_t id,
+            const RetryPolicy& retry,
+            std::chrono::steady_clock::duration wait =
+                std::chrono::steady_clock::duration(0));
     ~Resource();
 
+    /** GET @p path.  A retry of a body cut short, as when a stalled
+     * transfer times out, resumes from its last byte received with a range
+     * held to the ETag of the first response, rather than starting over.
+     * Only a whole body or a single range with a first byte is resumed, and
+     * only if its response has a strong ETag and no Content-Encoding.
+     */
     http::Response get(
-            std::string path,
-            Headers headers = Headers(),
-            Query query = Query(),
+            const std::string& path,
+            const Headers& headers = Headers(),
+            const Query& query = Query(),
             std::size_t reserve = 0);
 
+    /** Stream the body of a successful GET to @p sink as it arrives.  Once
+     * any of the body has been streamed, the request is no longer retried,
+     * unless it can be resumed as above.
+     */
+    http::Response get(
+            const std::string& path,
+            const std::function<void(const char*, std::size_t)>& sink,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
+
     http::Response head(
-            std::string path,
-            Headers headers = Headers(),
-            Query query = Query());
+            const std::string& path,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
+
+    http::Response del(
+            const std::string& path,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
 
     http::Response put(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            Headers headers = Headers(),
-            Query query = Query());
+            const Headers& headers = Headers(),
+            const Query& query = Query());
+
+    /** Upload the @p size bytes at @p data without copying them.  See
+     * Curl::put.
+     */
+    http::Response put(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
 
     http::Response post(
-            std::string path,
+            const std::string& path,
             const std::vector<char>& data,
-            Headers headers = Headers(),
-            Query query = Query());
+            const Headers& headers = Headers(),
+            const Query& query = Query());
+
+    /** POST the @p size bytes at @p data without copying them. */
+    http::Response post(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
+
+    /** As above, streaming the body of a successful response to @p sink,
+     * after which the request is no longer retried.
+     */
+    http::Response post(
+            const std::string& path,
+            const char* data,
+            std::size_t size,
+            const std::function<void(const char*, std::size_t)>& sink,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
+
+    /** Upload @p size bytes pulled from @p source.  See Curl::put.  Once
+     * any of the body has been pulled, the request is no longer retried.
+     */
+    http::Response put(
+            const std::string& path,
+            const std::function<std::size_t(char*, std::size_t)>& source,
+            std::size_t size,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
 
 private:
     Pool& m_pool;
     Curl& m_curl;
     std::size_t m_id;
-    std::size_t m_retry;
+    const RetryPolicy& m_retry;
+
+    // Time spent waiting for our handle, for the slow log.
+    const std::chrono::steady_clock::duration m_wait;
+
+    // Set by an attempt whose response came from another handle, as when a
+    // hedge wins, in which case the state of our own handle doesn't apply.
+    bool m_substituted = false;
 
-    http::Response exec(std::function<http::Response()> f);
+    // Make the request of @p method to @p path performed by @p f, with
+    // retries.
+    http::Response exec(
+            const char* method,
+            const std::string& path,
+            std::function<http::Response()> f);
 };
 
 class ARBITER_DLL Pool
@@ -85,20 +476,412 @@ class ARBITER_DLL Pool
 
 public:
     Pool() : Pool(4, 4, "") { }
+
+    /* The handles of a pool share a DNS cache, TLS sessions, and
+     * connections unless the `http` configuration contains
+     * `"share": false`.
+     *
+     * Bandwidth may be capped by the `http.bandwidth` object, whose `recv`
+     * and `send` entries limit the bytes per second of all transfers of the
+     * pool together, and whose `transfer` object may have `recv` and `send`
+     * entries limiting each transfer on its own.
+     */
     Pool(std::size_t concurrent, std::size_t retry, std::string j);
     ~Pool();
 
-    Resource acquire();
+    /* Handles are scheduled per host.  If the `http` configuration
+     * contains a nonzero `perHost` limit, no more than that many requests to
+     * any one host are in flight at once, so a slow backend can't occupy the
+     * entire pool.  Where possible, a request is given a handle which last
+     * spoke to the same host, so that its connection may be reused.
+     *
+     * The @p url of the intended request selects its host.  If omitted, the
+     * request is scheduled under an empty host name, which every such
+     * request shares, along with its `perHost` limit.
+     *
+     * Once the pool is exhausted, waiting requests are served by the
+     * Priority current on their calling threads, each priority in
+     * proportion to its weight from the `http.priority` object, whose
+     * optional `interactive`, `normal`, and `bulk` entries default to 16, 4,
+     * and 1.
+     */
+    Resource acquire(std::string url = std::string());
+
+    /* Asynchronous requests are driven by a curl-multi transfer engine
+     * rather than by the calling thread, so they return immediately.  If no
+     * handle is available, the request is queued and dispatched as handles
+     * are released, in order per host and round-robin across hosts.
+     * Retries follow the same policy as Resource.
+     *
+     * The engine is started on first use, or at construction if the `http`
+     * configuration contains `"async": true`, in which case synchronous
+     * Resource requests are driven by it as well.
+     */
+    std::future<http::Response> getAsync(
+            const std::string& path,
+            const Headers& headers = Headers(),
+            const Query& query = Query(),
+            std::size_t reserve = 0);
+
+    std::future<http::Response> headAsync(
+            const std::string& path,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
+
+    std::future<http::Response> putAsync(
+            const std::string& path,
+            std::vector<char> data,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
+
+    std::future<http::Response> postAsync(
+            const std::string& path,
+            std::vector<char> data,
+            const Headers& headers = Headers(),
+            const Query& query = Query());
+
+    /* As above, but passing the response to @p done, on the thread of the
+     * engine, rather than returning a future, so that no thread need wait
+     * for it.
+     */
+    void getAsync(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query,
+            std::size_t reserve,
+            Completion<http::Response> done);
+
+    void headAsync(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query,
+            Completion<http::Response> done);
+
+    void putAsync(
+            const std::string& path,
+            std::vector<char> data,
+            const Headers& headers,
+            const Query& query,
+            Completion<http::Response> done);
+
+    void postAsync(
+            const std::string& path,
+            std::vector<char> data,
+            const Headers& headers,
+            const Query& query,
+            Completion<http::Response> done);
+
+    /** Open @p count connections to each of @p urls ahead of their first
+     * use, so that the requests which follow skip DNS, TCP, and TLS setup.
+     * Each connection is opened by a HEAD of its URL, which is never
+     * retried and whose response is ignored.  These run on the async engine
+     * and this returns without waiting for them, so the returned future
+     * need only be waited upon by callers which care when they finish.
+     *
+     * If the `http` configuration contains a `warm` object, this is called
+     * at construction with its `urls`, and its `count`, defaulting to 1.
+     */
+    std::future<void> warm(
+            const std::vector<std::string>& urls,
+            std::size_t count = 1);
+
+    /** True if synchronous requests are being driven by the async engine. */
+    bool async() const { return m_async; }
+
+    /** Number of handles in this pool.  If the concurrency limit is
+     * adaptive, fewer may be in use at once.
+     */
+    std::size_t size() const { return m_size; }
+
+    /** Change the number of handles in this pool to @p concurrent, which
+     * may be at most the `http.maxConcurrency` configuration, defaulting to
+     * 1024 or the initial size if that is larger.  Growing takes effect
+     * immediately.  When shrinking, idle handles are retired right away, and
+     * those in flight once their requests complete, so no request is
+     * disturbed.  Throws if the concurrency limit is adaptive, since that
+     * limit manages the number of handles in use itself.
+     */
+    void resize(std::size_t concurrent);
+
+    /** Current limit on the number of requests in flight at once. */
+    std::size_t concurrency() const;
+
+    /** Snapshot of the activity of this pool. */
+    PoolStats stats() const;
+
+    /** The circuit breaker of this pool, from the `http.breaker`
+     * configuration, or null if there is none.
+     */
+    CircuitBreaker* breaker() const { return m_breaker.get(); }
+
+    /** The per-host pauses after throttling, or null if disabled. */
+    Throttle* throttle() const { return m_throttle.get(); }
+
+    /** Byte size of the ranges into which large downloads are split and
+     * fetched concurrently, from the `http.chunkSize` configuration or the
+     * ARBITER_HTTP_CHUNK_SIZE environment variable.  Zero, the default,
+     * disables ranged downloads.
+     */
+    std::size_t chunkSize() const { return m_chunkSize; }
+
+    /** True if several ranges of a file may be read by a single GET with a
+     * multi-range header, from the `http.multiRange` configuration.  Off by
+     * default, since servers such as S3 answer such requests with the
+     * whole file.
+     */
+    bool multiRange() const { return m_multiRange; }
+
+    /** The log of slow requests, configured by the `http.slowLog` object as
+     * described by SlowLog::create, or null if there is none.  Requests are
+     * timed from their wait for a handle to the end of their final attempt,
+     * and reported with their timing breakdown, retries, and bytes.
+     */
+    SlowLog* slowLog() const { return m_slowLog.get(); }
+
+    /** True if transfers are checked for integrity, from the `http.verify`
+     * configuration or the ARBITER_HTTP_VERIFY environment variable.  Full
+     * GET responses are hashed as they arrive and checked against the MD5
+     * claimed by their `Content-MD5` or `x-goog-hash` headers, or by their
+     * ETag if it is that of a single-part S3 object, and retried if they
+     * don't match.  Uploads to S3 are sent with a `Content-MD5`.
+     */
+    bool verify() const { return m_verify; }
+
+    /** Receive response bodies into buffers from @p buffers, or allocate
+     * each anew if it is null, which is the default unless the `http`
+     * configuration contains `"buffers": true`, or an object with a
+     * `maxIdle` byte limit, for a SlabPool.  Must be called before the pool
+     * is used.
+     */
+    void buffers(std::shared_ptr<BufferPool> buffers);
+    std::shared_ptr<BufferPool> buffers() const { return m_buffers; }
+
+    /** The Executor on which the drivers sharing this pool run the
+     * concurrent parts of their operations, like ranged downloads and
+     * multipart uploads, which is that of the owning Arbiter.  If null,
+     * these start threads of their own.
+     */
+    void executor(Executor* executor) { m_executor = executor; }
+    Executor* executor() const { return m_executor; }
+
+    /** The Executor on which the bodies of asynchronous responses are
+     * decoded once their transfers complete, so that the CPU time is kept
+     * off of the I/O thread of the transfer engine.  If null, a body is
+     * decoded by whichever thread first reads it.
+     */
+    void compute(Executor* compute) { m_compute = compute; }
+    Executor* compute() const { return m_compute; }
 
 private:
+    struct Request;
+
+    struct Host
+    {
+        std::size_t inFlight = 0;
+        std::array<std::deque<std::shared_ptr<Request>>, priorities> queues;
+
+        bool queued() const;
+    };
+
+    // A synchronous request waiting in acquire, to which serve grants a
+    // handle.
+    struct Waiter
+    {
+        explicit Waiter(std::string host) : host(host) { }
+
+        std::string host;
+        bool granted = false;
+        std::size_t id = 0;
+    };
+
+    // A lock-free stack of the ids of free handles.  Its head packs the top
+    // id with a count of changes, so that a pop can't be fooled by the same
+    // id having been popped and pushed again in the meantime.
+    class FreeList
+    {
+    public:
+        // Hold ids below @p capacity, beginning with none free.
+        explicit FreeList(std::size_t capacity);
+
+        void push(std::size_t id);
+        bool pop(std::size_t& id);
+        bool empty() const;
+
+    private:
+        static constexpr std::uint32_t none = 0xffffffff;
+
+        std::atomic<std::uint64_t> m_head;
+        std::unique_ptr<std::atomic<std::uint32_t>[]> m_next;
+    };
+
     void release(std::size_t id);
 
+    // These require m_mutex to be held, except during construction.  Add
+    // creates a handle in the spare slot @p id and frees it.  Retire
+    // destroys the handle @p id, which is not in use, if we hold more than
+    // our size, and returns true if it did.
+    void add(std::size_t id);
+    bool retire(std::size_t id);
+
+    // Run the GET set up by @p prepare on @p curl, hedging it on another
+    // handle if it is slow to start.  If the response comes from the hedge,
+    // it has already been recorded and @p substituted is set.
+    http::Response hedge(
+            Curl& curl,
+            const std::string& host,
+            const std::function<void(Curl&)>& prepare,
+            bool& substituted);
+
+    // Feed the outcome of an attempt on @p curl to our statistics and to the
+    // adaptive concurrency limit.
+    void record(const Curl& curl, const http::Response& res);
+    void recordRetry();
+
+    // Consult our breaker, if any, about a first attempt to @p host, or a
+    // retry if @p retry, counting those refused.
+    bool admit(const std::string& host, bool retry);
+
+    // Tell our throttle, if any, of the response @p res from @p host,
+    // counting those which were throttled.
+    void recordThrottle(const std::string& host, const http::Response& res);
+
+    void recordWait(std::chrono::steady_clock::duration wait);
+
+    // Report a request to the slow log, if it took long enough.
+    void recordSlow(
+            const char* method,
+            const std::string& url,
+            const http::Response& res,
+            std::size_t retries,
+            std::chrono::steady_clock::duration elapsed,
+            std::chrono::steady_clock::duration wait);
+
+    // These require m_mutex to be held.  If a handle is free for @p host,
+    // take sets @p id to it and returns true.
+    bool canStart() const;
+    bool canStart(const std::string& host) const;
+    bool take(const std::string& host, std::size_t& id);
+
+    // Count a request of priority @p p as waiting, once it has been queued.
+    void enqueue(std::size_t p);
+
+    // Hand out free handles to waiting requests, by priority.  Within a
+    // priority, queued asynchronous requests come first, since their callers
+    // are not holding a thread while they wait.
+    void serve(std::unique_lock<std::mutex>& lock);
+    bool serveQueued(
+            std::size_t p,
+            std::shared_ptr<Request>& next,
+            std::size_t& id);
+    bool serveWaiter(std::size_t p);
+
+    Multi& multi();
+
+    std::shared_ptr<Request> getRequest(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query,
+            std::size_t reserve) const;
+    std::shared_ptr<Request> headRequest(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query) const;
+    std::shared_ptr<Request> putRequest(
+            const std::string& path,
+            std::vector<char> data,
+            const Headers& headers,
+            const Query& query) const;
+    std::shared_ptr<Request> postRequest(
+            const std::string& path,
+            std::vector<char> data,
+            const Headers& headers,
+            const Query& query) const;
+
+    // Queue @p req, returning the future of its response, or if @p done is
+    // given, an invalid future and passing the response to @p done instead.
+    std::future<http::Response> dispatch(
+            std::shared_ptr<Request> req,
+            Completion<http::Response> done = nullptr);
+    void start(
+            std::size_t id,
+            std::shared_ptr<Request> req,
+            RetryPolicy::Duration delay = RetryPolicy::Duration(0));
+
+    // Declared before the handles which reference them.
+    std::unique_ptr<Share> m_share;
+    std::unique_ptr<RateLimit> m_recvLimit;
+    std::unique_ptr<RateLimit> m_sendLimit;
+
+    // Handles are indexed by id within m_curls, which is sized for the most
+    // handles we may hold so that it is never reallocated while they are in
+    // use.  Slots without a handle are null, and their ids are kept in
+    // m_spare.  While the pool is being shrunk, we hold more live handles
+    // than our size until those in flight are released.  With an adaptive
+    // limit, handles are only created as it first grows to need them.
+    std::shared_ptr<const CurlConfig> m_curlConfig;
     std::vector<std::unique_ptr<Curl>> m_curls;
+    std::vector<std::size_t> m_spare;
+    std::atomic<std::size_t> m_size;
+    std::size_t m_live = 0;
+    std::atomic<bool> m_shrinking;
+
     std::vector<std::size_t> m_available;
-    std::size_t m_retry;
+    std::shared_ptr<BufferPool> m_buffers;
+    Executor* m_executor = nullptr;
+    Executor* m_compute = nullptr;
+    std::atomic<std::size_t> m_inFlight;
+
+    // Without per-host or adaptive limits, and with connections shared
+    // among handles so that it doesn't matter which handle serves a host,
+    // free handles are kept here rather than in m_available, and checked
+    // out and in without locking.  The lock is then only taken while
+    // requests are waiting, as counted by m_waiting.
+    std::unique_ptr<FreeList> m_free;
+    std::atomic<std::size_t> m_waiting;
+    std::unique_ptr<ConcurrencyLimit> m_limit;
+    std::unique_ptr<HedgePolicy> m_hedge;
+    std::unique_ptr<CircuitBreaker> m_breaker;
+    std::unique_ptr<Throttle> m_throttle;
+    std::unique_ptr<SlowLog> m_slowLog;
+    RetryPolicy m_retry;
+    bool m_async = false;
+    std::size_t m_chunkSize = 0;
+    bool m_multiRange = false;
+    std::size_t m_perHost = 0;
+    bool m_verify = false;
+    Affinity m_ioAffinity;
 
-    std::mutex m_mutex;
+    // The host most recently assigned to each handle, and the state of each
+    // host with requests in flight or queued.
+    std::vector<std::string> m_handleHosts;
+    std::map<std::string, Host> m_hosts;
+    std::array<std::string, priorities> m_lastServed;
+    std::array<std::deque<Waiter*>, priorities> m_waiters;
+
+    // Priorities are served by stride scheduling.  Each time a priority is
+    // served, its pass advances by its stride, which is inversely
+    // proportional to its weight, and the waiting priority with the lowest
+    // pass is served next.  A priority which has had nothing waiting rejoins
+    // at the pass last served, rather than making up for the service that
+    // it didn't need.
+    std::array<std::size_t, priorities> m_pending;
+    std::array<std::uint64_t, priorities> m_stride;
+    std::array<std::uint64_t, priorities> m_pass;
+    std::uint64_t m_lastPass = 0;
+
+    // Guarded by m_statsMutex, except for the wait histogram, which is
+    // kept in m_waits.
+    PoolStats m_stats;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> m_waits;
+    mutable std::mutex m_statsMutex;
+
+    mutable std::mutex m_mutex;
     std::condition_variable m_cv;
+
+    // Declared last so that it is destroyed first, completing any transfers
+    // which reference the handles or the queues above.
+    std::mutex m_multiMutex;
+    std::unique_ptr<Multi> m_multi;
 };
 
 /** @endcond */
@@ -0,0 +1,322 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/iocp.hpp>
+
+#include <arbiter/util/types.hpp>
+#endif
+
+#ifdef ARBITER_WINDOWS
+#include <codecvt>
+#include <locale>
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+#ifdef ARBITER_WINDOWS
+
+namespace
+{
+    // The completion key of the post which wakes the reaper for shutdown.
+    const ULONG_PTR iocpWakeup(1);
+
+    // ReadFile and WriteFile take 32-bit lengths, so larger files are
+    // transferred in pieces.
+    const std::size_t iocpPiece(std::size_t(1) << 30);
+
+    std::wstring iocpWide(const std::string& s)
+    {
+        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+        return converter.from_bytes(s);
+    }
+}
+
+struct Iocp::Port
+{
+    ~Port()
+    {
+        if (handle) ::CloseHandle(handle);
+    }
+
+    HANDLE handle = nullptr;
+};
+
+struct Iocp::Request
+{
+    // First, so that the OVERLAPPED of a completion is its Request.
+    OVERLAPPED overlapped;
+
+    std::string path;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    bool write = false;
+
+    // The whole file, of which the first done bytes have been transferred.
+    std::vector<char> data;
+    std::size_t done = 0;
+
+    std::promise<std::vector<char>> readPromise;
+    std::promise<void> writePromise;
+};
+
+std::unique_ptr<Iocp> Iocp::create(const std::size_t depth)
+{
+    std::unique_ptr<Port> port(new Port());
+
+    // Completions are handled by our reaper alone.
+    port->handle = ::CreateIoCompletionPort(
+            INVALID_HANDLE_VALUE, nullptr, 0, 1);
+    if (!port->handle) return std::unique_ptr<Iocp>();
+
+    return std::unique_ptr<Iocp>(new Iocp(std::move(port), depth));
+}
+
+Iocp::Iocp(std::unique_ptr<Port> port, const std::size_t depth)
+    : m_port(std::move(port))
+    , m_depth((std::max)(depth, std::size_t(1)))
+    , m_reaper([this]() { reap(); })
+{ }
+
+Iocp::~Iocp()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return !m_active; });
+    }
+
+    ::PostQueuedCompletionStatus(m_port->handle, 0, iocpWakeup, nullptr);
+    m_reaper.join();
+}
+
+std::future<std::vector<char>> Iocp::read(const std::string path)
+{
+    std::unique_ptr<Request> req(new Request());
+    std::future<std::vector<char>> future(req->readPromise.get_future());
+
+    req->path = path;
+    req->file = ::CreateFileW(
+            iocpWide(path).c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN,
+            nullptr);
+    if (req->file == INVALID_HANDLE_VALUE)
+    {
+        req->readPromise.set_exception(std::make_exception_ptr(
+                    ArbiterError("Could not read file " + path)));
+        return future;
+    }
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(req->file, &size))
+    {
+        ::CloseHandle(req->file);
+        req->readPromise.set_exception(std::make_exception_ptr(
+                    ArbiterError("Could not stat " + path)));
+        return future;
+    }
+
+    if (!size.QuadPart)
+    {
+        ::CloseHandle(req->file);
+        req->readPromise.set_value(std::vector<char>());
+        return future;
+    }
+
+    req->data.resize(size.QuadPart);
+    begin(req.release());
+    return future;
+}
+
+std::future<void> Iocp::write(
+        const std::string path,
+        std::vector<char> data)
+{
+    std::unique_ptr<Request> req(new Request());
+    std::future<void> future(req->writePromise.get_future());
+
+    req->path = path;
+    req->write = true;
+    req->file = ::CreateFileW(
+            iocpWide(path).c_str(),
+            GENERIC_WRITE,
+            0,
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
+            nullptr);
+    if (req->file == INVALID_HANDLE_VALUE)
+    {
+        req->writePromise.set_exception(std::make_exception_ptr(
+                    ArbiterError("Could not open " + path + " for writing")));
+        return future;
+    }
+
+    if (data.empty())
+    {
+        ::CloseHandle(req->file);
+        req->writePromise.set_value();
+        return future;
+    }
+
+    req->data = std::move(data);
+    begin(req.release());
+    return future;
+}
+
+void Iocp::begin(Request* req)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_active < m_depth; });
+        ++m_active;
+    }
+
+    if (!::CreateIoCompletionPort(req->file, m_port->handle, 0, 0))
+    {
+        return complete(req, ::GetLastError());
+    }
+
+    issue(req);
+}
+
+void Iocp::issue(Request* req)
+{
+    const std::uint64_t offset(req->done);
+    std::memset(&req->overlapped, 0, sizeof(req->overlapped));
+    req->overlapped.Offset = static_cast<DWORD>(offset);
+    req->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    char* pos(req->data.data() + req->done);
+    const DWORD length(static_cast<DWORD>(
+                (std::min)(req->data.size() - req->done, iocpPiece)));
+
+    // Unless it fails outright, the transfer is completed through the port,
+    // even if it finished immediately.
+    const BOOL ok(req->write ?
+            ::WriteFile(req->file, pos, length, nullptr, &req->overlapped) :
+            ::ReadFile(req->file, pos, length, nullptr, &req->overlapped));
+    if (ok) return;
+
+    const DWORD error(::GetLastError());
+    if (error == ERROR_IO_PENDING) return;
+
+    // A file which shrank since it was sized is read as far as it goes.
+    complete(req, !req->write && error == ERROR_HANDLE_EOF ? 0 : error);
+}
+
+void Iocp::reap()
+{
+    while (true)
+    {
+        DWORD bytes(0);
+        ULONG_PTR key(0);
+        OVERLAPPED* overlapped(nullptr);
+
+        const BOOL ok(::GetQueuedCompletionStatus(
+                    m_port->handle, &bytes, &key, &overlapped, INFINITE));
+
+        if (!overlapped)
+        {
+            if (key == iocpWakeup) return;
+            continue;
+        }
+
+        Request* req(reinterpret_cast<Request*>(overlapped));
+
+        if (!ok)
+        {
+            const DWORD error(::GetLastError());
+            complete(req, !req->write && error == ERROR_HANDLE_EOF ? 0 : error);
+            continue;
+        }
+
+        req->done += bytes;
+        if (bytes && req->done < req->data.size()) issue(req);
+        else if (req->write && req->done < req->data.size())
+        {
+            // A write which makes no progress has failed.
+            complete(req, ERROR_WRITE_FAULT);
+        }
+        else complete(req, 0);
+    }
+}
+
+void Iocp::complete(Request* req, const unsigned long error)
+{
+    const bool closed(::CloseHandle(req->file) != 0);
+
+    if (error || (req->write && !closed))
+    {
+        const std::string message(
+                (req->write ?
+                    "Error occurred while writing " :
+                    "Error occurred reading ") + req->path +
+                (error ? ": system error " + std::to_string(error) : ""));
+
+        const auto e(std::make_exception_ptr(ArbiterError(message)));
+        if (req->write) req->writePromise.set_exception(e);
+        else req->readPromise.set_exception(e);
+    }
+    else if (req->write) req->writePromise.set_value();
+    else
+    {
+        req->data.resize(req->done);
+        req->readPromise.set_value(std::move(req->data));
+    }
+
+    delete req;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_active;
+    }
+    m_cv.notify_all();
+}
+
+#else
+
+struct Iocp::Port { };
+struct Iocp::Request { };
+
+std::unique_ptr<Iocp> Iocp::create(std::size_t)
+{
+    return std::unique_ptr<Iocp>();
+}
+
+Iocp::Iocp(std::unique_ptr<Port> port, const std::size_t depth)
+    : m_port(std::move(port))
+    , m_depth(depth)
+{ }
+
+Iocp::~Iocp() { }
+
+std::future<std::vector<char>> Iocp::read(std::string)
+{
+    throw ArbiterError("Overlapped I/O is only supported on Windows");
+}
+
+std::future<void> Iocp::write(std::string, std::vector<char>)
+{
+    throw ArbiterError("Overlapped I/O is only supported on Windows");
+}
+
+#endif
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
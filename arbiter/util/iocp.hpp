@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @cond arbiter_internal */
+
+/** Asynchronous local file I/O through a Windows I/O completion port, the
+ * counterpart of Uring.  Files are opened for overlapped I/O and bound to
+ * the port by the calling thread, which issues their first transfer, and
+ * completions are handled by a single thread, which issues the remainder of
+ * any transfer too large for one call.
+ */
+class ARBITER_DLL Iocp
+{
+public:
+    /** Returns null if not built for Windows, or if the port could not be
+     * created.  At most @p depth transfers are in flight at once.
+     */
+    static std::unique_ptr<Iocp> create(std::size_t depth = 256);
+
+    /** Waits for all outstanding requests to complete. */
+    ~Iocp();
+
+    /** Read the whole of the file at @p path.  Failures, including a path
+     * which doesn't exist, are reported through the future.
+     */
+    std::future<std::vector<char>> read(std::string path);
+
+    /** Write @p data to @p path, overwriting any existing file. */
+    std::future<void> write(std::string path, std::vector<char> data);
+
+private:
+    struct Port;
+    struct Request;
+
+    Iocp(std::unique_ptr<Port> port, std::size_t depth);
+
+    // Bind the file of @p req to the port and issue its first transfer.
+    // This waits while the port is at capacity.
+    void begin(Request* req);
+
+    // Issue the next piece of I/O of @p req, completing it on failure.
+    void issue(Request* req);
+    void reap();
+
+    // Settle @p req, which failed with the system @p error unless it is
+    // zero, and free it.
+    void complete(Request* req, unsigned long error);
+
+    Iocp(const Iocp&);
+    Iocp& operator=(const Iocp&);
+
+    std::unique_ptr<Port> m_port;
+    const std::size_t m_depth;
+
+    std::size_t m_active = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_reaper;
+};
+
+/** @endcond */
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/third/json/json.hpp>
 #endif
@@ -52,6 +56,86 @@ inline json merge(const json& a, const json& b)
     return out;
 }
 
+namespace detail
+{
+
+// Keeps the top-level fields of an object which are named in a set and hold
+// scalars, skipping everything else as it is parsed.
+class FieldsSax : public nlohmann::json_sax<json>
+{
+public:
+    FieldsSax(const std::vector<std::string>& keys, json& out)
+        : m_keys(keys)
+        , m_out(out)
+    { }
+
+    bool null() override { return keep(json()); }
+    bool boolean(bool val) override { return keep(val); }
+    bool number_integer(number_integer_t val) override { return keep(val); }
+    bool number_unsigned(number_unsigned_t val) override { return keep(val); }
+    bool number_float(number_float_t val, const string_t&) override
+    {
+        return keep(val);
+    }
+    bool string(string_t& val) override { return keep(std::move(val)); }
+
+    bool key(string_t& val) override
+    {
+        m_wanted =
+            m_depth == 1 &&
+            std::find(m_keys.begin(), m_keys.end(), val) != m_keys.end();
+        if (m_wanted) m_key = std::move(val);
+        return true;
+    }
+
+    bool start_object(std::size_t) override
+    {
+        if (!m_depth++) m_out = json::object();
+        return true;
+    }
+
+    bool end_object() override { --m_depth; return true; }
+    bool start_array(std::size_t) override { ++m_depth; return true; }
+    bool end_array() override { --m_depth; return true; }
+
+    bool parse_error(
+            std::size_t,
+            const std::string&,
+            const nlohmann::detail::exception&) override
+    {
+        return false;
+    }
+
+private:
+    bool keep(json val)
+    {
+        if (m_depth == 1 && m_wanted) m_out[m_key] = std::move(val);
+        return true;
+    }
+
+    const std::vector<std::string>& m_keys;
+    json& m_out;
+    std::string m_key;
+    std::size_t m_depth = 0;
+    bool m_wanted = false;
+};
+
+} // namespace detail
+
+// Parse the JSON object @p s, keeping only those of its top-level fields
+// which are named in @p keys and hold scalars, so that a few fields may be
+// read from an API response without building a document of all of it.
+// Returns null if @p s is not a valid object.
+inline json parseFields(
+        const std::string& s,
+        const std::vector<std::string>& keys)
+{
+    json out;
+    detail::FieldsSax sax(keys, out);
+    if (!json::sax_parse(s, &sax)) return json();
+    return out;
+}
+
 } // namespace arbiter
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
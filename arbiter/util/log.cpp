@@ -0,0 +1,210 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/log.hpp>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const char* levelPrefix(const LogLevel level)
+    {
+        switch (level)
+        {
+            case LogLevel::Warning: return "warning: ";
+            case LogLevel::Error: return "error: ";
+            default: return "";
+        }
+    }
+
+    struct LogState
+    {
+        using Clock = std::chrono::steady_clock;
+
+        LogState()
+            : sink(std::make_shared<AsyncLogSink>(std::cout))
+            , defaultSink(sink)
+            , last(Clock::now())
+        { }
+
+        std::atomic<int> level { static_cast<int>(LogLevel::Info) };
+
+        std::mutex mutex;
+        std::shared_ptr<LogSink> sink;
+        const std::shared_ptr<LogSink> defaultSink;
+
+        // A token bucket of messages.
+        double rate = 100;
+        double burst = 100;
+        double tokens = 100;
+        Clock::time_point last;
+        std::size_t suppressed = 0;
+    };
+
+    LogState& logState()
+    {
+        static LogState state;
+        return state;
+    }
+}
+
+AsyncLogSink::AsyncLogSink(std::ostream& stream, const std::size_t capacity)
+    : m_stream(stream)
+    , m_capacity((std::max)(capacity, std::size_t(1)))
+{ }
+
+AsyncLogSink::~AsyncLogSink()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopped = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void AsyncLogSink::write(const LogLevel level, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopped) return;
+
+    if (m_queue.size() >= m_capacity)
+    {
+        ++m_dropped;
+        return;
+    }
+
+    if (m_dropped)
+    {
+        m_queue.emplace_back(
+                LogLevel::Warning,
+                std::to_string(m_dropped) + " log messages dropped");
+        m_dropped = 0;
+    }
+    m_queue.emplace_back(level, message);
+
+    if (!m_thread.joinable()) m_thread = std::thread([this]() { run(); });
+    m_cv.notify_all();
+}
+
+void AsyncLogSink::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() { return m_queue.empty() && !m_writing; });
+}
+
+void AsyncLogSink::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        m_cv.wait(lock, [this]() { return m_stopped || !m_queue.empty(); });
+        if (m_queue.empty()) return;
+
+        // Write everything queued at once, without holding the lock.
+        std::deque<std::pair<LogLevel, std::string>> batch;
+        batch.swap(m_queue);
+        m_writing = true;
+        lock.unlock();
+
+        for (const auto& entry : batch)
+        {
+            m_stream << levelPrefix(entry.first) << entry.second << '\n';
+        }
+        m_stream.flush();
+
+        lock.lock();
+        m_writing = false;
+        m_cv.notify_all();
+    }
+}
+
+namespace logging
+{
+
+void setSink(std::shared_ptr<LogSink> sink)
+{
+    LogState& state(logState());
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.sink = sink ? std::move(sink) : state.defaultSink;
+}
+
+void setLevel(const LogLevel level)
+{
+    logState().level = static_cast<int>(level);
+}
+
+void setRate(const double perSecond, const double burst)
+{
+    LogState& state(logState());
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.rate = (std::max)(perSecond, 0.0);
+    state.burst = (std::max)(burst, 1.0);
+    state.tokens = state.burst;
+}
+
+bool enabled(const LogLevel level)
+{
+    return static_cast<int>(level) >= logState().level;
+}
+
+void write(const LogLevel level, const std::string& message)
+{
+    if (!enabled(level)) return;
+
+    LogState& state(logState());
+    std::shared_ptr<LogSink> sink;
+    std::size_t suppressed(0);
+
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        if (state.rate > 0)
+        {
+            const LogState::Clock::time_point now(LogState::Clock::now());
+            const double elapsed(
+                    std::chrono::duration<double>(now - state.last).count());
+            state.last = now;
+            state.tokens = (std::min)(
+                    state.burst,
+                    state.tokens + elapsed * state.rate);
+
+            if (state.tokens < 1)
+            {
+                ++state.suppressed;
+                return;
+            }
+            state.tokens -= 1;
+        }
+
+        std::swap(suppressed, state.suppressed);
+        sink = state.sink;
+    }
+
+    if (suppressed)
+    {
+        sink->write(
+                LogLevel::Warning,
+                std::to_string(suppressed) + " log messages suppressed");
+    }
+    sink->write(level, message);
+}
+
+} // namespace logging
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
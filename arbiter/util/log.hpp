@@ -0,0 +1,129 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+enum class LogLevel
+{
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+/** @brief Interface for receiving log messages.
+ *
+ * Once installed with logging::setSink, every message logged by arbiter
+ * which passes the level and rate limits of logging::write is passed here,
+ * without a trailing newline.  Calls arrive from whichever thread logs, so
+ * implementations must be thread-safe, and should be brief.  They must not
+ * throw.
+ */
+class ARBITER_DLL LogSink
+{
+public:
+    virtual ~LogSink() { }
+
+    virtual void write(LogLevel level, const std::string& message) = 0;
+};
+
+/** @brief A sink writing to a stream from a thread of its own.
+ *
+ * Messages are queued, so that logging threads never wait on the stream,
+ * and written a line at a time in the order they arrived.  Once the queue
+ * holds @p capacity messages, further messages are dropped until it drains,
+ * and their count is written in their place.  Queued messages are written
+ * before destruction completes.
+ */
+class ARBITER_DLL AsyncLogSink : public LogSink
+{
+public:
+    explicit AsyncLogSink(std::ostream& stream, std::size_t capacity = 4096);
+    ~AsyncLogSink();
+
+    virtual void write(LogLevel level, const std::string& message) override;
+
+    /** Wait until the messages queued so far have been written. */
+    void flush();
+
+private:
+    AsyncLogSink(const AsyncLogSink&);
+    AsyncLogSink& operator=(const AsyncLogSink&);
+
+    void run();
+
+    std::ostream& m_stream;
+    const std::size_t m_capacity;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::pair<LogLevel, std::string>> m_queue;
+    std::size_t m_dropped = 0;
+    bool m_writing = false;
+    bool m_stopped = false;
+
+    // Started with the first message.
+    std::thread m_thread;
+};
+
+/** @brief Logging of the messages of all drivers.
+ *
+ * Messages are routed to a single process-wide LogSink, which by default is
+ * an AsyncLogSink writing to `std::cout`.  Messages below the level, which
+ * is by default LogLevel::Info, are discarded without being formatted by
+ * callers which check logging::enabled.  So that a storm of errors can't
+ * make logging a bottleneck of its own, messages beyond a rate of 100 per
+ * second, with bursts of up to 100, are dropped, and their count is logged
+ * once messages are admitted again.
+ */
+namespace logging
+{
+
+/** Route messages to @p sink, or to the default sink if it is null. */
+ARBITER_DLL void setSink(std::shared_ptr<LogSink> sink);
+
+/** Discard messages below @p level. */
+ARBITER_DLL void setLevel(LogLevel level);
+
+/** Admit @p perSecond messages per second, with bursts of up to @p burst.
+ * A rate of zero admits every message.
+ */
+ARBITER_DLL void setRate(double perSecond, double burst);
+
+/** True if messages at @p level are logged, rate limits aside. */
+ARBITER_DLL bool enabled(LogLevel level);
+
+/** Log @p message at @p level. */
+ARBITER_DLL void write(LogLevel level, const std::string& message);
+
+inline void debug(const std::string& m) { write(LogLevel::Debug, m); }
+inline void info(const std::string& m) { write(LogLevel::Info, m); }
+inline void warn(const std::string& m) { write(LogLevel::Warning, m); }
+inline void error(const std::string& m) { write(LogLevel::Error, m); }
+
+} // namespace logging
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
@@ -5,7 +6,10 @@
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/util/md5.hpp>
+#include <arbiter/util/executor.hpp>
 #include <arbiter/util/macros.hpp>
+#include <arbiter/util/transforms.hpp>
+#include <arbiter/util/types.hpp>
 #endif
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
@@ -17,11 +21,7 @@ namespace arbiter
 {
 namespace crypto
 {
-namespace
-{
-
-const std::size_t blockSize(16);
-
+// Outside of the unnamed namespace, since Context of the hasher holds it.
 struct Md5Context
 {
     Md5Context() : data(), datalen(0), bitlen(0), state()
@@ -38,6 +38,11 @@ struct Md5Context
     uint32_t state[4];
 };
 
+namespace
+{
+
+const std::size_t blockSize(16);
+
 void md5_transform(Md5Context *ctx, const uint8_t data[])
 {
     uint32_t a, b, c, d, m[16], i, j;
@@ -133,10 +138,26 @@ void md5_transform(Md5Context *ctx, const uint8_t data[])
 
 void md5_update(Md5Context *ctx, const uint8_t data[], std::size_t len)
 {
-    for (std::size_t i(0); i < len; ++i) {
-        ctx->data[ctx->datalen] = data[i];
-        ctx->datalen++;
-        if (ctx->datalen == 64) {
+    while (len)
+    {
+        // Whole blocks are transformed in place, and the rest buffered.
+        if (!ctx->datalen && len >= 64)
+        {
+            md5_transform(ctx, data);
+            ctx->bitlen += 512;
+            data += 64;
+            len -= 64;
+            continue;
+        }
+
+        const std::size_t n((std::min)(len, std::size_t(64 - ctx->datalen)));
+        std::memcpy(ctx->data + ctx->datalen, data, n);
+        ctx->datalen += n;
+        data += n;
+        len -= n;
+
+        if (ctx->datalen == 64)
+        {
             md5_transform(ctx, ctx->data);
             ctx->bitlen += 512;
             ctx->datalen = 0;
@@ -189,16 +210,120 @@ void md5_final(Md5Context *ctx, uint8_t hash[])
 
 std::string md5(const std::string& data)
 {
-    std::vector<char> out(blockSize, 0);
+    Md5 hasher;
+    hasher.update(data);
+    return hasher.finalize();
+}
+
+std::string multipartEtag(
+        const char* data,
+        const std::size_t size,
+        const std::size_t partSize,
+        const std::size_t threads,
+        Executor* executor)
+{
+    if (!partSize) throw ArbiterError("Part size must be positive");
+
+    // An empty upload still has a single part.
+    const std::size_t parts((std::max<std::size_t>)(
+                (size + partSize - 1) / partSize,
+                1));
+
+    std::string digests(parts * blockSize, 0);
+    parallelFor(parts, threads, [&](const std::size_t i)
+    {
+        const std::size_t offset(i * partSize);
+        Md5 hasher;
+        hasher.update(data + offset, (std::min)(partSize, size - offset));
+        const std::string digest(hasher.finalize());
+        std::copy(digest.begin(), digest.end(), &digests[i * blockSize]);
+    }, executor);
+
+    return encodeAsHex(md5(digests)) + "-" + std::to_string(parts);
+}
+
+bool matchesEtag(
+        const char* data,
+        const std::size_t size,
+        std::string etag,
+        const std::vector<std::size_t>& partSizes,
+        const std::size_t threads,
+        Executor* executor)
+{
+    if (etag.size() >= 2 && etag.front() == '"' && etag.back() == '"')
+    {
+        etag = etag.substr(1, etag.size() - 2);
+    }
+
+    const std::size_t dash(etag.find('-'));
+    if (dash == std::string::npos)
+    {
+        if (etag.size() != blockSize * 2) return false;
+
+        Md5 hasher;
+        hasher.update(data, size);
+        return encodeAsHex(hasher.finalize()) == etag;
+    }
+
+    const std::size_t parts(
+            std::strtoull(etag.c_str() + dash + 1, nullptr, 10));
+    if (!parts) return false;
+
+    auto partsOf([size](const std::size_t partSize)
+    {
+        return (std::max<std::size_t>)((size + partSize - 1) / partSize, 1);
+    });
+
+    const std::size_t mib(1024 * 1024);
+    std::vector<std::size_t> candidates(partSizes);
+    candidates.push_back(5 * mib);
+    candidates.push_back(8 * mib);
+    candidates.push_back(16 * mib);
+    candidates.push_back(((size + parts - 1) / parts + mib - 1) / mib * mib);
+
+    std::vector<std::size_t> tried;
+    for (const std::size_t partSize : candidates)
+    {
+        if (!partSize || partsOf(partSize) != parts ||
+                std::count(tried.begin(), tried.end(), partSize))
+        {
+            continue;
+        }
+        tried.push_back(partSize);
 
+        if (multipartEtag(data, size, partSize, threads, executor) == etag)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+struct Md5::Context
+{
     Md5Context ctx;
+};
+
+Md5::Md5() : m_context(new Context()) { }
+Md5::Md5(Md5&&) = default;
+Md5& Md5::operator=(Md5&&) = default;
+Md5::~Md5() { }
+
+void Md5::update(const char* data, const std::size_t size)
+{
     md5_update(
-            &ctx,
-            reinterpret_cast<const uint8_t*>(data.data()),
-            data.size());
-    md5_final(&ctx, reinterpret_cast<uint8_t*>(out.data()));
+            &m_context->ctx,
+            reinterpret_cast<const uint8_t*>(data),
+            size);
+}
 
-    return std::string(out.data(), out.size());
+std::string Md5::finalize()
+{
+    std::string out(blockSize, 0);
+    md5_final(&m_context->ctx, reinterpret_cast<uint8_t*>(&out[0]));
+    m_context->ctx = Md5Context();
+    return out;
 }
 
 } // namespace crypto
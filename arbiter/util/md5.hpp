@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,11 +19,76 @@ namespace ARBITER_CUSTOM_NAMESPACE
 
 namespace arbiter
 {
+
+class Executor;
+
 namespace crypto
 {
 
 ARBITER_DLL std::string md5(const std::string& data);
 
+/** @brief The ETag which S3 gives the contents @p data if uploaded as a
+ * multipart upload in parts of @p partSize bytes: the hex MD5 of the
+ * concatenated MD5s of the parts, a dash, and the number of parts.
+ *
+ * Parts are hashed in parallel by up to @p threads threads, borrowed from
+ * @p executor as by parallelFor.
+ */
+ARBITER_DLL std::string multipartEtag(
+        const char* data,
+        std::size_t size,
+        std::size_t partSize,
+        std::size_t threads = 1,
+        Executor* executor = nullptr);
+
+/** @brief True if @p etag, as listed by S3 with or without its quotes, is
+ * that of an object with the contents @p data, so that a local file may be
+ * compared with an object without transferring either.
+ *
+ * A multipart ETag doesn't record the size of its parts, so each of
+ * @p partSizes, the usual sizes of 5, 8, and 16 MiB, and the smallest whole
+ * number of MiB, are tried which would give its number of parts.  Objects
+ * encrypted with SSE-KMS have ETags which are not MD5s, so never match.
+ */
+ARBITER_DLL bool matchesEtag(
+        const char* data,
+        std::size_t size,
+        std::string etag,
+        const std::vector<std::size_t>& partSizes = { },
+        std::size_t threads = 1,
+        Executor* executor = nullptr);
+
+/** @brief Incremental MD5, for data which is hashed as it arrives rather
+ * than buffered in full.
+ */
+class ARBITER_DLL Md5
+{
+public:
+    Md5();
+    Md5(Md5&&);
+    Md5& operator=(Md5&&);
+    ~Md5();
+
+    /** Hash the next @p size bytes of the message. */
+    void update(const char* data, std::size_t size);
+
+    void update(const std::string& data) { update(data.data(), data.size()); }
+    void update(const std::vector<char>& data)
+    {
+        update(data.data(), data.size());
+    }
+
+    /** The 16-byte digest of the message passed to update since
+     * construction or the previous finalize, after which the hasher is reset
+     * to begin a new message.
+     */
+    std::string finalize();
+
+private:
+    struct Context;
+    std::unique_ptr<Context> m_context;
+};
+
 } // namespace crypto
 } // namespace arbiter
 
@@ -0,0 +1,313 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/metrics.hpp>
+
+#include <arbiter/util/blocks.hpp>
+#include <arbiter/util/http.hpp>
+#endif
+
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    std::string formatMetric(const double v)
+    {
+        std::ostringstream os;
+        os.precision(9);
+        os << v;
+        return os.str();
+    }
+
+    // Label values escape backslashes, quotes, and newlines.
+    std::string metricLabel(const std::string& name, const std::string& v)
+    {
+        std::string out(name + "=\"");
+        for (const char c : v)
+        {
+            if (c == '\\') out += "\\\\";
+            else if (c == '"') out += "\\\"";
+            else if (c == '\n') out += "\\n";
+            else out += c;
+        }
+        return out + "\"";
+    }
+
+    void metricFamily(
+            std::string& out,
+            const std::string& name,
+            const std::string& type,
+            const std::string& help)
+    {
+        out += "# TYPE " + name + " " + type + "\n";
+        out += "# HELP " + name + " " + help + "\n";
+    }
+
+    void metricSample(
+            std::string& out,
+            const std::string& name,
+            const std::string& labels,
+            const std::string& value)
+    {
+        out += name;
+        if (labels.size()) out += "{" + labels + "}";
+        out += " " + value + "\n";
+    }
+}
+
+constexpr std::size_t MetricsTracer::bounds;
+
+const std::array<double, MetricsTracer::bounds> MetricsTracer::bucketBounds
+{ {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+    1, 2.5, 5, 10, 30, 60
+} };
+
+MetricsTracer::MetricsTracer(const std::size_t shards)
+{
+    for (std::size_t i(0); i < (shards ? shards : 1); ++i)
+    {
+        m_shards.emplace_back(new Shard());
+    }
+}
+
+void MetricsTracer::end(const TraceEvent& event)
+{
+    const double seconds(
+            std::chrono::duration<double>(event.duration).count());
+
+    std::size_t bucket(0);
+    while (bucket < bounds && seconds > bucketBounds[bucket]) ++bucket;
+
+    const std::size_t h(
+            std::hash<std::thread::id>()(std::this_thread::get_id()));
+    Shard& shard(*m_shards[h % m_shards.size()]);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Series& s(shard.series[Key(event.driver, event.operation, event.host)]);
+    ++s.count;
+    if (event.failed) ++s.failures;
+    s.bytes += event.bytes;
+    s.seconds += seconds;
+    ++s.buckets[bucket];
+}
+
+void MetricsTracer::render(std::string& out) const
+{
+    std::map<Key, Series> all;
+    for (const auto& p : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        for (const auto& entry : p->series)
+        {
+            Series& s(all[entry.first]);
+            s.count += entry.second.count;
+            s.failures += entry.second.failures;
+            s.bytes += entry.second.bytes;
+            s.seconds += entry.second.seconds;
+            for (std::size_t i(0); i <= bounds; ++i)
+            {
+                s.buckets[i] += entry.second.buckets[i];
+            }
+        }
+    }
+
+    auto labels([](const Key& key)
+    {
+        std::string l(
+                metricLabel("driver", std::get<0>(key)) + "," +
+                metricLabel("operation", std::get<1>(key)));
+        if (std::get<2>(key).size())
+        {
+            l += "," + metricLabel("host", std::get<2>(key));
+        }
+        return l;
+    });
+
+    metricFamily(out, "arbiter_operations", "counter",
+            "Operations performed.");
+    for (const auto& entry : all)
+    {
+        metricSample(out, "arbiter_operations_total", labels(entry.first),
+                std::to_string(entry.second.count));
+    }
+
+    metricFamily(out, "arbiter_operation_failures", "counter",
+            "Operations which failed.");
+    for (const auto& entry : all)
+    {
+        metricSample(out, "arbiter_operation_failures_total",
+                labels(entry.first), std::to_string(entry.second.failures));
+    }
+
+    metricFamily(out, "arbiter_operation_bytes", "counter",
+            "Bytes read or written by operations.");
+    for (const auto& entry : all)
+    {
+        metricSample(out, "arbiter_operation_bytes_total",
+                labels(entry.first), std::to_string(entry.second.bytes));
+    }
+
+    metricFamily(out, "arbiter_operation_seconds", "histogram",
+            "Durations of operations.");
+    for (const auto& entry : all)
+    {
+        const std::string l(labels(entry.first));
+        const Series& s(entry.second);
+
+        std::uint64_t cumulative(0);
+        for (std::size_t i(0); i <= bounds; ++i)
+        {
+            cumulative += s.buckets[i];
+            const std::string le(
+                    i < bounds ? formatMetric(bucketBounds[i]) : "+Inf");
+            metricSample(out, "arbiter_operation_seconds_bucket",
+                    l + "," + metricLabel("le", le),
+                    std::to_string(cumulative));
+        }
+        metricSample(out, "arbiter_operation_seconds_sum", l,
+                formatMetric(s.seconds));
+        metricSample(out, "arbiter_operation_seconds_count", l,
+                std::to_string(s.count));
+    }
+}
+
+void renderPoolMetrics(
+        const std::vector<std::pair<std::string, const http::Pool*>>& pools,
+        std::string& out)
+{
+    std::vector<std::pair<std::string, http::PoolStats>> stats;
+    for (const auto& p : pools)
+    {
+        stats.emplace_back(metricLabel("pool", p.first), p.second->stats());
+    }
+
+    // Families whose samples are a single counter or gauge per pool.
+    using Field = std::function<std::uint64_t(const http::PoolStats&)>;
+    auto perPool([&](
+                const std::string& name,
+                const std::string& type,
+                const std::string& help,
+                const Field& field)
+    {
+        metricFamily(out, name, type, help);
+        const std::string sample(type == "counter" ? name + "_total" : name);
+        for (const auto& s : stats)
+        {
+            metricSample(out, sample, s.first,
+                    std::to_string(field(s.second)));
+        }
+    });
+
+    metricFamily(out, "arbiter_http_requests", "counter",
+            "Completed HTTP attempts, including retries, by status code.");
+    for (const auto& s : stats)
+    {
+        for (const auto& code : s.second.codes)
+        {
+            metricSample(out, "arbiter_http_requests_total",
+                    s.first + "," +
+                        metricLabel("code", std::to_string(code.first)),
+                    std::to_string(code.second));
+        }
+    }
+
+    perPool("arbiter_http_failures", "counter",
+            "HTTP attempts which failed without a response.",
+            [](const http::PoolStats& s) { return s.failures; });
+    perPool("arbiter_http_retries", "counter",
+            "HTTP attempts which were retried.",
+            [](const http::PoolStats& s) { return s.retries; });
+    perPool("arbiter_http_hedges", "counter",
+            "GETs which were hedged.",
+            [](const http::PoolStats& s) { return s.hedges; });
+    perPool("arbiter_http_hedges_won", "counter",
+            "Hedged GETs won by the hedging request.",
+            [](const http::PoolStats& s) { return s.hedgesWon; });
+    perPool("arbiter_http_rejected", "counter",
+            "HTTP requests failed fast by an open circuit.",
+            [](const http::PoolStats& s) { return s.rejected; });
+    perPool("arbiter_http_retries_denied", "counter",
+            "HTTP retries refused by the retry budget.",
+            [](const http::PoolStats& s) { return s.retriesDenied; });
+    perPool("arbiter_http_throttled", "counter",
+            "Throttled HTTP responses, which paused their hosts.",
+            [](const http::PoolStats& s) { return s.throttled; });
+    perPool("arbiter_http_sent_bytes", "counter",
+            "Bytes sent, excluding headers.",
+            [](const http::PoolStats& s) { return s.bytesSent; });
+    perPool("arbiter_http_received_bytes", "counter",
+            "Bytes received, excluding headers.",
+            [](const http::PoolStats& s) { return s.bytesReceived; });
+    perPool("arbiter_http_in_flight", "gauge",
+            "HTTP requests in flight.",
+            [](const http::PoolStats& s) { return s.inFlight; });
+    perPool("arbiter_http_queued", "gauge",
+            "HTTP requests awaiting a handle.",
+            [](const http::PoolStats& s) { return s.queued; });
+
+    metricFamily(out, "arbiter_http_concurrency", "gauge",
+            "Limit on HTTP requests in flight at once.");
+    for (std::size_t i(0); i < pools.size(); ++i)
+    {
+        metricSample(out, "arbiter_http_concurrency", stats[i].first,
+                std::to_string(pools[i].second->concurrency()));
+    }
+
+    // Bucket i of the waits counts those of less than 2^i microseconds.
+    metricFamily(out, "arbiter_http_wait_seconds", "histogram",
+            "Time HTTP requests waited for a handle.");
+    for (const auto& s : stats)
+    {
+        const std::vector<std::uint64_t>& waits(s.second.waits);
+
+        std::uint64_t cumulative(0);
+        for (std::size_t i(0); i < waits.size(); ++i)
+        {
+            cumulative += waits[i];
+            const std::string le(i + 1 < waits.size() ?
+                    formatMetric((1ULL << i) / 1e6) : "+Inf");
+            metricSample(out, "arbiter_http_wait_seconds_bucket",
+                    s.first + "," + metricLabel("le", le),
+                    std::to_string(cumulative));
+        }
+        metricSample(out, "arbiter_http_wait_seconds_count", s.first,
+                std::to_string(cumulative));
+    }
+}
+
+void renderBlockCacheMetrics(const BlockCache& cache, std::string& out)
+{
+    metricFamily(out, "arbiter_block_cache_hits", "counter",
+            "Blocks found in the block cache, or already being fetched.");
+    metricSample(out, "arbiter_block_cache_hits_total", "",
+            std::to_string(cache.hits()));
+
+    metricFamily(out, "arbiter_block_cache_misses", "counter",
+            "Blocks which were fetched for the block cache.");
+    metricSample(out, "arbiter_block_cache_misses_total", "",
+            std::to_string(cache.misses()));
+
+    if (cache.shared())
+    {
+        metricFamily(out, "arbiter_block_cache_shared_hits", "counter",
+                "Missed blocks which were found in the shared blocks.");
+        metricSample(out, "arbiter_block_cache_shared_hits_total", "",
+                std::to_string(cache.sharedHits()));
+    }
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#include <arbiter/util/trace.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+class BlockCache;
+
+namespace http
+{
+class Pool;
+}
+
+/** @brief A Tracer which counts operations, for export in the OpenMetrics
+ * text format by Arbiter::metrics.
+ *
+ * Operations are counted by driver, operation, and host, with their
+ * failures, bytes, and a histogram of their durations.  Each thread records
+ * into one of a fixed set of shards, chosen by its id, so recording takes
+ * an uncontended lock, and the shards are only combined when rendered.
+ */
+class ARBITER_DLL MetricsTracer : public Tracer
+{
+public:
+    /** Upper bounds, in seconds, of the buckets of the duration histogram,
+     * besides the last, which is unbounded.
+     */
+    static constexpr std::size_t bounds = 15;
+    static const std::array<double, bounds> bucketBounds;
+
+    explicit MetricsTracer(std::size_t shards = 16);
+
+    virtual void end(const TraceEvent& event) override;
+
+    /** Append our metric families to @p out, without the terminating
+     * `# EOF` line.
+     */
+    void render(std::string& out) const;
+
+private:
+    // Driver, operation, and host.
+    using Key = std::tuple<std::string, std::string, std::string>;
+
+    struct Series
+    {
+        std::uint64_t count = 0;
+        std::uint64_t failures = 0;
+        std::uint64_t bytes = 0;
+        double seconds = 0;
+        std::array<std::uint64_t, bounds + 1> buckets { };
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::map<Key, Series> series;
+    };
+
+    MetricsTracer(const MetricsTracer&);
+    MetricsTracer& operator=(const MetricsTracer&);
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+/** Append to @p out, in the OpenMetrics text format, the request counts,
+ * failures, retries, hedges, circuit breaker refusals, bytes, occupancy,
+ * and wait histograms of each of @p pools, labeled by name.
+ */
+ARBITER_DLL void renderPoolMetrics(
+        const std::vector<std::pair<std::string, const http::Pool*>>& pools,
+        std::string& out);
+
+/** Append to @p out, in the OpenMetrics text format, the hits and misses of
+ * @p cache.
+ */
+ARBITER_DLL void renderBlockCacheMetrics(
+        const BlockCache& cache,
+        std::string& out);
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,200 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/paths.hpp>
+
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    // Suffixes are packed into blocks of this size, or are given a block of
+    // their own if they are larger.
+    const std::size_t pathBlockSize(256 * 1024);
+}
+
+int PathList::Suffix::compare(const Suffix& other) const
+{
+    const std::size_t common((std::min)(m_size, other.m_size));
+    if (common)
+    {
+        if (const int c = std::memcmp(m_data, other.m_data, common)) return c;
+    }
+    if (m_size == other.m_size) return 0;
+    return m_size < other.m_size ? -1 : 1;
+}
+
+PathList::PathList(std::string prefix)
+    : m_prefix(std::move(prefix))
+{ }
+
+PathList::PathList(PathList&& other)
+    : m_prefix(std::move(other.m_prefix))
+    , m_entries(std::move(other.m_entries))
+    , m_blocks(std::move(other.m_blocks))
+    , m_blockBytes(other.m_blockBytes)
+    , m_pos(other.m_pos)
+    , m_left(other.m_left)
+{
+    other.m_entries.clear();
+    other.m_blocks.clear();
+    other.m_blockBytes = 0;
+    other.m_pos = nullptr;
+    other.m_left = 0;
+}
+
+PathList& PathList::operator=(PathList&& other)
+{
+    if (this != &other)
+    {
+        m_prefix = std::move(other.m_prefix);
+        m_entries = std::move(other.m_entries);
+        m_blocks = std::move(other.m_blocks);
+        m_blockBytes = other.m_blockBytes;
+        m_pos = other.m_pos;
+        m_left = other.m_left;
+
+        other.m_entries.clear();
+        other.m_blocks.clear();
+        other.m_blockBytes = 0;
+        other.m_pos = nullptr;
+        other.m_left = 0;
+    }
+    return *this;
+}
+
+char* PathList::allocate(const std::size_t size)
+{
+    if (size > m_left)
+    {
+        // A suffix too large to share a block is given its own, leaving the
+        // current block to be filled by those which follow.
+        const std::size_t blockSize((std::max)(size, pathBlockSize));
+        std::unique_ptr<char[]> block(new char[blockSize]);
+        char* data(block.get());
+
+        m_blocks.push_back(std::move(block));
+        m_blockBytes += blockSize;
+
+        if (blockSize > pathBlockSize) return data;
+
+        m_pos = data;
+        m_left = blockSize;
+    }
+
+    char* data(m_pos);
+    m_pos += size;
+    m_left -= size;
+    return data;
+}
+
+void PathList::pushSuffix(const char* const suffix, const std::size_t size)
+{
+    append(suffix, size, nullptr, 0);
+}
+
+void PathList::pushSuffix(const std::string& head, const char* const tail)
+{
+    append(head.data(), head.size(), tail, std::strlen(tail));
+}
+
+void PathList::append(
+        const char* const a,
+        const std::size_t aSize,
+        const char* const b,
+        const std::size_t bSize)
+{
+    const std::size_t size(aSize + bSize);
+    if (size > (std::numeric_limits<std::uint32_t>::max)())
+    {
+        throw ArbiterError("Path too long");
+    }
+
+    char* data(allocate(size));
+    std::copy(a, a + aSize, data);
+    std::copy(b, b + bSize, data + aSize);
+
+    Entry entry;
+    entry.data = data;
+    entry.size = static_cast<std::uint32_t>(size);
+    m_entries.push_back(entry);
+}
+
+void PathList::push(const std::string& path)
+{
+    if (path.compare(0, m_prefix.size(), m_prefix) != 0)
+    {
+        // Shorten the prefix to the part we share, and move the rest of it
+        // into each suffix.
+        const std::size_t shared(
+                std::mismatch(
+                    m_prefix.begin(),
+                    m_prefix.begin() + (std::min)(m_prefix.size(), path.size()),
+                    path.begin()).first - m_prefix.begin());
+
+        PathList shortened(m_prefix.substr(0, shared));
+        const std::string moved(m_prefix.substr(shared));
+        for (const Entry& e : m_entries)
+        {
+            shortened.append(moved.data(), moved.size(), e.data, e.size);
+        }
+        *this = std::move(shortened);
+    }
+
+    pushSuffix(path.data() + m_prefix.size(), path.size() - m_prefix.size());
+}
+
+std::string PathList::operator[](const std::size_t i) const
+{
+    const Entry& e(m_entries.at(i));
+    std::string path;
+    path.reserve(m_prefix.size() + e.size);
+    path.append(m_prefix);
+    path.append(e.data, e.size);
+    return path;
+}
+
+void PathList::sort()
+{
+    std::sort(
+            m_entries.begin(),
+            m_entries.end(),
+            [](const Entry& a, const Entry& b)
+            {
+                return Suffix(a.data, a.size) < Suffix(b.data, b.size);
+            });
+}
+
+std::vector<std::string> PathList::strings() const
+{
+    std::vector<std::string> paths;
+    paths.reserve(size());
+    for (std::size_t i(0); i < size(); ++i) paths.push_back((*this)[i]);
+    return paths;
+}
+
+std::size_t PathList::bytes() const
+{
+    return
+        m_prefix.capacity() +
+        m_entries.capacity() * sizeof(Entry) +
+        m_blocks.capacity() * sizeof(std::unique_ptr<char[]>) +
+        m_blockBytes;
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief A compact list of paths, such as the results of a large glob.
+ *
+ * The prefix which the paths share, like `s3://bucket/dir/`, is held once,
+ * and the suffix of each path is packed into large blocks of memory, so
+ * that a listing of many millions of keys costs little more than the bytes
+ * which are unique to each, rather than a separately allocated string per
+ * path.
+ *
+ * Suffixes are read in place as a PathList::Suffix, valid for the lifetime
+ * of the list, and whole paths are only built when asked for.
+ */
+class ARBITER_DLL PathList
+{
+public:
+    /** @brief A view of the suffix of a path within a PathList. */
+    class Suffix
+    {
+    public:
+        Suffix() { }
+        Suffix(const char* data, std::size_t size)
+            : m_data(data)
+            , m_size(size)
+        { }
+
+        const char* data() const { return m_data; }
+        std::size_t size() const { return m_size; }
+        bool empty() const { return !m_size; }
+
+        std::string str() const { return std::string(m_data, m_size); }
+
+        /** Negative, zero, or positive as we sort before, with, or after
+         * @p other.
+         */
+        int compare(const Suffix& other) const;
+
+        bool operator<(const Suffix& other) const
+        {
+            return compare(other) < 0;
+        }
+
+        bool operator==(const Suffix& other) const
+        {
+            return compare(other) == 0;
+        }
+
+    private:
+        const char* m_data = nullptr;
+        std::size_t m_size = 0;
+    };
+
+    /** @brief Iterates over the suffixes of a PathList. */
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Suffix;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Suffix*;
+        using reference = Suffix;
+
+        const_iterator(const PathList& list, std::size_t i)
+            : m_list(&list)
+            , m_i(i)
+        { }
+
+        Suffix operator*() const { return m_list->suffix(m_i); }
+
+        const_iterator& operator++()
+        {
+            ++m_i;
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            return m_i == other.m_i;
+        }
+
+        bool operator!=(const const_iterator& other) const
+        {
+            return m_i != other.m_i;
+        }
+
+    private:
+        const PathList* m_list;
+        std::size_t m_i;
+    };
+
+    explicit PathList(std::string prefix = std::string());
+
+    PathList(PathList&& other);
+    PathList& operator=(PathList&& other);
+
+    /** The prefix shared by every path. */
+    const std::string& prefix() const { return m_prefix; }
+
+    std::size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+
+    /** Append the path made of our prefix followed by the @p size bytes at
+     * @p suffix.
+     */
+    void pushSuffix(const char* suffix, std::size_t size);
+
+    /** Append the path made of our prefix, @p head, and the null-terminated
+     * @p tail, without first joining them.
+     */
+    void pushSuffix(const std::string& head, const char* tail);
+
+    /** Append @p path, which should begin with our prefix.  If it doesn't,
+     * the prefix is shortened to the part which they share, which rewrites
+     * every suffix, so lists should be created with a prefix which all of
+     * their paths share.
+     */
+    void push(const std::string& path);
+
+    /** The suffix of the path at @p i. */
+    Suffix suffix(std::size_t i) const
+    {
+        const Entry& e(m_entries[i]);
+        return Suffix(e.data, e.size);
+    }
+
+    /** The whole path at @p i. */
+    std::string operator[](std::size_t i) const;
+
+    const_iterator begin() const { return const_iterator(*this, 0); }
+    const_iterator end() const { return const_iterator(*this, size()); }
+
+    /** Sort the paths, which only compares their suffixes. */
+    void sort();
+
+    /** The whole paths, as separate strings. */
+    std::vector<std::string> strings() const;
+
+    /** The bytes held, including the prefix and the index of suffixes. */
+    std::size_t bytes() const;
+
+private:
+    struct Entry
+    {
+        const char* data;
+        std::uint32_t size;
+    };
+
+    PathList(const PathList&);
+    PathList& operator=(const PathList&);
+
+    // Reserve @p size contiguous bytes in the arena.
+    char* allocate(std::size_t size);
+
+    // Append the suffix made of the @p aSize bytes at @p a followed by the
+    // @p bSize bytes at @p b.
+    void append(
+            const char* a,
+            std::size_t aSize,
+            const char* b,
+            std::size_t bSize);
+
+    std::string m_prefix;
+    std::vector<Entry> m_entries;
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    std::size_t m_blockBytes = 0;
+    char* m_pos = nullptr;
+    std::size_t m_left = 0;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
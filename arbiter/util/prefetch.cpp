@@ -0,0 +1,132 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/prefetch.hpp>
+
+#include <arbiter/util/executor.hpp>
+#include <arbiter/util/json.hpp>
+#endif
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const std::size_t defaultPrefetchWindow(8);
+}
+
+struct Prefetcher::Slot
+{
+    Slot() : future(promise.get_future().share()) { }
+
+    std::atomic<bool> claimed{ false };
+    std::promise<Data> promise;
+    std::shared_future<Data> future;
+};
+
+Prefetcher::Prefetcher(
+        Executor& executor,
+        Fetch fetch,
+        const std::size_t window)
+    : m_executor(executor)
+    , m_fetch(fetch)
+    , m_window((std::max)(window, std::size_t(1)))
+{ }
+
+std::unique_ptr<Prefetcher> Prefetcher::create(
+        Executor& executor,
+        Fetch fetch,
+        const std::string s)
+{
+    const json j(s.size() ? json::parse(s) : json());
+    const std::size_t window(
+            j.is_object() ?
+                j.value("window", defaultPrefetchWindow) :
+                defaultPrefetchWindow);
+
+    return std::unique_ptr<Prefetcher>(new Prefetcher(executor, fetch, window));
+}
+
+void Prefetcher::prefetch(const std::vector<std::string>& keys)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const std::string& key : keys)
+    {
+        if (m_held.count(key)) continue;
+        if (std::find(m_queue.begin(), m_queue.end(), key) != m_queue.end())
+        {
+            continue;
+        }
+
+        m_queue.push_back(key);
+    }
+
+    startQueued();
+}
+
+bool Prefetcher::take(const std::string& key, Data& data)
+{
+    std::shared_ptr<Slot> slot;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it(m_held.find(key));
+        if (it == m_held.end()) return false;
+
+        slot = it->second;
+        m_held.erase(it);
+        startQueued();
+    }
+
+    // Rather than waiting behind other work on the executor, which might
+    // include ourselves, run the fetch here if it hasn't started.
+    run(*slot, key);
+
+    data = slot->future.get();
+    return true;
+}
+
+void Prefetcher::erase(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_queue.erase(
+            std::remove(m_queue.begin(), m_queue.end(), key),
+            m_queue.end());
+    if (m_held.erase(key)) startQueued();
+}
+
+void Prefetcher::run(Slot& slot, const std::string& key) const
+{
+    if (slot.claimed.exchange(true)) return;
+
+    try { slot.promise.set_value(m_fetch(key)); }
+    catch (...) { slot.promise.set_exception(std::current_exception()); }
+}
+
+void Prefetcher::startQueued()
+{
+    while (m_queue.size() && m_held.size() < m_window)
+    {
+        const std::string key(m_queue.front());
+        m_queue.pop_front();
+
+        std::shared_ptr<Slot> slot(std::make_shared<Slot>());
+        m_held[key] = slot;
+        m_executor.post([this, slot, key]() { run(*slot, key); });
+    }
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
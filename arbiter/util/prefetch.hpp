@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+class Executor;
+
+/** @brief Read-ahead of objects which are known to be needed soon.
+ *
+ * Objects are fetched in the background, in the order requested, keeping a
+ * window of at most a fixed number of them in flight or fetched and not yet
+ * taken.  As objects are taken, the next queued ones are started, so a
+ * sequential scan over a list of objects finds each already fetched.
+ *
+ * Prefetched objects are assumed to be unchanging, so writes to an object
+ * must be followed by a call to Prefetcher::erase.
+ */
+class ARBITER_DLL Prefetcher
+{
+public:
+    using Data = std::shared_ptr<std::vector<char>>;
+
+    /** Fetch the object identified by a key, or return null if it does not
+     * exist.
+     */
+    using Fetch = std::function<Data(const std::string& key)>;
+
+    /** Fetch with @p fetch on @p executor, keeping at most @p window objects
+     * in flight or held at once.
+     */
+    Prefetcher(Executor& executor, Fetch fetch, std::size_t window);
+
+    /** Create from the stringified JSON @p j, which is the `prefetch` entry
+     * of the Arbiter configuration.  Its key is `window`, by default 8.
+     */
+    static std::unique_ptr<Prefetcher> create(
+            Executor& executor,
+            Fetch fetch,
+            std::string j);
+
+    /** Queue the objects identified by @p keys to be fetched in order.  Keys
+     * which are already queued or held are skipped.
+     */
+    void prefetch(const std::vector<std::string>& keys);
+
+    /** If the object identified by @p key has been prefetched, wait for it
+     * if necessary, set @p data to it, and return true.  If its fetch has
+     * not yet begun, it is run on the calling thread instead.  The object is
+     * no longer held afterward.  Errors from the fetch are propagated.
+     */
+    bool take(const std::string& key, Data& data);
+
+    /** Drop the object identified by @p key, whether queued or held. */
+    void erase(const std::string& key);
+
+    std::size_t window() const { return m_window; }
+
+private:
+    // A fetch, which is run by whichever of its task or a taker claims it.
+    struct Slot;
+
+    void run(Slot& slot, const std::string& key) const;
+
+    // Requires m_mutex to be held.
+    void startQueued();
+
+    Prefetcher(const Prefetcher&);
+    Prefetcher& operator=(const Prefetcher&);
+
+    Executor& m_executor;
+    const Fetch m_fetch;
+    const std::size_t m_window;
+
+    std::mutex m_mutex;
+    std::deque<std::string> m_queue;
+    std::map<std::string, std::shared_ptr<Slot>> m_held;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
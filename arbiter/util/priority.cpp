@@ -0,0 +1,42 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/priority.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    Priority& currentPriority()
+    {
+        thread_local Priority priority(Priority::Normal);
+        return priority;
+    }
+}
+
+PriorityScope::PriorityScope(const Priority priority)
+    : m_previous(currentPriority())
+{
+    currentPriority() = priority;
+}
+
+PriorityScope::~PriorityScope()
+{
+    currentPriority() = m_previous;
+}
+
+Priority PriorityScope::current()
+{
+    return currentPriority();
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
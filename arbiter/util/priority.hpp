@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief The class of service of a request, which decides the order in
+ * which waiting requests are given HTTP handles once a pool is exhausted.
+ *
+ * Each class is served in proportion to its weight, so that interactive
+ * reads are not stuck behind a deep queue of bulk transfers, while bulk
+ * transfers still make progress under a steady interactive load.
+ */
+enum class Priority
+{
+    Interactive,
+    Normal,
+    Bulk
+};
+
+/** Number of distinct priorities. */
+constexpr std::size_t priorities = 3;
+
+/** @brief Makes a Priority current on the calling thread for its lifetime.
+ * Scopes nest, restoring the previous priority when destroyed.
+ *
+ * As with CancelScope, the priority is carried along to asynchronous
+ * operations and to the threads of concurrent operations.  Arbiter::copy
+ * and its relatives run under Priority::Bulk, and everything else under
+ * Priority::Normal unless a scope says otherwise.
+ */
+class ARBITER_DLL PriorityScope
+{
+public:
+    explicit PriorityScope(Priority priority);
+    ~PriorityScope();
+
+    /** The current priority of the calling thread. */
+    static Priority current();
+
+private:
+    PriorityScope(const PriorityScope&);
+    PriorityScope& operator=(const PriorityScope&);
+
+    Priority m_previous;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
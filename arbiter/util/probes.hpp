@@ -0,0 +1,26 @@
+#pragma once
+
+// Static tracepoints, for tools like bpftrace, perf, and SystemTap to attach
+// to in a running process.  They are only compiled in if ARBITER_USDT is
+// defined, which the build does when configured with ARBITER_USDT on and
+// sys/sdt.h is found.  Otherwise ARBITER_PROBE expands to nothing and its
+// arguments are never evaluated.
+//
+// Each probe is named as `arbiter:<name>`, with these arguments:
+//
+//  http__start     curl handle
+//  http__done      curl handle, HTTP code, curl code, total microseconds
+//  acquire__start  pool, host
+//  acquire__done   pool, handle id, wait microseconds
+//  http__retry     method, URL, attempt, HTTP code, delay milliseconds
+//  sign__start     verb
+//  sign__done      verb
+//  list__page      driver, URL or bucket, page, bytes
+
+#ifdef ARBITER_USDT
+#include <sys/sdt.h>
+#define ARBITER_PROBE(...) STAP_PROBEV(arbiter, __VA_ARGS__)
+#else
+#define ARBITER_PROBE(...) do { } while (false)
+#endif
+
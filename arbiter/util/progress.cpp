@@ -0,0 +1,151 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/progress.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    Progress*& currentProgress()
+    {
+        thread_local Progress* progress(nullptr);
+        return progress;
+    }
+}
+
+Progress::Progress(Callback callback, const Clock::duration interval)
+    : m_callback(callback)
+    , m_interval(interval)
+    , m_start(Clock::now())
+    , m_bytes(0)
+    , m_totalBytes(0)
+    , m_files(0)
+    , m_totalFiles(0)
+    , m_active(0)
+    , m_due(interval.count())
+    , m_reported(m_start)
+{ }
+
+void Progress::expect(const std::size_t files, const std::uint64_t bytes)
+{
+    m_totalFiles += files;
+    m_totalBytes += bytes;
+}
+
+void Progress::add(const std::uint64_t bytes)
+{
+    if (!bytes) return;
+    m_bytes += bytes;
+    m_active = (Clock::now() - m_start).count();
+    poll();
+}
+
+void Progress::fileDone()
+{
+    ++m_files;
+    m_active = (Clock::now() - m_start).count();
+    poll();
+}
+
+void Progress::poll()
+{
+    if (!m_callback) return;
+
+    const Clock::time_point now(Clock::now());
+    const Clock::rep ticks((now - m_start).count());
+
+    // Whichever thread moves the due time along makes the report.
+    Clock::rep due(m_due);
+    if (ticks < due) return;
+    if (!m_due.compare_exchange_strong(due, ticks + m_interval.count()))
+    {
+        return;
+    }
+
+    ProgressReport report;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const std::uint64_t bytes(m_bytes);
+        const double seconds(
+                std::chrono::duration<double>(now - m_reported).count());
+        m_throughput = seconds > 0 ? (bytes - m_reportedBytes) / seconds : 0;
+        m_reported = now;
+        m_reportedBytes = bytes;
+
+        report = snapshot(now, m_throughput);
+    }
+
+    m_callback(report);
+}
+
+ProgressReport Progress::report() const
+{
+    const Clock::time_point now(Clock::now());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_throughput >= 0) return snapshot(now, m_throughput);
+
+    const double seconds(std::chrono::duration<double>(now - m_start).count());
+    return snapshot(now, seconds > 0 ? m_bytes / seconds : 0);
+}
+
+ProgressReport Progress::snapshot(
+        const Clock::time_point now,
+        const double throughput) const
+{
+    ProgressReport r;
+    r.bytes = m_bytes;
+    r.totalBytes = m_totalBytes;
+    r.files = m_files;
+    r.totalFiles = m_totalFiles;
+    r.throughput = throughput;
+    r.elapsed = now - m_start;
+    r.idle = r.elapsed - Clock::duration(m_active);
+
+    if (r.totalBytes)
+    {
+        const std::uint64_t remaining(
+                r.totalBytes > r.bytes ? r.totalBytes - r.bytes : 0);
+        if (!remaining) r.eta = 0;
+        else if (throughput > 0) r.eta = remaining / throughput;
+    }
+    else if (r.totalFiles && r.files)
+    {
+        const std::size_t remaining(
+                r.totalFiles > r.files ? r.totalFiles - r.files : 0);
+        r.eta = std::chrono::duration<double>(r.elapsed).count() *
+            remaining / r.files;
+    }
+
+    return r;
+}
+
+ProgressScope::ProgressScope(Progress* progress)
+    : m_previous(currentProgress())
+{
+    currentProgress() = progress;
+}
+
+ProgressScope::~ProgressScope()
+{
+    currentProgress() = m_previous;
+}
+
+Progress* ProgressScope::current()
+{
+    return currentProgress();
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief The state of the transfers watched by a Progress. */
+struct ARBITER_DLL ProgressReport
+{
+    using Duration = std::chrono::steady_clock::duration;
+
+    /** Bytes read from the sources of the transfers so far. */
+    std::uint64_t bytes = 0;
+
+    /** Bytes expected in all, or zero if unknown. */
+    std::uint64_t totalBytes = 0;
+
+    /** Files completed so far. */
+    std::size_t files = 0;
+
+    /** Files expected in all, or zero if unknown. */
+    std::size_t totalFiles = 0;
+
+    /** Bytes per second since the previous report. */
+    double throughput = 0;
+
+    /** Time since the Progress was created. */
+    Duration elapsed = Duration(0);
+
+    /** Time since a byte was last read or a file was last completed, which
+     * grows while the transfers are stalled.
+     */
+    Duration idle = Duration(0);
+
+    /** Estimated seconds remaining, from the bytes if their total is known,
+     * or else from the files, or negative if neither is known.
+     */
+    double eta = -1;
+};
+
+/** @brief Aggregates the progress of transfers across the threads working
+ * on them, and reports it to a callback at an interval.
+ *
+ * Transfers observe the Progress made current by a ProgressScope.  Bytes
+ * received by HTTP transfers are counted as curl reports them, and bytes
+ * read from local files as they are copied, so that a copy counts the bytes
+ * of its source once.  Copies within a single driver, like a server-side
+ * S3 copy, count only their files.  Arbiter::copy and Arbiter::sync set the
+ * expected totals, and count their files as they complete.
+ *
+ * The callback is called from whichever thread makes progress once the
+ * interval has passed, one call at a time.  While HTTP transfers are
+ * running, curl reports their progress about once a second even if no data
+ * flows, so a stall is reported with a growing ProgressReport::idle rather
+ * than by silence.  The callback must not throw.
+ */
+class ARBITER_DLL Progress
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void(const ProgressReport&)>;
+
+    explicit Progress(
+            Callback callback = Callback(),
+            Clock::duration interval = std::chrono::seconds(1));
+
+    /** Add @p files and @p bytes to the totals we expect. */
+    void expect(std::size_t files, std::uint64_t bytes = 0);
+
+    /** Count @p bytes read. */
+    void add(std::uint64_t bytes);
+
+    /** Count a completed file. */
+    void fileDone();
+
+    /** Report if the interval has passed, even without new progress. */
+    void poll();
+
+    /** The current state, with the throughput of the last report, or the
+     * average throughput if there has been none.
+     */
+    ProgressReport report() const;
+
+private:
+    ProgressReport snapshot(Clock::time_point now, double throughput) const;
+
+    Progress(const Progress&);
+    Progress& operator=(const Progress&);
+
+    const Callback m_callback;
+    const Clock::duration m_interval;
+    const Clock::time_point m_start;
+
+    std::atomic<std::uint64_t> m_bytes;
+    std::atomic<std::uint64_t> m_totalBytes;
+    std::atomic<std::size_t> m_files;
+    std::atomic<std::size_t> m_totalFiles;
+
+    // Ticks of the Clock since m_start, of the last progress made and of the
+    // next report due.
+    std::atomic<Clock::rep> m_active;
+    std::atomic<Clock::rep> m_due;
+
+    mutable std::mutex m_mutex;
+    Clock::time_point m_reported;
+    std::uint64_t m_reportedBytes = 0;
+    double m_throughput = -1;
+};
+
+/** @brief Makes a Progress current on the calling thread for its lifetime.
+ * Scopes nest, restoring the previous Progress when destroyed.  A null
+ * Progress watches nothing.
+ *
+ * As with CancelScope, the Progress is carried along to asynchronous
+ * operations and to the threads of concurrent operations.
+ */
+class ARBITER_DLL ProgressScope
+{
+public:
+    explicit ProgressScope(Progress* progress);
+    explicit ProgressScope(Progress& progress) : ProgressScope(&progress) { }
+    ~ProgressScope();
+
+    /** The Progress of the calling thread, or null if there is none. */
+    static Progress* current();
+
+private:
+    ProgressScope(const ProgressScope&);
+    ProgressScope& operator=(const ProgressScope&);
+
+    Progress* m_previous;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,50 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/rate.hpp>
+
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+namespace http
+{
+
+RateLimit::RateLimit(const std::uint64_t rate)
+    : m_rate(rate)
+    , m_capacity((std::max)(rate / 10.0, 64.0 * 1024))
+    , m_tokens(m_capacity)
+    , m_last(Clock::now())
+{
+    if (!m_rate) throw ArbiterError("Rate limit must be positive");
+}
+
+RateLimit::Clock::duration RateLimit::take(const std::size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const Clock::time_point now(Clock::now());
+    const std::chrono::duration<double> elapsed(now - m_last);
+    m_last = now;
+
+    m_tokens = (std::min)(m_capacity, m_tokens + elapsed.count() * m_rate);
+    m_tokens -= bytes;
+
+    if (m_tokens >= 0) return Clock::duration(0);
+
+    return std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(-m_tokens / m_rate));
+}
+
+} // namespace http
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
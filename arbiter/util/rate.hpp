@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+namespace http
+{
+
+/** @brief A token bucket limiting the bytes per second shared by many
+ * transfers.
+ *
+ * Transfers charge the bytes they move as they move them, and are told how
+ * long to pause to stay within the rate.  The bucket holds up to a tenth of
+ * a second of tokens, or 64 KiB if that is more, so that short bursts pass
+ * without pausing while sustained traffic settles at the rate.
+ *
+ * Charges may overdraw the bucket, in which case the pause covers the
+ * deficit, so that a charge larger than the bucket can't wait forever.
+ */
+class ARBITER_DLL RateLimit
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /** Allow @p rate bytes per second, which must be positive. */
+    explicit RateLimit(std::uint64_t rate);
+
+    /** Charge @p bytes against the limit, returning the time for which the
+     * caller should pause before moving more.
+     */
+    Clock::duration take(std::size_t bytes);
+
+    /** The limit, in bytes per second. */
+    std::uint64_t rate() const { return m_rate; }
+
+private:
+    RateLimit(const RateLimit&);
+    RateLimit& operator=(const RateLimit&);
+
+    const std::uint64_t m_rate;
+    const double m_capacity;
+
+    std::mutex m_mutex;
+    double m_tokens;
+    Clock::time_point m_last;
+};
+
+} // namespace http
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
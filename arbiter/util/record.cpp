@@ -0,0 +1,171 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/record.hpp>
+
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const std::string recordHeader("# arbiter recording 1");
+    const std::size_t recordBatch(64 * 1024);
+
+    std::uint64_t recordMicros(const TraceEvent::Clock::duration d)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d)
+            .count();
+    }
+
+    std::vector<std::string> recordFields(const std::string& line)
+    {
+        std::vector<std::string> fields;
+        std::size_t begin(0);
+        while (true)
+        {
+            const std::size_t end(line.find('\t', begin));
+            fields.push_back(line.substr(begin, end - begin));
+            if (end == std::string::npos) return fields;
+            begin = end + 1;
+        }
+    }
+}
+
+Recorder::Recorder(const std::string path)
+    : m_path(path)
+    , m_begin(TraceEvent::Clock::now())
+    , m_file(path, std::ofstream::binary | std::ofstream::trunc)
+{
+    if (!m_file.good()) throw ArbiterError("Could not record to " + path);
+    m_buffer = recordHeader + "\n";
+}
+
+Recorder::~Recorder()
+{
+    flush();
+}
+
+std::unique_ptr<Recorder> Recorder::create(const std::string s)
+{
+    std::unique_ptr<Recorder> recorder;
+
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object()) return recorder;
+
+    recorder.reset(new Recorder(c.at("path").get<std::string>()));
+    return recorder;
+}
+
+void Recorder::end(const TraceEvent& e)
+{
+    char hash[17];
+    std::snprintf(
+            hash,
+            sizeof(hash),
+            "%016llx",
+            static_cast<unsigned long long>(Recorder::hash(e.path)));
+
+    const std::string line(
+            std::to_string(recordMicros(e.start - m_begin)) + "\t" +
+            std::to_string(recordMicros(e.duration)) + "\t" +
+            e.driver + "\t" +
+            e.operation + "\t" +
+            hash + "\t" +
+            std::to_string(e.bytes) + "\t" +
+            std::to_string(e.offset) + "\t" +
+            std::to_string(e.length) + "\t" +
+            (e.failed ? "1" : "0") + "\n");
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer += line;
+    ++m_recorded;
+    if (m_buffer.size() >= recordBatch) write();
+}
+
+void Recorder::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    write();
+    m_file.flush();
+}
+
+void Recorder::write()
+{
+    // Tracers must not throw, so a failed write is only seen as a short
+    // recording.
+    m_file.write(m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+}
+
+std::size_t Recorder::recorded() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_recorded;
+}
+
+std::uint64_t Recorder::hash(const std::string& path)
+{
+    std::uint64_t h(0xcbf29ce484222325ull);
+    for (const char c : path)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+std::vector<RecordedOp> Recorder::parse(const std::string& data)
+{
+    std::vector<RecordedOp> ops;
+
+    std::size_t begin(data.find('\n'));
+    if (data.compare(0, begin, recordHeader))
+    {
+        throw ArbiterError("Not an arbiter recording");
+    }
+
+    while (begin != std::string::npos && ++begin < data.size())
+    {
+        const std::size_t end(data.find('\n', begin));
+        const std::string line(data.substr(begin, end - begin));
+        begin = end;
+        if (line.empty()) continue;
+
+        const std::vector<std::string> f(recordFields(line));
+        if (f.size() != 9)
+        {
+            throw ArbiterError("Invalid recorded operation: " + line);
+        }
+
+        RecordedOp op;
+        op.start = std::strtoull(f[0].c_str(), nullptr, 10);
+        op.duration = std::strtoull(f[1].c_str(), nullptr, 10);
+        op.driver = f[2];
+        op.operation = f[3];
+        op.path = std::strtoull(f[4].c_str(), nullptr, 16);
+        op.bytes = std::strtoull(f[5].c_str(), nullptr, 10);
+        op.offset = std::strtoull(f[6].c_str(), nullptr, 10);
+        op.length = std::strtoull(f[7].c_str(), nullptr, 10);
+        op.failed = f[8] == "1";
+        ops.push_back(op);
+    }
+
+    return ops;
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
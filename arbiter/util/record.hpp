@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#include <arbiter/util/trace.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief One operation of a workload recorded by a Recorder. */
+struct ARBITER_DLL RecordedOp
+{
+    /** Microseconds from the start of the recording to the start of the
+     * operation.
+     */
+    std::uint64_t start = 0;
+
+    /** Duration of the operation, in microseconds. */
+    std::uint64_t duration = 0;
+
+    /** Type of the Driver, and name of the operation, as in TraceEvent. */
+    std::string driver;
+    std::string operation;
+
+    /** Hash of the path, by Recorder::hash, so that a recording reveals
+     * which operations share a path but not what the paths are.
+     */
+    std::uint64_t path = 0;
+
+    /** Bytes read or written. */
+    std::size_t bytes = 0;
+
+    /** For ranged reads, the offset and length requested. */
+    std::size_t offset = 0;
+    std::size_t length = 0;
+
+    /** Set if the operation threw. */
+    bool failed = false;
+};
+
+/** @brief A Tracer which records the operations of a workload to a file,
+ * so that it may be replayed by a Replayer.
+ *
+ * Each operation is written when it ends, as a line of tab-separated
+ * fields of a RecordedOp following a header line.  Lines are buffered and
+ * written in batches, and any remaining when we are flushed or destroyed.
+ */
+class ARBITER_DLL Recorder : public Tracer
+{
+public:
+    /** Record to the local file at @p path, replacing it. */
+    explicit Recorder(std::string path);
+    ~Recorder();
+
+    /** Create from the stringified JSON @p j, which is an object with the
+     * key `path`.  If @p j is not an object, returns null.
+     */
+    static std::unique_ptr<Recorder> create(std::string j);
+
+    virtual void end(const TraceEvent& event) override;
+
+    /** Write any buffered operations. */
+    void flush();
+
+    /** Operations recorded so far. */
+    std::size_t recorded() const;
+
+    const std::string& path() const { return m_path; }
+
+    /** The hash by which paths are recorded, 64-bit FNV-1a. */
+    static std::uint64_t hash(const std::string& path);
+
+    /** Parse the contents of a recording.  Throws ArbiterError if they
+     * aren't one.
+     */
+    static std::vector<RecordedOp> parse(const std::string& data);
+
+private:
+    void write();
+
+    const std::string m_path;
+    const TraceEvent::Clock::time_point m_begin;
+
+    mutable std::mutex m_mutex;
+    std::ofstream m_file;
+    std::string m_buffer;
+    std::size_t m_recorded = 0;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,140 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/runtime.hpp>
+
+#include <arbiter/util/affinity.hpp>
+#include <arbiter/util/json.hpp>
+#endif
+
+#include <algorithm>
+#include <thread>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const std::size_t runtimeConcurrency(32);
+#ifdef ARBITER_CURL
+    const std::size_t runtimeRetryCount(8);
+#endif
+}
+
+Runtime::Runtime(const std::string s, std::shared_ptr<Executor> executor)
+{
+    json c(s.size() ? json::parse(s) : json::object());
+    if (c.is_null()) c = json::object();
+
+    // Threads may be pinned to CPUs by their role.  That of the HTTP I/O
+    // threads is read by the pools.
+    const json affinity(c.value("affinity", json::object()));
+    const auto pin([&affinity](const std::string& role)
+    {
+        return Affinity::create(
+                affinity.is_object() ?
+                    affinity.value(role, json()).dump() : json().dump());
+    });
+
+    m_compute = std::make_shared<Executor>(
+            c.value(
+                "computeThreads",
+                (std::max)(std::thread::hardware_concurrency(), 1u)),
+            pin("compute"));
+
+#ifdef ARBITER_CURL
+    m_pool.reset(
+            new http::Pool(
+                c.value("http", json::object())
+                    .value("concurrency", runtimeConcurrency),
+                runtimeRetryCount,
+                c.dump()));
+
+    // The drivers of the types named by `http.pools` have pools of their
+    // own, whose settings override those of the common pool.
+    const json httpConfig(c.value("http", json::object()));
+    const json pools(httpConfig.value("pools", json()));
+    if (pools.is_object())
+    {
+        json common(httpConfig);
+        common.erase("pools");
+
+        for (const auto& entry : pools.items())
+        {
+            json own(c);
+            own["http"] = merge(entry.value(), common);
+
+            m_pools[entry.key()].reset(
+                    new http::Pool(
+                        own["http"].value("concurrency", runtimeConcurrency),
+                        runtimeRetryCount,
+                        own.dump()));
+        }
+    }
+
+    // The types named by a `sidecar` are reached through the daemon on its
+    // socket, by a pool of our connections to it.
+    const json sidecar(c.value("sidecar", json()));
+    if (sidecar.is_object())
+    {
+        json common(httpConfig);
+        common.erase("pools");
+        common.erase("proxy");
+
+        json own(c);
+        own["http"] = merge(
+                json { { "unixSocket", sidecar.at("socket") } },
+                common);
+
+        m_pools["sidecar"].reset(
+                new http::Pool(
+                    sidecar.value(
+                        "concurrency",
+                        common.value("concurrency", runtimeConcurrency)),
+                    runtimeRetryCount,
+                    own.dump()));
+    }
+#endif
+
+    m_executor = executor ?
+        executor :
+        std::make_shared<Executor>(
+                c.value("threads", runtimeConcurrency),
+                pin("workers"));
+#ifdef ARBITER_CURL
+    m_pool->executor(m_executor.get());
+    m_pool->compute(m_compute.get());
+    for (auto& entry : m_pools)
+    {
+        entry.second->executor(m_executor.get());
+        entry.second->compute(m_compute.get());
+    }
+#endif
+
+    m_blocks = BlockCache::create(c.value("blocks", json()).dump());
+    m_budget = MemoryBudget::create(c.value("memory", json()).dump());
+    m_transfer = TransferPlanner::create(c.value("transfer", json()).dump());
+}
+
+std::shared_ptr<Runtime> Runtime::create(
+        const std::string j,
+        std::shared_ptr<Executor> executor)
+{
+    return std::make_shared<Runtime>(j, executor);
+}
+
+http::Pool& Runtime::httpPool(const std::string& type)
+{
+    const auto it(m_pools.find(type));
+    return it != m_pools.end() ? *it->second : *m_pool;
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
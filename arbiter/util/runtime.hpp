@@ -0,0 +1,124 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/blocks.hpp>
+#include <arbiter/util/budget.hpp>
+#include <arbiter/util/executor.hpp>
+#include <arbiter/util/exports.hpp>
+#include <arbiter/util/http.hpp>
+#include <arbiter/util/transfer.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief The resources which Arbiters may share: their HTTP pools,
+ * executors, caches, and credentials.
+ *
+ * Each Arbiter constructed from a configuration alone builds a Runtime of
+ * its own.  Several Arbiters with different driver configurations, as for
+ * different tenants, may instead be constructed from one Runtime, so that
+ * they share its connections, threads, block cache, memory budget, and
+ * transfer statistics, and discover the credentials of each profile once.
+ *
+ * A Runtime is built from the entries of an Arbiter configuration which
+ * describe these resources: `http`, with its `pools`, `sidecar`, `threads`,
+ * `computeThreads`, `affinity`, `blocks`, `memory`, and `transfer`.  They
+ * are used as given, without the merged configuration file read by the
+ * Arbiter.
+ */
+class ARBITER_DLL Runtime
+{
+public:
+    /** Build from the stringified JSON @p j.  If @p executor is not null,
+     * it is used rather than an Executor of our own, as by the Arbiter
+     * constructor which takes one.
+     */
+    explicit Runtime(
+            std::string j = "",
+            std::shared_ptr<Executor> executor = nullptr);
+
+    static std::shared_ptr<Runtime> create(
+            std::string j = "",
+            std::shared_ptr<Executor> executor = nullptr);
+
+    /** The common HTTP pool.  See Arbiter::httpPool. */
+    http::Pool& httpPool() { return *m_pool; }
+
+    /** The HTTP pool of the drivers of @p type.  See Arbiter::httpPool. */
+    http::Pool& httpPool(const std::string& type);
+
+    /** The common HTTP pool, or null if built without HTTP support. */
+    const http::Pool* commonPool() const { return m_pool.get(); }
+
+    /** The pools of their own, by the types given by `http.pools`, and that
+     * of the sidecar as `sidecar`.
+     */
+    const std::map<std::string, std::unique_ptr<http::Pool>>& pools() const
+    {
+        return m_pools;
+    }
+
+    Executor& executor() const { return *m_executor; }
+    Executor& compute() const { return *m_compute; }
+
+    BlockCache* blockCache() const { return m_blocks.get(); }
+    MemoryBudget* memoryBudget() const { return m_budget.get(); }
+    TransferPlanner* transferPlanner() const { return m_transfer.get(); }
+
+    /** @brief Fetch the shared object stored under @p key, creating it with
+     * @p create if there is none.
+     *
+     * Drivers keep their credential providers here, keyed by their
+     * configuration, so that those of each profile are discovered and
+     * refreshed once however many Arbiters use them.  Null results are not
+     * kept, so that a failed discovery is retried on next use.
+     */
+    template <typename T>
+    std::shared_ptr<T> shared(
+            const std::string& key,
+            const std::function<std::shared_ptr<T>()>& create)
+    {
+        std::lock_guard<std::mutex> lock(m_sharedMutex);
+        std::shared_ptr<void>& slot(m_shared[key]);
+        if (!slot) slot = create();
+        return std::static_pointer_cast<T>(slot);
+    }
+
+private:
+    Runtime(const Runtime&);
+    Runtime& operator=(const Runtime&);
+
+    // Declared before the pools, so that it outlives the work they hand it.
+    std::shared_ptr<Executor> m_compute;
+    std::unique_ptr<http::Pool> m_pool;
+    std::map<std::string, std::unique_ptr<http::Pool>> m_pools;
+    std::unique_ptr<BlockCache> m_blocks;
+    std::unique_ptr<MemoryBudget> m_budget;
+    std::unique_ptr<TransferPlanner> m_transfer;
+
+    std::mutex m_sharedMutex;
+    std::map<std::string, std::shared_ptr<void>> m_shared;
+
+    // Destroyed first, so any outstanding tasks complete while the pools
+    // they use still exist, unless it is shared.
+    std::shared_ptr<Executor> m_executor;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -1,12 +1,39 @@
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <new>
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/util/sha256.hpp>
 #include <arbiter/util/macros.hpp>
 #endif
 
+#ifdef ARBITER_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#else
+
+// Without OpenSSL, blocks are hashed with the SHA extensions of the CPU if it
+// has them, falling back to the portable implementation below.
+#   if (defined(__x86_64__) || defined(__i386__)) && \
+        (defined(__GNUC__) || defined(__clang__))
+#   define ARBITER_SHA256_X86
+#   include <cpuid.h>
+#   include <immintrin.h>
+#   elif defined(__aarch64__) && \
+        (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#   define ARBITER_SHA256_ARM
+#   include <arm_neon.h>
+#       ifdef __linux__
+#       include <sys/auxv.h>
+#       include <asm/hwcap.h>
+#       endif
+#   endif
+
+#endif
+
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
 {
@@ -19,6 +46,8 @@ namespace crypto
 namespace
 {
 
+#ifndef ARBITER_OPENSSL
+
 const std::size_t block(64);
 
 const std::vector<uint32_t> k {
@@ -40,6 +69,227 @@ const std::vector<uint32_t> k {
     0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
+// Hash @p blocks consecutive 64-byte blocks of @p data into @p state.
+using Transform = void (*)(uint32_t* state, const uint8_t* data, std::size_t);
+
+void transformPortable(
+        uint32_t* state,
+        const uint8_t* data,
+        std::size_t blocks)
+{
+    uint32_t a, b, c, d, e, f, g, h, i, j, t1, t2, m[64];
+
+    for ( ; blocks; --blocks, data += block)
+    {
+        for (i = 0, j = 0; i < 16; ++i, j += 4)
+        {
+            m[i] =
+                (data[j    ] << 24) |
+                (data[j + 1] << 16) |
+                (data[j + 2] << 8 ) |
+                (data[j + 3]);
+        }
+
+        for ( ; i < 64; ++i)
+        {
+            m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        for (i = 0; i < 64; ++i)
+        {
+            t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
+            t2 = EP0(a) + MAJ(a,b,c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef ARBITER_SHA256_X86
+// Intel SHA extensions.  These work on the state as the register pairs ABEF
+// and CDGH, four rounds per group of four message words.
+__attribute__((target("sha,sse4.1")))
+void transformX86(uint32_t* state, const uint8_t* data, std::size_t blocks)
+{
+    const __m128i mask(
+            _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL));
+
+    __m128i tmp(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)));
+    __m128i state1(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)));
+
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0(_mm_alignr_epi8(tmp, state1, 8));
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    __m128i w[4];
+
+    for ( ; blocks; --blocks, data += block)
+    {
+        const __m128i abef(state0);
+        const __m128i cdgh(state1);
+
+        for (int i(0); i < 16; ++i)
+        {
+            __m128i& cur(w[i % 4]);
+
+            if (i < 4)
+            {
+                cur = _mm_shuffle_epi8(
+                        _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(data + i * 16)),
+                        mask);
+            }
+            else
+            {
+                const __m128i& prev(w[(i + 3) % 4]);
+                cur = _mm_sha256msg2_epu32(
+                        _mm_add_epi32(
+                            _mm_sha256msg1_epu32(cur, w[(i + 1) % 4]),
+                            _mm_alignr_epi8(prev, w[(i + 2) % 4], 4)),
+                        prev);
+            }
+
+            const __m128i msg(
+                    _mm_add_epi32(
+                        cur,
+                        _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(&k[i * 4]))));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            state0 = _mm_sha256rnds2_epu32(
+                    state0,
+                    state1,
+                    _mm_shuffle_epi32(msg, 0x0E));
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+}
+
+bool haveX86()
+{
+    unsigned a(0), b(0), c(0), d(0);
+
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+    const bool ssse3(c & (1u << 9));
+    const bool sse41(c & (1u << 19));
+
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+    const bool sha(b & (1u << 29));
+
+    return ssse3 && sse41 && sha;
+}
+#endif
+
+#ifdef ARBITER_SHA256_ARM
+// ARMv8 cryptography extensions, which work on the state in order.
+void transformArm(uint32_t* state, const uint8_t* data, std::size_t blocks)
+{
+    uint32x4_t state0(vld1q_u32(state));
+    uint32x4_t state1(vld1q_u32(state + 4));
+
+    uint32x4_t w[4];
+
+    for ( ; blocks; --blocks, data += block)
+    {
+        const uint32x4_t abcd(state0);
+        const uint32x4_t efgh(state1);
+
+        for (int i(0); i < 4; ++i)
+        {
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+        }
+
+        for (int i(0); i < 16; ++i)
+        {
+            uint32x4_t& cur(w[i % 4]);
+
+            const uint32x4_t msg(vaddq_u32(cur, vld1q_u32(&k[i * 4])));
+            if (i < 12) cur = vsha256su0q_u32(cur, w[(i + 1) % 4]);
+
+            const uint32x4_t prev(state0);
+            state0 = vsha256hq_u32(state0, state1, msg);
+            state1 = vsha256h2q_u32(state1, prev, msg);
+
+            if (i < 12)
+            {
+                cur = vsha256su1q_u32(cur, w[(i + 2) % 4], w[(i + 3) % 4]);
+            }
+        }
+
+        state0 = vaddq_u32(state0, abcd);
+        state1 = vaddq_u32(state1, efgh);
+    }
+
+    vst1q_u32(state, state0);
+    vst1q_u32(state + 4, state1);
+}
+
+bool haveArm()
+{
+#ifdef __linux__
+    return getauxval(AT_HWCAP) & HWCAP_SHA2;
+#else
+    return true;
+#endif
+}
+#endif
+
+Transform selectTransform()
+{
+#ifdef ARBITER_SHA256_X86
+    if (haveX86()) return transformX86;
+#endif
+#ifdef ARBITER_SHA256_ARM
+    if (haveArm()) return transformArm;
+#endif
+    return transformPortable;
+}
+
+// The CPU is only inspected once.
+Transform transform()
+{
+    static const Transform t(selectTransform());
+    return t;
+}
+
+} // unnamed namespace
+
+// Outside of the unnamed namespace, since Context of the hasher holds it.
 struct Sha256Context
 {
     Sha256Context() : data(), datalen(0), bitlen(0), state()
@@ -60,76 +310,46 @@ struct Sha256Context
     uint32_t state[8];
 };
 
-void sha256_transform(Sha256Context *ctx, const uint8_t data[])
+namespace
 {
-    uint32_t a, b, c, d, e, f, g, h, i, j, t1, t2, m[64];
 
-    for (i = 0, j = 0; i < 16; ++i, j += 4)
-    {
-        m[i] =
-            (data[j    ] << 24) |
-            (data[j + 1] << 16) |
-            (data[j + 2] << 8 ) |
-            (data[j + 3]);
-    }
+void sha256_update(Sha256Context *ctx, const uint8_t data[], std::size_t len)
+{
+    const Transform t(transform());
 
-    for ( ; i < 64; ++i)
+    // Top off any partial block left over from a previous update.
+    if (ctx->datalen)
     {
-        m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
-    }
+        const std::size_t n((std::min)(len, block - ctx->datalen));
+        std::memcpy(ctx->data + ctx->datalen, data, n);
+        ctx->datalen += n;
+        data += n;
+        len -= n;
 
-    a = ctx->state[0];
-    b = ctx->state[1];
-    c = ctx->state[2];
-    d = ctx->state[3];
-    e = ctx->state[4];
-    f = ctx->state[5];
-    g = ctx->state[6];
-    h = ctx->state[7];
+        if (ctx->datalen < block) return;
 
-    for (i = 0; i < 64; ++i)
-    {
-        t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
-        t2 = EP0(a) + MAJ(a,b,c);
-        h = g;
-        g = f;
-        f = e;
-        e = d + t1;
-        d = c;
-        c = b;
-        b = a;
-        a = t1 + t2;
+        t(ctx->state, ctx->data, 1);
+        ctx->bitlen += 512;
+        ctx->datalen = 0;
     }
 
-    ctx->state[0] += a;
-    ctx->state[1] += b;
-    ctx->state[2] += c;
-    ctx->state[3] += d;
-    ctx->state[4] += e;
-    ctx->state[5] += f;
-    ctx->state[6] += g;
-    ctx->state[7] += h;
-}
-
-void sha256_update(Sha256Context *ctx, const uint8_t data[], std::size_t len)
-{
-    uint32_t i;
-
-    for (i = 0; i < len; ++i)
+    // Then hash whole blocks in place, buffering the remainder.
+    const std::size_t blocks(len / block);
+    if (blocks)
     {
-        ctx->data[ctx->datalen] = data[i];
-
-        if (++ctx->datalen == 64)
-        {
-            sha256_transform(ctx, ctx->data);
-            ctx->bitlen += 512;
-            ctx->datalen = 0;
-        }
+        t(ctx->state, data, blocks);
+        ctx->bitlen += blocks * 512;
+        data += blocks * block;
+        len -= blocks * block;
     }
+
+    std::memcpy(ctx->data, data, len);
+    ctx->datalen = len;
 }
 
 void sha256_final(Sha256Context *ctx, uint8_t hash[])
 {
+    const Transform t(transform());
     uint32_t i(ctx->datalen);
 
     // Pad whatever data is left in the buffer.
@@ -151,7 +371,7 @@ void sha256_final(Sha256Context *ctx, uint8_t hash[])
             ctx->data[i++] = 0x00;
         }
 
-        sha256_transform(ctx, ctx->data);
+        t(ctx->state, ctx->data, 1);
         std::memset(ctx->data, 0, 56);
     }
 
@@ -165,7 +385,7 @@ void sha256_final(Sha256Context *ctx, uint8_t hash[])
     ctx->data[58] = ctx->bitlen >> 40;
     ctx->data[57] = ctx->bitlen >> 48;
     ctx->data[56] = ctx->bitlen >> 56;
-    sha256_transform(ctx, ctx->data);
+    t(ctx->state, ctx->data, 1);
 
     // Since this implementation uses little endian byte ordering and SHA uses
     // big endian, reverse all the bytes when copying the final state to the
@@ -183,31 +403,76 @@ void sha256_final(Sha256Context *ctx, uint8_t hash[])
     }
 }
 
-} // unnamed namespace
+#endif // ARBITER_OPENSSL
 
-std::vector<char> sha256(const std::vector<char>& data)
+#ifdef ARBITER_OPENSSL
+EVP_MD_CTX* newDigestContext()
 {
-    std::vector<char> out(32, 0);
+#   if OPENSSL_VERSION_NUMBER >= 0x010100000
+    return EVP_MD_CTX_new();
+#   else
+    return EVP_MD_CTX_create();
+#   endif
+}
+
+void freeDigestContext(EVP_MD_CTX* ctx)
+{
+#   if OPENSSL_VERSION_NUMBER >= 0x010100000
+    EVP_MD_CTX_free(ctx);
+#   else
+    EVP_MD_CTX_destroy(ctx);
+#   endif
+}
+#endif
 
+void sha256(const char* data, std::size_t size, char* out)
+{
+#ifdef ARBITER_OPENSSL
+    EVP_Digest(
+            data,
+            size,
+            reinterpret_cast<unsigned char*>(out),
+            nullptr,
+            EVP_sha256(),
+            nullptr);
+#else
     Sha256Context ctx;
-    sha256_update(
-            &ctx,
-            reinterpret_cast<const uint8_t*>(data.data()),
-            data.size());
-    sha256_final(&ctx, reinterpret_cast<uint8_t*>(out.data()));
+    sha256_update(&ctx, reinterpret_cast<const uint8_t*>(data), size);
+    sha256_final(&ctx, reinterpret_cast<uint8_t*>(out));
+#endif
+}
 
+} // unnamed namespace
+
+std::vector<char> sha256(const std::vector<char>& data)
+{
+    std::vector<char> out(32, 0);
+    sha256(data.data(), data.size(), out.data());
     return out;
 }
 
 std::string sha256(const std::string& data)
 {
-    const std::vector<char> v(data.begin(), data.end());
-    const std::vector<char> result(sha256(v));
-    return std::string(result.data(), result.size());
+    std::string out(32, 0);
+    sha256(data.data(), data.size(), &out[0]);
+    return out;
 }
 
 std::string hmacSha256(const std::string& rawKey, const std::string& data)
 {
+#ifdef ARBITER_OPENSSL
+    std::string out(32, 0);
+    unsigned int size(0);
+    HMAC(
+            EVP_sha256(),
+            rawKey.data(),
+            static_cast<int>(rawKey.size()),
+            reinterpret_cast<const unsigned char*>(data.data()),
+            data.size(),
+            reinterpret_cast<unsigned char*>(&out[0]),
+            &size);
+    return out;
+#else
     std::string key(rawKey);
 
     if (key.size() > block) key = sha256(key);
@@ -223,6 +488,60 @@ std::string hmacSha256(const std::string& rawKey, const std::string& data)
     }
 
     return sha256(okeypad + sha256(ikeypad + data));
+#endif
+}
+
+struct Sha256::Context
+{
+#ifdef ARBITER_OPENSSL
+    Context() : md(newDigestContext())
+    {
+        if (!md) throw std::bad_alloc();
+        reset();
+    }
+
+    ~Context() { freeDigestContext(md); }
+
+    void reset() { EVP_DigestInit_ex(md, EVP_sha256(), nullptr); }
+
+    EVP_MD_CTX* md;
+#else
+    void reset() { ctx = Sha256Context(); }
+
+    Sha256Context ctx;
+#endif
+};
+
+Sha256::Sha256() : m_context(new Context()) { }
+Sha256::Sha256(Sha256&&) = default;
+Sha256& Sha256::operator=(Sha256&&) = default;
+Sha256::~Sha256() { }
+
+void Sha256::update(const char* data, const std::size_t size)
+{
+#ifdef ARBITER_OPENSSL
+    EVP_DigestUpdate(m_context->md, data, size);
+#else
+    sha256_update(
+            &m_context->ctx,
+            reinterpret_cast<const uint8_t*>(data),
+            size);
+#endif
+}
+
+std::string Sha256::finalize()
+{
+    std::string out(32, 0);
+#ifdef ARBITER_OPENSSL
+    EVP_DigestFinal_ex(
+            m_context->md,
+            reinterpret_cast<unsigned char*>(&out[0]),
+            nullptr);
+#else
+    sha256_final(&m_context->ctx, reinterpret_cast<uint8_t*>(&out[0]));
+#endif
+    m_context->reset();
+    return out;
 }
 
 } // namespace crypto
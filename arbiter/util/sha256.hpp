@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,37 @@ ARBITER_DLL std::string hmacSha256(
         const std::string& key,
         const std::string& data);
 
+/** @brief Incremental SHA-256, for data which is hashed as it arrives rather
+ * than buffered in full.
+ */
+class ARBITER_DLL Sha256
+{
+public:
+    Sha256();
+    Sha256(Sha256&&);
+    Sha256& operator=(Sha256&&);
+    ~Sha256();
+
+    /** Hash the next @p size bytes of the message. */
+    void update(const char* data, std::size_t size);
+
+    void update(const std::string& data) { update(data.data(), data.size()); }
+    void update(const std::vector<char>& data)
+    {
+        update(data.data(), data.size());
+    }
+
+    /** The 32-byte digest of the message passed to update since
+     * construction or the previous finalize, after which the hasher is reset
+     * to begin a new message.
+     */
+    std::string finalize();
+
+private:
+    struct Context;
+    std::unique_ptr<Context> m_context;
+};
+
 } // namespace crypto
 } // namespace arbiter
 
@@ -0,0 +1,102 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/slowlog.hpp>
+
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/log.hpp>
+#endif
+
+#include <cmath>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    std::string slowMillis(const SlowRequest::Duration d)
+    {
+        return std::to_string(d.count() / 1000) + " ms";
+    }
+
+    std::string describeSlow(const SlowRequest& req)
+    {
+        std::string s(
+                "slow " + req.source + " " + req.operation + " " + req.path +
+                ": " + slowMillis(req.elapsed));
+
+        if (req.source == "http")
+        {
+            const http::Transfer& t(req.transfer);
+            s += " (wait " + slowMillis(req.wait) +
+                "; dns " + slowMillis(t.dns) +
+                ", connect " + slowMillis(t.connect) +
+                ", tls " + slowMillis(t.tls) +
+                ", first byte " + slowMillis(t.firstByte) +
+                ", total " + slowMillis(t.total) + ")" +
+                ", code " + std::to_string(req.code) +
+                ", " + std::to_string(req.retries) + " retries";
+        }
+
+        return s + ", " + std::to_string(req.bytes) + " bytes";
+    }
+}
+
+SlowLog::SlowLog(const Duration threshold, const double sample)
+    : m_threshold(threshold)
+    , m_sample(sample)
+    , m_seen(0)
+{ }
+
+std::unique_ptr<SlowLog> SlowLog::create(const std::string s)
+{
+    std::unique_ptr<SlowLog> log;
+
+    const json c(s.size() ? json::parse(s) : json());
+    if (!c.is_object()) return log;
+
+    log.reset(new SlowLog(
+                std::chrono::milliseconds(c.value("threshold", 1000)),
+                c.value("sample", 1.0)));
+    return log;
+}
+
+void SlowLog::report(const SlowRequest& req)
+{
+    if (m_sample <= 0) return;
+
+    // Report the requests at which the running count of sampled requests
+    // reaches another whole number.
+    if (m_sample < 1)
+    {
+        const std::uint64_t n(++m_seen);
+        if (std::floor(n * m_sample) == std::floor((n - 1) * m_sample))
+        {
+            return;
+        }
+    }
+
+    Callback callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        callback = m_callback;
+    }
+
+    if (callback) callback(req);
+    else logging::warn(describeSlow(req));
+}
+
+void SlowLog::setCallback(Callback callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callback = std::move(callback);
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
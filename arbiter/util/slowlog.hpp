@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief A request which took at least the threshold of a SlowLog. */
+struct ARBITER_DLL SlowRequest
+{
+    using Duration = std::chrono::microseconds;
+
+    /** What made the request, `http` or `file`. */
+    std::string source;
+
+    /** The HTTP method, or for files the operation, like `read`. */
+    std::string operation;
+
+    /** The URL, or the path of the file. */
+    std::string path;
+
+    /** The host of the URL, empty for files. */
+    std::string host;
+
+    /** The HTTP status code of the final attempt, or zero for files. */
+    int code = 0;
+
+    /** Attempts which were retried. */
+    std::size_t retries = 0;
+
+    /** Bytes read or written. */
+    std::uint64_t bytes = 0;
+
+    /** Time from the start of the request, including any wait for a
+     * handle of the pool and any retries, until its end.
+     */
+    Duration elapsed = Duration(0);
+
+    /** Time spent waiting for a handle of the pool. */
+    Duration wait = Duration(0);
+
+    /** The timing breakdown of the final attempt, for HTTP requests. */
+    http::Transfer transfer;
+};
+
+/** @brief Reports requests slower than a threshold.
+ *
+ * Reports are logged as warnings, or passed to a callback if one is set.
+ * Only a fraction of slow requests may be reported, spread evenly over
+ * them, so that a slow store can't flood the log.  Requests which are not
+ * slow cost a comparison.
+ */
+class ARBITER_DLL SlowLog
+{
+public:
+    using Duration = std::chrono::microseconds;
+    using Callback = std::function<void(const SlowRequest&)>;
+
+    /** Report a @p sample fraction of the requests taking at least
+     * @p threshold.
+     */
+    explicit SlowLog(Duration threshold, double sample = 1);
+
+    /** Create from the stringified JSON @p j, which is an object with the
+     * optional keys `threshold`, in milliseconds, by default 1000, and
+     * `sample`, by default 1.  If @p j is not an object, returns null.
+     */
+    static std::unique_ptr<SlowLog> create(std::string j);
+
+    Duration threshold() const { return m_threshold; }
+
+    /** True if a request which took @p elapsed should be reported. */
+    template <typename D>
+    bool slow(D elapsed) const
+    {
+        return elapsed >= m_threshold;
+    }
+
+    /** Report @p req, a request for which slow is true, if it is among
+     * those sampled.
+     */
+    void report(const SlowRequest& req);
+
+    /** Pass reports to @p callback rather than logging them, or log them
+     * again if it is empty.  The callback may be called from any thread,
+     * and must not throw.
+     */
+    void setCallback(Callback callback);
+
+private:
+    const Duration m_threshold;
+    const double m_sample;
+    std::atomic<std::uint64_t> m_seen;
+
+    std::mutex m_mutex;
+    Callback m_callback;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
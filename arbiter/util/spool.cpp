@@ -0,0 +1,363 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/spool.hpp>
+
+#include <arbiter/drivers/fs.hpp>
+#include <arbiter/util/crc32c.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#ifdef ARBITER_WINDOWS
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <set>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const std::string spoolLog(".spool");
+    const std::string spoolIndex(".index");
+
+    // Each entry starts with its ID, the sizes of its data and its path,
+    // and the CRC-32C of its path and data, all little-endian.
+    const std::size_t spoolHeaderSize(24);
+
+    void spoolPut(char* pos, std::uint64_t value, const std::size_t bytes)
+    {
+        for (std::size_t i(0); i < bytes; ++i, value >>= 8)
+        {
+            pos[i] = static_cast<char>(value & 0xff);
+        }
+    }
+
+    std::uint64_t spoolGet(const char* pos, const std::size_t bytes)
+    {
+        std::uint64_t value(0);
+        for (std::size_t i(bytes); i; --i)
+        {
+            value = (value << 8) | static_cast<unsigned char>(pos[i - 1]);
+        }
+        return value;
+    }
+
+    bool spoolSync(std::FILE* file)
+    {
+        if (std::fflush(file)) return false;
+#ifdef ARBITER_WINDOWS
+        return _commit(_fileno(file)) == 0;
+#else
+        return ::fsync(fileno(file)) == 0;
+#endif
+    }
+
+    // Sync the entries of the directory @p dir, so that the files created or
+    // removed in it are too.  Windows commits them with the metadata of the
+    // files themselves.
+    bool spoolSyncDir(const std::string& dir)
+    {
+#ifdef ARBITER_WINDOWS
+        (void)dir;
+        return true;
+#else
+        const int fd(::open(dir.c_str(), O_RDONLY | O_CLOEXEC));
+        const bool synced(fd != -1 && ::fsync(fd) == 0);
+        if (fd != -1) ::close(fd);
+        return synced;
+#endif
+    }
+
+    std::vector<char> spoolRead(const std::string& path)
+    {
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        return std::vector<char>(
+                std::istreambuf_iterator<char>(stream),
+                std::istreambuf_iterator<char>());
+    }
+}
+
+Spool::Spool(
+        const std::string dir,
+        const std::size_t segmentSize,
+        const bool sync)
+    : m_dir(expandTilde(dir.size() && dir.back() != '/' ? dir + '/' : dir))
+    , m_segmentSize(segmentSize)
+    , m_sync(sync)
+    , m_current(m_segments.end())
+{
+    if (m_dir.empty()) throw ArbiterError("Spool directory may not be empty");
+    mkdirp(m_dir);
+    open();
+}
+
+Spool::~Spool()
+{
+    for (auto& entry : m_segments)
+    {
+        if (entry.second.log) std::fclose(entry.second.log);
+        if (entry.second.index) std::fclose(entry.second.index);
+    }
+}
+
+std::string Spool::fileOf(
+        const std::uint64_t first,
+        const std::string& extension) const
+{
+    char name[17];
+    std::snprintf(
+            name,
+            sizeof(name),
+            "%016llx",
+            static_cast<unsigned long long>(first));
+    return m_dir + name + extension;
+}
+
+void Spool::open()
+{
+    std::vector<std::string> logs;
+    for (const std::string& path : glob(m_dir + "*"))
+    {
+        if (path.size() > spoolLog.size() &&
+                !path.compare(
+                    path.size() - spoolLog.size(),
+                    spoolLog.size(),
+                    spoolLog))
+        {
+            logs.push_back(path);
+        }
+    }
+    std::sort(logs.begin(), logs.end());
+
+    std::vector<Entry> found;
+    std::vector<bool> resolved;
+
+    for (const std::string& path : logs)
+    {
+        const std::size_t slash(path.find_last_of('/'));
+        const std::uint64_t first(
+                std::strtoull(path.c_str() + slash + 1, nullptr, 16));
+        Segment& segment(m_segments[first]);
+
+        std::set<std::uint64_t> done;
+        const std::vector<char> index(spoolRead(fileOf(first, spoolIndex)));
+        for (std::size_t pos(0); pos + 8 <= index.size(); pos += 8)
+        {
+            done.insert(spoolGet(index.data() + pos, 8));
+        }
+
+        // Reading stops at an entry torn by a crash, the last to be written.
+        const std::vector<char> log(spoolRead(path));
+        std::size_t pos(0);
+        while (pos + spoolHeaderSize <= log.size())
+        {
+            const char* header(log.data() + pos);
+            const std::uint64_t id(spoolGet(header, 8));
+            const std::size_t size(spoolGet(header + 8, 8));
+            const std::size_t pathSize(spoolGet(header + 16, 4));
+            const std::uint32_t crc(spoolGet(header + 20, 4));
+
+            const std::size_t rest(log.size() - pos - spoolHeaderSize);
+            if (pathSize > rest || size > rest - pathSize) break;
+
+            const char* body(header + spoolHeaderSize);
+            if (crypto::crc32c(body, pathSize + size) != crc) break;
+
+            Entry entry { id, std::string(body, pathSize), { } };
+            resolved.push_back(done.count(id) > 0);
+            if (!resolved.back())
+            {
+                entry.data.assign(body + pathSize, body + pathSize + size);
+                ++segment.pending;
+            }
+            found.push_back(std::move(entry));
+
+            pos += spoolHeaderSize + pathSize + size;
+            m_next = (std::max)(m_next, id + 1);
+        }
+        segment.bytes = pos;
+    }
+
+    // Only the latest entry for each path is wanted, whether or not it has
+    // been resolved.
+    std::map<std::string, std::size_t> latest;
+    for (std::size_t i(0); i < found.size(); ++i) latest[found[i].path] = i;
+
+    for (std::size_t i(0); i < found.size(); ++i)
+    {
+        if (resolved[i]) continue;
+
+        Entry& entry(found[i]);
+        if (latest[entry.path] == i) m_recovered.push_back(std::move(entry));
+        else
+        {
+            auto segment(m_segments.upper_bound(entry.id));
+            resolve(--segment, entry.id);
+        }
+    }
+
+    for (auto it(m_segments.begin()); it != m_segments.end(); )
+    {
+        auto segment(it++);
+        if (!segment->second.pending) resolve(segment, 0);
+    }
+}
+
+std::vector<Spool::Entry> Spool::recover()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<Entry> entries;
+    entries.swap(m_recovered);
+    return entries;
+}
+
+std::uint64_t Spool::append(
+        const std::string& path,
+        const char* const data,
+        const std::size_t size)
+{
+    char header[spoolHeaderSize];
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_current != m_segments.end() &&
+            m_current->second.bytes >= m_segmentSize)
+    {
+        std::fclose(m_current->second.log);
+        m_current->second.log = nullptr;
+
+        const Segments::iterator full(m_current);
+        m_current = m_segments.end();
+        if (!full->second.pending) resolve(full, 0);
+    }
+
+    if (m_current == m_segments.end())
+    {
+        Segment segment;
+        segment.log = std::fopen(fileOf(m_next, spoolLog).c_str(), "wb");
+
+        // Until its directory entry is synced, a synced segment may itself
+        // be lost to a crash.
+        if (segment.log && m_sync && !spoolSyncDir(m_dir))
+        {
+            std::fclose(segment.log);
+            std::remove(fileOf(m_next, spoolLog).c_str());
+            segment.log = nullptr;
+        }
+
+        if (!segment.log)
+        {
+            throw ArbiterError("Could not create a spool segment in " + m_dir);
+        }
+        m_current = m_segments.insert(std::make_pair(m_next, segment)).first;
+    }
+
+    const std::uint64_t id(m_next++);
+    spoolPut(header, id, 8);
+    spoolPut(header + 8, size, 8);
+    spoolPut(header + 16, path.size(), 4);
+    spoolPut(
+            header + 20,
+            crypto::crc32c(
+                data,
+                size,
+                crypto::crc32c(path.data(), path.size())),
+            4);
+
+    Segment& segment(m_current->second);
+    const bool good(
+            std::fwrite(header, 1, spoolHeaderSize, segment.log) ==
+                spoolHeaderSize &&
+            std::fwrite(path.data(), 1, path.size(), segment.log) ==
+                path.size() &&
+            (!size || std::fwrite(data, 1, size, segment.log) == size) &&
+            (m_sync ? spoolSync(segment.log) : !std::fflush(segment.log)));
+
+    if (!good)
+    {
+        // Anything after a torn entry would not be recovered, so the rest
+        // go to a new segment.
+        segment.bytes = m_segmentSize;
+        throw ArbiterError("Could not spool " + path + " to " + m_dir);
+    }
+
+    segment.bytes += spoolHeaderSize + path.size() + size;
+    ++segment.pending;
+    return id;
+}
+
+void Spool::resolve(const std::uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto segment(m_segments.upper_bound(id));
+    if (segment == m_segments.begin()) return;
+    resolve(--segment, id);
+}
+
+void Spool::resolve(const Segments::iterator it, const std::uint64_t id)
+{
+    Segment& segment(it->second);
+
+    // A full segment with nothing left to resolve is passed without an ID.
+    if (id)
+    {
+        if (!segment.pending) return;
+
+        // A resolution lost to a crash only means an upload is made again,
+        // so the index is not synced.
+        if (!segment.index)
+        {
+            segment.index =
+                std::fopen(fileOf(it->first, spoolIndex).c_str(), "ab");
+        }
+        if (segment.index)
+        {
+            char entry[8];
+            spoolPut(entry, id, 8);
+            std::fwrite(entry, 1, sizeof(entry), segment.index);
+            std::fflush(segment.index);
+        }
+
+        if (--segment.pending) return;
+    }
+
+    // Once idle, the current segment is dropped too, so that the spool is
+    // empty whenever nothing is pending.
+    if (it == m_current) m_current = m_segments.end();
+    if (segment.log) std::fclose(segment.log);
+    if (segment.index) std::fclose(segment.index);
+    std::remove(fileOf(it->first, spoolLog).c_str());
+    std::remove(fileOf(it->first, spoolIndex).c_str());
+    m_segments.erase(it);
+
+    // A removal lost to a crash only means its entries are recovered and
+    // uploaded again, so a failure to sync it is ignored.
+    if (m_sync) spoolSyncDir(m_dir);
+}
+
+std::size_t Spool::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t pending(0);
+    for (const auto& entry : m_segments) pending += entry.second.pending;
+    return pending;
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief A durable local log of the data of unfinished uploads, so that
+ * they survive the death of their process.
+ *
+ * Each entry is appended with its path and a checksum to the current
+ * segment of a local directory, and synced, which costs a sequential write
+ * rather than an upload.  An entry is resolved once its upload is done or
+ * a later entry replaces it, which is noted, without syncing, in the index
+ * beside its segment.  A segment whose entries are all resolved is
+ * deleted, and a new one is started once the current one holds a segment
+ * size of data.
+ *
+ * When a spool is opened, the entries which its previous process left
+ * unresolved are recovered.  An entry torn by a crash as it was appended
+ * is ignored, as is any entry whose resolution was lost, at worst, to be
+ * uploaded again.
+ *
+ * Thread-safe.
+ */
+class ARBITER_DLL Spool
+{
+public:
+    struct Entry
+    {
+        std::uint64_t id;
+        std::string path;
+        std::vector<char> data;
+    };
+
+    /** Spool to the local directory @p dir, which is created if need be,
+     * starting a new segment after each @p segmentSize bytes.  Unless
+     * @p sync is false, each append is flushed to the disk before it
+     * returns.
+     */
+    explicit Spool(
+            std::string dir,
+            std::size_t segmentSize = 64 * 1024 * 1024,
+            bool sync = true);
+    ~Spool();
+
+    /** Take the unresolved entries found when we were opened, in the order
+     * in which they were appended, of which there is at most one for each
+     * path since later entries replace earlier ones.
+     */
+    std::vector<Entry> recover();
+
+    /** Durably append @p data for @p path, returning the ID of its entry.
+     * Throws ArbiterError if it cannot be written.
+     */
+    std::uint64_t append(
+            const std::string& path,
+            const char* data,
+            std::size_t size);
+
+    /** Resolve the entry @p id, which is no longer needed. */
+    void resolve(std::uint64_t id);
+
+    /** Entries which are unresolved. */
+    std::size_t pending() const;
+
+    const std::string& dir() const { return m_dir; }
+
+private:
+    struct Segment
+    {
+        std::FILE* log = nullptr;
+        std::FILE* index = nullptr;
+        std::size_t bytes = 0;
+        std::size_t pending = 0;
+    };
+
+    using Segments = std::map<std::uint64_t, Segment>;
+
+    // The file of the segment whose first entry is @p first, with the
+    // @p extension of its log or index.
+    std::string fileOf(std::uint64_t first, const std::string& extension)
+        const;
+
+    // Read the segments left by a previous process.
+    void open();
+
+    // Note @p id as resolved in the index of @p segment, deleting the
+    // segment if it then has no unresolved entries.  Requires m_mutex.
+    void resolve(Segments::iterator segment, std::uint64_t id);
+
+    Spool(const Spool&);
+    Spool& operator=(const Spool&);
+
+    const std::string m_dir;
+    const std::size_t m_segmentSize;
+    const bool m_sync;
+
+    mutable std::mutex m_mutex;
+
+    // By the ID of the first entry of each.
+    Segments m_segments;
+    Segments::iterator m_current;
+    std::uint64_t m_next = 1;
+    std::vector<Entry> m_recovered;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,251 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/streambuf.hpp>
+
+#include <arbiter/util/executor.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <limits>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const std::size_t defaultStreamBlockSize(1024 * 1024);
+    const std::size_t defaultStreamReadAhead(2);
+    const std::size_t defaultStreamCached(4);
+
+    const std::size_t none((std::numeric_limits<std::size_t>::max)());
+}
+
+struct RemoteStreamBuf::Block
+{
+    explicit Block(std::packaged_task<std::vector<char>()> t)
+        : task(std::move(t))
+        , future(task.get_future().share())
+    { }
+
+    // True if this call claimed the fetch, which then never runs elsewhere.
+    bool claim() { return !claimed.exchange(true); }
+
+    void run() { if (claim()) task(); }
+
+    bool ready() const
+    {
+        return future.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready;
+    }
+
+    std::atomic<bool> claimed{ false };
+    std::packaged_task<std::vector<char>()> task;
+    std::shared_future<std::vector<char>> future;
+};
+
+RemoteStreamBuf::RemoteStreamBuf(
+        Fetch fetch,
+        const std::size_t size,
+        Executor& executor,
+        const std::size_t blockSize,
+        const std::size_t readAhead,
+        const std::size_t cached)
+    : m_fetch(std::make_shared<const Fetch>(fetch))
+    , m_size(size)
+    , m_executor(executor)
+    , m_blockSize(blockSize)
+    , m_readAhead(readAhead)
+    , m_cached((std::max)(cached, std::size_t(1)))
+    , m_last(none)
+{
+    if (!m_blockSize) throw ArbiterError("Stream block size must be positive");
+}
+
+std::unique_ptr<RemoteStreamBuf> RemoteStreamBuf::create(
+        Fetch fetch,
+        const std::size_t size,
+        Executor& executor,
+        const std::string s)
+{
+    const json j(s.size() ? json::parse(s) : json());
+    const json c(j.is_object() ? j : json::object());
+
+    return std::unique_ptr<RemoteStreamBuf>(
+            new RemoteStreamBuf(
+                fetch,
+                size,
+                executor,
+                c.value("blockSize", defaultStreamBlockSize),
+                c.value("readAhead", defaultStreamReadAhead),
+                c.value("cached", defaultStreamCached)));
+}
+
+RemoteStreamBuf::~RemoteStreamBuf()
+{
+    // Fetches which haven't started never will, and those which have may
+    // still be using the fetch function.
+    for (auto& p : m_blocks)
+    {
+        if (!p.second->claim()) p.second->future.wait();
+    }
+    for (auto& b : m_retired) b->future.wait();
+}
+
+RemoteStreamBuf::int_type RemoteStreamBuf::underflow()
+{
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+    const std::size_t pos(position());
+    if (pos >= m_size) return traits_type::eof();
+
+    const std::size_t index(pos / m_blockSize);
+    const bool sequential(
+            m_last == none ? index == 0 : index == m_last + 1);
+
+    const Shared current(block(index, false));
+
+    if (sequential)
+    {
+        for (std::size_t i(1); i <= m_readAhead; ++i)
+        {
+            if ((index + i) * m_blockSize >= m_size) break;
+            block(index + i, true);
+        }
+    }
+
+    current->run();
+    const std::vector<char>& data(current->future.get());
+
+    m_current = current;
+    m_index = index;
+    m_last = index;
+    evict();
+
+    // The object may have shrunk since its size was taken.
+    const std::size_t skip(pos - index * m_blockSize);
+    if (skip >= data.size())
+    {
+        m_current.reset();
+        m_pos = pos;
+        setg(nullptr, nullptr, nullptr);
+        return traits_type::eof();
+    }
+
+    char* const begin(const_cast<char*>(data.data()));
+    setg(begin, begin + skip, begin + data.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize RemoteStreamBuf::showmanyc()
+{
+    const std::size_t pos(position());
+    return pos < m_size ? std::streamsize(m_size - pos) : -1;
+}
+
+RemoteStreamBuf::pos_type RemoteStreamBuf::seekoff(
+        const off_type off,
+        const std::ios_base::seekdir dir,
+        const std::ios_base::openmode which)
+{
+    off_type base(0);
+    if (dir == std::ios_base::cur) base = position();
+    else if (dir == std::ios_base::end) base = m_size;
+
+    return seekpos(pos_type(base + off), which);
+}
+
+RemoteStreamBuf::pos_type RemoteStreamBuf::seekpos(
+        const pos_type target,
+        const std::ios_base::openmode which)
+{
+    const off_type pos(target);
+    if (!(which & std::ios_base::in) || pos < 0 || pos > off_type(m_size))
+    {
+        return pos_type(off_type(-1));
+    }
+
+    // Within the current block, only the get pointer moves.
+    const off_type begin(m_index * m_blockSize);
+    if (m_current && pos >= begin && pos < begin + (egptr() - eback()))
+    {
+        setg(eback(), eback() + (pos - begin), egptr());
+        return target;
+    }
+
+    m_current.reset();
+    m_pos = pos;
+    setg(nullptr, nullptr, nullptr);
+    return target;
+}
+
+RemoteStreamBuf::Shared RemoteStreamBuf::block(
+        const std::size_t index,
+        const bool ahead)
+{
+    m_recent.remove(index);
+    m_recent.push_front(index);
+
+    auto it(m_blocks.find(index));
+    if (it != m_blocks.end()) return it->second;
+
+    const std::shared_ptr<const Fetch> fetch(m_fetch);
+    const std::size_t offset(index * m_blockSize);
+    const std::size_t length(
+            (std::min)(m_blockSize, m_size - (std::min)(offset, m_size)));
+
+    Shared b(std::make_shared<Block>(
+                std::packaged_task<std::vector<char>()>(
+                    [fetch, offset, length]()
+                    {
+                        return (*fetch)(offset, length);
+                    })));
+
+    m_blocks[index] = b;
+    if (ahead) m_executor.post([b]() { b->run(); });
+
+    return b;
+}
+
+void RemoteStreamBuf::evict()
+{
+    m_retired.erase(
+            std::remove_if(
+                m_retired.begin(),
+                m_retired.end(),
+                [](const Shared& b) { return b->ready(); }),
+            m_retired.end());
+
+    while (m_blocks.size() > m_cached + m_readAhead)
+    {
+        const std::size_t index(m_recent.back());
+        m_recent.pop_back();
+
+        auto it(m_blocks.find(index));
+        if (!it->second->claim() && !it->second->ready())
+        {
+            m_retired.push_back(it->second);
+        }
+        m_blocks.erase(it);
+    }
+}
+
+std::size_t RemoteStreamBuf::position() const
+{
+    if (!m_current) return m_pos;
+    return m_index * m_blockSize + (gptr() - eback());
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
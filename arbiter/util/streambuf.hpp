@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <ios>
+#include <list>
+#include <map>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+class Executor;
+
+/** @brief A read-only, seekable std::streambuf over a remote object, which
+ * is read in fixed-size blocks by ranged reads.
+ *
+ * While the object is read sequentially, the blocks which follow the one
+ * being read are fetched ahead on an Executor, so that a std::istream over
+ * it reads at close to the throughput of a single large read.  The most
+ * recently read blocks are kept, so that seeking back a short way reads
+ * nothing again.  A seek elsewhere reads only the block it lands in, and
+ * reading ahead resumes once reads carry on past that block.
+ *
+ * Errors from the fetch propagate out of the reading stream operation,
+ * which with the default exception mask of a std::istream sets its badbit.
+ * Like streams themselves, this is not thread-safe.
+ */
+class ARBITER_DLL RemoteStreamBuf : public std::streambuf
+{
+public:
+    /** Fetch up to @p length bytes of the object starting at byte
+     * @p offset, returning fewer only at the end of the object.
+     */
+    using Fetch = std::function<std::vector<char>(
+            std::size_t offset,
+            std::size_t length)>;
+
+    /** Read the @p size bytes of an object with @p fetch, in blocks of
+     * @p blockSize bytes, fetching up to @p readAhead blocks ahead on
+     * @p executor and keeping @p cached blocks which have been read.
+     */
+    RemoteStreamBuf(
+            Fetch fetch,
+            std::size_t size,
+            Executor& executor,
+            std::size_t blockSize,
+            std::size_t readAhead,
+            std::size_t cached);
+
+    /** Create from the stringified JSON @p j, whose keys are `blockSize`, by
+     * default 1 MiB, `readAhead`, by default 2, and `cached`, by default 4.
+     */
+    static std::unique_ptr<RemoteStreamBuf> create(
+            Fetch fetch,
+            std::size_t size,
+            Executor& executor,
+            std::string j = "");
+
+    /** Waits for any fetches which are still running. */
+    ~RemoteStreamBuf();
+
+    std::size_t size() const { return m_size; }
+    std::size_t blockSize() const { return m_blockSize; }
+    std::size_t readAhead() const { return m_readAhead; }
+
+protected:
+    virtual int_type underflow() override;
+    virtual std::streamsize showmanyc() override;
+
+    virtual pos_type seekoff(
+            off_type off,
+            std::ios_base::seekdir dir,
+            std::ios_base::openmode which) override;
+
+    virtual pos_type seekpos(
+            pos_type pos,
+            std::ios_base::openmode which) override;
+
+private:
+    // A fetch, which is run by whichever of its task or a reader claims it.
+    struct Block;
+    using Shared = std::shared_ptr<Block>;
+
+    // The block at @p index, started if it isn't held, in the background if
+    // @p ahead is set.
+    Shared block(std::size_t index, bool ahead);
+
+    // Drop the least recently used blocks beyond those we keep.
+    void evict();
+
+    // The offset of the next byte to be read.
+    std::size_t position() const;
+
+    RemoteStreamBuf(const RemoteStreamBuf&);
+    RemoteStreamBuf& operator=(const RemoteStreamBuf&);
+
+    const std::shared_ptr<const Fetch> m_fetch;
+    const std::size_t m_size;
+    Executor& m_executor;
+    const std::size_t m_blockSize;
+    const std::size_t m_readAhead;
+    const std::size_t m_cached;
+
+    std::map<std::size_t, Shared> m_blocks;
+    std::list<std::size_t> m_recent;
+
+    // Dropped blocks whose fetches were already running when dropped.
+    std::vector<Shared> m_retired;
+
+    // The block of the get area, if any, and otherwise the position set by
+    // the last seek.
+    Shared m_current;
+    std::size_t m_index = 0;
+    std::size_t m_pos = 0;
+
+    // The index of the last block read, for detecting sequential reads.
+    std::size_t m_last;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
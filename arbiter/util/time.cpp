@@ -42,6 +42,10 @@ Time::Time()
     m_time = std::time(nullptr);
 }
 
+Time::Time(const std::time_t time)
+    : m_time(time)
+{ }
+
 Time::Time(const std::string& s, const std::string& format)
 {
     std::tm tm{};
@@ -26,6 +26,7 @@ public:
     static const std::string dateNoSeparators;
 
     Time();
+    explicit Time(std::time_t time);
     Time(const std::string& s, const std::string& format = "%Y-%m-%dT%H:%M:%SZ");
 
     std::string str(const std::string& format = "%Y-%m-%dT%H:%M:%SZ") const;
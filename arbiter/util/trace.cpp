@@ -0,0 +1,60 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/trace.hpp>
+
+#include <arbiter/driver.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+TraceSpan::TraceSpan(
+        Tracer* tracer,
+        const Driver& driver,
+        const char* operation,
+        const std::string& path,
+        const std::size_t bytes)
+    : m_tracer(tracer)
+{
+    if (!m_tracer) return;
+
+    m_event.driver = driver.type();
+    m_event.operation = operation;
+    m_event.path = path;
+    if (driver.isRemote()) m_event.host = path.substr(0, path.find('/'));
+    m_event.bytes = bytes;
+    m_event.start = TraceEvent::Clock::now();
+
+    m_tracer->start(m_event);
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (!m_tracer) return;
+
+    try { end(true); }
+    catch (...) { }
+}
+
+void TraceSpan::end(const bool failed)
+{
+    m_event.failed = failed;
+    m_event.duration = TraceEvent::Clock::now() - m_event.start;
+
+    // Clear our tracer first so nothing is reported twice, even if the
+    // tracer itself throws.
+    Tracer* tracer(m_tracer);
+    m_tracer = nullptr;
+    tracer->end(m_event);
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
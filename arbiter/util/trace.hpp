@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+class Driver;
+
+/** @brief A single storage operation, as reported to a Tracer. */
+struct TraceEvent
+{
+    using Clock = std::chrono::steady_clock;
+
+    /** Type of the Driver performing the operation, for example `s3`. */
+    std::string driver;
+
+    /** Name of the operation, for example `get`, `put`, or `resolve`. */
+    std::string operation;
+
+    /** Path of the operation, without its type prefix. */
+    std::string path;
+
+    /** For remote drivers, the first component of the path, which is the
+     * host or the bucket.  Empty for local paths.
+     */
+    std::string host;
+
+    /** Bytes read or written.  For operations with a known payload, like a
+     * `put`, this is set for both the start and end events.  Otherwise it is
+     * only known at the end.
+     */
+    std::size_t bytes = 0;
+
+    /** For ranged reads, the offset and length requested.  For reads of
+     * several ranges, those of the span which covers them.
+     */
+    std::size_t offset = 0;
+    std::size_t length = 0;
+
+    /** Set for end events if the operation threw. */
+    bool failed = false;
+
+    /** Time at which the operation started. */
+    Clock::time_point start;
+
+    /** Duration of the operation, for end events. */
+    Clock::duration duration = Clock::duration(0);
+};
+
+/** @brief Interface for observing storage operations.
+ *
+ * Once installed with Arbiter::setTracer, every operation performed through
+ * the Arbiter, or through an Endpoint created from it, reports its start and
+ * end.  Calls arrive from whichever thread performs the operation, so
+ * implementations must be thread-safe, and should be brief since they are
+ * on the path of every operation.  They must not throw.
+ */
+class ARBITER_DLL Tracer
+{
+public:
+    virtual ~Tracer() { }
+
+    virtual void start(const TraceEvent&) { }
+    virtual void end(const TraceEvent&) { }
+};
+
+/** @cond arbiter_internal */
+
+// Reports a single operation to an optional Tracer over its lifetime.  If
+// destroyed before done is called, the operation is reported as failed.
+// Without a Tracer, this does nothing at all.
+class ARBITER_DLL TraceSpan
+{
+public:
+    TraceSpan(
+            Tracer* tracer,
+            const Driver& driver,
+            const char* operation,
+            const std::string& path,
+            std::size_t bytes = 0);
+
+    ~TraceSpan();
+
+    // Note the range of a ranged read, for its end event.
+    void range(std::size_t offset, std::size_t length)
+    {
+        m_event.offset = offset;
+        m_event.length = length;
+    }
+
+    void done(std::size_t bytes = 0)
+    {
+        if (!m_tracer) return;
+        if (bytes) m_event.bytes = bytes;
+        end(false);
+    }
+
+private:
+    void end(bool failed);
+
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    Tracer* m_tracer;
+    TraceEvent m_event;
+};
+
+/** @endcond */
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,164 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/transfer.hpp>
+
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const std::size_t mib(1024 * 1024);
+
+    const std::size_t defaultRangedThreshold(32 * mib);
+    const std::size_t defaultMultipartThreshold(64 * mib);
+    const std::size_t defaultPartSize(8 * mib);
+    const std::size_t defaultMinPartSize(5 * mib);
+    const std::size_t defaultMaxPartSize(512 * mib);
+    const std::size_t defaultMaxParts(10000);
+    const double defaultTargetSeconds(2);
+
+    // Smaller transfers are dominated by latency, so say little about
+    // throughput.
+    const std::size_t minSample(mib);
+
+    // The weight of each new measurement of throughput.
+    const double sampleWeight(0.2);
+}
+
+TransferPlanner::TransferPlanner(
+        const std::size_t rangedThreshold,
+        const std::size_t multipartThreshold,
+        const std::size_t partSize,
+        const std::size_t minPartSize,
+        const std::size_t maxPartSize,
+        const std::size_t maxParts,
+        const double targetSeconds)
+    : m_rangedThreshold(rangedThreshold)
+    , m_multipartThreshold(multipartThreshold)
+    , m_partSize(partSize)
+    , m_minPartSize(minPartSize)
+    , m_maxPartSize(maxPartSize)
+    , m_maxParts(maxParts)
+    , m_targetSeconds(targetSeconds)
+{
+    if (!m_partSize || !m_maxParts)
+    {
+        throw ArbiterError("Transfer part size and count must be positive");
+    }
+    if (!m_minPartSize || m_minPartSize > m_maxPartSize)
+    {
+        throw ArbiterError("Invalid transfer part size limits");
+    }
+}
+
+std::unique_ptr<TransferPlanner> TransferPlanner::create(const std::string s)
+{
+    const json j(s.size() ? json::parse(s) : json());
+    if (j.is_null()) return std::unique_ptr<TransferPlanner>();
+
+    const json c(j.is_object() ? j : json::object());
+
+    const json tune(c.value("autoTune", json(false)));
+    const double targetSeconds(
+            tune.is_boolean() ?
+                (tune.get<bool>() ? defaultTargetSeconds : 0) :
+                tune.get<double>());
+
+    return std::unique_ptr<TransferPlanner>(
+            new TransferPlanner(
+                c.value("rangedThreshold", defaultRangedThreshold),
+                c.value("multipartThreshold", defaultMultipartThreshold),
+                c.value("partSize", defaultPartSize),
+                c.value("minPartSize", defaultMinPartSize),
+                c.value("maxPartSize", defaultMaxPartSize),
+                c.value("maxParts", defaultMaxParts),
+                targetSeconds));
+}
+
+TransferPlan TransferPlanner::planGet(
+        const std::size_t size,
+        const std::size_t connections) const
+{
+    if (connections > 1 && m_rangedThreshold && size > m_rangedThreshold)
+    {
+        const TransferPlan plan(split(TransferPlan::Method::Ranged, size));
+        if (plan.parts > 1) return plan;
+    }
+
+    return split(TransferPlan::Method::Single, size);
+}
+
+TransferPlan TransferPlanner::planPut(const std::size_t size) const
+{
+    if (m_multipartThreshold && size > m_multipartThreshold)
+    {
+        const TransferPlan plan(split(TransferPlan::Method::Multipart, size));
+        if (plan.parts > 1) return plan;
+    }
+
+    return split(TransferPlan::Method::Single, size);
+}
+
+void TransferPlanner::record(const std::size_t bytes, const double seconds)
+{
+    if (bytes < minSample || seconds <= 0) return;
+
+    const double sample(bytes / seconds);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_throughput = m_throughput ?
+        m_throughput + sampleWeight * (sample - m_throughput) :
+        sample;
+}
+
+double TransferPlanner::throughput() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_throughput;
+}
+
+std::size_t TransferPlanner::partSize() const
+{
+    const double measured(throughput());
+    if (!autoTune() || !measured) return m_partSize;
+
+    const double target(measured * m_targetSeconds);
+    if (target <= m_minPartSize) return m_minPartSize;
+    if (target >= m_maxPartSize) return m_maxPartSize;
+    return static_cast<std::size_t>(target);
+}
+
+TransferPlan TransferPlanner::split(
+        const TransferPlan::Method method,
+        const std::size_t size) const
+{
+    TransferPlan plan;
+    plan.method = method;
+
+    if (method == TransferPlan::Method::Single)
+    {
+        plan.partSize = size;
+        return plan;
+    }
+
+    plan.partSize =
+        (std::max)(partSize(), (size + m_maxParts - 1) / m_maxParts);
+    plan.parts = (size + plan.partSize - 1) / plan.partSize;
+    return plan;
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
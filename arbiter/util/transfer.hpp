@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief How a single object is to be transferred. */
+struct TransferPlan
+{
+    enum class Method
+    {
+        /** One request for the whole object. */
+        Single,
+
+        /** Concurrent ranged reads of parts of the object. */
+        Ranged,
+
+        /** A multipart upload of parts of the object. */
+        Multipart
+    };
+
+    Method method = Method::Single;
+
+    /** Bytes in each part but the last, or the whole size for Single. */
+    std::size_t partSize = 0;
+
+    /** Number of parts, which is one for Single. */
+    std::size_t parts = 1;
+};
+
+/** @brief Chooses how objects are transferred from their sizes.
+ *
+ * Downloads larger than a threshold are split into parts which are read
+ * concurrently by ranged reads, and uploads larger than another threshold
+ * are sent as multipart uploads.  Smaller transfers are made by a single
+ * request, for which the latency of several would outweigh their
+ * concurrency.
+ *
+ * With auto-tuning, the throughput of each connection is measured from the
+ * transfers made, and parts are sized so that each takes about a target
+ * time: long enough that per-request latency is a small fraction of it,
+ * short enough that the parts of a download spread over its connections.
+ * Until any transfer has been measured, the configured part size is used.
+ */
+class ARBITER_DLL TransferPlanner
+{
+public:
+    /** Plan with the given thresholds, where a zero threshold disables its
+     * method, and parts of @p partSize bytes, no more than @p maxParts of
+     * them.  If @p targetSeconds is nonzero, part sizes are tuned to it
+     * from measured throughput, within @p minPartSize and @p maxPartSize.
+     */
+    TransferPlanner(
+            std::size_t rangedThreshold,
+            std::size_t multipartThreshold,
+            std::size_t partSize,
+            std::size_t minPartSize,
+            std::size_t maxPartSize,
+            std::size_t maxParts,
+            double targetSeconds);
+
+    /** Create from the stringified JSON @p j, which is the `transfer` entry
+     * of the Arbiter configuration, returning null if it is null.  Its keys,
+     * with sizes in bytes, are:
+     *
+     * - `rangedThreshold`, by default 32 MiB
+     * - `multipartThreshold`, by default 64 MiB
+     * - `partSize`, by default 8 MiB
+     * - `minPartSize`, by default 5 MiB
+     * - `maxPartSize`, by default 512 MiB
+     * - `maxParts`, by default 10000
+     * - `autoTune`, false by default, or the target seconds per part, where
+     *   true means 2
+     */
+    static std::unique_ptr<TransferPlanner> create(std::string j);
+
+    /** Plan the download of @p size bytes over up to @p connections
+     * concurrent connections.  With a single connection, parts would only
+     * add requests, so downloads are then always Single.
+     */
+    TransferPlan planGet(std::size_t size, std::size_t connections) const;
+
+    /** Plan the upload of @p size bytes. */
+    TransferPlan planPut(std::size_t size) const;
+
+    /** Record that one connection transferred @p bytes in @p seconds. */
+    void record(std::size_t bytes, double seconds);
+
+    /** Measured bytes per second of a single connection, or zero if
+     * nothing has been measured.
+     */
+    double throughput() const;
+
+    /** The size of parts currently planned, before being raised to keep
+     * within the maximum number of parts.
+     */
+    std::size_t partSize() const;
+
+    std::size_t rangedThreshold() const { return m_rangedThreshold; }
+    std::size_t multipartThreshold() const { return m_multipartThreshold; }
+    bool autoTune() const { return m_targetSeconds > 0; }
+
+private:
+    TransferPlanner(const TransferPlanner&);
+    TransferPlanner& operator=(const TransferPlanner&);
+
+    // Parts of @p size bytes, of at least the current part size.
+    TransferPlan split(TransferPlan::Method method, std::size_t size) const;
+
+    const std::size_t m_rangedThreshold;
+    const std::size_t m_multipartThreshold;
+    const std::size_t m_partSize;
+    const std::size_t m_minPartSize;
+    const std::size_t m_maxPartSize;
+    const std::size_t m_maxParts;
+    const double m_targetSeconds;
+
+    mutable std::mutex m_mutex;
+    double m_throughput = 0;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
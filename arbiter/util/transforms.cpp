@@ -1,8 +1,22 @@
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/util/transforms.hpp>
+#include <arbiter/util/types.hpp>
 #endif
 
 #include <cstdint>
+#include <cstring>
+
+// Encoding is vectorized where the CPU allows.  On x86 this is chosen at
+// runtime, since SSSE3 isn't part of the baseline, while NEON always is on
+// 64-bit ARM.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define ARBITER_TRANSFORMS_SSSE3
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define ARBITER_TRANSFORMS_NEON
+#include <arm_neon.h>
+#endif
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
@@ -15,86 +29,353 @@ namespace crypto
 {
 namespace
 {
-    const std::string base64Vals(
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+    const char base64Vals[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-    const std::string hexVals("0123456789abcdef");
-} // unnamed namespace
+    const char hexVals[] = "0123456789abcdef";
 
-std::string encodeBase64(const std::vector<char>& data, const bool pad)
-{
-    std::vector<uint8_t> input;
-    for (std::size_t i(0); i < data.size(); ++i)
+    // Maps each character to its 6-bit base64 value, or to 0xFF if it isn't
+    // one.
+    struct Base64Decoder
+    {
+        Base64Decoder()
+        {
+            std::memset(vals, 0xFF, sizeof(vals));
+            for (uint8_t i(0); i < 64; ++i)
+            {
+                vals[static_cast<uint8_t>(base64Vals[i])] = i;
+            }
+        }
+
+        uint8_t vals[256];
+    };
+
+    const Base64Decoder& base64Decoder()
     {
-        char c(data[i]);
-        input.push_back(*reinterpret_cast<uint8_t*>(&c));
+        static const Base64Decoder decoder;
+        return decoder;
     }
 
-    const std::size_t fullSteps(data.size() / 3);
-    const std::size_t remainder(data.size() % 3);
+    int hexValue(const char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
 
-    while (input.size() % 3) input.push_back(0);
-    uint8_t* pos(input.data());
+    // Each of these encodes as many leading bytes of @p in as it can in bulk,
+    // writing to @p out, and returns the number of input bytes consumed.  The
+    // rest are left to the scalar loops.
 
-    std::string output(fullSteps * 4, '_');
-    std::size_t outIndex(0);
+#ifdef ARBITER_TRANSFORMS_SSSE3
+    bool haveSsse3()
+    {
+        static const bool have(__builtin_cpu_supports("ssse3"));
+        return have;
+    }
 
-    const uint32_t mask(0x3F);
+    // Each 12 bytes of input become 16 characters.  See:
+    //      http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+    __attribute__((target("ssse3")))
+    std::size_t encodeBase64Bulk(const uint8_t* in, std::size_t n, char* out)
+    {
+        const __m128i shuffle(
+                _mm_set_epi8(
+                    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        const __m128i shifts(
+                _mm_setr_epi8(
+                    'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                    '/' - 63, 'A', 0, 0));
+
+        std::size_t done(0);
+
+        // Each load reads 16 bytes, of which 12 are used.
+        for ( ; done + 16 <= n; done += 12, out += 16)
+        {
+            __m128i v(
+                    _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(in + done)));
+            v = _mm_shuffle_epi8(v, shuffle);
 
-    for (std::size_t i(0); i < fullSteps; ++i)
+            // Split each 24 bits into four 6-bit indices, one per byte.
+            const __m128i a(
+                    _mm_mulhi_epu16(
+                        _mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)),
+                        _mm_set1_epi32(0x04000040)));
+            const __m128i b(
+                    _mm_mullo_epi16(
+                        _mm_and_si128(v, _mm_set1_epi32(0x003f03f0)),
+                        _mm_set1_epi32(0x01000010)));
+            const __m128i indices(_mm_or_si128(a, b));
+
+            // Then map each index to the offset of its character range.
+            __m128i range(_mm_subs_epu8(indices, _mm_set1_epi8(51)));
+            const __m128i lower(
+                    _mm_cmpgt_epi8(_mm_set1_epi8(26), indices));
+            range = _mm_or_si128(
+                    range,
+                    _mm_and_si128(lower, _mm_set1_epi8(13)));
+
+            const __m128i chars(
+                    _mm_add_epi8(_mm_shuffle_epi8(shifts, range), indices));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+        }
+
+        return done;
+    }
+
+    __attribute__((target("ssse3")))
+    std::size_t encodeHexBulk(const uint8_t* in, std::size_t n, char* out)
     {
-        uint32_t chunk((*pos) << 16 | *(pos + 1) << 8 | *(pos + 2));
+        const __m128i digits(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(hexVals)));
+        const __m128i low(_mm_set1_epi8(0x0F));
 
-        output[outIndex++] = base64Vals[(chunk >> 18) & mask];
-        output[outIndex++] = base64Vals[(chunk >> 12) & mask];
-        output[outIndex++] = base64Vals[(chunk >>  6) & mask];
-        output[outIndex++] = base64Vals[chunk & mask];
+        std::size_t done(0);
 
-        pos += 3;
+        for ( ; done + 16 <= n; done += 16, out += 32)
+        {
+            const __m128i v(
+                    _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(in + done)));
+            const __m128i hi(
+                    _mm_shuffle_epi8(
+                        digits,
+                        _mm_and_si128(_mm_srli_epi16(v, 4), low)));
+            const __m128i lo(
+                    _mm_shuffle_epi8(digits, _mm_and_si128(v, low)));
+
+            _mm_storeu_si128(
+                    reinterpret_cast<__m128i*>(out),
+                    _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(
+                    reinterpret_cast<__m128i*>(out + 16),
+                    _mm_unpackhi_epi8(hi, lo));
+        }
+
+        return done;
+    }
+
+    std::size_t encodeBase64Fast(const uint8_t* in, std::size_t n, char* out)
+    {
+        return haveSsse3() ? encodeBase64Bulk(in, n, out) : 0;
     }
 
-    if (remainder)
+    std::size_t encodeHexFast(const uint8_t* in, std::size_t n, char* out)
     {
-        uint32_t chunk(*(pos) << 16 | *(pos + 1) << 8 | *(pos + 2));
+        return haveSsse3() ? encodeHexBulk(in, n, out) : 0;
+    }
+#elif defined(ARBITER_TRANSFORMS_NEON)
+    // Each 48 bytes of input, deinterleaved into three registers, become 64
+    // characters.
+    std::size_t encodeBase64Fast(const uint8_t* in, std::size_t n, char* out)
+    {
+        const uint8_t* vals(reinterpret_cast<const uint8_t*>(base64Vals));
+        uint8x16x4_t table;
+        table.val[0] = vld1q_u8(vals);
+        table.val[1] = vld1q_u8(vals + 16);
+        table.val[2] = vld1q_u8(vals + 32);
+        table.val[3] = vld1q_u8(vals + 48);
+
+        const uint8x16_t mask(vdupq_n_u8(0x3F));
 
-        output.push_back(base64Vals[(chunk >> 18) & mask]);
-        output.push_back(base64Vals[(chunk >> 12) & mask]);
-        if (remainder == 2) output.push_back(base64Vals[(chunk >> 6) & mask]);
+        std::size_t done(0);
 
-        if (pad)
+        for ( ; done + 48 <= n; done += 48, out += 64)
         {
-            while (output.size() % 4) output.push_back('=');
+            const uint8x16x3_t v(vld3q_u8(in + done));
+
+            uint8x16x4_t chars;
+            chars.val[0] = vshrq_n_u8(v.val[0], 2);
+            chars.val[1] = vandq_u8(
+                    vorrq_u8(
+                        vshlq_n_u8(v.val[0], 4),
+                        vshrq_n_u8(v.val[1], 4)),
+                    mask);
+            chars.val[2] = vandq_u8(
+                    vorrq_u8(
+                        vshlq_n_u8(v.val[1], 2),
+                        vshrq_n_u8(v.val[2], 6)),
+                    mask);
+            chars.val[3] = vandq_u8(v.val[2], mask);
+
+            for (int i(0); i < 4; ++i)
+            {
+                chars.val[i] = vqtbl4q_u8(table, chars.val[i]);
+            }
+
+            vst4q_u8(reinterpret_cast<uint8_t*>(out), chars);
         }
+
+        return done;
     }
 
-    return output;
+    std::size_t encodeHexFast(const uint8_t* in, std::size_t n, char* out)
+    {
+        const uint8x16_t digits(
+                vld1q_u8(reinterpret_cast<const uint8_t*>(hexVals)));
+
+        std::size_t done(0);
+
+        for ( ; done + 16 <= n; done += 16, out += 32)
+        {
+            const uint8x16_t v(vld1q_u8(in + done));
+
+            uint8x16x2_t chars;
+            chars.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(v, 4));
+            chars.val[1] = vqtbl1q_u8(digits, vandq_u8(v, vdupq_n_u8(0x0F)));
+            vst2q_u8(reinterpret_cast<uint8_t*>(out), chars);
+        }
+
+        return done;
+    }
+#else
+    std::size_t encodeBase64Fast(const uint8_t*, std::size_t, char*)
+    {
+        return 0;
+    }
+
+    std::size_t encodeHexFast(const uint8_t*, std::size_t, char*)
+    {
+        return 0;
+    }
+#endif
+
+    std::string encodeBase64(const char* data, const std::size_t size, bool pad)
+    {
+        const uint8_t* in(reinterpret_cast<const uint8_t*>(data));
+        const std::size_t remainder(size % 3);
+
+        std::string output(
+                (size / 3) * 4 + (remainder ? (pad ? 4 : remainder + 1) : 0),
+                '=');
+        char* out(&output[0]);
+
+        const std::size_t fast(encodeBase64Fast(in, size, out));
+        out += fast / 3 * 4;
+
+        const uint32_t mask(0x3F);
+        std::size_t i(fast);
+
+        for ( ; i + 3 <= size; i += 3)
+        {
+            const uint32_t chunk(in[i] << 16 | in[i + 1] << 8 | in[i + 2]);
+
+            *out++ = base64Vals[(chunk >> 18) & mask];
+            *out++ = base64Vals[(chunk >> 12) & mask];
+            *out++ = base64Vals[(chunk >>  6) & mask];
+            *out++ = base64Vals[chunk & mask];
+        }
+
+        if (remainder)
+        {
+            const uint32_t chunk(
+                    in[i] << 16 | (remainder == 2 ? in[i + 1] << 8 : 0));
+
+            *out++ = base64Vals[(chunk >> 18) & mask];
+            *out++ = base64Vals[(chunk >> 12) & mask];
+            if (remainder == 2) *out++ = base64Vals[(chunk >> 6) & mask];
+        }
+
+        return output;
+    }
+
+    std::string encodeAsHex(const char* data, const std::size_t size)
+    {
+        const uint8_t* in(reinterpret_cast<const uint8_t*>(data));
+
+        std::string output(size * 2, 0);
+        char* out(&output[0]);
+
+        const std::size_t fast(encodeHexFast(in, size, out));
+        out += fast * 2;
+
+        for (std::size_t i(fast); i < size; ++i)
+        {
+            *out++ = hexVals[in[i] >> 4];
+            *out++ = hexVals[in[i] & 0x0F];
+        }
+
+        return output;
+    }
+
+} // unnamed namespace
+
+std::string encodeBase64(const std::vector<char>& data, const bool pad)
+{
+    return encodeBase64(data.data(), data.size(), pad);
 }
 
 std::string encodeBase64(const std::string& input, const bool pad)
 {
-    return encodeBase64(std::vector<char>(input.begin(), input.end()), pad);
+    return encodeBase64(input.data(), input.size(), pad);
 }
 
 std::string encodeAsHex(const std::vector<char>& input)
 {
-    std::string output;
-    output.reserve(input.size() * 2);
+    return encodeAsHex(input.data(), input.size());
+}
+
+std::string encodeAsHex(const std::string& input)
+{
+    return encodeAsHex(input.data(), input.size());
+}
+
+std::string decodeBase64(const std::string& input)
+{
+    std::size_t size(input.size());
+    while (size && input[size - 1] == '=') --size;
+    if (size % 4 == 1 || input.size() - size > 2)
+    {
+        throw ArbiterError("Invalid base64 length");
+    }
+
+    const uint8_t* vals(base64Decoder().vals);
+    const uint8_t* in(reinterpret_cast<const uint8_t*>(input.data()));
 
-    uint8_t u(0);
+    std::string output(size / 4 * 3 + (size % 4 ? size % 4 - 1 : 0), 0);
+    char* out(&output[0]);
 
-    for (const char c : input)
+    uint32_t chunk(0);
+    std::size_t bits(0);
+
+    for (std::size_t i(0); i < size; ++i)
     {
-        u = *reinterpret_cast<const uint8_t*>(&c);
-        output.push_back(hexVals[u >> 4]);
-        output.push_back(hexVals[u & 0x0F]);
+        const uint8_t v(vals[in[i]]);
+        if (v == 0xFF) throw ArbiterError("Invalid base64 character");
+
+        chunk = chunk << 6 | v;
+        bits += 6;
+
+        if (bits >= 8)
+        {
+            bits -= 8;
+            *out++ = static_cast<char>((chunk >> bits) & 0xFF);
+        }
     }
 
     return output;
 }
 
-std::string encodeAsHex(const std::string& input)
+std::string decodeAsHex(const std::string& input)
 {
-    return encodeAsHex(std::vector<char>(input.begin(), input.end()));
+    if (input.size() % 2) throw ArbiterError("Invalid hex length");
+
+    std::string output(input.size() / 2, 0);
+
+    for (std::size_t i(0); i < output.size(); ++i)
+    {
+        const int hi(hexValue(input[i * 2]));
+        const int lo(hexValue(input[i * 2 + 1]));
+        if (hi < 0 || lo < 0) throw ArbiterError("Invalid hex character");
+
+        output[i] = static_cast<char>(hi << 4 | lo);
+    }
+
+    return output;
 }
 
 } // namespace crypto
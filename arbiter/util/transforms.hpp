@@ -26,6 +26,16 @@ ARBITER_DLL std::string encodeBase64(const std::string& data, bool pad = true);
 ARBITER_DLL std::string encodeAsHex(const std::vector<char>& data);
 ARBITER_DLL std::string encodeAsHex(const std::string& data);
 
+/** Decode standard base64, with or without padding.  Throws ArbiterError if
+ * @p data is not valid base64.
+ */
+ARBITER_DLL std::string decodeBase64(const std::string& data);
+
+/** Decode hex of either case.  Throws ArbiterError if @p data is not valid
+ * hex.
+ */
+ARBITER_DLL std::string decodeAsHex(const std::string& data);
+
 } // namespace crypto
 } // namespace arbiter
 
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
@@ -23,45 +28,173 @@ public:
 namespace http
 {
 
-/** HTTP header fields. */
-using Headers = std::map<std::string, std::string>;
+/** @brief Orders strings regardless of ASCII case, as header names are
+ * compared.
+ */
+struct CaseInsensitiveLess
+{
+    bool operator()(const std::string& a, const std::string& b) const
+    {
+        const std::size_t n(a.size() < b.size() ? a.size() : b.size());
+        for (std::size_t i(0); i < n; ++i)
+        {
+            const char x(lower(a[i]));
+            const char y(lower(b[i]));
+            if (x != y) return x < y;
+        }
+        return a.size() < b.size();
+    }
+
+private:
+    static char lower(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+};
+
+/** HTTP header fields, whose names are matched regardless of case, so that
+ * for example the `content-length` of an HTTP/2 response is found as
+ * `Content-Length`.  Each name keeps the spelling with which it was first
+ * inserted.
+ */
+using Headers = std::map<std::string, std::string, CaseInsensitiveLess>;
 
 /** HTTP query parameters. */
 using Query = std::map<std::string, std::string>;
 
+/** @brief Details of the transfer which produced a Response.
+ *
+ * Each time is measured from the start of the transfer to the completion of
+ * its phase, so for example the time spent on the TLS handshake alone is
+ * `tls - connect`.  Phases which did not occur, like the handshake on a
+ * reused connection, are reported as zero or as the end of the preceding
+ * phase.
+ */
+struct Transfer
+{
+    using Duration = std::chrono::microseconds;
+
+    /** The final URL, after any redirects. */
+    std::string url;
+
+    Duration dns = Duration(0);         /**< Name resolution completed. */
+    Duration connect = Duration(0);     /**< TCP connection established. */
+    Duration tls = Duration(0);         /**< TLS handshake completed. */
+    Duration firstByte = Duration(0);   /**< First response byte received. */
+    Duration total = Duration(0);       /**< Transfer completed. */
+
+    /** Bytes of body sent and received on the wire. */
+    std::uint64_t bytesSent = 0;
+    std::uint64_t bytesReceived = 0;
+};
+
+/** @brief A source of reusable buffers for response bodies.
+ *
+ * An http::Pool with a BufferPool receives each response body whose size it
+ * knows in advance into a buffer from BufferPool::acquire, and the buffer is
+ * passed back to BufferPool::release when the response is destroyed, unless
+ * its body was released to the caller.  Implementations must be
+ * thread-safe.  See SlabPool.
+ */
+class BufferPool
+{
+public:
+    virtual ~BufferPool() { }
+
+    /** An empty buffer with capacity for at least @p size bytes. */
+    virtual std::vector<char> acquire(std::size_t size) = 0;
+
+    /** Take back @p buffer, whose contents are no longer needed. */
+    virtual void release(std::vector<char> buffer) = 0;
+};
+
 /** @cond arbiter_internal */
 
 class Response
 {
 public:
+    // Decodes an encoded body, like a gzipped one, returning the result.
+    using Decoder = std::function<std::vector<char>(const std::vector<char>&)>;
+
     Response(int code = 0)
         : m_code(code)
         , m_data()
     { }
 
-    Response(int code, std::vector<char> data)
-        : m_code(code)
-        , m_data(data)
-    { }
-
+    // The body and headers are taken by value, so callers may move them in
+    // to avoid copying.  If @p buffers is set, the body is released to it
+    // on destruction.
     Response(
             int code,
-            const std::vector<char>& data,
-            const Headers& headers)
+            std::vector<char> data,
+            Headers headers = Headers(),
+            Transfer transfer = Transfer(),
+            std::shared_ptr<BufferPool> buffers = nullptr)
         : m_code(code)
-        , m_data(data)
-        , m_headers(headers)
+        , m_data(std::move(data))
+        , m_headers(std::move(headers))
+        , m_transfer(std::move(transfer))
+        , m_buffers(std::move(buffers))
     { }
 
-    ~Response() { }
+    Response(const Response&) = default;
+    Response(Response&&) = default;
+    Response& operator=(const Response&) = default;
+    Response& operator=(Response&&) = default;
+
+    ~Response()
+    {
+        if (m_buffers && m_data.capacity())
+        {
+            m_buffers->release(std::move(m_data));
+        }
+    }
 
     bool ok() const             { return m_code / 100 == 2; }
     bool clientError() const    { return m_code / 100 == 4; }
     bool serverError() const    { return m_code / 100 == 5; }
     int code() const            { return m_code; }
 
-    std::vector<char> data() const { return m_data; }
+    const std::vector<char>& data() const
+    {
+        decode();
+        return m_data;
+    }
+
     const Headers& headers() const { return m_headers; }
+    const Transfer& transfer() const { return m_transfer; }
+
+    /** Move the body out of this Response, leaving it empty. */
+    std::vector<char> releaseData()
+    {
+        decode();
+        std::vector<char> data;
+        data.swap(m_data);
+        return data;
+    }
+
+    // The body is held as received, to be decoded by @p decoder when it is
+    // first read, which is typically after the handle which received it has
+    // been released.
+    void decoder(Decoder decoder) { m_decoder = std::move(decoder); }
+
+    // True if the body has yet to be decoded.
+    bool encoded() const { return static_cast<bool>(m_decoder); }
+
+    // Decode the body now, if it is encoded, throwing if it is invalid.
+    void decode() const
+    {
+        if (!m_decoder) return;
+
+        const Decoder decoder(std::move(m_decoder));
+        m_decoder = nullptr;
+
+        std::vector<char> raw;
+        raw.swap(m_data);
+        m_data = decoder(raw);
+        if (m_buffers && raw.capacity()) m_buffers->release(std::move(raw));
+    }
+
     std::string str() const
     {
         return std::string(data().data(), data().size());
@@ -69,8 +202,11 @@ public:
 
 private:
     int m_code;
-    std::vector<char> m_data;
+    mutable std::vector<char> m_data;
     Headers m_headers;
+    Transfer m_transfer;
+    std::shared_ptr<BufferPool> m_buffers;
+    mutable Decoder m_decoder;
 };
 
 /** @endcond */
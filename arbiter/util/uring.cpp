@@ -0,0 +1,408 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/uring.hpp>
+
+#include <arbiter/util/types.hpp>
+#endif
+
+#ifdef ARBITER_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+#ifdef ARBITER_URING
+
+namespace
+{
+    // There is no liburing dependency, so the ring is driven by the raw
+    // system calls.
+    int uringSetup(const unsigned entries, io_uring_params* params)
+    {
+        return ::syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    int uringEnter(
+            const int fd,
+            const unsigned submit,
+            const unsigned wait,
+            const unsigned flags)
+    {
+        return ::syscall(
+                __NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0);
+    }
+
+    // The user data of the no-op which wakes the reaper for shutdown.
+    const std::uint64_t wakeup(0);
+}
+
+struct Uring::Ring
+{
+    ~Ring()
+    {
+        if (sqes != MAP_FAILED) ::munmap(sqes, sqesSize);
+        if (cq != MAP_FAILED && cq != sq) ::munmap(cq, cqSize);
+        if (sq != MAP_FAILED) ::munmap(sq, sqSize);
+        if (fd != -1) ::close(fd);
+    }
+
+    int fd = -1;
+    unsigned entries = 0;
+
+    void* sq = MAP_FAILED;
+    void* cq = MAP_FAILED;
+    void* sqes = MAP_FAILED;
+    std::size_t sqSize = 0;
+    std::size_t cqSize = 0;
+    std::size_t sqesSize = 0;
+
+    // Submission queue, of which we are the producer.
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+
+    // Completion queue, of which we are the consumer.
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+};
+
+struct Uring::Request
+{
+    std::string path;
+    int fd = -1;
+    bool write = false;
+
+    // The whole file, of which the first done bytes have been transferred.
+    std::vector<char> data;
+    std::size_t done = 0;
+    iovec iov;
+
+    std::promise<std::vector<char>> readPromise;
+    std::promise<void> writePromise;
+};
+
+std::unique_ptr<Uring> Uring::create(const std::size_t depth)
+{
+    std::unique_ptr<Ring> ring(new Ring());
+
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    // Setup fails on kernels without io_uring, or where it is disabled.
+    ring->fd = uringSetup(depth, &params);
+    if (ring->fd < 0) return std::unique_ptr<Uring>();
+
+    ring->entries = params.sq_entries;
+    ring->sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    // Newer kernels map both rings with a single mapping.
+    const bool single(params.features & IORING_FEAT_SINGLE_MMAP);
+    if (single) ring->sqSize = ring->cqSize = (std::max)(
+            ring->sqSize,
+            ring->cqSize);
+
+    const int prot(PROT_READ | PROT_WRITE);
+    const int flags(MAP_SHARED | MAP_POPULATE);
+
+    ring->sq = ::mmap(
+            nullptr, ring->sqSize, prot, flags, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq == MAP_FAILED) return std::unique_ptr<Uring>();
+
+    if (single) ring->cq = ring->sq;
+    else
+    {
+        ring->cq = ::mmap(
+                nullptr, ring->cqSize, prot, flags, ring->fd,
+                IORING_OFF_CQ_RING);
+        if (ring->cq == MAP_FAILED) return std::unique_ptr<Uring>();
+    }
+
+    ring->sqes = ::mmap(
+            nullptr, ring->sqesSize, prot, flags, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) return std::unique_ptr<Uring>();
+
+    char* sq(static_cast<char*>(ring->sq));
+    ring->sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq(static_cast<char*>(ring->cq));
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return std::unique_ptr<Uring>(new Uring(std::move(ring)));
+}
+
+Uring::Uring(std::unique_ptr<Ring> ring)
+    : m_ring(std::move(ring))
+    , m_reaper([this]() { reap(); })
+{ }
+
+Uring::~Uring()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return !m_active; });
+        m_done = true;
+    }
+
+    Request nop;
+    submit(&nop, true);
+    m_reaper.join();
+}
+
+std::future<std::vector<char>> Uring::read(const std::string path)
+{
+    std::unique_ptr<Request> req(new Request());
+    std::future<std::vector<char>> future(req->readPromise.get_future());
+
+    req->path = path;
+    req->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (req->fd == -1)
+    {
+        req->readPromise.set_exception(std::make_exception_ptr(
+                    ArbiterError("Could not read file " + path)));
+        return future;
+    }
+
+    struct stat info;
+    if (::fstat(req->fd, &info) != 0)
+    {
+        ::close(req->fd);
+        req->readPromise.set_exception(std::make_exception_ptr(
+                    ArbiterError("Could not stat " + path)));
+        return future;
+    }
+
+    if (!info.st_size)
+    {
+        ::close(req->fd);
+        req->readPromise.set_value(std::vector<char>());
+        return future;
+    }
+
+    req->data.resize(info.st_size);
+    submit(req.release());
+    return future;
+}
+
+std::future<void> Uring::write(
+        const std::string path,
+        std::vector<char> data)
+{
+    std::unique_ptr<Request> req(new Request());
+    std::future<void> future(req->writePromise.get_future());
+
+    req->path = path;
+    req->write = true;
+    req->fd = ::open(
+            path.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0666);
+    if (req->fd == -1)
+    {
+        req->writePromise.set_exception(std::make_exception_ptr(
+                    ArbiterError("Could not open " + path + " for writing")));
+        return future;
+    }
+
+    if (data.empty())
+    {
+        ::close(req->fd);
+        req->writePromise.set_value();
+        return future;
+    }
+
+    req->data = std::move(data);
+    submit(req.release());
+    return future;
+}
+
+void Uring::submit(Request* req, const bool resubmit)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (!resubmit)
+    {
+        m_cv.wait(lock, [this]() { return m_active < m_ring->entries; });
+        ++m_active;
+    }
+
+    Ring& r(*m_ring);
+    const unsigned tail(*r.sqTail);
+    const unsigned index(tail & *r.sqMask);
+
+    io_uring_sqe& sqe(static_cast<io_uring_sqe*>(r.sqes)[index]);
+    std::memset(&sqe, 0, sizeof(sqe));
+
+    if (req->fd == -1)
+    {
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = wakeup;
+    }
+    else
+    {
+        req->iov.iov_base = req->data.data() + req->done;
+        req->iov.iov_len = req->data.size() - req->done;
+
+        sqe.opcode = req->write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe.fd = req->fd;
+        sqe.off = req->done;
+        sqe.addr = reinterpret_cast<std::uint64_t>(&req->iov);
+        sqe.len = 1;
+        sqe.user_data = reinterpret_cast<std::uint64_t>(req);
+    }
+
+    r.sqArray[index] = index;
+    __atomic_store_n(r.sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    // Submit everything the kernel hasn't yet consumed, which includes any
+    // entries left behind by a call that was interrupted.
+    while (true)
+    {
+        const unsigned head(__atomic_load_n(r.sqHead, __ATOMIC_ACQUIRE));
+        if (head == tail + 1) break;
+
+        if (uringEnter(r.fd, tail + 1 - head, 0, 0) < 0 &&
+                errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            break;
+        }
+    }
+}
+
+void Uring::reap()
+{
+    Ring& r(*m_ring);
+
+    while (true)
+    {
+        unsigned head(*r.cqHead);
+        const unsigned tail(__atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE));
+
+        if (head == tail)
+        {
+            uringEnter(r.fd, 0, 1, IORING_ENTER_GETEVENTS);
+            continue;
+        }
+
+        bool stop(false);
+
+        for ( ; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe(r.cqes[head & *r.cqMask]);
+            const std::uint64_t data(cqe.user_data);
+            const int result(cqe.res);
+
+            // Release the slot before acting on it, since continuing a short
+            // transfer may produce another completion.
+            __atomic_store_n(r.cqHead, head + 1, __ATOMIC_RELEASE);
+
+            if (data == wakeup) stop = true;
+            else complete(reinterpret_cast<Request*>(data), result);
+        }
+
+        if (stop) return;
+    }
+}
+
+void Uring::complete(Request* req, const int result)
+{
+    if (result == -EINTR || result == -EAGAIN) return submit(req, true);
+
+    if (result > 0)
+    {
+        req->done += result;
+        if (req->done < req->data.size()) return submit(req, true);
+    }
+
+    // A read which reaches the end early has found a file that shrank since
+    // it was sized, while a write which makes no progress has failed.
+    const bool closed(::close(req->fd) == 0);
+    const bool failed(result < 0 || (req->write && (!result || !closed)));
+
+    if (failed)
+    {
+        const std::string message(
+                (req->write ?
+                    "Error occurred while writing " :
+                    "Error occurred reading ") + req->path +
+                (result < 0 ? ": " + std::string(std::strerror(-result)) : ""));
+
+        const auto error(std::make_exception_ptr(ArbiterError(message)));
+        if (req->write) req->writePromise.set_exception(error);
+        else req->readPromise.set_exception(error);
+    }
+    else if (req->write) req->writePromise.set_value();
+    else
+    {
+        req->data.resize(req->done);
+        req->readPromise.set_value(std::move(req->data));
+    }
+
+    delete req;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_active;
+    }
+    m_cv.notify_all();
+}
+
+#else
+
+struct Uring::Ring { };
+struct Uring::Request { };
+
+std::unique_ptr<Uring> Uring::create(std::size_t)
+{
+    return std::unique_ptr<Uring>();
+}
+
+Uring::Uring(std::unique_ptr<Ring> ring) : m_ring(std::move(ring)) { }
+Uring::~Uring() { }
+
+std::future<std::vector<char>> Uring::read(std::string)
+{
+    throw ArbiterError("io_uring support was not built");
+}
+
+std::future<void> Uring::write(std::string, std::vector<char>)
+{
+    throw ArbiterError("io_uring support was not built");
+}
+
+#endif
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @cond arbiter_internal */
+
+/** Asynchronous local file I/O through a Linux io_uring.  Requests are
+ * submitted from the calling thread and completed by a single reaping thread,
+ * so many reads and writes may be in flight at once without a thread apiece.
+ * Opening and sizing a file is done by the caller, and the transfer of its
+ * contents by the kernel.
+ */
+class ARBITER_DLL Uring
+{
+public:
+    /** Returns null if io_uring support was not built, or if the running
+     * kernel does not permit it.
+     */
+    static std::unique_ptr<Uring> create(std::size_t depth = 256);
+
+    /** Waits for all outstanding requests to complete. */
+    ~Uring();
+
+    /** Read the whole of the file at @p path.  Failures, including a path
+     * which doesn't exist, are reported through the future.
+     */
+    std::future<std::vector<char>> read(std::string path);
+
+    /** Write @p data to @p path, overwriting any existing file. */
+    std::future<void> write(std::string path, std::vector<char> data);
+
+private:
+    struct Ring;
+    struct Request;
+
+    Uring(std::unique_ptr<Ring> ring);
+
+    // Queue @p req for its next piece of I/O.  Unless @p resubmit, which is
+    // for the continuation of a short transfer, this waits while the ring is
+    // at capacity.
+    void submit(Request* req, bool resubmit = false);
+    void reap();
+    void complete(Request* req, int result);
+
+    Uring(const Uring&);
+    Uring& operator=(const Uring&);
+
+    std::unique_ptr<Ring> m_ring;
+
+    std::size_t m_active = 0;
+    bool m_done = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_reaper;
+};
+
+/** @endcond */
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -91,6 +91,59 @@ std::string getNonBasename(const std::string fullPath)
     return result;
 }
 
+namespace detail
+{
+
+std::string joinParts(const PathPart* parts, const std::size_t n)
+{
+#ifdef ARBITER_WINDOWS
+    const char sep('\\');
+#else
+    const char sep('/');
+#endif
+
+    // The first part keeps its leading slashes, and is stripped of at most
+    // one trailing slash, so that roots like "C://" are retained.
+    const PathPart& first(parts[0]);
+    std::size_t firstSize(first.size);
+    const bool firstIsDir(firstSize && isSlash(first.data[firstSize - 1]));
+    if (firstSize > 1 && firstIsDir && !isSlash(first.data[firstSize - 2]))
+    {
+        --firstSize;
+    }
+
+    std::size_t size(firstSize + 1);
+    for (std::size_t i(1); i < n; ++i) size += parts[i].size + 1;
+
+    std::string result;
+    result.reserve(size);
+    result.append(first.data, firstSize);
+
+    // Later parts are stripped of slashes at both ends, and skipped if that
+    // leaves them empty.  The result ends with a slash if the last part
+    // which was not skipped did.
+    bool isDir(firstIsDir);
+    for (std::size_t i(1); i < n; ++i)
+    {
+        const char* begin(parts[i].data);
+        const char* end(begin + parts[i].size);
+        const bool partIsDir(begin != end && isSlash(end[-1]));
+
+        while (begin != end && isSlash(*begin)) ++begin;
+        while (begin != end && isSlash(end[-1])) --end;
+        if (begin == end) continue;
+
+        if (result.empty() || !isSlash(result.back())) result += sep;
+        result.append(begin, end);
+        isDir = partIsDir;
+    }
+
+    if (isDir && result.size() && !isSlash(result.back())) result += sep;
+    return result;
+}
+
+} // namespace detail
+
 std::unique_ptr<std::string> env(const std::string& var)
 {
     std::unique_ptr<std::string> result;
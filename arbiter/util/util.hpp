@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstring>
 #include <memory>
 #include <string>
 #include <utility>
@@ -59,70 +60,26 @@ inline bool isDirectory(std::string path)
     return (path.size() && isSlash(path.back())) || isGlob(path);
 }
 
-inline std::string joinImpl(bool first = false) { return std::string(); }
-
-template <typename ...Paths>
-inline std::string joinImpl(
-        bool first,
-        std::string current,
-        Paths&&... paths)
+namespace detail
 {
-    const bool currentIsDir(current.size() && isSlash(current.back()));
-    std::string next(joinImpl(false, std::forward<Paths>(paths)...));
-
-    // Strip slashes from the front of our remainder.
-    while (next.size() && isSlash(next.front())) next = next.substr(1);
-
-    if (first)
+    // A component of a path to be joined, which is not copied.
+    struct PathPart
     {
-        // If this is the first component, strip a single trailing slash if
-        // one exists - but do not strip a double trailing slash since we
-        // want to retain Windows paths like "C://".
-        if (
-                current.size() > 1 &&
-                isSlash(current.back()) &&
-                !isSlash(current.at(current.size() - 2)))
-        {
-            current.pop_back();
-        }
-    }
-    else
-    {
-        while (current.size() && isSlash(current.back()))
-        {
-            current.pop_back();
-        }
-        if (current.empty()) return next;
-    }
+        const char* data;
+        std::size_t size;
+    };
 
-    std::string sep;
-
-    if (next.size() && (current.empty() || !isSlash(current.back())))
+    inline PathPart pathPart(const std::string& s)
     {
-        // We are going to join current with a populated subpath, so make
-        // sure they are separated by a slash.
-#ifdef ARBITER_WINDOWS
-        sep = "\\";
-#else
-        sep = "/";
-#endif
+        return PathPart { s.data(), s.size() };
     }
-    else if (next.empty() && currentIsDir)
-    {
-        // We are at the end of the chain, and the last component was a
-        // directory.  Retain its trailing slash.
-        if (current.size() && !isSlash(current.back()))
-        {
-#ifdef ARBITER_WINDOWS
-            sep = "\\";
-#else
-            sep = "/";
-#endif
 
-        }
+    inline PathPart pathPart(const char* s)
+    {
+        return PathPart { s, std::strlen(s) };
     }
 
-    return current + sep + next;
+    ARBITER_DLL std::string joinParts(const PathPart* parts, std::size_t n);
 }
 /** @endcond */
 
@@ -148,11 +105,18 @@ inline std::string joinImpl(
  * join("C:\\", "My Documents")             // "C:/My Documents"
  * join("s3://", "bucket", "object.txt")    // "s3://bucket/object.txt"
  * @endcode
+ *
+ * The result is built in a single allocation, without copying @p path or
+ * @p paths.
  */
 template <typename ...Paths>
-inline std::string join(std::string path, Paths&&... paths)
+inline std::string join(const std::string& path, Paths&&... paths)
 {
-    return joinImpl(true, path, std::forward<Paths>(paths)...);
+    const detail::PathPart parts[] = {
+        detail::pathPart(path),
+        detail::pathPart(std::forward<Paths>(paths))...
+    };
+    return detail::joinParts(parts, 1 + sizeof...(paths));
 }
 
 /** @brief Extract an environment variable, if it exists, independent of
@@ -0,0 +1,234 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/writebehind.hpp>
+
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+namespace
+{
+    const std::size_t defaultWriteBehindLimit(256 * 1024 * 1024);
+    const std::size_t defaultSpoolSegmentSize(64 * 1024 * 1024);
+
+    std::string describe(const std::exception_ptr& error)
+    {
+        try { std::rethrow_exception(error); }
+        catch (const std::exception& e) { return e.what(); }
+        catch (...) { return "Unknown error"; }
+    }
+}
+
+WriteBehind::WriteBehind(
+        Put put,
+        const std::size_t limit,
+        std::unique_ptr<Spool> spool)
+    : m_put(put)
+    , m_limit(limit)
+    , m_spool(std::move(spool))
+{
+    if (!m_limit) throw ArbiterError("Write-behind limit must be positive");
+}
+
+std::unique_ptr<WriteBehind> WriteBehind::create(
+        Put put,
+        const std::string s)
+{
+    const json j(s.size() ? json::parse(s) : json());
+    if (!j.is_object())
+    {
+        return std::unique_ptr<WriteBehind>(
+                new WriteBehind(put, defaultWriteBehindLimit));
+    }
+
+    std::unique_ptr<Spool> spool;
+    const std::string dir(j.value("spool", std::string()));
+    if (dir.size())
+    {
+        spool.reset(new Spool(
+                dir,
+                j.value("segmentSize", defaultSpoolSegmentSize),
+                j.value("sync", true)));
+    }
+
+    return std::unique_ptr<WriteBehind>(new WriteBehind(
+                put,
+                j.value("limit", defaultWriteBehindLimit),
+                std::move(spool)));
+}
+
+WriteBehind::~WriteBehind()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() { return m_active.empty(); });
+}
+
+void WriteBehind::put(const std::string path, std::vector<char> data)
+{
+    const std::uint64_t id(
+            m_spool ? m_spool->append(path, data.data(), data.size()) : 0);
+    enqueue(path, std::move(data), id);
+}
+
+std::size_t WriteBehind::recover()
+{
+    if (!m_spool) return 0;
+
+    std::vector<Spool::Entry> entries(m_spool->recover());
+    for (Spool::Entry& entry : entries)
+    {
+        enqueue(entry.path, std::move(entry.data), entry.id);
+    }
+    return entries.size();
+}
+
+void WriteBehind::enqueue(
+        const std::string& path,
+        std::vector<char> data,
+        const std::uint64_t id)
+{
+    const std::size_t size(data.size());
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this, size]()
+        {
+            return !m_bytes || m_bytes + size <= m_limit;
+        });
+
+        m_bytes += size;
+
+        auto it(m_active.find(path));
+        if (it != m_active.end())
+        {
+            Active& active(it->second);
+            if (active.next)
+            {
+                m_bytes -= active.next->size();
+                if (m_spool) m_spool->resolve(active.nextId);
+                m_cv.notify_all();
+            }
+            active.next.reset(new std::vector<char>(std::move(data)));
+            active.nextId = id;
+            return;
+        }
+
+        m_active[path];
+    }
+
+    start(path, std::move(data), id);
+}
+
+void WriteBehind::start(
+        const std::string& path,
+        std::vector<char> data,
+        const std::uint64_t id)
+{
+    const std::size_t size(data.size());
+
+    try
+    {
+        m_put(path, std::move(data), [this, path, size, id](
+                    std::future<void> f)
+        {
+            std::exception_ptr error;
+            try { f.get(); }
+            catch (...) { error = std::current_exception(); }
+
+            finish(path, size, id, error);
+        });
+    }
+    catch (...)
+    {
+        finish(path, size, id, std::current_exception());
+    }
+}
+
+void WriteBehind::finish(
+        const std::string& path,
+        const std::size_t size,
+        const std::uint64_t id,
+        const std::exception_ptr error)
+{
+    std::unique_ptr<std::vector<char>> next;
+    std::uint64_t nextId(0);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bytes -= size;
+
+        if (error) m_errors[path] = error;
+        else m_errors.erase(path);
+
+        if (m_spool)
+        {
+            // The entry of a failed upload is kept for the next process to
+            // try again, unless this upload replaces it.
+            auto failed(m_failed.find(path));
+            if (failed != m_failed.end())
+            {
+                m_spool->resolve(failed->second);
+                m_failed.erase(failed);
+            }
+
+            if (error) m_failed[path] = id;
+            else m_spool->resolve(id);
+        }
+
+        // The path stays active while its held data starts, so that flush
+        // can't return in between.
+        auto it(m_active.find(path));
+        if (it->second.next)
+        {
+            next = std::move(it->second.next);
+            nextId = it->second.nextId;
+        }
+        else m_active.erase(it);
+
+        m_cv.notify_all();
+    }
+
+    if (next) start(path, std::move(*next), nextId);
+}
+
+void WriteBehind::flush()
+{
+    std::map<std::string, std::exception_ptr> errors;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_active.empty(); });
+        errors.swap(m_errors);
+    }
+
+    if (errors.empty()) return;
+
+    std::string message(
+            std::to_string(errors.size()) + " write-behind upload" +
+            (errors.size() == 1 ? "" : "s") + " failed:");
+    for (const auto& p : errors)
+    {
+        message += "\n" + p.first + ": " + describe(p.second);
+    }
+
+    throw ArbiterError(message);
+}
+
+std::size_t WriteBehind::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/executor.hpp>
+#include <arbiter/util/exports.hpp>
+#include <arbiter/util/spool.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+/** @brief Uploads which drain in the background while their producer
+ * carries on.
+ *
+ * Each put takes ownership of its data and returns at once, unless the data
+ * of unfinished uploads would then exceed a limit, in which case it waits
+ * for enough of them to finish.  A put to a path whose previous upload is
+ * still in flight is held until that one finishes, replacing any other
+ * held for the same path, so that the last data put to a path is what ends
+ * up there.
+ *
+ * Failures are collected rather than thrown, and reported by flush.
+ *
+ * With a Spool, each put is first appended to it, so that uploads which
+ * are unfinished when the process dies are made by recover in the next
+ * one.  The entries of failed uploads are kept until a later put to their
+ * path is uploaded, or until they are recovered.
+ */
+class ARBITER_DLL WriteBehind
+{
+public:
+    /** Upload @p data to @p path, passing the outcome to @p done. */
+    using Put = std::function<void(
+            const std::string& path,
+            std::vector<char> data,
+            Completion<void> done)>;
+
+    /** Upload with @p put, holding at most @p limit bytes of unfinished
+     * uploads, except that a single larger upload is let through alone,
+     * and spooling them to @p spool if it is given.
+     */
+    WriteBehind(
+            Put put,
+            std::size_t limit,
+            std::unique_ptr<Spool> spool = std::unique_ptr<Spool>());
+
+    /** Create from the stringified JSON @p j, which is the `writeBehind`
+     * entry of the Arbiter configuration.  Its keys are:
+     *      - `limit`, in bytes, by default 256 MiB
+     *      - `spool`, a local directory in which to spool uploads, by
+     *        default none
+     *      - `sync`, by default true, to sync each put to the spool before
+     *        it returns, without which a put survives the death of its
+     *        process but perhaps not of its host
+     *      - `segmentSize`, the bytes after which the spool starts a new
+     *        segment, by default 64 MiB
+     */
+    static std::unique_ptr<WriteBehind> create(Put put, std::string j);
+
+    /** Waits for unfinished uploads, whose failures are dropped. */
+    ~WriteBehind();
+
+    /** Queue @p data to be uploaded to @p path. */
+    void put(std::string path, std::vector<char> data);
+
+    /** Queue the uploads left unfinished in our spool by a previous
+     * process, returning their count.  Called once, before any put.
+     */
+    std::size_t recover();
+
+    /** Wait until no uploads remain, then throw an ArbiterError naming
+     * each path whose most recent upload failed since the last flush, if
+     * there are any.
+     */
+    void flush();
+
+    /** Bytes of data in flight or held. */
+    std::size_t pending() const;
+
+    std::size_t limit() const { return m_limit; }
+
+    /** Null if uploads are not spooled. */
+    const Spool* spool() const { return m_spool.get(); }
+
+private:
+    // A path with an upload in flight, and the data to follow it, if any,
+    // with the spool entry of that data.
+    struct Active
+    {
+        std::unique_ptr<std::vector<char>> next;
+        std::uint64_t nextId = 0;
+    };
+
+    // Queue @p data, whose spool entry is @p id, or 0 if it isn't spooled.
+    void enqueue(
+            const std::string& path,
+            std::vector<char> data,
+            std::uint64_t id);
+
+    void start(
+            const std::string& path,
+            std::vector<char> data,
+            std::uint64_t id);
+    void finish(
+            const std::string& path,
+            std::size_t size,
+            std::uint64_t id,
+            std::exception_ptr error);
+
+    WriteBehind(const WriteBehind&);
+    WriteBehind& operator=(const WriteBehind&);
+
+    const Put m_put;
+    const std::size_t m_limit;
+    const std::unique_ptr<Spool> m_spool;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::size_t m_bytes = 0;
+    std::map<std::string, Active> m_active;
+    std::map<std::string, std::exception_ptr> m_errors;
+
+    // The spool entries of the failed uploads, by path.
+    std::map<std::string, std::uint64_t> m_failed;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
@@ -0,0 +1,586 @@
+// Throughput and latency benchmarks for the drivers, the HTTP stack, and the
+// crypto kernels.
+//
+//      arbiter-bench [options] [output.json]
+//
+// Each benchmark runs a fixed workload several times and reports the median,
+// so that runs on one machine are comparable across revisions.  HTTP and S3
+// benchmarks are served by the in-process MockServer on the loopback
+// interface, so they measure the client stack rather than a network, unless
+// latency, bandwidth limits, or errors are injected (see --help).  Results
+// are written as JSON to the output path, or to stdout.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/drivers/fs.hpp>
+#include <arbiter/util/http.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/sha256.hpp>
+#include <arbiter/util/time.hpp>
+#include <arbiter/util/transforms.hpp>
+#include <arbiter/util/util.hpp>
+
+#ifdef ARBITER_MOCK_SERVER
+#include "mock-server.hpp"
+#endif
+
+using namespace arbiter;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const int samples(5);
+
+    const std::vector<std::size_t> kernelSizes { 64, 4096, 1024 * 1024 };
+    const std::vector<std::size_t> objectSizes { 4096, 1024 * 1024 };
+    const std::vector<std::size_t> concurrency { 1, 4, 16 };
+    const std::vector<std::size_t> scalingThreads {
+        1, 2, 4, 8, 16, 32, 64, 128, 256
+    };
+
+    // Each transfer benchmark moves about this much data per sample, with
+    // bounds on the number of operations for very small and large objects.
+    const std::size_t transferBytes(32 * 1024 * 1024);
+    const std::size_t maxTransferOps(2048);
+
+    // Keeps results alive so that the work producing them is not elided.
+    std::atomic<std::size_t> sink(0);
+
+    std::vector<char> makeData(std::size_t size)
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> dist(0, 255);
+
+        std::vector<char> data(size);
+        for (char& c : data) c = static_cast<char>(dist(gen));
+        return data;
+    }
+
+    // Returns the median wall time, in seconds, of @p f over several runs.
+    double time(const std::function<void()>& f)
+    {
+        std::vector<double> times;
+        for (int i(0); i < samples; ++i)
+        {
+            const auto start(Clock::now());
+            f();
+            times.push_back(
+                    std::chrono::duration<double>(Clock::now() - start)
+                        .count());
+        }
+
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+
+    // Runs @p f(thread) on @p threads threads at once.
+    void parallel(
+            std::size_t threads,
+            const std::function<void(std::size_t)>& f)
+    {
+        std::vector<std::thread> pool;
+        for (std::size_t t(0); t < threads; ++t)
+        {
+            pool.emplace_back([&f, t]() { f(t); });
+        }
+        for (auto& t : pool) t.join();
+    }
+
+    std::size_t opsPerThread(std::size_t size, std::size_t threads)
+    {
+        const std::size_t ops(
+                std::min(maxTransferOps, std::max<std::size_t>(
+                        transferBytes / size, 16)));
+        return std::max<std::size_t>(ops / threads, 1);
+    }
+
+    class Suite
+    {
+    public:
+        explicit Suite(std::string filter) : m_filter(filter) { }
+
+        bool enabled(const std::string& name) const
+        {
+            return name.find(m_filter) != std::string::npos;
+        }
+
+        // Record @p seconds taken for @p ops operations moving @p bytes,
+        // with any @p extra entries describing them.
+        void add(
+                const std::string& name,
+                const json& params,
+                double seconds,
+                std::size_t ops,
+                std::size_t bytes = 0,
+                const json& extra = json::object())
+        {
+            json entry {
+                { "name", name },
+                { "params", params },
+                { "seconds", seconds },
+                { "ops", ops },
+                { "opsPerSecond", ops / seconds },
+                { "secondsPerOp", seconds / ops }
+            };
+            if (bytes) entry["bytesPerSecond"] = bytes / seconds;
+            for (const auto& e : extra.items()) entry[e.key()] = e.value();
+
+            std::cerr << name << " " << params.dump() << ": " <<
+                ops / seconds << " ops/s" << std::endl;
+
+            m_results.push_back(entry);
+        }
+
+        const json& results() const { return m_results; }
+
+    private:
+        const std::string m_filter;
+        json m_results = json::array();
+    };
+
+    void benchKernels(Suite& suite)
+    {
+        for (const std::size_t size : kernelSizes)
+        {
+            const std::vector<char> raw(makeData(size));
+            const std::string data(raw.data(), raw.size());
+            const std::string encoded(crypto::encodeBase64(data));
+            const std::size_t ops(std::max<std::size_t>(
+                        (16 * 1024 * 1024) / size, 1));
+            const json params { { "size", size } };
+
+            auto run([&](
+                        const std::string& name,
+                        const std::function<std::size_t()>& f)
+            {
+                if (!suite.enabled(name)) return;
+                const double seconds(time([&]()
+                {
+                    for (std::size_t i(0); i < ops; ++i) sink += f();
+                }));
+                suite.add(name, params, seconds, ops, ops * size);
+            });
+
+            run("kernel.sha256", [&]() { return crypto::sha256(data).size(); });
+            run("kernel.base64.encode", [&]()
+            {
+                return crypto::encodeBase64(data).size();
+            });
+            run("kernel.base64.decode", [&]()
+            {
+                return crypto::decodeBase64(encoded).size();
+            });
+            run("kernel.hex.encode", [&]()
+            {
+                return crypto::encodeAsHex(data).size();
+            });
+        }
+    }
+
+    // Transfer benchmarks put, then get, distinct objects from each thread
+    // under @p prefix.
+    void benchTransfers(
+            Suite& suite,
+            const std::string& name,
+            const Arbiter& a,
+            const std::string& prefix,
+            const std::vector<std::size_t>& sizes)
+    {
+        for (const std::size_t size : sizes)
+        {
+            const std::vector<char> data(makeData(size));
+
+            for (const std::size_t threads : concurrency)
+            {
+                const std::size_t ops(opsPerThread(size, threads));
+                const json params { { "size", size }, { "threads", threads } };
+
+                auto path([&](std::size_t t, std::size_t i)
+                {
+                    return prefix + std::to_string(size) + "-" +
+                        std::to_string(t) + "-" + std::to_string(i);
+                });
+
+                // The objects read back must exist, so the put always runs.
+                const double putSeconds(time([&]()
+                {
+                    parallel(threads, [&](std::size_t t)
+                    {
+                        for (std::size_t i(0); i < ops; ++i)
+                        {
+                            a.put(path(t, i), data);
+                        }
+                    });
+                }));
+
+                if (suite.enabled(name + ".put"))
+                {
+                    suite.add(
+                            name + ".put",
+                            params,
+                            putSeconds,
+                            ops * threads,
+                            ops * threads * size);
+                }
+
+                if (!suite.enabled(name + ".get")) continue;
+
+                const double getSeconds(time([&]()
+                {
+                    parallel(threads, [&](std::size_t t)
+                    {
+                        for (std::size_t i(0); i < ops; ++i)
+                        {
+                            sink += a.getBinary(path(t, i)).size();
+                        }
+                    });
+                }));
+
+                suite.add(
+                        name + ".get",
+                        params,
+                        getSeconds,
+                        ops * threads,
+                        ops * threads * size);
+            }
+        }
+    }
+
+    // Lists a directory of empty objects under @p dir.
+    void benchGlob(
+            Suite& suite,
+            const std::string& name,
+            const Arbiter& a,
+            const std::string& dir)
+    {
+        if (!suite.enabled(name)) return;
+
+        const std::size_t count(1000);
+        const std::string globDir(dir + "glob/");
+        const bool local(a.isLocal(globDir));
+
+        if (local) mkdirp(globDir);
+        for (std::size_t i(0); i < count; ++i)
+        {
+            a.put(globDir + std::to_string(i), "");
+        }
+
+        const double seconds(time([&]()
+        {
+            sink += a.resolve(globDir + "*").size();
+        }));
+        suite.add(name, { { "files", count } }, seconds, count);
+
+        if (!local) return;
+
+        for (std::size_t i(0); i < count; ++i)
+        {
+            remove(globDir + std::to_string(i));
+        }
+        remove(globDir);
+    }
+
+    // The total of the waits for a handle counted by @p after but not by
+    // @p before, in seconds, taking each as the upper bound of its bucket.
+    double poolWait(const http::PoolStats& before, const http::PoolStats& after)
+    {
+        double seconds(0);
+        for (std::size_t i(0); i < after.waits.size(); ++i)
+        {
+            seconds +=
+                (after.waits[i] - before.waits[i]) *
+                std::ldexp(1.0, static_cast<int>(i)) / 1e6;
+        }
+        return seconds;
+    }
+
+    // Drives puts, gets, and size lookups of small objects under @p prefix
+    // from increasing numbers of threads, each reported with its throughput,
+    // latency percentiles, and for HTTP, the time spent waiting on @p pool
+    // for a handle, to show where callers begin to contend.
+    void benchScaling(
+            Suite& suite,
+            const std::string& name,
+            const Arbiter& a,
+            const std::string& prefix,
+            std::size_t totalOps,
+            const http::Pool* pool = nullptr)
+    {
+        const std::size_t size(4096);
+        const std::vector<char> data(makeData(size));
+        const std::vector<std::string> kinds { "put", "get", "getSize" };
+
+        for (const std::size_t threads : scalingThreads)
+        {
+            const std::size_t ops(std::max<std::size_t>(totalOps / threads, 4));
+
+            auto path([&](std::size_t t, std::size_t i)
+            {
+                return prefix + "scaling-" + std::to_string(t) + "-" +
+                    std::to_string(i);
+            });
+
+            for (const std::string& kind : kinds)
+            {
+                const std::string full("scaling." + name + "." + kind);
+
+                // Reads need the objects to exist.
+                if (!suite.enabled(full) && kind != "put") continue;
+
+                std::vector<std::vector<double>> latencies(threads);
+                const http::PoolStats before(
+                        pool ? pool->stats() : http::PoolStats());
+                const auto start(Clock::now());
+
+                parallel(threads, [&](std::size_t t)
+                {
+                    std::vector<double>& mine(latencies[t]);
+                    mine.reserve(ops);
+                    for (std::size_t i(0); i < ops; ++i)
+                    {
+                        const auto began(Clock::now());
+                        if (kind == "put") a.put(path(t, i), data);
+                        else if (kind == "get")
+                        {
+                            sink += a.getBinary(path(t, i)).size();
+                        }
+                        else sink += a.getSize(path(t, i));
+                        mine.push_back(
+                                std::chrono::duration<double>(
+                                    Clock::now() - began).count());
+                    }
+                });
+
+                const double seconds(
+                        std::chrono::duration<double>(
+                            Clock::now() - start).count());
+                if (!suite.enabled(full)) continue;
+
+                std::vector<double> all;
+                for (const auto& v : latencies)
+                {
+                    all.insert(all.end(), v.begin(), v.end());
+                }
+                std::sort(all.begin(), all.end());
+                auto percentile([&all](double p)
+                {
+                    return all[std::min(
+                            all.size() - 1,
+                            static_cast<std::size_t>(p * all.size()))];
+                });
+
+                json extra {
+                    { "latency", {
+                        { "p50", percentile(0.5) },
+                        { "p90", percentile(0.9) },
+                        { "p99", percentile(0.99) },
+                        { "max", all.back() }
+                    } }
+                };
+                if (pool)
+                {
+                    const double wait(poolWait(before, pool->stats()));
+                    extra["poolWaitSeconds"] = wait;
+                    extra["poolWaitPerOp"] = wait / all.size();
+                }
+
+                suite.add(
+                        full,
+                        { { "size", size }, { "threads", threads } },
+                        seconds,
+                        all.size(),
+                        kind == "getSize" ? 0 : all.size() * size,
+                        extra);
+            }
+        }
+    }
+
+#ifdef ARBITER_MOCK_SERVER
+    void benchHttp(Suite& suite, const MockServer::Options& options)
+    {
+        MockServer server(options);
+        const std::string root(server.httpRoot());
+
+        const json config { { "s3", json::parse(server.s3Config()) } };
+        Arbiter a(config.dump());
+
+        benchTransfers(suite, "http", a, root + "bench/", objectSizes);
+        benchTransfers(suite, "s3", a, "s3://bench/bench/", objectSizes);
+        benchGlob(suite, "s3.glob", a, "s3://bench/");
+
+        // Many callers of one Arbiter contend for its pool, and for S3, its
+        // credentials.
+        benchScaling(suite, "http", a, root + "bench/", 2048, &a.httpPool());
+        benchScaling(
+                suite,
+                "s3",
+                a,
+                "s3://bench/bench/",
+                2048,
+                &a.httpPool());
+
+        // Signing is the difference between an S3 request and a plain one
+        // for an empty object.
+        if (suite.enabled("s3.signing"))
+        {
+            const std::size_t ops(2000);
+            auto run([&](const std::string& path)
+            {
+                return time([&]()
+                {
+                    for (std::size_t i(0); i < ops; ++i)
+                    {
+                        sink += a.getBinary(path).size();
+                    }
+                });
+            });
+
+            a.put(root + "bench/signing", "");
+            a.put("s3://bench/bench/signing", "");
+
+            const double plain(run(root + "bench/signing"));
+            const double signed_(run("s3://bench/bench/signing"));
+            suite.add(
+                    "s3.signing",
+                    json::object(),
+                    std::max(signed_ - plain, 1e-9),
+                    ops);
+        }
+
+        if (suite.enabled("pool.acquire"))
+        {
+            const std::size_t handles(8);
+            const std::size_t ops(20000);
+            http::Pool pool(handles, 0, "");
+
+            for (const std::size_t threads : { 1, 8, 32 })
+            {
+                const double seconds(time([&]()
+                {
+                    parallel(threads, [&](std::size_t)
+                    {
+                        for (std::size_t i(0); i < ops / threads; ++i)
+                        {
+                            http::Resource r(pool.acquire(root));
+                        }
+                    });
+                }));
+
+                suite.add(
+                        "pool.acquire",
+                        { { "handles", handles }, { "threads", threads } },
+                        seconds,
+                        ops / threads * threads);
+            }
+        }
+    }
+#endif
+}
+
+int main(int argc, char** argv)
+{
+    std::string filter;
+    std::string output;
+
+    // Behavior of the local object store.
+    json server {
+        { "latency", 0 },
+        { "bandwidth", 0 },
+        { "errorRate", 0.0 }
+    };
+
+    for (int i(1); i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const bool value(i + 1 < argc);
+
+        if (arg == "--filter" && value) filter = argv[++i];
+        else if (arg == "--latency" && value)
+        {
+            server["latency"] = std::stoul(argv[++i]);
+        }
+        else if (arg == "--bandwidth" && value)
+        {
+            server["bandwidth"] = std::stoul(argv[++i]);
+        }
+        else if (arg == "--errors" && value)
+        {
+            server["errorRate"] = std::stod(argv[++i]);
+        }
+        else if (arg == "-h" || arg == "--help")
+        {
+            std::cout <<
+                "Usage: arbiter-bench [options] [output.json]\n"
+                "  --filter <s>     Run benchmarks whose names contain s\n"
+                "  --latency <ms>   Delay each local server response\n"
+                "  --bandwidth <n>  Limit local server responses to n "
+                    "bytes/s\n"
+                "  --errors <rate>  Fail a fraction of local server "
+                    "requests" <<
+                std::endl;
+            return 0;
+        }
+        else output = arg;
+    }
+
+    Suite suite(filter);
+
+    benchKernels(suite);
+
+    {
+        const Arbiter a;
+        const std::string dir(
+                getTempPath() + "arbiter-bench-" +
+                std::to_string(randomNumber()) + "/");
+        mkdirp(dir);
+
+        benchTransfers(suite, "mem", a, "mem://bench/", objectSizes);
+        benchTransfers(suite, "fs", a, dir, objectSizes);
+        benchGlob(suite, "fs.glob", a, dir);
+        benchScaling(suite, "mem", a, "mem://bench/", 65536);
+
+        for (const std::string& path : a.resolve(dir + "*")) remove(path);
+        remove(dir);
+    }
+
+#ifdef ARBITER_MOCK_SERVER
+    MockServer::Options options;
+    options.latency = std::chrono::milliseconds(
+            server["latency"].get<std::size_t>());
+    options.bandwidth = server["bandwidth"].get<std::size_t>();
+    options.errorRate = server["errorRate"].get<double>();
+
+    benchHttp(suite, options);
+#endif
+
+#ifdef __OPTIMIZE__
+    const bool optimized(true);
+#else
+    const bool optimized(false);
+#endif
+
+    const json result {
+        { "time", Time().str(Time::iso8601) },
+        { "optimized", optimized },
+        { "samples", samples },
+        { "hardwareConcurrency", std::thread::hardware_concurrency() },
+        { "server", server },
+        { "benchmarks", suite.results() }
+    };
+
+    if (output.empty()) std::cout << result.dump(2) << std::endl;
+    else drivers::Fs().put(output, result.dump(2));
+
+    return 0;
+}
@@ -0,0 +1,444 @@
+// A command-line interface to the Arbiter, for moving data between any of
+// its drivers with the same routing and configuration as the library.
+//
+//      arbiter [options] <command> [args]
+//
+// Commands are cp, cat, ls, du, sync, serve, and replay (see --help).  The
+// configuration is read as by the Arbiter, from ~/.arbiter/config.json or
+// the file named by ARBITER_CONFIG_FILE, under that of --config, under the
+// options given here.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/drivers/fs.hpp>
+#include <arbiter/replay.hpp>
+#include <arbiter/sidecar.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/time.hpp>
+#include <arbiter/util/util.hpp>
+
+using namespace arbiter;
+
+namespace
+{
+    const std::string usage(
+        "Usage: arbiter [options] <command> [args]\n"
+        "\n"
+        "Commands:\n"
+        "  cp <src>... <dst>     Copy files, or directories ending in '/'\n"
+        "  cat <path>...         Stream files to stdout\n"
+        "  ls [-l] [-r] <path>   List files, with sizes and times if -l\n"
+        "  du [-h] <path>...     Total the sizes of files\n"
+        "  sync [--delete] <src> <dst>\n"
+        "                        Copy new or changed files of a directory\n"
+        "  serve <socket>        Serve remote paths to other processes until\n"
+        "                        interrupted, as a sidecar daemon\n"
+        "  replay [--speed <x>] [--threads <n>] <recording> <root>\n"
+        "                        Replay a recorded workload beneath a root\n"
+        "\n"
+        "Options:\n"
+        "  -c, --config <path>   Configuration file, as JSON\n"
+        "  -j, --jobs <n>        Concurrent files and HTTP requests\n"
+        "  -p, --progress        Report progress to stderr\n"
+        "  -v, --verbose         Log each file copied\n"
+        "  -h, --help            Show this help\n");
+
+    struct Options
+    {
+        std::string config;
+        std::size_t jobs = 0;
+        bool progress = false;
+        bool verbose = false;
+    };
+
+    std::string humanSize(const std::uint64_t bytes)
+    {
+        const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB", "PiB" };
+
+        double v(static_cast<double>(bytes));
+        std::size_t unit(0);
+        while (v >= 1024 && unit < 5)
+        {
+            v /= 1024;
+            ++unit;
+        }
+
+        std::ostringstream os;
+        os.precision(unit ? 3 : 0);
+        os << std::fixed << v << " " << units[unit];
+        return os.str();
+    }
+
+    std::string humanTime(const double seconds)
+    {
+        const std::uint64_t s(static_cast<std::uint64_t>(seconds));
+        if (s < 60) return std::to_string(s) + "s";
+        if (s < 3600) return std::to_string(s / 60) + "m" +
+            std::to_string(s % 60) + "s";
+        return std::to_string(s / 3600) + "h" +
+            std::to_string(s / 60 % 60) + "m";
+    }
+
+    // Rewrites a line of progress on stderr.
+    void printProgress(const ProgressReport& r)
+    {
+        std::cerr << "\r" << r.files;
+        if (r.totalFiles) std::cerr << "/" << r.totalFiles;
+        std::cerr << " files, " << humanSize(r.bytes);
+        if (r.totalBytes) std::cerr << "/" << humanSize(r.totalBytes);
+        std::cerr << ", " << humanSize(static_cast<std::uint64_t>(
+                    r.throughput)) << "/s";
+        if (r.eta >= 0) std::cerr << ", ETA " << humanTime(r.eta);
+
+        const double idle(std::chrono::duration<double>(r.idle).count());
+        if (idle >= 10) std::cerr << ", stalled " << humanTime(idle);
+        std::cerr << "      " << std::flush;
+    }
+
+    // Flags of a command, like -l, are split from its other arguments.
+    bool takeFlag(std::vector<std::string>& args, const std::string& flag)
+    {
+        auto it(std::find(args.begin(), args.end(), flag));
+        if (it == args.end()) return false;
+        args.erase(it);
+        return true;
+    }
+
+    // As takeFlag, for a flag followed by a value, or empty if absent.
+    std::string takeValue(
+            std::vector<std::string>& args,
+            const std::string& flag)
+    {
+        auto it(std::find(args.begin(), args.end(), flag));
+        if (it == args.end()) return "";
+        if (it + 1 == args.end())
+        {
+            throw ArbiterError("Missing value for " + flag + "\n" + usage);
+        }
+        const std::string value(*(it + 1));
+        args.erase(it, it + 2);
+        return value;
+    }
+
+    void need(const std::vector<std::string>& args, std::size_t n)
+    {
+        if (args.size() < n) throw ArbiterError("Too few arguments\n" + usage);
+    }
+
+    int cp(
+            const Arbiter& a,
+            const std::vector<std::string>& args,
+            const Options& options)
+    {
+        need(args, 2);
+        const std::string& dst(args.back());
+        for (std::size_t i(0); i + 1 < args.size(); ++i)
+        {
+            a.copy(args[i], dst, options.verbose);
+        }
+        return 0;
+    }
+
+    int cat(
+            const Arbiter& a,
+            const std::vector<std::string>& args,
+            const Options& options)
+    {
+        need(args, 1);
+
+        // Blocks are read ahead in parallel up to the number of jobs.
+        json stream { { "blockSize", 8 * 1024 * 1024 } };
+        if (options.jobs) stream["readAhead"] = options.jobs;
+
+        // Bytes of remote files are counted as they are received.
+        Progress* progress(ProgressScope::current());
+
+        std::vector<char> buffer(1024 * 1024);
+        for (const std::string& path : args)
+        {
+            auto buf(a.getStreamBuf(path, stream.dump()));
+            if (progress) progress->expect(1, buf->size());
+
+            std::streamsize n(0);
+            while ((n = buf->sgetn(buffer.data(), buffer.size())) > 0)
+            {
+                std::cout.write(buffer.data(), n);
+                if (!std::cout) throw ArbiterError("Could not write stdout");
+                if (progress && a.isLocal(path)) progress->add(n);
+            }
+            if (progress) progress->fileDone();
+        }
+
+        std::cout.flush();
+        return 0;
+    }
+
+    int ls(const Arbiter& a, std::vector<std::string> args)
+    {
+        const bool details(takeFlag(args, "-l"));
+        const bool recursive(takeFlag(args, "-r"));
+        need(args, 1);
+
+        for (std::string path : args)
+        {
+            if (isDirectory(path)) path += recursive ? "**" : "*";
+
+            a.resolveInfo(path, [details](FileInfo info)
+            {
+                if (details)
+                {
+                    std::cout <<
+                        (info.hasSize ? std::to_string(info.size) : "-") <<
+                        "\t" <<
+                        (info.modified ?
+                            Time(static_cast<std::time_t>(info.modified))
+                                .str() :
+                            "-") <<
+                        "\t";
+                }
+                std::cout << info.path << "\n";
+            });
+        }
+
+        std::cout.flush();
+        return 0;
+    }
+
+    int du(const Arbiter& a, std::vector<std::string> args)
+    {
+        const bool human(takeFlag(args, "-h"));
+        need(args, 1);
+
+        for (const std::string& arg : args)
+        {
+            const std::string path(arg + (isDirectory(arg) ? "**" : ""));
+
+            std::uint64_t total(0);
+            std::size_t files(0);
+            std::vector<std::string> unsized;
+
+            a.resolveInfo(path, [&](FileInfo info)
+            {
+                ++files;
+                if (info.hasSize) total += info.size;
+                else unsized.push_back(info.path);
+            });
+
+            // Listings without sizes are filled in with concurrent lookups.
+            for (const auto& r : a.getSizeMany(unsized))
+            {
+                if (!r.ok()) std::rethrow_exception(r.error);
+                total += r.value;
+            }
+
+            std::cout << (human ? humanSize(total) : std::to_string(total)) <<
+                "\t" << files << " files\t" << arg << std::endl;
+        }
+
+        return 0;
+    }
+
+    int sync(
+            const Arbiter& a,
+            std::vector<std::string> args,
+            const Options& options)
+    {
+        const bool prune(takeFlag(args, "--delete"));
+        need(args, 2);
+
+        const SyncResult result(
+                a.sync(args[0], args[1], prune, options.verbose));
+
+        std::cout << "Copied " << result.copied << ", skipped " <<
+            result.skipped << ", removed " << result.removed << std::endl;
+        return 0;
+    }
+
+    // Runs until SIGINT or SIGTERM, which main blocks before any threads
+    // start so that only we receive them.
+#ifndef _WIN32
+    // The signals which stop serve.
+    sigset_t stopSignals()
+    {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        return signals;
+    }
+#endif
+
+    int serve(const Arbiter& a, const std::vector<std::string>& args)
+    {
+        need(args, 1);
+#ifndef _WIN32
+        const SidecarServer server(a, args[0]);
+        std::cerr << "Serving on " << server.path() << std::endl;
+
+        const sigset_t signals(stopSignals());
+        int signal(0);
+        sigwait(&signals, &signal);
+        std::cerr << "Served " << server.requests() << " requests" <<
+            std::endl;
+        return 0;
+#else
+        throw ArbiterError("serve is not available on Windows");
+#endif
+    }
+
+    int replay(const Arbiter& a, std::vector<std::string> args)
+    {
+        json config(json::object());
+        const std::string speed(takeValue(args, "--speed"));
+        const std::string threads(takeValue(args, "--threads"));
+        if (speed.size()) config["speed"] = std::stod(speed);
+        if (threads.size()) config["threads"] = std::stoul(threads);
+        need(args, 2);
+
+        const Replayer replayer(a, args[1], config.dump());
+        const ReplayResult r(replayer.replay(Recorder::parse(a.get(args[0]))));
+
+        const json result {
+            { "ops", r.ops },
+            { "failures", r.failures },
+            { "skipped", r.skipped },
+            { "threads", r.threads },
+            { "seconds", r.seconds },
+            { "latency", {
+                { "p50", r.p50 },
+                { "p90", r.p90 },
+                { "p99", r.p99 },
+                { "max", r.max } } },
+            { "lag", r.lag }
+        };
+        std::cout << result.dump(2) << std::endl;
+        return r.failures ? 1 : 0;
+    }
+
+    int run(
+            const std::string& command,
+            const std::vector<std::string>& args,
+            const Options& options)
+    {
+        json config(json::object());
+        if (options.config.size())
+        {
+            config = json::parse(drivers::Fs().get(options.config));
+        }
+        if (options.jobs)
+        {
+            config["threads"] = options.jobs;
+            config["http"]["concurrency"] = options.jobs;
+        }
+
+        Arbiter a(config.dump());
+
+        std::unique_ptr<Progress> progress;
+        if (options.progress)
+        {
+            progress.reset(new Progress(
+                        printProgress,
+                        std::chrono::milliseconds(500)));
+        }
+        ProgressScope scope(progress.get());
+
+        int result(0);
+        if (command == "cp") result = cp(a, args, options);
+        else if (command == "cat") result = cat(a, args, options);
+        else if (command == "ls") result = ls(a, args);
+        else if (command == "du") result = du(a, args);
+        else if (command == "sync") result = sync(a, args, options);
+        else if (command == "serve") result = serve(a, args);
+        else if (command == "replay") result = replay(a, args);
+        else throw ArbiterError("Unknown command: " + command + "\n" + usage);
+
+        if (progress)
+        {
+            printProgress(progress->report());
+            std::cerr << std::endl;
+        }
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::ios::sync_with_stdio(false);
+
+    Options options;
+    std::string command;
+    std::vector<std::string> args;
+
+    try
+    {
+        for (int i(1); i < argc; ++i)
+        {
+            const std::string arg(argv[i]);
+            const bool value(i + 1 < argc);
+
+            // Options come before the command, and flags of the command,
+            // like -l, after it.
+            if (command.size()) args.push_back(arg);
+            else if ((arg == "-c" || arg == "--config") && value)
+            {
+                options.config = argv[++i];
+            }
+            else if ((arg == "-j" || arg == "--jobs") && value)
+            {
+                options.jobs = std::stoul(argv[++i]);
+            }
+            else if (arg == "-p" || arg == "--progress")
+            {
+                options.progress = true;
+            }
+            else if (arg == "-v" || arg == "--verbose") options.verbose = true;
+            else if (arg == "-h" || arg == "--help")
+            {
+                std::cout << usage;
+                return 0;
+            }
+            else if (arg.size() > 1 && arg[0] == '-')
+            {
+                throw ArbiterError("Unknown option: " + arg + "\n" + usage);
+            }
+            else command = arg;
+        }
+
+        if (command.empty())
+        {
+            std::cerr << usage;
+            return 2;
+        }
+
+#ifndef _WIN32
+        // Threads inherit this mask, leaving the signals which stop a
+        // server to be waited for by serve.
+        if (command == "serve")
+        {
+            const sigset_t signals(stopSignals());
+            pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        }
+#endif
+
+        return run(command, args, options);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "arbiter: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,2328 @@
+#include "mock-server.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef ARBITER_ZLIB
+#include <zlib.h>
+#endif
+
+#include <arbiter/util/crc32c.hpp>
+#include <arbiter/util/credentials.hpp>
+#include <arbiter/util/json.hpp>
+#include <arbiter/util/md5.hpp>
+#include <arbiter/util/time.hpp>
+#include <arbiter/util/transforms.hpp>
+
+namespace
+{
+    using Headers = std::map<std::string, std::string>;
+
+    std::string toLower(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+        return s;
+    }
+
+    std::string trim(const std::string& s)
+    {
+        const std::size_t begin(s.find_first_not_of(" \t"));
+        if (begin == std::string::npos) return "";
+        return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+    }
+
+    std::string decode(const std::string& s)
+    {
+        std::string out;
+        out.reserve(s.size());
+
+        for (std::size_t i(0); i < s.size(); ++i)
+        {
+            if (s[i] == '%' && i + 2 < s.size())
+            {
+                const std::string hex(s.substr(i + 1, 2));
+                const unsigned long c(std::strtoul(hex.c_str(), nullptr, 16));
+                out.push_back(static_cast<char>(c));
+                i += 2;
+            }
+            else out.push_back(s[i]);
+        }
+
+        return out;
+    }
+
+    // The parameters of the query string @p s, without its '?'.
+    Headers parseQuery(const std::string& s)
+    {
+        Headers query;
+        std::size_t pos(0);
+        while (pos <= s.size())
+        {
+            std::size_t amp(s.find('&', pos));
+            if (amp == std::string::npos) amp = s.size();
+            const std::string kv(s.substr(pos, amp - pos));
+            const std::size_t eq(kv.find('='));
+            if (kv.size())
+            {
+                std::string& v(query[decode(kv.substr(0, eq))]);
+                if (eq != std::string::npos) v = decode(kv.substr(eq + 1));
+            }
+            pos = amp + 1;
+        }
+        return query;
+    }
+
+    // The headers of the lines of @p head which follow @p pos, the position
+    // of the line break ending its request line, with lowercase names.
+    Headers parseHeaders(const std::string& head, std::size_t pos)
+    {
+        Headers headers;
+        while (pos != std::string::npos)
+        {
+            const std::size_t next(head.find("\r\n", pos + 2));
+            const std::string h(head.substr(pos + 2, next - pos - 2));
+            const std::size_t colon(h.find(':'));
+            if (colon != std::string::npos)
+            {
+                headers[toLower(h.substr(0, colon))] =
+                    trim(h.substr(colon + 1));
+            }
+            pos = next;
+        }
+        return headers;
+    }
+
+#ifdef ARBITER_ZLIB
+    std::string gzip(const std::string& s)
+    {
+        z_stream z;
+        std::memset(&z, 0, sizeof(z));
+        if (deflateInit2(&z, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY))
+        {
+            throw std::runtime_error("Could not initialize compression");
+        }
+
+        std::string out(deflateBound(&z, s.size()), '\0');
+        z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(s.data()));
+        z.avail_in = static_cast<uInt>(s.size());
+        z.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        z.avail_out = static_cast<uInt>(out.size());
+
+        const int code(deflate(&z, Z_FINISH));
+        out.resize(z.total_out);
+        deflateEnd(&z);
+
+        if (code != Z_STREAM_END)
+        {
+            throw std::runtime_error("Could not compress");
+        }
+        return out;
+    }
+#endif
+
+    std::string escape(const std::string& s)
+    {
+        std::string out;
+        for (const char c : s)
+        {
+            if (c == '&') out += "&amp;";
+            else if (c == '<') out += "&lt;";
+            else if (c == '>') out += "&gt;";
+            else out.push_back(c);
+        }
+        return out;
+    }
+
+    std::string unescape(std::string s)
+    {
+        const std::vector<std::pair<std::string, std::string>> entities {
+            { "&lt;", "<" }, { "&gt;", ">" }, { "&quot;", "\"" },
+            { "&apos;", "'" }, { "&amp;", "&" }
+        };
+
+        for (const auto& entity : entities)
+        {
+            std::size_t pos(0);
+            while ((pos = s.find(entity.first, pos)) != std::string::npos)
+            {
+                s.replace(pos, entity.first.size(), entity.second);
+                pos += entity.second.size();
+            }
+        }
+        return s;
+    }
+
+    std::string etagOf(const std::vector<char>& data)
+    {
+        const std::string raw(data.data(), data.size());
+        return '"' + arbiter::crypto::encodeAsHex(arbiter::crypto::md5(raw)) +
+            '"';
+    }
+
+    std::string reason(const int code)
+    {
+        switch (code)
+        {
+            case 100: return "Continue";
+            case 200: return "OK";
+            case 204: return "No Content";
+            case 206: return "Partial Content";
+            case 304: return "Not Modified";
+            case 308: return "Resume Incomplete";
+            case 400: return "Bad Request";
+            case 401: return "Unauthorized";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 412: return "Precondition Failed";
+            case 416: return "Range Not Satisfiable";
+            case 500: return "Internal Server Error";
+            case 503: return "Service Unavailable";
+            default: return "Unknown";
+        }
+    }
+
+    // S3 event notifications URL-encode their keys, with spaces as '+'.
+    std::string eventKey(const std::string& key)
+    {
+        static const char hex[] = "0123456789ABCDEF";
+        const std::string unreserved("-_.~/");
+
+        std::string out;
+        for (const char c : key)
+        {
+            const unsigned char u(static_cast<unsigned char>(c));
+            if (std::isalnum(u) || unreserved.find(c) != std::string::npos)
+            {
+                out += c;
+            }
+            else if (c == ' ') out += '+';
+            else
+            {
+                out += '%';
+                out += hex[u >> 4];
+                out += hex[u & 0xf];
+            }
+        }
+        return out;
+    }
+
+    // The JSON body of a GCS error.
+    std::string gcsError(const int code, const std::string& message)
+    {
+        return arbiter::json {
+            { "error", { { "code", code }, { "message", message } } }
+        }.dump();
+    }
+
+    // The metadata of a GCS object, whose sizes are strings.
+    arbiter::json gcsResource(
+            const std::string& bucket,
+            const std::string& name,
+            const std::size_t size,
+            const std::string& etag,
+            const std::string& updated)
+    {
+        return arbiter::json {
+            { "kind", "storage#object" },
+            { "bucket", bucket },
+            { "name", name },
+            { "size", std::to_string(size) },
+            { "etag", etag },
+            { "updated", updated }
+        };
+    }
+
+    // The components of the path @p s, split at its slashes and decoded.
+    std::vector<std::string> segments(const std::string& s)
+    {
+        std::vector<std::string> out;
+        std::size_t pos(0);
+        while (true)
+        {
+            const std::size_t slash(s.find('/', pos));
+            out.push_back(decode(s.substr(pos, slash - pos)));
+            if (slash == std::string::npos) return out;
+            pos = slash + 1;
+        }
+    }
+
+    std::string error(const std::string& code)
+    {
+        return "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+            "<Error><Code>" + code + "</Code></Error>";
+    }
+
+    // The text of the first <tag> element of @p xml, or an empty string.
+    std::string element(const std::string& xml, const std::string& tag)
+    {
+        const std::string open("<" + tag + ">");
+        const std::size_t begin(xml.find(open));
+        if (begin == std::string::npos) return "";
+
+        const std::size_t start(begin + open.size());
+        const std::size_t end(xml.find("</" + tag + ">", start));
+        if (end == std::string::npos) return "";
+        return xml.substr(start, end - start);
+    }
+
+    // A message of an AWS event stream with string-valued @p headers.  Its
+    // CRCs are left zero, since drivers::S3 does not check them.
+    std::string eventMessage(
+            const std::vector<std::pair<std::string, std::string>>& headers,
+            const std::string& payload)
+    {
+        std::string encoded;
+        for (const auto& h : headers)
+        {
+            encoded.push_back(static_cast<char>(h.first.size()));
+            encoded += h.first;
+            encoded.push_back(7);
+            encoded.push_back(static_cast<char>(h.second.size() >> 8));
+            encoded.push_back(static_cast<char>(h.second.size() & 0xff));
+            encoded += h.second;
+        }
+
+        std::string message;
+        auto append([&message](const std::size_t v)
+        {
+            for (int shift(24); shift >= 0; shift -= 8)
+            {
+                message.push_back(static_cast<char>((v >> shift) & 0xff));
+            }
+        });
+
+        append(12 + encoded.size() + payload.size() + 4);
+        append(encoded.size());
+        append(0);
+        message += encoded + payload;
+        append(0);
+        return message;
+    }
+
+    std::string event(const std::string& type, const std::string& payload)
+    {
+        return eventMessage(
+                {
+                    { ":message-type", "event" },
+                    { ":event-type", type },
+                    { ":content-type", "application/octet-stream" }
+                },
+                payload);
+    }
+
+    // The region of the credential scope of a SigV4 Authorization header,
+    // or of the Credential= of a presigned query, or us-east-1 if the
+    // request is unsigned.
+    std::string signedRegion(const std::string& authorization)
+    {
+        const std::string credential("Credential=");
+        const std::size_t pos(authorization.find(credential));
+        if (pos == std::string::npos) return "us-east-1";
+
+        // The scope is <access>/<date>/<region>/s3/aws4_request.
+        std::size_t begin(pos + credential.size());
+        for (int i(0); i < 2; ++i) begin = authorization.find('/', begin) + 1;
+        return authorization.substr(
+                begin,
+                authorization.find('/', begin) - begin);
+    }
+
+    bool sendAll(const int fd, const char* data, std::size_t size)
+    {
+        while (size)
+        {
+            const ssize_t n(::send(fd, data, size, MSG_NOSIGNAL));
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // Parse a single range of an object of @p size bytes, as "bytes=a-b",
+    // "bytes=a-", or "bytes=-n", into [begin, end).
+    bool parseRange(
+            const std::string& range,
+            const std::size_t size,
+            std::size_t& begin,
+            std::size_t& end)
+    {
+        const std::string prefix("bytes=");
+        const std::size_t dash(range.find('-'));
+        if (range.compare(0, prefix.size(), prefix) ||
+            dash == std::string::npos)
+        {
+            return false;
+        }
+
+        const std::string first(
+                range.substr(prefix.size(), dash - prefix.size()));
+        const std::string last(range.substr(dash + 1));
+
+        begin = 0;
+        end = size;
+
+        if (first.empty())
+        {
+            const std::size_t n(std::stoul(last));
+            begin = size - std::min(n, size);
+        }
+        else
+        {
+            begin = std::stoul(first);
+            if (last.size()) end = std::min(std::stoul(last) + 1, size);
+        }
+
+        return begin < end;
+    }
+}
+
+struct MockServer::Request
+{
+    std::string method;
+    std::string bucket;
+    std::string key;
+
+    // The path of the target, without its leading slash, as sent.
+    std::string path;
+
+    Headers query;
+    Headers headers;
+    std::vector<char> body;
+
+    bool has(const std::string& q) const { return query.count(q) > 0; }
+
+    std::string param(const std::string& q) const
+    {
+        auto it(query.find(q));
+        return it == query.end() ? "" : it->second;
+    }
+
+    std::string header(const std::string& name) const
+    {
+        auto it(headers.find(name));
+        return it == headers.end() ? "" : it->second;
+    }
+};
+
+struct MockServer::Stored
+{
+    Stored(
+            std::vector<char> data,
+            std::string etag,
+            std::string encoding = "",
+            std::vector<std::size_t> parts = std::vector<std::size_t>())
+        : data(std::move(data))
+        , etag(std::move(etag))
+        , encoding(std::move(encoding))
+        , modified(arbiter::Time().str("%Y-%m-%dT%H:%M:%S.000Z"))
+        , parts(std::move(parts))
+    { }
+
+    const std::vector<char> data;
+    const std::string etag;
+    const std::string encoding;
+    const std::string modified;
+
+    // The sizes of the parts of a multipart upload, or empty for an object
+    // uploaded whole.
+    const std::vector<std::size_t> parts;
+};
+
+struct MockServer::Upload
+{
+    std::string bucket;
+    std::string key;
+    std::map<int, Object> parts;
+
+    // If set, every part listed by the completion carries its checksum.
+    bool checksummed = false;
+};
+
+struct MockServer::Resumable
+{
+    std::string bucket;
+    std::string name;
+    std::size_t total = 0;
+    std::vector<char> data;
+
+    // The X-Goog-Hash of the upload, if given when it was initiated, or by
+    // its final chunk.
+    std::string hash;
+};
+
+struct MockServer::Reply
+{
+    Reply(
+            const int code,
+            std::string body = "",
+            Headers headers = Headers {
+                { "Content-Type", "application/json" }
+            })
+        : code(code)
+        , body(std::move(body))
+        , headers(std::move(headers))
+    { }
+
+    int code;
+    std::string body;
+    Headers headers;
+};
+
+MockServer::MockServer() : MockServer(Options()) { }
+
+MockServer::MockServer(const Options options)
+    : m_listener(::socket(AF_INET, SOCK_STREAM, 0))
+    , m_options(options)
+    , m_random(options.seed)
+{
+    m_done = false;
+    m_requests = 0;
+    m_errors = 0;
+    m_accepted = 0;
+    m_notModified = 0;
+    m_continued = 0;
+    m_misdirected = 0;
+    m_sessions = 0;
+    m_checksummed = 0;
+    m_proxied = 0;
+    m_multipartUploads = 0;
+    m_parts = 0;
+    m_chunks = 0;
+    m_composed = 0;
+    m_rewrites = 0;
+    m_batches = 0;
+    m_compressed = 0;
+    m_truncated = 0;
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    socklen_t len(sizeof(addr));
+    if (m_listener < 0 ||
+            ::bind(m_listener, (sockaddr*)&addr, sizeof(addr)) ||
+            ::listen(m_listener, 128) ||
+            ::getsockname(m_listener, (sockaddr*)&addr, &len))
+    {
+        if (m_listener >= 0) ::close(m_listener);
+        throw std::runtime_error("Could not start the mock server");
+    }
+
+    m_port = ntohs(addr.sin_port);
+    m_thread = std::thread([this]() { accept(); });
+}
+
+MockServer::~MockServer()
+{
+    m_done = true;
+    ::shutdown(m_listener, SHUT_RDWR);
+    m_thread.join();
+    ::close(m_listener);
+
+    // Wake connections waiting for their next request, and wait for them to
+    // close.
+    std::unique_lock<std::mutex> lock(m_connectionsMutex);
+    for (const int fd : m_connections) ::shutdown(fd, SHUT_RDWR);
+    m_connectionsCv.wait(lock, [this]() { return m_connections.empty(); });
+}
+
+void MockServer::options(const Options options)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_options = options;
+    m_random.seed(options.seed);
+}
+
+std::set<std::string> MockServer::hosts() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hosts;
+}
+
+std::size_t MockServer::unacknowledged() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_received.size();
+}
+
+std::size_t MockServer::openUploads() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_uploads.size();
+}
+
+std::string MockServer::httpRoot() const
+{
+    return "http://127.0.0.1:" + std::to_string(m_port) + "/";
+}
+
+std::string MockServer::s3Config() const
+{
+    // Curl resolves subdomains of localhost to the loopback address, so
+    // virtual-hosted requests reach this server.
+    return arbiter::json {
+        { "access", "mock" },
+        { "secret", "mock" },
+        { "region", "us-east-1" },
+        { "endpoint", "localhost:" + std::to_string(m_port) }
+    }.dump();
+}
+
+std::string MockServer::gcsConfig(const std::string& cache) const
+{
+    const std::string email("mock@arbiter.iam.gserviceaccount.com");
+    const std::string key("mock");
+    const std::string scope(
+            "https://www.googleapis.com/auth/devstorage.read_write");
+
+    // As keyed by Google::Auth.
+    arbiter::CredentialCache(cache).put(
+            "gs:" + email + "\n" + scope + "\n" + key,
+            "mock-token",
+            std::time(nullptr) + 3600);
+
+    return arbiter::json {
+        { "client_email", email },
+        { "private_key", key },
+        { "credentialCache", cache },
+        { "endpoint", httpRoot() }
+    }.dump();
+}
+
+void MockServer::accept()
+{
+    while (true)
+    {
+        const int fd(::accept(m_listener, nullptr, nullptr));
+        if (m_done) return;
+        if (fd < 0) continue;
+
+        const int one(1);
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        ++m_accepted;
+
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        m_connections.insert(fd);
+        std::thread([this, fd]()
+        {
+            serve(fd);
+
+            std::lock_guard<std::mutex> lock(m_connectionsMutex);
+            ::close(fd);
+            m_connections.erase(fd);
+            m_connectionsCv.notify_all();
+        }).detach();
+    }
+}
+
+void MockServer::serve(const int fd)
+{
+    std::string buffer;
+    std::vector<char> chunk(64 * 1024);
+
+    auto fill([&]()
+    {
+        const ssize_t n(::recv(fd, chunk.data(), chunk.size(), 0));
+        if (n <= 0) return false;
+        buffer.append(chunk.data(), n);
+        return true;
+    });
+
+    // Read until @p s appears in the buffer, setting @p pos to its position.
+    auto await([&](const std::string& s, std::size_t& pos)
+    {
+        while ((pos = buffer.find(s)) == std::string::npos)
+        {
+            if (!fill()) return false;
+        }
+        return true;
+    });
+
+    while (true)
+    {
+        std::size_t end;
+        if (!await("\r\n\r\n", end)) return;
+
+        const std::string head(buffer.substr(0, end));
+        buffer.erase(0, end + 4);
+
+        Request req;
+
+        std::size_t lineEnd(head.find("\r\n"));
+        const std::string line(head.substr(0, lineEnd));
+        const std::size_t sp(line.find(' '));
+        req.method = line.substr(0, sp);
+        std::string target(
+                line.substr(sp + 1, line.find(' ', sp + 1) - sp - 1));
+
+        // Requests sent to us as a proxy name their whole URL, and are
+        // served as though they were sent directly.
+        if (target.compare(0, 7, "http://") == 0)
+        {
+            ++m_proxied;
+            const std::size_t slash(target.find('/', 7));
+            target = slash != std::string::npos ? target.substr(slash) : "/";
+        }
+
+        req.headers = parseHeaders(head, lineEnd);
+
+        const std::size_t qpos(target.find('?'));
+        req.path = target.substr(1, qpos - 1);
+        req.key = decode(req.path);
+        if (qpos != std::string::npos)
+        {
+            req.query = parseQuery(target.substr(qpos + 1));
+        }
+
+        // Virtual-hosted requests name their bucket by the first label of
+        // their host.
+        std::string host(req.header("host"));
+        host = host.substr(0, host.find(':'));
+        const std::string suffix(".localhost");
+        if (host.size() > suffix.size() &&
+                host.compare(host.size() - suffix.size(), suffix.size(), suffix)
+                    == 0)
+        {
+            req.bucket = host.substr(0, host.find('.'));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_hosts.insert(host);
+        }
+
+        if (toLower(req.header("expect")) == "100-continue")
+        {
+            ++m_continued;
+            const std::string cont("HTTP/1.1 100 Continue\r\n\r\n");
+            if (!sendAll(fd, cont.data(), cont.size())) return;
+        }
+
+        if (toLower(req.header("transfer-encoding")) == "chunked")
+        {
+            while (true)
+            {
+                std::size_t pos;
+                if (!await("\r\n", pos)) return;
+                const std::string line(buffer.substr(0, pos));
+                const std::size_t size(std::strtoul(line.c_str(), nullptr, 16));
+                buffer.erase(0, pos + 2);
+
+                if (!size)
+                {
+                    if (!await("\r\n", pos)) return;
+                    buffer.erase(0, pos + 2);
+                    break;
+                }
+
+                while (buffer.size() < size + 2) if (!fill()) return;
+                req.body.insert(
+                        req.body.end(),
+                        buffer.begin(),
+                        buffer.begin() + size);
+                buffer.erase(0, size + 2);
+            }
+        }
+        else
+        {
+            const std::string length(req.header("content-length"));
+            const std::size_t size(
+                    length.size() ? std::stoul(length) : 0);
+
+            while (buffer.size() < size) if (!fill()) return;
+            req.body.assign(buffer.begin(), buffer.begin() + size);
+            buffer.erase(0, size);
+        }
+
+        if (!handle(fd, req)) return;
+    }
+}
+
+bool MockServer::handle(const int fd, const Request& req)
+{
+    ++m_requests;
+
+    Options options;
+    bool fail(false);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        options = m_options;
+        if (options.errorRate > 0)
+        {
+            std::uniform_real_distribution<double> dist(0, 1);
+            fail = dist(m_random) < options.errorRate;
+        }
+    }
+
+    if (options.latency.count()) std::this_thread::sleep_for(options.latency);
+
+    if (fail)
+    {
+        ++m_errors;
+        return respond(fd, 503, error("SlowDown"), req.method == "HEAD");
+    }
+
+    // Requests of the GCS JSON API are told apart by their paths.
+    const std::string& path(req.path);
+    if (!path.compare(0, 13, "storage/v1/b/") ||
+            !path.compare(0, 20, "upload/storage/v1/b/") ||
+            path == "batch/storage/v1")
+    {
+        const bool head(req.method == "HEAD");
+        if (req.header("authorization").compare(0, 7, "Bearer "))
+        {
+            const std::string body(gcsError(401, "Unauthorized"));
+            return respond(fd, 401, Headers(), body.data(), body.size(), head);
+        }
+
+        const Reply reply(gcs(req));
+        return respond(
+                fd,
+                reply.code,
+                reply.headers,
+                reply.body.data(),
+                reply.body.size(),
+                head);
+    }
+
+    // Presigned requests carry their credentials in their queries, and are
+    // refused once they expire.
+    const bool presigned(req.has("X-Amz-Credential"));
+    const std::string authorization(
+            presigned ?
+                "Credential=" + req.param("X-Amz-Credential") :
+                req.header("authorization"));
+
+    if (presigned)
+    {
+        const arbiter::Time signedAt(
+                req.param("X-Amz-Date"),
+                "%Y%m%dT%H%M%SZ");
+        if (arbiter::Time() - signedAt >
+                std::stoll(req.param("X-Amz-Expires")))
+        {
+            return respond(
+                    fd,
+                    403,
+                    error("AccessDenied"),
+                    req.method == "HEAD");
+        }
+    }
+
+    const auto located(options.regions.find(req.bucket));
+    const std::string region(
+            located != options.regions.end() ? located->second : "us-east-1");
+    if (signedRegion(authorization) != region)
+    {
+        ++m_misdirected;
+        const std::string body(error("AuthorizationHeaderMalformed"));
+        const Headers headers {
+            { "Content-Type", "application/xml" },
+            { "x-amz-bucket-region", region }
+        };
+        return respond(
+                fd,
+                400,
+                headers,
+                body.data(),
+                body.size(),
+                req.method == "HEAD");
+    }
+
+    // Directory buckets are accessed with the tokens of their sessions,
+    // which are created with credentials for the s3express service.
+    const std::string directory("--x-s3");
+    if (req.bucket.size() > directory.size() &&
+            req.bucket.compare(
+                req.bucket.size() - directory.size(),
+                directory.size(),
+                directory) == 0)
+    {
+        const bool head(req.method == "HEAD");
+        if (authorization.find("/s3express/") == std::string::npos)
+        {
+            return respond(fd, 403, error("AccessDenied"), head);
+        }
+
+        if (req.method == "GET" && req.has("session"))
+        {
+            return createSession(fd, req);
+        }
+
+        const std::string token(
+                presigned ?
+                    req.param("X-Amz-S3session-Token") :
+                    req.header("x-amz-s3session-token"));
+
+        bool valid(false);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            valid = m_tokens.count(token) > 0;
+        }
+        if (!valid) return respond(fd, 403, error("AccessDenied"), head);
+    }
+
+    // SQS actions of the JSON protocol are named by a header.
+    const std::string target(req.header("x-amz-target"));
+    const std::string sqsPrefix("AmazonSQS.");
+    if (target.compare(0, sqsPrefix.size(), sqsPrefix) == 0)
+    {
+        return sqs(fd, req, target.substr(sqsPrefix.size()));
+    }
+
+    if (req.method == "GET")
+    {
+        if (req.has("list-type")) return list(fd, req);
+        return get(fd, req, false);
+    }
+    if (req.method == "HEAD")
+    {
+        if (options.rejectHead) return respond(fd, 405, Headers(), nullptr, 0);
+        return get(fd, req, true);
+    }
+    if (req.method == "PUT") return put(fd, req);
+    if (req.method == "POST") return post(fd, req);
+    if (req.method == "DELETE") return del(fd, req);
+
+    return respond(fd, 400, error("NotImplemented"));
+}
+
+bool MockServer::get(const int fd, const Request& req, const bool head)
+{
+    Object object;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto& objects(m_objects[req.bucket]);
+        auto it(objects.find(req.key));
+        if (it != objects.end()) object = it->second;
+    }
+
+    // The body of a response to a HEAD is left unsent, or it would be read
+    // as the start of the next response on this connection.
+    if (!object) return respond(fd, 404, error("NoSuchKey"), head);
+
+    const std::size_t size(object->data.size());
+    Headers headers { { "ETag", object->etag } };
+    if (object->encoding.size())
+    {
+        headers["Content-Encoding"] = object->encoding;
+    }
+
+    if (req.header("if-none-match") == object->etag)
+    {
+        ++m_notModified;
+        return respond(fd, 304, headers, nullptr, 0, head);
+    }
+
+    const std::string match(req.header("if-match"));
+    if (match.size() && match != object->etag)
+    {
+        return respond(fd, 412, error("PreconditionFailed"), head);
+    }
+
+    std::size_t truncate(0);
+    bool multiRange(false);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        truncate = m_options.truncate;
+        multiRange = m_options.multiRange;
+    }
+
+    // Promise the whole body, but hang up partway through it.
+    auto send([&](const int code, const char* body, const std::size_t n)
+    {
+        if (head || !truncate || n <= truncate)
+        {
+            return respond(fd, code, headers, body, n, head);
+        }
+
+        std::string out(
+                "HTTP/1.1 " + std::to_string(code) + " " + reason(code) +
+                "\r\n");
+        for (const auto& h : headers) out += h.first + ": " + h.second + "\r\n";
+        out += "Content-Length: " + std::to_string(n) + "\r\n\r\n";
+
+        ++m_truncated;
+        sendAll(fd, out.data(), out.size());
+        sendAll(fd, body, truncate);
+        return false;
+    });
+
+    // As by S3, a part of a multipart object may be read by its number,
+    // with the number of parts.  Other objects are a single part.
+    if (req.has("partNumber"))
+    {
+        const std::size_t number(std::atoi(req.param("partNumber").c_str()));
+        const std::size_t parts(
+                (std::max<std::size_t>)(object->parts.size(), 1));
+        if (!number || number > parts)
+        {
+            return respond(fd, 416, error("InvalidPartNumber"), head);
+        }
+
+        if (object->parts.empty()) return send(200, object->data.data(), size);
+
+        std::size_t begin(0);
+        for (std::size_t i(1); i < number; ++i) begin += object->parts[i - 1];
+        const std::size_t end(begin + object->parts[number - 1]);
+
+        headers["x-amz-mp-parts-count"] = std::to_string(parts);
+        headers["Content-Range"] =
+            "bytes " + std::to_string(begin) + "-" + std::to_string(end - 1) +
+            "/" + std::to_string(size);
+        return send(206, object->data.data() + begin, end - begin);
+    }
+
+    const std::string range(req.header("range"));
+    if (range.empty()) return send(200, object->data.data(), size);
+
+    if (range.find(',') != std::string::npos)
+    {
+        if (!multiRange) return send(200, object->data.data(), size);
+
+        // Each satisfiable range is a part of its own.
+        const std::string boundary("mock-byteranges");
+        std::string body;
+        std::size_t pos(std::string("bytes=").size());
+        while (pos <= range.size())
+        {
+            std::size_t comma(range.find(',', pos));
+            if (comma == std::string::npos) comma = range.size();
+
+            std::size_t begin(0);
+            std::size_t end(size);
+            if (parseRange(
+                        "bytes=" + range.substr(pos, comma - pos),
+                        size,
+                        begin,
+                        end))
+            {
+                body +=
+                    "--" + boundary + "\r\n" +
+                    "Content-Type: application/octet-stream\r\n" +
+                    "Content-Range: bytes " + std::to_string(begin) + "-" +
+                    std::to_string(end - 1) + "/" + std::to_string(size) +
+                    "\r\n\r\n";
+                body.append(object->data.data() + begin, end - begin);
+                body += "\r\n";
+            }
+            pos = comma + 1;
+        }
+
+        if (body.empty())
+        {
+            headers["Content-Range"] = "bytes */" + std::to_string(size);
+            return respond(fd, 416, headers, nullptr, 0, head);
+        }
+
+        body += "--" + boundary + "--\r\n";
+        headers["Content-Type"] = "multipart/byteranges; boundary=" + boundary;
+        return send(206, body.data(), body.size());
+    }
+
+    std::size_t begin(0);
+    std::size_t end(size);
+    if (!parseRange(range, size, begin, end))
+    {
+        const std::string body(error("InvalidRange"));
+        headers["Content-Type"] = "application/xml";
+        headers["Content-Range"] = "bytes */" + std::to_string(size);
+        return respond(fd, 416, headers, body.data(), body.size(), head);
+    }
+
+    headers["Content-Range"] =
+        "bytes " + std::to_string(begin) + "-" + std::to_string(end - 1) +
+        "/" + std::to_string(size);
+
+    return send(206, object->data.data() + begin, end - begin);
+}
+
+bool MockServer::put(const int fd, const Request& req)
+{
+    // Copies, of whole objects or of ranges of them into parts, read from
+    // the object named by x-amz-copy-source.
+    Object source;
+    const std::string copySource(decode(req.header("x-amz-copy-source")));
+    if (copySource.size())
+    {
+        const std::size_t start(copySource[0] == '/' ? 1 : 0);
+        const std::size_t slash(copySource.find('/', start));
+        const std::string bucket(copySource.substr(start, slash - start));
+        const std::string key(
+                slash == std::string::npos ? "" : copySource.substr(slash + 1));
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const auto& objects(m_objects[bucket]);
+            auto it(objects.find(key));
+            if (it != objects.end()) source = it->second;
+        }
+
+        if (!source) return respond(fd, 404, error("NoSuchKey"));
+    }
+
+    const std::string crc(req.header("x-amz-checksum-crc32c"));
+    if (crc.size())
+    {
+        arbiter::crypto::Crc32c expected;
+        expected.update(req.body);
+        if (crc != arbiter::crypto::encodeBase64(expected.finalize()))
+        {
+            return respond(fd, 400, error("BadDigest"));
+        }
+        ++m_checksummed;
+    }
+
+    if (req.has("uploadId"))
+    {
+        const int number(std::atoi(req.param("partNumber").c_str()));
+        ++m_parts;
+
+        bool failed(false);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it(m_options.partFailures.find(number));
+            if (it != m_options.partFailures.end() && it->second)
+            {
+                --it->second;
+                failed = true;
+            }
+        }
+        if (failed) return respond(fd, 500, error("InternalError"));
+
+        Object part(std::make_shared<Stored>(req.body, etagOf(req.body)));
+
+        if (source)
+        {
+            const std::vector<char>& data(source->data);
+            std::size_t begin(0);
+            std::size_t end(data.size());
+
+            const std::string range(req.header("x-amz-copy-source-range"));
+            if (range.size() && !parseRange(range, data.size(), begin, end))
+            {
+                return respond(fd, 416, error("InvalidRange"));
+            }
+
+            const std::vector<char> copied(
+                    data.begin() + begin,
+                    data.begin() + end);
+            part = std::make_shared<Stored>(copied, etagOf(copied));
+        }
+
+        bool found(false);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it(m_uploads.find(req.param("uploadId")));
+            if (it != m_uploads.end() && number > 0)
+            {
+                it->second->parts[number] = part;
+                found = true;
+            }
+        }
+
+        if (!found) return respond(fd, 404, error("NoSuchUpload"));
+
+        if (source)
+        {
+            return respond(
+                    fd,
+                    200,
+                    "<CopyPartResult><ETag>" + escape(part->etag) +
+                    "</ETag></CopyPartResult>");
+        }
+
+        return respond(fd, 200, { { "ETag", part->etag } });
+    }
+
+    const Object object(source ?
+            source :
+            std::make_shared<Stored>(
+                req.body,
+                etagOf(req.body),
+                req.header("content-encoding")));
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_objects[req.bucket][req.key] = object;
+        notify(req.bucket, req.key, object);
+    }
+
+    if (source)
+    {
+        return respond(
+                fd,
+                200,
+                "<CopyObjectResult><ETag>" + escape(object->etag) +
+                "</ETag></CopyObjectResult>");
+    }
+
+    return respond(fd, 200, { { "ETag", object->etag } });
+}
+
+bool MockServer::post(const int fd, const Request& req)
+{
+    if (req.has("delete")) return deleteObjects(fd, req);
+    if (req.has("select")) return select(fd, req);
+
+    if (req.has("uploads"))
+    {
+        ++m_multipartUploads;
+        std::string id;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            id = std::to_string(++m_nextUpload);
+            std::unique_ptr<Upload> upload(new Upload());
+            upload->bucket = req.bucket;
+            upload->key = req.key;
+            upload->checksummed =
+                req.header("x-amz-checksum-algorithm") == "CRC32C";
+            m_uploads[id] = std::move(upload);
+        }
+
+        return respond(
+                fd,
+                200,
+                "<InitiateMultipartUploadResult>"
+                "<Bucket>" + escape(req.bucket) + "</Bucket>"
+                "<Key>" + escape(req.key) + "</Key>"
+                "<UploadId>" + id + "</UploadId>"
+                "</InitiateMultipartUploadResult>");
+    }
+
+    if (!req.has("uploadId")) return respond(fd, 400, error("NotImplemented"));
+
+    // Assemble the parts in the order listed by the completion request.
+    const std::string body(req.body.begin(), req.body.end());
+    const std::string open("<PartNumber>");
+
+    std::string etag;
+    std::string failure;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it(m_uploads.find(req.param("uploadId")));
+        if (it == m_uploads.end()) failure = "NoSuchUpload";
+        else
+        {
+            const Upload& upload(*it->second);
+            std::vector<char> data;
+            std::vector<std::size_t> sizes;
+            std::string digests;
+            std::size_t count(0);
+
+            for (
+                    std::size_t pos(body.find(open));
+                    pos != std::string::npos && failure.empty();
+                    pos = body.find(open, pos + 1))
+            {
+                const int number(std::atoi(body.c_str() + pos + open.size()));
+                auto part(upload.parts.find(number));
+                if (part == upload.parts.end())
+                {
+                    failure = "InvalidPart";
+                    break;
+                }
+
+                const std::vector<char>& bytes(part->second->data);
+                data.insert(data.end(), bytes.begin(), bytes.end());
+                sizes.push_back(bytes.size());
+                digests += arbiter::crypto::md5(
+                        std::string(bytes.data(), bytes.size()));
+                ++count;
+            }
+
+            const std::string checksum("<ChecksumCRC32C>");
+            std::size_t checksums(0);
+            for (
+                    std::size_t pos(body.find(checksum));
+                    pos != std::string::npos;
+                    pos = body.find(checksum, pos + 1))
+            {
+                ++checksums;
+            }
+
+            if (failure.empty() && upload.checksummed && checksums != count)
+            {
+                failure = "InvalidRequest";
+            }
+
+            if (failure.empty())
+            {
+                // Multipart ETags are digests of the digests of the parts,
+                // not of the whole object.
+                etag = etagOf(std::vector<char>(
+                            digests.begin(),
+                            digests.end()));
+                etag.insert(etag.size() - 1, "-" + std::to_string(count));
+
+                const Object object(
+                        std::make_shared<Stored>(
+                            std::move(data),
+                            etag,
+                            "",
+                            std::move(sizes)));
+                m_objects[upload.bucket][upload.key] = object;
+                notify(upload.bucket, upload.key, object);
+                m_uploads.erase(it);
+            }
+        }
+    }
+
+    if (failure == "NoSuchUpload") return respond(fd, 404, error(failure));
+    if (failure.size()) return respond(fd, 400, error(failure));
+
+    return respond(
+            fd,
+            200,
+            "<CompleteMultipartUploadResult><ETag>" + escape(etag) +
+            "</ETag></CompleteMultipartUploadResult>");
+}
+
+bool MockServer::del(const int fd, const Request& req)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (req.has("uploadId")) m_uploads.erase(req.param("uploadId"));
+        else if (m_objects[req.bucket].erase(req.key))
+        {
+            notify(req.bucket, req.key, Object());
+        }
+    }
+
+    return respond(fd, 204, Headers());
+}
+
+void MockServer::notify(
+        const std::string& bucket,
+        const std::string& key,
+        const Object& object)
+{
+    if (!m_options.notifications) return;
+
+    arbiter::json record {
+        { "eventSource", "aws:s3" },
+        { "eventName", object ? "ObjectCreated:Put" : "ObjectRemoved:Delete" },
+        { "s3", {
+            { "bucket", { { "name", bucket } } },
+            { "object", { { "key", eventKey(key) } } }
+        } }
+    };
+
+    if (object)
+    {
+        // Event ETags are unquoted.
+        arbiter::json& o(record["s3"]["object"]);
+        o["size"] = object->data.size();
+        o["eTag"] = object->etag.substr(1, object->etag.size() - 2);
+    }
+
+    const arbiter::json body {
+        { "Records", arbiter::json::array({ record }) }
+    };
+    m_notifications.push_back(body.dump());
+}
+
+bool MockServer::sqs(
+        const int fd,
+        const Request& req,
+        const std::string& action)
+{
+    const arbiter::json body(
+            arbiter::json::parse(
+                std::string(req.body.begin(), req.body.end())));
+    arbiter::json response(arbiter::json::object());
+
+    if (action == "ReceiveMessage")
+    {
+        const std::size_t max(body.value("MaxNumberOfMessages", 1));
+        const auto until(
+                std::chrono::steady_clock::now() +
+                std::chrono::seconds(body.value("WaitTimeSeconds", 0)));
+
+        // Long polls return as soon as there are messages.
+        arbiter::json messages(arbiter::json::array());
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                while (m_notifications.size() && messages.size() < max)
+                {
+                    const std::string receipt(std::to_string(m_nextReceipt++));
+                    messages.push_back({
+                        { "MessageId", receipt },
+                        { "ReceiptHandle", receipt },
+                        { "Body", m_notifications.front() }
+                    });
+                    m_received[receipt] = m_notifications.front();
+                    m_notifications.pop_front();
+                }
+            }
+
+            if (messages.size() || m_done) break;
+            if (std::chrono::steady_clock::now() >= until) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        if (messages.size()) response["Messages"] = messages;
+    }
+    else if (action == "DeleteMessageBatch")
+    {
+        arbiter::json successful(arbiter::json::array());
+        arbiter::json failed(arbiter::json::array());
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const arbiter::json& entry : body.at("Entries"))
+        {
+            const std::string receipt(entry.at("ReceiptHandle"));
+            if (m_received.erase(receipt))
+            {
+                successful.push_back({ { "Id", entry.at("Id") } });
+            }
+            else
+            {
+                failed.push_back({
+                    { "Id", entry.at("Id") },
+                    { "Code", "ReceiptHandleIsInvalid" },
+                    { "SenderFault", true }
+                });
+            }
+        }
+
+        response["Successful"] = successful;
+        response["Failed"] = failed;
+    }
+    else
+    {
+        response["__type"] = "com.amazonaws.sqs#InvalidAction";
+        const std::string s(response.dump());
+        return respond(
+                fd,
+                400,
+                Headers { { "Content-Type", "application/x-amz-json-1.0" } },
+                s.data(),
+                s.size());
+    }
+
+    const std::string s(response.dump());
+    return respond(
+            fd,
+            200,
+            Headers { { "Content-Type", "application/x-amz-json-1.0" } },
+            s.data(),
+            s.size());
+}
+
+bool MockServer::select(const int fd, const Request& req)
+{
+    Object object;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto& objects(m_objects[req.bucket]);
+        auto it(objects.find(req.key));
+        if (it != objects.end()) object = it->second;
+    }
+
+    if (!object) return respond(fd, 404, error("NoSuchKey"));
+
+    const std::string body(req.body.begin(), req.body.end());
+    const std::string expression(unescape(element(body, "Expression")));
+    const std::string input(element(body, "InputSerialization"));
+    const std::string header(element(input, "FileHeaderInfo"));
+    std::string delimiter(unescape(element(input, "FieldDelimiter")));
+    if (delimiter.empty()) delimiter = ",";
+
+    const std::string start(element(body, "Start"));
+    const std::string end(element(body, "End"));
+    const std::vector<char>& data(object->data);
+    const std::size_t scanStart(start.size() ? std::stoul(start) : 0);
+    const std::size_t scanEnd(end.size() ? std::stoul(end) : data.size());
+
+    const std::string prefix("SELECT * FROM S3Object");
+    const std::string where("WHERE s._");
+    const std::size_t clause(expression.find(where));
+
+    int column(0);
+    std::string value;
+    bool supported(
+            input.find("<CSV>") != std::string::npos &&
+            expression.compare(0, prefix.size(), prefix) == 0);
+
+    if (supported && clause != std::string::npos)
+    {
+        column = std::atoi(expression.c_str() + clause + where.size());
+        const std::size_t open(expression.find('\'', clause));
+        const std::size_t close(
+                open == std::string::npos ?
+                    open : expression.find('\'', open + 1));
+        supported = column > 0 && close != std::string::npos;
+        if (supported) value = expression.substr(open + 1, close - open - 1);
+    }
+
+    if (!supported)
+    {
+        const std::string failure(eventMessage(
+                    {
+                        { ":message-type", "error" },
+                        { ":error-code", "UnsupportedSyntax" },
+                        { ":error-message", "Unsupported: " + expression }
+                    },
+                    ""));
+        return respond(fd, 200, Headers(), failure.data(), failure.size());
+    }
+
+    // Records are those which begin within the scan range.
+    std::string out;
+    std::size_t returned(0);
+    bool first(true);
+
+    for (std::size_t pos(0); pos < data.size() && pos < scanEnd; )
+    {
+        const auto newline(std::find(data.begin() + pos, data.end(), '\n'));
+        const std::size_t next(newline - data.begin());
+        const std::string line(data.begin() + pos, newline);
+        const bool skip(first && header.size() && header != "NONE");
+
+        if (!skip && pos >= scanStart && line.size())
+        {
+            std::string field;
+            std::size_t begin(0);
+            for (int i(1); i <= column; ++i)
+            {
+                const std::size_t stop(line.find(delimiter, begin));
+                field = line.substr(begin, stop - begin);
+                begin = stop == std::string::npos ?
+                    line.size() : stop + delimiter.size();
+            }
+
+            if (!column || field == value)
+            {
+                out += event("Records", line + "\n");
+                returned += line.size() + 1;
+            }
+        }
+
+        first = false;
+        pos = next + 1;
+    }
+
+    out += event(
+            "Stats",
+            "<Stats><BytesScanned>" + std::to_string(data.size()) +
+            "</BytesScanned><BytesReturned>" + std::to_string(returned) +
+            "</BytesReturned></Stats>");
+    out += event("End", "");
+
+    return respond(fd, 200, Headers(), out.data(), out.size());
+}
+
+bool MockServer::deleteObjects(const int fd, const Request& req)
+{
+    // Like S3, refuse a DeleteObjects request without an integrity check.
+    const std::string body(req.body.begin(), req.body.end());
+    const std::string md5(req.header("content-md5"));
+    if (md5 != arbiter::crypto::encodeBase64(arbiter::crypto::md5(body)))
+    {
+        return respond(fd, 400, error("InvalidDigest"));
+    }
+
+    const std::string open("<Key>");
+    const std::string close("</Key>");
+    const bool quiet(body.find("<Quiet>true</Quiet>") != std::string::npos);
+
+    std::string result("<DeleteResult>");
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& objects(m_objects[req.bucket]);
+
+        for (
+                std::size_t pos(body.find(open));
+                pos != std::string::npos;
+                pos = body.find(open, pos + 1))
+        {
+            const std::size_t begin(pos + open.size());
+            const std::size_t end(body.find(close, begin));
+            if (end == std::string::npos) break;
+
+            const std::string key(unescape(body.substr(begin, end - begin)));
+            if (objects.erase(key)) notify(req.bucket, key, Object());
+
+            if (!quiet)
+            {
+                result += "<Deleted><Key>" + escape(key) + "</Key></Deleted>";
+            }
+        }
+    }
+    result += "</DeleteResult>";
+
+    return respond(fd, 200, result);
+}
+
+bool MockServer::list(const int fd, const Request& req)
+{
+    const std::string prefix(req.param("prefix"));
+    const std::string delimiter(req.param("delimiter"));
+    const std::string token(req.param("continuation-token"));
+    const std::string after(req.param("start-after"));
+    const std::size_t maxKeys(
+            req.has("max-keys") ? std::stoul(req.param("max-keys")) : 1000);
+
+    std::string contents;
+    std::set<std::string> prefixes;
+    std::size_t count(0);
+    std::string last;
+    bool truncated(false);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto& objects(m_objects[req.bucket]);
+
+        auto it(token.size() ?
+                objects.upper_bound(token) :
+                after > prefix ?
+                    objects.upper_bound(after) :
+                    objects.lower_bound(prefix));
+
+        for ( ; it != objects.end(); ++it)
+        {
+            const std::string& key(it->first);
+            if (key.compare(0, prefix.size(), prefix)) break;
+
+            // Keys under a common prefix already listed are rolled into it
+            // without counting against the page.
+            std::string common;
+            if (delimiter.size())
+            {
+                const std::size_t pos(key.find(delimiter, prefix.size()));
+                if (pos != std::string::npos)
+                {
+                    common = key.substr(0, pos + delimiter.size());
+                    if (prefixes.count(common))
+                    {
+                        last = key;
+                        continue;
+                    }
+                }
+            }
+
+            if (count == maxKeys)
+            {
+                truncated = true;
+                break;
+            }
+
+            if (common.size()) prefixes.insert(common);
+            else
+            {
+                contents +=
+                    "<Contents><Key>" + escape(key) + "</Key>"
+                    "<Size>" + std::to_string(it->second->data.size()) +
+                    "</Size><ETag>" + escape(it->second->etag) +
+                    "</ETag><LastModified>" + it->second->modified +
+                    "</LastModified></Contents>";
+            }
+
+            last = key;
+            ++count;
+        }
+    }
+
+    std::string xml(
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?><ListBucketResult>"
+            "<Name>" + escape(req.bucket) + "</Name>"
+            "<Prefix>" + escape(prefix) + "</Prefix>"
+            "<KeyCount>" + std::to_string(count) + "</KeyCount>"
+            "<MaxKeys>" + std::to_string(maxKeys) + "</MaxKeys>"
+            "<IsTruncated>" + (truncated ? "true" : "false") +
+            "</IsTruncated>");
+
+    if (truncated)
+    {
+        xml += "<NextContinuationToken>" + escape(last) +
+            "</NextContinuationToken>";
+    }
+
+    xml += contents;
+    for (const std::string& p : prefixes)
+    {
+        xml += "<CommonPrefixes><Prefix>" + escape(p) +
+            "</Prefix></CommonPrefixes>";
+    }
+    xml += "</ListBucketResult>";
+
+#ifdef ARBITER_ZLIB
+    if (req.header("accept-encoding").find("gzip") != std::string::npos)
+    {
+        ++m_compressed;
+        const std::string gz(gzip(xml));
+        const Headers headers {
+            { "Content-Type", "application/xml" },
+            { "Content-Encoding", "gzip" }
+        };
+        return respond(fd, 200, headers, gz.data(), gz.size());
+    }
+#endif
+
+    return respond(fd, 200, xml);
+}
+
+bool MockServer::createSession(const int fd, const Request&)
+{
+    const std::string token("session-" + std::to_string(++m_sessions));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tokens.insert(token);
+    }
+
+    // Like those of S3, sessions last five minutes.
+    const std::string expiration(arbiter::Time(std::time(nullptr) + 300).str());
+    const std::string body(
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+            "<CreateSessionResult><Credentials>"
+            "<SessionToken>" + token + "</SessionToken>"
+            "<SecretAccessKey>" + token + "-secret</SecretAccessKey>"
+            "<AccessKeyId>" + token + "-access</AccessKeyId>"
+            "<Expiration>" + expiration + "</Expiration>"
+            "</Credentials></CreateSessionResult>");
+
+    const Headers headers { { "Content-Type", "application/xml" } };
+    return respond(fd, 200, headers, body.data(), body.size());
+}
+
+MockServer::Reply MockServer::gcs(const Request& req)
+{
+    const std::vector<std::string> s(segments(req.path));
+    const std::string& method(req.method);
+    const Reply missing(404, gcsError(404, "Not Found"));
+
+    if (s.front() == "batch")
+    {
+        if (method != "POST") return Reply(405, gcsError(405, "Not allowed"));
+        return gcsBatch(req);
+    }
+
+    // upload/storage/v1/b/<bucket>/o
+    if (s.front() == "upload")
+    {
+        if (s.size() != 6 || s[5] != "o") return missing;
+        return gcsUpload(req, s[4]);
+    }
+
+    // storage/v1/b/<bucket>/o, followed by /<object>, and by /compose or by
+    // /rewriteTo/b/<bucket>/o/<object> for those actions.
+    if (s.size() < 5 || s[4] != "o") return missing;
+    const std::string& bucket(s[3]);
+
+    if (s.size() == 5 && method == "GET") return gcsList(req, bucket);
+    if (s.size() == 7 && s[6] == "compose" && method == "POST")
+    {
+        return gcsCompose(req, bucket, s[5]);
+    }
+    if (s.size() == 11 && s[6] == "rewriteTo" && s[7] == "b" && s[9] == "o" &&
+            method == "POST")
+    {
+        return gcsRewrite(req, bucket, s[5], s[8], s[10]);
+    }
+    if (s.size() != 6) return missing;
+
+    const std::string& name(s[5]);
+    const Reply noSuchObject(
+            404,
+            gcsError(404, "No such object: " + bucket + "/" + name));
+
+    if (method == "DELETE")
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_objects[bucket].erase(name)) return noSuchObject;
+        return Reply(204, "", Headers());
+    }
+
+    if (method != "GET" && method != "HEAD")
+    {
+        return Reply(405, gcsError(405, "Not allowed"));
+    }
+
+    Object object;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto& objects(m_objects[bucket]);
+        auto it(objects.find(name));
+        if (it != objects.end()) object = it->second;
+    }
+
+    if (!object) return noSuchObject;
+
+    const std::vector<char>& data(object->data);
+    if (req.param("alt") != "media")
+    {
+        return Reply(
+                200,
+                gcsResource(
+                    bucket,
+                    name,
+                    data.size(),
+                    object->etag,
+                    object->modified).dump());
+    }
+
+    Headers headers {
+        { "Content-Type", "application/octet-stream" },
+        { "ETag", object->etag }
+    };
+
+    const std::string range(req.header("range"));
+    std::size_t begin(0);
+    std::size_t end(data.size());
+    if (range.size())
+    {
+        if (!parseRange(range, data.size(), begin, end))
+        {
+            headers["Content-Range"] = "bytes */" + std::to_string(end);
+            return Reply(416, "", headers);
+        }
+
+        headers["Content-Range"] =
+            "bytes " + std::to_string(begin) + "-" + std::to_string(end - 1) +
+            "/" + std::to_string(data.size());
+    }
+
+    return Reply(
+            range.size() ? 206 : 200,
+            std::string(data.begin() + begin, data.begin() + end),
+            headers);
+}
+
+MockServer::Reply MockServer::gcsList(
+        const Request& req,
+        const std::string& bucket)
+{
+    const std::string prefix(req.param("prefix"));
+    const std::string delimiter(req.param("delimiter"));
+    const std::string token(req.param("pageToken"));
+    const std::string startOffset(req.param("startOffset"));
+    const std::string endOffset(req.param("endOffset"));
+    const std::size_t maxResults(
+            req.has("maxResults") ? std::stoul(req.param("maxResults")) : 1000);
+
+    arbiter::json items(arbiter::json::array());
+    std::set<std::string> prefixes;
+    std::size_t count(0);
+    std::string last;
+    bool truncated(false);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto& objects(m_objects[bucket]);
+
+        auto it(token.size() ?
+                objects.upper_bound(token) :
+                objects.lower_bound((std::max)(prefix, startOffset)));
+
+        for ( ; it != objects.end(); ++it)
+        {
+            const std::string& name(it->first);
+            if (name.compare(0, prefix.size(), prefix)) break;
+            if (endOffset.size() && name >= endOffset) break;
+
+            // As for ListObjectsV2, names under a common prefix already
+            // listed are rolled into it without counting against the page.
+            std::string common;
+            if (delimiter.size())
+            {
+                const std::size_t pos(name.find(delimiter, prefix.size()));
+                if (pos != std::string::npos)
+                {
+                    common = name.substr(0, pos + delimiter.size());
+                    if (prefixes.count(common))
+                    {
+                        last = name;
+                        continue;
+                    }
+                }
+            }
+
+            if (count == maxResults)
+            {
+                truncated = true;
+                break;
+            }
+
+            if (common.size()) prefixes.insert(common);
+            else
+            {
+                items.push_back(
+                        gcsResource(
+                            bucket,
+                            name,
+                            it->second->data.size(),
+                            it->second->etag,
+                            it->second->modified));
+            }
+
+            last = name;
+            ++count;
+        }
+    }
+
+    // Like those of GCS, empty members are left out.
+    arbiter::json body { { "kind", "storage#objects" } };
+    if (items.size()) body["items"] = items;
+    if (prefixes.size()) body["prefixes"] = prefixes;
+    if (truncated) body["nextPageToken"] = last;
+    return Reply(200, body.dump());
+}
+
+MockServer::Reply MockServer::gcsUpload(
+        const Request& req,
+        const std::string& bucket)
+{
+    // Uploads may carry the CRC32C of their whole object, which is checked
+    // before it is stored.
+    auto verify([this](const std::vector<char>& data, const std::string& hash)
+    {
+        const std::string field("crc32c=");
+        const std::size_t pos(hash.find(field));
+        if (pos == std::string::npos) return true;
+
+        arbiter::crypto::Crc32c crc;
+        crc.update(data);
+        const std::size_t begin(pos + field.size());
+        ++m_checksummed;
+        return hash.substr(begin, hash.find(',', begin) - begin) ==
+            arbiter::crypto::encodeBase64(crc.finalize());
+    });
+
+    // Requires m_mutex.
+    auto store([this](
+                const std::string& into,
+                const std::string& key,
+                std::vector<char> data)
+    {
+        const std::string etag(etagOf(data));
+        const Object object(std::make_shared<Stored>(std::move(data), etag));
+        m_objects[into][key] = object;
+        return Reply(
+                200,
+                gcsResource(
+                    into,
+                    key,
+                    object->data.size(),
+                    object->etag,
+                    object->modified).dump());
+    });
+
+    // Resumable uploads are sent, a chunk at a time, to their sessions,
+    // each of which is named by its upload_id.
+    if (req.method == "PUT" && req.has("upload_id"))
+    {
+        const std::string range(req.header("content-range"));
+        const std::string unit("bytes ");
+        const std::size_t dash(range.find('-'));
+        const std::size_t slash(range.find('/'));
+        if (range.compare(0, unit.size(), unit) || slash == std::string::npos)
+        {
+            return Reply(400, gcsError(400, "Bad Content-Range: " + range));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it(m_resumables.find(req.param("upload_id")));
+        if (it == m_resumables.end())
+        {
+            return Reply(404, gcsError(404, "No such upload"));
+        }
+
+        Resumable& upload(*it->second);
+
+        // The Range of a 308 is that of the bytes committed, and is absent
+        // if there are none.
+        auto incomplete([&upload]()
+        {
+            Headers headers;
+            if (upload.data.size())
+            {
+                headers["Range"] =
+                    "bytes=0-" + std::to_string(upload.data.size() - 1);
+            }
+            return Reply(308, "", headers);
+        });
+
+        // A query of the status of the session.
+        if (range[unit.size()] == '*') return incomplete();
+
+        ++m_chunks;
+        if (dash == std::string::npos || dash > slash)
+        {
+            return Reply(400, gcsError(400, "Bad Content-Range: " + range));
+        }
+
+        const std::size_t first(
+                std::stoul(range.substr(unit.size(), dash - unit.size())));
+        const std::size_t last(
+                std::stoul(range.substr(dash + 1, slash - dash - 1)));
+        if (last < first || last - first + 1 != req.body.size())
+        {
+            return Reply(400, gcsError(400, "Bad chunk: " + range));
+        }
+
+        // Chunks which don't continue from the committed bytes are dropped,
+        // and are resent from the Range of our reply.
+        if (m_options.stallResumable || first != upload.data.size())
+        {
+            return incomplete();
+        }
+
+        upload.data.insert(upload.data.end(), req.body.begin(), req.body.end());
+        if (upload.data.size() < upload.total) return incomplete();
+
+        const std::string hash(req.header("x-goog-hash"));
+        if (upload.data.size() > upload.total ||
+                !verify(upload.data, hash.size() ? hash : upload.hash))
+        {
+            m_resumables.erase(it);
+            return Reply(400, gcsError(400, "Upload failed verification"));
+        }
+
+        const Reply reply(
+                store(upload.bucket, upload.name, std::move(upload.data)));
+        m_resumables.erase(it);
+        return reply;
+    }
+
+    const std::string type(req.param("uploadType"));
+    const std::string name(req.param("name"));
+    if (req.method != "POST" || name.empty() ||
+            (type != "media" && type != "resumable"))
+    {
+        return Reply(400, gcsError(400, "Unsupported upload"));
+    }
+
+    std::string rejected;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        rejected = m_options.rejectUploads;
+    }
+
+    if (rejected.size() && name.size() >= rejected.size() &&
+            !name.compare(name.size() - rejected.size(), rejected.size(),
+                rejected))
+    {
+        return Reply(400, gcsError(400, "Upload refused: " + name));
+    }
+
+    if (type == "resumable")
+    {
+        const std::string total(req.header("x-upload-content-length"));
+        if (total.empty())
+        {
+            return Reply(400, gcsError(400, "Missing X-Upload-Content-Length"));
+        }
+
+        std::unique_ptr<Resumable> upload(new Resumable());
+        upload->bucket = bucket;
+        upload->name = name;
+        upload->total = std::stoul(total);
+        upload->hash = req.header("x-goog-hash");
+
+        std::string id;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            id = std::to_string(++m_nextUpload);
+            m_resumables[id] = std::move(upload);
+        }
+
+        return Reply(
+                200,
+                "",
+                Headers {
+                    {
+                        "Location",
+                        httpRoot() + "upload/storage/v1/b/" + bucket +
+                            "/o?uploadType=resumable&upload_id=" + id
+                    }
+                });
+    }
+
+    if (!verify(req.body, req.header("x-goog-hash")))
+    {
+        return Reply(400, gcsError(400, "Upload failed verification"));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return store(bucket, name, req.body);
+}
+
+MockServer::Reply MockServer::gcsCompose(
+        const Request& req,
+        const std::string& bucket,
+        const std::string& name)
+{
+    arbiter::json sources;
+    try
+    {
+        sources = arbiter::json::parse(
+                std::string(req.body.begin(), req.body.end()))
+            .at("sourceObjects");
+    }
+    catch (...)
+    {
+        return Reply(400, gcsError(400, "Bad compose request"));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& objects(m_objects[bucket]);
+
+    std::vector<char> data;
+    for (const arbiter::json& source : sources)
+    {
+        const std::string component(source.value("name", std::string()));
+        auto it(objects.find(component));
+        if (it == objects.end())
+        {
+            return Reply(
+                    404,
+                    gcsError(404, "No such object: " + bucket + "/" +
+                        component));
+        }
+
+        const std::vector<char>& bytes(it->second->data);
+        data.insert(data.end(), bytes.begin(), bytes.end());
+    }
+
+    ++m_composed;
+    const std::string etag(etagOf(data));
+    const Object object(std::make_shared<Stored>(std::move(data), etag));
+    objects[name] = object;
+
+    return Reply(
+            200,
+            gcsResource(
+                bucket,
+                name,
+                object->data.size(),
+                object->etag,
+                object->modified).dump());
+}
+
+MockServer::Reply MockServer::gcsRewrite(
+        const Request& req,
+        const std::string& bucket,
+        const std::string& name,
+        const std::string& toBucket,
+        const std::string& toName)
+{
+    ++m_rewrites;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto& objects(m_objects[bucket]);
+    auto it(objects.find(name));
+    if (it == objects.end())
+    {
+        return Reply(
+                404,
+                gcsError(404, "No such object: " + bucket + "/" + name));
+    }
+
+    // Each call rewrites up to maxBytesRewrittenPerCall more bytes, and
+    // until the last, its token is the number rewritten so far.
+    const Object source(it->second);
+    const std::size_t size(source->data.size());
+    const std::size_t step(
+            req.has("maxBytesRewrittenPerCall") ?
+                std::stoul(req.param("maxBytesRewrittenPerCall")) : 0);
+    const std::size_t previous(
+            req.has("rewriteToken") ?
+                std::stoul(req.param("rewriteToken")) : 0);
+    const std::size_t rewritten(
+            step ? (std::min)(previous + step, size) : size);
+
+    arbiter::json body {
+        { "kind", "storage#rewriteResponse" },
+        { "totalBytesRewritten", std::to_string(rewritten) },
+        { "objectSize", std::to_string(size) },
+        { "done", rewritten == size }
+    };
+
+    if (rewritten < size) body["rewriteToken"] = std::to_string(rewritten);
+    else
+    {
+        m_objects[toBucket][toName] = source;
+        body["resource"] = gcsResource(
+                toBucket,
+                toName,
+                size,
+                source->etag,
+                source->modified);
+    }
+
+    return Reply(200, body.dump());
+}
+
+MockServer::Reply MockServer::gcsBatch(const Request& req)
+{
+    ++m_batches;
+
+    const std::string type(req.header("content-type"));
+    const std::string param("boundary=");
+    const std::size_t pos(type.find(param));
+    if (pos == std::string::npos)
+    {
+        return Reply(400, gcsError(400, "Batches must be multipart/mixed"));
+    }
+
+    const std::string delimiter("--" + type.substr(pos + param.size()));
+    const std::string body(req.body.begin(), req.body.end());
+    const std::string blank("\r\n\r\n");
+    const std::string boundary("batch_mock");
+
+    // Each part is headed by its Content-ID and holds a request of its own,
+    // whose reply is headed by the same ID in the part which answers it.
+    std::string out;
+    std::size_t begin(body.find(delimiter));
+    while (begin != std::string::npos)
+    {
+        begin += delimiter.size();
+        if (!body.compare(begin, 2, "--")) break;
+
+        const std::size_t end(body.find(delimiter, begin));
+        if (end == std::string::npos) break;
+        const std::string part(body.substr(begin, end - begin));
+        begin = end;
+
+        const std::size_t split(part.find(blank));
+        if (split == std::string::npos) continue;
+
+        std::string id(parseHeaders(part.substr(0, split), 0)["content-id"]);
+        if (id.size() > 2 && id.front() == '<' && id.back() == '>')
+        {
+            id = id.substr(1, id.size() - 2);
+        }
+
+        const std::string inner(part.substr(split + blank.size()));
+        const std::size_t headEnd(inner.find(blank));
+        if (headEnd == std::string::npos) continue;
+
+        const std::string head(inner.substr(0, headEnd));
+        const std::size_t lineEnd(head.find("\r\n"));
+        const std::string line(head.substr(0, lineEnd));
+        const std::size_t sp(line.find(' '));
+
+        Request call;
+        call.method = line.substr(0, sp);
+        call.headers = parseHeaders(head, lineEnd);
+
+        const std::string target(
+                line.substr(sp + 1, line.find(' ', sp + 1) - sp - 1));
+        const std::size_t qpos(target.find('?'));
+        call.path = target.substr(1, qpos - 1);
+        call.key = decode(call.path);
+        if (qpos != std::string::npos)
+        {
+            call.query = parseQuery(target.substr(qpos + 1));
+        }
+
+        const std::string length(call.header("content-length"));
+        const std::size_t size(length.size() ? std::stoul(length) : 0);
+        call.body.assign(
+                inner.begin() + headEnd + blank.size(),
+                inner.begin() + (std::min)(
+                    headEnd + blank.size() + size,
+                    inner.size()));
+
+        const Reply reply(
+                call.path.compare(0, 13, "storage/v1/b/") ?
+                    Reply(404, gcsError(404, "Not Found")) :
+                    gcs(call));
+
+        out +=
+            "--" + boundary + "\r\n"
+            "Content-Type: application/http\r\n"
+            "Content-ID: <response-" + id + ">\r\n\r\n"
+            "HTTP/1.1 " + std::to_string(reply.code) + " " +
+            reason(reply.code) + "\r\n";
+        for (const auto& h : reply.headers)
+        {
+            out += h.first + ": " + h.second + "\r\n";
+        }
+        out +=
+            "Content-Length: " + std::to_string(reply.body.size()) +
+            "\r\n\r\n" + reply.body + "\r\n";
+    }
+    out += "--" + boundary + "--\r\n";
+
+    return Reply(
+            200,
+            out,
+            Headers {
+                { "Content-Type", "multipart/mixed; boundary=" + boundary }
+            });
+}
+
+bool MockServer::respond(
+        const int fd,
+        const int code,
+        const Headers& headers,
+        const char* body,
+        const std::size_t size,
+        const bool head)
+{
+    std::string out(
+            "HTTP/1.1 " + std::to_string(code) + " " + reason(code) + "\r\n");
+    for (const auto& h : headers) out += h.first + ": " + h.second + "\r\n";
+    out += "Content-Length: " + std::to_string(size) + "\r\n\r\n";
+
+    if (!sendAll(fd, out.data(), out.size())) return false;
+    if (head || !size) return true;
+
+    std::size_t bandwidth(0);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        bandwidth = m_options.bandwidth;
+    }
+
+    if (!bandwidth) return sendAll(fd, body, size);
+
+    // Pace the body in slices of about 10ms each.
+    using Clock = std::chrono::steady_clock;
+    const auto start(Clock::now());
+    const std::size_t slice(std::max<std::size_t>(bandwidth / 100, 1));
+
+    for (std::size_t sent(0); sent < size; )
+    {
+        const std::size_t n(std::min(slice, size - sent));
+        if (!sendAll(fd, body + sent, n)) return false;
+        sent += n;
+
+        std::this_thread::sleep_until(
+                start + std::chrono::microseconds(
+                    static_cast<std::uint64_t>(sent * 1e6 / bandwidth)));
+    }
+
+    return true;
+}
+
+bool MockServer::respond(
+        const int fd,
+        const int code,
+        const std::string& body,
+        const bool head)
+{
+    return respond(
+            fd,
+            code,
+            { { "Content-Type", "application/xml" } },
+            body.data(),
+            body.size(),
+            head);
+}
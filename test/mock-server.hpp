@@ -0,0 +1,286 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// An in-memory object store on the loopback interface, speaking enough of
+// HTTP and the S3 REST API to drive drivers::Http and drivers::S3:
+//      - GET, with single byte ranges and If-Match
+//      - HEAD, PUT, DELETE, and copies via x-amz-copy-source
+//      - A Content-Encoding given with a PUT, which is sent with GETs
+//      - ListObjectsV2, with prefixes, delimiters, and continuation tokens
+//      - Multipart uploads, with parts copied via x-amz-copy-source-range,
+//        which may be aborted
+//      - CRC32C checksums of uploads and parts, which are verified
+//      - S3 Select of CSV objects, for expressions of the form
+//        SELECT * FROM S3Object s [WHERE s._<n> = '<value>'], whose results
+//        are sent as one Records event per record.  Others fail with an
+//        error event, as errors found partway through a scan do on S3
+//      - CreateSession for directory buckets, named with an `--x-s3` suffix,
+//        whose other requests must carry the token of a session
+//      - If enabled, S3 event notifications of the objects written and
+//        removed, delivered to a single SQS queue which answers the
+//        ReceiveMessage and DeleteMessageBatch actions of the JSON protocol
+//        at any URL.  Received messages are never redelivered
+//      - Enough of the GCS JSON API, beneath storage/v1/, upload/storage/v1/,
+//        and batch/storage/v1, to drive drivers::Google: reads of objects and
+//        their metadata, listings, media and resumable uploads, composition,
+//        rewrites which may take several calls, deletions, and batches of
+//        these.  The matchGlob of a listing is ignored, which widens it
+//
+// Requests are not authenticated, though the region for which they are
+// signed must be that of their bucket.  Those of GCS must carry a bearer
+// token.  Virtual-hosted S3 requests, to
+// <bucket>.localhost or any further subdomain of it like those of the
+// alternative S3 hosts, store objects under their bucket.  Plain HTTP requests,
+// to 127.0.0.1, store them under the empty bucket.  Requests may also be
+// sent through us as an HTTP proxy.
+//
+// Latency, bandwidth, and errors may be injected to exercise retries and
+// timeouts, or to model a remote store for benchmarks.
+class MockServer
+{
+public:
+    struct Options
+    {
+        // Delay before each response.
+        std::chrono::milliseconds latency = std::chrono::milliseconds(0);
+
+        // Rate at which each response body is sent, in bytes per second, or
+        // unlimited if zero.
+        std::size_t bandwidth = 0;
+
+        // Fraction of requests which fail with a 503 SlowDown.  Failures are
+        // drawn from a generator seeded by @p seed, so the same sequence of
+        // requests meets the same failures.
+        double errorRate = 0;
+        std::uint32_t seed = 42;
+
+        // If set, HEAD requests are refused with a 405, as by servers which
+        // only serve GETs.
+        bool rejectHead = false;
+
+        // If nonzero, the bodies of GETs are cut off after this many bytes
+        // by dropping their connections, as when a stalled transfer times
+        // out.
+        std::size_t truncate = 0;
+
+        // If set, GETs of several ranges are answered by a multipart/
+        // byteranges body of them.  Otherwise they are answered with the
+        // whole object, as by S3.
+        bool multiRange = false;
+
+        // Buckets in regions other than us-east-1.  As by S3, requests for
+        // them which are signed for another region are refused with a 400
+        // naming their region in an x-amz-bucket-region header.
+        std::map<std::string, std::string> regions;
+
+        // If set, changes to objects are queued as S3 event notifications.
+        bool notifications = false;
+
+        // The number of times the uploads of each part number, whether of
+        // data or copies, fail with a 500 before they succeed.
+        std::map<int, std::size_t> partFailures;
+
+        // If set, the chunks of GCS resumable uploads are acknowledged with
+        // a 308 without committing any of them, as by a session which
+        // doesn't advance.
+        bool stallResumable = false;
+
+        // If nonempty, GCS uploads of objects whose names end with this are
+        // refused with a 400.
+        std::string rejectUploads;
+    };
+
+    MockServer();
+    explicit MockServer(Options options);
+    ~MockServer();
+
+    // Replace the options for subsequent requests.
+    void options(Options options);
+
+    int port() const { return m_port; }
+
+    // The root of plain HTTP requests, ending with a slash.
+    std::string httpRoot() const;
+
+    // A stringified configuration with which drivers::S3 addresses this
+    // server.
+    std::string s3Config() const;
+
+    std::size_t requests() const { return m_requests; }
+    std::size_t errors() const { return m_errors; }
+
+    // The number of connections accepted.
+    std::size_t accepted() const { return m_accepted; }
+
+    // The number of conditional GETs answered by a 304.
+    std::size_t notModified() const { return m_notModified; }
+
+    // The number of requests which asked for a `100 Continue`.
+    std::size_t continued() const { return m_continued; }
+
+    // The number of requests refused for being signed for the wrong region.
+    std::size_t misdirected() const { return m_misdirected; }
+
+    // The number of sessions created for directory buckets.
+    std::size_t sessions() const { return m_sessions; }
+
+    // The number of uploads and parts whose CRC32C checksums were verified.
+    std::size_t checksummed() const { return m_checksummed; }
+
+    // A stringified configuration with which drivers::Google addresses
+    // this server.  A token for its credentials is stored in the credential
+    // cache in the directory @p cache, so that they aren't exchanged with
+    // Google.
+    std::string gcsConfig(const std::string& cache) const;
+
+    // The number of requests received as a proxy.
+    std::size_t proxied() const { return m_proxied; }
+
+    // The number of multipart uploads initiated, of the UploadPart and
+    // UploadPartCopy requests received for them, and of those neither
+    // completed nor aborted.
+    std::size_t multipartUploads() const { return m_multipartUploads; }
+    std::size_t parts() const { return m_parts; }
+    std::size_t openUploads() const;
+
+    // The number of chunks sent to GCS resumable upload sessions, of
+    // composed objects, of rewrite calls, and of batch requests.
+    std::size_t chunks() const { return m_chunks; }
+    std::size_t composed() const { return m_composed; }
+    std::size_t rewrites() const { return m_rewrites; }
+    std::size_t batches() const { return m_batches; }
+
+    // The number of listings sent gzipped, for requests which accept it.
+    std::size_t compressed() const { return m_compressed; }
+
+    // The number of GET bodies cut off by Options::truncate.
+    std::size_t truncated() const { return m_truncated; }
+
+    // The hosts, without ports, to which requests have been addressed.
+    std::set<std::string> hosts() const;
+
+    // The number of notifications received from the queue and not yet
+    // deleted.
+    std::size_t unacknowledged() const;
+
+private:
+    struct Request;
+    struct Stored;
+    struct Upload;
+    struct Resumable;
+    struct Reply;
+    using Object = std::shared_ptr<const Stored>;
+
+    void accept();
+    void serve(int fd);
+    bool handle(int fd, const Request& req);
+
+    bool get(int fd, const Request& req, bool head);
+    bool put(int fd, const Request& req);
+    bool post(int fd, const Request& req);
+    bool del(int fd, const Request& req);
+    bool deleteObjects(int fd, const Request& req);
+    bool list(int fd, const Request& req);
+    bool createSession(int fd, const Request& req);
+    bool select(int fd, const Request& req);
+    bool sqs(int fd, const Request& req, const std::string& action);
+
+    // The reply to a request of the GCS JSON API.  Those within a batch are
+    // answered together by its reply.
+    Reply gcs(const Request& req);
+    Reply gcsList(const Request& req, const std::string& bucket);
+    Reply gcsUpload(const Request& req, const std::string& bucket);
+    Reply gcsCompose(
+            const Request& req,
+            const std::string& bucket,
+            const std::string& name);
+    Reply gcsRewrite(
+            const Request& req,
+            const std::string& bucket,
+            const std::string& name,
+            const std::string& toBucket,
+            const std::string& toName);
+    Reply gcsBatch(const Request& req);
+
+    // Queue a notification of the write of @p object to @p key, or of its
+    // removal if @p object is null, if notifications are enabled.
+    // Requires m_mutex.
+    void notify(
+            const std::string& bucket,
+            const std::string& key,
+            const Object& object);
+
+    bool respond(
+            int fd,
+            int code,
+            const std::map<std::string, std::string>& headers,
+            const char* body = nullptr,
+            std::size_t size = 0,
+            bool head = false);
+    bool respond(
+            int fd,
+            int code,
+            const std::string& body,
+            bool head = false);
+
+    const int m_listener;
+    int m_port = 0;
+    std::atomic<bool> m_done;
+    std::thread m_thread;
+
+    // Open connections, each served by a detached thread.
+    std::mutex m_connectionsMutex;
+    std::condition_variable m_connectionsCv;
+    std::set<int> m_connections;
+
+    mutable std::mutex m_mutex;
+    Options m_options;
+    std::mt19937 m_random;
+    std::set<std::string> m_hosts;
+    std::set<std::string> m_tokens;
+
+    // Keyed by bucket, then object.
+    std::map<std::string, std::map<std::string, Object>> m_objects;
+    std::map<std::string, std::unique_ptr<Upload>> m_uploads;
+    std::uint64_t m_nextUpload = 0;
+
+    // GCS resumable upload sessions, by their upload_id.
+    std::map<std::string, std::unique_ptr<Resumable>> m_resumables;
+
+    // Notifications waiting to be received, and those received, by their
+    // receipt handles.
+    std::deque<std::string> m_notifications;
+    std::map<std::string, std::string> m_received;
+    std::uint64_t m_nextReceipt = 0;
+
+    std::atomic<std::size_t> m_requests;
+    std::atomic<std::size_t> m_errors;
+    std::atomic<std::size_t> m_accepted;
+    std::atomic<std::size_t> m_notModified;
+    std::atomic<std::size_t> m_continued;
+    std::atomic<std::size_t> m_misdirected;
+    std::atomic<std::size_t> m_sessions;
+    std::atomic<std::size_t> m_checksummed;
+    std::atomic<std::size_t> m_proxied;
+    std::atomic<std::size_t> m_multipartUploads;
+    std::atomic<std::size_t> m_parts;
+    std::atomic<std::size_t> m_chunks;
+    std::atomic<std::size_t> m_composed;
+    std::atomic<std::size_t> m_rewrites;
+    std::atomic<std::size_t> m_batches;
+    std::atomic<std::size_t> m_compressed;
+    std::atomic<std::size_t> m_truncated;
+};
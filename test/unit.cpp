@@ -1,68 +1,4956 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
 #include <numeric>
 #include <set>
 
 #include <arbiter/util/time.hpp>
 #include <arbiter/arbiter.hpp>
+#include <arbiter/replay.hpp>
+#include <arbiter/util/http.hpp>
+#include <arbiter/util/crc32c.hpp>
+#include <arbiter/util/credentials.hpp>
+#include <arbiter/util/md5.hpp>
+#include <arbiter/util/sha256.hpp>
 #include <arbiter/util/transforms.hpp>
 
 #include "config.hpp"
 
+#ifndef ARBITER_WINDOWS
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef ARBITER_MOCK_SERVER
+#include <utime.h>
+
+#include <arbiter/sidecar.hpp>
+
+#include "mock-server.hpp"
+#endif
+
 #include "gtest/gtest.h"
 
-using namespace arbiter;
+using namespace arbiter;
+
+TEST(Env, HomeDir)
+{
+    std::string home;
+
+    ASSERT_NO_THROW(home = arbiter::expandTilde("~"));
+    EXPECT_NE(home, "~");
+    EXPECT_FALSE(home.empty());
+}
+
+TEST(Arbiter, HttpDerivation)
+{
+    Arbiter a;
+    EXPECT_TRUE(a.isHttpDerived("http://arbitercpp.com"));
+    EXPECT_FALSE(a.isHttpDerived("~/data"));
+    EXPECT_FALSE(a.isHttpDerived("."));
+}
+
+TEST(Arbiter, Capabilities)
+{
+    Arbiter a;
+
+    const Capabilities local(a.capabilities("~/data"));
+    EXPECT_TRUE(local.rangedReads);
+    EXPECT_TRUE(local.serverSideCopy);
+    EXPECT_FALSE(local.multipart);
+    EXPECT_TRUE(local.listingMetadata);
+
+    const Capabilities http(a.capabilities("http://arbitercpp.com"));
+    EXPECT_TRUE(http.rangedReads);
+    EXPECT_FALSE(http.serverSideCopy);
+    EXPECT_FALSE(http.multipart);
+    EXPECT_FALSE(http.delimiters);
+    EXPECT_FALSE(http.listingMetadata);
+}
+
+TEST(Arbiter, Time)
+{
+    Time a;
+    Time b(a.str());
+
+    EXPECT_EQ(a.str(), b.str());
+    EXPECT_EQ(a - b, 0);
+
+    Time x("2016-03-18T03:14:42Z");
+    Time y("2016-03-18T04:24:54Z");
+    const int64_t delta(1 * 60 * 60 + 10 * 60 + 12);
+
+    EXPECT_EQ(y - x, delta);
+    EXPECT_EQ(x - y, -delta);
+
+    Time epoch("1970-01-01T00:00:00Z");
+    EXPECT_EQ(epoch.asUnix(), 0);
+
+    // Issue 23.
+    {
+        Time t("2019-01-03T17:39:11Z");
+        EXPECT_EQ(t.asUnix() - 1546537151, 0);
+    }
+}
+
+TEST(Arbiter, Base64)
+{
+    EXPECT_EQ(crypto::encodeBase64(""), "");
+    EXPECT_EQ(crypto::encodeBase64("f"), "Zg==");
+    EXPECT_EQ(crypto::encodeBase64("fo"), "Zm8=");
+    EXPECT_EQ(crypto::encodeBase64("foo"), "Zm9v");
+    EXPECT_EQ(crypto::encodeBase64("foob"), "Zm9vYg==");
+    EXPECT_EQ(crypto::encodeBase64("fooba"), "Zm9vYmE=");
+    EXPECT_EQ(crypto::encodeBase64("foobar"), "Zm9vYmFy");
+    EXPECT_EQ(crypto::encodeBase64("foob", false), "Zm9vYg");
+
+    EXPECT_EQ(crypto::decodeBase64(""), "");
+    EXPECT_EQ(crypto::decodeBase64("Zg=="), "f");
+    EXPECT_EQ(crypto::decodeBase64("Zm8"), "fo");
+    EXPECT_EQ(crypto::decodeBase64("Zm9vYmFy"), "foobar");
+    EXPECT_THROW(crypto::decodeBase64("Zm9v!"), ArbiterError);
+    EXPECT_THROW(crypto::decodeBase64("Z"), ArbiterError);
+
+    // Long enough for any vectorized encoding, with a scalar tail.
+    std::string bytes;
+    for (int i(0); i < 1000; ++i) bytes.push_back(static_cast<char>(i * 7));
+    for (std::size_t n(0); n < 100; ++n)
+    {
+        const std::string s(bytes.substr(n));
+        EXPECT_EQ(crypto::decodeBase64(crypto::encodeBase64(s)), s);
+        EXPECT_EQ(crypto::decodeAsHex(crypto::encodeAsHex(s)), s);
+    }
+}
+
+TEST(Arbiter, Hex)
+{
+    const std::string bytes("\x00\x1f\xab\xff", 4);
+    EXPECT_EQ(crypto::encodeAsHex(bytes), "001fabff");
+    EXPECT_EQ(crypto::decodeAsHex("001FabfF"), bytes);
+    EXPECT_THROW(crypto::decodeAsHex("abc"), ArbiterError);
+    EXPECT_THROW(crypto::decodeAsHex("zz"), ArbiterError);
+}
+
+TEST(Arbiter, Join)
+{
+    EXPECT_EQ(join(""), "");
+    EXPECT_EQ(join("/"), "/");
+    EXPECT_EQ(join("/var", "log", "arbiter.log"), "/var/log/arbiter.log");
+    EXPECT_EQ(join("/var/", "log", "arbiter.log"), "/var/log/arbiter.log");
+    EXPECT_EQ(join("", "var", "log", "arbiter.log"), "/var/log/arbiter.log");
+    EXPECT_EQ(join("/", "/var", "log", "arbiter.log"), "/var/log/arbiter.log");
+    EXPECT_EQ(join("~", "code", "", "test.cpp", "/"), "~/code/test.cpp");
+    EXPECT_EQ(join("s3://", "bucket", "object.txt"), "s3://bucket/object.txt");
+    EXPECT_EQ(join("a", "b/"), "a/b/");
+    EXPECT_EQ(join("a/", std::string("//"), "b//"), "a/b/");
+
+    Arbiter a;
+    const Endpoint local(a.getEndpoint("/tmp/dir"));
+    EXPECT_EQ(local.fullPath("file"), "/tmp/dir/file");
+    EXPECT_EQ(local.prefixedFullPath("file"), "/tmp/dir/file");
+    EXPECT_EQ(local.prefixedRoot(), "/tmp/dir/");
+    EXPECT_EQ(
+            local.getSubEndpoint("sub").prefixedFullPath("file"),
+            "/tmp/dir/sub/file");
+}
+
+TEST(Arbiter, ParseFields)
+{
+    const std::string s(
+            R"({ "name": "a", "size": 42, "nested": { "size": 1 }, )"
+            R"("list": [{ "size": 2 }], "rev": "r1" })");
+
+    const json fields(parseFields(s, { "size", "rev", "missing" }));
+    EXPECT_EQ(fields, (json { { "size", 42 }, { "rev", "r1" } }));
+
+    EXPECT_TRUE(parseFields("[1, 2]", { "size" }).is_null());
+    EXPECT_TRUE(parseFields("{ \"size\": ", { "size" }).is_null());
+}
+
+TEST(Arbiter, Sanitize)
+{
+    EXPECT_EQ(http::sanitize("a-b_c.d~e/f"), "a-b_c.d~e/f");
+    EXPECT_EQ(http::sanitize("a b/c", ""), "a%20b%2Fc");
+    EXPECT_EQ(http::sanitize("x=1&y", "="), "x=1%26y");
+    EXPECT_EQ(http::sanitize("\xff\x01"), "%FF%01");
+
+    std::string out("stale");
+    http::sanitize("a+b", "", out);
+    EXPECT_EQ(out, "a%2Bb");
+    http::sanitize("", "", out);
+    EXPECT_EQ(out, "");
+}
+
+TEST(Arbiter, Sha256)
+{
+    auto hex([](std::string s) { return crypto::encodeAsHex(s); });
+
+    EXPECT_EQ(
+            hex(crypto::sha256("")),
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(
+            hex(crypto::sha256("abc")),
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(
+            hex(crypto::sha256(std::string(1000000, 'a'))),
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    EXPECT_EQ(
+            hex(crypto::hmacSha256("Jefe", "what do ya want for nothing?")),
+            "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+    // Incremental hashing matches, however the message is split.
+    const std::string message(100000, 'x');
+    crypto::Sha256 hasher;
+    for (std::size_t i(0); i < message.size(); i += 77)
+    {
+        hasher.update(message.substr(i, 77));
+    }
+    EXPECT_EQ(hasher.finalize(), crypto::sha256(message));
+
+    hasher.update("abc");
+    EXPECT_EQ(hasher.finalize(), crypto::sha256("abc"));
+}
+
+TEST(Arbiter, Headers)
+{
+    http::Headers headers;
+    headers["Content-Length"] = "5";
+    headers["content-length"] = "6";
+
+    // Names are matched regardless of case, keeping their first spelling.
+    ASSERT_EQ(headers.size(), 1u);
+    EXPECT_EQ(headers.begin()->first, "Content-Length");
+    EXPECT_EQ(headers.at("CONTENT-LENGTH"), "6");
+
+    headers["x-amz-date"] = "now";
+    headers["Host"] = "example.com";
+    std::vector<std::string> names;
+    for (const auto& h : headers) names.push_back(h.first);
+    const std::vector<std::string> expected {
+        "Content-Length", "Host", "x-amz-date"
+    };
+    EXPECT_EQ(names, expected);
+}
+
+TEST(Arbiter, Md5)
+{
+    auto hex([](std::string s) { return crypto::encodeAsHex(s); });
+
+    EXPECT_EQ(hex(crypto::md5("")), "d41d8cd98f00b204e9800998ecf8427e");
+    EXPECT_EQ(hex(crypto::md5("abc")), "900150983cd24fb0d6963f7d28e17f72");
+
+    const std::string message(100000, 'x');
+    crypto::Md5 hasher;
+    for (std::size_t i(0); i < message.size(); i += 77)
+    {
+        hasher.update(message.substr(i, 77));
+    }
+    EXPECT_EQ(hasher.finalize(), crypto::md5(message));
+
+    hasher.update("abc");
+    EXPECT_EQ(hasher.finalize(), crypto::md5("abc"));
+}
+
+TEST(Arbiter, MultipartEtag)
+{
+    auto hex([](std::string s) { return crypto::encodeAsHex(s); });
+
+    const std::string data("abcde");
+    const std::string etag(hex(crypto::md5(
+                    crypto::md5("ab") + crypto::md5("cd") + crypto::md5("e"))) +
+            "-3");
+    EXPECT_EQ(crypto::multipartEtag(data.data(), data.size(), 2), etag);
+    EXPECT_EQ(crypto::multipartEtag(data.data(), data.size(), 2, 4), etag);
+    EXPECT_EQ(
+            crypto::multipartEtag(nullptr, 0, 2),
+            hex(crypto::md5(crypto::md5(""))) + "-1");
+
+    const std::string quoted('"' + etag + '"');
+    EXPECT_TRUE(crypto::matchesEtag(data.data(), data.size(), quoted, { 2 }));
+    EXPECT_FALSE(crypto::matchesEtag(data.data(), data.size(), quoted));
+    EXPECT_FALSE(crypto::matchesEtag(data.data(), 4, quoted, { 2 }));
+    EXPECT_TRUE(crypto::matchesEtag(
+                data.data(),
+                data.size(),
+                hex(crypto::md5(data))));
+    EXPECT_FALSE(crypto::matchesEtag(data.data(), data.size(), "unrelated"));
+
+    // Part sizes of whole MiB are found without being given.
+    const std::size_t mib(1024 * 1024);
+    const std::vector<char> big(7 * mib, 'x');
+    EXPECT_TRUE(crypto::matchesEtag(
+                big.data(),
+                big.size(),
+                crypto::multipartEtag(big.data(), big.size(), 3 * mib, 3)));
+}
+
+TEST(Arbiter, Crc32c)
+{
+    EXPECT_EQ(crypto::crc32c(""), 0u);
+    EXPECT_EQ(crypto::crc32c("123456789"), 0xe3069283u);
+
+    // From RFC 3720, section B.4.
+    std::string ascending(32, 0);
+    for (std::size_t i(0); i < ascending.size(); ++i) ascending[i] = char(i);
+    EXPECT_EQ(crypto::crc32c(std::string(32, 0)), 0x8a9136aau);
+    EXPECT_EQ(crypto::crc32c(std::string(32, '\xff')), 0x62a8ab43u);
+    EXPECT_EQ(crypto::crc32c(ascending), 0x46dd794eu);
+
+    // Checksums continue across any split, whatever the alignment of the
+    // data which follows it.
+    std::string message(1000, 0);
+    for (std::size_t i(0); i < message.size(); ++i)
+    {
+        message[i] = char(i * 7 + 3);
+    }
+
+    const uint32_t whole(crypto::crc32c(message));
+    for (std::size_t split(0); split < 20; ++split)
+    {
+        const uint32_t first(crypto::crc32c(message.data(), split));
+        EXPECT_EQ(
+                crypto::crc32c(
+                    message.data() + split,
+                    message.size() - split,
+                    first),
+                whole);
+    }
+
+    crypto::Crc32c crc;
+    crc.update("12345");
+    crc.update("6789");
+    EXPECT_EQ(crypto::encodeAsHex(crc.finalize()), "e3069283");
+    EXPECT_EQ(crypto::encodeAsHex(crc.finalize()), "00000000");
+}
+
+TEST(Arbiter, Async)
+{
+    Arbiter a;
+
+    const std::string root(getTempPath() + "arbiter-async/");
+    mkdirp(root);
+
+    std::vector<std::future<void>> puts;
+    for (std::size_t i(0); i < 8; ++i)
+    {
+        const std::string path(root + std::to_string(i) + ".txt");
+        puts.push_back(a.putAsync(path, "Data " + std::to_string(i)));
+    }
+    for (auto& f : puts) EXPECT_NO_THROW(f.get());
+
+    for (std::size_t i(0); i < 8; ++i)
+    {
+        const std::string path(root + std::to_string(i) + ".txt");
+        const std::string data("Data " + std::to_string(i));
+        EXPECT_EQ(a.getAsync(path).get(), data);
+        EXPECT_EQ(a.getSizeAsync(path).get(), data.size());
+
+        const std::vector<char> binary(a.getBinaryAsync(path).get());
+        EXPECT_EQ(std::string(binary.begin(), binary.end()), data);
+    }
+
+    a.putAsync(root + "empty.txt", std::vector<char>()).get();
+    EXPECT_TRUE(a.getBinaryAsync(root + "empty.txt").get().empty());
+
+    EXPECT_THROW(a.getAsync(root + "nonexistent").get(), ArbiterError);
+    EXPECT_THROW(
+            a.getBinaryAsync(root + "nonexistent").get(),
+            ArbiterError);
+
+    // Completions receive the outcome as a ready future.
+    std::promise<void> put;
+    a.putAsync(root + "done.txt", std::vector<char>(3, 'x'), [&put](
+                std::future<void> f)
+    {
+        f.get();
+        put.set_value();
+    });
+    put.get_future().get();
+
+    std::promise<std::size_t> size;
+    a.getSizeAsync(root + "done.txt", [&size](std::future<std::size_t> f)
+    {
+        size.set_value(f.get());
+    });
+    EXPECT_EQ(size.get_future().get(), 3u);
+
+    std::promise<std::vector<std::string>> resolved;
+    a.resolveAsync(root + "done*", [&resolved](
+                std::future<std::vector<std::string>> f)
+    {
+        resolved.set_value(f.get());
+    });
+    EXPECT_EQ(resolved.get_future().get().size(), 1u);
+
+    std::promise<bool> failed;
+    a.getBinaryAsync(root + "nonexistent", [&failed](
+                std::future<std::vector<char>> f)
+    {
+        try { f.get(); failed.set_value(false); }
+        catch (ArbiterError&) { failed.set_value(true); }
+    });
+    EXPECT_TRUE(failed.get_future().get());
+}
+
+TEST(Arbiter, CopyDirectory)
+{
+    Arbiter a;
+
+    const std::string src(getTempPath() + "arbiter-copy-src/");
+    const std::string dst(getTempPath() + "arbiter-copy-dst/");
+    mkdirp(src + "a/b");
+
+    std::vector<std::string> files;
+    for (std::size_t i(0); i < 20; ++i)
+    {
+        files.push_back("a/" + std::to_string(i) + ".txt");
+        files.push_back("a/b/" + std::to_string(i) + ".txt");
+    }
+    for (const auto& f : files) a.put(src + f, f);
+
+    EXPECT_NO_THROW(a.copy(src, dst));
+    for (const auto& f : files) EXPECT_EQ(a.get(dst + f), f);
+
+    // Copies within a remote driver are handed to it together.
+    class Batched : public drivers::Test
+    {
+    public:
+        virtual std::vector<std::exception_ptr> copyMany(
+                const std::vector<std::pair<std::string, std::string>>& pairs,
+                std::size_t threads) const override
+        {
+            ++batches;
+            copied += pairs.size();
+            return drivers::Test::copyMany(pairs, threads);
+        }
+
+        mutable std::atomic<std::size_t> batches;
+        mutable std::atomic<std::size_t> copied;
+    };
+
+    Batched* batched(new Batched());
+    batched->batches = 0;
+    batched->copied = 0;
+    a.addDriver("test", std::unique_ptr<Driver>(batched));
+
+    const std::string remote(getTempPath() + "arbiter-copy-remote/");
+    mkdirp(remote + "a/b");
+    EXPECT_NO_THROW(a.copy("test://" + src, "test://" + remote));
+    for (const auto& f : files) EXPECT_EQ(a.get(remote + f), f);
+    EXPECT_EQ(batched->batches.load(), 1u);
+    EXPECT_EQ(batched->copied.load(), files.size());
+}
+
+TEST(Arbiter, Move)
+{
+    Arbiter a;
+
+    const std::string src(getTempPath() + "arbiter-move-src/");
+    const std::string dst(getTempPath() + "arbiter-move-dst/");
+    mkdirp(src + "a/b");
+    mkdirp(dst);
+
+    std::vector<std::string> files;
+    for (std::size_t i(0); i < 20; ++i)
+    {
+        files.push_back("a/" + std::to_string(i) + ".txt");
+        files.push_back("a/b/" + std::to_string(i) + ".txt");
+    }
+    for (const auto& f : files) a.put(src + f, f);
+
+    EXPECT_NO_THROW(a.move(src, dst));
+    for (const auto& f : files)
+    {
+        EXPECT_EQ(a.get(dst + f), f);
+        EXPECT_FALSE(a.exists(src + f));
+    }
+
+    // A file moved into a directory keeps its basename.
+    a.put(src + "single.txt", "single");
+    EXPECT_NO_THROW(a.move(src + "single.txt", dst));
+    EXPECT_EQ(a.get(dst + "single.txt"), "single");
+    EXPECT_FALSE(a.exists(src + "single.txt"));
+
+    EXPECT_THROW(a.move(src + "nonexistent", dst), ArbiterError);
+
+    // Moves between drivers copy, then remove the sources.
+    a.addDriver("test", std::unique_ptr<Driver>(new drivers::Test()));
+    EXPECT_NO_THROW(a.move(dst, "test://" + src));
+    for (const auto& f : files)
+    {
+        EXPECT_EQ(a.get(src + f), f);
+        EXPECT_FALSE(a.exists(dst + f));
+    }
+}
+
+TEST(Arbiter, Tracer)
+{
+    class Recorder : public Tracer
+    {
+    public:
+        void start(const TraceEvent& e) override { starts.push_back(e); }
+        void end(const TraceEvent& e) override { ends.push_back(e); }
+
+        std::vector<TraceEvent> starts;
+        std::vector<TraceEvent> ends;
+    };
+
+    auto recorder(std::make_shared<Recorder>());
+
+    Arbiter a;
+    a.setTracer(recorder);
+
+    const std::string root(getTempPath() + "arbiter-trace/");
+    mkdirp(root);
+
+    a.put(root + "a.txt", "Hello");
+    EXPECT_EQ(a.get(root + "a.txt"), "Hello");
+    EXPECT_THROW(a.get(root + "nonexistent"), ArbiterError);
+    EXPECT_EQ(a.getEndpoint(root).getSize("a.txt"), 5u);
+
+    ASSERT_EQ(recorder->starts.size(), 4u);
+    ASSERT_EQ(recorder->ends.size(), 4u);
+
+    const auto& ends(recorder->ends);
+    EXPECT_EQ(ends[0].driver, "file");
+    EXPECT_EQ(ends[0].operation, "put");
+    EXPECT_EQ(ends[0].path, root + "a.txt");
+    EXPECT_EQ(ends[0].bytes, 5u);
+    EXPECT_EQ(ends[1].operation, "get");
+    EXPECT_EQ(ends[1].bytes, 5u);
+    EXPECT_FALSE(ends[1].failed);
+    EXPECT_TRUE(ends[2].failed);
+    EXPECT_EQ(ends[3].operation, "getSize");
+    EXPECT_EQ(ends[3].path, root + "a.txt");
+
+    a.setTracer(nullptr);
+    a.get(root + "a.txt");
+    EXPECT_EQ(recorder->ends.size(), 4u);
+}
+
+TEST(Arbiter, RecordReplay)
+{
+    const std::string recording(getTempPath() + "arbiter-record.trace");
+
+    {
+        Arbiter a(json {
+            { "record", { { "path", recording } } }
+        }.dump());
+        a.put("mem://record/a", "a");
+    }
+    EXPECT_EQ(Recorder::parse(Arbiter().get(recording)).size(), 1u);
+
+    {
+        Arbiter a;
+        a.put("mem://record/b", std::string(30, 'b'));
+
+        auto recorder(std::make_shared<Recorder>(recording));
+        a.setTracer(recorder);
+
+        a.put("mem://record/a", std::string(100, 'a'));
+        EXPECT_EQ(a.get("mem://record/a").size(), 100u);
+        EXPECT_EQ(a.getRange("mem://record/b", 10, 20).size(), 20u);
+        EXPECT_TRUE(a.tryGetSize("mem://record/a").get());
+        EXPECT_FALSE(a.tryGet("mem://record/missing"));
+        EXPECT_EQ(a.resolve("mem://record/*").size(), 2u);
+        EXPECT_EQ(recorder->recorded(), 6u);
+    }
+
+    Arbiter a;
+    const std::vector<RecordedOp> ops(Recorder::parse(a.get(recording)));
+    ASSERT_EQ(ops.size(), 6u);
+
+    EXPECT_EQ(ops[0].driver, "mem");
+    EXPECT_EQ(ops[0].operation, "put");
+    EXPECT_EQ(ops[0].path, Recorder::hash("record/a"));
+    EXPECT_EQ(ops[0].bytes, 100u);
+    EXPECT_EQ(ops[1].operation, "get");
+    EXPECT_EQ(ops[1].path, ops[0].path);
+    EXPECT_EQ(ops[2].operation, "getRange");
+    EXPECT_EQ(ops[2].offset, 10u);
+    EXPECT_EQ(ops[2].length, 20u);
+    EXPECT_EQ(ops[2].bytes, 20u);
+    EXPECT_LE(ops[0].start, ops[1].start);
+    EXPECT_EQ(ops[5].operation, "resolve");
+    EXPECT_THROW(Recorder::parse("not a recording"), ArbiterError);
+
+    // The range read of a file which the recording never wrote needs it to
+    // be prepared, and the listing isn't replayed.
+    const Replayer replayer(a, "mem://replay/", json {
+        { "speed", 0 }
+    }.dump());
+    const ReplayResult r(replayer.replay(ops));
+    EXPECT_EQ(r.ops, 5u);
+    EXPECT_EQ(r.skipped, 1u);
+    EXPECT_EQ(r.failures, 0u);
+    EXPECT_EQ(r.threads, Replayer::concurrency({ ops.begin(), ops.end() - 1 }));
+    EXPECT_LE(r.p50, r.max);
+
+    EXPECT_EQ(a.getSize(replayer.pathOf(ops[0].path)), 100u);
+    EXPECT_EQ(a.getSize(replayer.pathOf(ops[2].path)), 30u);
+    EXPECT_FALSE(a.exists(replayer.pathOf(ops[4].path)));
+}
+
+TEST(Arbiter, MappedFile)
+{
+    Arbiter a;
+
+    const std::string root(getTempPath() + "arbiter-map/");
+    mkdirp(root);
+
+    a.put(root + "data.txt", "0123456789");
+    a.put(root + "empty.txt", "");
+
+    auto handle(a.getLocalHandle(root + "data.txt"));
+    const MappedFile& mapped(handle->map());
+    ASSERT_EQ(mapped.size(), 10u);
+    EXPECT_EQ(std::string(mapped.data(), mapped.size()), "0123456789");
+    EXPECT_EQ(&handle->map(), &mapped);
+    EXPECT_FALSE(handle->sparse());
+
+    // Only the requested ranges of a remote file are downloaded.
+    using Ranges = std::vector<std::pair<std::size_t, std::size_t>>;
+    auto sparse(a.getLocalHandle(
+                "test://" + root + "data.txt",
+                Ranges { { 0, 2 }, { 8, 100 } }));
+    ASSERT_TRUE(sparse->sparse());
+    EXPECT_EQ(
+            a.get(sparse->localPath()),
+            std::string("01") + std::string(6, '\0') + "89");
+
+    sparse->fill(4, 2);
+    EXPECT_EQ(
+            a.get(sparse->localPath()),
+            std::string("01") + std::string(2, '\0') + "45" +
+                std::string(2, '\0') + "89");
+    const std::string sparsePath(sparse->localPath());
+    sparse.reset();
+    EXPECT_FALSE(a.exists(sparsePath));
+
+    drivers::Fs fs;
+    EXPECT_EQ(fs.map(root + "empty.txt")->size(), 0u);
+    EXPECT_THROW(fs.map(root + "nonexistent.txt"), ArbiterError);
+}
+
+TEST(Arbiter, AtomicWrites)
+{
+    const std::string root(getTempPath() + "arbiter-atomic/");
+    mkdirp(root);
+    arbiter::remove(root + "b.txt");
+
+    const json c {
+        { "atomic", true }, { "durable", true }, { "preallocate", true }
+    };
+    drivers::Fs fs((drivers::Fs::Config(c.dump())));
+
+    fs.put(root + "a.txt", std::string("Old"));
+    fs.put(root + "a.txt", std::string("New data"));
+    EXPECT_EQ(fs.get(root + "a.txt"), "New data");
+
+    {
+        auto writer(fs.putStream(root + "b.txt"));
+        writer->write("Streamed", 8);
+        EXPECT_FALSE(fs.tryGetSize(root + "b.txt"));
+        writer->done();
+    }
+    EXPECT_EQ(fs.get(root + "b.txt"), "Streamed");
+
+    {
+        // Abandoned writes leave nothing behind.
+        auto writer(fs.putStream(root + "c.txt"));
+        writer->write("Partial", 7);
+    }
+
+    EXPECT_NO_THROW(fs.sync());
+
+    Arbiter a;
+    EXPECT_EQ(a.resolve(root + "*").size(), 2u);
+    EXPECT_EQ(a.resolve(root + ".*").size(), 0u);
+}
+
+TEST(Arbiter, PageCacheHints)
+{
+    const std::string root(getTempPath() + "arbiter-direct/");
+    mkdirp(root);
+
+    // Sizes around the alignment of direct transfers, from which point they
+    // bypass the page cache, where the filesystem allows.
+    const json c { { "file", { { "dropCache", true }, { "direct", 4096 } } } };
+    Arbiter a(c.dump());
+
+    for (const std::size_t size : { 0u, 100u, 4096u, 10000u, 5000000u })
+    {
+        std::vector<char> data(size);
+        for (std::size_t i(0); i < size; ++i) data[i] = i * 7 % 251;
+
+        const std::string path(root + std::to_string(size));
+        a.put(path, data);
+        EXPECT_EQ(a.getBinary(path), data);
+
+        std::vector<char> streamed;
+        a.getDriver(path).getStream(path, [&](const char* d, std::size_t n)
+        {
+            streamed.insert(streamed.end(), d, d + n);
+        });
+        EXPECT_EQ(streamed, data);
+
+        a.copy(path, path + "-copy");
+        EXPECT_EQ(a.getBinary(path + "-copy"), data);
+    }
+
+    EXPECT_FALSE(a.tryGetBinary(root + "nonexistent"));
+}
+
+TEST(Arbiter, Cache)
+{
+    const std::string root(getTempPath() + "arbiter-cache-src/");
+    const std::string dir(getTempPath() + "arbiter-cache-test/");
+    mkdirp(root);
+    for (const std::string& p : glob(dir + "*")) arbiter::remove(p);
+
+    const json c { { "cache", { { "dir", dir }, { "maxSize", 10 } } } };
+    Arbiter a(c.dump());
+    drivers::Fs fs;
+
+    // The test driver is remote, so it is cached by default.
+    const std::string path("test://" + root + "a.txt");
+    a.put(path, "12345");
+    EXPECT_EQ(a.get(path), "12345");
+    EXPECT_EQ(glob(dir + "*.json").size(), 1u);
+
+    // Changes at the source are revalidated.
+    fs.put(root + "a.txt", std::string("abcdefg"));
+    EXPECT_EQ(a.get(path), "abcdefg");
+
+    std::string streamed;
+    a.getDriver(path).getStream(root + "a.txt", [&](
+                const char* d,
+                std::size_t n)
+    {
+        streamed.append(d, n);
+    });
+    EXPECT_EQ(streamed, "abcdefg");
+    EXPECT_EQ(a.getRange(path, 2, 3), std::vector<char>({ 'c', 'd', 'e' }));
+
+    // Beyond the size limit, the least recently used copy is evicted.
+    a.put("test://" + root + "b.txt", "1234");
+    EXPECT_EQ(a.get("test://" + root + "b.txt"), "1234");
+    EXPECT_EQ(glob(dir + "*.json").size(), 1u);
+
+    // Copies persist across instances, and without revalidation they are
+    // used as they are.
+    fs.put(root + "b.txt", std::string("5678"));
+    json d(c);
+    d["cache"]["revalidate"] = false;
+    Arbiter b(d.dump());
+    EXPECT_EQ(b.get("test://" + root + "b.txt"), "1234");
+    EXPECT_EQ(a.get("test://" + root + "b.txt"), "5678");
+}
+
+TEST(Arbiter, Coalescing)
+{
+    class Slow : public drivers::Test
+    {
+    public:
+        virtual std::string type() const override { return "slow"; }
+
+        mutable std::atomic<std::size_t> reads;
+
+    protected:
+        virtual bool get(std::string path, std::vector<char>& data)
+            const override
+        {
+            ++reads;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            return drivers::Test::get(path, data);
+        }
+    };
+
+    const std::string root(getTempPath() + "arbiter-coalesce/");
+    mkdirp(root);
+
+    Arbiter a;
+    Slow* slow(new Slow());
+    slow->reads = 0;
+    a.addDriver("slow", std::unique_ptr<Driver>(slow));
+
+    const std::string path("slow://" + root + "a.txt");
+    a.put(path, "shared");
+
+    // Identical reads at once share one request, but are otherwise separate.
+    parallelFor(8, 8, [&](std::size_t i)
+    {
+        if (i % 2) EXPECT_EQ(a.get(path), "shared");
+        else EXPECT_EQ(a.getBinary(path).size(), 6u);
+    });
+    EXPECT_LT(slow->reads, 8u);
+
+    const std::size_t before(slow->reads);
+    EXPECT_EQ(a.get(path), "shared");
+    EXPECT_EQ(slow->reads, before + 1);
+
+    std::vector<std::future<std::unique_ptr<std::string>>> missing;
+    for (std::size_t i(0); i < 4; ++i)
+    {
+        missing.push_back(std::async(std::launch::async, [&]()
+        {
+            return a.tryGet("slow://" + root + "nonexistent");
+        }));
+    }
+    for (auto& f : missing) EXPECT_FALSE(f.get());
+}
+
+TEST(Arbiter, Batch)
+{
+    const std::string root(getTempPath() + "arbiter-batch/");
+    mkdirp(root);
+    arbiter::remove(root + "missing.txt");
+
+    Arbiter a;
+
+    std::vector<std::pair<std::string, std::vector<char>>> items;
+    std::vector<std::string> paths;
+    for (std::size_t i(0); i < 16; ++i)
+    {
+        const std::string path(
+                (i % 2 ? "test://" : "") + root + std::to_string(i));
+        items.emplace_back(path, std::vector<char>(i, 'a'));
+        paths.push_back(path);
+    }
+
+    for (const auto& r : a.putMany(items)) EXPECT_TRUE(r.ok());
+
+    {
+        const std::string missing("test://" + root + "missing");
+        const auto handles(a.getLocalHandleMany(
+                    { paths[1], paths[3], missing, paths[0] }));
+        ASSERT_EQ(handles.size(), 4u);
+        ASSERT_TRUE(handles[0].ok());
+        ASSERT_TRUE(handles[1].ok());
+        EXPECT_FALSE(handles[2].ok());
+        ASSERT_TRUE(handles[3].ok());
+
+        EXPECT_NE(handles[0].value->localPath(), root + "1");
+        EXPECT_EQ(a.getSize(handles[0].value->localPath()), 1u);
+        EXPECT_EQ(a.getSize(handles[1].value->localPath()), 3u);
+        EXPECT_EQ(handles[3].value->localPath(), root + "0");
+    }
+
+    // Failures are reported per item, without affecting the others.
+    paths.push_back(root + "missing.txt");
+    paths.push_back("nodriver://" + root + "0");
+
+    const auto data(a.getMany(paths));
+    const auto sizes(a.getSizeMany(paths));
+    ASSERT_EQ(data.size(), paths.size());
+    ASSERT_EQ(sizes.size(), paths.size());
+
+    for (std::size_t i(0); i < items.size(); ++i)
+    {
+        ASSERT_TRUE(data[i].ok());
+        EXPECT_EQ(data[i].value, items[i].second);
+        ASSERT_TRUE(sizes[i].ok());
+        EXPECT_EQ(sizes[i].value, i);
+    }
+
+    for (std::size_t i(items.size()); i < paths.size(); ++i)
+    {
+        EXPECT_FALSE(data[i].ok());
+        EXPECT_FALSE(sizes[i].ok());
+        EXPECT_THROW(std::rethrow_exception(data[i].error), ArbiterError);
+    }
+
+    // Existence is answered for the paths of each driver together.
+    const auto found(a.existsMany(paths));
+    ASSERT_EQ(found.size(), paths.size());
+    for (std::size_t i(0); i < items.size(); ++i)
+    {
+        ASSERT_TRUE(found[i].ok());
+        EXPECT_TRUE(found[i].value);
+    }
+    ASSERT_TRUE(found[items.size()].ok());
+    EXPECT_FALSE(found[items.size()].value);
+    EXPECT_FALSE(found.back().ok());
+
+    // Directories holding many of the paths are answered by listing them.
+    {
+        const std::string dense(root + "dense/");
+        mkdirp(dense);
+
+        std::vector<std::string> queried;
+        for (std::size_t i(0); i < 24; ++i)
+        {
+            const std::string path(dense + std::to_string(i));
+            if (i % 3) a.put(path, std::string(i, 'a'));
+            else arbiter::remove(path);
+            queried.push_back(path);
+        }
+
+        const auto listed(a.existsMany(queried));
+        ASSERT_EQ(listed.size(), queried.size());
+        for (std::size_t i(0); i < queried.size(); ++i)
+        {
+            ASSERT_TRUE(listed[i].ok());
+            EXPECT_EQ(listed[i].value, i % 3 != 0) << queried[i];
+        }
+
+        a.removeMany(queried);
+        arbiter::remove(dense);
+    }
+
+    // Removing a file which doesn't exist is not an error.
+    const auto removed(a.removeMany(paths));
+    ASSERT_EQ(removed.size(), paths.size());
+    for (std::size_t i(0); i + 1 < paths.size(); ++i)
+    {
+        EXPECT_TRUE(removed[i].ok());
+        EXPECT_FALSE(a.exists(paths[i]));
+    }
+    EXPECT_FALSE(removed.back().ok());
+
+    a.put(root + "single", "a");
+    a.remove(root + "single");
+    EXPECT_FALSE(a.exists(root + "single"));
+    a.remove(root + "single");
+}
+
+TEST(Arbiter, CopyResumable)
+{
+    const std::string root(getTempPath() + "arbiter-resumable/");
+    const std::string src(root + "src/");
+    const std::string dst(root + "dst/");
+    mkdirp(src + "sub/");
+
+    Arbiter a;
+    a.removeMany(a.resolve(root + "**"));
+
+    a.put(src + "a", "a");
+    a.put(src + "b", "b");
+    a.put(src + "sub/c", "c");
+
+    // A journal left by an interrupted copy skips the files it records.
+    const std::string journal("mem://journal/");
+    a.put(journal + "000000000000", "a\nsub/c\n");
+
+    a.copyResumable(src, dst, journal);
+    EXPECT_FALSE(a.exists(dst + "a"));
+    EXPECT_EQ(a.get(dst + "b"), "b");
+    EXPECT_FALSE(a.exists(dst + "sub/c"));
+    EXPECT_TRUE(a.resolve(journal + "*").empty());
+
+    // Without one, everything is copied.
+    a.copyResumable(src, dst, root + "journal/");
+    EXPECT_EQ(a.get(dst + "a"), "a");
+    EXPECT_EQ(a.get(dst + "sub/c"), "c");
+}
+
+TEST(Arbiter, Sync)
+{
+    const std::string root(getTempPath() + "arbiter-sync/");
+    const std::string src(root + "src/");
+    const std::string dst(root + "dst/");
+    mkdirp(src + "sub/");
+
+    Arbiter a;
+    a.removeMany(a.resolve(root + "**"));
+
+    a.put(src + "a", "a");
+    a.put(src + "sub/b", "bb");
+
+    SyncResult result(a.sync(src, dst));
+    EXPECT_EQ(result.copied, 2u);
+    EXPECT_EQ(a.get(dst + "sub/b"), "bb");
+
+    // Only new or changed files are copied again.
+    a.put(src + "c", "c");
+    a.put(src + "sub/b", "bbb");
+    a.put(dst + "extra", "x");
+
+    result = a.sync(src, dst);
+    EXPECT_EQ(result.copied, 2u);
+    EXPECT_EQ(result.skipped, 1u);
+    EXPECT_EQ(result.removed, 0u);
+    EXPECT_EQ(a.get(dst + "sub/b"), "bbb");
+    EXPECT_TRUE(a.exists(dst + "extra"));
+
+    // Files matching by version are unchanged between drivers of a type.
+    result = a.sync(src, "mem://sync/");
+    EXPECT_EQ(result.copied, 3u);
+    result = a.sync("mem://sync/", "mem://mirror/");
+    EXPECT_EQ(result.copied, 3u);
+    result = a.sync("mem://sync/", "mem://mirror/");
+    EXPECT_EQ(result.copied, 0u);
+    EXPECT_EQ(result.skipped, 3u);
+
+    // Pruning removes destination files missing from the source.
+    result = a.sync(src, dst, true);
+    EXPECT_EQ(result.copied, 0u);
+    EXPECT_EQ(result.skipped, 3u);
+    EXPECT_EQ(result.removed, 1u);
+    EXPECT_FALSE(a.exists(dst + "extra"));
+}
+
+TEST(Arbiter, Progress)
+{
+    const std::string src(getTempPath() + "arbiter-progress/");
+    mkdirp(src + "sub/");
+
+    Arbiter a;
+    a.removeMany(a.resolve(src + "**"));
+    a.put(src + "a", "a");
+    a.put(src + "sub/b", "bb");
+
+    std::mutex mutex;
+    std::vector<ProgressReport> reports;
+    Progress progress([&](const ProgressReport& r)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reports.push_back(r);
+    }, std::chrono::seconds(0));
+
+    {
+        ProgressScope scope(progress);
+        EXPECT_EQ(a.sync(src, "mem://progress/").copied, 2u);
+    }
+
+    // Local bytes are counted as they are read, on the threads of the copy.
+    const ProgressReport r(progress.report());
+    EXPECT_EQ(r.files, 2u);
+    EXPECT_EQ(r.totalFiles, 2u);
+    EXPECT_EQ(r.bytes, 3u);
+    EXPECT_EQ(r.totalBytes, 3u);
+    EXPECT_EQ(r.eta, 0);
+    EXPECT_FALSE(reports.empty());
+
+    // Without a scope, nothing is counted.
+    a.copy(src, "mem://unwatched/");
+    EXPECT_EQ(progress.report().files, 2u);
+}
+
+TEST(Arbiter, Prefetch)
+{
+    class Counted : public drivers::Test
+    {
+    public:
+        virtual std::string type() const override { return "counted"; }
+
+        mutable std::atomic<std::size_t> reads;
+
+    protected:
+        virtual bool get(std::string path, std::vector<char>& data)
+            const override
+        {
+            ++reads;
+            return drivers::Test::get(path, data);
+        }
+    };
+
+    const std::string root(getTempPath() + "arbiter-prefetch/");
+    mkdirp(root);
+    arbiter::remove(root + "missing.txt");
+
+    const json c { { "prefetch", { { "window", 2 } } } };
+    Arbiter a(c.dump());
+    Counted* counted(new Counted());
+    counted->reads = 0;
+    a.addDriver("counted", std::unique_ptr<Driver>(counted));
+
+    std::vector<std::string> paths;
+    for (std::size_t i(0); i < 6; ++i)
+    {
+        paths.push_back("counted://" + root + std::to_string(i));
+        a.put(paths.back(), std::to_string(i));
+    }
+    paths.push_back("counted://" + root + "missing.txt");
+
+    // Each prefetched path is read once, and served once.
+    a.prefetch(paths);
+    for (std::size_t i(0); i < 6; ++i)
+    {
+        EXPECT_EQ(a.get(paths[i]), std::to_string(i));
+    }
+    EXPECT_FALSE(a.tryGet(paths.back()));
+    EXPECT_EQ(counted->reads, 7u);
+
+    EXPECT_EQ(a.get(paths[0]), "0");
+    EXPECT_EQ(counted->reads, 8u);
+
+    // Writes drop prefetched data.
+    const Endpoint ep(a.getEndpoint("counted://" + root));
+    ep.prefetch({ "0", "1" });
+    ep.put("0", std::string("new"));
+    EXPECT_EQ(ep.get("0"), "new");
+    EXPECT_EQ(a.get(paths[1]), "1");
+}
+
+TEST(Arbiter, Logging)
+{
+    class Captured : public LogSink
+    {
+    public:
+        virtual void write(LogLevel level, const std::string& message)
+            override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            messages.emplace_back(level, message);
+        }
+
+        std::mutex mutex;
+        std::vector<std::pair<LogLevel, std::string>> messages;
+    };
+
+    auto captured(std::make_shared<Captured>());
+    logging::setSink(captured);
+    logging::setLevel(LogLevel::Warning);
+
+    // Verbose listings are logged at the level of information.
+    const std::string root(getTempPath() + "arbiter-logging/");
+    mkdirp(root);
+    Arbiter a;
+    a.resolve(root + "*", true);
+    logging::warn("warned");
+    EXPECT_FALSE(logging::enabled(LogLevel::Info));
+    ASSERT_EQ(captured->messages.size(), 1u);
+    EXPECT_EQ(captured->messages[0].second, "warned");
+
+    // Beyond the rate, messages are counted rather than logged.
+    captured->messages.clear();
+    logging::setRate(1, 3);
+    for (int i(0); i < 10; ++i) logging::error(std::to_string(i));
+    EXPECT_EQ(captured->messages.size(), 3u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    logging::error("later");
+    ASSERT_EQ(captured->messages.size(), 5u);
+    EXPECT_EQ(captured->messages[3].second, "7 log messages suppressed");
+    EXPECT_EQ(captured->messages[4].second, "later");
+
+    logging::setSink(nullptr);
+    logging::setLevel(LogLevel::Info);
+    logging::setRate(100, 100);
+
+    // The asynchronous sink writes lines in order.
+    std::ostringstream stream;
+    {
+        AsyncLogSink sink(stream);
+        sink.write(LogLevel::Info, "a");
+        sink.write(LogLevel::Error, "b");
+        sink.flush();
+        EXPECT_EQ(stream.str(), "a\nerror: b\n");
+        sink.write(LogLevel::Info, "c");
+    }
+    EXPECT_EQ(stream.str(), "a\nerror: b\nc\n");
+}
+
+TEST(Arbiter, SlowLog)
+{
+    std::vector<SlowRequest> reports;
+    auto capture([&reports](const SlowRequest& req)
+    {
+        reports.push_back(req);
+    });
+
+    // Sampled reports are spread evenly.
+    SlowLog sampled(SlowLog::Duration(0), 0.25);
+    sampled.setCallback(capture);
+    for (int i(0); i < 8; ++i) sampled.report(SlowRequest());
+    EXPECT_EQ(reports.size(), 2u);
+
+    EXPECT_FALSE(SlowLog::create(""));
+    EXPECT_EQ(
+            SlowLog::create(R"({ "threshold": 5 })")->threshold(),
+            std::chrono::milliseconds(5));
+
+    const std::string root(getTempPath() + "arbiter-slowlog/");
+    mkdirp(root);
+
+    reports.clear();
+    const auto fs(drivers::Fs::create(R"({ "slowLog": { "threshold": 0 } })"));
+    fs->slowLog()->setCallback(capture);
+    fs->put(root + "a.txt", std::string("hello"));
+    EXPECT_EQ(fs->get(root + "a.txt"), "hello");
+    EXPECT_EQ(fs->getRange(root + "a.txt", 1, 2), std::vector<char>(
+                { 'e', 'l' }));
+
+    ASSERT_EQ(reports.size(), 3u);
+    EXPECT_EQ(reports[0].source, "file");
+    EXPECT_EQ(reports[0].operation, "write");
+    EXPECT_EQ(reports[0].bytes, 5u);
+    EXPECT_EQ(reports[1].operation, "read");
+    EXPECT_EQ(reports[1].path, root + "a.txt");
+    EXPECT_EQ(reports[2].operation, "range");
+    EXPECT_EQ(reports[2].bytes, 2u);
+
+    // Without a slow log, nothing is timed.
+    EXPECT_FALSE(drivers::Fs::create()->slowLog());
+}
+
+TEST(Arbiter, Registration)
+{
+    Arbiter a;
+    a.put("mem://a", "a");
+
+    // Drivers are added and replaced while requests are routed.
+    a.addDriver("tenant0", std::unique_ptr<Driver>(new drivers::Memory()));
+
+    std::atomic<bool> done(false);
+    std::thread reader([&]()
+    {
+        while (!done)
+        {
+            EXPECT_EQ(a.get("mem://a"), "a");
+            EXPECT_TRUE(a.hasDriver("tenant0://"));
+        }
+    });
+
+    for (std::size_t i(0); i < 100; ++i)
+    {
+        const std::string type("tenant" + std::to_string(i % 10));
+        a.addDriver(type, std::unique_ptr<Driver>(new drivers::Memory()));
+        a.put(type + "://x", std::to_string(i));
+        EXPECT_EQ(a.get(type + "://x"), std::to_string(i));
+    }
+
+    done = true;
+    reader.join();
+
+    // The last driver of each type is the one in use.
+    EXPECT_EQ(a.get("tenant3://x"), "93");
+    EXPECT_EQ(a.get("mem://a"), "a");
+}
+
+TEST(Arbiter, MetadataCache)
+{
+    const std::string root(getTempPath() + "arbiter-metadata/");
+    mkdirp(root);
+    arbiter::remove(root + "b.txt");
+
+    const json c { { "metadata", { { "ttl", 60 }, { "negativeTtl", 60 } } } };
+    Arbiter a(c.dump());
+    drivers::Fs fs;
+
+    const std::string path("test://" + root + "a.txt");
+    a.put(path, "12345");
+    EXPECT_EQ(a.getSize(path), 5u);
+
+    // Lookups, including of paths not found, are answered from the cache.
+    fs.put(root + "a.txt", std::string("1234567"));
+    EXPECT_EQ(a.getSize(path), 5u);
+    EXPECT_FALSE(a.exists("test://" + root + "b.txt"));
+    fs.put(root + "b.txt", std::string("1"));
+    EXPECT_FALSE(a.exists("test://" + root + "b.txt"));
+
+    // Complete reads and our own writes refresh them.
+    EXPECT_EQ(a.get(path), "1234567");
+    EXPECT_EQ(a.getSize(path), 7u);
+    a.put("test://" + root + "b.txt", "12");
+    EXPECT_EQ(a.getSize("test://" + root + "b.txt"), 2u);
+
+    // Listings record existence, and sizes where they include them.
+    arbiter::remove(root + "c.txt");
+    Arbiter b(c.dump());
+    fs.put(root + "c.txt", std::string("123"));
+    EXPECT_EQ(b.resolve("test://" + root + "*").size(), 3u);
+    arbiter::remove(root + "c.txt");
+    EXPECT_TRUE(b.exists("test://" + root + "c.txt"));
+    EXPECT_EQ(b.getSize("test://" + root + "c.txt"), 3u);
+}
+
+TEST(Arbiter, BlockCache)
+{
+    const std::string root(getTempPath() + "arbiter-blocks/");
+    mkdirp(root);
+
+    const json c { { "blocks", { { "blockSize", 4 } } } };
+    Arbiter a(c.dump());
+    drivers::Fs fs;
+
+    const std::string path("test://" + root + "a.txt");
+    a.put(path, "0123456789");
+
+    auto range([&](std::size_t offset, std::size_t length)
+    {
+        const std::vector<char> v(a.getRange(path, offset, length));
+        return std::string(v.begin(), v.end());
+    });
+
+    EXPECT_EQ(range(2, 6), "234567");
+
+    // Cached blocks are served without rereading the source, while the rest
+    // of a range is read on demand.
+    fs.put(root + "a.txt", std::string("abcdefghij"));
+    EXPECT_EQ(range(0, 10), "01234567ij");
+    EXPECT_EQ(range(9, 100), "j");
+    EXPECT_EQ(range(10, 5), "");
+
+    // Writes drop the cached blocks.
+    a.put(path, "abcdefghij");
+    EXPECT_EQ(range(0, 10), "abcdefghij");
+
+    // Concurrent misses for the same blocks are fetched once.
+    BlockCache cache(4, 1024, 2);
+    std::atomic<std::size_t> fetched(0);
+    parallelFor(16, 8, [&](std::size_t)
+    {
+        const std::vector<char> v(cache.get("k", 1, 10, [&](
+                        std::size_t,
+                        std::size_t length)
+        {
+            fetched += length / 4;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            return std::vector<char>(length, 'x');
+        }));
+        EXPECT_EQ(v.size(), 10u);
+    });
+    EXPECT_EQ(fetched, 3u);
+
+    // Caches attached to the same shared blocks, as those of separate
+    // processes would be, fetch each block once between them.
+    const std::string table(root + "shared");
+    const json sharing {
+        { "blockSize", 4 },
+        { "shared", { { "path", table }, { "slots", 64 } } }
+    };
+    auto first(BlockCache::create(sharing.dump()));
+    auto second(BlockCache::create(sharing.dump()));
+
+    const std::string object("0123456789");
+    std::size_t reads(0);
+    auto source([&](std::size_t offset, std::size_t length)
+    {
+        ++reads;
+        offset = (std::min)(offset, object.size());
+        length = (std::min)(length, object.size() - offset);
+        return std::vector<char>(
+                object.begin() + offset,
+                object.begin() + offset + length);
+    });
+
+    auto str([](const std::vector<char>& v)
+    {
+        return std::string(v.begin(), v.end());
+    });
+
+    EXPECT_EQ(str(first->get("s", 2, 100, source)), "23456789");
+    EXPECT_EQ(reads, 1u);
+    EXPECT_EQ(str(second->get("s", 0, 100, source)), "0123456789");
+    EXPECT_EQ(reads, 1u);
+    EXPECT_EQ(second->sharedHits(), 3u);
+
+    // Erasing an object drops its shared blocks too.
+    first->erase("s");
+    auto third(BlockCache::create(sharing.dump()));
+    EXPECT_EQ(str(third->get("s", 0, 4, source)), "0123");
+    EXPECT_EQ(reads, 2u);
+
+    // The layout of an existing table must match.
+    json other(sharing);
+    other["blockSize"] = 8;
+    EXPECT_THROW(BlockCache::create(other.dump()), ArbiterError);
+
+    first.reset();
+    second.reset();
+    third.reset();
+    remove(table);
+}
+
+TEST(Arbiter, ParallelFor)
+{
+    std::vector<int> hits(100, 0);
+    parallelFor(hits.size(), 4, [&](std::size_t i) { ++hits[i]; });
+    EXPECT_EQ(std::count(hits.begin(), hits.end(), 1), 100);
+
+    EXPECT_THROW(
+            parallelFor(10, 4, [](std::size_t i)
+            {
+                if (i == 5) throw ArbiterError("Failed");
+            }),
+            ArbiterError);
+
+    // Nested loops on a shared executor run on its workers, and don't
+    // deadlock waiting on each other even when they outnumber them.
+    auto executor(std::make_shared<Executor>(2));
+    std::atomic<int> inner(0);
+    std::atomic<int> foreign(0);
+
+    parallelFor(8, 4, [&](std::size_t)
+    {
+        parallelFor(8, 4, [&](std::size_t)
+        {
+            ++inner;
+            if (Executor::current() &&
+                Executor::current() != executor.get())
+            {
+                ++foreign;
+            }
+        }, executor.get());
+    }, executor.get());
+
+    EXPECT_EQ(inner.load(), 64);
+    EXPECT_EQ(foreign.load(), 0);
+
+    Arbiter a("{}", executor);
+    EXPECT_EQ(&a.executor(), executor.get());
+}
+
+TEST(Arbiter, Affinity)
+{
+    const std::vector<unsigned> cpus { 0, 1, 2, 3, 8, 10 };
+    EXPECT_EQ(Affinity::parse("0-3,8, 10"), cpus);
+    EXPECT_EQ(Affinity::create("\"0-3,8,10\"").cpus(), cpus);
+    EXPECT_EQ(Affinity::create("[10, 8, 3, 2, 1, 0, 0]").cpus(), cpus);
+    EXPECT_TRUE(Affinity::create("").empty());
+    EXPECT_FALSE(Affinity().apply());
+
+    EXPECT_THROW(Affinity::parse("3-1"), ArbiterError);
+    EXPECT_THROW(Affinity::parse("1-"), ArbiterError);
+    EXPECT_THROW(Affinity::parse("a"), ArbiterError);
+    EXPECT_THROW(Affinity::create("{ \"cpus\": 1 }"), ArbiterError);
+    EXPECT_THROW(Affinity::create("{ \"node\": 100000 }"), ArbiterError);
+
+    // Pinned workers still run their tasks, wherever they are allowed.
+    Executor executor(2, Affinity(Affinity::parse("0")));
+    auto f(executor.async([]() { return 42; }));
+    EXPECT_EQ(f.get(), 42);
+
+    Arbiter a(R"({ "affinity": { "workers": "0", "compute": [0] } })");
+    auto g(a.executor().async([]() { return 1; }));
+    EXPECT_EQ(g.get(), 1);
+    EXPECT_THROW(Arbiter(R"({ "affinity": { "io": "x" } })"), ArbiterError);
+}
+
+TEST(Arbiter, BufferPool)
+{
+    http::SlabPool pool(1024 * 1024);
+
+    // Requests are rounded up to their class, of at least 64 KiB.
+    std::vector<char> a(pool.acquire(100));
+    EXPECT_GE(a.capacity(), 64u * 1024);
+    EXPECT_EQ(pool.misses(), 1u);
+
+    a.assign(100, 'a');
+    const std::size_t capacity(a.capacity());
+    pool.release(std::move(a));
+    EXPECT_EQ(pool.idle(), capacity);
+
+    // A released buffer serves the next request of its class, empty.
+    std::vector<char> b(pool.acquire(1000));
+    EXPECT_TRUE(b.empty());
+    EXPECT_EQ(b.capacity(), capacity);
+    EXPECT_EQ(pool.hits(), 1u);
+    EXPECT_EQ(pool.idle(), 0u);
+
+    // Beyond the idle limit, released buffers are freed.
+    std::vector<char> big(pool.acquire(2 * 1024 * 1024));
+    pool.release(std::move(big));
+    EXPECT_EQ(pool.idle(), 0u);
+
+    EXPECT_FALSE(!!http::SlabPool::create(""));
+    EXPECT_FALSE(!!http::SlabPool::create("false"));
+    EXPECT_TRUE(!!http::SlabPool::create("true"));
+    EXPECT_TRUE(!!http::SlabPool::create(R"({ "maxIdle": 1024 })"));
+}
+
+TEST(Arbiter, PoolCheckout)
+{
+    // Handles are checked out without locking unless the pool is exhausted,
+    // but never more at once than the pool holds.
+    http::Pool pool(4, 0, "");
+    std::atomic<int> held(0);
+    std::atomic<int> most(0);
+
+    std::vector<std::thread> threads;
+    for (int t(0); t < 16; ++t)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int i(0); i < 1000; ++i)
+            {
+                http::Resource resource(pool.acquire());
+                const int now(++held);
+                int prev(most);
+                while (now > prev && !most.compare_exchange_weak(prev, now)) { }
+                --held;
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    EXPECT_LE(most, 4);
+    EXPECT_EQ(pool.stats().inFlight, 0u);
+
+    std::uint64_t waits(0);
+    for (const auto w : pool.stats().waits) waits += w;
+    EXPECT_EQ(waits, 16000u);
+}
+
+TEST(Arbiter, PoolResize)
+{
+    http::Pool pool(2, 0, "");
+
+    // Growing takes effect right away.
+    pool.resize(4);
+    EXPECT_EQ(pool.size(), 4u);
+    std::vector<std::unique_ptr<http::Resource>> held;
+    for (int i(0); i < 4; ++i)
+    {
+        held.emplace_back(new http::Resource(pool.acquire()));
+    }
+    EXPECT_EQ(pool.stats().inFlight, 4u);
+
+    // Shrinking leaves requests in flight undisturbed, retiring their
+    // handles as they complete.
+    pool.resize(1);
+    EXPECT_EQ(pool.size(), 1u);
+    held.clear();
+    EXPECT_EQ(pool.stats().inFlight, 0u);
+
+    held.emplace_back(new http::Resource(pool.acquire()));
+    std::atomic<bool> acquired(false);
+    std::thread t([&]()
+    {
+        http::Resource resource(pool.acquire());
+        acquired = true;
+    });
+
+    while (!pool.stats().queued)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_FALSE(acquired);
+    held.clear();
+    t.join();
+    EXPECT_TRUE(acquired);
+
+    EXPECT_THROW(pool.resize(0), ArbiterError);
+    EXPECT_THROW(pool.resize(1024 * 1024), ArbiterError);
+
+    // As with per-host limits, whose handles are checked out under a lock.
+    http::Pool hosts(2, 0, R"({ "http": { "perHost": 8 } })");
+    hosts.resize(3);
+    for (int i(0); i < 3; ++i)
+    {
+        held.emplace_back(new http::Resource(hosts.acquire()));
+    }
+    hosts.resize(1);
+    held.clear();
+    EXPECT_EQ(hosts.stats().inFlight, 0u);
+    EXPECT_EQ(hosts.size(), 1u);
+
+    // An adaptive limit manages its own concurrency.
+    http::Pool adaptive(2, 0, R"({ "http": { "adaptive": true } })");
+    EXPECT_THROW(adaptive.resize(4), ArbiterError);
+}
+
+TEST(Arbiter, PoolPriority)
+{
+    // Once the pool is exhausted, an interactive request is served ahead of
+    // bulk requests which have been waiting longer.
+    http::Pool pool(1, 0, "");
+    std::unique_ptr<http::Resource> held(
+            new http::Resource(pool.acquire()));
+
+    std::mutex mutex;
+    std::vector<Priority> order;
+
+    auto waitFor([&pool](std::size_t n)
+    {
+        while (pool.stats().queued < n)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::vector<std::thread> threads;
+    auto add([&](Priority p)
+    {
+        threads.emplace_back([&, p]()
+        {
+            PriorityScope scope(p);
+            http::Resource resource(pool.acquire());
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(p);
+        });
+    });
+
+    for (std::size_t i(0); i < 3; ++i) add(Priority::Bulk);
+    waitFor(3);
+    add(Priority::Interactive);
+    waitFor(4);
+
+    held.reset();
+    for (auto& t : threads) t.join();
+
+    ASSERT_EQ(order.size(), 4u);
+    EXPECT_EQ(order.front(), Priority::Interactive);
+    EXPECT_EQ(pool.stats().queued, 0u);
+
+    // The priority is carried along to the threads of concurrent work.
+    PriorityScope scope(Priority::Bulk);
+    std::atomic<int> bulk(0);
+    parallelFor(8, 4, [&bulk](std::size_t)
+    {
+        if (PriorityScope::current() == Priority::Bulk) ++bulk;
+    });
+    EXPECT_EQ(bulk, 8);
+}
+
+TEST(Arbiter, RateLimit)
+{
+    using ms = std::chrono::milliseconds;
+    auto millis([](http::RateLimit::Clock::duration d)
+    {
+        return std::chrono::duration_cast<ms>(d).count();
+    });
+
+    // A burst of up to 64 KiB passes without pausing, beyond which the
+    // pause covers the deficit at the rate.
+    http::RateLimit limit(64 * 1024);
+    EXPECT_EQ(millis(limit.take(64 * 1024)), 0);
+    EXPECT_NEAR(millis(limit.take(32 * 1024)), 500, 50);
+    EXPECT_NEAR(millis(limit.take(32 * 1024)), 1000, 50);
+
+    EXPECT_THROW(http::RateLimit(0), ArbiterError);
+}
+
+TEST(Arbiter, WriteBehind)
+{
+    // Uploads complete only when the test says so.
+    std::mutex mutex;
+    std::map<std::string, std::string> stored;
+    std::map<std::string, Completion<void>> uploads;
+
+    WriteBehind queue(
+            [&](
+                const std::string& path,
+                std::vector<char> data,
+                Completion<void> done)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stored[path] = std::string(data.begin(), data.end());
+                uploads[path] = done;
+            },
+            100);
+
+    auto finish([&](const std::string& path, bool ok)
+    {
+        Completion<void> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = uploads.at(path);
+            uploads.erase(path);
+        }
+        complete(done, [ok]()
+        {
+            if (!ok) throw ArbiterError("Failed");
+        });
+    });
+
+    queue.put("a", std::vector<char>(60, 'a'));
+    queue.put("b", std::vector<char>(30, 'b'));
+    EXPECT_EQ(queue.pending(), 90u);
+
+    // Past the limit, a put waits for room.
+    std::atomic<bool> put(false);
+    std::thread producer([&]()
+    {
+        queue.put("c", std::vector<char>(40, 'c'));
+        put = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(put.load());
+
+    finish("a", true);
+    producer.join();
+    EXPECT_TRUE(put.load());
+
+    // Puts to a path in flight are held, the latest replacing the others.
+    queue.put("b", { '1' });
+    queue.put("b", { '2' });
+    EXPECT_EQ(queue.pending(), 71u);
+    EXPECT_EQ(stored["b"], std::string(30, 'b'));
+
+    finish("b", true);
+    EXPECT_EQ(stored["b"], "2");
+
+    finish("b", false);
+    finish("c", true);
+
+    EXPECT_THROW(queue.flush(), ArbiterError);
+    EXPECT_NO_THROW(queue.flush());
+    EXPECT_EQ(queue.pending(), 0u);
+
+    // Through an Arbiter, the last write to each path wins.
+    Arbiter a;
+    const std::string root(getTempPath() + "arbiter-write-behind/");
+    mkdirp(root);
+
+    for (int i(0); i < 32; ++i)
+    {
+        const std::string data(std::to_string(i));
+        a.putBehind(
+                root + std::to_string(i % 4),
+                std::vector<char>(data.begin(), data.end()));
+    }
+    a.flush();
+
+    for (int i(0); i < 4; ++i)
+    {
+        EXPECT_EQ(a.get(root + std::to_string(i)), std::to_string(28 + i));
+    }
+
+    a.putBehind("nonexistent-type://a", { 'a' });
+    EXPECT_THROW(a.flush(), ArbiterError);
+
+    // A spool recovers the latest unresolved entry for each path, ignoring
+    // one torn as it was appended.
+    const std::string spoolDir(root + "spool/");
+    auto spoolFiles([&]() { return glob(spoolDir + "*").size(); });
+    for (const std::string& f : glob(spoolDir + "*")) arbiter::remove(f);
+    {
+        Spool spool(spoolDir, 64);
+        const std::string x("x1"), y("y"), z("x2");
+        spool.append("x", x.data(), x.size());
+        const std::uint64_t done(spool.append("y", y.data(), y.size()));
+        spool.append("x", z.data(), z.size());
+        spool.resolve(done);
+        EXPECT_EQ(spool.pending(), 2u);
+    }
+    {
+        const std::vector<std::string> segments(glob(spoolDir + "*.spool"));
+        ASSERT_EQ(segments.size(), 1u);
+        std::ofstream torn(segments[0], std::ios::binary | std::ios::app);
+        torn << "torn";
+    }
+    {
+        Spool spool(spoolDir, 64);
+        EXPECT_EQ(spool.pending(), 1u);
+        const std::vector<Spool::Entry> entries(spool.recover());
+        ASSERT_EQ(entries.size(), 1u);
+        EXPECT_EQ(entries[0].path, "x");
+        EXPECT_EQ(std::string(entries[0].data.begin(), entries[0].data.end()),
+                "x2");
+        spool.resolve(entries[0].id);
+        EXPECT_EQ(spool.pending(), 0u);
+        EXPECT_EQ(spoolFiles(), 0u);
+    }
+
+    // Spooled writes left unfinished are made by the next Arbiter with the
+    // same spool.
+    {
+        WriteBehind failing(
+                [](
+                    const std::string&,
+                    std::vector<char>,
+                    Completion<void> done)
+                {
+                    complete(done, []() { throw ArbiterError("Down"); });
+                },
+                100,
+                std::unique_ptr<Spool>(new Spool(spoolDir)));
+
+        failing.put(root + "spooled-a", { 'a' });
+        failing.put(root + "spooled-b", { 'b' });
+        EXPECT_THROW(failing.flush(), ArbiterError);
+        EXPECT_EQ(failing.spool()->pending(), 2u);
+    }
+
+    {
+        const Arbiter spooled(json {
+            { "writeBehind", { { "spool", spoolDir } } }
+        }.dump());
+        spooled.flush();
+        EXPECT_EQ(spooled.get(root + "spooled-a"), "a");
+        EXPECT_EQ(spooled.get(root + "spooled-b"), "b");
+        EXPECT_EQ(spoolFiles(), 0u);
+    }
+}
+
+TEST(Arbiter, CredentialCache)
+{
+    const std::string root(getTempPath() + "arbiter-credentials/");
+    for (const std::string& f : glob(root + "*")) arbiter::remove(f);
+
+    const CredentialCache cache(root);
+    const int64_t now(Time().asUnix());
+    int64_t expiration(0);
+
+    EXPECT_FALSE(!!cache.get("a", 0, expiration));
+
+    cache.put("a", "secret", now + 600);
+    auto value(cache.get("a", 60, expiration));
+    ASSERT_TRUE(!!value);
+    EXPECT_EQ(*value, "secret");
+    EXPECT_EQ(expiration, now + 600);
+
+    // Entries expiring too soon to be useful are ignored.
+    EXPECT_FALSE(!!cache.get("a", 900, expiration));
+    EXPECT_FALSE(!!cache.get("b", 0, expiration));
+
+    const std::vector<std::string> files(glob(root + "*"));
+    ASSERT_EQ(files.size(), 1u);
+
+#ifndef ARBITER_WINDOWS
+    // As are those which others may read.
+    struct stat st;
+    ASSERT_EQ(::stat(files.front().c_str(), &st), 0);
+    EXPECT_EQ(st.st_mode & 0777, 0600u);
+
+    ::chmod(files.front().c_str(), 0644);
+    EXPECT_FALSE(!!cache.get("a", 0, expiration));
+#endif
+
+    // Replacing an entry writes it anew.
+    cache.put("a", "replaced", now + 600);
+    value = cache.get("a", 0, expiration);
+    ASSERT_TRUE(!!value);
+    EXPECT_EQ(*value, "replaced");
+    EXPECT_EQ(glob(root + "*").size(), 1u);
+
+    // Drivers only use a cache when one is configured.
+    EXPECT_FALSE(!!CredentialCache::create("{ }"));
+    const auto configured(
+            CredentialCache::create(
+                json { { "credentialCache", root } }.dump()));
+    ASSERT_TRUE(!!configured);
+    EXPECT_EQ(configured->dir(), root);
+}
+
+TEST(Arbiter, MemoryBudget)
+{
+    MemoryBudget budget(100);
+
+    MemoryBudget::Reservation a(budget.reserve(60));
+    EXPECT_EQ(budget.used(), 60u);
+
+    // Exceeding the budget waits for a release.
+    std::atomic<bool> reserved(false);
+    std::thread t([&]()
+    {
+        MemoryBudget::Reservation b(budget.reserve(60));
+        reserved = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(reserved);
+    a.release();
+    t.join();
+    EXPECT_TRUE(reserved);
+    EXPECT_EQ(budget.waits(), 1u);
+    EXPECT_EQ(budget.used(), 0u);
+
+    // Reservations beyond the whole budget are reduced to it.
+    EXPECT_EQ(budget.reserve(1000).size(), 100u);
+    EXPECT_EQ(budget.used(), 0u);
+
+    EXPECT_FALSE(!!MemoryBudget::create(""));
+    EXPECT_FALSE(!!MemoryBudget::create(R"({ "budget": 0 })"));
+    EXPECT_TRUE(!!MemoryBudget::create(R"({ "budget": 1024 })"));
+
+    // Reads and copies through an Arbiter reserve their sizes while they run.
+    const Arbiter arbiter(R"({ "memory": { "budget": 16 } })");
+    ASSERT_TRUE(arbiter.memoryBudget());
+
+    std::vector<std::pair<std::string, std::vector<char>>> items;
+    std::vector<std::string> paths;
+    for (int i(0); i < 8; ++i)
+    {
+        const std::string path("mem://budget/" + std::to_string(i));
+        items.emplace_back(path, std::vector<char>(10, 'a' + i));
+        paths.push_back(path);
+    }
+    for (const auto& r : arbiter.putMany(items)) EXPECT_TRUE(r.ok());
+
+    const auto results(arbiter.getMany(paths));
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        ASSERT_TRUE(results[i].ok());
+        EXPECT_EQ(results[i].value, items[i].second);
+    }
+
+    const std::string dst(getTempPath() + "arbiter-budget/");
+    arbiter.copy("mem://budget/", dst);
+    EXPECT_EQ(arbiter.getBinary(dst + "3"), items[3].second);
+    EXPECT_EQ(arbiter.memoryBudget()->used(), 0u);
+}
+
+TEST(Arbiter, TransferPlanner)
+{
+    const std::size_t mib(1024 * 1024);
+    using Method = TransferPlan::Method;
+
+    // Ranged above 32 MiB and multipart above 64 MiB, in parts of 8 MiB
+    // tuned within 5 MiB and 64 MiB to take 2 seconds, and at most 100.
+    TransferPlanner planner(
+            32 * mib,
+            64 * mib,
+            8 * mib,
+            5 * mib,
+            64 * mib,
+            100,
+            2);
+
+    // Small downloads, and any over a single connection, are made whole.
+    EXPECT_EQ(planner.planGet(32 * mib, 8).method, Method::Single);
+    EXPECT_EQ(planner.planGet(100 * mib, 1).method, Method::Single);
+
+    TransferPlan plan(planner.planGet(100 * mib, 8));
+    EXPECT_EQ(plan.method, Method::Ranged);
+    EXPECT_EQ(plan.partSize, 8 * mib);
+    EXPECT_EQ(plan.parts, 13u);
+
+    EXPECT_EQ(planner.planPut(64 * mib).method, Method::Single);
+    EXPECT_EQ(planner.planPut(65 * mib).method, Method::Multipart);
+
+    // Parts grow to keep within the maximum count.
+    plan = planner.planPut(2000 * mib);
+    EXPECT_EQ(plan.partSize, 20 * mib);
+    EXPECT_EQ(plan.parts, 100u);
+
+    // Measured throughput sizes parts to take about the target time, within
+    // their limits.
+    planner.record(1024, 1);
+    EXPECT_EQ(planner.throughput(), 0);
+    planner.record(4 * mib, 1);
+    EXPECT_EQ(planner.partSize(), 8 * mib);
+    planner.record(40 * mib, 0.5);
+    EXPECT_GT(planner.partSize(), 8 * mib);
+    for (int i(0); i < 50; ++i) planner.record(mib, 1);
+    EXPECT_EQ(planner.partSize(), 5 * mib);
+
+    EXPECT_FALSE(!!TransferPlanner::create(""));
+    EXPECT_TRUE(!!TransferPlanner::create("{ }"));
+    EXPECT_FALSE(TransferPlanner::create("{ }")->autoTune());
+    EXPECT_TRUE(
+            TransferPlanner::create(R"({ "autoTune": true })")->autoTune());
+    EXPECT_THROW(
+            TransferPlanner::create(R"({ "partSize": 0 })"),
+            ArbiterError);
+
+    // Local paths are never planned.
+    const Arbiter arbiter(R"({ "transfer": { "rangedThreshold": 1 } })");
+    ASSERT_TRUE(arbiter.transferPlanner());
+    arbiter.put("mem://transfer/a", "abc");
+    EXPECT_EQ(arbiter.get("mem://transfer/a"), "abc");
+}
+
+TEST(Arbiter, CurlConfig)
+{
+    const auto defaults(http::CurlConfig::create(""));
+    EXPECT_EQ(defaults->connectTimeout, 2000);
+    EXPECT_EQ(defaults->ipResolve, "v4");
+    EXPECT_TRUE(defaults->tcpNoDelay);
+    EXPECT_FALSE(defaults->tcpKeepAlive);
+
+    const auto tuned(http::CurlConfig::create(json {
+        { "http", {
+            { "connectTimeout", 500 },
+            { "ipResolve", "any" },
+            { "dnsCacheTimeout", -1 },
+            { "bufferSize", 512 * 1024 },
+            { "uploadBufferSize", 1024 * 1024 },
+            { "tcpNoDelay", false },
+            { "tcpKeepAlive", { { "idle", 30 } } }
+        } }
+    }.dump()));
+    EXPECT_EQ(tuned->connectTimeout, 500);
+    EXPECT_EQ(tuned->ipResolve, "any");
+    EXPECT_EQ(tuned->dnsCacheTimeout, -1);
+    EXPECT_EQ(tuned->bufferSize, 512 * 1024);
+    EXPECT_EQ(tuned->uploadBufferSize, 1024 * 1024);
+    EXPECT_FALSE(tuned->tcpNoDelay);
+    EXPECT_TRUE(tuned->tcpKeepAlive);
+    EXPECT_EQ(tuned->tcpKeepIdle, 30);
+    EXPECT_EQ(tuned->tcpKeepInterval, 60);
+
+    EXPECT_THROW(
+            http::CurlConfig::create(R"({ "http": { "ipResolve": "v5" } })"),
+            ArbiterError);
+
+    // HTTP/3 falls back to HTTP/2 where curl can't speak it.
+    const auto quic(
+            http::CurlConfig::create(R"({ "http": { "http3": true } })"));
+    EXPECT_TRUE(quic->http3 || quic->http2);
+}
+
+TEST(Arbiter, Throttle)
+{
+    using Duration = http::Throttle::Duration;
+
+    http::Throttle throttle(R"({ "pause": 1000, "maxPause": 5000 })");
+    EXPECT_EQ(throttle.remaining("a").count(), 0);
+
+    EXPECT_FALSE(throttle.record("a", http::Response(200)));
+    EXPECT_FALSE(throttle.record("a", http::Response(500)));
+    EXPECT_TRUE(throttle.record("a", http::Response(429)));
+    EXPECT_GT(throttle.remaining("a").count(), 0);
+    EXPECT_LE(throttle.remaining("a"), Duration(1001));
+    EXPECT_EQ(throttle.remaining("b").count(), 0);
+
+    // Responses to requests sent before the pause don't lengthen it, but a
+    // Retry-After does, up to the longest pause.
+    EXPECT_TRUE(throttle.record("a", http::Response(503)));
+    EXPECT_LE(throttle.remaining("a"), Duration(1001));
+
+    const http::Response after(503, { }, { { "Retry-After", "3" } });
+    EXPECT_EQ(http::Throttle::retryAfter(after), Duration(3000));
+    EXPECT_TRUE(throttle.record("a", after));
+    EXPECT_GT(throttle.remaining("a"), Duration(2000));
+
+    const http::Response later(500, { }, { { "Retry-After", "60" } });
+    EXPECT_TRUE(throttle.record("a", later));
+    EXPECT_LE(throttle.remaining("a"), Duration(5001));
+
+    const http::Response date(
+            429, { }, { { "Retry-After", "Wed, 21 Oct 2015 07:28:00 GMT" } });
+    EXPECT_EQ(http::Throttle::retryAfter(date).count(), 0);
+    EXPECT_EQ(http::Throttle::retryAfter(http::Response(429)).count(), 0);
+}
+
+TEST(Arbiter, SharedRuntime)
+{
+    const auto runtime(
+            Runtime::create(
+                R"({ "threads": 3, "blocks": { "blockSize": 4096 } })"));
+    ASSERT_TRUE(runtime->blockCache());
+
+    Arbiter a(runtime);
+    Arbiter b(runtime, R"({ "rangeGap": 0 })");
+
+    EXPECT_EQ(&a.executor(), &runtime->executor());
+    EXPECT_EQ(&b.executor(), &runtime->executor());
+    EXPECT_EQ(a.executor().size(), 3u);
+    EXPECT_EQ(&a.compute(), &b.compute());
+    EXPECT_EQ(&a.httpPool(), &b.httpPool());
+    EXPECT_EQ(&a.httpPool("s3"), &b.httpPool("s3"));
+    EXPECT_EQ(a.blockCache(), b.blockCache());
+    EXPECT_EQ(a.runtime(), b.runtime());
+
+    // Each has its own drivers.
+    a.put("mem://a.txt", "a");
+    EXPECT_FALSE(b.tryGet("mem://a.txt"));
+
+    // Shared objects are created once, unless their creation fails.
+    int created(0);
+    const std::function<std::shared_ptr<int>()> create([&]()
+    {
+        return std::make_shared<int>(++created);
+    });
+    EXPECT_EQ(*runtime->shared<int>("one", create), 1);
+    EXPECT_EQ(*runtime->shared<int>("one", create), 1);
+    EXPECT_EQ(*runtime->shared<int>("two", create), 2);
+
+    const std::function<std::shared_ptr<int>()> fail([]()
+    {
+        return std::shared_ptr<int>();
+    });
+    EXPECT_FALSE(runtime->shared<int>("three", fail));
+    EXPECT_EQ(*runtime->shared<int>("three", create), 3);
+
+    EXPECT_THROW(Arbiter(std::shared_ptr<Runtime>()), ArbiterError);
+}
+
+TEST(Arbiter, Cancellation)
+{
+    const CancelToken expired(CancelToken::after(std::chrono::milliseconds(0)));
+    EXPECT_TRUE(expired.cancelled());
+    EXPECT_FALSE(expired.sleep(std::chrono::seconds(10)));
+
+    CancelToken token;
+    EXPECT_FALSE(token.cancelled());
+    EXPECT_FALSE(CancelScope::current());
+
+    {
+        CancelScope scope(token);
+        ASSERT_TRUE(CancelScope::current());
+
+        // The token is carried to other threads, and its cancellation
+        // stops the remaining work.
+        std::atomic<std::size_t> count(0);
+        EXPECT_THROW(
+                parallelFor(1000, 4, [&](std::size_t)
+                {
+                    EXPECT_TRUE(CancelScope::current());
+                    if (++count == 10) token.cancel();
+                }),
+                CancelledError);
+        EXPECT_LT(count, 1000u);
+
+        Executor executor(2);
+        EXPECT_THROW(
+                executor.async([]() { CancelScope::check(); }).get(),
+                CancelledError);
+    }
+
+    EXPECT_FALSE(CancelScope::current());
+    EXPECT_TRUE(token.cancelled());
+}
+
+TEST(Arbiter, ParallelTraverse)
+{
+    // Each node "n" has children "n0" and "n1", to a depth of 6.
+    std::mutex mutex;
+    std::set<std::string> seen;
+
+    parallelTraverse({ "" }, 4, [&](
+                const std::string& node,
+                const std::function<void(std::string)>& push)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            seen.insert(node);
+        }
+
+        if (node.size() < 6)
+        {
+            push(node + "0");
+            push(node + "1");
+        }
+    });
+
+    EXPECT_EQ(seen.size(), 127u);
+}
+
+TEST(Arbiter, Memory)
+{
+    using Paths = std::set<std::string>;
+
+    const Arbiter a;
+    EXPECT_TRUE(a.isRemote("mem://a"));
+
+    a.put("mem://dir/a.txt", "hello world");
+    EXPECT_EQ(a.get("mem://dir/a.txt"), "hello world");
+    EXPECT_EQ(a.getSize("mem://dir/a.txt"), 11u);
+    EXPECT_FALSE(a.tryGet("mem://dir/missing"));
+
+    const std::vector<char> range(a.getRange("mem://dir/a.txt", 6, 100));
+    EXPECT_EQ(std::string(range.begin(), range.end()), "world");
+
+    char buffer[16];
+    EXPECT_EQ(a.getInto("mem://dir/a.txt", buffer, sizeof(buffer)), 11u);
+    EXPECT_EQ(std::string(buffer, 11), "hello world");
+    EXPECT_THROW(a.getInto("mem://dir/a.txt", buffer, 4), ArbiterError);
+
+    using Ranges = std::vector<std::pair<std::size_t, std::size_t>>;
+    const auto ranges(a.getRanges(
+                "mem://dir/a.txt",
+                Ranges { { 6, 5 }, { 0, 5 }, { 3, 0 }, { 9, 10 }, { 20, 1 } }));
+    ASSERT_EQ(ranges.size(), 5u);
+    EXPECT_EQ(std::string(ranges[0].begin(), ranges[0].end()), "world");
+    EXPECT_EQ(std::string(ranges[1].begin(), ranges[1].end()), "hello");
+    EXPECT_TRUE(ranges[2].empty());
+    EXPECT_EQ(std::string(ranges[3].begin(), ranges[3].end()), "ld");
+    EXPECT_TRUE(ranges[4].empty());
+
+    a.copy("mem://dir/a.txt", "mem://dir/sub/b.txt");
+    EXPECT_EQ(a.get("mem://dir/sub/b.txt"), "hello world");
+
+    const auto flat(a.resolve("mem://dir/*"));
+    EXPECT_EQ(Paths(flat.begin(), flat.end()), Paths { "mem://dir/a.txt" });
+
+    const auto deep(a.resolve("mem://dir/**"));
+    EXPECT_EQ(
+            Paths(deep.begin(), deep.end()),
+            (Paths { "mem://dir/a.txt", "mem://dir/sub/b.txt" }));
+
+    // Contents of the same size have different versions.
+    const drivers::Memory memory;
+    memory.put("a", std::string("1"));
+    const std::string version(*memory.tryGetVersion("a"));
+    memory.put("a", std::string("2"));
+    EXPECT_NE(*memory.tryGetVersion("a"), version);
+    memory.remove("a");
+    EXPECT_FALSE(memory.tryGetVersion("a"));
+    memory.remove("a");
+
+    // Data may be given as a span, or handed over.
+    const char raw[] = "spanned";
+    memory.put("span", raw, 4);
+    EXPECT_EQ(memory.get("span"), "span");
+
+    std::vector<char> owned { 'm', 'o', 'v', 'e', 'd' };
+    a.put("mem://owned", std::move(owned));
+    EXPECT_EQ(a.get("mem://owned"), "moved");
+}
+
+TEST(Arbiter, ResolveInfo)
+{
+    const Arbiter a;
+
+    a.put("mem://info/a", "abc");
+    a.put("mem://info/sub/b", "de");
+
+    const auto flat(a.resolveInfo("mem://info/*"));
+    ASSERT_EQ(flat.size(), 1u);
+    EXPECT_EQ(flat[0].path, "mem://info/a");
+    EXPECT_TRUE(flat[0].hasSize);
+    EXPECT_EQ(flat[0].size, 3u);
+
+    const auto deep(a.resolveInfo("mem://info/**"));
+    ASSERT_EQ(deep.size(), 2u);
+    EXPECT_EQ(deep[1].path, "mem://info/sub/b");
+    EXPECT_EQ(deep[1].size, 2u);
+
+    // Local listings describe each file from its stat.
+    const std::string root(getTempPath() + "arbiter-info/");
+    mkdirp(root + "sub");
+    a.put(root + "a", "abc");
+    a.put(root + "sub/b", "de");
+
+    for (const std::string glob : { "*", "**" })
+    {
+        const auto local(a.resolveInfo(root + glob));
+        ASSERT_EQ(local.size(), glob == "*" ? 1u : 2u);
+        EXPECT_EQ(local[0].path, root + "a");
+        EXPECT_TRUE(local[0].hasSize);
+        EXPECT_EQ(local[0].size, 3u);
+        EXPECT_EQ(local[0].version, *drivers::Fs().tryGetVersion(root + "a"));
+        EXPECT_GT(local[0].modified, 0);
+    }
+
+    // Paths which are not globbed are not described.
+    const auto single(a.resolveInfo(root + "a"));
+    ASSERT_EQ(single.size(), 1u);
+    EXPECT_FALSE(single[0].hasSize);
+
+    remove(root + "sub/b");
+    remove(root + "sub");
+    remove(root + "a");
+    remove(root);
+}
+
+TEST(Arbiter, ResolveList)
+{
+    const Arbiter a;
+
+    a.put("mem://list/b", "b");
+    a.put("mem://list/a", "a");
+    a.put("mem://list/sub/c", "c");
+
+    const PathList flat(a.resolveList("mem://list/*"));
+    EXPECT_EQ(flat.prefix(), "mem://list/");
+    ASSERT_EQ(flat.size(), 2u);
+    EXPECT_EQ(flat.suffix(0).str(), "a");
+    EXPECT_EQ(flat[1], "mem://list/b");
+
+    const PathList deep(a.resolveList("mem://list/**"));
+    EXPECT_EQ(deep.strings(), a.resolve("mem://list/**"));
+
+    std::vector<std::string> suffixes;
+    for (const PathList::Suffix s : deep) suffixes.push_back(s.str());
+    EXPECT_EQ(suffixes, (std::vector<std::string> { "a", "b", "sub/c" }));
+
+    // Paths outside of the prefix shorten it.
+    PathList list("dir/sub/");
+    list.pushSuffix("x", 1);
+    list.pushSuffix(std::string("y/"), "z");
+    list.push("dir/other");
+    EXPECT_EQ(list.prefix(), "dir/");
+    list.sort();
+    const std::vector<std::string> expected {
+        "dir/other", "dir/sub/x", "dir/sub/y/z"
+    };
+    EXPECT_EQ(list.strings(), expected);
+    EXPECT_GT(list.bytes(), 0u);
+
+    // Local listings match resolve.
+    const std::string root(getTempPath() + "arbiter-list/");
+    mkdirp(root + "sub");
+    a.put(root + "a", "a");
+    a.put(root + "sub/b", "b");
+
+    for (const std::string glob : { "*", "**" })
+    {
+        EXPECT_EQ(a.resolveList(root + glob).strings(), a.resolve(root + glob));
+    }
+    EXPECT_EQ(a.resolveList(root + "**").prefix(), root);
+
+    remove(root + "sub/b");
+    remove(root + "sub");
+    remove(root + "a");
+    remove(root);
+}
+
+TEST(Arbiter, ResolveShard)
+{
+    const Arbiter a;
+
+    // The shares of each number of them together make up the whole.
+    auto check([&a](const std::string& glob)
+    {
+        std::vector<std::string> whole(a.resolve(glob));
+        std::sort(whole.begin(), whole.end());
+
+        for (const std::size_t shards : { 1u, 2u, 3u, 7u, 20u })
+        {
+            std::vector<std::string> all;
+            for (std::size_t shard(0); shard < shards; ++shard)
+            {
+                const auto share(a.resolve(glob, shard, shards));
+                EXPECT_TRUE(std::is_sorted(share.begin(), share.end()));
+                all.insert(all.end(), share.begin(), share.end());
+            }
+            std::sort(all.begin(), all.end());
+            EXPECT_EQ(all, whole) << glob << " " << shards;
+        }
+    });
+
+    const std::string root(getTempPath() + "arbiter-shard/");
+    for (const std::string dir : { "", "a/", "b/", "b/c/", "d/e/f/" })
+    {
+        mkdirp(root + dir);
+        for (const std::string name : { "x", "y", "z" })
+        {
+            a.put(root + dir + name, name);
+            a.put("mem://shard/" + dir + name, name);
+        }
+    }
+
+    for (const std::string glob : { "*", "**" })
+    {
+        check(root + glob);
+        check("mem://shard/" + glob);
+    }
+
+    EXPECT_THROW(a.resolve(root + "**", 2, 2), ArbiterError);
+    EXPECT_THROW(a.resolve(root + "x", 0, 2), ArbiterError);
+
+    a.removeMany(a.resolve(root + "**"));
+    for (const std::string dir : { "d/e/f/", "d/e/", "d/", "b/c/", "b/" })
+    {
+        remove(root + dir);
+    }
+    remove(root + "a/");
+    remove(root);
+}
+
+TEST(Arbiter, Glob)
+{
+    EXPECT_FALSE(Glob::isPattern("a/b"));
+    EXPECT_FALSE(Glob::isPattern("a/*"));
+    EXPECT_FALSE(Glob::isPattern("a/**"));
+    EXPECT_TRUE(Glob::isPattern("a/*/b"));
+    EXPECT_TRUE(Glob::isPattern("a/*/**"));
+
+    const Glob tiles("b/2024-*/tiles/*.laz");
+    EXPECT_EQ(tiles.prefix(), "b/2024-");
+    EXPECT_TRUE(tiles.recursive());
+    EXPECT_TRUE(tiles.match("b/2024-01/tiles/x.laz"));
+    EXPECT_FALSE(tiles.match("b/2024-01/tiles/x.las"));
+    EXPECT_FALSE(tiles.match("b/2024-01/other/tiles/x.laz"));
+    EXPECT_FALSE(tiles.match("b/2024-01/tiles/sub/x.laz"));
+
+    EXPECT_TRUE(tiles.mayContain("b/2024-01/"));
+    EXPECT_FALSE(tiles.mayContain("b/2023-01/"));
+    EXPECT_FALSE(tiles.mayContain("b/2024-01/other/"));
+    EXPECT_EQ(tiles.extend("b/2024-01/"), "b/2024-01/tiles/");
+    EXPECT_EQ(tiles.extend("b/2024-01/tiles/"), "b/2024-01/tiles/");
+
+    // A whole level of ** matches any number of levels, including none.
+    const Glob deep("a/**/x?.[lL][!b]z");
+    EXPECT_EQ(deep.prefix(), "a/");
+    EXPECT_TRUE(deep.match("a/x1.laz"));
+    EXPECT_TRUE(deep.match("a/b/c/x2.Laz"));
+    EXPECT_FALSE(deep.match("a/b/x2.lbz"));
+    EXPECT_FALSE(deep.match("a/b/x22.laz"));
+    EXPECT_TRUE(deep.mayContain("a/any/depth/"));
+
+    // Elsewhere, it matches across levels within a name.
+    const Glob within("a/pre**.txt");
+    EXPECT_TRUE(within.match("a/pre.txt"));
+    EXPECT_TRUE(within.match("a/pre/b/c.txt"));
+    EXPECT_FALSE(within.match("a/b/pre.txt"));
+
+    const Glob flat("a/*.txt");
+    EXPECT_FALSE(flat.recursive());
+    EXPECT_THROW(Glob("a/[bc/*"), ArbiterError);
+
+    const Arbiter a;
+    a.put("mem://glob/2024-01/tiles/a.laz", "");
+    a.put("mem://glob/2024-01/tiles/b.las", "");
+    a.put("mem://glob/2024-02/tiles/c.laz", "");
+    a.put("mem://glob/2024-02/other/d.laz", "");
+    a.put("mem://glob/2023-12/tiles/e.laz", "");
+
+    EXPECT_EQ(
+            a.resolve("mem://glob/2024-*/tiles/*.laz"),
+            (std::vector<std::string> {
+                "mem://glob/2024-01/tiles/a.laz",
+                "mem://glob/2024-02/tiles/c.laz"
+            }));
+
+    const auto info(a.resolveInfo("mem://glob/**/*.las"));
+    ASSERT_EQ(info.size(), 1u);
+    EXPECT_EQ(info[0].path, "mem://glob/2024-01/tiles/b.las");
+    EXPECT_TRUE(info[0].hasSize);
+
+    // The filesystem resolves the same patterns.
+    const std::string root(getTempPath() + "arbiter-glob/");
+    mkdirp(root + "2024-01/tiles");
+    mkdirp(root + "2023-12/tiles");
+    a.put(root + "2024-01/tiles/a.laz", "");
+    a.put(root + "2023-12/tiles/e.laz", "");
+
+    EXPECT_EQ(
+            a.resolve(root + "2024-*/tiles/*.laz"),
+            std::vector<std::string> { root + "2024-01/tiles/a.laz" });
+    EXPECT_EQ(a.resolve(root + "*/tiles/*.laz").size(), 2u);
+
+    remove(root + "2024-01/tiles/a.laz");
+    remove(root + "2023-12/tiles/e.laz");
+    remove(root + "2024-01/tiles");
+    remove(root + "2023-12/tiles");
+    remove(root + "2024-01");
+    remove(root + "2023-12");
+    remove(root);
+}
+
+TEST(Arbiter, FsWalk)
+{
+    // Recursive globs walk the tree in parallel, skipping hidden
+    // directories, and their results are sorted.
+    const std::string root(getTempPath() + "arbiter-walk/");
+#ifndef ARBITER_WINDOWS
+    for (const std::string link : { "x", "y", "z" })
+    {
+        ::unlink((root + link).c_str());
+    }
+#endif
+    for (const std::string& f : glob(root + "**")) remove(f);
+
+    mkdirp(root + ".hidden");
+    mkdirp(root + "sub/deep");
+    const Arbiter a;
+    a.put(root + "a.txt", "a");
+    a.put(root + ".dot.txt", "");
+    a.put(root + ".hidden/h.txt", "");
+    a.put(root + "sub/b.txt", "");
+    a.put(root + "sub/deep/c.txt", "c");
+    a.put(root + "sub/deep/c.las", "");
+
+    std::vector<std::string> expected {
+        root + "a.txt",
+        root + "sub/b.txt",
+        root + "sub/deep/c.las",
+        root + "sub/deep/c.txt"
+    };
+
+#ifndef ARBITER_WINDOWS
+    // Symlinks, whose entries don't say what they point to, are followed,
+    // and those which dangle are skipped.
+    ASSERT_EQ(::symlink((root + "a.txt").c_str(), (root + "z").c_str()), 0);
+    ASSERT_EQ(::symlink((root + "sub").c_str(), (root + "y").c_str()), 0);
+    ASSERT_EQ(::symlink((root + "none").c_str(), (root + "x").c_str()), 0);
+    expected.insert(expected.end(), {
+        root + "y/b.txt",
+        root + "y/deep/c.las",
+        root + "y/deep/c.txt",
+        root + "z"
+    });
+#endif
+
+    EXPECT_EQ(glob(root + "**"), expected);
+    EXPECT_EQ(a.resolve(root + "**"), expected);
+
+    std::vector<FileInfo> infos;
+    globInfo(root + "**/c.txt", [&infos](FileInfo info)
+    {
+        infos.push_back(std::move(info));
+    });
+    std::sort(infos.begin(), infos.end(), [](
+                const FileInfo& l,
+                const FileInfo& r)
+    {
+        return l.path < r.path;
+    });
+    ASSERT_FALSE(infos.empty());
+    EXPECT_EQ(infos[0].path, root + "sub/deep/c.txt");
+    EXPECT_EQ(infos[0].size, 1u);
+
+    // Patterns spanning levels are matched by glob within each directory.
+    std::vector<std::string> deep { root + "sub/deep/c.txt" };
+#ifndef ARBITER_WINDOWS
+    deep.push_back(root + "y/deep/c.txt");
+#endif
+    EXPECT_EQ(glob(root + "**/deep/*.txt"), deep);
+
+    // Walks borrow the threads of the executor of which the caller is a
+    // worker, and find the same files.
+    Executor executor(2);
+    auto walked(executor.async([&]() { return glob(root + "**"); }));
+    EXPECT_EQ(walked.get(), expected);
+
+#ifndef ARBITER_WINDOWS
+    for (const std::string link : { "x", "y", "z" })
+    {
+        ::unlink((root + link).c_str());
+    }
+#endif
+    for (const std::string& f : glob(root + "**")) remove(f);
+    remove(root + ".dot.txt");
+    remove(root + ".hidden/h.txt");
+    remove(root + ".hidden");
+    remove(root + "sub/deep");
+    remove(root + "sub");
+    remove(root);
+}
+
+// Collects the changes delivered to a watch, for a test to wait on.
+class ChangeLog
+{
+public:
+    ChangeCallback callback()
+    {
+        return [this](const ChangeEvent& event)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_events.push_back(event);
+            m_cv.notify_all();
+        };
+    }
+
+    // Wait for a change of @p type to @p path, returning false if none is
+    // delivered in time.
+    bool await(const std::string& path, const ChangeEvent::Type type)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_cv.wait_for(lock, std::chrono::seconds(10), [&]()
+        {
+            for (const ChangeEvent& e : m_events)
+            {
+                if (e.info.path == path && e.type == type) return true;
+            }
+            return false;
+        });
+    }
+
+    std::vector<ChangeEvent> events() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_events;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<ChangeEvent> m_events;
+};
+
+TEST(Arbiter, Watch)
+{
+    const Arbiter a;
+    const auto changed(ChangeEvent::Type::Changed);
+    const auto removed(ChangeEvent::Type::Removed);
+
+    // Without notifications, watches diff successive listings.
+    EXPECT_FALSE(a.capabilities("mem://").changeNotifications);
+    a.put("mem://watch/a", "a");
+    a.put("mem://watch/unchanged", "u");
+    {
+        ChangeLog log;
+        auto watch(
+                a.watch(
+                    "mem://watch/",
+                    log.callback(),
+                    std::chrono::milliseconds(10)));
+
+        a.put("mem://watch/b", "bb");
+        a.put("mem://watch/a", "aaa");
+        ASSERT_TRUE(log.await("mem://watch/a", changed));
+        ASSERT_TRUE(log.await("mem://watch/b", changed));
+        a.remove("mem://watch/b");
+        ASSERT_TRUE(log.await("mem://watch/b", removed));
+
+        watch.reset();
+        for (const ChangeEvent& e : log.events())
+        {
+            EXPECT_NE(e.info.path, "mem://watch/unchanged");
+            if (e.info.path == "mem://watch/a")
+            {
+                EXPECT_EQ(e.info.size, 3u);
+            }
+        }
+    }
+
+#ifdef __linux__
+    // Local directories are watched with inotify, including those created
+    // beneath them while they are watched.
+    const std::string root(getTempPath() + "arbiter-watch/");
+    EXPECT_TRUE(a.capabilities(root).changeNotifications);
+    mkdirp(root);
+    a.removeMany(a.resolve(root + "**"));
+    {
+        ChangeLog log;
+        auto watch(a.watch(root, log.callback()));
+
+        a.put(root + "a", "abc");
+        ASSERT_TRUE(log.await(root + "a", changed));
+
+        mkdirp(root + "sub");
+        a.put(root + "sub/b", "de");
+        ASSERT_TRUE(log.await(root + "sub/b", changed));
+
+        a.remove(root + "a");
+        ASSERT_TRUE(log.await(root + "a", removed));
+
+        watch.reset();
+        const std::vector<ChangeEvent> events(log.events());
+        ASSERT_FALSE(events.empty());
+        EXPECT_EQ(events[0].info.size, 3u);
+        EXPECT_FALSE(events[0].info.version.empty());
+    }
+    a.removeMany(a.resolve(root + "**"));
+    remove(root + "sub");
+    remove(root);
+#endif
+}
+
+#ifdef ARBITER_ZLIB
+TEST(Arbiter, StreamBuf)
+{
+    std::vector<char> data(10000);
+    for (std::size_t i(0); i < data.size(); ++i) data[i] = i % 251;
+
+    const Arbiter a;
+    a.put("mem://stream", data);
+
+    // Sequential reads see the whole object.
+    {
+        auto buf(a.getStreamBuf("mem://stream", R"({ "blockSize": 1000 })"));
+        std::istream stream(buf.get());
+        const std::vector<char> read(
+                (std::istreambuf_iterator<char>(stream)),
+                std::istreambuf_iterator<char>());
+        EXPECT_EQ(read, data);
+    }
+
+    // Blocks are fetched once, ahead of sequential reads, and seeks within
+    // kept blocks fetch nothing.
+    Executor executor(2);
+    std::mutex mutex;
+    std::map<std::size_t, std::size_t> fetches;
+    RemoteStreamBuf buf(
+            [&](std::size_t offset, std::size_t length)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ++fetches[offset];
+                }
+                return a.getRange("mem://stream", offset, length);
+            },
+            data.size(),
+            executor,
+            1000,
+            2,
+            4);
+    std::istream stream(&buf);
+
+    char c(0);
+    ASSERT_TRUE(!!stream.read(&c, 1));
+    EXPECT_EQ(c, data[0]);
+
+    std::vector<char> chunk(1500);
+    ASSERT_TRUE(!!stream.seekg(2500));
+    ASSERT_TRUE(!!stream.read(chunk.data(), chunk.size()));
+    EXPECT_TRUE(std::equal(chunk.begin(), chunk.end(), data.begin() + 2500));
+    EXPECT_EQ(stream.tellg(), std::streampos(4000));
+
+    ASSERT_TRUE(!!stream.seekg(-1200, std::ios_base::cur));
+    ASSERT_TRUE(!!stream.read(&c, 1));
+    EXPECT_EQ(c, data[2800]);
+
+    ASSERT_TRUE(!!stream.seekg(-10, std::ios_base::end));
+    ASSERT_TRUE(!!stream.read(chunk.data(), 10));
+    EXPECT_TRUE(std::equal(chunk.begin(), chunk.begin() + 10, data.end() - 10));
+    EXPECT_FALSE(!!stream.read(&c, 1));
+
+    stream.clear();
+    EXPECT_FALSE(!!stream.seekg(data.size() + 1));
+    EXPECT_THROW(a.getStreamBuf("mem://missing"), ArbiterError);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& p : fetches) EXPECT_EQ(p.second, 1u);
+}
+
+TEST(Arbiter, Compressed)
+{
+    const Arbiter a(json { { "compression", { { "gz", { { "level", 9 } } } } } }
+            .dump());
+
+    const std::string text(100000, 'a');
+    a.put("gz+mem://dir/a.txt", text);
+    EXPECT_EQ(a.get("gz+mem://dir/a.txt"), text);
+    EXPECT_EQ(a.getSize("gz+mem://dir/a.txt"), text.size());
+    EXPECT_LT(a.getSize("mem://dir/a.txt"), text.size() / 100);
+
+    const std::vector<char> range(a.getRange("gz+mem://dir/a.txt", 99998, 8));
+    EXPECT_EQ(std::string(range.begin(), range.end()), "aa");
+
+    // Streamed writes are compressed as they are written.
+    const std::vector<char> data(text.begin(), text.end());
+    std::size_t offset(0);
+    a.putFrom("gz+mem://dir/b.txt", [&](char* out, std::size_t size)
+    {
+        const std::size_t n((std::min)(size, data.size() - offset));
+        std::copy(data.begin() + offset, data.begin() + offset + n, out);
+        offset += n;
+        return n;
+    }, data.size());
+    EXPECT_EQ(a.get("gz+mem://dir/b.txt"), text);
+    EXPECT_LT(a.getSize("mem://dir/b.txt"), text.size() / 100);
+
+    // Uncompressed files read through unchanged.
+    a.put("mem://dir/plain.txt", "plain");
+    EXPECT_EQ(a.get("gz+mem://dir/plain.txt"), "plain");
+    EXPECT_FALSE(a.tryGet("gz+mem://dir/missing"));
+
+    // Truncated data is an error rather than a short read.
+    const std::vector<char> stored(a.getBinary("mem://dir/a.txt"));
+    a.put(
+            "mem://dir/truncated.txt",
+            std::vector<char>(stored.begin(), stored.end() - 10));
+    EXPECT_THROW(a.get("gz+mem://dir/truncated.txt"), ArbiterError);
+
+    const auto flat(a.resolve("gz+mem://dir/a*"));
+    EXPECT_EQ(flat, std::vector<std::string> { "gz+mem://dir/a.txt" });
+}
+#endif
+
+TEST(Arbiter, GoogleBatch)
+{
+    // A batch response in the form sent by GCS, whose parts are out of
+    // order, one of which carries a later status line, and one of which
+    // answers an unknown call.  The response to call 1 is missing.
+    const std::string body(
+            "--batch_abc\r\n"
+            "Content-Type: application/http\r\n"
+            "Content-ID: <response-2>\r\n"
+            "\r\n"
+            "HTTP/1.1 404 Not Found\r\n"
+            "Content-Type: application/json; charset=UTF-8\r\n"
+            "\r\n"
+            "{\"error\":{\"code\":404}}\r\n"
+            "--batch_abc\r\n"
+            "Content-Type: application/http\r\n"
+            "Content-ID: <response-0>\r\n"
+            "\r\n"
+            "HTTP/1.1 200 OK\r\n"
+            "ETag: \"abc\"\r\n"
+            "\r\n"
+            "Content-ID: <response-3>\r\n\r\nHTTP/1.1 500 Server Error\r\n"
+            "--batch_abc\r\n"
+            "Content-Type: application/http\r\n"
+            "Content-ID: <response-3>\r\n"
+            "\r\n"
+            "HTTP/2 204 No Content\r\n"
+            "\r\n"
+            "\r\n"
+            "--batch_abc\r\n"
+            "Content-Type: application/http\r\n"
+            "Content-ID: <response-4>\r\n"
+            "\r\n"
+            "HTTP/1.1 429 Too Many Requests\r\n"
+            "\r\n"
+            "\r\n"
+            "--batch_abc\r\n"
+            "Content-Type: application/http\r\n"
+            "Content-ID: <response-7>\r\n"
+            "\r\n"
+            "HTTP/1.1 200 OK\r\n"
+            "\r\n"
+            "\r\n"
+            "--batch_abc--\r\n");
+
+    const auto responses(
+            drivers::Google::parseBatch(
+                "multipart/mixed; boundary=batch_abc",
+                body,
+                5));
+    ASSERT_EQ(responses.size(), 5u);
+
+    // Content-IDs within the bodies of responses are ignored.
+    EXPECT_EQ(responses[0].code(), 200);
+    EXPECT_EQ(
+            responses[0].str(),
+            "Content-ID: <response-3>\r\n\r\nHTTP/1.1 500 Server Error");
+    EXPECT_EQ(responses[0].headers().at("etag"), "\"abc\"");
+
+    EXPECT_EQ(responses[1].code(), 0);
+    EXPECT_EQ(responses[2].code(), 404);
+    EXPECT_EQ(responses[2].str(), "{\"error\":{\"code\":404}}");
+    EXPECT_EQ(responses[3].code(), 204);
+    EXPECT_TRUE(responses[3].data().empty());
+    EXPECT_EQ(responses[4].code(), 429);
+
+    EXPECT_THROW(
+            drivers::Google::parseBatch("application/json", body, 5),
+            ArbiterError);
+}
+
+#ifdef ARBITER_MOCK_SERVER
+// Each test runs against a server of its own, into which the files that
+// most of them read are written beforehand.
+class MockServerTest : public ::testing::Test
+{
+protected:
+    using Paths = std::set<std::string>;
+
+    MockServerTest()
+        : s3(config(server))
+        , a(json { { "s3", s3 } }.dump())
+        , http(server.httpRoot())
+        , big(6 * 1024 * 1024)
+    {
+        for (std::size_t i(0); i < big.size(); ++i) big[i] = i % 251;
+
+        a.put(http + "a.txt", "plain");
+        a.put("s3://bucket/dir/a.txt", "hello world");
+        a.put("s3://bucket/dir/b.txt", "");
+        a.put("s3://bucket/dir/sub/c.txt", "");
+    }
+
+    static json config(const MockServer& server)
+    {
+        json s3(json::parse(server.s3Config()));
+        s3["multipartThreshold"] = 1024 * 1024;
+        s3["copyPartSize"] = 5 * 1024 * 1024;
+        return s3;
+    }
+
+    // A configuration of drivers::Google addressing the server.
+    json gcsConfig() const
+    {
+        return json::parse(
+                server.gcsConfig(getTempPath() + "arbiter-mock-credentials/"));
+    }
+
+    MockServer server;
+    const json s3;
+    const Arbiter a;
+    const std::string http;
+    std::vector<char> big;
+};
+
+TEST_F(MockServerTest, Basics)
+{
+    EXPECT_EQ(a.get(http + "a.txt"), "plain");
+
+    EXPECT_EQ(a.get("s3://bucket/dir/a.txt"), "hello world");
+    EXPECT_EQ(a.getSize("s3://bucket/dir/a.txt"), 11u);
+    EXPECT_EQ(
+            a.get("s3://bucket/dir/a.txt", { { "Range", "bytes=6-10" } }),
+            "world");
+    EXPECT_FALSE(a.tryGet("s3://bucket/missing"));
+    EXPECT_FALSE(a.tryGet("s3://other/dir/a.txt"));
+
+    const auto flat(a.resolve("s3://bucket/dir/*"));
+    EXPECT_EQ(
+            Paths(flat.begin(), flat.end()),
+            (Paths { "s3://bucket/dir/a.txt", "s3://bucket/dir/b.txt" }));
+
+    const auto deep(a.resolve("s3://bucket/dir/**"));
+    EXPECT_EQ(
+            Paths(deep.begin(), deep.end()),
+            (Paths {
+                "s3://bucket/dir/a.txt",
+                "s3://bucket/dir/b.txt",
+                "s3://bucket/dir/sub/c.txt"
+            }));
+
+#ifdef ARBITER_ZLIB
+    // Listings are negotiated as gzipped, and decoded as they arrive.
+    EXPECT_GT(server.compressed(), 0u);
+#endif
+}
+
+TEST_F(MockServerTest, MultipartUploads)
+{
+    // Above the threshold, puts are uploaded in parts.
+    json parted(s3);
+    parted["partSize"] = 5 * 1024 * 1024;
+    const Arbiter b(json { { "s3", parted } }.dump());
+
+    b.put("s3://bucket/small", std::vector<char>(1024 * 1024, 'a'));
+    EXPECT_EQ(server.multipartUploads(), 0u);
+
+    b.put("s3://bucket/big", big);
+    EXPECT_EQ(server.multipartUploads(), 1u);
+    EXPECT_EQ(server.parts(), 2u);
+    EXPECT_EQ(a.getBinary("s3://bucket/big"), big);
+
+    // A part which fails is sent again on its own.
+    MockServer::Options options;
+    options.partFailures[2] = 1;
+    server.options(options);
+
+    b.put("s3://bucket/retried", big);
+    EXPECT_EQ(server.multipartUploads(), 2u);
+    EXPECT_EQ(server.parts(), 5u);
+    EXPECT_EQ(server.openUploads(), 0u);
+    EXPECT_EQ(a.getBinary("s3://bucket/retried"), big);
+}
+
+TEST_F(MockServerTest, AbortedUploads)
+{
+    // Uploads whose parts fail are aborted, whether put whole or streamed.
+    const Arbiter failing(json {
+        { "s3", s3 },
+        { "http", { { "retry", { { "count", 0 } } } } }
+    }.dump());
+
+    MockServer::Options options;
+    options.partFailures[1] = 100;
+    server.options(options);
+
+    EXPECT_THROW(failing.put("s3://bucket/aborted", big), ArbiterError);
+    EXPECT_EQ(server.multipartUploads(), 1u);
+    EXPECT_EQ(server.openUploads(), 0u);
+
+    {
+        auto writer(failing.getDriver("s3://").putStream("bucket/aborted"));
+        writer->write(big.data(), big.size());
+        EXPECT_THROW(writer->done(), ArbiterError);
+    }
+    EXPECT_EQ(server.multipartUploads(), 2u);
+    EXPECT_EQ(server.openUploads(), 0u);
+    EXPECT_FALSE(a.exists("s3://bucket/aborted"));
+}
+
+TEST_F(MockServerTest, Copies)
+{
+    // Large copies are made in parts, which are copied on the server.
+    a.put("s3://bucket/big", big);
+    const std::size_t before(server.requests());
+    a.copy("s3://bucket/big", "s3://bucket/copies/big");
+    EXPECT_EQ(a.getBinary("s3://bucket/copies/big"), big);
+    EXPECT_LT(server.requests() - before, 10u);
+
+    a.copy("s3://bucket/dir/a.txt", "s3://bucket/copies/a.txt");
+    EXPECT_EQ(a.get("s3://bucket/copies/a.txt"), "hello world");
+
+    a.remove("s3://bucket/copies/a.txt");
+    EXPECT_FALSE(a.exists("s3://bucket/copies/a.txt"));
+
+    // Those whose parts fail are aborted.
+    const Arbiter failing(json {
+        { "s3", s3 },
+        { "http", { { "retry", { { "count", 0 } } } } }
+    }.dump());
+
+    MockServer::Options options;
+    options.partFailures[2] = 100;
+    server.options(options);
+
+    const std::size_t uploads(server.multipartUploads());
+    EXPECT_THROW(
+            failing.copy("s3://bucket/big", "s3://bucket/copies/failed"),
+            ArbiterError);
+    EXPECT_EQ(server.multipartUploads(), uploads + 1);
+    EXPECT_EQ(server.openUploads(), 0u);
+    EXPECT_FALSE(a.exists("s3://bucket/copies/failed"));
+}
+
+TEST_F(MockServerTest, ExpectContinue)
+{
+    // Only uploads above the Expect threshold wait for a 100 Continue.
+    Arbiter expecting(json {
+        { "s3", s3 },
+        { "http", { { "expectThreshold", 1024 } } }
+    }.dump());
+
+    const std::size_t before(server.continued());
+    expecting.put(http + "expect", std::string(1024, 'a'));
+    EXPECT_EQ(server.continued(), before);
+    expecting.put(http + "expect", std::string(1025, 'a'));
+    EXPECT_EQ(server.continued(), before + 1);
+    expecting.put("s3://bucket/expect", std::string(1025, 'a'));
+    EXPECT_EQ(server.continued(), before + 2);
+    EXPECT_EQ(a.get("s3://bucket/expect"), std::string(1025, 'a'));
+}
+
+TEST_F(MockServerTest, Proxies)
+{
+    // The drivers of a type may be routed through a proxy of their own.
+    const std::string proxy("127.0.0.1:" + std::to_string(server.port()));
+    Arbiter proxied(json {
+        { "http", { { "pools", { { "http", { { "proxy", proxy } } } } } } }
+    }.dump());
+
+    const std::size_t before(server.proxied());
+    proxied.put("http://cache.invalid/proxied", "through");
+    EXPECT_EQ(proxied.get("http://cache.invalid/proxied"), "through");
+    EXPECT_EQ(a.get(http + "proxied"), "through");
+    EXPECT_EQ(server.proxied(), before + 2);
+}
+
+TEST_F(MockServerTest, MergedRanges)
+{
+    // Nearby ranges are merged into single requests.
+    a.put("s3://bucket/big", big);
+
+    using Ranges = std::vector<std::pair<std::size_t, std::size_t>>;
+    const std::size_t before(server.requests());
+    const auto ranges(a.getRanges(
+                "s3://bucket/big",
+                Ranges { { 5000000, 10 }, { 100, 10 }, { 0, 10 } }));
+    EXPECT_EQ(server.requests() - before, 2u);
+    ASSERT_EQ(ranges.size(), 3u);
+    EXPECT_TRUE(std::equal(
+                ranges[0].begin(),
+                ranges[0].end(),
+                big.begin() + 5000000));
+    EXPECT_TRUE(std::equal(
+                ranges[1].begin(),
+                ranges[1].end(),
+                big.begin() + 100));
+    EXPECT_EQ(ranges[2], std::vector<char>(big.begin(), big.begin() + 10));
+}
+
+TEST_F(MockServerTest, ListingMetadata)
+{
+    // Listings carry the metadata of each object.
+    const auto infos(a.resolveInfo("s3://bucket/dir/*"));
+    ASSERT_EQ(infos.size(), 2u);
+    EXPECT_EQ(infos[0].path, "s3://bucket/dir/a.txt");
+    EXPECT_TRUE(infos[0].hasSize);
+    EXPECT_EQ(infos[0].size, 11u);
+    EXPECT_FALSE(infos[0].version.empty());
+    EXPECT_GT(infos[0].modified, 0);
+    EXPECT_EQ(infos[1].size, 0u);
+}
+
+TEST_F(MockServerTest, BatchedRemovals)
+{
+    // Removals are batched into requests of up to 1000 keys.
+    std::vector<std::pair<std::string, std::vector<char>>> items;
+    std::vector<std::string> removals;
+    for (std::size_t i(0); i < 1500; ++i)
+    {
+        const std::string path("s3://bucket/remove/" + std::to_string(i));
+        items.emplace_back(path, std::vector<char>());
+        removals.push_back(path);
+    }
+    for (const auto& r : a.putMany(items)) EXPECT_TRUE(r.ok());
+    removals.push_back("s3://bucket/remove/missing & <escaped>");
+
+    const std::size_t beforeRemove(server.requests());
+    for (const auto& r : a.removeMany(removals)) EXPECT_TRUE(r.ok());
+    EXPECT_EQ(server.requests() - beforeRemove, 2u);
+    EXPECT_TRUE(a.resolve("s3://bucket/remove/**").empty());
+}
+
+TEST_F(MockServerTest, GcsBasics)
+{
+    const Arbiter g(json { { "gs", gcsConfig() } }.dump());
+
+    g.put("gs://gcs/dir/a.txt", "hello world");
+    g.put("gs://gcs/dir/b.txt", "");
+    g.put("gs://gcs/dir/sub/c.txt", "");
+    g.put("gs://gcs/dir/sub/deeper/d.txt", "d");
+
+    EXPECT_EQ(g.get("gs://gcs/dir/a.txt"), "hello world");
+    EXPECT_EQ(g.getSize("gs://gcs/dir/a.txt"), 11u);
+    EXPECT_FALSE(g.tryGet("gs://gcs/missing"));
+    EXPECT_FALSE(g.exists("gs://gcs/missing"));
+
+    const auto flat(g.resolve("gs://gcs/dir/*"));
+    EXPECT_EQ(
+            Paths(flat.begin(), flat.end()),
+            (Paths { "gs://gcs/dir/a.txt", "gs://gcs/dir/b.txt" }));
+
+    // Recursive globs list each common prefix on its own, concurrently.
+    const auto deep(g.resolve("gs://gcs/dir/**"));
+    EXPECT_EQ(
+            Paths(deep.begin(), deep.end()),
+            (Paths {
+                "gs://gcs/dir/a.txt",
+                "gs://gcs/dir/b.txt",
+                "gs://gcs/dir/sub/c.txt",
+                "gs://gcs/dir/sub/deeper/d.txt"
+            }));
+
+    const auto infos(g.resolveInfo("gs://gcs/dir/*"));
+    ASSERT_EQ(infos.size(), 2u);
+    EXPECT_EQ(infos[0].size, 11u);
+    EXPECT_GT(infos[0].modified, 0);
+
+    g.remove("gs://gcs/dir/a.txt");
+    EXPECT_FALSE(g.exists("gs://gcs/dir/a.txt"));
+    EXPECT_NO_THROW(g.remove("gs://gcs/dir/a.txt"));
+}
+
+TEST_F(MockServerTest, GcsResumableUploads)
+{
+    json config(gcsConfig());
+    config["resumableThreshold"] = 1024 * 1024;
+    config["chunkSize"] = 1024 * 1024;
+    config["checksum"] = "crc32c";
+    const Arbiter g(json { { "gs", config } }.dump());
+
+    // Large uploads are sent a chunk at a time, the last with the checksum
+    // of the whole.
+    g.put("gs://gcs/big", big);
+    EXPECT_EQ(server.chunks(), 6u);
+    EXPECT_EQ(server.checksummed(), 1u);
+    EXPECT_EQ(g.getBinary("gs://gcs/big"), big);
+
+    // A session which stops advancing is given up on after a few tries,
+    // rather than being sent the same chunk forever.
+    MockServer::Options options;
+    options.stallResumable = true;
+    server.options(options);
+
+    EXPECT_THROW(g.put("gs://gcs/stalled", big), ArbiterError);
+    EXPECT_EQ(server.chunks(), 9u);
+    EXPECT_FALSE(g.exists("gs://gcs/stalled"));
+}
+
+TEST_F(MockServerTest, GcsCompositeUploads)
+{
+    json config(gcsConfig());
+    config["compositeThreshold"] = 1024 * 1024;
+    config["chunkSize"] = 1024 * 1024;
+    config["resumableThreshold"] = 0;
+    const Arbiter g(json { { "gs", config } }.dump());
+
+    // Large uploads are sent as components in parallel, which are composed
+    // and then removed.
+    g.put("gs://gcs/big", big);
+    EXPECT_EQ(server.composed(), 1u);
+    EXPECT_EQ(g.getBinary("gs://gcs/big"), big);
+    EXPECT_EQ(g.resolve("gs://gcs/**"), std::vector<std::string> {
+                "gs://gcs/big" });
+
+    // Those with a component which fails leave neither the object nor any
+    // components behind.
+    MockServer::Options options;
+    options.rejectUploads = "/1";
+    server.options(options);
+
+    EXPECT_THROW(g.put("gs://gcs/failed", big), ArbiterError);
+    EXPECT_EQ(server.composed(), 1u);
+    EXPECT_EQ(g.resolve("gs://gcs/**"), std::vector<std::string> {
+                "gs://gcs/big" });
+}
+
+TEST_F(MockServerTest, GcsCopies)
+{
+    json config(gcsConfig());
+    config["rewriteChunkSize"] = 1024 * 1024;
+    const Arbiter g(json { { "gs", config } }.dump());
+    const Driver& gs(g.getDriver("gs://"));
+
+    // Copies are rewritten on the server, a bounded amount per call.
+    g.put("gs://gcs/big", big);
+    g.copy("gs://gcs/big", "gs://other/big");
+    EXPECT_EQ(server.rewrites(), 6u);
+    EXPECT_EQ(g.getBinary("gs://other/big"), big);
+
+    // Many are started with batch requests, and those left unfinished by
+    // their first call are resumed on their own.
+    g.put("gs://gcs/a", "a");
+    g.put("gs://gcs/b", "b");
+    const std::size_t batches(server.batches());
+    const std::vector<std::exception_ptr> errors(
+            gs.copyMany(
+                {
+                    { "gcs/a", "other/a" },
+                    { "gcs/big", "other/big2" },
+                    { "gcs/missing", "other/missing" },
+                    { "gcs/b", "other/b" }
+                },
+                4));
+    EXPECT_EQ(server.batches(), batches + 1);
+    ASSERT_EQ(errors.size(), 4u);
+    EXPECT_FALSE(!!errors[0]);
+    EXPECT_FALSE(!!errors[1]);
+    EXPECT_TRUE(!!errors[2]);
+    EXPECT_FALSE(!!errors[3]);
+    EXPECT_EQ(server.rewrites(), 15u);
+
+    EXPECT_EQ(g.get("gs://other/a"), "a");
+    EXPECT_EQ(g.get("gs://other/b"), "b");
+    EXPECT_EQ(g.getBinary("gs://other/big2"), big);
+}
+
+TEST_F(MockServerTest, GcsBatches)
+{
+    const Arbiter g(json { { "gs", gcsConfig() } }.dump());
+
+    // Paths scattered across directories are looked up, and removed, with
+    // batch requests rather than one request each.
+    std::vector<std::pair<std::string, std::vector<char>>> items;
+    std::vector<std::string> paths;
+    for (std::size_t i(0); i < 150; ++i)
+    {
+        const std::string path(
+                "gs://gcs/" + std::to_string(i) + "/" + std::to_string(i));
+        items.emplace_back(path, std::vector<char>(i));
+        paths.push_back(path);
+    }
+    for (const auto& r : g.putMany(items)) EXPECT_TRUE(r.ok());
+    paths.push_back("gs://gcs/missing/file");
+
+    std::size_t batches(server.batches());
+    const auto sizes(g.getSizeMany(paths));
+    EXPECT_EQ(server.batches(), batches + 2);
+    ASSERT_EQ(sizes.size(), 151u);
+    for (std::size_t i(0); i < 150; ++i)
+    {
+        ASSERT_TRUE(sizes[i].ok());
+        EXPECT_EQ(sizes[i].value, i);
+    }
+    EXPECT_FALSE(sizes[150].ok());
+
+    batches = server.batches();
+    for (const auto& r : g.removeMany(paths)) EXPECT_TRUE(r.ok());
+    EXPECT_EQ(server.batches(), batches + 2);
+    EXPECT_TRUE(g.resolve("gs://gcs/**").empty());
+}
+
+TEST_F(MockServerTest, PooledBuffers)
+{
+    // With pooled buffers, the ranges of chunked downloads are received
+    // into reused buffers.
+    a.put("s3://bucket/big", big);
+
+    Arbiter pooled(json {
+        { "s3", s3 },
+        { "http", { { "buffers", true }, { "chunkSize", 1024 * 1024 } } }
+    }.dump());
+    auto buffers(std::dynamic_pointer_cast<http::SlabPool>(
+                pooled.httpPool().buffers()));
+    ASSERT_TRUE(!!buffers);
+
+    EXPECT_EQ(pooled.getBinary("s3://bucket/big"), big);
+    EXPECT_EQ(pooled.getBinary("s3://bucket/big"), big);
+    EXPECT_GT(buffers->hits(), 0u);
+    EXPECT_EQ(pooled.get("s3://bucket/dir/a.txt"), "hello world");
+
+    // Local handles are downloaded in ranges, each written into place.
+    std::string local;
+    {
+        auto handle(pooled.getLocalHandle("s3://bucket/big"));
+        local = handle->localPath();
+        const MappedFile& file(handle->map());
+        ASSERT_EQ(file.size(), big.size());
+        EXPECT_TRUE(std::equal(big.begin(), big.end(), file.data()));
+
+        auto small(pooled.getLocalHandle("s3://bucket/dir/a.txt"));
+        const MappedFile& text(small->map());
+        EXPECT_EQ(std::string(text.data(), text.size()), "hello world");
+    }
+    EXPECT_FALSE(pooled.exists(local));
+}
+
+TEST_F(MockServerTest, Bandwidth)
+{
+    // Transfers are paced within the bandwidth of their pool.
+    a.put("s3://bucket/big", big);
+
+    Arbiter capped(json {
+        { "s3", s3 },
+        { "http", { { "bandwidth", { { "recv", 8 * 1024 * 1024 } } } } }
+    }.dump());
+
+    const auto begin(std::chrono::steady_clock::now());
+    EXPECT_EQ(capped.getBinary("s3://bucket/big"), big);
+    EXPECT_GE(
+            std::chrono::steady_clock::now() - begin,
+            std::chrono::milliseconds(500));
+}
+
+TEST_F(MockServerTest, Revalidation)
+{
+    // Cached copies of HTTP files are revalidated by conditional GETs.
+    const std::string dir(getTempPath() + "arbiter-revalidate/");
+    for (const std::string& p : glob(dir + "*")) arbiter::remove(p);
+
+    Arbiter cached(json { { "cache", { { "dir", dir } } } }.dump());
+
+    std::size_t before(server.requests());
+    EXPECT_EQ(cached.get(http + "a.txt"), "plain");
+    EXPECT_EQ(server.requests() - before, 1u);
+
+    before = server.requests();
+    EXPECT_EQ(cached.get(http + "a.txt"), "plain");
+    EXPECT_EQ(server.requests() - before, 1u);
+    EXPECT_EQ(server.notModified(), 1u);
+    EXPECT_EQ(glob(dir + "*.json").size(), 1u);
+
+    a.put(http + "a.txt", "fresh");
+    before = server.requests();
+    EXPECT_EQ(cached.get(http + "a.txt"), "fresh");
+    EXPECT_EQ(server.requests() - before, 1u);
+    EXPECT_EQ(cached.get(http + "a.txt"), "fresh");
+    EXPECT_EQ(server.notModified(), 2u);
+
+    a.put(http + "a.txt", "plain");
+}
+
+TEST_F(MockServerTest, WarmedConnections)
+{
+    // Warmed connections are reused by the requests which follow.
+    Arbiter warmed;
+    warmed.httpPool().warm({ http }, 2).wait();
+    const std::size_t before(server.accepted());
+    for (int i(0); i < 4; ++i)
+    {
+        EXPECT_EQ(warmed.get(http + "a.txt"), "plain");
+    }
+    EXPECT_EQ(server.accepted(), before);
+}
+
+TEST_F(MockServerTest, TransferEngine)
+{
+    // Completion-based operations on S3 are driven by the transfer engine,
+    // so they finish while every thread of the Executor is busy.
+    Arbiter engine(json { { "s3", s3 }, { "threads", 1 } }.dump());
+
+    std::promise<void> unblock;
+    std::shared_future<void> blocked(unblock.get_future().share());
+    engine.executor().post([blocked]() { blocked.wait(); });
+
+    std::promise<std::string> got;
+    engine.putAsync("s3://bucket/engine.txt", { 'a', 'b', 'c' }, [&](
+                std::future<void> f)
+    {
+        f.get();
+        engine.getBinaryAsync("s3://bucket/engine.txt", [&got](
+                    std::future<std::vector<char>> f)
+        {
+            const std::vector<char> data(f.get());
+            got.set_value(std::string(data.begin(), data.end()));
+        });
+    });
+
+    std::future<std::string> result(got.get_future());
+    const bool ready(
+            result.wait_for(std::chrono::seconds(10)) ==
+            std::future_status::ready);
+    unblock.set_value();
+
+    ASSERT_TRUE(ready);
+    EXPECT_EQ(result.get(), "abc");
+}
+
+TEST_F(MockServerTest, PlannedTransfers)
+{
+    // Planned transfers are split into parts whatever the thresholds of
+    // their drivers.
+    a.put("s3://bucket/big", big);
+
+    json whole(json::parse(server.s3Config()));
+    whole["multipartThreshold"] = 0;
+
+    Arbiter planned(json {
+        { "s3", whole },
+        { "transfer", {
+            { "rangedThreshold", 1024 * 1024 },
+            { "multipartThreshold", 1024 * 1024 },
+            { "partSize", 1024 * 1024 },
+            { "minPartSize", 1024 * 1024 },
+            { "maxPartSize", 1024 * 1024 },
+            { "autoTune", true }
+        } }
+    }.dump());
+
+    // A size lookup and a ranged read of each part.
+    std::size_t before(server.requests());
+    EXPECT_EQ(planned.getBinary("s3://bucket/big"), big);
+    EXPECT_EQ(server.requests() - before, 7u);
+    EXPECT_GT(planned.transferPlanner()->throughput(), 0);
+
+    // Initiation, two parts of the S3 minimum size, and completion.
+    before = server.requests();
+    planned.put("s3://bucket/planned", big);
+    EXPECT_EQ(server.requests() - before, 4u);
+    EXPECT_EQ(a.getBinary("s3://bucket/planned"), big);
+
+    before = server.requests();
+    planned.put("s3://bucket/planned", "small");
+    EXPECT_EQ(server.requests() - before, 1u);
+    EXPECT_EQ(planned.get("s3://bucket/planned"), "small");
+
+    // Copies of local files are uploaded from a mapping of them, in
+    // parts if so planned.
+    const std::string local(getTempPath() + "arbiter-mapped-upload");
+    planned.put(local, big);
+
+    before = server.requests();
+    planned.copy(local, "s3://bucket/mapped");
+    EXPECT_EQ(server.requests() - before, 4u);
+    EXPECT_EQ(a.getBinary("s3://bucket/mapped"), big);
+
+    a.copy(local, "s3://bucket/mapped-whole");
+    EXPECT_EQ(a.getBinary("s3://bucket/mapped-whole"), big);
+
+    planned.put(local, "");
+    a.copy(local, "s3://bucket/mapped-empty");
+    EXPECT_EQ(a.get("s3://bucket/mapped-empty"), "");
+}
+
+TEST_F(MockServerTest, RefusedHeads)
+{
+    // Sizes are found by a ranged GET from servers which refuse HEADs.
+    MockServer::Options refusing;
+    refusing.rejectHead = true;
+    server.options(refusing);
+
+    a.put(http + "empty", "");
+    EXPECT_EQ(a.getSize(http + "a.txt"), 5u);
+    EXPECT_EQ(a.getSize(http + "empty"), 0u);
+    EXPECT_EQ(a.getSizeAsync(http + "a.txt").get(), 5u);
+    EXPECT_FALSE(a.tryGetSize(http + "missing"));
+    EXPECT_THROW(a.getSizeAsync(http + "missing").get(), ArbiterError);
+}
+
+TEST_F(MockServerTest, Regions)
+{
+    // The region of a bucket outside the configured one is learned from the
+    // refusal of the first request for it, after which requests are signed
+    // for its region.
+    MockServer::Options elsewhere;
+    elsewhere.regions["west"] = "us-west-2";
+    server.options(elsewhere);
+
+    Arbiter regional(json { { "s3", s3 } }.dump());
+
+    std::size_t before(server.requests());
+    regional.put("s3://west/a.txt", "west");
+    EXPECT_EQ(server.requests() - before, 2u);
+    EXPECT_EQ(server.misdirected(), 1u);
+
+    before = server.requests();
+    EXPECT_EQ(regional.get("s3://west/a.txt"), "west");
+    EXPECT_EQ(regional.getSize("s3://west/a.txt"), 4u);
+    EXPECT_EQ(regional.getSizeAsync("s3://west/a.txt").get(), 4u);
+    regional.putAsync("s3://west/b.txt", std::string("b")).get();
+    const auto listed(regional.resolve("s3://west/*"));
+    EXPECT_EQ(
+            Paths(listed.begin(), listed.end()),
+            (Paths { "s3://west/a.txt", "s3://west/b.txt" }));
+    regional.put("s3://west/big", big);
+    EXPECT_EQ(regional.getBinary("s3://west/big"), big);
+    EXPECT_EQ(server.misdirected(), 1u);
+
+    // Requests on the transfer engine are signed again as well.
+    Arbiter engine(json { { "s3", s3 } }.dump());
+    EXPECT_EQ(engine.getAsync("s3://west/a.txt").get(), "west");
+    EXPECT_EQ(server.misdirected(), 2u);
+
+    // Multipart uploads learn the region from their initiation.
+    Arbiter multipart(json { { "s3", s3 } }.dump());
+    multipart.put("s3://west/big", big);
+    EXPECT_EQ(server.misdirected(), 3u);
+    EXPECT_EQ(regional.getBinary("s3://west/big"), big);
+
+    regional.remove("s3://west/a.txt");
+    EXPECT_FALSE(regional.exists("s3://west/a.txt"));
+    EXPECT_EQ(server.misdirected(), 3u);
+}
+
+TEST_F(MockServerTest, EndpointStyles)
+{
+    // Buckets may be addressed by Transfer Acceleration or dual-stack hosts,
+    // for a whole profile or for single buckets.
+    const std::string endpoints(getTempPath() + "arbiter-endpoints.json");
+    const json services { { "s3", { { "endpoints", json::object() } } } };
+    a.put(endpoints, json {
+        { "partitions", json::array({ {
+            { "dnsSuffix", "localhost:" + std::to_string(server.port()) },
+            { "services", services }
+        } }) }
+    }.dump());
+
+    json hosted(json::parse(server.s3Config()));
+    hosted.erase("endpoint");
+    hosted["endpointsFile"] = endpoints;
+    hosted["dualstack"] = true;
+    hosted["buckets"] = { { "fast", { { "accelerate", true } } } };
+
+    Arbiter styled(json { { "s3", hosted } }.dump());
+    styled.put("s3://bucket/styled.txt", "dual");
+    styled.put("s3://fast/styled.txt", "fast");
+    EXPECT_EQ(a.get("s3://bucket/styled.txt"), "dual");
+    EXPECT_EQ(a.get("s3://fast/styled.txt"), "fast");
+
+    const auto hosts(server.hosts());
+    EXPECT_TRUE(hosts.count("bucket.s3.dualstack.us-east-1.localhost"));
+    EXPECT_TRUE(hosts.count("fast.s3-accelerate.dualstack.localhost"));
+
+    a.remove(endpoints);
+}
+
+TEST_F(MockServerTest, DirectoryBuckets)
+{
+    // Directory buckets are accessed with the credentials of a session,
+    // which is created once for all of the requests which follow.
+    const std::string zonal("s3://fast--use1-az4--x-s3/");
+    a.put(zonal + "a.txt", "zonal");
+    EXPECT_EQ(a.get(zonal + "a.txt"), "zonal");
+    EXPECT_EQ(a.getSize(zonal + "a.txt"), 5u);
+    EXPECT_EQ(a.getSizeAsync(zonal + "a.txt").get(), 5u);
+    EXPECT_EQ(a.resolve(zonal + "*").size(), 1u);
+    a.put(zonal + "big", big);
+    EXPECT_EQ(a.getBinary(zonal + "big"), big);
+    a.remove(zonal + "a.txt");
+    EXPECT_FALSE(a.exists(zonal + "a.txt"));
+    EXPECT_EQ(server.sessions(), 1u);
+}
+
+TEST_F(MockServerTest, Presigned)
+{
+    // Presigned URLs are fetched and uploaded to by the plain HTTP driver,
+    // without credentials.
+    a.put("s3://fast--use1-az4--x-s3/big", big);
+
+    a.put("s3://bucket/shared.txt", "shared");
+    const auto& s3(
+            dynamic_cast<const drivers::S3&>(
+                a.getDriver("s3://bucket/shared.txt")));
+
+    EXPECT_EQ(a.get(s3.presign("bucket/shared.txt")), "shared");
+
+    const std::string upload(
+            s3.presign(
+                "bucket/uploaded.txt",
+                "PUT",
+                std::chrono::seconds(60)));
+    a.put(upload, "uploaded");
+    EXPECT_EQ(a.get("s3://bucket/uploaded.txt"), "uploaded");
+
+    // Those of directory buckets carry the token of a session.
+    const std::string zonal(s3.presign("fast--use1-az4--x-s3/big"));
+    EXPECT_EQ(a.getBinary(zonal), big);
+
+    EXPECT_THROW(
+            s3.presign("bucket/shared.txt", "GET", std::chrono::hours(169)),
+            ArbiterError);
+}
+
+TEST_F(MockServerTest, Select)
+{
+    // S3 Select passes back only the records which match, as they arrive.
+    a.put("s3://bucket/rows.csv", "name,kind\na,x\nb,y\nc,x\n");
+    const auto& s3(
+            dynamic_cast<const drivers::S3&>(
+                a.getDriver("s3://bucket/rows.csv")));
+
+    const std::string path("bucket/rows.csv");
+    const std::string matching("SELECT * FROM S3Object s WHERE s._2 = 'x'");
+    const std::vector<char> rows(
+            s3.select(path, matching, R"({ "header": "ignore" })"));
+    EXPECT_EQ(std::string(rows.data(), rows.size()), "a,x\nc,x\n");
+
+    std::size_t chunks(0);
+    s3.select(
+            path,
+            matching,
+            [&chunks](const char*, std::size_t) { ++chunks; },
+            R"({ "header": "use" })");
+    EXPECT_EQ(chunks, 2u);
+
+    // Only the records which begin within the scan range are scanned.
+    const std::vector<char> ranged(
+            s3.select(path, matching, R"({ "scanStart": 14 })"));
+    EXPECT_EQ(std::string(ranged.data(), ranged.size()), "c,x\n");
+
+    // Messages which arrive in pieces are reassembled.
+    MockServer::Options slow;
+    slow.bandwidth = 5000;
+    server.options(slow);
+    const std::vector<char> paced(
+            s3.select(path, matching, R"({ "header": "ignore" })"));
+    EXPECT_EQ(std::string(paced.data(), paced.size()), "a,x\nc,x\n");
+    server.options(MockServer::Options());
+
+    EXPECT_THROW(
+            s3.select(path, "SELECT s._1 FROM S3Object s"),
+            ArbiterError);
+}
+
+TEST_F(MockServerTest, Patterns)
+{
+    // Patterns are matched level by level, listing only the directories
+    // which may contain matches.
+    a.put("s3://bucket/glob/2024-01/tiles/a.laz", "");
+    a.put("s3://bucket/glob/2024-01/tiles/b.las", "");
+    a.put("s3://bucket/glob/2024-01/other/c.laz", "");
+    a.put("s3://bucket/glob/2024-02/tiles/d.laz", "");
+    a.put("s3://bucket/glob/2023-12/tiles/e.laz", "");
+
+    const std::size_t before(server.requests());
+    const auto found(a.resolve("s3://bucket/glob/2024-*/tiles/*.laz"));
+    EXPECT_EQ(
+            found,
+            (std::vector<std::string> {
+                "s3://bucket/glob/2024-01/tiles/a.laz",
+                "s3://bucket/glob/2024-02/tiles/d.laz"
+            }));
+
+    // One listing of glob/2024- and one of each tiles directory.
+    EXPECT_EQ(server.requests() - before, 3u);
+
+    const auto deep(a.resolveInfo("s3://bucket/glob/**/*.laz"));
+    ASSERT_EQ(deep.size(), 4u);
+    EXPECT_TRUE(deep[0].hasSize);
+
+    EXPECT_THROW(a.resolve("s3://b*/glob/*/x"), ArbiterError);
+}
+
+TEST_F(MockServerTest, ListingIndex)
+{
+    // Listings of indexed prefixes are kept in local files, which later
+    // resolves, and later Arbiters, search without listing.
+    const std::string dir(getTempPath() + "arbiter-listings-test/");
+    json listings {
+        { "dir", dir },
+        { "prefixes", { "s3://bucket/indexed/" } },
+        { "appendOnly", { "s3://bucket/log/" } }
+    };
+    const std::string config(
+            json { { "s3", s3 }, { "listings", listings } }.dump());
+
+    a.put("s3://bucket/indexed/x/1", "1");
+    a.put("s3://bucket/indexed/x/2", "22");
+    a.put("s3://bucket/indexed/y/3", "333");
+
+    {
+        const Arbiter b(config);
+        EXPECT_EQ(b.resolve("s3://bucket/indexed/**").size(), 3u);
+
+        const std::string version(
+                *a.getDriver("s3://").tryGetVersion("bucket/indexed/x/2"));
+
+        const std::size_t before(server.requests());
+        const auto flat(b.resolveInfo("s3://bucket/indexed/x/*"));
+        ASSERT_EQ(flat.size(), 2u);
+        EXPECT_EQ(flat[1].path, "s3://bucket/indexed/x/2");
+        EXPECT_TRUE(flat[1].hasSize);
+        EXPECT_EQ(flat[1].size, 2u);
+        EXPECT_EQ(flat[1].version, version);
+        EXPECT_EQ(
+                b.resolve("s3://bucket/indexed/*/3"),
+                std::vector<std::string> { "s3://bucket/indexed/y/3" });
+        EXPECT_TRUE(b.resolve("s3://bucket/indexed/z*").empty());
+        EXPECT_EQ(server.requests(), before);
+
+        // Writes made elsewhere are unseen until the index expires, but
+        // those made through it are seen at once.
+        a.put("s3://bucket/indexed/x/4", "");
+        EXPECT_EQ(b.resolve("s3://bucket/indexed/**").size(), 3u);
+        b.put("s3://bucket/indexed/x/5", "");
+        EXPECT_EQ(b.resolve("s3://bucket/indexed/**").size(), 5u);
+        b.remove("s3://bucket/indexed/x/5");
+        EXPECT_EQ(b.resolve("s3://bucket/indexed/**").size(), 4u);
+
+        // Other prefixes are listed as usual.
+        EXPECT_EQ(
+                b.resolve("s3://bucket/dir/*"),
+                a.resolve("s3://bucket/dir/*"));
+    }
+
+    {
+        const std::size_t before(server.requests());
+        const Arbiter b(config);
+        EXPECT_EQ(b.resolve("s3://bucket/indexed/**").size(), 4u);
+        EXPECT_EQ(server.requests(), before);
+    }
+
+    // Append-only prefixes are refreshed by listing only the files after
+    // the last one indexed, so a file sorting before it is not found.
+    listings["ttl"] = 0;
+    const Arbiter b(json { { "s3", s3 }, { "listings", listings } }.dump());
+
+    a.put("s3://bucket/log/002", "");
+    EXPECT_EQ(b.resolve("s3://bucket/log/*").size(), 1u);
+    a.put("s3://bucket/log/003", "");
+    a.put("s3://bucket/log/001", "");
+    EXPECT_EQ(
+            b.resolve("s3://bucket/log/*"),
+            (std::vector<std::string> {
+                "s3://bucket/log/002",
+                "s3://bucket/log/003"
+            }));
+
+    // Without an expiry, other prefixes are listed again on each use.
+    a.put("s3://bucket/indexed/y/6", "");
+    EXPECT_EQ(b.resolve("s3://bucket/indexed/**").size(), 5u);
+
+    const auto& listing(
+            dynamic_cast<const drivers::ListingIndex&>(
+                b.getDriver("s3://")));
+    remove(listing.indexPath("bucket/indexed/"));
+    remove(listing.indexPath("bucket/log/"));
+    remove(dir);
+}
+
+TEST_F(MockServerTest, Inventory)
+{
+    // Globs within an inventoried bucket are answered from the files of the
+    // newest delivery of its inventory which has a manifest.
+    const std::string dir("bucket/inventory/listed/daily/");
+    const std::string row(
+            R"("listed","dir/a.txt","5","2024-01-02T03:04:05.000Z",)"
+            R"("abc","true","false")");
+    const Arbiter writer(json {
+        { "s3", s3 },
+        { "compression", { { "gz", json::object() } } }
+    }.dump());
+
+    writer.put(
+            "gz+s3://" + dir + "data/1.csv.gz",
+            row + "\n" +
+            R"("listed","dir/my+file%21.txt","1","","","true","false")"
+            "\n" +
+            R"("listed","dir/sub/c.txt","3","","","true","false")" "\n" +
+            R"("listed","other/d.txt","4","","","true","false")" "\n");
+    writer.put(
+            "s3://" + dir + "data/2.csv",
+            R"("listed","dir/old.txt","1","","","false","false")" "\n"
+            R"("listed","dir/gone.txt","0","","","true","true")" "\n"
+            R"("listed","dir/e.txt","2","","","true","false")");
+
+    const json manifest {
+        { "destinationBucket", "arn:aws:s3:::bucket" },
+        { "fileFormat", "CSV" },
+        { "fileSchema", "Bucket, Key, Size, LastModifiedDate, ETag, "
+            "IsLatest, IsDeleteMarker" },
+        { "files", {
+            { { "key", "inventory/listed/daily/data/1.csv.gz" } },
+            { { "key", "inventory/listed/daily/data/2.csv" } }
+        } }
+    };
+    json stale(manifest);
+    stale["files"] = json::array();
+
+    a.put("s3://" + dir + "2024-01-01T00-00Z/manifest.json", stale.dump());
+    a.put("s3://" + dir + "2024-01-02T00-00Z/manifest.json",
+            manifest.dump());
+    a.put("s3://" + dir + "2024-01-03T00-00Z/manifest.checksum", "");
+    a.put("s3://" + dir + "hive/dt=2024-01-04-00-00/symlink.txt", "");
+
+    json inventoried(s3);
+    inventoried["inventory"] = { { "listed", "s3://" + dir } };
+    const Arbiter b(json { { "s3", inventoried } }.dump());
+
+    const auto flat(b.resolveInfo("s3://listed/dir/*"));
+    std::map<std::string, FileInfo> found;
+    for (const FileInfo& info : flat) found[info.path] = info;
+    EXPECT_EQ(found.size(), 3u);
+    ASSERT_TRUE(found.count("s3://listed/dir/a.txt"));
+    EXPECT_TRUE(found.count("s3://listed/dir/my file!.txt"));
+    EXPECT_TRUE(found.count("s3://listed/dir/e.txt"));
+
+    const FileInfo& info(found["s3://listed/dir/a.txt"]);
+    EXPECT_TRUE(info.hasSize);
+    EXPECT_EQ(info.size, 5u);
+    EXPECT_EQ(info.version, "\"abc\"");
+    EXPECT_EQ(info.modified, Time("2024-01-02T03:04:05Z").asUnix());
+
+    EXPECT_EQ(b.resolve("s3://listed/dir/**").size(), 4u);
+    EXPECT_EQ(b.resolve("s3://listed/**").size(), 5u);
+    EXPECT_TRUE(b.resolve("s3://listed/dir/z*").empty());
+
+    // A manifest may also be named directly.
+    inventoried["inventory"] = {
+        { "listed", "s3://" + dir + "2024-01-01T00-00Z/manifest.json" }
+    };
+    const Arbiter c(json { { "s3", inventoried } }.dump());
+    EXPECT_TRUE(c.resolve("s3://listed/**").empty());
+
+    // Other buckets are still listed.
+    const auto listed(b.resolve("s3://bucket/dir/*"));
+    EXPECT_EQ(
+            Paths(listed.begin(), listed.end()),
+            (Paths { "s3://bucket/dir/a.txt", "s3://bucket/dir/b.txt" }));
+}
+
+TEST_F(MockServerTest, Shards)
+{
+    // Files within sharded prefixes are stored under hashed shard prefixes,
+    // spread across roots, and are read, written, and globbed by their
+    // logical paths.
+    const Arbiter b(json {
+        { "s3", s3 },
+        { "shards", { { "prefixes", {
+            { { "path", "s3://bucket/sharded/" }, { "count", 4 } },
+            {
+                { "path", "s3://bucket/spread/" },
+                { "count", 2 },
+                { "roots", { "s3://spread-a/", "s3://spread-b/t/" } }
+            }
+        } } } }
+    }.dump());
+
+    Paths logical;
+    for (int i(0); i < 20; ++i)
+    {
+        const std::string path(
+                "s3://bucket/sharded/" + std::to_string(i % 2) +
+                "/" + std::to_string(i));
+        b.put(path, std::to_string(i));
+        logical.insert(path);
+    }
+
+    const auto& sharded(
+            dynamic_cast<const drivers::Sharded&>(b.getDriver("s3://")));
+    const std::string physical(sharded.physical("bucket/sharded/1/3"));
+    EXPECT_EQ(physical.substr(0, 15), "bucket/sharded/");
+    EXPECT_EQ(physical.substr(16), "/1/3");
+    EXPECT_EQ(a.get("s3://" + physical), "3");
+    EXPECT_EQ(b.get("s3://bucket/sharded/1/3"), "3");
+    EXPECT_EQ(*b.tryGetSize("s3://bucket/sharded/1/13"), 2u);
+
+    // Files are spread across shards, unseen by their logical paths.
+    Paths shards;
+    for (const std::string& path : a.resolve("s3://bucket/sharded/**"))
+    {
+        shards.insert(path.substr(0, 21));
+    }
+    EXPECT_GT(shards.size(), 1u);
+    EXPECT_FALSE(a.exists("s3://bucket/sharded/1/3"));
+
+    const auto all(b.resolve("s3://bucket/sharded/**"));
+    EXPECT_EQ(Paths(all.begin(), all.end()), logical);
+    EXPECT_EQ(b.resolve("s3://bucket/sharded/*").size(), 0u);
+    EXPECT_EQ(b.resolve("s3://bucket/sharded/1/*").size(), 10u);
+    EXPECT_EQ(
+            b.resolve("s3://bucket/sharded/*/1?"),
+            (std::vector<std::string> {
+                "s3://bucket/sharded/0/10",
+                "s3://bucket/sharded/0/12",
+                "s3://bucket/sharded/0/14",
+                "s3://bucket/sharded/0/16",
+                "s3://bucket/sharded/0/18",
+                "s3://bucket/sharded/1/11",
+                "s3://bucket/sharded/1/13",
+                "s3://bucket/sharded/1/15",
+                "s3://bucket/sharded/1/17",
+                "s3://bucket/sharded/1/19"
+            }));
+
+    b.copy("s3://bucket/sharded/1/3", "s3://bucket/sharded/copied");
+    EXPECT_EQ(b.get("s3://bucket/sharded/copied"), "3");
+    b.remove("s3://bucket/sharded/copied");
+    EXPECT_FALSE(b.exists("s3://bucket/sharded/copied"));
+
+    // Shards alternate between roots.
+    b.put("s3://bucket/spread/x", "x");
+    b.put("s3://bucket/spread/y", "y");
+    b.put("s3://bucket/spread/z", "z");
+    const auto spread(b.resolve("s3://bucket/spread/**"));
+    EXPECT_EQ(
+            Paths(spread.begin(), spread.end()),
+            (Paths {
+                "s3://bucket/spread/x",
+                "s3://bucket/spread/y",
+                "s3://bucket/spread/z"
+            }));
+    EXPECT_EQ(
+            a.resolve("s3://spread-a/0/*").size() +
+                a.resolve("s3://spread-b/t/1/*").size(),
+            3u);
+}
+
+TEST_F(MockServerTest, Replicas)
+{
+    // Reads of replica sets go to their fastest healthy replica, are hedged
+    // when that stalls, and fail over to another on errors.
+    json dead(s3);
+    dead["profile"] = "dead";
+    dead["endpoint"] = "localhost:1";
+
+    const Arbiter b(json {
+        { "s3", { s3, dead } },
+        { "mem", { { "latency", 400 } } },
+        { "http", { { "retry", { { "count", 0 } } } } },
+        { "replicas", {
+            { "sets", {
+                { "slow", { "mem://slow/", "s3://bucket/replica/" } },
+                {
+                    "failing",
+                    { "dead@s3://bucket/replica/", "s3://bucket/replica/" }
+                }
+            } },
+            { "hedge", { { "maxDelay", 50 } } }
+        } }
+    }.dump());
+
+    a.put("s3://bucket/replica/x", "x");
+    b.put("mem://slow/x", "x");
+
+    const auto& replicas(
+            dynamic_cast<const drivers::Replicated&>(
+                b.getDriver("replica://")));
+    EXPECT_EQ(replicas.ranked("slow").front(), "mem://slow/");
+
+    // Neither is measured, so the slow one is tried first, and hedged.
+    EXPECT_EQ(b.get("replica://slow/x"), "x");
+    EXPECT_EQ(replicas.ranked("slow").front(), "s3://bucket/replica/");
+
+    const std::size_t before(server.requests());
+    EXPECT_EQ(b.get("replica://slow/x"), "x");
+    EXPECT_EQ(*b.tryGetSize("replica://slow/x"), 1u);
+    EXPECT_EQ(server.requests(), before + 2);
+
+    // The dead replica fails over, and is then passed over.
+    EXPECT_EQ(b.get("replica://failing/x"), "x");
+    EXPECT_EQ(
+            replicas.ranked("failing"),
+            (std::vector<std::string> {
+                "s3://bucket/replica/",
+                "dead@s3://bucket/replica/"
+            }));
+    EXPECT_EQ(
+            b.resolve("replica://failing/*"),
+            std::vector<std::string> { "replica://failing/x" });
+    EXPECT_FALSE(b.exists("replica://failing/y"));
+
+    EXPECT_THROW(b.put("replica://slow/y", "y"), ArbiterError);
+    EXPECT_THROW(b.get("replica://none/x"), ArbiterError);
+}
+
+TEST_F(MockServerTest, ContentAddressed)
+{
+    // Content-addressed files with the same contents share a blob, so that
+    // writing the same contents again uploads nothing.
+    const Arbiter b(json {
+        { "s3", s3 },
+        { "cas", { { "root", "s3://bucket/cas/" } } }
+    }.dump());
+
+    b.put("cas://tiles/a", big);
+    const std::size_t before(server.requests());
+    b.put("cas://tiles/b", big);
+    EXPECT_EQ(server.requests(), before + 1);
+
+    const std::string digest(crypto::encodeAsHex(crypto::sha256(big)));
+    const std::string blob(
+            "s3://bucket/cas/blobs/" + digest.substr(0, 2) + "/" + digest);
+    const Driver& cas(b.getDriver("cas://"));
+    EXPECT_EQ(*cas.tryGetVersion("tiles/a"), digest);
+    EXPECT_EQ(*cas.tryGetVersion("tiles/b"), digest);
+    EXPECT_EQ(
+            a.resolve("s3://bucket/cas/blobs/**"),
+            std::vector<std::string> { blob });
+
+    // Another writer looks up the blob, rather than uploading it.
+    const Arbiter c(json {
+        { "s3", s3 },
+        { "cas", { { "root", "s3://bucket/cas/" } } }
+    }.dump());
+    const std::size_t uploaded(server.requests());
+    c.put("cas://tiles/c", big);
+    EXPECT_EQ(server.requests(), uploaded + 2);
+
+    EXPECT_EQ(b.getBinary("cas://tiles/c"), big);
+    EXPECT_EQ(*b.tryGetSize("cas://tiles/c"), big.size());
+    EXPECT_EQ(b.getRange("cas://tiles/a", 1, 2), a.getRange(blob, 1, 2));
+
+    b.put("cas://tiles/d", "d");
+    b.copy("cas://tiles/d", "cas://tiles/e");
+    EXPECT_EQ(b.get("cas://tiles/e"), "d");
+    b.remove("cas://tiles/d");
+    EXPECT_FALSE(b.exists("cas://tiles/d"));
+    EXPECT_FALSE(b.tryGetSize("cas://tiles/d"));
+
+    const auto names(b.resolve("cas://tiles/*"));
+    EXPECT_EQ(
+            Paths(names.begin(), names.end()),
+            (Paths {
+                "cas://tiles/a",
+                "cas://tiles/b",
+                "cas://tiles/c",
+                "cas://tiles/e"
+            }));
+}
+
+TEST_F(MockServerTest, Packs)
+{
+    // Packed files cost a request per pack to write, and once the index is
+    // fetched, a single ranged request to read.
+    const std::size_t written(server.requests());
+    PackWriter writer(a.getEndpoint("s3://bucket/packed/"), 8);
+    writer.add("a/1", "aaaa");
+    writer.add("a/2", "bbbb");
+    writer.add("a/3", "cc");
+    writer.add("b/1", "dddd");
+    writer.add("a/2", "BBBB");
+    writer.close();
+    EXPECT_EQ(server.requests(), written + 4);
+    EXPECT_THROW(writer.add("c", "c"), ArbiterError);
+
+    const Arbiter b(json {
+        { "s3", s3 },
+        { "packs", { { "sets", { { "tiles", "s3://bucket/packed" } } } } }
+    }.dump());
+
+    const std::size_t before(server.requests());
+    EXPECT_EQ(b.get("pack://tiles/a/1"), "aaaa");
+    EXPECT_EQ(server.requests(), before + 2);
+    EXPECT_EQ(b.get("pack://tiles/a/2"), "BBBB");
+    EXPECT_EQ(server.requests(), before + 3);
+
+    EXPECT_EQ(*b.tryGetSize("pack://tiles/b/1"), 4u);
+    EXPECT_FALSE(b.exists("pack://tiles/x"));
+    EXPECT_FALSE(b.tryGetBinary("pack://tiles/x"));
+    EXPECT_EQ(b.getRange("pack://tiles/a/2", 1, 10), (std::vector<char> {
+        'B', 'B', 'B'
+    }));
+
+    const auto flat(b.resolve("pack://tiles/a/*"));
+    EXPECT_EQ(
+            Paths(flat.begin(), flat.end()),
+            (Paths {
+                "pack://tiles/a/1",
+                "pack://tiles/a/2",
+                "pack://tiles/a/3"
+            }));
+    EXPECT_EQ(b.resolve("pack://tiles/**").size(), 4u);
+    EXPECT_EQ(
+            b.resolve("pack://tiles/*/1"),
+            (std::vector<std::string> {
+                "pack://tiles/a/1",
+                "pack://tiles/b/1"
+            }));
+    EXPECT_EQ(server.requests(), before + 4);
+
+    // Many files are read with a request per pack.
+    const auto& packs(
+            dynamic_cast<const drivers::Packs&>(b.getDriver("pack://")));
+    const auto many(packs.tryGetMany({
+        "tiles/a/1", "tiles/a/3", "tiles/x", "tiles/b/1", "tiles/a/2"
+    }));
+    EXPECT_EQ(server.requests(), before + 7);
+    ASSERT_EQ(many.size(), 5u);
+    EXPECT_EQ(std::string(many[0]->begin(), many[0]->end()), "aaaa");
+    EXPECT_EQ(std::string(many[1]->begin(), many[1]->end()), "cc");
+    EXPECT_FALSE(many[2]);
+    EXPECT_EQ(std::string(many[3]->begin(), many[3]->end()), "dddd");
+    EXPECT_EQ(std::string(many[4]->begin(), many[4]->end()), "BBBB");
+
+    EXPECT_THROW(b.put("pack://tiles/c", "c"), ArbiterError);
+}
+
+TEST_F(MockServerTest, NamedPools)
+{
+    // Drivers named by the pools of the HTTP configuration have their own.
+    Arbiter b(json {
+        { "s3", s3 },
+        { "http", { { "pools", { { "s3", { { "concurrency", 2 } } } } } } }
+    }.dump());
+
+    EXPECT_NE(&b.httpPool("s3"), &b.httpPool());
+    EXPECT_EQ(&b.httpPool("https"), &b.httpPool());
+    EXPECT_EQ(b.httpPool("s3").size(), 2u);
+    EXPECT_EQ(b.httpPool().size(), 32u);
+
+    b.put("s3://bucket/pooled", "pooled");
+    EXPECT_EQ(b.get("s3://bucket/pooled"), "pooled");
+    EXPECT_EQ(b.httpPool("s3").stats().codes[200], 2u);
+    EXPECT_TRUE(b.httpPool().stats().codes.empty());
+}
+
+#ifdef ARBITER_ZLIB
+TEST_F(MockServerTest, Archives)
+{
+    // Members of an archive are read with ranged requests, once its
+    // directory is read from its end.
+    const auto le([](std::string& s, std::uint64_t v, std::size_t n)
+    {
+        for (std::size_t i(0); i < n; ++i, v >>= 8) s.push_back(v & 0xff);
+    });
+
+    // The raw deflated data and CRC of gzipped data are those of a
+    // deflated member.
+    const auto gzip([&](const std::string& data)
+    {
+        a.put("gz+mem://zip/member", data);
+        const std::vector<char> gz(a.getBinary("mem://zip/member"));
+        return std::string(gz.begin(), gz.end());
+    });
+
+    std::string zip;
+    std::string cd;
+    std::size_t count(0);
+    const auto add([&](
+                const std::string& name,
+                const std::string& data,
+                const bool deflate)
+    {
+        const std::string gz(gzip(data));
+        const std::string stored(
+                deflate ? gz.substr(10, gz.size() - 18) : data);
+
+        std::string common;
+        le(common, 20, 2);
+        le(common, 0, 2);
+        le(common, deflate ? 8 : 0, 2);
+        le(common, 0, 4);
+        common += gz.substr(gz.size() - 8, 4);
+        le(common, stored.size(), 4);
+        le(common, data.size(), 4);
+        le(common, name.size(), 2);
+
+        le(cd, 0x02014b50, 4);
+        le(cd, 20, 2);
+        cd += common;
+        le(cd, 0, 2 + 2 + 2 + 2 + 4);
+        le(cd, zip.size(), 4);
+        cd += name;
+
+        le(zip, 0x04034b50, 4);
+        zip += common;
+        le(zip, 0, 2);
+        zip += name + stored;
+        ++count;
+    });
+
+    const std::string text(100000, 'b');
+    add("a.txt", "hello", false);
+    add("dir/", "", false);
+    add("dir/b.txt", text, true);
+    add("dir/sub/c.txt", "c", false);
+
+    const std::size_t cdOffset(zip.size());
+    zip += cd;
+    le(zip, 0x06054b50, 4);
+    le(zip, 0, 4);
+    le(zip, count, 2);
+    le(zip, count, 2);
+    le(zip, cd.size(), 4);
+    le(zip, cdOffset, 4);
+    le(zip, 0, 2);
+    a.put("s3://bucket/archive.zip", zip);
+    EXPECT_LT(zip.size(), text.size() / 10);
+
+    const std::string root("zip+s3://bucket/archive.zip!/");
+    const std::size_t before(server.requests());
+    EXPECT_EQ(*a.tryGetSize(root + "a.txt"), 5u);
+    EXPECT_EQ(server.requests(), before + 2);
+    EXPECT_EQ(*a.tryGetSize(root + "dir/b.txt"), text.size());
+    EXPECT_FALSE(a.exists(root + "dir/"));
+    EXPECT_FALSE(a.tryGet(root + "missing"));
+    EXPECT_EQ(server.requests(), before + 2);
+
+    EXPECT_EQ(a.get(root + "a.txt"), "hello");
+    EXPECT_EQ(server.requests(), before + 3);
+    EXPECT_EQ(a.get(root + "dir/b.txt"), text);
+    EXPECT_EQ(server.requests(), before + 4);
+
+    const std::vector<char> stored(a.getRange(root + "a.txt", 1, 3));
+    EXPECT_EQ(std::string(stored.begin(), stored.end()), "ell");
+    const std::vector<char> inflated(
+            a.getRange(root + "dir/b.txt", text.size() - 2, 8));
+    EXPECT_EQ(std::string(inflated.begin(), inflated.end()), "bb");
+
+    EXPECT_EQ(
+            a.resolve(root + "dir/*"),
+            std::vector<std::string> { root + "dir/b.txt" });
+    EXPECT_EQ(a.resolve(root + "**").size(), 3u);
+    EXPECT_EQ(
+            a.resolve(root + "dir/*/c.txt"),
+            std::vector<std::string> { root + "dir/sub/c.txt" });
+
+    EXPECT_FALSE(a.tryGetSize("zip+s3://bucket/missing.zip!/a.txt"));
+    EXPECT_THROW(a.put(root + "a.txt", "a"), ArbiterError);
+}
+#endif
 
-TEST(Env, HomeDir)
+TEST_F(MockServerTest, Checksums)
 {
-    std::string home;
+    // Checksummed uploads carry the CRC32C of each object and part, which
+    // the server verifies, though their payloads are unsigned.  Copies have
+    // no checksums.
+    json checked(json::parse(server.s3Config()));
+    checked["multipartThreshold"] = 1024 * 1024;
+    checked["unsignedPayload"] = true;
+    checked["checksum"] = "crc32c";
+    const Arbiter summed(json { { "s3", checked } }.dump());
 
-    ASSERT_NO_THROW(home = arbiter::expandTilde("~"));
-    EXPECT_NE(home, "~");
-    EXPECT_FALSE(home.empty());
+    const std::size_t before(server.checksummed());
+    summed.put("s3://bucket/checked.txt", "checked");
+    summed.put("s3://bucket/checked", big);
+    summed.copy("s3://bucket/checked", "s3://bucket/copied");
+    EXPECT_EQ(server.checksummed() - before, 2u);
+
+    EXPECT_EQ(a.get("s3://bucket/checked.txt"), "checked");
+    EXPECT_EQ(a.getBinary("s3://bucket/checked"), big);
+    EXPECT_EQ(a.getBinary("s3://bucket/copied"), big);
 }
 
-TEST(Arbiter, HttpDerivation)
+TEST_F(MockServerTest, InjectedFailures)
+{
+    // Injected failures are retried.
+    MockServer::Options options;
+    options.errorRate = 0.3;
+    server.options(options);
+
+    for (int i(0); i < 10; ++i)
+    {
+        EXPECT_EQ(a.get("s3://bucket/dir/a.txt"), "hello world");
+    }
+    EXPECT_GT(server.errors(), 0u);
+}
+
+TEST_F(MockServerTest, CircuitBreaker)
+{
+    // Against a failing host, retries are limited by the retry budget, and
+    // once the circuit opens, requests fail without reaching it.
+    Arbiter broken(json {
+        { "http", {
+            { "retry", { { "baseDelay", 1 }, { "maxDelay", 1 } } },
+            { "breaker", {
+                { "threshold", 3 },
+                { "cooldown", 200 },
+                { "retryBurst", 1 }
+            } }
+        } }
+    }.dump());
+
+    const std::string root(server.httpRoot());
+    const std::string host(root.substr(0, root.size() - 1));
+    const http::CircuitBreaker& breaker(*broken.httpPool().breaker());
+
+    broken.put(root + "breaker.txt", "up");
+
+    MockServer::Options failing;
+    failing.errorRate = 1;
+    server.options(failing);
+
+    // One retry from the budget, then none.
+    std::size_t before(server.requests());
+    EXPECT_THROW(broken.get(root + "breaker.txt"), ArbiterError);
+    EXPECT_EQ(server.requests() - before, 2u);
+    EXPECT_EQ(breaker.state(host), http::CircuitBreaker::State::Closed);
+
+    before = server.requests();
+    EXPECT_THROW(broken.get(root + "breaker.txt"), ArbiterError);
+    EXPECT_EQ(server.requests() - before, 1u);
+    EXPECT_EQ(breaker.state(host), http::CircuitBreaker::State::Open);
+
+    before = server.requests();
+    EXPECT_THROW(broken.get(root + "breaker.txt"), ArbiterError);
+    EXPECT_EQ(server.requests() - before, 0u);
+
+    const http::PoolStats stats(broken.httpPool().stats());
+    EXPECT_EQ(stats.rejected, 1u);
+    EXPECT_EQ(stats.retriesDenied, 2u);
+
+    // After the cooldown, a successful probe closes the circuit.
+    server.options(MockServer::Options());
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    EXPECT_EQ(broken.get(root + "breaker.txt"), "up");
+    EXPECT_EQ(breaker.state(host), http::CircuitBreaker::State::Closed);
+}
+
+TEST_F(MockServerTest, Resumption)
+{
+    // Bodies cut short are resumed from their last byte, whether buffered,
+    // ranged, or streamed.
+    const Arbiter resuming(json {
+        { "http", {
+            { "retry", { { "baseDelay", 1 }, { "maxDelay", 1 } } }
+        } }
+    }.dump());
+
+    const std::string path(server.httpRoot() + "resume.bin");
+    std::vector<char> data(10000);
+    for (std::size_t i(0); i < data.size(); ++i) data[i] = char(i * 7);
+    resuming.put(path, data);
+
+    MockServer::Options cutting;
+    cutting.truncate = 4000;
+    server.options(cutting);
+
+    std::size_t before(server.truncated());
+    EXPECT_EQ(resuming.getBinary(path), data);
+    EXPECT_EQ(server.truncated() - before, 2u);
+
+    before = server.truncated();
+    EXPECT_EQ(
+            resuming.getRange(path, 1000, 9000),
+            std::vector<char>(data.begin() + 1000, data.end()));
+    EXPECT_EQ(server.truncated() - before, 2u);
+
+    std::vector<char> streamed;
+    resuming.getDriver(path).getStream(
+            path,
+            [&](const char* d, std::size_t n)
+            {
+                streamed.insert(streamed.end(), d, d + n);
+            });
+    EXPECT_EQ(streamed, data);
+}
+
+TEST_F(MockServerTest, Throttling)
+{
+    // A throttled response pauses its host for every request of the pool.
+    Arbiter throttled(json {
+        { "http", {
+            { "retry", { { "count", 0 } } },
+            { "throttle", { { "pause", 300 } } }
+        } }
+    }.dump());
+
+    const std::string path(server.httpRoot() + "throttle.txt");
+    throttled.put(path, "paused");
+
+    MockServer::Options slow;
+    slow.errorRate = 1;
+    server.options(slow);
+    EXPECT_THROW(throttled.get(path), ArbiterError);
+    server.options(MockServer::Options());
+
+    const auto start(std::chrono::steady_clock::now());
+    std::string result;
+    std::thread other([&]() { result = throttled.get(path); });
+    other.join();
+    EXPECT_EQ(result, "paused");
+    EXPECT_GE(
+            std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(200));
+    EXPECT_EQ(throttled.httpPool().stats().throttled, 1u);
+}
+
+TEST_F(MockServerTest, MultiRange)
+{
+    // Ranges are read by a single request from servers which serve several
+    // at once, and otherwise by a request for each merged read.
+    const Arbiter ranging(json {
+        { "rangeGap", 0 },
+        { "http", { { "multiRange", true } } }
+    }.dump());
+
+    const std::string path(server.httpRoot() + "ranges.bin");
+    std::vector<char> data(10000);
+    for (std::size_t i(0); i < data.size(); ++i) data[i] = char(i * 3);
+    ranging.put(path, data);
+
+    const std::vector<std::pair<std::size_t, std::size_t>> ranges {
+        { 9000, 2000 }, { 100, 50 }, { 5000, 100 }, { 120, 100 },
+        { 20000, 10 }
+    };
+    std::vector<std::vector<char>> expected;
+    for (const auto& r : ranges)
+    {
+        const std::size_t begin((std::min)(r.first, data.size()));
+        const std::size_t end((std::min)(r.first + r.second, data.size()));
+        expected.emplace_back(data.begin() + begin, data.begin() + end);
+    }
+
+    MockServer::Options multi;
+    multi.multiRange = true;
+    server.options(multi);
+
+    std::size_t before(server.requests());
+    EXPECT_EQ(ranging.getRanges(path, ranges), expected);
+    EXPECT_EQ(server.requests() - before, 1u);
+
+    // A server answering with the whole file serves this read, but is
+    // then read a range at a time.
+    server.options(MockServer::Options());
+    before = server.requests();
+    EXPECT_EQ(ranging.getRanges(path, ranges), expected);
+    EXPECT_EQ(server.requests() - before, 1u);
+
+    before = server.requests();
+    EXPECT_EQ(ranging.getRanges(path, ranges), expected);
+    EXPECT_GE(server.requests() - before, 4u);
+}
+
+TEST_F(MockServerTest, TunedHandles)
+{
+    // Transfers work as before with tuned handles.
+    const Arbiter tuned(json {
+        { "http", {
+            { "ipResolve", "any" },
+            { "bufferSize", 512 * 1024 },
+            { "uploadBufferSize", 1024 * 1024 },
+            { "tcpKeepAlive", true }
+        } }
+    }.dump());
+
+    const std::string path(server.httpRoot() + "tuned.bin");
+    std::vector<char> data(3 * 1024 * 1024);
+    for (std::size_t i(0); i < data.size(); ++i) data[i] = char(i % 253);
+    tuned.put(path, data);
+    EXPECT_EQ(tuned.getBinary(path), data);
+}
+
+TEST_F(MockServerTest, ETagSync)
+{
+    // Local files which seem newer than their multipart uploads are found
+    // unchanged by their ETags, without being copied again.
+    const std::string local(getTempPath() + "arbiter-etag/");
+    const std::string remote("s3://bucket/etag/");
+    mkdirp(local);
+    a.removeMany(a.resolve(local + "**"));
+
+    std::vector<char> large(12 * 1024 * 1024);
+    for (std::size_t i(0); i < large.size(); ++i) large[i] = char(i % 251);
+    a.put(local + "large.bin", large);
+    a.put(local + "small.txt", "small");
+
+    SyncResult result(a.sync(local, remote));
+    EXPECT_EQ(result.copied, 2u);
+
+    auto touch([](const std::string& path)
+    {
+        utimbuf times;
+        times.actime = times.modtime = std::time(nullptr) + 3600;
+        ::utime(path.c_str(), &times);
+    });
+    touch(local + "large.bin");
+    touch(local + "small.txt");
+
+    const std::size_t before(server.requests());
+    result = a.sync(local, remote);
+    EXPECT_EQ(result.copied, 0u);
+    EXPECT_EQ(result.skipped, 2u);
+    EXPECT_EQ(result.verified, 2u);
+    EXPECT_EQ(server.requests() - before, 1u);
+
+    large[large.size() / 2] ^= 1;
+    a.put(local + "large.bin", large);
+    touch(local + "large.bin");
+    result = a.sync(local, remote);
+    EXPECT_EQ(result.copied, 1u);
+    EXPECT_EQ(result.verified, 1u);
+    EXPECT_EQ(a.getBinary(remote + "large.bin"), large);
+}
+
+TEST_F(MockServerTest, Notifications)
+{
+    // With a queue of event notifications, watches of buckets receive
+    // their changes from it rather than polling, and delete what they
+    // receive.
+    MockServer::Options options;
+    options.notifications = true;
+    server.options(options);
+
+    json config(json::parse(server.s3Config()));
+    config["notifications"] = {
+        { "queue", http + "123456789012/changes" },
+        { "wait", 1 }
+    };
+    const Arbiter b(json { { "s3", config } }.dump());
+    EXPECT_TRUE(b.capabilities("s3://bucket").changeNotifications);
+
+    const std::string path("s3://bucket/watched/a b");
+    ChangeLog log;
+    auto watch(b.watch("s3://bucket/watched/", log.callback()));
+
+    b.put(path, "abc");
+    const std::string version(
+            *b.getDriver(path).tryGetVersion(Arbiter::stripType(path)));
+    b.put("s3://bucket/unwatched", "x");
+    b.remove(path);
+    ASSERT_TRUE(log.await(path, ChangeEvent::Type::Removed));
+
+    watch.reset();
+    const std::vector<ChangeEvent> events(log.events());
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0].type, ChangeEvent::Type::Changed);
+    EXPECT_EQ(events[0].info.path, path);
+    EXPECT_EQ(events[0].info.size, 3u);
+    EXPECT_EQ(events[0].info.version, version);
+    EXPECT_EQ(server.unacknowledged(), 0u);
+}
+
+TEST_F(MockServerTest, ExistsMany)
+{
+    // Bulk existence checks list the directories holding many of the
+    // paths, and look up the rest.
+    std::vector<std::string> paths;
+    for (std::size_t i(0); i < 40; ++i)
+    {
+        const std::string path("s3://bucket/bulk/" + std::to_string(i));
+        if (i % 4) a.put(path, "x");
+        paths.push_back(path);
+    }
+    a.put("s3://bucket/sparse/a", "a");
+    paths.push_back("s3://bucket/sparse/a");
+    paths.push_back("s3://bucket/sparse/b");
+
+    const std::size_t before(server.requests());
+    const auto found(a.existsMany(paths));
+    EXPECT_EQ(server.requests() - before, 3u);
+
+    ASSERT_EQ(found.size(), paths.size());
+    for (std::size_t i(0); i < 40; ++i)
+    {
+        ASSERT_TRUE(found[i].ok());
+        EXPECT_EQ(found[i].value, i % 4 != 0) << paths[i];
+    }
+    EXPECT_TRUE(found[40].value);
+    EXPECT_FALSE(found[41].value);
+}
+
+TEST_F(MockServerTest, StreamedText)
+{
+    // Text is received directly into a string, by the streaming GET.
+    const std::string text("{ \"manifest\": [1, 2, 3] }");
+    a.put("s3://bucket/text.json", text);
+    a.put(http + "text.json", text);
+
+    const Driver& s3(a.getDriver("s3://"));
+    EXPECT_EQ(s3.get("bucket/text.json"), text);
+    EXPECT_FALSE(!!s3.tryGet("bucket/missing.json"));
+
+    const std::string root(Arbiter::stripType(http));
+    const Driver& plain(a.getDriver(http));
+    ASSERT_TRUE(!!plain.tryGet(root + "text.json"));
+    EXPECT_EQ(*plain.tryGet(root + "text.json"), text);
+    EXPECT_FALSE(!!plain.tryGet(root + "missing.json"));
+    EXPECT_THROW(plain.get(root + "missing.json"), ArbiterError);
+}
+
+TEST_F(MockServerTest, KeyTemplates)
+{
+    // Resources are built from a template of their bucket, encoding only
+    // their keys, for endpoints as for whole paths.
+    const Endpoint ep(a.getEndpoint("s3://bucket/templated/"));
+    ep.put("a b/c+d.txt", "encoded");
+    EXPECT_EQ(ep.get("a b/c+d.txt"), "encoded");
+    EXPECT_EQ(a.get("s3://bucket/templated/a b/c+d.txt"), "encoded");
+    EXPECT_EQ(
+            a.resolve("s3://bucket/templated/**"),
+            std::vector<std::string> {
+                "s3://bucket/templated/a b/c+d.txt" });
+    EXPECT_EQ(*ep.tryGetSize("a b/c+d.txt"), 7u);
+    EXPECT_FALSE(!!ep.tryGetSize("a b/missing"));
+}
+
+TEST_F(MockServerTest, PartGets)
+{
+    // Objects are read by part number without a HEAD, the first part
+    // giving the number of the rest.
+    json parted(json::parse(server.s3Config()));
+    parted["multipartThreshold"] = 1024 * 1024;
+    parted["partSize"] = 5 * 1024 * 1024;
+    parted["partGets"] = true;
+    const Arbiter p(json { { "s3", parted } }.dump());
+
+    std::vector<char> data(12 * 1024 * 1024);
+    for (std::size_t i(0); i < data.size(); ++i) data[i] = i % 251;
+    p.put("s3://bucket/parted", data);
+
+    std::size_t before(server.requests());
+    EXPECT_EQ(p.getBinary("s3://bucket/parted"), data);
+    EXPECT_EQ(server.requests() - before, 3u);
+
+    // Objects uploaded whole are a single part.
+    p.put("s3://bucket/unparted", "whole");
+    before = server.requests();
+    EXPECT_EQ(p.get("s3://bucket/unparted"), "whole");
+    EXPECT_EQ(server.requests() - before, 1u);
+
+    EXPECT_FALSE(!!p.tryGetBinary("s3://bucket/missing"));
+    EXPECT_EQ(
+            p.get("s3://bucket/unparted", { { "Range", "bytes=1-2" } }),
+            "ho");
+}
+
+TEST_F(MockServerTest, Shares)
+{
+    // Shares of a prefix are runs of its keys, which together make up the
+    // whole of it.
+    for (const std::string dir : { "", "a/", "b/", "b/c/", "d/e/" })
+    {
+        for (const std::string name : { "x", "y" })
+        {
+            a.put("s3://bucket/shares/" + dir + name, name);
+        }
+    }
+
+    for (const std::string glob : { "*", "**" })
+    {
+        const std::string path("s3://bucket/shares/" + glob);
+        for (const std::size_t shards : { 1u, 3u, 5u, 20u })
+        {
+            std::vector<std::string> all;
+            for (std::size_t shard(0); shard < shards; ++shard)
+            {
+                const auto share(a.resolve(path, shard, shards));
+                all.insert(all.end(), share.begin(), share.end());
+            }
+            EXPECT_EQ(all, a.resolve(path)) << path << " " << shards;
+        }
+    }
+}
+
+TEST(Arbiter, StatusResults)
+{
+    MockServer server;
+    const Arbiter a(json {
+        { "s3", json::parse(server.s3Config()) },
+        { "http", { { "retry", { { "count", 0 } } } } }
+    }.dump());
+
+    const std::string http(server.httpRoot());
+    a.put(http + "a.txt", "plain");
+    a.put("s3://bucket/a.txt", "hello");
+
+    std::vector<char> data;
+    std::size_t size(0);
+
+    Status status(a.tryRead("s3://bucket/a.txt", data));
+    EXPECT_TRUE(status.ok());
+    EXPECT_EQ(status.httpCode, 200);
+    EXPECT_EQ(std::string(data.begin(), data.end()), "hello");
+
+    status = a.tryReadSize("s3://bucket/a.txt", size);
+    EXPECT_TRUE(status.ok());
+    EXPECT_EQ(size, 5u);
+
+    status = a.tryRead(http + "a.txt", data);
+    EXPECT_TRUE(status.ok());
+    EXPECT_EQ(std::string(data.begin(), data.end()), "plain");
+
+    status = a.tryRead("s3://bucket/missing", data);
+    EXPECT_EQ(status.code, Status::Code::NotFound);
+    EXPECT_EQ(status.httpCode, 404);
+
+    status = a.tryReadSize(http + "missing", size);
+    EXPECT_EQ(status.code, Status::Code::NotFound);
+    EXPECT_EQ(status.httpCode, 404);
+    EXPECT_EQ(size, 5u);
+
+    status = a.tryRead("nope://a.txt", data);
+    EXPECT_EQ(status.code, Status::Code::Failed);
+    EXPECT_EQ(status.httpCode, 0);
+
+    // Refusals for rate are told apart from misses.
+    MockServer::Options options;
+    options.errorRate = 1;
+    server.options(options);
+
+    status = a.tryRead("s3://bucket/a.txt", data);
+    EXPECT_EQ(status.code, Status::Code::Throttled);
+    EXPECT_EQ(status.httpCode, 503);
+
+    status = a.tryReadSize("s3://bucket/a.txt", size);
+    EXPECT_EQ(status.code, Status::Code::Throttled);
+
+    Endpoint ep(a.getEndpoint(http));
+    EXPECT_EQ(ep.tryRead("a.txt", data).code, Status::Code::Throttled);
+
+    server.options(MockServer::Options());
+    EXPECT_TRUE(ep.tryRead("a.txt", data).ok());
+    EXPECT_EQ(std::string(data.begin(), data.end()), "plain");
+}
+
+TEST(Arbiter, SlowRequests)
+{
+    MockServer::Options options;
+    options.latency = std::chrono::milliseconds(30);
+    MockServer server(options);
+
+    Arbiter a(json {
+        { "http", { { "slowLog", { { "threshold", 20 } } } } }
+    }.dump());
+
+    std::mutex mutex;
+    std::vector<SlowRequest> reports;
+    ASSERT_TRUE(a.httpPool().slowLog());
+    a.httpPool().slowLog()->setCallback([&](const SlowRequest& req)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reports.push_back(req);
+    });
+
+    const std::string http(server.httpRoot());
+    a.put(http + "a.txt", "hello");
+    EXPECT_EQ(a.get(http + "a.txt"), "hello");
+
+    ASSERT_EQ(reports.size(), 2u);
+    EXPECT_EQ(reports[0].operation, "PUT");
+    EXPECT_EQ(reports[1].source, "http");
+    EXPECT_EQ(reports[1].operation, "GET");
+    EXPECT_EQ(reports[1].code, 200);
+    EXPECT_EQ(reports[1].host, "127.0.0.1:" + std::to_string(server.port()));
+    EXPECT_EQ(reports[1].bytes, 5u);
+    EXPECT_GE(reports[1].elapsed, std::chrono::milliseconds(20));
+    EXPECT_GE(reports[1].transfer.total, std::chrono::milliseconds(20));
+}
+
+TEST(Arbiter, HttpProgress)
 {
+    MockServer server;
     Arbiter a;
-    EXPECT_TRUE(a.isHttpDerived("http://arbitercpp.com"));
-    EXPECT_FALSE(a.isHttpDerived("~/data"));
-    EXPECT_FALSE(a.isHttpDerived("."));
+
+    const std::string http(server.httpRoot());
+    a.put(http + "big", std::vector<char>(1024 * 1024, 'x'));
+
+    // Bytes received over HTTP are counted by the transfer, once.
+    Progress progress;
+    {
+        ProgressScope scope(progress);
+        a.copy(http + "big", "mem://http-progress/big");
+    }
+
+    const ProgressReport r(progress.report());
+    EXPECT_EQ(r.files, 1u);
+    EXPECT_EQ(r.totalFiles, 1u);
+    EXPECT_EQ(r.bytes, 1024u * 1024u);
+    EXPECT_GT(r.throughput, 0);
 }
 
-TEST(Arbiter, Time)
+#ifdef ARBITER_ZLIB
+TEST(Arbiter, DeferredDecoding)
 {
-    Time a;
-    Time b(a.str());
+    MockServer server;
+    Arbiter a(json { { "computeThreads", 2 } }.dump());
+    EXPECT_EQ(a.compute().size(), 2u);
 
-    EXPECT_EQ(a.str(), b.str());
-    EXPECT_EQ(a - b, 0);
+    const std::string text(100000, 'z');
+    a.put("gz+mem://deferred/a", text);
+    const std::vector<char> gz(a.getBinary("mem://deferred/a"));
 
-    Time x("2016-03-18T03:14:42Z");
-    Time y("2016-03-18T04:24:54Z");
-    const int64_t delta(1 * 60 * 60 + 10 * 60 + 12);
+    const std::string http(server.httpRoot());
+    a.put(http + "a", gz, { { "Content-Encoding", "gzip" } });
 
-    EXPECT_EQ(y - x, delta);
-    EXPECT_EQ(x - y, -delta);
+    // Buffered bodies are decoded after their transfers, on the compute
+    // pool for asynchronous reads.
+    EXPECT_EQ(a.get(http + "a"), text);
+    EXPECT_EQ(a.getAsync(http + "a").get(), text);
 
-    Time epoch("1970-01-01T00:00:00Z");
-    EXPECT_EQ(epoch.asUnix(), 0);
+    std::vector<std::future<std::string>> reads;
+    for (int i(0); i < 8; ++i) reads.push_back(a.getAsync(http + "a"));
+    for (auto& f : reads) EXPECT_EQ(f.get(), text);
 
-    // Issue 23.
+    // Streamed bodies are still decoded as they arrive.
+    a.copy(http + "a", "mem://deferred/b");
+    EXPECT_EQ(a.get("mem://deferred/b"), text);
+
+    // A truncated body fails when it is decoded.
+    a.put(
+            http + "truncated",
+            std::vector<char>(gz.begin(), gz.begin() + gz.size() / 2),
+            { { "Content-Encoding", "gzip" } });
+    EXPECT_THROW(a.get(http + "truncated"), ArbiterError);
+    EXPECT_THROW(a.getAsync(http + "truncated").get(), ArbiterError);
+}
+
+// Send @p request to the sidecar at @p socket, returning all of its reply,
+// which ends when it closes the connection after finding no more requests.
+std::string sidecarExchange(
+        const std::string& socket,
+        const std::string& request)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, socket.c_str());
+
+    const int fd(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)))
     {
-        Time t("2019-01-03T17:39:11Z");
-        EXPECT_EQ(t.asUnix() - 1546537151, 0);
+        ::close(fd);
+        return "";
+    }
+
+    // The server may hang up before it has read everything.
+    for (std::size_t sent(0); sent < request.size(); )
+    {
+        const ssize_t n(
+                ::send(
+                    fd,
+                    request.data() + sent,
+                    request.size() - sent,
+                    MSG_NOSIGNAL));
+        if (n <= 0) break;
+        sent += n;
+    }
+    ::shutdown(fd, SHUT_WR);
+
+    std::string reply;
+    char buffer[4096];
+    ssize_t n(0);
+    while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+    {
+        reply.append(buffer, n);
     }
+    ::close(fd);
+    return reply;
 }
 
-TEST(Arbiter, Base64)
+TEST(Arbiter, Sidecar)
 {
-    EXPECT_EQ(crypto::encodeBase64(""), "");
-    EXPECT_EQ(crypto::encodeBase64("f"), "Zg==");
-    EXPECT_EQ(crypto::encodeBase64("fo"), "Zm8=");
-    EXPECT_EQ(crypto::encodeBase64("foo"), "Zm9v");
-    EXPECT_EQ(crypto::encodeBase64("foob"), "Zm9vYg==");
-    EXPECT_EQ(crypto::encodeBase64("fooba"), "Zm9vYmE=");
-    EXPECT_EQ(crypto::encodeBase64("foobar"), "Zm9vYmFy");
+    const Arbiter daemon;
+    const std::string socket(getTempPath() + "arbiter-sidecar.sock");
+    SidecarServer server(daemon, socket);
+
+    const Arbiter a(json {
+        { "sidecar", { { "socket", socket }, { "types", { "mem" } } } }
+    }.dump());
+
+    // Remote paths of the forwarded types live in the daemon.
+    a.put("mem://side/a b.txt", "hello sidecar");
+    EXPECT_EQ(daemon.get("mem://side/a b.txt"), "hello sidecar");
+    EXPECT_EQ(a.get("mem://side/a b.txt"), "hello sidecar");
+    EXPECT_EQ(*a.tryGetSize("mem://side/a b.txt"), 13u);
+
+    const std::vector<char> range(a.getRange("mem://side/a b.txt", 6, 7));
+    EXPECT_EQ(std::string(range.begin(), range.end()), "sidecar");
+
+    // Ranges may be open at either end, and malformed ones are refused.
+    auto ranged([&socket](const std::string& range)
+    {
+        return sidecarExchange(
+                socket,
+                "GET /mem/side/a%20b.txt HTTP/1.1\r\n"
+                "Range: " + range + "\r\n\r\n");
+    });
+    auto status([](const std::string& reply) { return reply.substr(0, 12); });
+    auto body([](const std::string& reply)
+    {
+        return reply.substr(reply.find("\r\n\r\n") + 4);
+    });
+
+    std::string reply(ranged("bytes=6-"));
+    EXPECT_EQ(status(reply), "HTTP/1.1 206");
+    EXPECT_NE(reply.find("Content-Range: bytes 6-12/13"), std::string::npos);
+    EXPECT_EQ(body(reply), "sidecar");
+
+    reply = ranged("bytes=-7");
+    EXPECT_EQ(status(reply), "HTTP/1.1 206");
+    EXPECT_EQ(body(reply), "sidecar");
+    EXPECT_EQ(body(ranged("bytes=-100")), "hello sidecar");
+    EXPECT_EQ(body(ranged("bytes=0-4")), "hello");
+
+    EXPECT_EQ(status(ranged("bytes=13-")), "HTTP/1.1 416");
+    EXPECT_EQ(status(ranged("bytes=-0")), "HTTP/1.1 416");
+    for (const std::string r : { "bytes=5-2", "bytes=-", "bytes=a-", "0-4",
+            "bytes=0-1,3-4", "bytes=99999999999999999999-" })
+    {
+        EXPECT_EQ(status(ranged(r)), "HTTP/1.1 400") << r;
+    }
+
+    // As are requests too large to buffer, or whose bodies can't be found.
+    EXPECT_EQ(
+            status(sidecarExchange(
+                    socket,
+                    "PUT /mem/side/big HTTP/1.1\r\n"
+                    "Content-Length: 10000000000\r\n\r\n")),
+            "HTTP/1.1 413");
+    EXPECT_EQ(
+            status(sidecarExchange(
+                    socket,
+                    "PUT /mem/side/big HTTP/1.1\r\n"
+                    "Content-Length: -1\r\n\r\n")),
+            "HTTP/1.1 400");
+    EXPECT_EQ(
+            status(sidecarExchange(
+                    socket,
+                    "GET /mem/side/a%20b.txt HTTP/1.1\r\n"
+                    "X-Padding: " + std::string(100 * 1024, 'x'))),
+            "HTTP/1.1 431");
+    EXPECT_FALSE(daemon.tryGetSize("mem://side/big"));
+
+    daemon.put("mem://side/sub/c", "c");
+    EXPECT_EQ(
+            a.resolve("mem://side/**"),
+            (std::vector<std::string> {
+                "mem://side/a b.txt",
+                "mem://side/sub/c"
+            }));
+
+    EXPECT_FALSE(a.tryGetBinary("mem://side/missing"));
+    EXPECT_FALSE(a.tryGetSize("mem://side/missing"));
+
+    a.remove("mem://side/sub/c");
+    EXPECT_FALSE(daemon.tryGetSize("mem://side/sub/c"));
+
+    // Other types are our own, and local paths are never served.
+    a.put("test://" + getTempPath() + "arbiter-sidecar.txt", "local");
+    EXPECT_EQ(a.get(getTempPath() + "arbiter-sidecar.txt"), "local");
+    remove(getTempPath() + "arbiter-sidecar.txt");
+    EXPECT_GT(server.requests(), 0u);
+
+    // The socket is only for its owner, and isn't taken from a server which
+    // is running.
+    struct stat st;
+    ASSERT_EQ(::stat(socket.c_str(), &st), 0);
+    EXPECT_EQ(st.st_mode & 0777, 0600u);
+    EXPECT_THROW({ SidecarServer other(daemon, socket); }, ArbiterError);
+    EXPECT_EQ(daemon.get("mem://side/a b.txt"), "hello sidecar");
+
+    // Nor is anything which isn't a socket replaced.
+    const std::string file(getTempPath() + "arbiter-sidecar.file");
+    daemon.put(file, "not a socket");
+    EXPECT_THROW({ SidecarServer other(daemon, file); }, ArbiterError);
+    EXPECT_EQ(daemon.get(file), "not a socket");
+    remove(file);
+
+    // A socket left by a server which is gone is.
+    const std::string stale(getTempPath() + "arbiter-stale.sock");
+    remove(stale);
+    {
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, stale.c_str());
+
+        const int fd(::socket(AF_UNIX, SOCK_STREAM, 0));
+        ASSERT_EQ(::bind(fd, (sockaddr*)&addr, sizeof(addr)), 0);
+        ::close(fd);
+    }
+    {
+        SidecarServer replaced(daemon, stale, 0660);
+        ASSERT_EQ(::stat(stale.c_str(), &st), 0);
+        EXPECT_EQ(st.st_mode & 0777, 0660u);
+    }
+}
+#endif
+
+TEST(Arbiter, Metrics)
+{
+    MockServer server;
+    Arbiter a(json {
+        { "s3", json::parse(server.s3Config()) },
+        { "http", { { "pools", { { "s3", { { "concurrency", 2 } } } } } } },
+        { "blocks", json::object() }
+    }.dump());
+    a.setTracer(std::make_shared<MetricsTracer>());
+
+    a.put("s3://bucket/a.txt", "hello");
+    EXPECT_EQ(a.get("s3://bucket/a.txt"), "hello");
+    EXPECT_FALSE(a.tryGet("s3://bucket/missing"));
+    EXPECT_EQ(a.getRange("s3://bucket/a.txt", 1, 3), std::vector<char>(
+                { 'e', 'l', 'l' }));
+    EXPECT_EQ(a.getRange("s3://bucket/a.txt", 0, 2), std::vector<char>(
+                { 'h', 'e' }));
+
+    const std::string m(a.metrics());
+    auto has([&m](const std::string& line)
+    {
+        return m.find(line + "\n") != std::string::npos;
+    });
+
+    const std::string get(
+            "{driver=\"s3\",operation=\"get\",host=\"bucket\"");
+    EXPECT_TRUE(has("# TYPE arbiter_operations counter"));
+    EXPECT_TRUE(has("arbiter_operations_total" + get + "} 1"));
+    EXPECT_TRUE(has("arbiter_operation_bytes_total" + get + "} 5"));
+    EXPECT_TRUE(has("arbiter_operation_seconds_count" + get + "} 1"));
+    EXPECT_TRUE(has("arbiter_operation_seconds_bucket" +
+                get + ",le=\"+Inf\"} 1"));
+
+    EXPECT_TRUE(has("arbiter_http_requests_total{pool=\"s3\",code=\"404\"} 1"));
+    EXPECT_TRUE(has("arbiter_http_concurrency{pool=\"s3\"} 2"));
+    EXPECT_TRUE(has("arbiter_http_in_flight{pool=\"default\"} 0"));
+    EXPECT_TRUE(has("arbiter_block_cache_hits_total 1"));
+    EXPECT_TRUE(has("arbiter_block_cache_misses_total 1"));
+    EXPECT_EQ(m.substr(m.size() - 6), "# EOF\n");
 }
+#endif
 
 class DriverTest : public ::testing::TestWithParam<std::string> { };
 
@@ -80,6 +4968,77 @@ TEST_P(DriverTest, PutGet)
     EXPECT_EQ(a.get(path), data);
 }
 
+TEST_P(DriverTest, GetInto)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    const std::string path(root + "into.txt");
+    const std::string data("0123456789");
+
+    if (a.isLocal(root)) mkdirp(root);
+
+    EXPECT_NO_THROW(a.put(path, data));
+
+    std::vector<char> buffer(data.size());
+    EXPECT_EQ(a.getInto(path, buffer.data(), buffer.size()), data.size());
+    EXPECT_EQ(std::string(buffer.begin(), buffer.end()), data);
+
+    EXPECT_THROW(a.getInto(path, buffer.data(), data.size() - 1), ArbiterError);
+}
+
+TEST_P(DriverTest, Sizes)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    if (a.isLocal(root)) mkdirp(root);
+
+    EXPECT_NO_THROW(a.put(root + "size-a.txt", "a"));
+    EXPECT_NO_THROW(a.put(root + "size-b.txt", "bbb"));
+
+    const Driver& driver(a.getDriver(root));
+    const std::string stripped(Arbiter::stripType(root));
+    const auto sizes(driver.tryGetSizes({
+        stripped + "size-a.txt",
+        stripped + "size-missing.txt",
+        stripped + "size-b.txt"
+    }));
+
+    ASSERT_EQ(sizes.size(), 3u);
+    ASSERT_TRUE(sizes[0].get());
+    EXPECT_EQ(*sizes[0], 1u);
+    EXPECT_FALSE(sizes[1].get());
+    ASSERT_TRUE(sizes[2].get());
+    EXPECT_EQ(*sizes[2], 3u);
+}
+
+TEST_P(DriverTest, GetRange)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    const std::string path(root + "get-range.txt");
+    const std::string data("0123456789");
+
+    if (a.isLocal(root)) mkdirp(root);
+
+    EXPECT_NO_THROW(a.put(path, data));
+
+    auto range([&](std::size_t offset, std::size_t length)
+    {
+        const std::vector<char> v(a.getRange(path, offset, length));
+        return std::string(v.begin(), v.end());
+    });
+
+    EXPECT_EQ(range(2, 6), "234567");
+    EXPECT_EQ(range(0, 10), data);
+    EXPECT_EQ(range(8, 100), "89");
+    EXPECT_EQ(range(10, 5), "");
+    EXPECT_EQ(range(3, 0), "");
+    EXPECT_THROW(a.getRange(root + "nonexistent.txt", 0, 1), ArbiterError);
+}
+
 TEST_P(DriverTest, HttpRange)
 {
     Arbiter a;
@@ -146,6 +5105,14 @@ TEST_P(DriverTest, Glob)
         const auto got(resolve(p));
         EXPECT_GE(got.size(), exp.size());
 
+        // The streaming version should yield the same results.
+        Paths streamed;
+        a.resolve(root + p, [&streamed](std::string s)
+        {
+            streamed.insert(s);
+        });
+        EXPECT_EQ(streamed, got) << p;
+
         for (const auto& s : exp)
         {
             EXPECT_TRUE(got.count(root + s)) << p << ": " << root << s;
@@ -179,13 +5146,14 @@ TEST_P(DriverTest, Glob)
     check("asdf.txt", Paths { "asdf.txt" });
 }
 
+// The memory driver is always tested, along with any configured paths.
 const auto tests = std::accumulate(
         Config::get().begin(),
         Config::get().end(),
-        std::vector<std::string>(),
+        std::vector<std::string> { "mem://driver-test/" },
         [](const std::vector<std::string>& in, const json& entry)
         {
-            if (in.empty())
+            if (in.size() == 1)
             {
                 std::cout << "Testing PUT/GET/LS with:" << std::endl;
             }